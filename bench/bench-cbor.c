@@ -0,0 +1,190 @@
+/*
+ * Decode benchmark: the same synthetic post records as DAG-CBOR (with
+ * `bsky_parse_cbor' and `bsky_cbor_skip') and as JSON (with
+ * `bsky_parse_json'). Canonical re-encoding of decoded records
+ * (`bsky_sb_push_cbor') is measured too.
+ *
+ * Usage:
+ *      ./bench-cbor [-n records] [-r rounds]
+ *
+ * Reports records per second and megabytes per second for every decoder.
+ */
+#define BSKY_API_IMPLEMENTATION
+#include "../bsky-api.h"
+
+#include <stdio.h>
+
+static int records = 10000, rounds = 50;
+
+static void cbor_text(struct bsky_str_builder *sb, char *s)
+{
+    bsky_cbor_push_str(sb, bsky_mk_str(s));
+}
+
+static void cbor_link(struct bsky_str_builder *sb, unsigned char *cid)
+{
+    bsky_cbor_push_link(sb, (struct bsky_view) { cid, cid + 36 });
+}
+
+// Post with reply refs, language and image embed, similar to commit ops
+// seen on the firehose.
+static void make_record(int i, struct bsky_str_builder *cbor,
+                        struct bsky_str_builder *json)
+{
+    char text[128], created[32], uri[96];
+    unsigned char cid[36] = { 0x01, 0x71, 0x12, 0x20 };
+
+    snprintf(text, sizeof (text), "post number %d, just setting up my "
+             "firehose consumer and checking how fast it goes", i);
+    snprintf(created, sizeof (created), "2024-05-%02dT12:%02d:%02d.000Z",
+             1 + i % 28, i / 60 % 60, i % 60);
+    snprintf(uri, sizeof (uri), "at://did:plc:%024d/app.bsky.feed.post/"
+             "3k%011d", i, i);
+    for (int j = 4; j < 36; ++j) cid[j] = i * 31 + j;
+
+    // keys in canonical order: length first, then bytewise.
+    bsky_cbor_push_map(cbor, 6);
+    cbor_text(cbor, "text");  cbor_text(cbor, text);
+    cbor_text(cbor, "$type"); cbor_text(cbor, "app.bsky.feed.post");
+    cbor_text(cbor, "embed");
+    bsky_cbor_push_map(cbor, 2);
+        cbor_text(cbor, "$type"); cbor_text(cbor, "app.bsky.embed.images");
+        cbor_text(cbor, "images");
+        bsky_cbor_push_arr(cbor, 1);
+        bsky_cbor_push_map(cbor, 2);
+            cbor_text(cbor, "alt");   cbor_text(cbor, "a picture");
+            cbor_text(cbor, "image");
+            bsky_cbor_push_map(cbor, 4);
+                cbor_text(cbor, "ref");   cbor_link(cbor, cid);
+                cbor_text(cbor, "size");  bsky_cbor_push_int(cbor, 100000 + i);
+                cbor_text(cbor, "$type"); cbor_text(cbor, "blob");
+                cbor_text(cbor, "mimeType"); cbor_text(cbor, "image/jpeg");
+    cbor_text(cbor, "langs");
+    bsky_cbor_push_arr(cbor, 1); cbor_text(cbor, "en");
+    cbor_text(cbor, "reply");
+    bsky_cbor_push_map(cbor, 2);
+        cbor_text(cbor, "root");
+        bsky_cbor_push_map(cbor, 2);
+            cbor_text(cbor, "cid"); cbor_link(cbor, cid);
+            cbor_text(cbor, "uri"); cbor_text(cbor, uri);
+        cbor_text(cbor, "parent");
+        bsky_cbor_push_map(cbor, 2);
+            cbor_text(cbor, "cid"); cbor_link(cbor, cid);
+            cbor_text(cbor, "uri"); cbor_text(cbor, uri);
+    cbor_text(cbor, "createdAt"); cbor_text(cbor, created);
+
+    // JSON form of the same record; links are `{"$link": "b..."}'.
+    char *link = bsky_tmp_blob_cid(cid + 4).start;
+    char  buf[1024];
+    int   len = snprintf(buf, sizeof (buf),
+        "{\"text\":\"%s\",\"$type\":\"app.bsky.feed.post\","
+        "\"embed\":{\"$type\":\"app.bsky.embed.images\",\"images\":[{"
+        "\"alt\":\"a picture\",\"image\":{\"ref\":{\"$link\":\"%s\"},"
+        "\"size\":%d,\"$type\":\"blob\",\"mimeType\":\"image/jpeg\"}}]},"
+        "\"langs\":[\"en\"],\"reply\":{"
+        "\"root\":{\"cid\":{\"$link\":\"%s\"},\"uri\":\"%s\"},"
+        "\"parent\":{\"cid\":{\"$link\":\"%s\"},\"uri\":\"%s\"}},"
+        "\"createdAt\":\"%s\"}",
+        text, link, 100000 + i, link, uri, link, uri, created);
+
+    __bsky_da_append(json, buf, 1, len + 1);
+    bsky_default_tmp_reset();
+}
+
+static void report(const char *name, uint64_t ns, size_t bytes)
+{
+    double s = ns / 1e9;
+
+    printf("%-12s %10.0f records/s %9.1f MB/s\n", name,
+           (double) records * rounds / s, bytes * (double) rounds / s / 1e6);
+}
+
+int main(int argc, char **argv)
+{
+    struct bsky_str_builder cbor = { 0 }, json = { 0 };
+    size_t *cbor_off, *json_off;
+    enum bsky_error_code ec;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:r:")) != -1) {
+        if (opt == 'n') records = atoi(optarg);
+        else if (opt == 'r') rounds = atoi(optarg);
+        else {
+            fprintf(stderr, "usage: %s [-n records] [-r rounds]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    cbor_off = calloc(records + 1, sizeof (size_t));
+    json_off = calloc(records + 1, sizeof (size_t));
+
+    for (int i = 0; i < records; ++i) {
+        make_record(i, &cbor, &json);
+        cbor_off[i + 1] = cbor.len;
+        json_off[i + 1] = json.len;
+    }
+
+    printf("%d records: %zu bytes of DAG-CBOR, %zu bytes of JSON\n",
+           records, cbor.len, json.len);
+
+    uint64_t start = __bsky_now_ns();
+    for (int r = 0; r < rounds; ++r) {
+        for (int i = 0; i < records; ++i) {
+            struct bsky_view view = { cbor.data + cbor_off[i],
+                                      cbor.data + cbor_off[i + 1] };
+
+            bsky_parse_cbor(&view, &ec);
+            if (ec != bsky_ec_Ok) return 1;
+            bsky_default_tmp_reset();
+        }
+    }
+    report("cbor-tree", __bsky_now_ns() - start, cbor.len);
+
+    start = __bsky_now_ns();
+    for (int r = 0; r < rounds; ++r) {
+        for (int i = 0; i < records; ++i) {
+            struct bsky_view view = { cbor.data + cbor_off[i],
+                                      cbor.data + cbor_off[i + 1] };
+
+            if (bsky_cbor_skip(&view) != bsky_ec_Ok) return 1;
+        }
+    }
+    report("cbor-skip", __bsky_now_ns() - start, cbor.len);
+
+    struct bsky_str_builder out = { 0 };
+
+    start = __bsky_now_ns();
+    for (int r = 0; r < rounds; ++r) {
+        for (int i = 0; i < records; ++i) {
+            struct bsky_view view = { cbor.data + cbor_off[i],
+                                      cbor.data + cbor_off[i + 1] };
+            struct bsky_cbor tree = bsky_parse_cbor(&view, &ec);
+
+            out.len = 0;
+            if (bsky_sb_push_cbor(&out, tree) != bsky_ec_Ok) return 1;
+            bsky_default_tmp_reset();
+        }
+    }
+    report("cbor-encode", __bsky_now_ns() - start, cbor.len);
+    bsky_da_free(&out);
+
+    start = __bsky_now_ns();
+    for (int r = 0; r < rounds; ++r) {
+        for (int i = 0; i < records; ++i) {
+            struct bsky_str str = { json.data + json_off[i],
+                                    json.data + json_off[i + 1] - 1 };
+
+            bsky_parse_json(&str, &ec);
+            if (ec != bsky_ec_Ok) return 1;
+            bsky_default_tmp_reset();
+        }
+    }
+    report("json-tree", __bsky_now_ns() - start, json.len);
+
+    bsky_da_free(&cbor);
+    bsky_da_free(&json);
+    free(cbor_off);
+    free(json_off);
+
+    return 0;
+}
@@ -0,0 +1,127 @@
+/*
+ * Firehose pipeline benchmark on synthetic `#commit' frames.
+ *
+ * Usage:
+ *      ./bench-firehose [-n frames] [-r repos] [-s max_shards]
+ *
+ * Frames are pushed from one thread as fast as pipeline accepts them,
+ * handler hashes `blocks' of every event to emulate record processing.
+ * For every number of shards reports events per second, how often reader
+ * waited for full ring and maximum queue depths.
+ */
+#define BSKY_API_IMPLEMENTATION
+#include "../bsky-api.h"
+
+#include <stdio.h>
+
+static int frames = 200000, repos = 1000, max_shards = 0;
+
+static void on_event(void *user, struct bsky_firehose_event *ev)
+{
+    unsigned char digest[32];
+
+    (void) user;
+    bsky_sha256(ev->blocks.start,
+                (char*) ev->blocks.end - (char*) ev->blocks.start, digest);
+}
+
+static void build_frame(struct bsky_str_builder *sb, int64_t seq)
+{
+    static unsigned char block[1024];
+    unsigned char cid[36] = { 0x01, 0x71, 0x12, 0x20 };
+    char repo[64];
+
+    snprintf(repo, sizeof (repo), "did:plc:%024d", (int) (seq % repos));
+
+    bsky_cbor_push_map(sb, 2);
+    bsky_cbor_push_str(sb, bsky_mk_str("t"));
+    bsky_cbor_push_str(sb, bsky_mk_str("#commit"));
+    bsky_cbor_push_str(sb, bsky_mk_str("op"));
+    bsky_cbor_push_int(sb, 1);
+
+    bsky_cbor_push_map(sb, 5);
+    bsky_cbor_push_str(sb, bsky_mk_str("ops"));
+    bsky_cbor_push_arr(sb, 2);
+    for (int i = 0; i < 2; ++i) {
+        bsky_cbor_push_map(sb, 3);
+        bsky_cbor_push_str(sb, bsky_mk_str("cid"));
+        bsky_cbor_push_link(sb, (struct bsky_view) { cid, cid + 36 });
+        bsky_cbor_push_str(sb, bsky_mk_str("path"));
+        bsky_cbor_push_str(sb, bsky_mk_str("app.bsky.feed.like/3kxyzabc"));
+        bsky_cbor_push_str(sb, bsky_mk_str("action"));
+        bsky_cbor_push_str(sb, bsky_mk_str("create"));
+    }
+    bsky_cbor_push_str(sb, bsky_mk_str("rev"));
+    bsky_cbor_push_str(sb, bsky_mk_str("3kxyzabcdefgh"));
+    bsky_cbor_push_str(sb, bsky_mk_str("seq"));
+    bsky_cbor_push_int(sb, seq);
+    bsky_cbor_push_str(sb, bsky_mk_str("repo"));
+    bsky_cbor_push_str(sb, bsky_mk_str(repo));
+    bsky_cbor_push_str(sb, bsky_mk_str("blocks"));
+    bsky_cbor_push_bytes(sb, (struct bsky_view) { block, block + 1024 });
+}
+
+int main(int argc, char **argv)
+{
+    struct { struct bsky_str_builder *data; size_t len, cap; } input = { 0 };
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:r:s:")) != -1) {
+        if (opt == 'n') frames = atoi(optarg);
+        else if (opt == 'r') repos = atoi(optarg);
+        else if (opt == 's') max_shards = atoi(optarg);
+    }
+    if (max_shards == 0) max_shards = cpus > 1 ? cpus / 2 : 1;
+
+    // a small set of frames is reused, so input fits in cache.
+    for (int i = 0; i < 4096; ++i) {
+        struct bsky_str_builder sb = { 0 };
+
+        build_frame(&sb, i);
+        bsky_da_push(&input, sb);
+    }
+
+    printf("firehose: %d frames, %d repos, %ld cpus\n", frames, repos, cpus);
+
+    for (int shards = 1; shards <= max_shards; shards *= 2) {
+        struct bsky_firehose pipe;
+        struct bsky_firehose_config config = {
+            .shards = shards, .handler = on_event,
+        };
+        struct bsky_firehose_metrics metrics[64];
+        size_t decode_max = 0, handle_max = 0;
+        uint64_t stalls = 0;
+
+        bsky_firehose_start(&pipe, &config);
+
+        uint64_t start = __bsky_now_ns();
+        for (int i = 0; i < frames; ++i) {
+            struct bsky_str_builder *sb = &input.data[i % input.len];
+
+            bsky_firehose_push(&pipe,
+                (struct bsky_view) { sb->data, sb->data + sb->len });
+        }
+
+        size_t len = bsky_firehose_metrics(&pipe, metrics, 64);
+        for (size_t i = 0; i < len && i < 64; ++i) {
+            stalls    += metrics[i].stalls;
+            decode_max = metrics[i].decode_max > decode_max
+                       ? metrics[i].decode_max : decode_max;
+            handle_max = metrics[i].handle_max > handle_max
+                       ? metrics[i].handle_max : handle_max;
+        }
+
+        bsky_firehose_stop(&pipe);
+        double s = (__bsky_now_ns() - start) / 1e9;
+
+        printf("  shards %2d %10.0f events/s  stalls %8llu  "
+               "max depth decode %4zu handle %4zu\n", shards, frames / s,
+               (unsigned long long) stalls, decode_max, handle_max);
+    }
+
+    for (size_t i = 0; i < input.len; ++i) bsky_da_free(&input.data[i]);
+    bsky_da_free(&input);
+
+    return 0;
+}
@@ -0,0 +1,140 @@
+/*
+ * Jetstream replay benchmark.
+ *
+ * Usage:
+ *      ./bench-jetstream [-t milliseconds] [capture.jsonl]
+ *
+ * Replays events from capture (one JSON event per line, as saved from
+ * Jetstream with `websocat ws://.../subscribe > capture.jsonl') or from
+ * generated events, and reports events per second of consumer with JSON
+ * cursor (`bsky_jetstream_feed') and of full `bsky_parse_json' tree.
+ */
+#define BSKY_API_IMPLEMENTATION
+#include "../bsky-api.h"
+
+#include <stdio.h>
+
+static int millis = 500;
+
+struct lines { struct bsky_str *data; size_t len, cap; };
+
+static void generate(struct bsky_str_builder *text)
+{
+    static const char *collections[] = {
+        "app.bsky.feed.like", "app.bsky.feed.post", "app.bsky.graph.follow",
+        "app.bsky.feed.repost",
+    };
+    char line[1024];
+
+    for (int i = 0; i < 10000; ++i) {
+        int len = snprintf(line, sizeof (line),
+            "{\"did\":\"did:plc:%024d\",\"time_us\":%lld,\"kind\":\"commit\","
+            "\"commit\":{\"rev\":\"3l3qo2vutsw2b\",\"operation\":\"create\","
+            "\"collection\":\"%s\",\"rkey\":\"3l3qo2vuowo2b\",\"record\":{"
+            "\"$type\":\"%s\",\"text\":\"event number %d with some text\","
+            "\"langs\":[\"en\"],\"createdAt\":\"2024-09-09T19:46:02.102Z\"},"
+            "\"cid\":\"bafyreidwaivazkwu67xztlmuobx35hs2lnfh3kolmgfmucldvhd3"
+            "sgzcqi\"}}\n", i % 5000, 1725911162329308ll + i,
+            collections[i % 4], collections[i % 4], i);
+
+        __bsky_da_append(text, line, 1, len);
+    }
+}
+
+static void split(struct lines *lines, struct bsky_str_builder *text)
+{
+    char *p = text->data, *end = text->data + text->len;
+
+    while (p < end) {
+        char *nl = memchr(p, '\n', end - p);
+        if (nl == NULL) nl = end;
+
+        // NUL for full parser.
+        *nl = '\0';
+        if (nl > p) {
+            struct bsky_str line = { p, nl };
+            bsky_da_push(lines, line);
+        }
+        p = nl + 1;
+    }
+}
+
+static void on_commit(void *user, const struct bsky_jetstream_commit *commit)
+{
+    *(size_t*) user += commit->collection.end - commit->collection.start;
+}
+
+int main(int argc, char **argv)
+{
+    struct bsky_str_builder text  = { 0 };
+    struct lines            lines = { 0 };
+    size_t sink = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "t:")) != -1) {
+        if (opt == 't') millis = atoi(optarg);
+    }
+
+    if (optind < argc) {
+        FILE *file = fopen(argv[optind], "r");
+        char  buf[0x10000];
+        size_t n;
+
+        if (file == NULL) {
+            perror(argv[optind]);
+            return 1;
+        }
+        while ((n = fread(buf, 1, sizeof (buf), file)) > 0)
+            __bsky_da_append(&text, buf, 1, n);
+        fclose(file);
+    } else {
+        generate(&text);
+    }
+    split(&lines, &text);
+
+    printf("jetstream: %zu events, %.1f MB\n", lines.len, text.len / 1e6);
+
+    struct bsky_jetstream js = { .on_commit = on_commit, .user = &sink };
+    uint64_t start = __bsky_now_ns(), end, events = 0;
+
+    do {
+        for (size_t i = 0; i < lines.len; ++i) {
+            bsky_jetstream_feed(&js, (struct bsky_view) {
+                lines.data[i].start, lines.data[i].end
+            }, 0);
+        }
+        events += lines.len;
+        end = __bsky_now_ns();
+    } while (end - start < (uint64_t) millis * 1000000);
+
+    printf("  cursor %12.0f events/s %8.1f MB/s\n",
+           events / ((end - start) / 1e9),
+           events * (text.len / (double) lines.len) / ((end - start) / 1e3));
+
+    start  = __bsky_now_ns();
+    events = 0;
+    do {
+        for (size_t i = 0; i < lines.len; ++i) {
+            enum bsky_error_code ec;
+            struct bsky_str str = lines.data[i];
+            struct bsky_json json = bsky_parse_json(&str, &ec);
+            struct bsky_json *commit = bsky_json_get(&json, "commit");
+
+            if (commit && bsky_json_get(commit, "collection"))
+                sink++;
+            bsky_default_tmp_reset();
+        }
+        events += lines.len;
+        end = __bsky_now_ns();
+    } while (end - start < (uint64_t) millis * 1000000);
+
+    printf("  tree   %12.0f events/s %8.1f MB/s\n",
+           events / ((end - start) / 1e9),
+           events * (text.len / (double) lines.len) / ((end - start) / 1e3));
+
+    bsky_jetstream_free(&js);
+    bsky_da_free(&lines);
+    bsky_da_free(&text);
+
+    return sink == 0;
+}
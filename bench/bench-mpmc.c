@@ -0,0 +1,192 @@
+/*
+ * Contention benchmark of MPMC queue against mutex and condition variable.
+ *
+ * Usage:
+ *      ./bench-mpmc [-n items] [-c cap] [-t max_threads] [-b batch]
+ *
+ * For 1, 2, 4 ... `max_threads' (online CPUs by default) producers and
+ * as many consumers moves `items' pointers through queue of capacity
+ * `cap' with blocking push and pop, then with batches of `batch' items.
+ * Reports items per second of every variant.
+ */
+#define BSKY_API_IMPLEMENTATION
+#include "../bsky-api.h"
+
+#include <stdio.h>
+
+static int items = 2000000, cap = 1024, max_threads = 0, batch = 32;
+
+// baseline: ring under one lock.
+struct locked {
+    pthread_mutex_t lock;
+    pthread_cond_t  not_empty, not_full;
+    void  **data;
+    size_t  head, len, cap;
+    int     closed;
+};
+
+static void locked_push(struct locked *q, void *item)
+{
+    pthread_mutex_lock(&q->lock);
+    while (q->len == q->cap) pthread_cond_wait(&q->not_full, &q->lock);
+    q->data[(q->head + q->len++) % q->cap] = item;
+    pthread_cond_signal(&q->not_empty);
+    pthread_mutex_unlock(&q->lock);
+}
+
+static void *locked_pop(struct locked *q)
+{
+    void *item = NULL;
+
+    pthread_mutex_lock(&q->lock);
+    while (q->len == 0 && !q->closed)
+        pthread_cond_wait(&q->not_empty, &q->lock);
+    if (q->len) {
+        item = q->data[q->head];
+        q->head = (q->head + 1) % q->cap;
+        q->len--;
+        pthread_cond_signal(&q->not_full);
+    }
+    pthread_mutex_unlock(&q->lock);
+
+    return item;
+}
+
+enum variant { Locked, Mpmc, Mpmc_batch };
+
+struct run {
+    enum variant     variant;
+    struct locked    locked;
+    struct bsky_mpmc mpmc;
+    int              per_producer;
+    _Atomic uint64_t sum;
+};
+
+static void *produce(void *arg)
+{
+    struct run *r = arg;
+    void *buf[256];
+
+    for (int i = 1; i <= r->per_producer; ) {
+        if (r->variant == Locked) {
+            locked_push(&r->locked, (void*) (uintptr_t) i++);
+        } else if (r->variant == Mpmc) {
+            bsky_mpmc_push_wait(&r->mpmc, (void*) (uintptr_t) i++);
+        } else {
+            size_t n = 0, pushed = 0;
+
+            while (n < (size_t) batch && i <= r->per_producer)
+                buf[n++] = (void*) (uintptr_t) i++;
+            while (pushed < n) {
+                size_t k = bsky_mpmc_push_n(&r->mpmc, buf + pushed,
+                                            n - pushed);
+                if (k == 0) {
+                    bsky_mpmc_push_wait(&r->mpmc, buf[pushed]);
+                    k = 1;
+                }
+                pushed += k;
+            }
+        }
+    }
+
+    return NULL;
+}
+
+static void *consume(void *arg)
+{
+    struct run *r = arg;
+    uint64_t sum = 0;
+    void *buf[256], *item;
+
+    if (r->variant == Locked) {
+        while ((item = locked_pop(&r->locked)) != NULL)
+            sum += (uintptr_t) item;
+    } else if (r->variant == Mpmc) {
+        while ((item = bsky_mpmc_pop_wait(&r->mpmc)) != NULL)
+            sum += (uintptr_t) item;
+    } else {
+        for (;;) {
+            size_t n = bsky_mpmc_pop_n(&r->mpmc, buf, batch);
+
+            for (size_t i = 0; i < n; ++i) sum += (uintptr_t) buf[i];
+            if (n) continue;
+
+            // sleep until something comes.
+            if ((item = bsky_mpmc_pop_wait(&r->mpmc)) == NULL) break;
+            sum += (uintptr_t) item;
+        }
+    }
+
+    atomic_fetch_add(&r->sum, sum);
+
+    return NULL;
+}
+
+static void run(enum variant variant, int threads)
+{
+    static const char *names[] = { "mutex", "mpmc", "mpmc batch" };
+    struct run r = { .variant = variant, .per_producer = items / threads };
+    pthread_t *producers = calloc(threads, sizeof (pthread_t));
+    pthread_t *consumers = calloc(threads, sizeof (pthread_t));
+    uint64_t n = (uint64_t) r.per_producer * threads;
+
+    pthread_mutex_init(&r.locked.lock, NULL);
+    pthread_cond_init(&r.locked.not_empty, NULL);
+    pthread_cond_init(&r.locked.not_full, NULL);
+    r.locked.data = malloc(cap * sizeof (void*));
+    r.locked.cap  = cap;
+    bsky_mpmc_init(&r.mpmc, cap);
+
+    uint64_t start = __bsky_now_ns();
+
+    for (int i = 0; i < threads; ++i) {
+        pthread_create(&consumers[i], NULL, consume, &r);
+        pthread_create(&producers[i], NULL, produce, &r);
+    }
+    for (int i = 0; i < threads; ++i) pthread_join(producers[i], NULL);
+
+    pthread_mutex_lock(&r.locked.lock);
+    r.locked.closed = 1;
+    pthread_cond_broadcast(&r.locked.not_empty);
+    pthread_mutex_unlock(&r.locked.lock);
+    bsky_mpmc_close(&r.mpmc);
+
+    for (int i = 0; i < threads; ++i) pthread_join(consumers[i], NULL);
+
+    double secs = (__bsky_now_ns() - start) / 1e9;
+    uint64_t expected = (uint64_t) r.per_producer * (r.per_producer + 1) / 2
+                      * threads;
+
+    printf("  %-10s %2d+%-2d threads %12.0f items/s %s\n", names[variant],
+           threads, threads, n / secs,
+           atomic_load(&r.sum) == expected ? "" : "  LOST ITEMS");
+
+    bsky_mpmc_free(&r.mpmc);
+    free(r.locked.data);
+    free(producers);
+    free(consumers);
+}
+
+int main(int argc, char **argv)
+{
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:c:t:b:")) != -1) {
+        if (opt == 'n') items       = atoi(optarg);
+        if (opt == 'c') cap         = atoi(optarg);
+        if (opt == 't') max_threads = atoi(optarg);
+        if (opt == 'b') batch       = atoi(optarg);
+    }
+    if (max_threads <= 0) max_threads = sysconf(_SC_NPROCESSORS_ONLN);
+    if (batch <= 0 || batch > 256) batch = 32;
+
+    printf("mpmc: %d items, capacity %d, batch %d\n", items, cap, batch);
+
+    for (int threads = 1; threads <= max_threads; threads *= 2) {
+        run(Locked, threads);
+        run(Mpmc, threads);
+        run(Mpmc_batch, threads);
+    }
+
+    return 0;
+}
@@ -0,0 +1,86 @@
+/*
+ * Prefilter benchmark: DID filter with followed set of a million repos
+ * and collection set lookups.
+ *
+ * Usage:
+ *      ./bench-prefilter [-n dids]
+ *
+ * Reports nanoseconds per check of DIDs which are not in the set (the
+ * common case of the firehose), DIDs which are in the set and of
+ * collection paths.
+ */
+#define BSKY_API_IMPLEMENTATION
+#include "../bsky-api.h"
+
+#include <stdio.h>
+
+#define PROBES 0x100000
+
+static int dids = 1000000;
+
+static char (*make_dids(int from, int len))[32]
+{
+    char (*out)[32] = malloc((size_t) len * 32);
+
+    for (int i = 0; i < len; ++i)
+        snprintf(out[i], 32, "did:plc:%023d", from + i);
+
+    return out;
+}
+
+int main(int argc, char **argv)
+{
+    struct bsky_did_filter filter;
+    struct bsky_nsid_set   set;
+    const char *nsids[] = {
+        "app.bsky.feed.post", "app.bsky.feed.repost", "app.bsky.graph.*",
+    };
+    const char *paths[] = {
+        "app.bsky.feed.like/3kxyzabcdefgh", "app.bsky.feed.post/3kxyzabcdefgh",
+        "app.bsky.graph.follow/3kxyzabcdefgh", "app.bsky.actor.profile/self",
+    };
+    volatile int sink = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:")) != -1) {
+        if (opt == 'n') dids = atoi(optarg);
+    }
+
+    char (*in)[32]  = make_dids(0, dids);
+    char (*out)[32] = make_dids(dids, PROBES);
+
+    bsky_did_filter_init(&filter, dids);
+    for (int i = 0; i < dids; ++i)
+        bsky_did_filter_add(&filter, bsky_mk_str(in[i]));
+
+    bsky_nsid_set_build(&set, nsids, BSKY_ARRAY_LEN(nsids));
+
+    printf("prefilter: %d dids, %zu KB bloom\n", dids,
+           (filter.mask + 1) * 64 / 1024);
+
+    uint64_t start = __bsky_now_ns();
+    for (int i = 0; i < PROBES; ++i)
+        sink += bsky_did_filter_has(&filter, bsky_mk_str(out[i]));
+    printf("  did miss   %6.1f ns  false positives %llu\n",
+           (double) (__bsky_now_ns() - start) / PROBES,
+           (unsigned long long) filter.false_positives);
+
+    start = __bsky_now_ns();
+    for (int i = 0; i < PROBES; ++i)
+        sink += bsky_did_filter_has(&filter, bsky_mk_str(in[i % dids]));
+    printf("  did hit    %6.1f ns\n",
+           (double) (__bsky_now_ns() - start) / PROBES);
+
+    start = __bsky_now_ns();
+    for (int i = 0; i < PROBES; ++i)
+        sink += bsky_nsid_set_has(&set, bsky_mk_str((char*) paths[i % 4]));
+    printf("  collection %6.1f ns\n",
+           (double) (__bsky_now_ns() - start) / PROBES);
+
+    bsky_did_filter_free(&filter);
+    bsky_nsid_set_free(&set);
+    free(in);
+    free(out);
+
+    return sink == -1;
+}
@@ -0,0 +1,107 @@
+/*
+ * Replay of captured `subscribeRepos' traffic through WebSocket parser
+ * and firehose pipeline.
+ *
+ * Usage:
+ *      ./bench-replay [-p] [-n repeat] [-s shards] [capture]
+ *
+ * Default capture is `../dump-test/firehose.cap' (`make capture' there).
+ * Frames are fed as fast as possible `repeat' times, or once at recorded
+ * pace with -p. Reports events and bytes per second and latency of
+ * stages: reader (WebSocket parsing and push into ring), decoder and
+ * handler.
+ */
+#define BSKY_API_IMPLEMENTATION
+#include "../bsky-api.h"
+
+#include <stdio.h>
+
+static void on_event(void *user, struct bsky_firehose_event *ev)
+{
+    unsigned char digest[32];
+
+    (void) user;
+    bsky_sha256(ev->blocks.start,
+                (char*) ev->blocks.end - (char*) ev->blocks.start, digest);
+}
+
+int main(int argc, char **argv)
+{
+    enum bsky_error_code ec;
+    struct bsky_replay  replay;
+    struct bsky_replay_stats stats, total = { 0 };
+    struct bsky_firehose pipe;
+    struct bsky_firehose_config config = { .handler = on_event };
+    struct bsky_firehose_metrics metrics[256], sum = { 0 };
+    struct bsky_ws ws = {
+        .fd = -1, .on_message = bsky_firehose_on_ws_message, .user = &pipe,
+    };
+    const char *path = "../dump-test/firehose.cap";
+    int paced = 0, repeat = 100, opt;
+
+    while ((opt = getopt(argc, argv, "pn:s:")) != -1) {
+        if (opt == 'p') paced = 1;
+        else if (opt == 'n') repeat = atoi(optarg);
+        else if (opt == 's') config.shards = atoi(optarg);
+    }
+    if (optind < argc) path = argv[optind];
+    if (paced) repeat = 1;
+
+    if (bsky_replay_open(&replay, path, &ec) != bsky_ec_Ok) return 1;
+    if (bsky_firehose_start(&pipe, &config) != bsky_ec_Ok) return 1;
+
+    uint64_t start = __bsky_now_ns();
+    for (int i = 0; i < repeat; ++i) {
+        bsky_replay_rewind(&replay);
+        if (bsky_replay_run(&replay, &ws, paced, &stats) != bsky_ec_Ok)
+            return 1;
+
+        total.frames  += stats.frames;
+        total.bytes   += stats.bytes;
+        total.feed_ns += stats.feed_ns;
+        if (stats.feed_max_ns > total.feed_max_ns)
+            total.feed_max_ns = stats.feed_max_ns;
+        if (stats.late_max_ns > total.late_max_ns)
+            total.late_max_ns = stats.late_max_ns;
+    }
+
+    size_t shards = bsky_firehose_metrics(&pipe, metrics, 256);
+    bsky_firehose_stop(&pipe);
+    double secs = (__bsky_now_ns() - start) / 1e9;
+
+    for (size_t i = 0; i < shards && i < 256; ++i) {
+        sum.pushed    += metrics[i].pushed;
+        sum.handled   += metrics[i].handled;
+        sum.decode_ns += metrics[i].decode_ns;
+        sum.handle_ns += metrics[i].handle_ns;
+        if (metrics[i].decode_ns_max > sum.decode_ns_max)
+            sum.decode_ns_max = metrics[i].decode_ns_max;
+        if (metrics[i].handle_ns_max > sum.handle_ns_max)
+            sum.handle_ns_max = metrics[i].handle_ns_max;
+    }
+
+    printf("replay: %s, %s, %zu shards\n", path,
+           paced ? "recorded pace" : "as fast as possible", shards);
+    printf("  %llu events  %.0f events/s  %.1f MB/s",
+           (unsigned long long) total.frames, total.frames / secs,
+           total.bytes / secs / 1e6);
+    if (paced) printf("  max lag %.2f ms", total.late_max_ns / 1e6);
+    printf("\n");
+
+    // metrics are read before stop, so in-flight events are not counted.
+    printf("  stage      mean us    max us\n");
+    printf("  reader  %10.2f %9.1f\n",
+           total.feed_ns / 1e3 / (total.frames ? total.frames : 1),
+           total.feed_max_ns / 1e3);
+    printf("  decoder %10.2f %9.1f\n",
+           sum.decode_ns / 1e3 / (sum.pushed ? sum.pushed : 1),
+           sum.decode_ns_max / 1e3);
+    printf("  handler %10.2f %9.1f\n",
+           sum.handle_ns / 1e3 / (sum.handled ? sum.handled : 1),
+           sum.handle_ns_max / 1e3);
+
+    bsky_replay_free(&replay);
+    bsky_ws_free(&ws);
+
+    return 0;
+}
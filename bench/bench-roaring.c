@@ -0,0 +1,191 @@
+/*
+ * Set operations of roaring bitmaps against sorted arrays of ids.
+ *
+ * Usage:
+ *      ./bench-roaring [-n members] [-u universe] [-r rounds]
+ *
+ * Two random sets of `members' ids (1000000 by default) are made for
+ * three shapes: sparse in `universe' ids (arrays), dense in 2 * `members'
+ * ids (bitmaps) and ranges of 1000 ids (runs after optimize). Reports
+ * memory of every form and time of intersection, union and difference
+ * for every supported kernel and for merge of sorted arrays.
+ */
+#define BSKY_API_IMPLEMENTATION
+#include "../bsky-api.h"
+
+#include <stdio.h>
+
+static int members = 1000000, universe = 100000000, rounds = 10;
+
+static uint64_t seed = 88172645463325252ull;
+
+static uint32_t next(void)
+{
+    seed ^= seed << 13;
+    seed ^= seed >> 7;
+    seed ^= seed << 17;
+    return seed;
+}
+
+static int cmp_u32(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t*) a, y = *(const uint32_t*) b;
+
+    return x < y ? -1 : x > y;
+}
+
+enum shape { Sparse, Dense, Ranges };
+
+// sorted unique ids.
+static size_t make(enum shape shape, uint32_t *ids)
+{
+    size_t n = 0, k = 0;
+
+    if (shape == Ranges) {
+        while (n < (size_t) members) {
+            uint32_t start = next() % (universe - 1000);
+
+            for (uint32_t v = start; v < start + 1000 &&
+                                     n < (size_t) members; ++v) {
+                ids[n++] = v;
+            }
+        }
+    } else {
+        uint32_t range = shape == Sparse ? universe : 2 * members;
+
+        while (n < (size_t) members) ids[n++] = next() % range;
+    }
+
+    qsort(ids, n, sizeof (uint32_t), cmp_u32);
+    for (size_t i = 0; i < n; ++i) {
+        if (k == 0 || ids[k - 1] != ids[i]) ids[k++] = ids[i];
+    }
+
+    return k;
+}
+
+static size_t memory(struct bsky_roaring *r)
+{
+    size_t size = r->cap * sizeof (*r->data);
+
+    for (size_t i = 0; i < r->len; ++i) {
+        struct __bsky_roaring_container *c = &r->data[i];
+
+        size += c->type == __bsky_roaring_Bitmap ? 8192
+              : c->type == __bsky_roaring_Run    ? c->cap * 4
+              : c->cap * 2;
+    }
+
+    return size;
+}
+
+enum op { And, Or, Andnot };
+
+// baseline: merge of sorted arrays.
+static size_t merge(enum op op, const uint32_t *a, size_t na,
+                    const uint32_t *b, size_t nb, uint32_t *out)
+{
+    size_t i = 0, j = 0, k = 0;
+
+    while (i < na && j < nb) {
+        if (a[i] < b[j]) {
+            if (op != And) out[k++] = a[i];
+            i++;
+        } else if (b[j] < a[i]) {
+            if (op == Or) out[k++] = b[j];
+            j++;
+        } else {
+            if (op != Andnot) out[k++] = a[i];
+            i++;
+            j++;
+        }
+    }
+    while (op != And && i < na) out[k++] = a[i++];
+    while (op == Or && j < nb) out[k++] = b[j++];
+
+    return k;
+}
+
+static void run(enum shape shape)
+{
+    static const char *shapes[]   = { "sparse", "dense", "ranges" };
+    static const char *ops[]      = { "and", "or", "andnot" };
+    static const char *backends[] = { "", "portable", "sse2", "avx2" };
+    struct bsky_roaring a = { 0 }, b = { 0 }, out = { 0 };
+    uint32_t *x   = malloc(members * sizeof (uint32_t));
+    uint32_t *y   = malloc(members * sizeof (uint32_t));
+    uint32_t *res = malloc(2 * members * sizeof (uint32_t));
+    size_t nx = make(shape, x), ny = make(shape, y), expected[3];
+
+    bsky_roaring_add_many(&a, x, nx);
+    bsky_roaring_add_many(&b, y, ny);
+    if (shape == Ranges) {
+        bsky_roaring_optimize(&a);
+        bsky_roaring_optimize(&b);
+    }
+
+    printf("%s: %zu and %zu members, %zu containers\n", shapes[shape],
+           nx, ny, a.len);
+    printf("  memory     %10zu bytes, sorted array %zu bytes\n",
+           memory(&a), nx * sizeof (uint32_t));
+
+    for (enum op op = And; op <= Andnot; ++op) {
+        uint64_t start = __bsky_now_ns();
+
+        for (int i = 0; i < rounds; ++i)
+            expected[op] = merge(op, x, nx, y, ny, res);
+
+        double ns = (double) (__bsky_now_ns() - start) / rounds;
+
+        printf("  %-6s %-8s %10.0f us %8.2f ns/member\n", ops[op], "merge",
+               ns / 1e3, ns / (nx + ny));
+    }
+
+    for (enum bsky_roaring_backend backend = bsky_roaring_Portable;
+         backend <= bsky_roaring_Avx2; ++backend) {
+        if (bsky_roaring_use(backend) != backend) continue;
+
+        for (enum op op = And; op <= Andnot; ++op) {
+            uint64_t start = __bsky_now_ns();
+
+            for (int i = 0; i < rounds; ++i) {
+                if (op == And)    bsky_roaring_and(&out, &a, &b);
+                if (op == Or)     bsky_roaring_or(&out, &a, &b);
+                if (op == Andnot) bsky_roaring_andnot(&out, &a, &b);
+            }
+
+            double ns = (double) (__bsky_now_ns() - start) / rounds;
+
+            printf("  %-6s %-8s %10.0f us %8.2f ns/member %s\n", ops[op],
+                   backends[backend], ns / 1e3, ns / (nx + ny),
+                   bsky_roaring_card(&out) == expected[op] ? "" : "  WRONG");
+        }
+    }
+
+    bsky_roaring_free(&a);
+    bsky_roaring_free(&b);
+    bsky_roaring_free(&out);
+    free(x);
+    free(y);
+    free(res);
+}
+
+int main(int argc, char **argv)
+{
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:u:r:")) != -1) {
+        if (opt == 'n') members  = atoi(optarg);
+        if (opt == 'u') universe = atoi(optarg);
+        if (opt == 'r') rounds   = atoi(optarg);
+    }
+    if (members <= 0) members = 1000000;
+    if (universe <= 2000 || universe < members) universe = 100 * members;
+    if (rounds <= 0) rounds = 1;
+
+    run(Sparse);
+    run(Dense);
+    run(Ranges);
+
+    return 0;
+}
@@ -0,0 +1,95 @@
+/*
+ * SHA-256 benchmark on sizes typical for repo blocks: small records and
+ * commits, MST nodes and bigger records.
+ *
+ * Usage:
+ *      ./bench-sha256 [-n blocks] [-t milliseconds]
+ *
+ * For every backend supported by CPU reports hashes per second and
+ * megabytes per second of hashing blocks one by one (`bsky_sha256') and
+ * in batches (`bsky_sha256_many').
+ */
+#define BSKY_API_IMPLEMENTATION
+#include "../bsky-api.h"
+
+#include <stdio.h>
+
+static int blocks = 4096, millis = 300;
+
+static const char *names[] = {
+    [bsky_sha256_Portable] = "portable",
+    [bsky_sha256_Avx2]     = "avx2",
+    [bsky_sha256_Shani]    = "sha-ni",
+    [bsky_sha256_Armv8]    = "armv8",
+};
+
+static void run(const char *mode, size_t size, struct bsky_view *views,
+                unsigned char (*digests)[32], int many)
+{
+    uint64_t start = __bsky_now_ns(), end, hashes = 0;
+
+    do {
+        if (many) {
+            bsky_sha256_many(views, blocks, digests);
+        } else {
+            for (int i = 0; i < blocks; ++i) {
+                bsky_sha256(views[i].start, size, digests[i]);
+            }
+        }
+        hashes += blocks;
+        end = __bsky_now_ns();
+    } while (end - start < (uint64_t) millis * 1000000);
+
+    double s = (end - start) / 1e9;
+
+    printf("  %-6s %5zu B %12.0f hashes/s %9.1f MB/s\n", mode, size,
+           hashes / s, hashes * size / s / 1e6);
+}
+
+int main(int argc, char **argv)
+{
+    static const size_t sizes[] = { 64, 200, 500, 1500, 4000 };
+    enum bsky_sha256_backend backends[] = {
+        bsky_sha256_Portable, bsky_sha256_Avx2, bsky_sha256_Shani,
+        bsky_sha256_Armv8,
+    };
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:t:")) != -1) {
+        if (opt == 'n') blocks = atoi(optarg);
+        else if (opt == 't') millis = atoi(optarg);
+        else {
+            fprintf(stderr, "usage: %s [-n blocks] [-t milliseconds]\n",
+                    argv[0]);
+            return 1;
+        }
+    }
+
+    unsigned char    *data    = malloc(blocks * sizes[4]);
+    unsigned char   (*digests)[32] = malloc(blocks * 32);
+    struct bsky_view *views   = malloc(blocks * sizeof (*views));
+
+    for (size_t i = 0; i < blocks * sizes[4]; ++i) data[i] = i * 131 + 7;
+
+    for (size_t b = 0; b < sizeof (backends) / sizeof (*backends); ++b) {
+        if (bsky_sha256_use(backends[b]) != backends[b]) continue;
+
+        printf("%s:\n", names[backends[b]]);
+
+        for (size_t s = 0; s < sizeof (sizes) / sizeof (*sizes); ++s) {
+            for (int i = 0; i < blocks; ++i) {
+                views[i] = (struct bsky_view) { data + i * sizes[s],
+                                                data + (i + 1) * sizes[s] };
+            }
+
+            run("single", sizes[s], views, digests, 0);
+            run("many", sizes[s], views, digests, 1);
+        }
+    }
+
+    free(data);
+    free(digests);
+    free(views);
+
+    return 0;
+}
@@ -0,0 +1,158 @@
+/*
+ * Commit signature verification benchmark with OpenSSL backend.
+ *
+ * Usage:
+ *      ./bench-verify [-n commits] [-d dids] [-w workers]
+ *
+ * Signs commits of `dids' repos with secp256k1 and P-256 keys and
+ * verifies them with one worker and with `workers' (online CPUs by
+ * default). Reports verifications per second and per core.
+ */
+#define BSKY_API_IMPLEMENTATION
+#define BSKY_API_OPENSSL
+#include "../bsky-api.h"
+
+#include <stdio.h>
+#include <openssl/ecdsa.h>
+
+static int commits = 20000, dids = 1000, workers = 0;
+
+static _Atomic int bad;
+
+static void on_result(void *user, void *job, enum bsky_verify_status status)
+{
+    (void) user; (void) job;
+    if (status != bsky_verify_Ok) atomic_fetch_add(&bad, 1);
+}
+
+// low-S compact signature (retry until random nonce gives low `s').
+static void sign(EVP_PKEY *pkey, enum bsky_key_type type,
+                 const unsigned char digest[32], unsigned char sig[64])
+{
+    for (;;) {
+        unsigned char der[80];
+        const unsigned char *p = der;
+        size_t len = sizeof (der);
+        EVP_PKEY_CTX *ctx = EVP_PKEY_CTX_new(pkey, NULL);
+
+        EVP_PKEY_sign_init(ctx);
+        EVP_PKEY_sign(ctx, der, &len, digest, 32);
+        EVP_PKEY_CTX_free(ctx);
+
+        ECDSA_SIG *s = d2i_ECDSA_SIG(NULL, &p, len);
+        BN_bn2binpad(ECDSA_SIG_get0_r(s), sig, 32);
+        BN_bn2binpad(ECDSA_SIG_get0_s(s), sig + 32, 32);
+        ECDSA_SIG_free(s);
+
+        if (memcmp(sig + 32, __bsky_half_order[type], 32) <= 0) return;
+    }
+}
+
+static void push_commit(struct bsky_str_builder *sb, const char *did,
+                        int rev, const unsigned char *sig)
+{
+    unsigned char cid[36] = { 0x01, 0x71, 0x12, 0x20, rev };
+    char rev_str[16];
+
+    snprintf(rev_str, sizeof (rev_str), "3k%08d", rev);
+
+    bsky_cbor_push_map(sb, sig ? 6 : 5);
+    bsky_cbor_push_str(sb, bsky_mk_str("did"));
+    bsky_cbor_push_str(sb, bsky_mk_str((char*) did));
+    bsky_cbor_push_str(sb, bsky_mk_str("rev"));
+    bsky_cbor_push_str(sb, bsky_mk_str(rev_str));
+    if (sig) {
+        bsky_cbor_push_str(sb, bsky_mk_str("sig"));
+        bsky_cbor_push_bytes(sb, (struct bsky_view) { (void*) sig,
+                                                      (void*) (sig + 64) });
+    }
+    bsky_cbor_push_str(sb, bsky_mk_str("data"));
+    bsky_cbor_push_link(sb, (struct bsky_view) { cid, cid + 36 });
+    bsky_cbor_push_str(sb, bsky_mk_str("prev"));
+    bsky_cbor_push_null(sb);
+    bsky_cbor_push_str(sb, bsky_mk_str("version"));
+    bsky_cbor_push_int(sb, 3);
+}
+
+static void run(enum bsky_key_type type, size_t threads)
+{
+    const char *curve = type == bsky_key_P256 ? "prime256v1" : "secp256k1";
+    struct bsky_str_builder *blocks = calloc(commits, sizeof (*blocks));
+    char (*names)[32] = malloc((size_t) dids * 32);
+    struct bsky_verifier v = {
+        .crypto = bsky_crypto_openssl(), .on_result = on_result,
+        .workers = threads,
+    };
+
+    bsky_verifier_start(&v);
+
+    for (int i = 0; i < dids; ++i) {
+        EVP_PKEY *pkey = EVP_PKEY_Q_keygen(NULL, NULL, "EC", curve);
+        struct bsky_pubkey pub = { .type = type };
+        size_t len;
+
+        EVP_PKEY_set_utf8_string_param(pkey,
+            OSSL_PKEY_PARAM_EC_POINT_CONVERSION_FORMAT, "compressed");
+        EVP_PKEY_get_octet_string_param(pkey, OSSL_PKEY_PARAM_PUB_KEY,
+                                        pub.point, sizeof (pub.point), &len);
+
+        snprintf(names[i], 32, "did:plc:%023d", i);
+        bsky_verifier_set_key(&v, bsky_mk_str(names[i]), &pub);
+
+        for (int j = i; j < commits; j += dids) {
+            struct bsky_str_builder unsigned_sb = { 0 };
+            unsigned char digest[32], sig[64];
+
+            push_commit(&unsigned_sb, names[i], j, NULL);
+            bsky_sha256(unsigned_sb.data, unsigned_sb.len, digest);
+            sign(pkey, type, digest, sig);
+            push_commit(&blocks[j], names[i], j, sig);
+            bsky_da_free(&unsigned_sb);
+        }
+        EVP_PKEY_free(pkey);
+    }
+
+    atomic_store(&bad, 0);
+    uint64_t start = __bsky_now_ns();
+
+    for (int i = 0; i < commits; ++i) {
+        bsky_verifier_submit(&v, bsky_mk_str(names[i % dids]),
+            (struct bsky_view) { blocks[i].data,
+                                 blocks[i].data + blocks[i].len }, NULL);
+    }
+    bsky_verifier_wait(&v);
+
+    double secs = (__bsky_now_ns() - start) / 1e9;
+    printf("  %-10s %2zu workers %9.0f verifies/s %8.0f per core  bad %d\n",
+           curve, v.workers, commits / secs, commits / secs / v.workers,
+           atomic_load(&bad));
+
+    bsky_verifier_stop(&v);
+    for (int i = 0; i < commits; ++i) bsky_da_free(&blocks[i]);
+    free(blocks);
+    free(names);
+}
+
+int main(int argc, char **argv)
+{
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:d:w:")) != -1) {
+        if (opt == 'n') commits = atoi(optarg);
+        if (opt == 'd') dids    = atoi(optarg);
+        if (opt == 'w') workers = atoi(optarg);
+    }
+    if (workers <= 0) workers = sysconf(_SC_NPROCESSORS_ONLN);
+    if (dids > commits) dids = commits;
+
+    printf("verify: %d commits of %d repos\n", commits, dids);
+
+    run(bsky_key_Secp256k1, 1);
+    run(bsky_key_P256, 1);
+    if (workers > 1) {
+        run(bsky_key_Secp256k1, workers);
+        run(bsky_key_P256, workers);
+    }
+
+    return 0;
+}
@@ -39,6 +39,10 @@
 #include <stdlib.h>
 #include <math.h>
 #include <stdio.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <sys/socket.h>
 
 #define BSKY_ARRAY_LEN(array) (sizeof (array) / sizeof (array)[0])
 
@@ -128,6 +132,67 @@
         bsky_ec_Json_expect_CQ,
         bsky_ec_Json_expect_Colon,
 		bsky_ec_Json_invalid_variant,
+
+        bsky_ec_Out_of_memory,
+
+        bsky_ec_Url_invalid,
+        bsky_ec_Net_resolve,
+        bsky_ec_Net_connect,
+
+        bsky_ec_Pds_not_found,
+        bsky_ec_Pds_unknown_did,
+
+        bsky_ec_Io,
+        bsky_ec_Net_send,
+
+        bsky_ec_Xrpc_status,
+        bsky_ec_Xrpc_transport,
+
+        bsky_ec_Loop,
+
+        bsky_ec_Ws_handshake,
+        bsky_ec_Ws_protocol,
+        bsky_ec_Ws_too_large,
+        bsky_ec_Ws_closed,
+
+        bsky_ec_Cbor_eof,
+        bsky_ec_Cbor_invalid,
+        bsky_ec_Cbor_non_canonical,
+
+        bsky_ec_Car_invalid,
+        bsky_ec_Car_truncated,
+
+        bsky_ec_Cid_invalid,
+
+        bsky_ec_Mst_invalid,
+        bsky_ec_Mst_missing_block,
+
+        bsky_ec_Firehose_invalid,
+        bsky_ec_Firehose_thread,
+
+        bsky_ec_Checkpoint_io,
+
+        bsky_ec_Prefilter_build,
+
+        bsky_ec_Jetstream_invalid,
+        bsky_ec_Jetstream_decompress,
+
+        bsky_ec_Verify_invalid_key,
+        bsky_ec_Verify_thread,
+
+        bsky_ec_Capture_invalid,
+
+        bsky_ec_Backfill_fetch,
+
+        bsky_ec_Label_invalid,
+
+        bsky_ec_Pool_thread,
+
+        bsky_ec_Snapshot_invalid,
+
+        bsky_ec_Graph_invalid,
+
+        bsky_ec_Roaring_response,
     };
 
     /**
@@ -181,6 +246,9 @@
      * To reset default tmp arena call:
      * bsky_default_tmp_reset();
      *
+     * Default tmp arena is per thread, so stage threads of firehose
+     * pipeline don't share it.
+     *
      * NOTE: if `bsky_tmp_alloc' returns NULL, it will be interpreted as
      *       temporary arena overflow.
      */
@@ -191,6 +259,13 @@
         #define BSKY_DEFAULT_TMP_ARENA_CAPACITY (0x8 * 0x400 * 0x400)
     #endif
 
+    /**
+     * Released arena blocks kept for reuse by other threads.
+     */
+    #ifndef BSKY_TMP_POOL
+        #define BSKY_TMP_POOL 4
+    #endif
+
 
     /**
      * Default tmp arena allocator.
@@ -202,6 +277,12 @@
      */
     void bsky_default_tmp_reset(void);
 
+    /**
+     * Release default tmp arena of calling thread (to pool of
+     * `BSKY_TMP_POOL' blocks), worker threads call it before exit.
+     */
+    void bsky_default_tmp_free(void);
+
 
 /*
  * module:
@@ -492,6 +573,12 @@
     struct bsky_json bsky_parse_json_bool(struct bsky_str*,
                                           enum bsky_error_code*);
 
+    /**
+     * Get value of dictionary field by name. Return NULL if json is not
+     * dictionary or there is no such field.
+     */
+    struct bsky_json *bsky_json_get(struct bsky_json *, const char *name);
+
 
     typedef struct bsky_json      bsky_Json;
     typedef struct bsky_json_pair bsky_Json_Pair;
@@ -502,593 +589,14879 @@
 
 
 /*
+ * module:
  * ============================================================================
- *                             IMPLEMENTATION
- * ===========================================================================
- *
- * To enable implementation predefine `BSKY_API_IMPLEMENTATION' macro.
- */
-#ifdef BSKY_API_IMPLEMENTATION
+ *                                STRING MAP
+ * ============================================================================
+*/
+    /**
+     * Open addressing hash map from string to `size_t'. Keys are copied,
+     * so map can be filled from views into temporary data. Usually value
+     * is index into some dynamic array owned by the user of the map.
+     *
+     * NOTE: `len' is number of keys and `cap' is number of slots
+     *       (always power of two).
+     */
+    struct bsky_str_map_entry { char *key; size_t hash, value; };
+    struct bsky_str_map { struct bsky_str_map_entry *data; size_t len, cap; };
 
-    /*
-     * BSKY ERROR CODE
+    /**
+     * Insert key or overwrite value of existing key.
      */
-    const char *bsky_str_of_error_code(enum bsky_error_code code)
-    {
-        switch (code) {
-        case bsky_ec_Ok:           return "Ok";
-        case bsky_ec_Tmp_overflow: return "overflow of temporary arena!";
+    enum bsky_error_code bsky_str_map_set(struct bsky_str_map *,
+                                          struct bsky_str key, size_t value);
 
-        case bsky_ec_Json_expect_CSB: 
-            return "JSON: expect ']' at the end of array!";
-        case bsky_ec_Json_expect_OSB: 
-            return "JSON: expect '[' at the start of the array!";
-        case bsky_ec_Json_expect_CCB: 
-            return "JSON: expect '}' at the end of dictionary!";
-        case bsky_ec_Json_expect_OCB: 
-            return "JSON: expect '}' at the start of dictionary!";
-        case bsky_ec_Json_expect_Bool: 
-            return "JSON: expect 'true' or 'false'!";
-        case bsky_ec_Json_expect_Null: 
-            return "JSON: expect 'null'!";
-        case bsky_ec_Json_expect_Number: 
-            return "JSON: expect number!";
-        case bsky_ec_Json_expect_OQ: 
-            return "JSON: expect '\"' at the start of string!";
-        case bsky_ec_Json_expect_CQ: 
-            return "JSON: expect '\"' at the end of string!";
-        case bsky_ec_Json_expect_Colon: 
-            return "JSON: expect ':' between key and value!";
-        case bsky_ec_Json_invalid_variant:
-            return "JSON: parse invalid json variant!";
-        }
-    }
+    /**
+     * Get pointer to value of the key. Return NULL if there is no such key.
+     */
+    size_t *bsky_str_map_get(struct bsky_str_map *, struct bsky_str key);
 
-    /*
-     * DEFAULT TMP ARENA
+    /**
+     * Remove key. Return 0 if there is no such key.
      */
-    struct __bsky_default_tmp_arena {
-        void *allocator; size_t len;
-    } __bsky_default_tmp_arena = { 0 };
+    int bsky_str_map_del(struct bsky_str_map *, struct bsky_str key);
 
-    void    bsky_default_tmp_reset(void) {
-        __bsky_default_tmp_arena.len = 0;
-    }
+    /**
+     * Free map and all copied keys.
+     */
+    void bsky_str_map_free(struct bsky_str_map *);
 
-    void *__bsky_default_tmp_alloc(size_t size_to_alloc)
-    {
-        if (__bsky_default_tmp_arena.allocator == 0) {
-            __bsky_default_tmp_arena.allocator =
-                calloc(BSKY_DEFAULT_TMP_ARENA_CAPACITY, sizeof(char));
-        }
 
-        if (__bsky_default_tmp_arena.len + size_to_alloc >
-            BSKY_DEFAULT_TMP_ARENA_CAPACITY) 
-            return NULL;
+/*
+ * module:
+ * ============================================================================
+ *                                    NET
+ * ============================================================================
+*/
+    /**
+     * Parsed url. All fields are views into the original string, so they
+     * are NOT null terminated. Missing port is left empty and `path' can be
+     * empty too.
+     */
+    struct bsky_url { struct bsky_str scheme, host, port, path; };
 
-        void *ret = __bsky_default_tmp_arena.allocator
-                    + __bsky_default_tmp_arena.len;
+    /**
+     * Parse `scheme://host[:port][/path]' url.
+     */
+    struct bsky_url bsky_parse_url(struct bsky_str, enum bsky_error_code *);
 
-        __bsky_default_tmp_arena.len += size_to_alloc;
+    /**
+     * Port of url, or default port of url scheme (`443' for https and wss,
+     * `80' otherwise). Returned string is temporary.
+     */
+    struct bsky_str bsky_url_port(struct bsky_url);
 
-        return ret;
-    }
+    /**
+     * Resolve host and open TCP connection to it (with TCP_NODELAY).
+     * Return socket file descriptor or -1 on error.
+     */
+    int bsky_net_connect(const char *host, const char *port,
+                         enum bsky_error_code *);
 
-    /*
-     * BKSY DYNAMIC ARRAY
+    /**
+     * Maximum number of idle keep-alive connections kept per host by
+     * `bsky_conn_pool'. Can be predefined.
      */
-	#include <string.h>
-    void bsky_da_free(void *da) {
-        struct bsky_dynamic_arr *self = (struct bsky_dynamic_arr*) da;
+    #ifndef BSKY_CONN_POOL_MAX_IDLE
+        #define BSKY_CONN_POOL_MAX_IDLE 8
+    #endif
 
-        if (self->data != NULL) free(self->data);
-    }
+    /**
+     * Connections to one host:port. `idle' is stack of keep-alive
+     * sockets, so the most recently used (the warmest) socket is reused
+     * first.
+     *
+     * Address of host is resolved once and cached in `addr', so only the
+     * first connection (or `bsky_conn_pool_warmup') pays for DNS.
+     */
+    struct bsky_conn_host {
+        char *host, *port;
+        struct { int *data; size_t len, cap; } idle;
 
-    enum bsky_error_code 
-    __bsky_da_push(void *self_gen, const void *elem, size_t elem_size)
-    {
-        struct bsky_dynamic_arr *self = (struct bsky_dynamic_arr*) self_gen;
+        struct sockaddr_storage addr;
+        socklen_t addr_len;
 
-        if (self->len >= self->cap) {
-            self->cap  = self->cap ?  self->cap * 2 : 16;
-            self->data = realloc(self->data, self->cap * elem_size);
-            if (self->data == NULL) bsky_return_error(bsky_ec_Tmp_overflow);
-        }
+        size_t   connects, reuses;
+        uint64_t resolve_ns, first_ready_ns;
+    };
 
-        memcpy(self->data + self->len++ * elem_size, elem, elem_size);
+    /**
+     * Pool of keep-alive connections per host. Hosts are interned by
+     * `host:port', and index of host is stable while pool is alive, so
+     * it can be stored by other structures (see `bsky_pds_router').
+     *
+     * `max_idle' is limit of idle connections per host, 0 means
+     * `BSKY_CONN_POOL_MAX_IDLE'.
+     */
+    struct bsky_conn_pool {
+        struct bsky_conn_host *data; size_t len, cap;
+        struct bsky_str_map index;
 
-        return bsky_ec_Ok;
-    }
+        size_t max_idle;
+    };
 
-    enum bsky_error_code
-    __bsky_da_append(void *self_gen, const void *elems,
-                     size_t elem_size, size_t len)
-    {
-        struct bsky_dynamic_arr *self = (struct bsky_dynamic_arr*) self_gen;
+    /**
+     * Get (or create) index of host in the pool.
+     */
+    size_t bsky_conn_pool_host(struct bsky_conn_pool *, struct bsky_str host,
+                               struct bsky_str port, enum bsky_error_code *);
 
-        if (self->len + len > self->cap) {
-            self->cap  = (self->cap ? self->cap * 2 : 16) + len;
-            self->data = realloc(self->data, self->cap * elem_size);
+    /**
+     * Take idle connection to the host or open new one.
+     * Return socket or -1 on error.
+     */
+    int bsky_conn_pool_get(struct bsky_conn_pool *, size_t host,
+                           enum bsky_error_code *);
 
-            if (self->data == NULL) bsky_return_error(bsky_ec_Tmp_overflow);
-        }
+    /**
+     * Return connection to the pool. If connection cannot be reused
+     * (`keep_alive' is 0) or there are already `BSKY_CONN_POOL_MAX_IDLE'
+     * idle connections, socket is closed.
+     */
+    void bsky_conn_pool_put(struct bsky_conn_pool *, size_t host,
+                            int fd, int keep_alive);
 
-        memcpy(self->data + self->len, elems, elem_size * len);
-        self->len += len;
+    /**
+     * Close all idle connections and free pool.
+     */
+    void bsky_conn_pool_free(struct bsky_conn_pool *);
 
-        return bsky_ec_Ok;
-    }
+    /**
+     * Statistics of `bsky_conn_pool_warmup'. Times are in nanoseconds
+     * from the start of warmup.
+     */
+    struct bsky_warmup_stats {
+        size_t   ready, failed;
+        uint64_t resolve_ns;     // time spent in DNS resolution
+        uint64_t first_ready_ns; // time to first ready connection
+        uint64_t all_ready_ns;   // time to last ready connection
+    };
 
-    void bsky_clear_da(void *self_gen) {
-        struct bsky_dynamic_arr *self = (struct bsky_dynamic_arr*) self_gen;
+    /**
+     * Prepare pool before traffic arrives: resolve every host of the pool
+     * (and cache address), then open connections in parallel until each
+     * host has `per_host' idle keep-alive connections. Waits at most
+     * `timeout_ms' for connections. `stats' can be NULL.
+     *
+     * Example:
+     *      bsky_pds_router_set_fallback(&router, appview);
+     *      bsky_pds_router_set(&router, did, pds);
+     *      ...
+     *      struct bsky_warmup_stats stats;
+     *      bsky_conn_pool_warmup(&router.pool, 4, 2000, &stats);
+     *      bsky_log(bsky_log_Info, "first connection in %.3f ms",
+     *               stats.first_ready_ns / 1e6);
+     */
+    enum bsky_error_code bsky_conn_pool_warmup(struct bsky_conn_pool *,
+                                               size_t per_host,
+                                               int timeout_ms,
+                                               struct bsky_warmup_stats *);
 
-        *self = (struct bsky_dynamic_arr) { 0 }; 
-    }
 
-    /*
-     * BSKY VIEW
+/*
+ * module:
+ * ============================================================================
+ *                                PDS ROUTING
+ * ============================================================================
+*/
+    /**
+     * Route of DID: base url of account's PDS and index of PDS host in the
+     * connection pool of router. Routes are shared by all DIDs on the
+     * same PDS.
      */
-    struct bsky_view __bsky_view_of_da(void *_da, size_t elem_size)
-    {
-        struct bsky_dynamic_arr *da = (struct bsky_dynamic_arr *) _da;
+    struct bsky_pds_route { char *endpoint; size_t host; };
 
-        return (struct bsky_view) { da->data, da->data + da->len * elem_size };
-    }
+    /**
+     * Routing table from DID to PDS. Writes and `com.atproto.sync.*'
+     * calls must go to the account's own PDS, other calls go to the
+     * `fallback' endpoint (AppView or entryway), if it is set.
+     *
+     * Example:
+     *      struct bsky_pds_router router = { 0 };
+     *      bsky_pds_router_set_fallback(&router,
+     *                                   bsky_mk_str("https://bsky.social"));
+     *      bsky_pds_router_add_doc(&router, did_doc);
+     *
+     *      struct bsky_xrpc_target t = bsky_pds_router_route(&router,
+     *                       did, bsky_mk_str("com.atproto.sync.getRepo"), &ec);
+     *      ... send request to `t.url' over `t.fd' ...
+     *      bsky_pds_router_release(&router, &t, keep_alive);
+     */
+    struct bsky_pds_router {
+        struct bsky_str_map dids;      // DID -> route index
+        struct bsky_str_map endpoints; // endpoint -> route index
+        struct { struct bsky_pds_route *data; size_t len, cap; } routes;
 
-    struct bsky_view bsky_view_to_tmp(struct bsky_view view)
-    {
-        void *data = bsky_tmp_alloc(view.end - view.start);
-        memcpy(data, view.start, view.end - view.start);
+        char  *fallback;
+        size_t fallback_host;
 
-        return (struct bsky_view) { data, data +  (view.end - view.start) };
-    }
+        struct bsky_conn_pool pool;
+    };
 
-    struct bsky_view __bsky_tmp_view_of_da(void *da, size_t elem_size)
-    {
-        struct bsky_view ret = bsky_view_to_tmp(
-                                 __bsky_view_of_da(da, elem_size));
+    /**
+     * Where to send XRPC call: full temporary url of the method and
+     * connection from the pool of router.
+     */
+    struct bsky_xrpc_target { struct bsky_str url; size_t host; int fd; };
 
-        bsky_da_free(da);
-        bsky_clear_da(da);
+    /**
+     * Find `#atproto_pds' service endpoint in DID document.
+     * Returned string points into the document.
+     */
+    struct bsky_str bsky_pds_of_did_doc(struct bsky_json doc,
+                                        enum bsky_error_code *);
 
-        return ret;
-    }
+    /**
+     * Return 1 if XRPC method must be served by account's own PDS
+     * (`com.atproto.repo.*' and `com.atproto.sync.*') and 0 otherwise.
+     */
+    int bsky_xrpc_is_pds_scoped(struct bsky_str nsid);
 
-    /*
-     * BSKY STRING
+    /**
+     * Set route of DID to PDS endpoint (like `https://pds.example.com').
      */
-    void bsky_sb_push(struct bsky_str_builder *sb, char c)
-    {
-        const char nullc = '\0';
+    enum bsky_error_code bsky_pds_router_set(struct bsky_pds_router *,
+                                             struct bsky_str did,
+                                             struct bsky_str endpoint);
 
-        if (sb->len == 0) {
-            char buf[] = { c, nullc };ic_arr*)da)->data
-            __bsky_da_append(sb, buf, sizeof(buf), 2);
-        }
-        else {
-            sb->data[sb->len-1] = c;
-            bsky_da_push(sb, nullc);
-        }
-    }
+    /**
+     * Set route from (cached) DID document. DID is taken from `id' field.
+     */
+    enum bsky_error_code bsky_pds_router_add_doc(struct bsky_pds_router *,
+                                                 struct bsky_json doc);
 
-    void bsky_sb_push_str(struct bsky_str_builder *sb, struct bsky_str str)
-    {
-        const char nullc = '\0';
+    /**
+     * Set endpoint for not PDS scoped calls and unknown DIDs.
+     */
+    enum bsky_error_code bsky_pds_router_set_fallback(struct bsky_pds_router*,
+                                                      struct bsky_str);
 
-        if (sb->len != 0) sb->len--; // remove null character.
+    /**
+     * Get route of DID or NULL if DID is unknown.
+     */
+    struct bsky_pds_route *bsky_pds_router_lookup(struct bsky_pds_router *,
+                                                  struct bsky_str did);
 
-        __bsky_da_append(sb, str.start, sizeof(char), str.end - str.start);
+    /**
+     * Route XRPC call of `nsid' made on behalf of (or about repo of) DID.
+     * On error `fd' of target is -1.
+     */
+    struct bsky_xrpc_target bsky_pds_router_route(struct bsky_pds_router *,
+                                                  struct bsky_str did,
+                                                  struct bsky_str nsid,
+                                                  enum bsky_error_code *);
 
-        if (sb->data[sb->len-1] != '\0') bsky_da_push(sb, nullc);
-    }
+    /**
+     * Return connection of target to the pool.
+     */
+    void bsky_pds_router_release(struct bsky_pds_router *,
+                                 struct bsky_xrpc_target *, int keep_alive);
 
-    #include <stdarg.h>
+    /**
+     * Close all connections and free router.
+     */
+    void bsky_pds_router_free(struct bsky_pds_router *);
 
-    void bsky_sb_push_fmt(struct bsky_str_builder *sb, char *fmt, ...)
-    {
-        va_list args;
-        va_start(args, fmt);
-        int len = vsnprintf(NULL, 0, fmt, args);
+
+/*
+ * module:
+ * ============================================================================
+ *                                  SHA-256
+ * ============================================================================
+*/
+    /**
+     * Incremental SHA-256 state.
+     */
+    struct bsky_sha256 {
+        uint32_t state[8];
+        uint64_t len;
+        unsigned char buf[64];
+        size_t   buf_len;
+    };
+
+    void bsky_sha256_init(struct bsky_sha256 *);
+    void bsky_sha256_update(struct bsky_sha256 *, const void *, size_t);
+    void bsky_sha256_final(struct bsky_sha256 *, unsigned char digest[32]);
+
+    /**
+     * Hash whole buffer at once.
+     */
+    void bsky_sha256(const void *, size_t, unsigned char digest[32]);
+
+    /**
+     * Block function used by all SHA-256 functions. By default the
+     * fastest one supported by CPU is selected on the first use:
+     *     - `Shani'    -- x86 SHA extensions;
+     *     - `Armv8'    -- ARMv8 crypto extensions;
+     *     - `Avx2'     -- portable code, but `bsky_sha256_many' hashes 8
+     *                     messages at once in AVX2 lanes;
+     *     - `Portable' -- plain C.
+     *
+     * NOTE: define `BSKY_SHA256_PORTABLE' to compile only portable code.
+     */
+    enum bsky_sha256_backend {
+        bsky_sha256_Auto,
+        bsky_sha256_Portable,
+        bsky_sha256_Avx2,
+        bsky_sha256_Shani,
+        bsky_sha256_Armv8,
+    };
+
+    /**
+     * Select backend (for benchmarks and tests). Return selected backend,
+     * which is `Portable' if requested one is not supported by CPU.
+     */
+    enum bsky_sha256_backend bsky_sha256_use(enum bsky_sha256_backend);
+
+    /**
+     * Hash many independent buffers (blocks of repo or firehose commit).
+     * Small buffers are hashed in parallel lanes when backend has them.
+     */
+    void bsky_sha256_many(const struct bsky_view *data, size_t len,
+                          unsigned char (*digests)[32]);
+
+
+/*
+ * module:
+ * ============================================================================
+ *                                BLOB UPLOAD
+ * ============================================================================
+*/
+    /**
+     * Size of chunk sent by one `sendfile' call and hashed between
+     * progress callbacks. Can be predefined.
+     */
+    #ifndef BSKY_BLOB_CHUNK
+        #define BSKY_BLOB_CHUNK (0x400 * 0x400)
+    #endif
+
+    /**
+     * `com.atproto.repo.uploadBlob' request streamed directly from file
+     * (with `sendfile') or from memory region, without copying blob into
+     * string builder. SHA-256 of the blob is computed chunk by chunk while
+     * it is sent, so after upload `sha256' and `cid' are ready and file
+     * was read only once.
+     *
+     * Input:
+     *      fd       -- plaintext socket connected to PDS.
+     *      host     -- value of `Host' header.
+     *      token    -- access JWT (can be empty).
+     *      mime     -- content type of the blob (`image/jpeg', ...).
+     *      progress -- optional callback called after every chunk.
+     *
+     * Output:
+     *      sent     -- number of blob bytes sent.
+     *      sha256   -- digest of the blob.
+     *
+     * NOTE: only request is sent. Response is left in socket.
+     */
+    struct bsky_blob_upload {
+        int fd;
+        struct bsky_str host, token, mime;
+
+        void (*progress)(void *user, size_t sent, size_t total);
+        void  *user;
+
+        size_t sent;
+        unsigned char sha256[32];
+    };
+
+    /**
+     * Upload blob from file descriptor. Regular files are mmapped for
+     * hashing and sent with `sendfile', other files (pipes, ...) are read
+     * by chunks.
+     */
+    enum bsky_error_code bsky_blob_upload_file(struct bsky_blob_upload *,
+                                               int file_fd);
+
+    /**
+     * Upload blob from memory region (for example mmapped by user).
+     */
+    enum bsky_error_code bsky_blob_upload_mem(struct bsky_blob_upload *,
+                                              struct bsky_view);
+
+    /**
+     * Temporary CID string (CIDv1, raw codec, sha2-256, base32) of blob
+     * with given SHA-256 digest. The same CID PDS returns in blob ref.
+     */
+    struct bsky_str bsky_tmp_blob_cid(const unsigned char sha256[32]);
+
+
+/*
+ * module:
+ * ============================================================================
+ *                               WRITE BATCHER
+ * ============================================================================
+*/
+    /**
+     * Server limits of `com.atproto.repo.applyWrites'. Can be predefined.
+     */
+    #ifndef BSKY_APPLY_WRITES_MAX
+        #define BSKY_APPLY_WRITES_MAX 200
+    #endif
+    #ifndef BSKY_APPLY_WRITES_MAX_BYTES
+        #define BSKY_APPLY_WRITES_MAX_BYTES (0x400 * 0x400)
+    #endif
+    #ifndef BSKY_APPLY_WRITES_DELAY_MS
+        #define BSKY_APPLY_WRITES_DELAY_MS 500
+    #endif
+
+    enum bsky_write_op {
+        bsky_write_Create,
+        bsky_write_Update,
+        bsky_write_Delete,
+    };
+
+    /**
+     * One write of `applyWrites'. `rkey' can be NULL for create, `value'
+     * is ignored for delete. Write is serialized when it is added to
+     * batcher, so strings and value can be freed right after that.
+     *
+     * `done' is called after batch of the write is flushed, with error
+     * code and (on success) result of the write:
+     *      { "$type": "...#createResult", "uri": ..., "cid": ... }
+     * Result is NULL if server did not return results. Result lives in
+     * tmp arena.
+     */
+    struct bsky_write {
+        enum bsky_write_op op;
+        char *collection, *rkey;
+        struct bsky_json value;
+
+        void (*done)(void *user, enum bsky_error_code,
+                     struct bsky_json *result);
+        void  *user;
+    };
+
+    /**
+     * Send callback used by batcher. It must POST `body' to
+     * `com.atproto.repo.applyWrites' of repo's PDS (see `bsky_pds_router'),
+     * store response body to `response' and return HTTP status, or
+     * negative number on transport error.
+     */
+    typedef int (*bsky_xrpc_post_fn)(void *user, struct bsky_str repo,
+                                     struct bsky_str body,
+                                     struct bsky_str *response);
+
+    /**
+     * Pending writes of one repo. Writes are serialized into `body' as
+     * they come, so flush of whole queue sends `body' without copying.
+     */
+    struct bsky_write_queue {
+        char *repo;
+        struct bsky_str_builder body;
+        size_t head; // length of `{"repo":...,"writes":[' in body
+        struct {
+            struct bsky_write_slot {
+                size_t start, end;
+                void (*done)(void *, enum bsky_error_code, struct bsky_json*);
+                void  *user;
+            } *data;
+            size_t len, cap;
+        } writes;
+
+        uint64_t first_ns;
+    };
+
+    /**
+     * Collect writes per repo and flush them as `applyWrites' calls.
+     * Queue of repo is flushed when it reaches `max_writes' writes,
+     * `max_bytes' bytes of body, or when oldest write waits longer than
+     * `max_delay_ms' (checked by `bsky_write_batcher_poll'). Zero limits
+     * mean `BSKY_APPLY_WRITES_*' defaults.
+     *
+     * If server rejects batch as too large (413, or 400 `Too many
+     * writes'), batch is split in halves and `max_writes' is lowered.
+     *
+     * Example:
+     *      struct bsky_write_batcher b = { .send = my_post, .user = ctx };
+     *
+     *      bsky_write_batcher_add(&b, did, (struct bsky_write) {
+     *          .op         = bsky_write_Create,
+     *          .collection = "app.bsky.feed.like",
+     *          .value      = like,
+     *          .done       = on_like_done,
+     *      });
+     *      ...
+     *      bsky_write_batcher_poll(&b);   // in main loop
+     *      ...
+     *      bsky_write_batcher_flush(&b);  // before exit
+     *      bsky_write_batcher_free(&b);
+     */
+    struct bsky_write_batcher {
+        size_t   max_writes, max_bytes;
+        uint64_t max_delay_ms;
+
+        bsky_xrpc_post_fn send;
+        void *user;
+
+        struct bsky_str_map repos;
+        struct { struct bsky_write_queue *data; size_t len, cap; } queues;
+    };
+
+    /**
+     * Add write to the queue of repo. Can flush queue.
+     */
+    enum bsky_error_code bsky_write_batcher_add(struct bsky_write_batcher *,
+                                                struct bsky_str repo,
+                                                struct bsky_write);
+
+    /**
+     * Flush queues whose oldest write is older than `max_delay_ms'.
+     */
+    enum bsky_error_code bsky_write_batcher_poll(struct bsky_write_batcher *);
+
+    /**
+     * Flush all queues.
+     */
+    enum bsky_error_code bsky_write_batcher_flush(struct bsky_write_batcher *);
+
+    /**
+     * Free batcher. Pending writes are dropped without calling callbacks.
+     */
+    void bsky_write_batcher_free(struct bsky_write_batcher *);
+
+
+/*
+ * module:
+ * ============================================================================
+ *                                EVENT LOOP
+ * ============================================================================
+*/
+    /**
+     * Events of file descriptor registered in loop.
+     */
+    enum bsky_loop_event {
+        bsky_loop_Read  = 1,
+        bsky_loop_Write = 2,
+        bsky_loop_Close = 4, // hang up or error
+    };
+
+    struct bsky_loop;
+
+    /**
+     * Callback of file descriptor. `events' is mask of `bsky_loop_event'.
+     */
+    typedef void (*bsky_loop_fd_fn)(struct bsky_loop *, int fd,
+                                    int events, void *user);
+
+    /**
+     * Callback of timer.
+     */
+    typedef void (*bsky_loop_timer_fn)(struct bsky_loop *, void *user);
+
+    /**
+     * Single threaded epoll event loop with one shot timers. Handlers are
+     * stored in array indexed by file descriptor, and timers in binary
+     * heap, so there is no allocation per event.
+     *
+     * Example:
+     *      struct bsky_loop loop = { 0 };
+     *      bsky_loop_init(&loop);
+     *      bsky_loop_add(&loop, listen_fd, bsky_loop_Read, on_accept, ctx);
+     *      bsky_loop_run(&loop);
+     *      bsky_loop_free(&loop);
+     */
+    struct bsky_loop {
+        int epfd, running;
+        void *user; // not used by loop
+
+        struct bsky_loop_handler {
+            bsky_loop_fd_fn fn; void *user;
+        } *handlers;
+        size_t handlers_cap;
+
+        struct {
+            struct bsky_loop_timer {
+                uint64_t deadline_ns;
+                bsky_loop_timer_fn fn; void *user;
+            } *data;
+            size_t len, cap;
+        } timers;
+    };
+
+    enum bsky_error_code bsky_loop_init(struct bsky_loop *);
+
+    /**
+     * Register file descriptor. File descriptor is made non-blocking.
+     */
+    enum bsky_error_code bsky_loop_add(struct bsky_loop *, int fd, int events,
+                                       bsky_loop_fd_fn, void *user);
+
+    /**
+     * Change events of registered file descriptor.
+     */
+    enum bsky_error_code bsky_loop_mod(struct bsky_loop *, int fd, int events);
+
+    /**
+     * Unregister file descriptor. File descriptor is not closed.
+     */
+    void bsky_loop_del(struct bsky_loop *, int fd);
+
+    /**
+     * Call `fn' once after `delay_ms' milliseconds.
+     */
+    enum bsky_error_code bsky_loop_timer(struct bsky_loop *, uint64_t delay_ms,
+                                         bsky_loop_timer_fn fn, void *user);
+
+    /**
+     * Wait for events at most `timeout_ms' (-1 is infinite) and dispatch
+     * them and expired timers.
+     */
+    enum bsky_error_code bsky_loop_run_once(struct bsky_loop *, int timeout_ms);
+
+    /**
+     * Run loop until `bsky_loop_stop' is called.
+     */
+    enum bsky_error_code bsky_loop_run(struct bsky_loop *);
+    void bsky_loop_stop(struct bsky_loop *);
+
+    void bsky_loop_free(struct bsky_loop *);
+
+
+/*
+ * module:
+ * ============================================================================
+ *                                 WEBSOCKET
+ * ============================================================================
+*/
+    /**
+     * Limit of reassembled message size. Can be predefined.
+     */
+    #ifndef BSKY_WS_MAX_MESSAGE
+        #define BSKY_WS_MAX_MESSAGE (0x10 * 0x400 * 0x400)
+    #endif
+
+    enum bsky_ws_opcode {
+        bsky_ws_Continuation = 0x0,
+        bsky_ws_Text         = 0x1,
+        bsky_ws_Binary       = 0x2,
+        bsky_ws_Close        = 0x8,
+        bsky_ws_Ping         = 0x9,
+        bsky_ws_Pong         = 0xA,
+    };
+
+    /**
+     * WebSocket client for event streams (`subscribeRepos',
+     * `subscribeLabels', Jetstream).
+     *
+     * Messages are delivered to `on_message' as views valid only until
+     * the callback returns:
+     *     - not fragmented message is view right into receive buffer;
+     *     - fragmented message is reassembled into `msg' buffer, which is
+     *       reused for next messages.
+     * Pings are answered automatically. `on_close' is called once with
+     * close code (1006 if connection was lost without close frame).
+     *
+     * Example:
+     *      struct bsky_ws ws = { .on_message = on_frame, .user = ctx };
+     *
+     *      bsky_ws_connect(&ws, bsky_mk_str(
+     *          "ws://localhost:6008/subscribe?wantedCollections=app.bsky.feed.post"),
+     *          &ec);
+     *      bsky_ws_attach(&ws, &loop);
+     *      bsky_loop_run(&loop);
+     *
+     * NOTE: there is no TLS in the library, so only `ws://' urls
+     *       (local relay, Jetstream or TLS terminating proxy) work.
+     */
+    struct bsky_ws {
+        int fd;
+
+        void (*on_message)(void *user, enum bsky_ws_opcode,
+                           struct bsky_view message);
+        void (*on_close)(void *user, int code);
+        void  *user;
+
+        size_t max_message; // 0 means `BSKY_WS_MAX_MESSAGE'
+
+        struct { char *data; size_t len, cap; } in, msg, out;
+        int msg_opcode, closed;
+
+        struct bsky_loop *loop;
+    };
+
+    /**
+     * Connect to `ws://host[:port]/path' and perform handshake.
+     * Connection is blocking until handshake is done and non-blocking
+     * after that.
+     */
+    enum bsky_error_code bsky_ws_connect(struct bsky_ws *, struct bsky_str url,
+                                         enum bsky_error_code *);
+
+    /**
+     * Perform client handshake on already connected socket.
+     */
+    enum bsky_error_code bsky_ws_handshake(struct bsky_ws *, int fd,
+                                           struct bsky_str host,
+                                           struct bsky_str path);
+
+    /**
+     * Register websocket in event loop. On every read event all available
+     * data is read and delivered.
+     */
+    enum bsky_error_code bsky_ws_attach(struct bsky_ws *, struct bsky_loop *);
+
+    /**
+     * Read all available data from socket and deliver messages.
+     */
+    enum bsky_error_code bsky_ws_read(struct bsky_ws *);
+
+    /**
+     * Deliver messages from raw stream bytes (for replay of captured
+     * traffic and tests). Masked frames are unmasked in place, so data
+     * can be modified.
+     */
+    enum bsky_error_code bsky_ws_feed(struct bsky_ws *, void *data, size_t len);
+
+    /**
+     * Send masked frame.
+     */
+    enum bsky_error_code bsky_ws_send(struct bsky_ws *, enum bsky_ws_opcode,
+                                      const void *data, size_t len);
+
+    /**
+     * Send close frame (if connection is open), close socket and free
+     * buffers.
+     */
+    void bsky_ws_free(struct bsky_ws *);
+
+    /**
+     * XOR data with 4 bytes masking key. Works with 8 bytes words, so
+     * compiler can vectorize the loop.
+     */
+    void bsky_ws_mask(void *data, size_t len, const unsigned char key[4]);
+
+    /**
+     * Temporary `Sec-WebSocket-Accept' value for `Sec-WebSocket-Key'.
+     */
+    struct bsky_str bsky_ws_accept_key(struct bsky_str key);
+
+
+/*
+ * module:
+ * ============================================================================
+ *                                 DAG-CBOR
+ * ============================================================================
+*/
+    #ifndef BSKY_CBOR_MAX_DEPTH
+        #define BSKY_CBOR_MAX_DEPTH 64
+    #endif
+
+    struct bsky_cbor_pair;
+
+    /**
+     * `bsky_cbor' is value of DAG-CBOR data model (firehose frames, repo
+     * blocks, records).
+     *
+     * Decoded tree does not copy any data: text strings, byte strings and
+     * links are views into the input, so the input must outlive the tree.
+     * Arrays and maps are allocated in tmp arena.
+     *
+     * NOTE: text strings are NOT null terminated.
+     * NOTE: `Link' is binary CID without multibase identity prefix.
+     */
+    struct bsky_cbor {
+        enum {
+            bsky_cbor_Int,   // integer in int64 range
+            bsky_cbor_Float, // 64 bit float
+            bsky_cbor_Bytes, // byte string
+            bsky_cbor_Str,   // UTF-8 text string
+            bsky_cbor_Arr,   // array
+            bsky_cbor_Map,   // map with text string keys
+            bsky_cbor_Bool,  // boolean
+            bsky_cbor_Null,  // null
+            bsky_cbor_Link,  // CID (tag 42)
+        } var;
+
+        union {
+            int64_t i;
+            double  f;
+            struct bsky_view bytes;
+            struct bsky_str  str;
+            struct { struct bsky_cbor      *data; size_t len; } arr;
+            struct { struct bsky_cbor_pair *data; size_t len; } map;
+            int _bool;
+        };
+    };
+
+    // pair to implement maps.
+    struct bsky_cbor_pair {
+        struct bsky_str key; struct bsky_cbor value;
+    };
+
+    /**
+     * Decode one DAG-CBOR item from the beginning of data and shift data
+     * to the end of the item (firehose frame is two items: header and
+     * body).
+     *
+     * Strict DAG-CBOR rules are checked: definite lengths, minimal
+     * integer and length encoding, text string map keys sorted by length
+     * and then bytewise without duplicates, only tag 42, only 64 bit
+     * floats (not NaN or infinity) and valid UTF-8.
+     */
+    struct bsky_cbor bsky_parse_cbor(struct bsky_view *data,
+                                     enum bsky_error_code *);
+
+    /**
+     * Validate and skip one DAG-CBOR item without building the tree.
+     * Nothing is allocated, so it is used to walk over parts of data
+     * which are not needed.
+     */
+    enum bsky_error_code bsky_cbor_skip(struct bsky_view *data);
+
+    /**
+     * Get value of map field by key. Return NULL if cbor is not map or
+     * there is no such field.
+     */
+    struct bsky_cbor *bsky_cbor_get(struct bsky_cbor *, const char *key);
+
+    /**
+     * Compare string with null terminated c string.
+     */
+    int bsky_cbor_str_eq(struct bsky_str, const char *);
+
+    typedef struct bsky_cbor      bsky_Cbor;
+    typedef struct bsky_cbor_pair bsky_Cbor_Pair;
+
+    #ifndef BSKY_CBOR_SORT_STACK
+        #define BSKY_CBOR_SORT_STACK 32
+    #endif
+
+    /**
+     * Encode tree as canonical DAG-CBOR. Encoded bytes are appended to
+     * string builder as is (without null terminator), so `sb.data' and
+     * `sb.len' is the encoding.
+     *
+     * Map keys are sorted by length and then bytewise. Keys of maps up to
+     * `BSKY_CBOR_SORT_STACK' entries are sorted on the stack, only bigger
+     * maps allocate.
+     */
+    enum bsky_error_code bsky_sb_push_cbor(struct bsky_str_builder *,
+                                           struct bsky_cbor);
+
+    /**
+     * Encode json tree as canonical DAG-CBOR (record in JSON form to
+     * record block):
+     *     - integral numbers are integers, other numbers are 64 bit floats;
+     *     - `{"$link": "b..."}' is CID link (tag 42);
+     *     - `{"$bytes": "..."}' is byte string (base64).
+     */
+    enum bsky_error_code bsky_sb_push_cbor_of_json(struct bsky_str_builder *,
+                                                   struct bsky_json);
+
+    /**
+     * Writer API to encode data without building tree. Maps and arrays
+     * are started with number of items, which must follow. Map keys must
+     * be pushed in canonical order (see `bsky_cbor_key_cmp').
+     */
+    void bsky_cbor_push_head(struct bsky_str_builder *, int major,
+                             uint64_t arg);
+    void bsky_cbor_push_int(struct bsky_str_builder *, int64_t);
+    void bsky_cbor_push_float(struct bsky_str_builder *, double);
+    void bsky_cbor_push_str(struct bsky_str_builder *, struct bsky_str);
+    void bsky_cbor_push_bytes(struct bsky_str_builder *, struct bsky_view);
+    void bsky_cbor_push_link(struct bsky_str_builder *, struct bsky_view cid);
+    void bsky_cbor_push_bool(struct bsky_str_builder *, int);
+    void bsky_cbor_push_null(struct bsky_str_builder *);
+    void bsky_cbor_push_arr(struct bsky_str_builder *, size_t len);
+    void bsky_cbor_push_map(struct bsky_str_builder *, size_t len);
+
+    /**
+     * Compare map keys in DAG-CBOR order: shorter key first, keys of equal
+     * length bytewise.
+     */
+    int bsky_cbor_key_cmp(struct bsky_str, struct bsky_str);
+
+    /**
+     * Temporary CID string (CIDv1, dag-cbor, sha2-256) of encoded record.
+     */
+    struct bsky_str bsky_tmp_record_cid(struct bsky_view cbor);
+
+
+/*
+ * module:
+ * ============================================================================
+ *                                  CAR V1
+ * ============================================================================
+*/
+    #ifndef BSKY_CAR_READ_CHUNK
+        #define BSKY_CAR_READ_CHUNK (0x400 * 0x400)
+    #endif
+
+    /**
+     * Maximum length of header or block frame, larger frames are
+     * `bsky_ec_Car_invalid' before buffer grows for them. Can be
+     * predefined.
+     */
+    #ifndef BSKY_CAR_MAX_BLOCK
+        #define BSKY_CAR_MAX_BLOCK (4 * 0x400 * 0x400)
+    #endif
+
+    /**
+     * Block of CAR file. Views point into mmapped file or into reader
+     * buffer of streaming source, where they are valid until the next
+     * block is read.
+     */
+    struct bsky_car_block {
+        struct bsky_view cid;    // binary CID
+        struct bsky_view data;   // block bytes (usually DAG-CBOR)
+        uint64_t         offset; // offset of block frame in CAR
+    };
+
+    // open addressing table from CID hash to block frame offset.
+    struct bsky_car_index_entry { uint64_t hash, offset; };
+    struct bsky_car_index {
+        struct bsky_car_index_entry *data; size_t len, cap;
+    };
+
+    /**
+     * Sequential CAR v1 reader (`com.atproto.sync.getRepo' response,
+     * repo exports).
+     *
+     * Source is either memory (mmapped file) or file descriptor (socket
+     * or pipe with response body), which is read in `BSKY_CAR_READ_CHUNK'
+     * chunks into reused buffer. Blocks are views, nothing is allocated
+     * per block.
+     *
+     * Example:
+     *      struct bsky_car_reader car;
+     *      struct bsky_car_block  block;
+     *
+     *      bsky_car_open_file(&car, "repo.car", &ec);
+     *      while (bsky_car_next(&car, &block, &ec)) {
+     *          ...
+     *      }
+     *      bsky_car_free(&car);
+     */
+    struct bsky_car_reader {
+        int fd;                // streaming source, -1 for memory
+        struct bsky_view mem;  // memory source
+        int mapped;            // `mem' is mmapped by reader
+
+        struct { char *data; size_t len, cap; } buf;
+        size_t   pos;          // position in memory or buffer
+        uint64_t offset;       // CAR offset of the buffer start
+
+        // header is copied, so roots are valid until reader is freed.
+        struct { char *data; size_t len, cap; } header;
+        struct { struct bsky_view *data; size_t len, cap; } roots;
+        uint64_t blocks_start;
+
+        struct bsky_car_index index;
+    };
+
+    /**
+     * Open CAR in memory. Data must outlive the reader.
+     */
+    enum bsky_error_code bsky_car_open_mem(struct bsky_car_reader *,
+                                           struct bsky_view data,
+                                           enum bsky_error_code *);
+
+    /**
+     * Open and mmap CAR file.
+     */
+    enum bsky_error_code bsky_car_open_file(struct bsky_car_reader *,
+                                            const char *path,
+                                            enum bsky_error_code *);
+
+    /**
+     * Open streaming CAR from file descriptor. `prefix' are bytes of the
+     * body already read from descriptor (with response headers), it is
+     * copied. Descriptor is not closed by reader.
+     */
+    enum bsky_error_code bsky_car_open_stream(struct bsky_car_reader *, int fd,
+                                              struct bsky_view prefix,
+                                              enum bsky_error_code *);
+
+    /**
+     * Read next block. Return 0 at the end of CAR or on error.
+     */
+    int bsky_car_next(struct bsky_car_reader *, struct bsky_car_block *,
+                      enum bsky_error_code *);
+
+    /**
+     * Build block offset index for random access. Works only for memory
+     * and mmapped CAR and does not move sequential position.
+     */
+    enum bsky_error_code bsky_car_build_index(struct bsky_car_reader *);
+
+    /**
+     * Find block by binary CID using index. Return 0 if there is no such
+     * block.
+     */
+    int bsky_car_find(struct bsky_car_reader *, struct bsky_view cid,
+                      struct bsky_car_block *);
+
+    /**
+     * Unmap file and free buffers and index.
+     */
+    void bsky_car_free(struct bsky_car_reader *);
+
+    /**
+     * Write CAR v1 header with roots.
+     */
+    void bsky_car_push_header(struct bsky_str_builder *,
+                              const struct bsky_view *roots, size_t len);
+
+    /**
+     * Write block frame.
+     */
+    void bsky_car_push_block(struct bsky_str_builder *, struct bsky_view cid,
+                             struct bsky_view data);
+
+
+/*
+ * module:
+ * ============================================================================
+ *                                    CID
+ * ============================================================================
+*/
+    enum bsky_multicodec {
+        bsky_multicodec_Sha2_256 = 0x12,
+        bsky_multicodec_Raw      = 0x55,
+        bsky_multicodec_Dag_pb   = 0x70,
+        bsky_multicodec_Dag_cbor = 0x71,
+    };
+
+    /**
+     * Content identifier: version, content codec and multihash.
+     *
+     * NOTE: CIDv0 (bare sha2-256 multihash, dag-pb) is parsed from
+     *       binary, but AT Protocol uses only CIDv1 and only it is
+     *       formatted as string (base32, `b' multibase prefix).
+     */
+    struct bsky_cid {
+        uint64_t version, codec, hash;
+        size_t   digest_len;
+        unsigned char digest[64];
+    };
+
+    /**
+     * Parse binary CID (tag 42 link, CAR block) and shift data.
+     */
+    struct bsky_cid bsky_cid_of_bytes(struct bsky_view *data,
+                                      enum bsky_error_code *);
+
+    /**
+     * Parse base32 CIDv1 string (`bafy...').
+     */
+    struct bsky_cid bsky_cid_of_str(struct bsky_str, enum bsky_error_code *);
+
+    /**
+     * CIDv1 with sha2-256 of data.
+     */
+    struct bsky_cid bsky_cid_of_data(enum bsky_multicodec codec,
+                                     struct bsky_view data);
+
+    /**
+     * Push binary CID (without identity multibase prefix of tag 42).
+     */
+    void bsky_sb_push_cid(struct bsky_str_builder *, struct bsky_cid);
+
+    /**
+     * Create temporary base32 string of CIDv1.
+     */
+    struct bsky_str bsky_tmp_str_of_cid(struct bsky_cid);
+
+    int bsky_cid_eq(struct bsky_cid, struct bsky_cid);
+
+    /**
+     * Check that data hashes to CID (only sha2-256 is supported).
+     */
+    int bsky_cid_verify(struct bsky_cid, struct bsky_view data);
+
+    /**
+     * Verify CAR blocks against their CIDs with `bsky_sha256_many'. Return
+     * number of valid blocks, result of each block is written to `ok'
+     * unless it is NULL.
+     */
+    size_t bsky_car_verify(const struct bsky_car_block *, size_t len,
+                           unsigned char *ok);
+
+
+/*
+ * module:
+ * ============================================================================
+ *                             MERKLE SEARCH TREE
+ * ============================================================================
+*/
+    /**
+     * Get block by binary CID. Block must stay valid while tree is used.
+     * Return 0 if there is no such block.
+     */
+    typedef int (*bsky_mst_fetch_fn)(void *user, struct bsky_view cid,
+                                     struct bsky_view *block);
+
+    /**
+     * Entry of the node. Key is full `collection/rkey', value is CID of
+     * record and `right' is CID of subtree with keys between this and
+     * the next entry (empty view if there is no subtree).
+     */
+    struct bsky_mst_entry {
+        struct bsky_str  key;
+        struct bsky_view value, right;
+    };
+
+    /**
+     * Decoded node. CIDs are views into block, keys are stored in `keys'.
+     */
+    struct bsky_mst_node {
+        struct bsky_view cid, left;
+        struct bsky_mst_entry *data; size_t len;
+        char *keys;
+    };
+
+    /**
+     * Repository Merkle Search Tree.
+     *
+     * Nodes are decoded only when they are reached and decoded nodes are
+     * cached by CID, so lookups share the path from root and diff of close
+     * revisions touches only changed subtrees.
+     *
+     * Example:
+     *      bsky_car_open_file(&car, "repo.car", &ec);
+     *      bsky_car_build_index(&car);
+     *      bsky_mst_init_car(&mst, &car, &ec);
+     *
+     *      bsky_mst_iter_init(&it, &mst);
+     *      while (bsky_mst_next(&it, &key, &record_cid, &ec)) {
+     *          ...
+     *      }
+     */
+    struct bsky_mst {
+        struct bsky_view  root;
+        bsky_mst_fetch_fn fetch;
+        void             *user;
+
+        // open addressing table of decoded nodes by CID.
+        struct { struct bsky_mst_node **data; size_t len, cap; } cache;
+        size_t loaded; // number of decoded nodes
+    };
+
+    struct __bsky_mst_frame { struct bsky_mst_node *node; size_t pos; };
+
+    /**
+     * In order iterator over entries.
+     */
+    struct bsky_mst_iter {
+        struct bsky_mst *mst;
+        struct { struct __bsky_mst_frame *data; size_t len, cap; } stack;
+        int started;
+    };
+
+    /**
+     * Init tree with root node CID and block source.
+     */
+    void bsky_mst_init(struct bsky_mst *, struct bsky_view root,
+                       bsky_mst_fetch_fn, void *user);
+
+    /**
+     * Init tree of repo CAR: root is `data' of the commit in CAR roots.
+     * CAR must be in memory and indexed (`bsky_car_build_index').
+     */
+    enum bsky_error_code bsky_mst_init_car(struct bsky_mst *,
+                                           struct bsky_car_reader *,
+                                           enum bsky_error_code *);
+
+    /**
+     * Get decoded node by CID.
+     */
+    enum bsky_error_code bsky_mst_node(struct bsky_mst *, struct bsky_view cid,
+                                       struct bsky_mst_node **);
+
+    /**
+     * Lookup record CID by key. Return 0 if there is no such key.
+     */
+    int bsky_mst_get(struct bsky_mst *, struct bsky_str key,
+                     struct bsky_view *value, enum bsky_error_code *);
+
+    void bsky_mst_iter_init(struct bsky_mst_iter *, struct bsky_mst *);
+
+    /**
+     * Get next entry. Return 0 at the end or on error.
+     */
+    int bsky_mst_next(struct bsky_mst_iter *, struct bsky_str *key,
+                      struct bsky_view *value, enum bsky_error_code *);
+
+    void bsky_mst_iter_free(struct bsky_mst_iter *);
+
+    /**
+     * Report changes from `from' revision to `to' revision in key order.
+     * Value of created record is empty view in `old', of deleted record in
+     * `new'. Equal subtrees are skipped without decoding.
+     */
+    typedef void (*bsky_mst_diff_fn)(void *user, enum bsky_write_op,
+                                     struct bsky_str key,
+                                     struct bsky_view old,
+                                     struct bsky_view new);
+
+    enum bsky_error_code bsky_mst_diff(struct bsky_mst *from,
+                                       struct bsky_mst *to,
+                                       bsky_mst_diff_fn, void *user);
+
+    /**
+     * Free cached nodes.
+     */
+    void bsky_mst_free(struct bsky_mst *);
+
+
+/*
+ * module:
+ * ============================================================================
+ *                              FIREHOSE PIPELINE
+ * ============================================================================
+*/
+    /**
+     * Default capacity of rings between stages (per shard). Can be
+     * predefined.
+     */
+    #ifndef BSKY_FIREHOSE_RING
+        #define BSKY_FIREHOSE_RING 1024
+    #endif
+
+    /**
+     * Bounded lock-free single-producer/single-consumer ring of pointers.
+     *
+     * Producer and consumer indices live on separate cache lines, each
+     * side keeps cached copy of the other index, so the shared line is
+     * touched only when ring looks full (empty).
+     */
+    struct bsky_spsc {
+        _Alignas(64) _Atomic size_t head; // consumer
+        size_t tail_cache;
+
+        _Alignas(64) _Atomic size_t tail; // producer
+        size_t head_cache;
+
+        _Alignas(64) void **data;
+        size_t mask;
+        _Atomic size_t max_depth;
+    };
+
+    /**
+     * Init ring, capacity is rounded up to power of two.
+     */
+    enum bsky_error_code bsky_spsc_init(struct bsky_spsc *, size_t cap);
+
+    /**
+     * Return 0 if ring is full.
+     */
+    int bsky_spsc_push(struct bsky_spsc *, void *);
+
+    /**
+     * Return NULL if ring is empty.
+     */
+    void *bsky_spsc_pop(struct bsky_spsc *);
+
+    /**
+     * Approximate number of items, may be called from any thread.
+     */
+    size_t bsky_spsc_depth(struct bsky_spsc *);
+
+    void bsky_spsc_free(struct bsky_spsc *);
+
+    /**
+     * Operation of `#commit' event.
+     */
+    struct bsky_firehose_op {
+        enum bsky_write_op op;
+        struct bsky_str    path; // `collection/rkey'
+        struct bsky_view   cid;  // record CID, empty for delete
+    };
+
+    /**
+     * Decoded `subscribeRepos' frame. Strings and views point into
+     * `frame', which is owned by the pipeline and reused after handler
+     * returns.
+     */
+    struct bsky_firehose_event {
+        struct bsky_view frame;
+        struct bsky_view body;  // raw CBOR of body for other fields
+
+        int64_t          op;    // header `op', -1 is error frame
+        struct bsky_str  type;  // header `t': `#commit', `#identity', ...
+        int64_t          seq;
+        struct bsky_str  repo;  // `repo' or `did'
+        struct bsky_str  rev, time;
+        struct bsky_view blocks; // CAR slice with commit and records
+
+        struct { struct bsky_firehose_op *data; size_t len, cap; } ops;
+
+        size_t shard;
+
+        // private
+        struct { char *data; size_t len, cap; } __buf;
+        int      __drop;
+        int64_t  __cursor; // `seq' found by reader, 0 if not tracked
+        uint64_t __pushed_ns, __decoded_ns;
+    };
+
+    struct bsky_firehose_config {
+        size_t shards; // 0 is half of online CPUs (at least 1)
+        size_t ring;   // 0 is `BSKY_FIREHOSE_RING'
+
+        /**
+         * Called on decoder thread, return 0 to drop event before it
+         * reaches handler. Can be NULL.
+         */
+        int (*filter)(void *user, const struct bsky_firehose_event *);
+
+        /**
+         * Called on handler thread of event shard. Default tmp arena of
+         * the thread is reset after every call.
+         */
+        void (*handler)(void *user, struct bsky_firehose_event *);
+
+        void *user;
+
+        /**
+         * Optional `seq' checkpoint, number of its workers is number of
+         * shards. Frames already seen are skipped.
+         */
+        struct bsky_checkpoint *checkpoint;
+
+        /**
+         * Optional repo and collection filters, applied before `filter'.
+         * DID filter is used only by reader thread.
+         */
+        struct bsky_prefilter *prefilter;
+    };
+
+    /**
+     * Queue depths and counters of one shard.
+     */
+    struct bsky_firehose_metrics {
+        size_t decode_depth, decode_max;   // reader -> decoder ring
+        size_t handle_depth, handle_max;   // decoder -> handler ring
+        uint64_t pushed, filtered, invalid, handled;
+        uint64_t stalls;     // pushes which waited for full ring
+        uint64_t duplicates; // frames skipped by checkpoint
+
+        // stage latency sums (ns) with queueing: push to decoded (divide
+        // by `pushed') and decoded to handled (divide by `handled').
+        uint64_t decode_ns, decode_ns_max;
+        uint64_t handle_ns, handle_ns_max;
+    };
+
+    struct __bsky_firehose_shard {
+        struct bsky_spsc decode, handle, free;
+        struct bsky_firehose *pipe;
+        pthread_t decoder, handler;
+        int decoder_started, handler_started;
+
+        _Atomic int      decoder_done;
+        _Atomic uint64_t pushed, stalls, filtered, invalid, handled;
+        _Atomic uint64_t duplicates;
+        _Atomic uint64_t decode_ns, decode_ns_max, handle_ns, handle_ns_max;
+    };
+
+    /**
+     * Parallel `subscribeRepos' consumer:
+     *
+     *  reader --> decoder[shard] --> filter --> handler[shard]
+     *
+     * Reader is the thread which calls `bsky_firehose_push' (usually
+     * websocket loop). It only finds repo DID of the frame, copies frame
+     * into recycled event and puts it to ring of shard `hash(DID) %
+     * shards', so events of one repo are decoded and handled in order,
+     * while different repos go in parallel. Decoder validates and decodes
+     * frame and runs filter on its thread, handler thread calls handler.
+     * Rings are bounded: when handler is slow, decoder waits, and then
+     * reader waits (backpressure propagates to socket).
+     *
+     * Example:
+     *      struct bsky_firehose pipe;
+     *      struct bsky_firehose_config config = { .handler = on_event };
+     *
+     *      bsky_firehose_start(&pipe, &config);
+     *
+     *      struct bsky_ws ws = {
+     *          .on_message = bsky_firehose_on_ws_message, .user = &pipe
+     *      };
+     *      ...
+     *      bsky_loop_run(&loop);
+     *      bsky_firehose_stop(&pipe);
+     */
+    struct bsky_firehose {
+        struct bsky_firehose_config config;
+
+        struct __bsky_firehose_shard *shards; size_t len;
+        _Atomic int stop;
+    };
+
+    /**
+     * Start decoder and handler threads.
+     */
+    enum bsky_error_code bsky_firehose_start(struct bsky_firehose *,
+                                             const struct bsky_firehose_config *);
+
+    /**
+     * Put frame to pipeline, frame is copied. Block while ring of the
+     * shard is full. Must be called from one thread.
+     */
+    enum bsky_error_code bsky_firehose_push(struct bsky_firehose *,
+                                            struct bsky_view frame);
+
+    /**
+     * `on_message' of `struct bsky_ws' with pipeline as `user'.
+     */
+    void bsky_firehose_on_ws_message(void *pipe, enum bsky_ws_opcode,
+                                     struct bsky_view message);
+
+    /**
+     * Decode frame into event (what decoder stage does).
+     */
+    enum bsky_error_code bsky_firehose_decode(struct bsky_firehose_event *,
+                                              struct bsky_view frame);
+
+    /**
+     * Fill metrics of every shard, return number of shards.
+     */
+    size_t bsky_firehose_metrics(struct bsky_firehose *,
+                                 struct bsky_firehose_metrics *, size_t len);
+
+    /**
+     * Process all pushed frames, stop threads and free pipeline.
+     */
+    void bsky_firehose_stop(struct bsky_firehose *);
+
+
+/*
+ * module:
+ * ============================================================================
+ *                             CURSOR CHECKPOINT
+ * ============================================================================
+*/
+    /**
+     * Default minimal interval between syncs of checkpoint file. Can be
+     * predefined.
+     */
+    #ifndef BSKY_CHECKPOINT_INTERVAL_MS
+        #define BSKY_CHECKPOINT_INTERVAL_MS 1000
+    #endif
+
+    struct __bsky_checkpoint_worker {
+        _Alignas(64) _Atomic int64_t started, base; // reader
+        _Alignas(64) _Atomic int64_t done;          // worker
+    };
+
+    /**
+     * Durable stream cursor (`seq' of subscribeRepos, `time_us' of
+     * Jetstream) for consumers with parallel workers.
+     *
+     * Reader calls `bsky_checkpoint_dispatch' before it gives event to a
+     * worker and worker calls `bsky_checkpoint_done' after event is
+     * processed; both are a couple of atomic stores. Every worker
+     * processes its events in order, so the low-watermark (the highest
+     * cursor below which every event is done) is computed from per-worker
+     * last dispatched and last done cursors without locks.
+     *
+     * `bsky_checkpoint_flush' writes the watermark not more often than
+     * `interval_ms' (fsync batching). File has two slots written in turn
+     * with generation and checksum, so torn write loses only the last
+     * checkpoint.
+     *
+     * Example:
+     *      bsky_checkpoint_open(&cp, "firehose.ckpt", shards, &ec);
+     *      bsky_checkpoint_attach(&cp, &loop);
+     *
+     *      bsky_ws_connect(&ws, bsky_checkpoint_url(&cp, bsky_mk_str(
+     *          "ws://localhost:2470/xrpc/com.atproto.sync.subscribeRepos")),
+     *          &ec);
+     *      ...
+     *      bsky_checkpoint_close(&cp);
+     */
+    struct bsky_checkpoint {
+        int fd;
+
+        struct __bsky_checkpoint_worker *data; size_t workers;
+
+        _Atomic int64_t last;   // the highest dispatched cursor
+        int64_t  resume;        // cursor loaded from file
+        int64_t  saved;         // the last written cursor
+
+        uint64_t interval_ms;   // 0 is `BSKY_CHECKPOINT_INTERVAL_MS'
+        uint64_t synced_ns, generation, syncs;
+
+        struct bsky_loop *loop;
+    };
+
+    /**
+     * Open (create) checkpoint file and load cursor to resume from (0 if
+     * there is no checkpoint yet).
+     */
+    enum bsky_error_code bsky_checkpoint_open(struct bsky_checkpoint *,
+                                              const char *path,
+                                              size_t workers,
+                                              enum bsky_error_code *);
+
+    /**
+     * Register event of `worker' (reader thread). Return 0 and ignore
+     * event, if cursor is not greater than the last one (replayed event
+     * after reconnect).
+     */
+    int bsky_checkpoint_dispatch(struct bsky_checkpoint *, size_t worker,
+                                 int64_t cursor);
+
+    /**
+     * Register event which is not given to any worker (dropped by reader
+     * thread), so watermark can move past it.
+     */
+    void bsky_checkpoint_skip(struct bsky_checkpoint *, int64_t cursor);
+
+    /**
+     * Mark event of `worker' as processed (worker thread).
+     */
+    void bsky_checkpoint_done(struct bsky_checkpoint *, size_t worker,
+                              int64_t cursor);
+
+    /**
+     * The highest cursor with all events up to it processed.
+     */
+    int64_t bsky_checkpoint_watermark(struct bsky_checkpoint *);
+
+    /**
+     * Write and sync watermark, if it was moved and `interval_ms' passed
+     * since the last sync (or `force' is set). Call from reader thread.
+     */
+    enum bsky_error_code bsky_checkpoint_flush(struct bsky_checkpoint *,
+                                               int force);
+
+    /**
+     * Flush checkpoint on timer of event loop every `interval_ms'.
+     */
+    enum bsky_error_code bsky_checkpoint_attach(struct bsky_checkpoint *,
+                                                struct bsky_loop *);
+
+    /**
+     * Temporary stream url with `cursor' query parameter to resume from
+     * (url as is when there is no checkpoint).
+     */
+    struct bsky_str bsky_checkpoint_url(struct bsky_checkpoint *,
+                                        struct bsky_str url);
+
+    /**
+     * Flush watermark, close file and free workers.
+     */
+    enum bsky_error_code bsky_checkpoint_close(struct bsky_checkpoint *);
+
+
+/*
+ * module:
+ * ============================================================================
+ *                                 PREFILTER
+ * ============================================================================
+*/
+    /**
+     * Largest hash table slot count tried while looking for seed. Can be
+     * predefined.
+     */
+    #ifndef BSKY_NSID_SET_MAX_SLOTS
+        #define BSKY_NSID_SET_MAX_SLOTS (0x400 * 0x400)
+    #endif
+
+    /**
+     * Set of collection NSIDs compiled into perfect hash table: lookup is
+     * one hash, one slot and one compare. Entry `app.bsky.feed.*' matches
+     * every collection with that prefix, `*' matches everything.
+     */
+    struct bsky_nsid_set {
+        struct { struct bsky_str nsid; int exact, prefix; } *data; size_t len;
+        uint32_t *table; // index + 1 of entry, 0 is empty slot
+        size_t    mask;
+        uint64_t  seed;
+        int       any, has_prefix;
+        char     *keys;
+    };
+
+    /**
+     * Build set. Strings are copied, duplicates are merged. Fails with
+     * Prefilter_build if no seed fits into BSKY_NSID_SET_MAX_SLOTS.
+     */
+    enum bsky_error_code bsky_nsid_set_build(struct bsky_nsid_set *,
+                                             const char **nsids, size_t len);
+
+    /**
+     * Check collection (`collection/rkey' path is also fine).
+     */
+    int bsky_nsid_set_has(const struct bsky_nsid_set *, struct bsky_str);
+
+    void bsky_nsid_set_free(struct bsky_nsid_set *);
+
+    /**
+     * Blocked bloom filter of DIDs with exact set behind it.
+     *
+     * Every DID sets 8 bits in one 64 bytes block (one bit per word), so
+     * negative answer, which is the common one, costs one cache miss.
+     * Positive answers of the bloom filter are confirmed by exact set.
+     */
+    struct bsky_did_filter {
+        uint64_t *blocks; size_t mask; // 8 words per block
+        struct bsky_str_map exact;
+        size_t len;
+        uint64_t bloom_hits, false_positives;
+    };
+
+    /**
+     * Init filter for about `expected' DIDs (it still works with more,
+     * but false positives rate grows).
+     */
+    enum bsky_error_code bsky_did_filter_init(struct bsky_did_filter *,
+                                              size_t expected);
+
+    enum bsky_error_code bsky_did_filter_add(struct bsky_did_filter *,
+                                             struct bsky_str did);
+
+    int bsky_did_filter_has(struct bsky_did_filter *, struct bsky_str did);
+
+    void bsky_did_filter_free(struct bsky_did_filter *);
+
+    /**
+     * Filters of firehose events, both are optional. Repo DID is checked
+     * by pipeline reader right after it finds DID, so events of other
+     * repos are never copied or decoded. Collections are checked by
+     * decoder after `ops' are decoded and before handler reads record
+     * blocks: `#commit' passes if any of ops matches; other events
+     * (`#identity', `#account', ...) are not filtered by collection.
+     */
+    struct bsky_prefilter {
+        struct bsky_nsid_set   *collections;
+        struct bsky_did_filter *dids;
+    };
+
+    int bsky_prefilter_repo(const struct bsky_prefilter *, struct bsky_str did);
+
+    int bsky_prefilter_ops(const struct bsky_prefilter *,
+                           const struct bsky_firehose_event *);
+
+
+/*
+ * module:
+ * ============================================================================
+ *                                 JETSTREAM
+ * ============================================================================
+*/
+    /**
+     * On-demand JSON cursor: walks text without building `bsky_json', so
+     * consumer reads only fields it needs and skips the rest. Strings are
+     * raw views without quotes (escapes are not decoded), skipped values
+     * are not validated.
+     *
+     * Example:
+     *      struct bsky_json_cursor c = { text.start, text.end };
+     *
+     *      bsky_json_cursor_object(&c, &ec);
+     *      while (bsky_json_cursor_field(&c, &key, &ec)) {
+     *          if (bsky_json_key_is(key, "did"))
+     *              bsky_json_cursor_str(&c, &did, &ec);
+     *          else
+     *              bsky_json_cursor_skip(&c, &ec);
+     *      }
+     */
+    struct bsky_json_cursor { const char *p, *end; int first; };
+
+    /**
+     * Enter object.
+     */
+    enum bsky_error_code bsky_json_cursor_object(struct bsky_json_cursor *,
+                                                 enum bsky_error_code *);
+
+    /**
+     * Go to the next field of the object and leave cursor on its value.
+     * Return 0 at the end of the object or on error.
+     */
+    int bsky_json_cursor_field(struct bsky_json_cursor *, struct bsky_str *key,
+                               enum bsky_error_code *);
+
+    /**
+     * Enter array.
+     */
+    enum bsky_error_code bsky_json_cursor_array(struct bsky_json_cursor *,
+                                                enum bsky_error_code *);
+
+    /**
+     * Go to the next element of the array and leave cursor on it. Return 0
+     * at the end of the array or on error.
+     */
+    int bsky_json_cursor_elem(struct bsky_json_cursor *,
+                              enum bsky_error_code *);
+
+    enum bsky_error_code bsky_json_cursor_str(struct bsky_json_cursor *,
+                                              struct bsky_str *,
+                                              enum bsky_error_code *);
+
+    int64_t bsky_json_cursor_int(struct bsky_json_cursor *,
+                                 enum bsky_error_code *);
+
+    /**
+     * Skip value and return its raw text.
+     */
+    struct bsky_str bsky_json_cursor_skip(struct bsky_json_cursor *,
+                                          enum bsky_error_code *);
+
+    /**
+     * Compare raw key with NUL terminated name.
+     */
+    int bsky_json_key_is(struct bsky_str key, const char *name);
+
+    /**
+     * Jetstream `commit' event. Strings are raw views into the message.
+     */
+    struct bsky_jetstream_commit {
+        struct bsky_str    did;
+        int64_t            time_us;
+        enum bsky_write_op op;
+        struct bsky_str    collection, rkey, rev, cid;
+        struct bsky_str    record; // raw JSON, empty for delete
+    };
+
+    struct bsky_jetstream_identity {
+        struct bsky_str did;
+        int64_t         time_us, seq;
+        struct bsky_str handle;
+    };
+
+    struct bsky_jetstream_account {
+        struct bsky_str did;
+        int64_t         time_us, seq;
+        int             active;
+        struct bsky_str status;
+    };
+
+    /**
+     * Decompress message into `out' (reused buffer). Return 0 on error.
+     */
+    typedef int (*bsky_jetstream_decompress_fn)(void *user,
+                                                struct bsky_view in,
+                                                struct bsky_str_builder *out);
+
+    /**
+     * Jetstream consumer.
+     *
+     * Text messages are JSON events, binary messages are compressed
+     * events and are decompressed by `decompress' into reused buffer.
+     * With `BSKY_API_ZSTD' defined (link with -lzstd)
+     * `bsky_jetstream_use_zstd' installs zstd decompressor with
+     * Jetstream dictionary.
+     *
+     * Event is read with JSON cursor: `did' and `time_us' first, so
+     * events of filtered repos or already seen cursors are dropped
+     * before the rest is read; `commit.record' is only skipped over and
+     * given to callback as raw JSON.
+     *
+     * Example:
+     *      struct bsky_jetstream js = { .on_commit = on_commit };
+     *      struct bsky_ws ws = {
+     *          .on_message = bsky_jetstream_on_ws_message, .user = &js
+     *      };
+     *
+     *      bsky_ws_connect(&ws, bsky_mk_str("ws://localhost:6008/subscribe"
+     *          "?wantedCollections=app.bsky.feed.post"), &ec);
+     */
+    struct bsky_jetstream {
+        void (*on_commit)(void *user, const struct bsky_jetstream_commit *);
+        void (*on_identity)(void *user, const struct bsky_jetstream_identity *);
+        void (*on_account)(void *user, const struct bsky_jetstream_account *);
+        void *user;
+
+        struct bsky_prefilter  *prefilter;  // optional
+        struct bsky_checkpoint *checkpoint; // optional, `time_us' of worker 0
+
+        bsky_jetstream_decompress_fn decompress;
+        void                        *decompress_user;
+        struct bsky_str_builder      buf;
+
+        uint64_t events, filtered, invalid;
+    };
+
+    /**
+     * Handle one message (JSON text or compressed with `compressed' set).
+     */
+    enum bsky_error_code bsky_jetstream_feed(struct bsky_jetstream *,
+                                             struct bsky_view message,
+                                             int compressed);
+
+    /**
+     * `on_message' of `struct bsky_ws' with consumer as `user'.
+     */
+    void bsky_jetstream_on_ws_message(void *js, enum bsky_ws_opcode,
+                                      struct bsky_view message);
+
+    #ifdef BSKY_API_ZSTD
+        /**
+         * Use zstd with dictionary (Jetstream `zstd_dictionary' file).
+         */
+        enum bsky_error_code bsky_jetstream_use_zstd(struct bsky_jetstream *,
+                                                     struct bsky_view dict);
+    #endif
+
+    /**
+     * Free buffer (and zstd context).
+     */
+    void bsky_jetstream_free(struct bsky_jetstream *);
+
+
+/*
+ * module:
+ * ============================================================================
+ *                           SIGNATURE VERIFICATION
+ * ============================================================================
+*/
+    #ifndef BSKY_VERIFY_QUEUE
+        #define BSKY_VERIFY_QUEUE 4096
+    #endif
+
+    #ifndef BSKY_VERIFY_BATCH
+        #define BSKY_VERIFY_BATCH 32
+    #endif
+
+    enum bsky_key_type {
+        bsky_key_Secp256k1, // multicodec 0xe7
+        bsky_key_P256,      // multicodec 0x1200
+    };
+
+    /**
+     * Public key from `did:key' or `publicKeyMultibase' of DID document.
+     * Point is compressed.
+     */
+    struct bsky_pubkey {
+        enum bsky_key_type type;
+        unsigned char      point[33];
+    };
+
+    /**
+     * Decode `did:key:z...' or multibase `z...' (base58btc, multicodec
+     * prefixed key).
+     */
+    enum bsky_error_code bsky_pubkey_of_did_key(struct bsky_str,
+                                                struct bsky_pubkey *);
+
+    /**
+     * Crypto backend. Keys are parsed once per DID and shared between
+     * workers, so `verify' must be thread safe for the same key.
+     *
+     * Signature is compact `r || s', high-S signatures are rejected
+     * before `verify' is called.
+     */
+    struct bsky_crypto {
+        void *(*key_new)(void *user, const struct bsky_pubkey *);
+        void  (*key_free)(void *user, void *key);
+        int   (*verify)(void *user, void *key, const unsigned char digest[32],
+                        const unsigned char sig[64]);
+        void *user;
+    };
+
+    #ifdef BSKY_API_OPENSSL
+        /**
+         * OpenSSL (libcrypto 3) backend, link with -lcrypto.
+         */
+        struct bsky_crypto bsky_crypto_openssl(void);
+    #endif
+
+    enum bsky_verify_status {
+        bsky_verify_Ok,
+        bsky_verify_Bad_signature,
+        bsky_verify_No_key,     // DID has no key and `resolve' failed
+        bsky_verify_Invalid,    // malformed commit or `did' mismatch
+    };
+
+    // immutable, replaced keys live until verifier is stopped.
+    struct __bsky_verify_key {
+        struct bsky_pubkey pubkey;
+        void              *key;
+    };
+
+    struct __bsky_verify_job {
+        struct __bsky_verify_key *key;
+        struct bsky_str           did;    // owned
+        struct bsky_view          commit; // owned
+        void                     *user;
+    };
+
+    /**
+     * Commit signature verification pool.
+     *
+     * `bsky_verifier_submit' copies commit block and looks up parsed key
+     * of DID in cache (`resolve' is called for unknown DIDs on submitting
+     * thread), workers take jobs in batches of `batch' under one lock,
+     * re-encode commit without `sig', hash it and verify. Result is
+     * reported on worker thread. Submit blocks when `queue' jobs are
+     * pending.
+     *
+     * Example:
+     *      struct bsky_verifier v = {
+     *          .crypto = bsky_crypto_openssl(), .on_result = on_result,
+     *      };
+     *
+     *      bsky_verifier_start(&v);
+     *      bsky_verifier_set_key(&v, did, &pubkey);
+     *      bsky_verifier_submit(&v, did, commit_block, job);
+     *      ...
+     *      bsky_verifier_stop(&v);
+     */
+    struct bsky_verifier {
+        struct bsky_crypto crypto;
+
+        /**
+         * Find key of unknown DID (from DID document). Return 0 if there
+         * is no key. Can be NULL.
+         */
+        int (*resolve)(void *user, struct bsky_str did, struct bsky_pubkey *);
+
+        void (*on_result)(void *user, void *job, enum bsky_verify_status);
+        void *user;
+
+        size_t workers; // 0 is online CPUs
+        size_t batch;   // 0 is `BSKY_VERIFY_BATCH'
+        size_t queue;   // 0 is `BSKY_VERIFY_QUEUE'
+
+        _Atomic uint64_t verified, failed;
+
+        // private
+        pthread_mutex_t lock;
+        pthread_cond_t  has_jobs, has_space, idle;
+        struct __bsky_verify_job *jobs;
+        size_t head, len, busy;
+        int    stop;
+        struct { pthread_t *data; size_t len, cap; } threads;
+
+        struct bsky_str_map keys;
+        struct { struct __bsky_verify_key **data; size_t len, cap; } key_list;
+    };
+
+    enum bsky_error_code bsky_verifier_start(struct bsky_verifier *);
+
+    /**
+     * Set (or rotate) key of DID.
+     */
+    enum bsky_error_code bsky_verifier_set_key(struct bsky_verifier *,
+                                               struct bsky_str did,
+                                               const struct bsky_pubkey *);
+
+    /**
+     * Queue signed commit block of DID.
+     */
+    enum bsky_error_code bsky_verifier_submit(struct bsky_verifier *,
+                                              struct bsky_str did,
+                                              struct bsky_view commit,
+                                              void *job);
+
+    /**
+     * Queue commit of firehose `#commit' event (root block of `blocks').
+     */
+    enum bsky_error_code bsky_verifier_submit_event(
+        struct bsky_verifier *, const struct bsky_firehose_event *, void *job);
+
+    /**
+     * Wait until all queued jobs are reported.
+     */
+    void bsky_verifier_wait(struct bsky_verifier *);
+
+    /**
+     * Finish queued jobs, join workers and free keys.
+     */
+    void bsky_verifier_stop(struct bsky_verifier *);
+
+
+/*
+ * module:
+ * ============================================================================
+ *                              CAPTURE & REPLAY
+ * ============================================================================
+*/
+    #ifndef BSKY_CAPTURE_BUFFER
+        #define BSKY_CAPTURE_BUFFER (0x400 * 0x400)
+    #endif
+
+    #define BSKY_CAPTURE_MAGIC "BSKYCAP1"
+
+    /**
+     * Capture of stream traffic for reproducible benchmarks.
+     *
+     * File is `BSKY_CAPTURE_MAGIC' and records (little endian):
+     *      u32 frame length | u64 receive time, ns | WebSocket frame
+     * where frame is unmasked server frame with one complete message, so
+     * replay goes through the same WebSocket parser as live traffic.
+     *
+     * Records are written into `BSKY_CAPTURE_BUFFER' buffer and flushed
+     * with sequential writes.
+     *
+     * Example:
+     *      struct bsky_capture cap = {
+     *          .on_message = bsky_firehose_on_ws_message, .user = &pipe,
+     *      };
+     *      struct bsky_ws ws = {
+     *          .on_message = bsky_capture_on_ws_message, .user = &cap,
+     *      };
+     *
+     *      bsky_capture_open(&cap, "firehose.cap", &ec);
+     *      ...
+     *      bsky_capture_close(&cap);
+     */
+    struct bsky_capture {
+        // captured messages are forwarded here, can be NULL.
+        void (*on_message)(void *user, enum bsky_ws_opcode,
+                           struct bsky_view message);
+        void *user;
+
+        uint64_t frames, bytes;
+
+        // private
+        int fd;
+        struct { char *data; size_t len, cap; } buf;
+    };
+
+    /**
+     * Create (truncate) capture file.
+     */
+    enum bsky_error_code bsky_capture_open(struct bsky_capture *,
+                                           const char *path,
+                                           enum bsky_error_code *);
+
+    /**
+     * Append message received at `time_ns' (any clock, replay uses only
+     * differences).
+     */
+    enum bsky_error_code bsky_capture_write(struct bsky_capture *,
+                                            uint64_t time_ns,
+                                            enum bsky_ws_opcode,
+                                            struct bsky_view message);
+
+    /**
+     * `on_message' of `struct bsky_ws' with capture as `user', records
+     * message with monotonic time and forwards it.
+     */
+    void bsky_capture_on_ws_message(void *cap, enum bsky_ws_opcode,
+                                    struct bsky_view message);
+
+    /**
+     * Flush buffer and close file.
+     */
+    enum bsky_error_code bsky_capture_close(struct bsky_capture *);
+
+    struct bsky_replay {
+        struct bsky_view data; // mmapped capture
+        size_t pos;
+    };
+
+    struct bsky_replay_stats {
+        uint64_t frames, bytes;
+        uint64_t elapsed_ns;
+        uint64_t feed_ns, feed_max_ns; // WebSocket parser and `on_message'
+        uint64_t late_max_ns;          // paced: lag behind recorded time
+    };
+
+    /**
+     * Map capture file. Mapping is private and writable, because
+     * WebSocket parser may unmask frames in place.
+     */
+    enum bsky_error_code bsky_replay_open(struct bsky_replay *,
+                                          const char *path,
+                                          enum bsky_error_code *);
+
+    /**
+     * Read next record. Return 0 at the end or on error.
+     */
+    int bsky_replay_next(struct bsky_replay *, struct bsky_view *frame,
+                         uint64_t *time_ns, enum bsky_error_code *);
+
+    /**
+     * Feed all frames from current position into `ws' (with `fd' -1 and
+     * `on_message' set), as fast as possible or, with `paced', at
+     * recorded pace. `stats' can be NULL.
+     */
+    enum bsky_error_code bsky_replay_run(struct bsky_replay *,
+                                         struct bsky_ws *, int paced,
+                                         struct bsky_replay_stats *);
+
+    void bsky_replay_rewind(struct bsky_replay *);
+    void bsky_replay_free(struct bsky_replay *);
+
+
+/*
+ * module:
+ * ============================================================================
+ *                                 BACKFILL
+ * ============================================================================
+*/
+    #ifndef BSKY_BACKFILL_CONCURRENCY
+        #define BSKY_BACKFILL_CONCURRENCY 32
+    #endif
+    #ifndef BSKY_BACKFILL_PER_HOST
+        #define BSKY_BACKFILL_PER_HOST 4
+    #endif
+    #ifndef BSKY_BACKFILL_RATE
+        #define BSKY_BACKFILL_RATE 10.0 // getRepo calls per second per host
+    #endif
+    #ifndef BSKY_BACKFILL_RETRIES
+        #define BSKY_BACKFILL_RETRIES 5
+    #endif
+    #ifndef BSKY_BACKFILL_SYNC_MS
+        #define BSKY_BACKFILL_SYNC_MS 1000
+    #endif
+
+    /**
+     * Open `com.atproto.sync.getRepo' of DID on PDS `host'. Return
+     * descriptor to read CAR body from (socket after response headers,
+     * pipe of `curl' ...) and put body bytes already read with headers to
+     * `prefix'. On failure return -1 for transport error or negated HTTP
+     * status (-429 pauses the host). Descriptor is closed by scheduler.
+     */
+    typedef int (*bsky_backfill_fetch_fn)(void *user, struct bsky_str did,
+                                          struct bsky_str host,
+                                          struct bsky_str_builder *prefix);
+
+    struct __bsky_backfill_job {
+        char *did;
+        int   attempts;
+    };
+
+    struct __bsky_backfill_host {
+        char  *host;
+        size_t limit, active;
+        double rate, tokens;
+        uint64_t refill_ns, paused_until_ns;
+        int    strikes; // 429 in a row
+        struct { struct __bsky_backfill_job *data; size_t len, cap; } jobs;
+        size_t head;
+    };
+
+    /**
+     * Repo backfill scheduler (`listRepos' -> `getRepo' of every DID).
+     *
+     * Repos are downloaded by `concurrency' workers, with at most
+     * `per_host' downloads and `rate' calls per second (token bucket) per
+     * PDS host. Host answering 429 is paused with exponential backoff and
+     * its job is retried; transport errors are retried `retries' times.
+     *
+     * CAR is streamed into MST walk: commit gives root node, nodes give
+     * keys of records and records are reported to `on_record' (on worker
+     * thread, in CAR order) as soon as both record block and its key are
+     * known. Only blocks which come before their parent node are kept in
+     * memory, so record which is under several keys is reported with
+     * empty `record' to keys which are reached after its block.
+     *
+     * With progress file every finished repo (done or failed
+     * permanently) is appended to it and file is synced every
+     * `BSKY_BACKFILL_SYNC_MS', so after restart finished repos are
+     * skipped by `bsky_backfill_add'.
+     *
+     * Example:
+     *      struct bsky_backfill bf = {
+     *          .fetch = get_repo, .on_record = on_record,
+     *      };
+     *
+     *      bsky_backfill_start(&bf, "backfill.progress");
+     *      do {
+     *          body   = list_repos(pds, cursor);
+     *          cursor = bsky_backfill_add_list(&bf, pds, body, &ec);
+     *      } while (cursor.start != cursor.end);
+     *      bsky_backfill_stop(&bf);
+     */
+    struct bsky_backfill {
+        bsky_backfill_fetch_fn fetch;
+
+        void (*on_record)(void *user, struct bsky_str did,
+                          struct bsky_str key, struct bsky_view cid,
+                          struct bsky_view record);
+        // called once per repo, can be NULL.
+        void (*on_repo)(void *user, struct bsky_str did,
+                        enum bsky_error_code);
+        void *user;
+
+        size_t concurrency; // 0 is `BSKY_BACKFILL_CONCURRENCY'
+        size_t per_host;    // 0 is `BSKY_BACKFILL_PER_HOST'
+        double rate;        // 0 is `BSKY_BACKFILL_RATE'
+        int    retries;     // 0 is `BSKY_BACKFILL_RETRIES'
+
+        _Atomic uint64_t repos, failed, skipped, records, rate_limited;
+
+        // private
+        pthread_mutex_t lock;
+        pthread_cond_t  wake, idle;
+        struct bsky_str_map host_index;
+        struct { struct __bsky_backfill_host *data; size_t len, cap; } hosts;
+        size_t next_host, pending, active;
+        int    stop;
+        struct { pthread_t *data; size_t len, cap; } threads;
+
+        int fd; // progress file
+        struct bsky_str_map done;
+        uint64_t synced_ns;
+        int      dirty;
+    };
+
+    /**
+     * Load progress file (can be NULL) and start workers.
+     */
+    enum bsky_error_code bsky_backfill_start(struct bsky_backfill *,
+                                             const char *progress);
+
+    /**
+     * Set limits of host, zero limit keeps default.
+     */
+    enum bsky_error_code bsky_backfill_host(struct bsky_backfill *,
+                                            struct bsky_str host,
+                                            size_t concurrency, double rate);
+
+    /**
+     * Queue repo on PDS host. Finished repos of progress file are
+     * skipped.
+     */
+    enum bsky_error_code bsky_backfill_add(struct bsky_backfill *,
+                                           struct bsky_str did,
+                                           struct bsky_str host);
+
+    /**
+     * Queue active repos of `com.atproto.sync.listRepos' response of host
+     * and return `cursor' of the next page (empty at the end), it points
+     * into response.
+     */
+    struct bsky_str bsky_backfill_add_list(struct bsky_backfill *,
+                                           struct bsky_str host,
+                                           struct bsky_str response,
+                                           enum bsky_error_code *);
+
+    /**
+     * Return 1 if repo is finished in this or previous run.
+     */
+    int bsky_backfill_done(struct bsky_backfill *, struct bsky_str did);
+
+    /**
+     * Wait until all queued repos are finished.
+     */
+    void bsky_backfill_wait(struct bsky_backfill *);
+
+    /**
+     * Wait for queued repos, stop workers, sync progress and free.
+     */
+    void bsky_backfill_stop(struct bsky_backfill *);
+
+
+/*
+ * module:
+ * ============================================================================
+ *                                LABEL INDEX
+ * ============================================================================
+*/
+    /**
+     * Label of `com.atproto.label.subscribeLabels'. Strings point into
+     * frame.
+     */
+    struct bsky_label {
+        struct bsky_str src; // DID of labeler
+        struct bsky_str uri; // subject: at:// URI of record or DID
+        struct bsky_str val;
+        int             neg;
+        int64_t         exp; // unix seconds, 0 never expires
+    };
+
+    struct bsky_label_entry { uint32_t src, val; int64_t exp; };
+
+    // immutable, replaced as whole. Key follows entries.
+    struct __bsky_label_subject {
+        size_t   hash;
+        uint32_t key_len, len;
+        struct bsky_label_entry data[];
+    };
+
+    struct __bsky_label_table {
+        size_t cap, used; // used counts tombstones
+        _Atomic(struct __bsky_label_subject *) slots[];
+    };
+
+    /**
+     * Active labels by subject.
+     *
+     * Labeler DIDs and values are interned to ids once
+     * (`bsky_label_id'), so check on serving path is a single hash probe
+     * of subject and scan of its few labels, without locks: subject
+     * entries are immutable and writer publishes new one with atomic
+     * store. Replaced entries and tables are retired to epoch
+     * reclamation.
+     *
+     * Negation removes label, newer label of the same labeler and value
+     * replaces expiry. Expired labels are not reported and are removed by
+     * `bsky_label_index_expire'.
+     *
+     * Example:
+     *      uint32_t mod  = bsky_label_id(&idx, bsky_mk_str(MOD_DID));
+     *      uint32_t porn = bsky_label_id(&idx, bsky_mk_str("porn"));
+     *
+     *      if (bsky_label_index_has(&idx, post_uri, mod, porn))
+     *          skip(post);
+     */
+    struct bsky_label_index {
+        _Atomic(struct __bsky_label_table *) table;
+
+        // writer
+        pthread_mutex_t     lock;
+        struct bsky_str_map names;
+        size_t   subjects, labels;
+        int64_t  next_exp;
+    };
+
+    enum bsky_error_code bsky_label_index_init(struct bsky_label_index *);
+
+    /**
+     * Id of labeler DID or label value, 0 if out of memory. Ids are
+     * stable for lifetime of index.
+     */
+    uint32_t bsky_label_id(struct bsky_label_index *, struct bsky_str name);
+
+    /**
+     * Apply label or negation, can be called from any thread.
+     */
+    enum bsky_error_code bsky_label_index_apply(struct bsky_label_index *,
+                                                const struct bsky_label *);
+
+    /**
+     * Return 1 if subject has not expired label `val' by labeler `src'
+     * (0 is any labeler). Lock free, can be called from any thread.
+     */
+    int bsky_label_index_has(struct bsky_label_index *, struct bsky_str subject,
+                             uint32_t src, uint32_t val);
+
+    /**
+     * Remove labels expired at `now' (unix seconds). Return number of
+     * removed labels.
+     */
+    size_t bsky_label_index_expire(struct bsky_label_index *, int64_t now);
+
+    /**
+     * Free index, there must be no readers.
+     */
+    void bsky_label_index_free(struct bsky_label_index *);
+
+    /**
+     * `subscribeLabels' consumer which applies `#labels' frames to
+     * `index'. `seq' is cursor to resume from.
+     *
+     * Example:
+     *      struct bsky_label_stream ls = { .index = &idx };
+     *      struct bsky_ws ws = {
+     *          .on_message = bsky_label_stream_on_ws_message, .user = &ls
+     *      };
+     */
+    struct bsky_label_stream {
+        struct bsky_label_index *index;
+
+        // called after label is applied, can be NULL.
+        void (*on_label)(void *user, const struct bsky_label *);
+        void  *user;
+
+        int64_t  seq;
+        uint64_t events, labels, invalid;
+
+        // private
+        struct bsky_firehose_event ev;
+    };
+
+    /**
+     * Handle one binary frame.
+     */
+    enum bsky_error_code bsky_label_stream_feed(struct bsky_label_stream *,
+                                                struct bsky_view frame);
+
+    /**
+     * `on_message' of `struct bsky_ws' with consumer as `user'.
+     */
+    void bsky_label_stream_on_ws_message(void *ls, enum bsky_ws_opcode,
+                                         struct bsky_view message);
+
+    void bsky_label_stream_free(struct bsky_label_stream *);
+
+
+/*
+ * module:
+ * ============================================================================
+ *                             EPOCH RECLAMATION
+ * ============================================================================
+*/
+    /**
+     * Retired objects of thread between attempts to advance epoch. Can be
+     * predefined.
+     */
+    #ifndef BSKY_EBR_COLLECT
+        #define BSKY_EBR_COLLECT 64
+    #endif
+
+    /**
+     * Epoch based reclamation for structures read without locks and
+     * updated rarely (label index, caches, routing tables).
+     *
+     * Reader wraps access into `bsky_ebr_enter' / `bsky_ebr_leave', which
+     * only publish global epoch in record of the thread (no shared
+     * writes). Writer unlinks object, then `bsky_ebr_retire's it; object
+     * is freed after epoch advanced twice, when no reader which could
+     * see it is left. Epoch advances only if every thread inside
+     * critical section has seen the current one.
+     *
+     * Threads are registered on first use and unregistered at exit;
+     * objects retired by exited thread are freed by others.
+     *
+     * JSON parsed into default tmp arena can be shared too: after
+     * publishing it writer calls `bsky_ebr_retire_tmp' instead of
+     * `bsky_default_tmp_reset', the arena block goes to readers' grace
+     * period and thread continues with another block (blocks are reused
+     * from pool of `BSKY_TMP_POOL').
+     *
+     * Example:
+     *      // reader
+     *      bsky_ebr_enter();
+     *      struct config *c = atomic_load(&current);
+     *      use(c->json);
+     *      bsky_ebr_leave();
+     *
+     *      // writer
+     *      bsky_parse_json(&text, &ec);
+     *      old = atomic_exchange(&current, new);
+     *      bsky_ebr_retire(old, free);
+     *      bsky_ebr_retire_tmp();
+     *
+     * NOTE: critical sections can be nested, but must not block: while
+     *       thread is inside, nothing retired after it entered is freed.
+     */
+    void bsky_ebr_enter(void);
+    void bsky_ebr_leave(void);
+
+    /**
+     * Free `ptr' with `free_fn' after grace period.
+     */
+    enum bsky_error_code bsky_ebr_retire(void *ptr, void (*free_fn)(void *));
+
+    /**
+     * Retire current block of default tmp arena of the thread.
+     */
+    enum bsky_error_code bsky_ebr_retire_tmp(void);
+
+    /**
+     * Try to advance epoch and free objects of the thread (and of exited
+     * threads) which are out of grace period. Return number of freed.
+     */
+    size_t bsky_ebr_collect(void);
+
+    /**
+     * Wait until everything retired by the thread and by exited threads
+     * is freed. Must be called outside of critical section.
+     */
+    void bsky_ebr_flush(void);
+
+
+/*
+ * module:
+ * ============================================================================
+ *                                THREAD POOL
+ * ============================================================================
+*/
+    /**
+     * Initial capacity of worker deque, it grows when full. Can be
+     * predefined.
+     */
+    #ifndef BSKY_POOL_DEQUE
+        #define BSKY_POOL_DEQUE 256
+    #endif
+
+    /**
+     * Tasks of `bsky_pool_submit' with common `bsky_pool_wait'.
+     */
+    struct bsky_task_group {
+        _Atomic uint32_t pending;
+    };
+
+    /**
+     * Task is owned by caller and must live until it is finished.
+     */
+    struct bsky_task {
+        void (*fn)(void *arg);
+        void  *arg;
+        struct bsky_task_group *group; // can be NULL
+    };
+
+    struct __bsky_deque_array {
+        int64_t size;
+        _Atomic(struct bsky_task *) data[];
+    };
+
+    // Chase-Lev deque: owner pushes and takes at bottom, thieves steal at
+    // top.
+    struct __bsky_deque {
+        _Atomic int64_t top, bottom;
+        _Atomic(struct __bsky_deque_array *) array;
+    };
+
+    struct __bsky_pool_worker {
+        struct __bsky_deque deque;
+        struct bsky_pool   *pool;
+        size_t     index;
+        pthread_t  thread;
+        uint64_t   seed;
+        _Atomic int reset_tmp;
+    };
+
+    /**
+     * Work-stealing thread pool for CPU work (parsing, encoding, hashing).
+     *
+     * Every worker has its own deque: tasks submitted by worker go to the
+     * bottom of its deque and are taken LIFO (cache is warm), idle
+     * workers steal the oldest tasks from top of random victim. Tasks of
+     * other threads go through shared queue. Waiting threads run tasks
+     * instead of blocking.
+     *
+     * Default tmp arena is per thread, so every worker allocates into its
+     * own arena, which is reset by `bsky_pool_tmp_reset' (results of
+     * tasks can live there until then).
+     *
+     * Example:
+     *      struct bsky_pool pool = { .pin = 1 };
+     *
+     *      bsky_pool_start(&pool);
+     *      bsky_pool_for(&pool, 0, lines.len, 64, parse_lines, &lines);
+     *      bsky_pool_stop(&pool);
+     *
+     * NOTE: blocking I/O does not belong to the pool, worker blocked in
+     *       `read' can't run or give away its tasks.
+     */
+    struct bsky_pool {
+        size_t workers; // 0 is number of online CPUs
+        int    pin;     // pin worker i to CPU i
+
+        _Atomic uint64_t executed, stolen;
+
+        // private
+        struct __bsky_pool_worker *worker;
+
+        pthread_mutex_t lock;
+        pthread_cond_t  wake;
+        _Atomic int     idle, stop;
+        struct { struct bsky_task **data; size_t len, cap; } queue;
+        size_t head;
+        _Atomic size_t queued;
+    };
+
+    enum bsky_error_code bsky_pool_start(struct bsky_pool *);
+
+    /**
+     * Queue task, can be called from any thread and from tasks.
+     */
+    enum bsky_error_code bsky_pool_submit(struct bsky_pool *,
+                                          struct bsky_task *);
+
+    /**
+     * Run tasks of the pool until all tasks of group are finished.
+     */
+    void bsky_pool_wait(struct bsky_pool *, struct bsky_task_group *);
+
+    /**
+     * Call `fn' for ranges of [begin, end) of at most `grain' items (0
+     * picks grain for 8 ranges per worker) on the pool and wait. Range is
+     * split in halves on demand, so stolen work is large.
+     */
+    enum bsky_error_code bsky_pool_for(struct bsky_pool *, size_t begin,
+                                       size_t end, size_t grain,
+                                       void (*fn)(void *user, size_t begin,
+                                                  size_t end),
+                                       void *user);
+
+    /**
+     * Index of worker of the calling thread, -1 outside of pool.
+     */
+    int bsky_pool_worker(void);
+
+    /**
+     * Reset tmp arenas of workers before their next task.
+     */
+    void bsky_pool_tmp_reset(struct bsky_pool *);
+
+    /**
+     * Stop and join workers. Queued tasks which are not started are
+     * dropped, so wait for them first.
+     */
+    void bsky_pool_stop(struct bsky_pool *);
+
+
+/*
+ * module:
+ * ============================================================================
+ *                                 MPMC QUEUE
+ * ============================================================================
+*/
+    struct __bsky_mpmc_cell {
+        _Atomic size_t seq;
+        void *item;
+    };
+
+    /**
+     * Bounded lock-free multi-producer/multi-consumer ring of pointers
+     * (Vyukov). Every cell has sequence number which tells whether it is
+     * free for producer of position or full for consumer of position, so
+     * producers and consumers only contend on their own index.
+     *
+     * Non-blocking `bsky_mpmc_push' and `bsky_mpmc_pop' never sleep, `_wait'
+     * variants spin for a while, then sleep on futex until the other side
+     * makes progress or queue is closed.
+     *
+     * Example:
+     *      struct bsky_mpmc q;
+     *
+     *      bsky_mpmc_init(&q, 4096);
+     *
+     *      // producers
+     *      bsky_mpmc_push_wait(&q, event);
+     *
+     *      // consumers
+     *      while ((event = bsky_mpmc_pop_wait(&q)) != NULL)
+     *          handle(event);
+     *
+     *      // shutdown: consumers drain the queue and get NULL
+     *      bsky_mpmc_close(&q);
+     */
+    struct bsky_mpmc {
+        _Alignas(64) _Atomic size_t head; // consumers
+        _Alignas(64) _Atomic size_t tail; // producers
+
+        _Alignas(64) struct __bsky_mpmc_cell *cells;
+        size_t mask;
+
+        // futex words, bumped only when there are sleepers
+        _Alignas(64) _Atomic uint32_t pushes, pops;
+        _Atomic uint32_t push_waiters, pop_waiters;
+        _Atomic int      closed;
+    };
+
+    /**
+     * Init queue, capacity is rounded up to power of two (at least 2).
+     */
+    enum bsky_error_code bsky_mpmc_init(struct bsky_mpmc *, size_t cap);
+
+    /**
+     * Return 0 if queue is full.
+     */
+    int bsky_mpmc_push(struct bsky_mpmc *, void *);
+
+    /**
+     * Return NULL if queue is empty.
+     */
+    void *bsky_mpmc_pop(struct bsky_mpmc *);
+
+    /**
+     * Push up to `n' items with one claim of positions. Return number of
+     * pushed items (prefix of `items').
+     */
+    size_t bsky_mpmc_push_n(struct bsky_mpmc *, void **items, size_t n);
+
+    /**
+     * Pop up to `n' items with one claim of positions. Return number of
+     * popped items.
+     */
+    size_t bsky_mpmc_pop_n(struct bsky_mpmc *, void **items, size_t n);
+
+    /**
+     * Push, wait while queue is full. Return 0 if queue is closed.
+     */
+    int bsky_mpmc_push_wait(struct bsky_mpmc *, void *);
+
+    /**
+     * Pop, wait while queue is empty. Return NULL if queue is closed and
+     * empty.
+     */
+    void *bsky_mpmc_pop_wait(struct bsky_mpmc *);
+
+    /**
+     * Wake all waiters, `_wait' calls don't sleep from now on. Call it when
+     * producers are done.
+     */
+    void bsky_mpmc_close(struct bsky_mpmc *);
+
+    /**
+     * Approximate number of items, may be called from any thread.
+     */
+    size_t bsky_mpmc_depth(struct bsky_mpmc *);
+
+    void bsky_mpmc_free(struct bsky_mpmc *);
+
+
+/*
+ * module:
+ * ============================================================================
+ *                               JSON SNAPSHOT
+ * ============================================================================
+*/
+    #ifndef BSKY_SNAP_BUFFER
+        #define BSKY_SNAP_BUFFER (0x400 * 0x400)
+    #endif
+
+    /**
+     * Limit of nesting checked by `bsky_snap_validate'. Can be predefined.
+     */
+    #ifndef BSKY_SNAP_DEPTH
+        #define BSKY_SNAP_DEPTH 256
+    #endif
+
+    #define BSKY_SNAP_MAGIC "BSKYSNP1"
+
+    /**
+     * Node of JSON tree inside snapshot. Offsets are in bytes relative to
+     * the node itself, so file is used in place wherever it is mapped.
+     *
+     * `off' of array points to `len' element nodes, of dictionary to
+     * `len' pairs of nodes (name string, value), of string to `len' bytes
+     * and '\0'. Numbers are stored as double.
+     */
+    struct bsky_snap_node {
+        uint32_t var; // `bsky_json_Arr' ...
+        uint32_t len;
+        union { int64_t off; double num; int64_t _bool; };
+    };
+
+    struct bsky_snap_header {
+        char     magic[8];
+        uint64_t size;      // 0 until writer is closed
+        uint64_t docs;
+        uint64_t index;     // offset of `index_cap' slots
+        uint64_t index_cap;
+    };
+
+    struct bsky_snap_slot {
+        uint64_t hash;
+        uint64_t key; // offset of key node, the root follows it; 0 is empty
+    };
+
+    /**
+     * Snapshot of `bsky_json' documents by key (hydration caches of
+     * profiles, posts ...) for warm restart without parsing.
+     *
+     * File is header, documents and open addressing index (little
+     * endian, 8 bytes aligned):
+     *      header | key node, root node, nodes and strings ... | slots
+     * Reader maps file and looks documents up in place, only touched
+     * pages are read.
+     *
+     * Example:
+     *      struct bsky_snap_writer w;
+     *
+     *      bsky_snap_writer_open(&w, "profiles.snap", &ec);
+     *      bsky_snap_put(&w, did, profile_json);
+     *      bsky_snap_writer_close(&w);
+     *
+     *      struct bsky_snap snap;
+     *
+     *      bsky_snap_open(&snap, "profiles.snap", &ec);
+     *      const struct bsky_snap_node *p = bsky_snap_get(&snap, did);
+     *      const struct bsky_snap_node *name =
+     *          bsky_snap_field(p, "displayName");
+     *      if (name && name->var == bsky_json_Str)
+     *          use(bsky_snap_str(name));
+     *
+     * NOTE: snapshot is for the same machine, it is not portable across
+     *       byte orders.
+     */
+    struct bsky_snap_writer {
+        uint64_t docs, bytes;
+
+        // private
+        int fd;
+        char *path;
+        struct bsky_str_builder tmp; // `path.tmp'
+        struct { char *data; size_t len, cap; } buf, doc;
+        struct { struct bsky_snap_slot *data; size_t len, cap; } keys;
+        struct bsky_str_map seen;
+    };
+
+    /**
+     * Start snapshot file. It is written to `path.tmp' and renamed over
+     * `path' on close, so the old snapshot stays valid (and mapped one
+     * stays readable) until then.
+     */
+    enum bsky_error_code bsky_snap_writer_open(struct bsky_snap_writer *,
+                                               const char *path,
+                                               enum bsky_error_code *);
+
+    /**
+     * Append document, the last one of the same key wins.
+     */
+    enum bsky_error_code bsky_snap_put(struct bsky_snap_writer *,
+                                       struct bsky_str key,
+                                       struct bsky_json);
+
+    /**
+     * Write index and header, close file and rename it over `path'. File
+     * without header size (writer crashed) is rejected by `bsky_snap_open'.
+     */
+    enum bsky_error_code bsky_snap_writer_close(struct bsky_snap_writer *);
+
+    struct bsky_snap {
+        struct bsky_view data; // mmapped file
+        uint64_t docs;
+
+        // private
+        const struct bsky_snap_slot *slots;
+        uint64_t mask;
+    };
+
+    /**
+     * Map snapshot and check header and index bounds. Nodes are not
+     * checked, use `bsky_snap_validate' for files from untrusted source.
+     */
+    enum bsky_error_code bsky_snap_open(struct bsky_snap *, const char *path,
+                                        enum bsky_error_code *);
+
+    /**
+     * Check every slot, node and string of snapshot: offsets are in
+     * bounds and aligned, strings are terminated, nesting is below
+     * `BSKY_SNAP_DEPTH'.
+     */
+    enum bsky_error_code bsky_snap_validate(struct bsky_snap *);
+
+    /**
+     * Root node of document by key, NULL if there is no such key.
+     */
+    const struct bsky_snap_node *bsky_snap_get(struct bsky_snap *,
+                                               struct bsky_str key);
+
+    /**
+     * Elements of array, or pairs of names and values of dictionary.
+     */
+    const struct bsky_snap_node *
+    bsky_snap_items(const struct bsky_snap_node *);
+
+    /**
+     * String of string node, it points into the map.
+     */
+    struct bsky_str bsky_snap_str(const struct bsky_snap_node *);
+
+    /**
+     * Value of dictionary field by name, NULL if node is not dictionary or
+     * there is no such field.
+     */
+    const struct bsky_snap_node *
+    bsky_snap_field(const struct bsky_snap_node *, const char *name);
+
+    void bsky_snap_free(struct bsky_snap *);
+
+
+/*
+ * module:
+ * ============================================================================
+ *                                SOCIAL GRAPH
+ * ============================================================================
+*/
+    /**
+     * Number of logged follows and unfollows which triggers merge. Can be
+     * predefined.
+     */
+    #ifndef BSKY_GRAPH_LOG
+        #define BSKY_GRAPH_LOG (0x400 * 0x400)
+    #endif
+
+    #define BSKY_GRAPH_NONE  UINT32_MAX
+    #define BSKY_GRAPH_MAGIC "BSKYGRF1"
+
+    struct bsky_graph_ids { uint32_t *data; size_t len, cap; };
+
+    // Compressed sparse rows: neighbours of node `u' are sorted ids in
+    // `data[off[u]] .. data[off[u + 1]]', first id and then gaps as
+    // LEB128 varints.
+    struct __bsky_graph_csr {
+        uint64_t      *off;
+        unsigned char *data;
+        size_t nodes;
+        int    owned; // arrays are not mapped
+    };
+
+    struct __bsky_graph_op {
+        uint32_t src, dst;
+        uint64_t seq; // order in log << 1 | unfollow
+    };
+
+    struct bsky_graph_header {
+        char     magic[8];
+        uint64_t size;
+        uint64_t nodes, edges;
+
+        // offsets and lengths of sections: DIDs separated by '\0', then
+        // `nodes + 1' offsets and data of following and followers.
+        uint64_t dids, dids_len;
+        uint64_t out_off, out_data, out_len;
+        uint64_t in_off, in_data, in_len;
+    };
+
+    /**
+     * Follow graph with DIDs interned to dense 32 bit ids.
+     *
+     * Adjacency is kept in both directions in compressed sparse rows
+     * (about 1-2 bytes per edge for sorted ids). Follows and unfollows
+     * go to append log, `bsky_graph_merge' rebuilds rows with one
+     * sequential pass, it is called when log reaches `BSKY_GRAPH_LOG'.
+     * Queries see merged edges only.
+     *
+     * Graph can be saved to file and loaded back with rows used in place
+     * from the map (interning table is rebuilt on load).
+     *
+     * Example:
+     *      struct bsky_graph g = { 0 };
+     *
+     *      bsky_graph_load(&g, "follows.graph", &ec);
+     *      bsky_graph_follow_record(&g, repo, &record); // from firehose
+     *      bsky_graph_merge(&g);
+     *
+     *      uint32_t me = bsky_graph_find(&g, did);
+     *      bsky_graph_two_hop(&g, me, &suggestions);
+     *
+     * NOTE: queries can run in parallel, but not with updates and merge.
+     */
+    struct bsky_graph {
+        size_t   nodes;
+        uint64_t edges;
+
+        // private
+        struct bsky_str_map ids;
+        struct { char **data; size_t len, cap; } dids; // keys of `ids'
+        struct __bsky_graph_csr out, in;
+        struct { struct __bsky_graph_op *data; size_t len, cap; } log;
+        struct bsky_view map;
+    };
+
+    /**
+     * Id of DID, new DID gets the next id. Return `BSKY_GRAPH_NONE' if
+     * out of memory.
+     */
+    uint32_t bsky_graph_id(struct bsky_graph *, struct bsky_str did);
+
+    /**
+     * Id of DID or `BSKY_GRAPH_NONE' if DID is unknown.
+     */
+    uint32_t bsky_graph_find(struct bsky_graph *, struct bsky_str did);
+
+    /**
+     * DID of id or NULL.
+     */
+    const char *bsky_graph_did(struct bsky_graph *, uint32_t id);
+
+    enum bsky_error_code bsky_graph_follow(struct bsky_graph *, uint32_t src,
+                                           uint32_t dst);
+    enum bsky_error_code bsky_graph_unfollow(struct bsky_graph *, uint32_t src,
+                                             uint32_t dst);
+
+    /**
+     * Follow of `app.bsky.graph.follow' record created in repo of `did'.
+     * Deletes of records carry no subject, so user keeps record keys and
+     * calls `bsky_graph_unfollow'.
+     */
+    enum bsky_error_code bsky_graph_follow_record(struct bsky_graph *,
+                                                  struct bsky_str did,
+                                                  struct bsky_json *record);
+
+    /**
+     * Apply log to rows.
+     */
+    enum bsky_error_code bsky_graph_merge(struct bsky_graph *);
+
+    /**
+     * Append ids followed by `id' (followers of `id') to `out', sorted.
+     */
+    enum bsky_error_code bsky_graph_following(struct bsky_graph *, uint32_t id,
+                                              struct bsky_graph_ids *out);
+    enum bsky_error_code bsky_graph_followers(struct bsky_graph *, uint32_t id,
+                                              struct bsky_graph_ids *out);
+
+    size_t bsky_graph_following_count(struct bsky_graph *, uint32_t id);
+    size_t bsky_graph_followers_count(struct bsky_graph *, uint32_t id);
+
+    /**
+     * Return 1 if `src' follows `dst'.
+     */
+    int bsky_graph_follows(struct bsky_graph *, uint32_t src, uint32_t dst);
+
+    /**
+     * Append distinct ids followed by follows of `id' to `out', sorted,
+     * without `id' and its own follows (follow suggestions).
+     */
+    enum bsky_error_code bsky_graph_two_hop(struct bsky_graph *, uint32_t id,
+                                            struct bsky_graph_ids *out);
+
+    /**
+     * Merge log and write graph to file.
+     */
+    enum bsky_error_code bsky_graph_save(struct bsky_graph *, const char *path);
+
+    /**
+     * Map graph from file, rows are used from the map until the next
+     * merge.
+     */
+    enum bsky_error_code bsky_graph_load(struct bsky_graph *, const char *path,
+                                         enum bsky_error_code *);
+
+    void bsky_graph_free(struct bsky_graph *);
+
+
+/*
+ * module:
+ * ============================================================================
+ *                              ROARING BITMAP
+ * ============================================================================
+*/
+    #define BSKY_ROARING_ARRAY_MAX 4096
+
+    enum {
+        __bsky_roaring_Array,  // sorted low halves, at most 4096
+        __bsky_roaring_Bitmap, // 1024 words
+        __bsky_roaring_Run,    // pairs of start and length - 1
+    };
+
+    struct __bsky_roaring_container {
+        uint16_t key;  // high half of values
+        uint16_t type;
+        uint32_t card;
+        uint32_t len, cap; // values of array, runs of run container
+        union { uint16_t *array; uint64_t *bitmap; uint16_t *runs; };
+    };
+
+    /**
+     * Compressed set of 32 bit ids (dense DID ids of `bsky_graph') for
+     * follows, blocks, mutes and list members.
+     *
+     * Values are split by high 16 bits into containers: sorted array of
+     * low halves up to `BSKY_ROARING_ARRAY_MAX' values, bitmap of 65536
+     * bits above it, and runs made by `bsky_roaring_optimize' for ranges.
+     * Array intersections compare blocks of 8 values with SSE2, bitmaps
+     * are combined with AVX2 when CPU has it.
+     *
+     * Example:
+     *      // candidates ∩ followed - blocked - muted
+     *      bsky_roaring_and(&tmp, &page_authors, &following);
+     *      bsky_roaring_andnot(&tmp2, &tmp, &blocks);
+     *      bsky_roaring_andnot(&visible, &tmp2, &mutes);
+     *
+     * NOTE: define `BSKY_ROARING_PORTABLE' to compile only portable code.
+     */
+    struct bsky_roaring {
+        struct __bsky_roaring_container *data;
+        size_t len, cap;
+    };
+
+    enum bsky_error_code bsky_roaring_add(struct bsky_roaring *, uint32_t);
+
+    /**
+     * Add many values, sorted input is appended without search.
+     */
+    enum bsky_error_code bsky_roaring_add_many(struct bsky_roaring *,
+                                               const uint32_t *, size_t n);
+
+    enum bsky_error_code bsky_roaring_remove(struct bsky_roaring *, uint32_t);
+
+    int bsky_roaring_has(struct bsky_roaring *, uint32_t);
+
+    uint64_t bsky_roaring_card(struct bsky_roaring *);
+
+    /**
+     * `out' = `a' ∩ `b', `a' ∪ `b' and `a' - `b'. Previous content of
+     * `out' is freed, `out' must not be `a' or `b'.
+     */
+    enum bsky_error_code bsky_roaring_and(struct bsky_roaring *out,
+                                          struct bsky_roaring *a,
+                                          struct bsky_roaring *b);
+    enum bsky_error_code bsky_roaring_or(struct bsky_roaring *out,
+                                         struct bsky_roaring *a,
+                                         struct bsky_roaring *b);
+    enum bsky_error_code bsky_roaring_andnot(struct bsky_roaring *out,
+                                             struct bsky_roaring *a,
+                                             struct bsky_roaring *b);
+
+    /**
+     * Convert containers to runs where runs are smaller. Updates turn
+     * runs back into array or bitmap.
+     */
+    enum bsky_error_code bsky_roaring_optimize(struct bsky_roaring *);
+
+    /**
+     * Append values to `out', sorted.
+     */
+    enum bsky_error_code bsky_roaring_ids(struct bsky_roaring *,
+                                          struct bsky_graph_ids *out);
+
+    /**
+     * Add actors of `getFollows', `getFollowers', `getBlocks', `getMutes'
+     * or `getList' response (profile views with `did', list items with
+     * `subject'), DIDs are interned by `g'. Pages are added one by one,
+     * `cursor' of response is left to caller.
+     */
+    enum bsky_error_code bsky_roaring_add_actors(struct bsky_roaring *,
+                                                 struct bsky_graph *g,
+                                                 struct bsky_json *response);
+
+    void bsky_roaring_free(struct bsky_roaring *);
+
+    /**
+     * Kernels of set operations. By default the fastest one supported by
+     * CPU is selected on the first use:
+     *     - `Avx2'     -- bitmaps in AVX2 lanes, arrays as in `Sse2';
+     *     - `Sse2'     -- arrays compared by blocks of 8 values;
+     *     - `Portable' -- plain C merges.
+     */
+    enum bsky_roaring_backend {
+        bsky_roaring_Auto,
+        bsky_roaring_Portable,
+        bsky_roaring_Sse2,
+        bsky_roaring_Avx2,
+    };
+
+    /**
+     * Select kernels, unsupported backend falls back to `Portable'.
+     * Returns selected backend.
+     */
+    enum bsky_roaring_backend bsky_roaring_use(enum bsky_roaring_backend);
+
+/*
+ * ============================================================================
+ *                             IMPLEMENTATION
+ * ===========================================================================
+ *
+ * To enable implementation predefine `BSKY_API_IMPLEMENTATION' macro.
+ */
+#ifdef BSKY_API_IMPLEMENTATION
+
+    /*
+     * BSKY ERROR CODE
+     */
+    const char *bsky_str_of_error_code(enum bsky_error_code code)
+    {
+        switch (code) {
+        case bsky_ec_Ok:           return "Ok";
+        case bsky_ec_Tmp_overflow: return "overflow of temporary arena!";
+
+        case bsky_ec_Json_expect_CSB: 
+            return "JSON: expect ']' at the end of array!";
+        case bsky_ec_Json_expect_OSB: 
+            return "JSON: expect '[' at the start of the array!";
+        case bsky_ec_Json_expect_CCB: 
+            return "JSON: expect '}' at the end of dictionary!";
+        case bsky_ec_Json_expect_OCB: 
+            return "JSON: expect '}' at the start of dictionary!";
+        case bsky_ec_Json_expect_Bool: 
+            return "JSON: expect 'true' or 'false'!";
+        case bsky_ec_Json_expect_Null: 
+            return "JSON: expect 'null'!";
+        case bsky_ec_Json_expect_Number: 
+            return "JSON: expect number!";
+        case bsky_ec_Json_expect_OQ: 
+            return "JSON: expect '\"' at the start of string!";
+        case bsky_ec_Json_expect_CQ: 
+            return "JSON: expect '\"' at the end of string!";
+        case bsky_ec_Json_expect_Colon: 
+            return "JSON: expect ':' between key and value!";
+        case bsky_ec_Json_invalid_variant:
+            return "JSON: parse invalid json variant!";
+
+        case bsky_ec_Out_of_memory:
+            return "out of memory!";
+
+        case bsky_ec_Url_invalid:
+            return "URL: expect `scheme://host[:port][/path]'!";
+        case bsky_ec_Net_resolve:
+            return "NET: failed to resolve host!";
+        case bsky_ec_Net_connect:
+            return "NET: failed to connect to host!";
+
+        case bsky_ec_Pds_not_found:
+            return "PDS: DID document has no `#atproto_pds' service!";
+        case bsky_ec_Pds_unknown_did:
+            return "PDS: no route for DID and no fallback endpoint!";
+
+        case bsky_ec_Io:
+            return "IO: failed to read file!";
+        case bsky_ec_Net_send:
+            return "NET: failed to send data!";
+
+        case bsky_ec_Xrpc_status:
+            return "XRPC: server responded with error status!";
+        case bsky_ec_Xrpc_transport:
+            return "XRPC: failed to send request!";
+
+        case bsky_ec_Loop:
+            return "LOOP: epoll operation failed!";
+
+        case bsky_ec_Ws_handshake:
+            return "WS: server rejected websocket handshake!";
+        case bsky_ec_Ws_protocol:
+            return "WS: invalid websocket frame!";
+        case bsky_ec_Ws_too_large:
+            return "WS: message is larger than `max_message'!";
+        case bsky_ec_Ws_closed:
+            return "WS: connection is closed!";
+
+        case bsky_ec_Cbor_eof:
+            return "CBOR: unexpected end of data!";
+        case bsky_ec_Cbor_invalid:
+            return "CBOR: invalid DAG-CBOR data!";
+        case bsky_ec_Cbor_non_canonical:
+            return "CBOR: data is not in canonical DAG-CBOR form!";
+
+        case bsky_ec_Car_invalid:
+            return "CAR: invalid header, block frame or CID!";
+        case bsky_ec_Car_truncated:
+            return "CAR: unexpected end of data!";
+
+        case bsky_ec_Cid_invalid:
+            return "CID: invalid binary CID or base32 string!";
+
+        case bsky_ec_Mst_invalid:
+            return "MST: invalid node or commit block!";
+        case bsky_ec_Mst_missing_block:
+            return "MST: block of node is not found!";
+
+        case bsky_ec_Firehose_invalid:
+            return "FIREHOSE: invalid event frame!";
+        case bsky_ec_Firehose_thread:
+            return "FIREHOSE: can't start stage thread!";
+
+        case bsky_ec_Checkpoint_io:
+            return "CHECKPOINT: can't read or write checkpoint file!";
+
+        case bsky_ec_Prefilter_build:
+            return "PREFILTER: can't build NSID set!";
+
+        case bsky_ec_Jetstream_invalid:
+            return "JETSTREAM: invalid event!";
+        case bsky_ec_Jetstream_decompress:
+            return "JETSTREAM: can't decompress message!";
+        case bsky_ec_Verify_invalid_key:
+            return "VERIFY: invalid did:key!";
+        case bsky_ec_Verify_thread:
+            return "VERIFY: can't start worker!";
+        case bsky_ec_Capture_invalid:
+            return "CAPTURE: invalid capture file!";
+        case bsky_ec_Backfill_fetch:
+            return "BACKFILL: can't fetch repo!";
+        case bsky_ec_Label_invalid:
+            return "LABEL: invalid label!";
+        case bsky_ec_Pool_thread:
+            return "POOL: can't start worker!";
+        case bsky_ec_Snapshot_invalid:
+            return "SNAPSHOT: invalid file!";
+        case bsky_ec_Graph_invalid:
+            return "GRAPH: invalid file!";
+        case bsky_ec_Roaring_response:
+            return "ROARING: no list of actors!";
+        }
+    }
+
+    /*
+     * DEFAULT TMP ARENA
+     */
+    _Thread_local struct __bsky_default_tmp_arena {
+        void *allocator; size_t len;
+    } __bsky_default_tmp_arena = { 0 };
+
+    void    bsky_default_tmp_reset(void) {
+        __bsky_default_tmp_arena.len = 0;
+    }
+
+    // arena blocks of exited threads and of `bsky_ebr_retire_tmp'.
+    static struct {
+        pthread_mutex_t lock;
+        void  *data[BSKY_TMP_POOL];
+        size_t len;
+    } __bsky_tmp_pool = { .lock = PTHREAD_MUTEX_INITIALIZER };
+
+    static void __bsky_tmp_pool_put(void *block)
+    {
+        pthread_mutex_lock(&__bsky_tmp_pool.lock);
+        if (__bsky_tmp_pool.len < BSKY_TMP_POOL) {
+            __bsky_tmp_pool.data[__bsky_tmp_pool.len++] = block;
+            block = NULL;
+        }
+        pthread_mutex_unlock(&__bsky_tmp_pool.lock);
+
+        free(block);
+    }
+
+    static void *__bsky_tmp_pool_get(void)
+    {
+        void *block = NULL;
+
+        pthread_mutex_lock(&__bsky_tmp_pool.lock);
+        if (__bsky_tmp_pool.len)
+            block = __bsky_tmp_pool.data[--__bsky_tmp_pool.len];
+        pthread_mutex_unlock(&__bsky_tmp_pool.lock);
+
+        return block ? block : calloc(BSKY_DEFAULT_TMP_ARENA_CAPACITY,
+                                      sizeof(char));
+    }
+
+    void    bsky_default_tmp_free(void) {
+        if (__bsky_default_tmp_arena.allocator)
+            __bsky_tmp_pool_put(__bsky_default_tmp_arena.allocator);
+        __bsky_default_tmp_arena = (struct __bsky_default_tmp_arena) { 0 };
+    }
+
+    void *__bsky_default_tmp_alloc(size_t size_to_alloc)
+    {
+        if (__bsky_default_tmp_arena.allocator == 0) {
+            __bsky_default_tmp_arena.allocator = __bsky_tmp_pool_get();
+        }
+
+        if (__bsky_default_tmp_arena.len + size_to_alloc >
+            BSKY_DEFAULT_TMP_ARENA_CAPACITY) 
+            return NULL;
+
+        void *ret = __bsky_default_tmp_arena.allocator
+                    + __bsky_default_tmp_arena.len;
+
+        __bsky_default_tmp_arena.len += size_to_alloc;
+
+        return ret;
+    }
+
+    /*
+     * BKSY DYNAMIC ARRAY
+     */
+	#include <string.h>
+    void bsky_da_free(void *da) {
+        struct bsky_dynamic_arr *self = (struct bsky_dynamic_arr*) da;
+
+        if (self->data != NULL) free(self->data);
+    }
+
+    enum bsky_error_code 
+    __bsky_da_push(void *self_gen, const void *elem, size_t elem_size)
+    {
+        struct bsky_dynamic_arr *self = (struct bsky_dynamic_arr*) self_gen;
+
+        if (self->len >= self->cap) {
+            self->cap  = self->cap ?  self->cap * 2 : 16;
+            self->data = realloc(self->data, self->cap * elem_size);
+            if (self->data == NULL) bsky_return_error(bsky_ec_Tmp_overflow);
+        }
+
+        memcpy(self->data + self->len++ * elem_size, elem, elem_size);
+
+        return bsky_ec_Ok;
+    }
+
+    enum bsky_error_code
+    __bsky_da_append(void *self_gen, const void *elems,
+                     size_t elem_size, size_t len)
+    {
+        struct bsky_dynamic_arr *self = (struct bsky_dynamic_arr*) self_gen;
+
+        if (self->len + len > self->cap) {
+            self->cap  = (self->cap ? self->cap * 2 : 16) + len;
+            self->data = realloc(self->data, self->cap * elem_size);
+
+            if (self->data == NULL) bsky_return_error(bsky_ec_Tmp_overflow);
+        }
+
+        memcpy(self->data + self->len, elems, elem_size * len);
+        self->len += len;
+
+        return bsky_ec_Ok;
+    }
+
+    void bsky_clear_da(void *self_gen) {
+        struct bsky_dynamic_arr *self = (struct bsky_dynamic_arr*) self_gen;
+
+        *self = (struct bsky_dynamic_arr) { 0 }; 
+    }
+
+    /*
+     * BSKY VIEW
+     */
+    struct bsky_view __bsky_view_of_da(void *_da, size_t elem_size)
+    {
+        struct bsky_dynamic_arr *da = (struct bsky_dynamic_arr *) _da;
+
+        return (struct bsky_view) { da->data, da->data + da->len * elem_size };
+    }
+
+    struct bsky_view bsky_view_to_tmp(struct bsky_view view)
+    {
+        void *data = bsky_tmp_alloc(view.end - view.start);
+        memcpy(data, view.start, view.end - view.start);
+
+        return (struct bsky_view) { data, data +  (view.end - view.start) };
+    }
+
+    struct bsky_view __bsky_tmp_view_of_da(void *da, size_t elem_size)
+    {
+        struct bsky_view ret = bsky_view_to_tmp(
+                                 __bsky_view_of_da(da, elem_size));
+
+        bsky_da_free(da);
+        bsky_clear_da(da);
+
+        return ret;
+    }
+
+    /*
+     * BSKY STRING
+     */
+    void bsky_sb_push(struct bsky_str_builder *sb, char c)
+    {
+        const char nullc = '\0';
+
+        if (sb->len == 0) {
+            char buf[] = { c, nullc };ic_arr*)da)->data
+            __bsky_da_append(sb, buf, sizeof(buf), 2);
+        }
+        else {
+            sb->data[sb->len-1] = c;
+            bsky_da_push(sb, nullc);
+        }
+    }
+
+    void bsky_sb_push_str(struct bsky_str_builder *sb, struct bsky_str str)
+    {
+        const char nullc = '\0';
+
+        if (sb->len != 0) sb->len--; // remove null character.
+
+        __bsky_da_append(sb, str.start, sizeof(char), str.end - str.start);
+
+        if (sb->data[sb->len-1] != '\0') bsky_da_push(sb, nullc);
+    }
+
+    #include <stdarg.h>
+
+    void bsky_sb_push_fmt(struct bsky_str_builder *sb, char *fmt, ...)
+    {
+        va_list args;
+        va_start(args, fmt);
+        int len = vsnprintf(NULL, 0, fmt, args);
         va_end(args);
 
-        char *result = bsky_tmp_alloc(len + 1);
-        va_start(args, fmt);
-        vsnprintf(result, len + 1, fmt, args);
-        va_end(args);
+        char *result = bsky_tmp_alloc(len + 1);
+        va_start(args, fmt);
+        vsnprintf(result, len + 1, fmt, args);
+        va_end(args);
+
+        bsky_sb_push_str(sb, (struct bsky_str) {result, result + len + 1});
+    }
+
+    struct bsky_str bsky_sb_build(struct bsky_str_builder *sb)
+    {
+        return (struct bsky_str) { sb->data, sb->data + sb->len-1 };
+    }
+
+    struct bsky_str bsky_sb_build_tmp(struct bsky_str_builder *sb)
+    {
+        struct bsky_view str = bsky_view_of_str(bsky_sb_build(sb));
+        struct bsky_view tmp = bsky_view_to_tmp(str);
+
+        bsky_da_free(sb);
+        *sb = (struct bsky_str_builder) { 0 };
+
+        return (struct bsky_str) { tmp.start, tmp.end-1 };
+    }
+
+    struct bsky_view bsky_view_of_str(struct bsky_str str)
+    {
+        return (struct bsky_view) { str.start, str.end + 1 };
+    }
+
+    static int __s_is_whitespace(char c) {
+        return c == ' ' || c == '\n' || c == '\t';
+    }
+
+    struct bsky_str bsky_trim_left(struct bsky_str str)
+    {
+        while (str.start != str.end && __s_is_whitespace(*str.start)) {
+            str.start++;
+        }
+
+        return str;
+    }
+
+    int bsky_str_starts_with(struct bsky_str fst, struct bsky_str pref)
+    {
+        size_t fst_len = bsky_str_len(fst), pref_len = bsky_str_len(pref);
+
+        if (fst_len < pref_len) return 0;
+
+        return memcmp(fst.start, pref.start, pref_len) == 0;
+    }
+
+    int bsky_str_ends_with(struct bsky_str fst, struct bsky_str post)
+    {
+        size_t fst_len = bsky_str_len(fst), post_len = bsky_str_len(post);
+
+        if (fst_len < post_len) return 0;
+
+        return memcmp(fst.start + fst_len - post_len,
+                      post.start, post_len) == 0;
+    }
+
+    size_t bsky_str_len(struct bsky_str str) {
+        return (str.end - str.start) / sizeof (char);
+    }
+
+    int bsky_str_eq(struct bsky_str fst, struct bsky_str snd) {
+        return strcmp(fst.start, snd.start) == 0;
+    }
+
+    int bsky_str_cmp(struct bsky_str fst, struct bsky_str snd) {
+        size_t fst_len = bsky_str_len(fst), snd_len = bsky_str_len(snd);
+
+        for (int i = 0; i < (fst_len > snd_len ? fst_len : snd_len); ++i) {
+            if (fst.start[i] > snd.start[i]) return  1 + i;
+            if (fst.start[i] < snd.start[i]) return -1 - i;
+        }
+
+        return fst_len > snd_len ?   1 + snd_len :
+               snd_len > fst_len ? - 1 - fst_len :
+               0;
+    }
+
+
+    struct bsky_str bsky_shift_str(struct bsky_str str, size_t n) {
+        if (n > bsky_str_len(str)) {
+            return (struct bsky_str){str.end, str.end};
+        }
+
+
+        return (struct bsky_str) {str.start + n, str.end};
+    }
+
+    struct bsky_str bsky_mk_str(char *str) {
+        return (struct bsky_str) { str, str + strlen(str) };
+    }
+
+    struct bsky_str bsky_mk_str(char *str) {
+        return (struct bsky_str) { str, str + strlen(str) };
+    }
+
+	/*
+     * BSKY JSON
+     */
+    void bsky_sb_push_json(struct bsky_str_builder *sb, struct bsky_json json)
+    {
+        switch (json.var) {
+        case bsky_json_Arr: {
+            bsky_sb_push_fmt(sb, "[");
+
+            for (size_t i = 0; i < json.arr.len; ++i) {
+                bsky_sb_push_json(sb, json.arr.data[i]);
+
+                if (i != json.arr.len-1) bsky_sb_push_fmt(sb, ",");
+                else                     bsky_sb_push_fmt(sb, "]");
+            }
+        } break;
+        case bsky_json_Dct: {
+            bsky_sb_push_fmt(sb, "{");
+
+            for (size_t i = 0; i < json.dct.len; ++i) {
+                bsky_sb_push_fmt(sb, "\"%s\":", json.dct.data[i].name);
+                bsky_sb_push_json(sb, json.dct.data[i].value);
+
+                if (i != json.dct.len-1) bsky_sb_push_fmt(sb, ",");
+                else                     bsky_sb_push_fmt(sb, "}");
+            }
+
+        } break;
+        case bsky_json_Num: {
+            if (fabsl(json.num - (float)(int)json.num) < 0.0001) {
+                bsky_sb_push_fmt(sb, "%d", (int)json.num);
+            } else {
+                bsky_sb_push_fmt(sb, "%f.3",    json.num);
+            }
+        }break;
+        case bsky_json_Str:  bsky_sb_push_fmt(sb, "\"%s\"", json.str); break;
+        case bsky_json_Null: bsky_sb_push_fmt(sb, "null"); break;
+        case bsky_json_Bool: {
+            bsky_sb_push_fmt(sb, "%s", json._bool ? "true" : "false"); 
+        }break;
+        }
+    }
+
+    struct bsky_str bsky_tmp_str_of_json(struct bsky_json json)
+    {
+        struct bsky_str_builder sb = { 0 };
+
+        bsky_sb_push_json(&sb, json);
+
+        return bsky_sb_build_tmp(&sb);
+    }
+
+
+    struct bsky_json bsky_parse_json_arr(struct bsky_str *data,
+                                         enum bsky_error_code *ec)
+    {
+        *ec = bsky_ec_Ok;
+
+        struct bsky_json_da arr_da = { 0 };
+        struct bsky_json json = { 0 };
+
+        *data = bsky_trim_left(*data);
+
+        if (*data->start != '[') bsky_defer_ec(bsky_ec_Json_expect_OSB);
+
+        do {
+            *data = bsky_shift_str(*data, 1);
+            *data = bsky_trim_left(*data);
+            if (*data->start == ']') break;
+
+            struct bsky_json elem = bsky_parse_json(data, ec);
+            if (*ec != bsky_ec_Ok) bsky_defer_ec(*ec);
+
+            bsky_da_push(&arr_da, elem);
+
+            *data = bsky_trim_left(*data);
+        } while(*data->start == ',');
+
+        if (*data->start != ']') bsky_defer_ec(bsky_ec_Json_expect_CSB);
+
+        *ec = bsky_ec_Ok;
+        *data = bsky_shift_str(*data, 1);
+
+        struct bsky_view arr = bsky_tmp_view_of_da(&arr_da);
+
+        json.var = bsky_json_Arr;
+        json.arr.data = arr.start;
+        json.arr.len  = (arr.end - arr.start) / sizeof (struct bsky_json);
+
+    defer:
+        bsky_da_free(&arr_da);
+        return json;
+    }
+
+
+    struct bsky_json bsky_parse_json_dct(struct bsky_str *data,
+                                         enum bsky_error_code *ec)
+    {
+        *ec = bsky_ec_Ok;
+
+        struct bsky_json_pair_da dct_da = { 0 };
+        struct bsky_json json = { 0 };
+
+        *data = bsky_trim_left(*data);
+
+        if (*data->start != '{') bsky_defer_ec(bsky_ec_Json_expect_OCB);
+
+        json.var = bsky_json_Dct;
+
+        struct bsky_json elem = { 0 };
+        struct bsky_json name = { 0 };
+        struct bsky_json_pair pair = { 0 };
+
+        do {
+            *data = bsky_shift_str(*data, 1);
+
+            name = bsky_parse_json_str(data, ec);
+            if (*ec != bsky_ec_Ok) bsky_defer_ec(*ec);
+
+            *data = bsky_trim_left(*data);
+
+            if (*data->start != ':') bsky_defer_ec(bsky_ec_Json_expect_Colon);
+
+            *data = bsky_shift_str(*data, 1);
+
+            elem = bsky_parse_json(data, ec);
+
+            if (*ec != bsky_ec_Ok) bsky_defer_ec(*ec);
+
+            pair.name  = name.str;
+            pair.value = elem;
+            bsky_da_push(&dct_da, pair);
+
+            *data = bsky_trim_left(*data);
+        } while(*data->start == ',');
+
+        if (*data->start != '}') bsky_defer_ec(bsky_ec_Json_expect_CCB);
+
+        *data = bsky_shift_str(*data, 1);
+
+        struct bsky_view dct = bsky_tmp_view_of_da(&dct_da);
+
+        json.dct.data = dct.start;
+        json.dct.len  = (dct.end - dct.start) / sizeof (struct bsky_json_pair);
+
+    defer:
+        bsky_da_free(&dct_da);
+        return json;
+    }
+
+    struct bsky_json bsky_parse_json_str(struct bsky_str *data,
+                                         enum bsky_error_code *ec)
+    {
+        *ec = bsky_ec_Ok;
+
+        struct bsky_str_builder sb = { 0 };
+        struct bsky_json json = { 0 };
+
+        *data = bsky_trim_left(*data);
+
+        if (*data->start != '"') bsky_defer_ec(bsky_ec_Json_expect_OQ);
+
+        *data = bsky_shift_str(*data, 1);
+
+        char *end = data->start;
+
+        while (end < data->end && *end != '"') {
+            if (*end == '\\' && end+1 != data->end) end++;
+            end++;
+        }
+
+        bsky_sb_push_str(&sb, (struct bsky_str) { data->start, end });
+        data->start = end;
+
+        if (end >= data->end) bsky_defer_ec(bsky_ec_Json_expect_CQ);
+
+        data->start++;
+
+
+
+        struct bsky_str str = bsky_sb_build_tmp(&sb);
+
+        json.var = bsky_json_Str;
+        json.str = str.start;
+
+    defer:
+        bsky_da_free(&sb);
+        return json;
+    }
+
+    struct bsky_json bsky_parse_json_num(struct bsky_str *data,
+                                         enum bsky_error_code *ec)
+    {
+        *ec = bsky_ec_Ok;
+
+        struct bsky_json json = { 0 };
+
+        *data = bsky_trim_left(*data);
+
+        char *endptr = NULL;
+        long double v = strtold(data->start, &endptr);
+
+        if (endptr == data->start) bsky_defer_ec(bsky_ec_Json_expect_Number);
+
+        data->start = endptr;
+
+        json.var = bsky_json_Num;
+        json.num = v;
+
+    defer:
+        return json;
+    }
+
+    struct bsky_json bsky_parse_json_null(struct bsky_str *data,
+                                          enum bsky_error_code *ec)
+    {
+        *ec = bsky_ec_Ok;
+
+        struct bsky_json json = { 0 };
+
+        *data = bsky_trim_left(*data);
+
+        if (!bsky_str_starts_with(*data, bsky_mk_str("null")))
+            bsky_defer_ec(bsky_ec_Json_expect_Null);
+
+        json.var = bsky_json_Null;
+
+        data->start += 4;
+
+	defer:
+        return json;
+    }
+
+    struct bsky_json bsky_parse_json_bool(struct bsky_str *data,
+                                          enum bsky_error_code *ec)
+    {
+        *ec = bsky_ec_Ok;
+
+        struct bsky_json json = { 0 };
+
+        *data = bsky_trim_left(*data);
+
+        json.var = bsky_json_Bool;
+
+        if (bsky_str_starts_with(*data, bsky_mk_str("false"))) {
+            data->start += 5;
+            json._bool = 0;
+
+        } else if (bsky_str_starts_with(*data, bsky_mk_str("true"))) {
+            data->start += 4;
+            json._bool = 1;
+
+        } else {
+            bsky_defer_ec(bsky_ec_Json_expect_Bool);
+        }
+
+    defer:
+        return json;
+    }
+
+    struct bsky_json bsky_parse_json(struct bsky_str *data,
+                                     enum bsky_error_code* ec)
+    {
+        *ec = bsky_ec_Ok;
+        struct bsky_json json = { 0 };
+
+        *data = bsky_trim_left(*data);
+        struct bsky_str data_s = *data;
+
+        json = bsky_parse_json_null(data, ec);
+        if (*ec != bsky_ec_Json_expect_Null) return json;
+
+        *data = data_s;
+        json = bsky_parse_json_bool(data, ec);
+        if (*ec != bsky_ec_Json_expect_Bool) return json;
+
+        *data = data_s;
+        json = bsky_parse_json_num(data, ec);
+        if (*ec != bsky_ec_Json_expect_Number) return json;
+
+        *data = data_s;
+        json = bsky_parse_json_str(data, ec);
+        if (*ec != bsky_ec_Json_expect_OQ) return json;
+
+        *data = data_s;
+        json = bsky_parse_json_arr(data, ec);
+        if (*ec != bsky_ec_Json_expect_OSB) return json;
+
+        *data = data_s;
+        json = bsky_parse_json_dct(data, ec);
+        if (*ec != bsky_ec_Json_expect_OCB) return json;
+
+        *ec = bsky_ec_Json_invalid_variant;
+
+    defer:
+        return json;
+    }
+
+    struct bsky_json *bsky_json_get(struct bsky_json *json, const char *name)
+    {
+        if (json->var != bsky_json_Dct) return NULL;
+
+        for (size_t i = 0; i < json->dct.len; ++i) {
+            if (strcmp(json->dct.data[i].name, name) == 0)
+                return &json->dct.data[i].value;
+        }
+
+        return NULL;
+    }
+
+
+    /*
+     * BSKY STRING MAP
+     */
+    static size_t __bsky_hash_bytes(const void *data, size_t len)
+    {
+        const unsigned char *p = data;
+        uint64_t h = 0xcbf29ce484222325ull;
+
+        for (size_t i = 0; i < len; ++i) {
+            h ^= p[i];
+            h *= 0x100000001b3ull;
+        }
+
+        return (size_t) h;
+    }
+
+    static struct bsky_str_map_entry *
+    __bsky_str_map_slot(struct bsky_str_map *map, struct bsky_str key,
+                        size_t hash)
+    {
+        size_t mask = map->cap - 1, len = bsky_str_len(key);
+
+        for (size_t i = hash & mask;; i = (i + 1) & mask) {
+            struct bsky_str_map_entry *e = &map->data[i];
+
+            if (e->key == NULL) return e;
+            if (e->hash == hash && strncmp(e->key, key.start, len) == 0
+                                && e->key[len] == '\0') return e;
+        }
+    }
+
+    static enum bsky_error_code __bsky_str_map_grow(struct bsky_str_map *map)
+    {
+        struct bsky_str_map old = *map;
+
+        map->cap  = old.cap ? old.cap * 2 : 16;
+        map->data = calloc(map->cap, sizeof (struct bsky_str_map_entry));
+        if (map->data == NULL) {
+            *map = old;
+            bsky_return_error(bsky_ec_Out_of_memory);
+        }
+
+        for (size_t i = 0; i < old.cap; ++i) {
+            struct bsky_str_map_entry *e = &old.data[i];
+            if (e->key == NULL) continue;
+
+            struct bsky_str key = { e->key, e->key + strlen(e->key) };
+            *__bsky_str_map_slot(map, key, e->hash) = *e;
+        }
+
+        free(old.data);
+        return bsky_ec_Ok;
+    }
+
+    enum bsky_error_code bsky_str_map_set(struct bsky_str_map *map,
+                                          struct bsky_str key, size_t value)
+    {
+        enum bsky_error_code ec;
+
+        if ((map->len + 1) * 4 > map->cap * 3) {
+            if ((ec = __bsky_str_map_grow(map)) != bsky_ec_Ok) return ec;
+        }
+
+        size_t len  = bsky_str_len(key);
+        size_t hash = __bsky_hash_bytes(key.start, len);
+        struct bsky_str_map_entry *e = __bsky_str_map_slot(map, key, hash);
+
+        if (e->key == NULL) {
+            if ((e->key = malloc(len + 1)) == NULL)
+                bsky_return_error(bsky_ec_Out_of_memory);
+
+            memcpy(e->key, key.start, len);
+            e->key[len] = '\0';
+            e->hash     = hash;
+            map->len++;
+        }
+        e->value = value;
+
+        return bsky_ec_Ok;
+    }
+
+    size_t *bsky_str_map_get(struct bsky_str_map *map, struct bsky_str key)
+    {
+        if (map->len == 0) return NULL;
+
+        size_t hash = __bsky_hash_bytes(key.start, bsky_str_len(key));
+        struct bsky_str_map_entry *e = __bsky_str_map_slot(map, key, hash);
+
+        return e->key ? &e->value : NULL;
+    }
+
+    int bsky_str_map_del(struct bsky_str_map *map, struct bsky_str key)
+    {
+        if (map->len == 0) return 0;
+
+        size_t mask = map->cap - 1;
+        size_t hash = __bsky_hash_bytes(key.start, bsky_str_len(key));
+        struct bsky_str_map_entry *e = __bsky_str_map_slot(map, key, hash);
+
+        if (e->key == NULL) return 0;
+
+        free(e->key);
+        e->key = NULL;
+        map->len--;
+
+        // shift back entries of the probe run, so lookups don't stop at
+        // the hole.
+        for (size_t i = e - map->data, j = (i + 1) & mask;
+             map->data[j].key != NULL; j = (j + 1) & mask) {
+            size_t home = map->data[j].hash & mask;
+
+            if (((j - home) & mask) >= ((j - i) & mask)) {
+                map->data[i] = map->data[j];
+                map->data[j].key = NULL;
+                i = j;
+            }
+        }
+
+        return 1;
+    }
+
+    void bsky_str_map_free(struct bsky_str_map *map)
+    {
+        for (size_t i = 0; i < map->cap; ++i) free(map->data[i].key);
+        free(map->data);
+
+        *map = (struct bsky_str_map) { 0 };
+    }
+
+    /*
+     * BSKY NET
+     */
+    #include <time.h>
+    #include <errno.h>
+    #include <unistd.h>
+    #include <fcntl.h>
+    #include <netdb.h>
+    #include <netinet/in.h>
+    #include <netinet/tcp.h>
+
+    static uint64_t __bsky_now_ns(void)
+    {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+
+        return (uint64_t) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+    }
+
+    #define __BSKY_OR_DEFAULT(v, d) ((v) ? (v) : (d))
+
+    static char *__bsky_tmp_cstr(struct bsky_str str)
+    {
+        size_t len = bsky_str_len(str);
+        char  *ret = bsky_tmp_alloc(len + 1);
+
+        if (ret == NULL) return NULL;
+
+        memcpy(ret, str.start, len);
+        ret[len] = '\0';
+
+        return ret;
+    }
+
+    struct bsky_url bsky_parse_url(struct bsky_str str,
+                                   enum bsky_error_code *ec)
+    {
+        *ec = bsky_ec_Ok;
+
+        struct bsky_url url = { 0 };
+        char *p = str.start;
+
+        while (p + 2 < str.end && !(p[0] == ':' && p[1] == '/' && p[2] == '/'))
+            p++;
+        if (p + 2 >= str.end || p == str.start)
+            bsky_defer_ec(bsky_ec_Url_invalid);
+
+        url.scheme = (struct bsky_str) { str.start, p };
+        p += 3;
+
+        char *host = p;
+        while (p < str.end && *p != ':' && *p != '/') p++;
+        if (p == host) bsky_defer_ec(bsky_ec_Url_invalid);
+
+        url.host = (struct bsky_str) { host, p };
+
+        if (p < str.end && *p == ':') {
+            char *port = ++p;
+            while (p < str.end && *p >= '0' && *p <= '9') p++;
+            if (p == port) bsky_defer_ec(bsky_ec_Url_invalid);
+
+            url.port = (struct bsky_str) { port, p };
+        }
+        else url.port = (struct bsky_str) { p, p };
+
+        if (p < str.end && *p != '/') bsky_defer_ec(bsky_ec_Url_invalid);
+
+        url.path = (struct bsky_str) { p, str.end };
+
+    defer:
+        return url;
+    }
+
+    struct bsky_str bsky_url_port(struct bsky_url url)
+    {
+        if (bsky_str_len(url.port) != 0) {
+            char *port = __bsky_tmp_cstr(url.port);
+            if (port != NULL) return bsky_mk_str(port);
+        }
+
+        if (bsky_str_len(url.scheme) == 5 &&
+            (memcmp(url.scheme.start, "https", 5) == 0))
+            return bsky_mk_str("443");
+        if (bsky_str_len(url.scheme) == 3 &&
+            (memcmp(url.scheme.start, "wss", 3) == 0))
+            return bsky_mk_str("443");
+
+        return bsky_mk_str("80");
+    }
+
+    int bsky_net_connect(const char *host, const char *port,
+                         enum bsky_error_code *ec)
+    {
+        *ec = bsky_ec_Ok;
+
+        struct addrinfo hints = { 0 }, *res = NULL;
+        int fd = -1;
+
+        hints.ai_family   = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+
+        if (getaddrinfo(host, port, &hints, &res) != 0)
+            bsky_defer_ec(bsky_ec_Net_resolve);
+
+        for (struct addrinfo *ai = res; ai != NULL; ai = ai->ai_next) {
+            fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+            if (fd < 0) continue;
+
+            if (connect(fd, ai->ai_addr, ai->ai_addrlen) == 0) break;
+
+            close(fd);
+            fd = -1;
+        }
+
+        if (fd < 0) bsky_defer_ec(bsky_ec_Net_connect);
+
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof (one));
+
+    defer:
+        if (res != NULL) freeaddrinfo(res);
+        return fd;
+    }
+
+    size_t bsky_conn_pool_host(struct bsky_conn_pool *pool,
+                               struct bsky_str host, struct bsky_str port,
+                               enum bsky_error_code *ec)
+    {
+        *ec = bsky_ec_Ok;
+
+        struct bsky_str_builder sb = { 0 };
+        size_t ret = (size_t) -1;
+
+        bsky_sb_push_str(&sb, host);
+        bsky_sb_push(&sb, ':');
+        bsky_sb_push_str(&sb, port);
+
+        struct bsky_str key = bsky_sb_build(&sb);
+        size_t *idx = bsky_str_map_get(&pool->index, key);
+
+        if (idx != NULL) {
+            ret = *idx;
+            goto defer;
+        }
+
+        struct bsky_conn_host entry = { 0 };
+        size_t host_len = bsky_str_len(host), port_len = bsky_str_len(port);
+
+        entry.host = malloc(host_len + 1);
+        entry.port = malloc(port_len + 1);
+        if (entry.host == NULL || entry.port == NULL) {
+            free(entry.host);
+            free(entry.port);
+            bsky_defer_ec(bsky_ec_Out_of_memory);
+        }
+
+        memcpy(entry.host, host.start, host_len);
+        memcpy(entry.port, port.start, port_len);
+        entry.host[host_len] = entry.port[port_len] = '\0';
+
+        if ((*ec = bsky_da_push(pool, entry)) != bsky_ec_Ok) {
+            free(entry.host);
+            free(entry.port);
+            goto defer;
+        }
+
+        // entry the index can't reach is dropped.
+        if ((*ec = bsky_str_map_set(&pool->index, key, pool->len - 1))
+                != bsky_ec_Ok) {
+            pool->len--;
+            free(entry.host);
+            free(entry.port);
+            goto defer;
+        }
+
+        ret = pool->len - 1;
+
+    defer:
+        bsky_da_free(&sb);
+        return ret;
+    }
+
+    static enum bsky_error_code
+    __bsky_conn_host_resolve(struct bsky_conn_host *h)
+    {
+        struct addrinfo hints = { 0 }, *res = NULL;
+        uint64_t start = __bsky_now_ns();
+
+        hints.ai_family   = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+
+        if (getaddrinfo(h->host, h->port, &hints, &res) != 0 || res == NULL)
+            bsky_return_error(bsky_ec_Net_resolve);
+
+        memcpy(&h->addr, res->ai_addr, res->ai_addrlen);
+        h->addr_len   = res->ai_addrlen;
+        h->resolve_ns = __bsky_now_ns() - start;
+
+        freeaddrinfo(res);
+        return bsky_ec_Ok;
+    }
+
+    // Open socket to cached address of host. With `nonblock' connect is
+    // only started and socket is returned in non-blocking mode.
+    static int __bsky_net_connect_addr(struct bsky_conn_host *h, int nonblock)
+    {
+        int type = SOCK_STREAM | SOCK_CLOEXEC | (nonblock ? SOCK_NONBLOCK : 0);
+        int fd   = socket(h->addr.ss_family, type, 0);
+        if (fd < 0) return -1;
+
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof (one));
+        setsockopt(fd, SOL_SOCKET, SO_KEEPALIVE, &one, sizeof (one));
+
+        if (connect(fd, (struct sockaddr*) &h->addr, h->addr_len) != 0 &&
+            !(nonblock && errno == EINPROGRESS)) {
+            close(fd);
+            return -1;
+        }
+
+        return fd;
+    }
+
+    int bsky_conn_pool_get(struct bsky_conn_pool *pool, size_t host,
+                           enum bsky_error_code *ec)
+    {
+        *ec = bsky_ec_Ok;
+
+        struct bsky_conn_host *h = &pool->data[host];
+
+        if (h->idle.len != 0) {
+            h->reuses++;
+            return h->idle.data[--h->idle.len];
+        }
+
+        if (h->addr_len == 0 &&
+            (*ec = __bsky_conn_host_resolve(h)) != bsky_ec_Ok) return -1;
+
+        int fd = __bsky_net_connect_addr(h, 0);
+
+        if (fd < 0) {
+            // address could change, try to resolve it again.
+            h->addr_len = 0;
+            if ((*ec = __bsky_conn_host_resolve(h)) != bsky_ec_Ok) return -1;
+
+            fd = __bsky_net_connect_addr(h, 0);
+        }
+
+        if (fd < 0) *ec = bsky_ec_Net_connect;
+        else        h->connects++;
+
+        return fd;
+    }
+
+    void bsky_conn_pool_put(struct bsky_conn_pool *pool, size_t host,
+                            int fd, int keep_alive)
+    {
+        struct bsky_conn_host *h = &pool->data[host];
+
+        if (fd < 0) return;
+
+        if (!keep_alive ||
+            h->idle.len >= __BSKY_OR_DEFAULT(pool->max_idle,
+                                             BSKY_CONN_POOL_MAX_IDLE) ||
+            bsky_da_push(&h->idle, fd) != bsky_ec_Ok) {
+            close(fd);
+        }
+    }
+
+    void bsky_conn_pool_free(struct bsky_conn_pool *pool)
+    {
+        for (size_t i = 0; i < pool->len; ++i) {
+            struct bsky_conn_host *h = &pool->data[i];
+
+            for (size_t j = 0; j < h->idle.len; ++j) close(h->idle.data[j]);
+
+            bsky_da_free(&h->idle);
+            free(h->host);
+            free(h->port);
+        }
+
+        bsky_da_free(pool);
+        bsky_str_map_free(&pool->index);
+
+        *pool = (struct bsky_conn_pool) { 0 };
+    }
+
+    struct __bsky_warmup {
+        struct bsky_conn_pool    *pool;
+        struct bsky_warmup_stats *stats;
+        uint64_t start_ns;
+        size_t   pending;
+
+        struct __bsky_warmup_conn { int fd; size_t host; } *conns;
+    };
+
+    static void __bsky_warmup_on_connect(struct bsky_loop *loop, int fd,
+                                         int events, void *user)
+    {
+        struct __bsky_warmup_conn *c = user;
+        struct __bsky_warmup *w = loop->user;
+        struct bsky_conn_host *h = &w->pool->data[c->host];
+
+        int err = 0;
+        socklen_t len = sizeof (err);
+
+        getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &len);
+        bsky_loop_del(loop, fd);
+
+        if (err != 0 || (events & bsky_loop_Close)) {
+            close(fd);
+            w->stats->failed++;
+        } else {
+            uint64_t t = __bsky_now_ns() - w->start_ns;
+
+            // pool hands out blocking sockets.
+            fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_NONBLOCK);
+
+            if (bsky_da_push(&h->idle, fd) != bsky_ec_Ok) {
+                close(fd);
+                w->stats->failed++;
+            } else {
+                if (w->stats->ready++ == 0) w->stats->first_ready_ns = t;
+                if (h->first_ready_ns == 0) h->first_ready_ns = t;
+
+                w->stats->all_ready_ns = t;
+                h->connects++;
+            }
+        }
+
+        c->fd = -1;
+        if (--w->pending == 0) bsky_loop_stop(loop);
+    }
+
+    static void __bsky_warmup_on_timeout(struct bsky_loop *loop, void *user)
+    {
+        bsky_loop_stop(loop);
+    }
+
+    enum bsky_error_code bsky_conn_pool_warmup(struct bsky_conn_pool *pool,
+                                               size_t per_host,
+                                               int timeout_ms,
+                                               struct bsky_warmup_stats *stats)
+    {
+        enum bsky_error_code ec = bsky_ec_Ok;
+        struct bsky_warmup_stats dummy;
+        struct __bsky_warmup w = { .pool = pool, .stats = stats };
+        struct bsky_loop loop  = { .epfd = -1 };
+        size_t total = 0;
+
+        if (w.stats == NULL) w.stats = &dummy;
+        *w.stats   = (struct bsky_warmup_stats) { 0 };
+        w.start_ns = __bsky_now_ns();
+
+        if (per_host > __BSKY_OR_DEFAULT(pool->max_idle,
+                                          BSKY_CONN_POOL_MAX_IDLE)) {
+            pool->max_idle = per_host;
+        }
+
+        for (size_t i = 0; i < pool->len; ++i) {
+            struct bsky_conn_host *h = &pool->data[i];
+
+            if (h->addr_len == 0 && __bsky_conn_host_resolve(h) != bsky_ec_Ok)
+                continue;
+
+            if (h->idle.len < per_host) total += per_host - h->idle.len;
+        }
+        w.stats->resolve_ns = __bsky_now_ns() - w.start_ns;
+
+        if (total == 0) return bsky_ec_Ok;
+
+        w.conns = malloc(total * sizeof (struct __bsky_warmup_conn));
+        if (w.conns == NULL) bsky_return_error(bsky_ec_Out_of_memory);
+
+        for (size_t i = 0; i < total; ++i) w.conns[i].fd = -1;
+
+        if ((ec = bsky_loop_init(&loop)) != bsky_ec_Ok) goto defer;
+        loop.user = &w;
+
+        for (size_t i = 0, n = 0; i < pool->len; ++i) {
+            struct bsky_conn_host *h = &pool->data[i];
+
+            if (h->addr_len == 0) continue;
+
+            for (size_t j = h->idle.len; j < per_host; ++j, ++n) {
+                struct __bsky_warmup_conn *c = &w.conns[n];
+
+                c->host = i;
+                c->fd   = __bsky_net_connect_addr(h, 1);
+
+                if (c->fd < 0 || bsky_loop_add(&loop, c->fd, bsky_loop_Write,
+                                     __bsky_warmup_on_connect, c) != bsky_ec_Ok) {
+                    if (c->fd >= 0) close(c->fd);
+                    c->fd = -1;
+                    w.stats->failed++;
+                    continue;
+                }
+                w.pending++;
+            }
+        }
+
+        if (w.pending != 0) {
+            bsky_loop_timer(&loop, timeout_ms, __bsky_warmup_on_timeout, NULL);
+            ec = bsky_loop_run(&loop);
+        }
+
+        // connections still in progress after timeout.
+        for (size_t i = 0; i < total; ++i) {
+            if (w.conns[i].fd < 0) continue;
+
+            close(w.conns[i].fd);
+            w.stats->failed++;
+        }
+
+    defer:
+        if (loop.epfd >= 0) bsky_loop_free(&loop);
+        free(w.conns);
+
+        if (ec == bsky_ec_Ok && w.stats->ready == 0 && w.stats->failed != 0)
+            ec = bsky_ec_Net_connect;
+
+        return ec;
+    }
+
+    /*
+     * BSKY PDS ROUTING
+     */
+    struct bsky_str bsky_pds_of_did_doc(struct bsky_json doc,
+                                        enum bsky_error_code *ec)
+    {
+        *ec = bsky_ec_Ok;
+
+        struct bsky_json *services = bsky_json_get(&doc, "service");
+
+        if (services == NULL || services->var != bsky_json_Arr)
+            bsky_defer_ec(bsky_ec_Pds_not_found);
+
+        for (size_t i = 0; i < services->arr.len; ++i) {
+            struct bsky_json *id = bsky_json_get(&services->arr.data[i], "id");
+            struct bsky_json *ep = bsky_json_get(&services->arr.data[i],
+                                                 "serviceEndpoint");
+
+            if (id == NULL || id->var != bsky_json_Str) continue;
+            if (ep == NULL || ep->var != bsky_json_Str) continue;
+
+            if (bsky_str_ends_with(bsky_mk_str(id->str),
+                                   bsky_mk_str("#atproto_pds"))) {
+                return bsky_mk_str(ep->str);
+            }
+        }
+
+        *ec = bsky_ec_Pds_not_found;
+
+    defer:
+        return (struct bsky_str) { 0 };
+    }
+
+    int bsky_xrpc_is_pds_scoped(struct bsky_str nsid)
+    {
+        return bsky_str_starts_with(nsid, bsky_mk_str("com.atproto.repo.")) ||
+               bsky_str_starts_with(nsid, bsky_mk_str("com.atproto.sync."));
+    }
+
+    static size_t __bsky_pds_router_endpoint(struct bsky_pds_router *router,
+                                             struct bsky_str endpoint,
+                                             enum bsky_error_code *ec)
+    {
+        *ec = bsky_ec_Ok;
+
+        // trailing slash would break `endpoint + "/xrpc/" + nsid'.
+        while (bsky_str_len(endpoint) != 0 && endpoint.end[-1] == '/')
+            endpoint.end--;
+
+        size_t *idx = bsky_str_map_get(&router->endpoints, endpoint);
+        if (idx != NULL) return *idx;
+
+        struct bsky_url url = bsky_parse_url(endpoint, ec);
+        if (*ec != bsky_ec_Ok) return (size_t) -1;
+
+        struct bsky_pds_route route = { 0 };
+
+        route.host = bsky_conn_pool_host(&router->pool, url.host,
+                                         bsky_url_port(url), ec);
+        if (*ec != bsky_ec_Ok) return (size_t) -1;
+
+        size_t len = bsky_str_len(endpoint);
+        if ((route.endpoint = malloc(len + 1)) == NULL) {
+            *ec = bsky_ec_Out_of_memory;
+            return (size_t) -1;
+        }
+        memcpy(route.endpoint, endpoint.start, len);
+        route.endpoint[len] = '\0';
+
+        if ((*ec = bsky_da_push(&router->routes, route)) != bsky_ec_Ok) {
+            free(route.endpoint);
+            return (size_t) -1;
+        }
+
+        *ec = bsky_str_map_set(&router->endpoints, endpoint,
+                               router->routes.len - 1);
+
+        return router->routes.len - 1;
+    }
+
+    enum bsky_error_code bsky_pds_router_set(struct bsky_pds_router *router,
+                                             struct bsky_str did,
+                                             struct bsky_str endpoint)
+    {
+        enum bsky_error_code ec;
+
+        size_t route = __bsky_pds_router_endpoint(router, endpoint, &ec);
+        if (ec != bsky_ec_Ok) return ec;
+
+        return bsky_str_map_set(&router->dids, did, route);
+    }
+
+    enum bsky_error_code bsky_pds_router_add_doc(struct bsky_pds_router *router,
+                                                 struct bsky_json doc)
+    {
+        enum bsky_error_code ec;
+
+        struct bsky_json *id = bsky_json_get(&doc, "id");
+        if (id == NULL || id->var != bsky_json_Str)
+            bsky_return_error(bsky_ec_Pds_not_found);
+
+        struct bsky_str endpoint = bsky_pds_of_did_doc(doc, &ec);
+        if (ec != bsky_ec_Ok) return ec;
+
+        return bsky_pds_router_set(router, bsky_mk_str(id->str), endpoint);
+    }
+
+    enum bsky_error_code
+    bsky_pds_router_set_fallback(struct bsky_pds_router *router,
+                                 struct bsky_str endpoint)
+    {
+        enum bsky_error_code ec;
+
+        size_t route = __bsky_pds_router_endpoint(router, endpoint, &ec);
+        if (ec != bsky_ec_Ok) return ec;
+
+        router->fallback      = router->routes.data[route].endpoint;
+        router->fallback_host = router->routes.data[route].host;
+
+        return bsky_ec_Ok;
+    }
+
+    struct bsky_pds_route *bsky_pds_router_lookup(struct bsky_pds_router *router,
+                                                  struct bsky_str did)
+    {
+        size_t *idx = bsky_str_map_get(&router->dids, did);
+
+        return idx ? &router->routes.data[*idx] : NULL;
+    }
+
+    struct bsky_xrpc_target bsky_pds_router_route(struct bsky_pds_router *router,
+                                                  struct bsky_str did,
+                                                  struct bsky_str nsid,
+                                                  enum bsky_error_code *ec)
+    {
+        *ec = bsky_ec_Ok;
+
+        struct bsky_xrpc_target target = { .fd = -1 };
+        struct bsky_pds_route  *route  = NULL;
+        char  *endpoint = router->fallback;
+
+        target.host = router->fallback_host;
+
+        if (bsky_xrpc_is_pds_scoped(nsid) || endpoint == NULL) {
+            route = bsky_pds_router_lookup(router, did);
+        }
+
+        if (route != NULL) {
+            endpoint    = route->endpoint;
+            target.host = route->host;
+        }
+
+        if (endpoint == NULL) bsky_defer_ec(bsky_ec_Pds_unknown_did);
+
+        struct bsky_str_builder sb = { 0 };
+        bsky_sb_push_str(&sb, bsky_mk_str(endpoint));
+        bsky_sb_push_str(&sb, bsky_mk_str("/xrpc/"));
+        bsky_sb_push_str(&sb, nsid);
+        target.url = bsky_sb_build_tmp(&sb);
+
+        target.fd = bsky_conn_pool_get(&router->pool, target.host, ec);
+
+    defer:
+        return target;
+    }
+
+    void bsky_pds_router_release(struct bsky_pds_router *router,
+                                 struct bsky_xrpc_target *target,
+                                 int keep_alive)
+    {
+        bsky_conn_pool_put(&router->pool, target->host, target->fd,
+                           keep_alive);
+        target->fd = -1;
+    }
+
+    void bsky_pds_router_free(struct bsky_pds_router *router)
+    {
+        for (size_t i = 0; i < router->routes.len; ++i)
+            free(router->routes.data[i].endpoint);
+
+        bsky_da_free(&router->routes);
+        bsky_str_map_free(&router->dids);
+        bsky_str_map_free(&router->endpoints);
+        bsky_conn_pool_free(&router->pool);
+
+        *router = (struct bsky_pds_router) { 0 };
+    }
+
+    /*
+     * BSKY SHA-256
+     */
+    static const uint32_t __bsky_sha256_k[64] = {
+        0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1,
+        0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+        0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786,
+        0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+        0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147,
+        0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+        0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85, 0xa2bfe8a1, 0xa81a664b,
+        0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+        0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a,
+        0x5b9cca4f, 0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+        0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+    };
+
+    #define __BSKY_ROTR32(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+    static void __bsky_sha256_blocks_portable(uint32_t state[8],
+                                              const unsigned char *data,
+                                              size_t n)
+    {
+        for (; n != 0; --n, data += 64) {
+            uint32_t w[64];
+            uint32_t a = state[0], b = state[1], c = state[2], d = state[3],
+                     e = state[4], f = state[5], g = state[6], h = state[7];
+
+            for (int i = 0; i < 16; ++i) {
+                w[i] = (uint32_t) data[i*4]   << 24 |
+                       (uint32_t) data[i*4+1] << 16 |
+                       (uint32_t) data[i*4+2] <<  8 |
+                       (uint32_t) data[i*4+3];
+            }
+            for (int i = 16; i < 64; ++i) {
+                uint32_t s0 = __BSKY_ROTR32(w[i-15], 7) ^
+                              __BSKY_ROTR32(w[i-15], 18) ^ (w[i-15] >> 3);
+                uint32_t s1 = __BSKY_ROTR32(w[i-2], 17) ^
+                              __BSKY_ROTR32(w[i-2], 19) ^ (w[i-2] >> 10);
+                w[i] = w[i-16] + s0 + w[i-7] + s1;
+            }
+
+            for (int i = 0; i < 64; ++i) {
+                uint32_t s1 = __BSKY_ROTR32(e, 6) ^ __BSKY_ROTR32(e, 11) ^
+                              __BSKY_ROTR32(e, 25);
+                uint32_t ch = (e & f) ^ (~e & g);
+                uint32_t t1 = h + s1 + ch + __bsky_sha256_k[i] + w[i];
+                uint32_t s0 = __BSKY_ROTR32(a, 2) ^ __BSKY_ROTR32(a, 13) ^
+                              __BSKY_ROTR32(a, 22);
+                uint32_t mj = (a & b) ^ (a & c) ^ (b & c);
+                uint32_t t2 = s0 + mj;
+
+                h = g; g = f; f = e; e = d + t1;
+                d = c; c = b; b = a; a = t1 + t2;
+            }
+
+            state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+            state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+        }
+    }
+
+    #if !defined(BSKY_SHA256_PORTABLE) && (defined(__x86_64__) || \
+                                           defined(__i386__))
+        #define __BSKY_SHA256_X86
+        #include <cpuid.h>
+        #include <immintrin.h>
+
+    __attribute__((target("sha,sse4.1")))
+    static void __bsky_sha256_blocks_shani(uint32_t state[8],
+                                           const unsigned char *data,
+                                           size_t n)
+    {
+        const __m128i mask = _mm_set_epi64x(0x0c0d0e0f08090a0bull,
+                                            0x0405060700010203ull);
+        __m128i state0, state1, tmp;
+
+        // instructions work with ABEF and CDGH halves of state.
+        tmp    = _mm_loadu_si128((const __m128i*) &state[0]);
+        state1 = _mm_loadu_si128((const __m128i*) &state[4]);
+        tmp    = _mm_shuffle_epi32(tmp, 0xb1);
+        state1 = _mm_shuffle_epi32(state1, 0x1b);
+        state0 = _mm_alignr_epi8(tmp, state1, 8);
+        state1 = _mm_blend_epi16(state1, tmp, 0xf0);
+
+        for (; n != 0; --n, data += 64) {
+            __m128i abef = state0, cdgh = state1, msg[4];
+
+            for (int i = 0; i < 4; ++i) {
+                msg[i] = _mm_shuffle_epi8(_mm_loadu_si128(
+                             (const __m128i*) (data + i * 16)), mask);
+            }
+
+            #pragma GCC unroll 16
+            for (int i = 0; i < 16; ++i) {
+                __m128i w = _mm_add_epi32(msg[i & 3], _mm_loadu_si128(
+                                (const __m128i*) &__bsky_sha256_k[i * 4]));
+
+                state1 = _mm_sha256rnds2_epu32(state1, state0, w);
+                state0 = _mm_sha256rnds2_epu32(state0, state1,
+                                               _mm_shuffle_epi32(w, 0x0e));
+
+                // schedule words of the group i + 4.
+                if (i < 12) {
+                    __m128i next = _mm_sha256msg1_epu32(msg[i & 3],
+                                                        msg[(i + 1) & 3]);
+                    next = _mm_add_epi32(next, _mm_alignr_epi8(
+                               msg[(i + 3) & 3], msg[(i + 2) & 3], 4));
+                    msg[i & 3] = _mm_sha256msg2_epu32(next, msg[(i + 3) & 3]);
+                }
+            }
+
+            state0 = _mm_add_epi32(state0, abef);
+            state1 = _mm_add_epi32(state1, cdgh);
+        }
+
+        tmp    = _mm_shuffle_epi32(state0, 0x1b);
+        state1 = _mm_shuffle_epi32(state1, 0xb1);
+        state0 = _mm_blend_epi16(tmp, state1, 0xf0);
+        state1 = _mm_alignr_epi8(state1, tmp, 8);
+
+        _mm_storeu_si128((__m128i*) &state[0], state0);
+        _mm_storeu_si128((__m128i*) &state[4], state1);
+    }
+
+    #define __BSKY_ROTR32_X8(x, n) _mm256_or_si256(_mm256_srli_epi32(x, n), \
+                                       _mm256_slli_epi32(x, 32 - (n)))
+
+    // One block of 8 independent messages. State is transposed: `state[i]'
+    // holds i-th word of all 8 lanes.
+    __attribute__((target("avx2")))
+    static void __bsky_sha256_block_x8(uint32_t state[8][8],
+                                       const unsigned char *blocks[8])
+    {
+        __m256i w[16], s[8];
+
+        for (int i = 0; i < 8; ++i) {
+            s[i] = _mm256_loadu_si256((const __m256i*) state[i]);
+        }
+        for (int i = 0; i < 16; ++i) {
+            uint32_t lane[8];
+
+            for (int j = 0; j < 8; ++j) {
+                memcpy(&lane[j], blocks[j] + i * 4, 4);
+                lane[j] = __builtin_bswap32(lane[j]);
+            }
+            w[i] = _mm256_loadu_si256((const __m256i*) lane);
+        }
+
+        __m256i a = s[0], b = s[1], c = s[2], d = s[3],
+                e = s[4], f = s[5], g = s[6], h = s[7];
+
+        for (int i = 0; i < 64; ++i) {
+            if (i >= 16) {
+                __m256i w15 = w[(i - 15) & 15], w2 = w[(i - 2) & 15];
+                __m256i s0  = _mm256_xor_si256(_mm256_xor_si256(
+                                  __BSKY_ROTR32_X8(w15, 7),
+                                  __BSKY_ROTR32_X8(w15, 18)),
+                                  _mm256_srli_epi32(w15, 3));
+                __m256i s1  = _mm256_xor_si256(_mm256_xor_si256(
+                                  __BSKY_ROTR32_X8(w2, 17),
+                                  __BSKY_ROTR32_X8(w2, 19)),
+                                  _mm256_srli_epi32(w2, 10));
+
+                w[i & 15] = _mm256_add_epi32(_mm256_add_epi32(w[i & 15], s0),
+                                             _mm256_add_epi32(w[(i - 7) & 15],
+                                                              s1));
+            }
+
+            __m256i s1 = _mm256_xor_si256(_mm256_xor_si256(
+                             __BSKY_ROTR32_X8(e, 6), __BSKY_ROTR32_X8(e, 11)),
+                             __BSKY_ROTR32_X8(e, 25));
+            __m256i ch = _mm256_xor_si256(_mm256_and_si256(e, f),
+                                          _mm256_andnot_si256(e, g));
+            __m256i t1 = _mm256_add_epi32(_mm256_add_epi32(h, s1),
+                             _mm256_add_epi32(_mm256_add_epi32(ch, w[i & 15]),
+                                 _mm256_set1_epi32(__bsky_sha256_k[i])));
+            __m256i s0 = _mm256_xor_si256(_mm256_xor_si256(
+                             __BSKY_ROTR32_X8(a, 2), __BSKY_ROTR32_X8(a, 13)),
+                             __BSKY_ROTR32_X8(a, 22));
+            __m256i mj = _mm256_or_si256(_mm256_and_si256(a, b),
+                             _mm256_and_si256(c, _mm256_or_si256(a, b)));
+
+            h = g; g = f; f = e; e = _mm256_add_epi32(d, t1);
+            d = c; c = b; b = a; a = _mm256_add_epi32(t1,
+                                                      _mm256_add_epi32(s0, mj));
+        }
+
+        s[0] = _mm256_add_epi32(s[0], a); s[1] = _mm256_add_epi32(s[1], b);
+        s[2] = _mm256_add_epi32(s[2], c); s[3] = _mm256_add_epi32(s[3], d);
+        s[4] = _mm256_add_epi32(s[4], e); s[5] = _mm256_add_epi32(s[5], f);
+        s[6] = _mm256_add_epi32(s[6], g); s[7] = _mm256_add_epi32(s[7], h);
+
+        for (int i = 0; i < 8; ++i) {
+            _mm256_storeu_si256((__m256i*) state[i], s[i]);
+        }
+    }
+
+    #elif !defined(BSKY_SHA256_PORTABLE) && defined(__aarch64__) && \
+          defined(__linux__)
+        #define __BSKY_SHA256_ARMV8
+        #include <arm_neon.h>
+        #include <sys/auxv.h>
+        #include <asm/hwcap.h>
+
+    #ifdef __clang__
+    __attribute__((target("sha2")))
+    #else
+    __attribute__((target("+crypto")))
+    #endif
+    static void __bsky_sha256_blocks_armv8(uint32_t state[8],
+                                           const unsigned char *data,
+                                           size_t n)
+    {
+        uint32x4_t state0 = vld1q_u32(&state[0]);
+        uint32x4_t state1 = vld1q_u32(&state[4]);
+
+        for (; n != 0; --n, data += 64) {
+            uint32x4_t abcd = state0, efgh = state1, msg[4];
+
+            for (int i = 0; i < 4; ++i) {
+                msg[i] = vreinterpretq_u32_u8(vrev32q_u8(
+                             vld1q_u8(data + i * 16)));
+            }
+
+            #pragma GCC unroll 16
+            for (int i = 0; i < 16; ++i) {
+                uint32x4_t w = vaddq_u32(msg[i & 3],
+                                         vld1q_u32(&__bsky_sha256_k[i * 4]));
+                uint32x4_t prev = state0;
+
+                state0 = vsha256hq_u32(state0, state1, w);
+                state1 = vsha256h2q_u32(state1, prev, w);
+
+                if (i < 12) {
+                    msg[i & 3] = vsha256su1q_u32(
+                        vsha256su0q_u32(msg[i & 3], msg[(i + 1) & 3]),
+                        msg[(i + 2) & 3], msg[(i + 3) & 3]);
+                }
+            }
+
+            state0 = vaddq_u32(state0, abcd);
+            state1 = vaddq_u32(state1, efgh);
+        }
+
+        vst1q_u32(&state[0], state0);
+        vst1q_u32(&state[4], state1);
+    }
+    #endif
+
+    // The first use can come from several threads at once, function is
+    // published before backend, so backend other than `Auto' means the
+    // function is set.
+    static _Atomic(enum bsky_sha256_backend) __bsky_sha256_backend =
+        bsky_sha256_Auto;
+    static void (*_Atomic __bsky_sha256_fn)(uint32_t *, const unsigned char *,
+                                            size_t)
+        = __bsky_sha256_blocks_portable;
+
+    static int __bsky_sha256_supported(enum bsky_sha256_backend backend)
+    {
+    #if defined(__BSKY_SHA256_X86)
+        unsigned int eax, ebx = 0, ecx, edx;
+
+        __get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx);
+
+        if (backend == bsky_sha256_Shani) return (ebx >> 29) & 1;
+        if (backend == bsky_sha256_Avx2)  return __builtin_cpu_supports("avx2");
+    #elif defined(__BSKY_SHA256_ARMV8)
+        if (backend == bsky_sha256_Armv8)
+            return (getauxval(AT_HWCAP) & HWCAP_SHA2) != 0;
+    #endif
+
+        return backend == bsky_sha256_Portable;
+    }
+
+    enum bsky_sha256_backend bsky_sha256_use(enum bsky_sha256_backend backend)
+    {
+        if (backend == bsky_sha256_Auto) {
+            backend = __bsky_sha256_supported(bsky_sha256_Shani)
+                    ? bsky_sha256_Shani
+                    : __bsky_sha256_supported(bsky_sha256_Armv8)
+                    ? bsky_sha256_Armv8
+                    : __bsky_sha256_supported(bsky_sha256_Avx2)
+                    ? bsky_sha256_Avx2 : bsky_sha256_Portable;
+        }
+        if (!__bsky_sha256_supported(backend)) backend = bsky_sha256_Portable;
+
+        void (*fn)(uint32_t *, const unsigned char *, size_t)
+            = __bsky_sha256_blocks_portable;
+    #if defined(__BSKY_SHA256_X86)
+        if (backend == bsky_sha256_Shani) fn = __bsky_sha256_blocks_shani;
+    #elif defined(__BSKY_SHA256_ARMV8)
+        if (backend == bsky_sha256_Armv8) fn = __bsky_sha256_blocks_armv8;
+    #endif
+
+        atomic_store_explicit(&__bsky_sha256_fn, fn, memory_order_release);
+        atomic_store_explicit(&__bsky_sha256_backend, backend,
+                              memory_order_release);
+
+        return backend;
+    }
+
+    static enum bsky_sha256_backend __bsky_sha256_current(void)
+    {
+        enum bsky_sha256_backend backend = atomic_load_explicit(
+            &__bsky_sha256_backend, memory_order_acquire);
+
+        return backend == bsky_sha256_Auto ? bsky_sha256_use(bsky_sha256_Auto)
+                                           : backend;
+    }
+
+    static void __bsky_sha256_blocks(uint32_t state[8],
+                                     const unsigned char *data, size_t n)
+    {
+        __bsky_sha256_current();
+        atomic_load_explicit(&__bsky_sha256_fn, memory_order_acquire)(
+            state, data, n);
+    }
+
+    void bsky_sha256_init(struct bsky_sha256 *sha)
+    {
+        static const uint32_t iv[8] = {
+            0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+            0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+        };
+
+        memcpy(sha->state, iv, sizeof (iv));
+        sha->len     = 0;
+        sha->buf_len = 0;
+    }
+
+    void bsky_sha256_update(struct bsky_sha256 *sha, const void *data,
+                            size_t len)
+    {
+        const unsigned char *p = data;
+
+        sha->len += len;
+
+        if (sha->buf_len != 0) {
+            size_t n = 64 - sha->buf_len < len ? 64 - sha->buf_len : len;
+
+            memcpy(sha->buf + sha->buf_len, p, n);
+            sha->buf_len += n;
+            p   += n;
+            len -= n;
+
+            if (sha->buf_len < 64) return;
+
+            __bsky_sha256_blocks(sha->state, sha->buf, 1);
+            sha->buf_len = 0;
+        }
+
+        __bsky_sha256_blocks(sha->state, p, len / 64);
+
+        memcpy(sha->buf, p + len / 64 * 64, len % 64);
+        sha->buf_len = len % 64;
+    }
+
+    void bsky_sha256_final(struct bsky_sha256 *sha, unsigned char digest[32])
+    {
+        uint64_t bits = sha->len * 8;
+
+        sha->buf[sha->buf_len++] = 0x80;
+
+        if (sha->buf_len > 56) {
+            memset(sha->buf + sha->buf_len, 0, 64 - sha->buf_len);
+            __bsky_sha256_blocks(sha->state, sha->buf, 1);
+            sha->buf_len = 0;
+        }
+
+        memset(sha->buf + sha->buf_len, 0, 56 - sha->buf_len);
+        for (int i = 0; i < 8; ++i) sha->buf[56 + i] = bits >> (56 - i * 8);
+
+        __bsky_sha256_blocks(sha->state, sha->buf, 1);
+
+        for (int i = 0; i < 8; ++i) {
+            digest[i*4]   = sha->state[i] >> 24;
+            digest[i*4+1] = sha->state[i] >> 16;
+            digest[i*4+2] = sha->state[i] >>  8;
+            digest[i*4+3] = sha->state[i];
+        }
+    }
+
+    void bsky_sha256(const void *data, size_t len, unsigned char digest[32])
+    {
+        struct bsky_sha256 sha;
+
+        bsky_sha256_init(&sha);
+        bsky_sha256_update(&sha, data, len);
+        bsky_sha256_final(&sha, digest);
+    }
+
+    #ifdef __BSKY_SHA256_X86
+    // Lane of multi-buffer hashing: full blocks are read from message,
+    // the last one or two padded blocks from `tail'.
+    struct __bsky_sha256_lane {
+        const unsigned char *p;
+        size_t full, tail_pos, tail_len, msg;
+        int    busy;
+        unsigned char tail[128];
+    };
+
+    static void __bsky_sha256_lane_init(struct __bsky_sha256_lane *lane,
+                                        struct bsky_view data, size_t msg)
+    {
+        size_t   len  = (char*) data.end - (char*) data.start;
+        size_t   rest = len % 64;
+        uint64_t bits = (uint64_t) len * 8;
+
+        lane->p        = data.start;
+        lane->full     = len / 64;
+        lane->msg      = msg;
+        lane->busy     = 1;
+        lane->tail_pos = 0;
+        lane->tail_len = rest < 56 ? 64 : 128;
+
+        if (rest) memcpy(lane->tail, lane->p + len - rest, rest);
+        lane->tail[rest] = 0x80;
+        memset(lane->tail + rest + 1, 0, lane->tail_len - rest - 1);
+        for (int i = 0; i < 8; ++i) {
+            lane->tail[lane->tail_len - 1 - i] = bits >> (i * 8);
+        }
+    }
+
+    static void __bsky_sha256_many_x8(const struct bsky_view *data, size_t len,
+                                      unsigned char (*digests)[32])
+    {
+        static const uint32_t iv[8] = {
+            0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+            0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+        };
+        static const unsigned char idle[64];
+
+        struct __bsky_sha256_lane lanes[8];
+        uint32_t state[8][8];
+        size_t   next = 0, active = 0;
+
+        for (int j = 0; j < 8; ++j) {
+            for (int i = 0; i < 8; ++i) state[i][j] = iv[i];
+
+            lanes[j].busy = 0;
+            if (next < len) {
+                __bsky_sha256_lane_init(&lanes[j], data[next], next);
+                next++;
+                active++;
+            }
+        }
+
+        while (active != 0) {
+            const unsigned char *blocks[8];
+
+            for (int j = 0; j < 8; ++j) {
+                struct __bsky_sha256_lane *lane = &lanes[j];
+
+                blocks[j] = !lane->busy ? idle
+                          : lane->full  ? lane->p
+                          : lane->tail + lane->tail_pos;
+            }
+
+            __bsky_sha256_block_x8(state, blocks);
+
+            for (int j = 0; j < 8; ++j) {
+                struct __bsky_sha256_lane *lane = &lanes[j];
+
+                if (!lane->busy) continue;
+
+                if (lane->full) {
+                    lane->p += 64;
+                    lane->full--;
+                    continue;
+                }
+                if ((lane->tail_pos += 64) != lane->tail_len) continue;
+
+                // message is done: write digest and take the next one.
+                for (int i = 0; i < 8; ++i) {
+                    uint32_t v = state[i][j];
+
+                    digests[lane->msg][i*4]   = v >> 24;
+                    digests[lane->msg][i*4+1] = v >> 16;
+                    digests[lane->msg][i*4+2] = v >>  8;
+                    digests[lane->msg][i*4+3] = v;
+                    state[i][j] = iv[i];
+                }
+
+                lane->busy = 0;
+                active--;
+                if (next < len) {
+                    __bsky_sha256_lane_init(lane, data[next], next);
+                    next++;
+                    active++;
+                }
+            }
+        }
+    }
+    #endif
+
+    void bsky_sha256_many(const struct bsky_view *data, size_t len,
+                          unsigned char (*digests)[32])
+    {
+    #ifdef __BSKY_SHA256_X86
+        if (__bsky_sha256_current() == bsky_sha256_Avx2) {
+            __bsky_sha256_many_x8(data, len, digests);
+            return;
+        }
+    #endif
+
+        for (size_t i = 0; i < len; ++i) {
+            bsky_sha256(data[i].start,
+                        (char*) data[i].end - (char*) data[i].start,
+                        digests[i]);
+        }
+    }
+
+    /*
+     * BSKY BLOB UPLOAD
+     */
+    #include <poll.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <sys/sendfile.h>
+
+    static enum bsky_error_code __bsky_send_all(int fd, const void *data,
+                                                size_t len)
+    {
+        const char *p = data;
+
+        while (len != 0) {
+            ssize_t n = send(fd, p, len, MSG_NOSIGNAL);
+
+            if (n < 0 && errno == EINTR) continue;
+            if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                struct pollfd pfd = { .fd = fd, .events = POLLOUT };
+                poll(&pfd, 1, -1);
+                continue;
+            }
+            if (n <= 0) bsky_return_error(bsky_ec_Net_send);
+
+            p   += n;
+            len -= n;
+        }
+
+        return bsky_ec_Ok;
+    }
+
+    static enum bsky_error_code
+    __bsky_blob_send_head(struct bsky_blob_upload *up, size_t len, int chunked)
+    {
+        struct bsky_str_builder sb = { 0 };
+
+        bsky_sb_push_str(&sb, bsky_mk_str(
+                    "POST /xrpc/com.atproto.repo.uploadBlob HTTP/1.1\r\n"
+                    "Host: "));
+        bsky_sb_push_str(&sb, up->host);
+        bsky_sb_push_str(&sb, bsky_mk_str("\r\nContent-Type: "));
+        bsky_sb_push_str(&sb, up->mime);
+
+        if (bsky_str_len(up->token) != 0) {
+            bsky_sb_push_str(&sb, bsky_mk_str("\r\nAuthorization: Bearer "));
+            bsky_sb_push_str(&sb, up->token);
+        }
+
+        if (chunked) {
+            bsky_sb_push_fmt(&sb, "\r\nTransfer-Encoding: chunked\r\n\r\n");
+        } else {
+            bsky_sb_push_fmt(&sb, "\r\nContent-Length: %zu\r\n\r\n", len);
+        }
+
+        struct bsky_str head = bsky_sb_build(&sb);
+        enum bsky_error_code ec = __bsky_send_all(up->fd, head.start,
+                                                  bsky_str_len(head));
+        bsky_da_free(&sb);
+
+        return ec;
+    }
+
+    static void __bsky_blob_progress(struct bsky_blob_upload *up,
+                                     size_t n, size_t total)
+    {
+        up->sent += n;
+        if (up->progress != NULL) up->progress(up->user, up->sent, total);
+    }
+
+    enum bsky_error_code bsky_blob_upload_mem(struct bsky_blob_upload *up,
+                                              struct bsky_view data)
+    {
+        enum bsky_error_code ec;
+        struct bsky_sha256 sha;
+        size_t total = data.end - data.start;
+
+        up->sent = 0;
+        bsky_sha256_init(&sha);
+
+        if ((ec = __bsky_blob_send_head(up, total, 0)) != bsky_ec_Ok)
+            return ec;
+
+        for (char *p = data.start; p != data.end;) {
+            size_t n = (char*) data.end - p < BSKY_BLOB_CHUNK ?
+                       (char*) data.end - p : BSKY_BLOB_CHUNK;
+
+            bsky_sha256_update(&sha, p, n);
+            if ((ec = __bsky_send_all(up->fd, p, n)) != bsky_ec_Ok) return ec;
+
+            p += n;
+            __bsky_blob_progress(up, n, total);
+        }
+
+        bsky_sha256_final(&sha, up->sha256);
+
+        return bsky_ec_Ok;
+    }
+
+    static enum bsky_error_code
+    __bsky_blob_upload_stream(struct bsky_blob_upload *up, int file_fd)
+    {
+        enum bsky_error_code ec;
+        struct bsky_sha256 sha;
+        char *buf = malloc(BSKY_BLOB_CHUNK);
+
+        if (buf == NULL) bsky_return_error(bsky_ec_Out_of_memory);
+
+        bsky_sha256_init(&sha);
+
+        if ((ec = __bsky_blob_send_head(up, 0, 1)) != bsky_ec_Ok) goto defer;
+
+        for (;;) {
+            ssize_t n = read(file_fd, buf, BSKY_BLOB_CHUNK);
+
+            if (n < 0 && errno == EINTR) continue;
+            if (n < 0) {
+                ec = bsky_ec_Io;
+                goto defer;
+            }
+
+            char size[32];
+            int  size_len = snprintf(size, sizeof (size), "%zx\r\n", n);
+
+            bsky_sha256_update(&sha, buf, n);
+
+            if ((ec = __bsky_send_all(up->fd, size, size_len)) != bsky_ec_Ok)
+                goto defer;
+            if ((ec = __bsky_send_all(up->fd, buf, n)) != bsky_ec_Ok)
+                goto defer;
+            if ((ec = __bsky_send_all(up->fd, "\r\n", 2)) != bsky_ec_Ok)
+                goto defer;
+
+            if (n == 0) break;
+
+            __bsky_blob_progress(up, n, 0);
+        }
+
+        bsky_sha256_final(&sha, up->sha256);
+
+    defer:
+        free(buf);
+        return ec;
+    }
+
+    enum bsky_error_code bsky_blob_upload_file(struct bsky_blob_upload *up,
+                                               int file_fd)
+    {
+        enum bsky_error_code ec = bsky_ec_Ok;
+        struct bsky_sha256 sha;
+        struct stat st;
+
+        up->sent = 0;
+
+        if (fstat(file_fd, &st) != 0) bsky_return_error(bsky_ec_Io);
+
+        if (!S_ISREG(st.st_mode)) return __bsky_blob_upload_stream(up, file_fd);
+
+        size_t total = st.st_size;
+        off_t  off   = 0;
+        char  *map   = NULL;
+
+        if (total != 0) {
+            map = mmap(NULL, total, PROT_READ, MAP_PRIVATE, file_fd, 0);
+            if (map == MAP_FAILED) bsky_return_error(bsky_ec_Io);
+
+            madvise(map, total, MADV_SEQUENTIAL);
+        }
+
+        bsky_sha256_init(&sha);
+
+        if ((ec = __bsky_blob_send_head(up, total, 0)) != bsky_ec_Ok)
+            goto defer;
+
+        // Hash chunk while its pages are hot in page cache, then let kernel
+        // copy the same pages to socket.
+        while ((size_t) off < total) {
+            size_t n = total - off < BSKY_BLOB_CHUNK ?
+                       total - off : BSKY_BLOB_CHUNK;
+            off_t  chunk_start = off;
+
+            bsky_sha256_update(&sha, map + off, n);
+
+            while ((size_t) (off - chunk_start) < n) {
+                ssize_t r = sendfile(up->fd, file_fd, &off,
+                                     n - (off - chunk_start));
+
+                if (r < 0 && errno == EINTR) continue;
+                if (r < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                    struct pollfd pfd = { .fd = up->fd, .events = POLLOUT };
+                    poll(&pfd, 1, -1);
+                    continue;
+                }
+                if (r <= 0) {
+                    ec = bsky_ec_Net_send;
+                    goto defer;
+                }
+            }
+
+            __bsky_blob_progress(up, n, total);
+        }
+
+        bsky_sha256_final(&sha, up->sha256);
+
+    defer:
+        if (map != NULL) munmap(map, total);
+        return ec;
+    }
+
+    // Temporary base32 string with `b' multibase prefix.
+    static struct bsky_str __bsky_tmp_multibase32(const unsigned char *data,
+                                                  size_t size)
+    {
+        static const char alphabet[] = "abcdefghijklmnopqrstuvwxyz234567";
+
+        char *str = bsky_tmp_alloc(1 + (size * 8 + 4) / 5 + 1);
+        if (str == NULL) return (struct bsky_str) { 0 };
+
+        size_t len = 0;
+        uint32_t acc = 0;
+        int bits = 0;
+
+        str[len++] = 'b';
+        for (size_t i = 0; i < size; ++i) {
+            acc   = acc << 8 | data[i];
+            bits += 8;
+
+            while (bits >= 5) {
+                str[len++] = alphabet[(acc >> (bits - 5)) & 31];
+                bits -= 5;
+            }
+        }
+        if (bits != 0) str[len++] = alphabet[(acc << (5 - bits)) & 31];
+        str[len] = '\0';
+
+        return (struct bsky_str) { str, str + len };
+    }
+
+    // Temporary base32 string of CIDv1 with sha2-256 digest.
+    static struct bsky_str __bsky_tmp_cid_str(unsigned char codec,
+                                              const unsigned char sha256[32])
+    {
+        // CIDv1 | codec | sha2-256 | 32 bytes digest
+        unsigned char cid[36] = { 0x01, codec, 0x12, 0x20 };
+        memcpy(cid + 4, sha256, 32);
+
+        return __bsky_tmp_multibase32(cid, sizeof (cid));
+    }
+
+    struct bsky_str bsky_tmp_blob_cid(const unsigned char sha256[32])
+    {
+        return __bsky_tmp_cid_str(0x55, sha256);
+    }
+
+    /*
+     * BSKY WRITE BATCHER
+     */
+    static void __bsky_write_fail(struct bsky_write_queue *q,
+                                  size_t from, size_t to,
+                                  enum bsky_error_code ec)
+    {
+        for (size_t i = from; i < to; ++i) {
+            struct bsky_write_slot *w = &q->writes.data[i];
+            if (w->done != NULL) w->done(w->user, ec, NULL);
+        }
+    }
+
+    static enum bsky_error_code
+    __bsky_write_send(struct bsky_write_batcher *b, struct bsky_write_queue *q,
+                      size_t from, size_t to);
+
+    static enum bsky_error_code
+    __bsky_write_post(struct bsky_write_batcher *b, struct bsky_write_queue *q,
+                      size_t from, size_t to, struct bsky_str body)
+    {
+        enum bsky_error_code ec = bsky_ec_Ok;
+        struct bsky_str response = { 0 };
+
+        int status = b->send(b->user, bsky_mk_str(q->repo), body, &response);
+
+        if (status < 0) {
+            __bsky_write_fail(q, from, to, bsky_ec_Xrpc_transport);
+            bsky_return_error(bsky_ec_Xrpc_transport);
+        }
+
+        int too_large = status == 413 ||
+            (status == 400 && response.start != NULL &&
+             strstr(response.start, "Too many writes") != NULL);
+
+        if (too_large && to - from > 1) {
+            size_t mid = from + (to - from) / 2;
+
+            if (__BSKY_OR_DEFAULT(b->max_writes, BSKY_APPLY_WRITES_MAX)
+                    > mid - from) {
+                b->max_writes = mid - from;
+            }
+
+            ec = __bsky_write_send(b, q, from, mid);
+            enum bsky_error_code ec2 = __bsky_write_send(b, q, mid, to);
+
+            return ec != bsky_ec_Ok ? ec : ec2;
+        }
+
+        if (status < 200 || status >= 300) {
+            __bsky_write_fail(q, from, to, bsky_ec_Xrpc_status);
+            bsky_return_error(bsky_ec_Xrpc_status);
+        }
+
+        struct bsky_json  json    = { .var = bsky_json_Null };
+        struct bsky_json *results = NULL;
+
+        if (bsky_str_len(response) != 0) {
+            json = bsky_parse_json(&response, &ec);
+            if (ec == bsky_ec_Ok) results = bsky_json_get(&json, "results");
+        }
+
+        if (results != NULL && results->var != bsky_json_Arr) results = NULL;
+
+        for (size_t i = from; i < to; ++i) {
+            struct bsky_write_slot *w = &q->writes.data[i];
+
+            if (w->done == NULL) continue;
+
+            w->done(w->user, bsky_ec_Ok,
+                    results != NULL && i - from < results->arr.len ?
+                    &results->arr.data[i - from] : NULL);
+        }
+
+        return bsky_ec_Ok;
+    }
+
+    static enum bsky_error_code
+    __bsky_write_send(struct bsky_write_batcher *b, struct bsky_write_queue *q,
+                      size_t from, size_t to)
+    {
+        struct bsky_str_builder sb = { 0 };
+        char *body = q->body.data;
+
+        bsky_sb_push_str(&sb, (struct bsky_str) { body, body + q->head });
+        bsky_sb_push_str(&sb, (struct bsky_str) {
+                            body + q->writes.data[from].start,
+                            body + q->writes.data[to - 1].end
+                         });
+        bsky_sb_push_str(&sb, bsky_mk_str("]}"));
+
+        enum bsky_error_code ec = __bsky_write_post(b, q, from, to,
+                                                    bsky_sb_build(&sb));
+        bsky_da_free(&sb);
+
+        return ec;
+    }
+
+    static enum bsky_error_code
+    __bsky_write_queue_flush(struct bsky_write_batcher *b,
+                             struct bsky_write_queue *q)
+    {
+        enum bsky_error_code ec = bsky_ec_Ok, ec2;
+        size_t len = q->writes.len;
+
+        if (len == 0) return bsky_ec_Ok;
+
+        if (len <= __BSKY_OR_DEFAULT(b->max_writes, BSKY_APPLY_WRITES_MAX)) {
+            // whole queue: close array in place and send body as is.
+            bsky_sb_push_str(&q->body, bsky_mk_str("]}"));
+            ec = __bsky_write_post(b, q, 0, len, bsky_sb_build(&q->body));
+        }
+        else for (size_t from = 0; from < len;) {
+            size_t max = __BSKY_OR_DEFAULT(b->max_writes, BSKY_APPLY_WRITES_MAX);
+            size_t to  = len - from < max ? len : from + max;
+
+            ec2  = __bsky_write_send(b, q, from, to);
+            ec   = ec != bsky_ec_Ok ? ec : ec2;
+            from = to;
+        }
+
+        q->writes.len = 0;
+        q->body.len   = q->head + 1;
+        q->body.data[q->head] = '\0';
+
+        return ec;
+    }
+
+    static void __bsky_sb_push_json_str(struct bsky_str_builder *sb,
+                                        const char *name, const char *value)
+    {
+        bsky_sb_push_str(sb, bsky_mk_str(",\""));
+        bsky_sb_push_str(sb, bsky_mk_str((char*) name));
+        bsky_sb_push_str(sb, bsky_mk_str("\":\""));
+        bsky_sb_push_str(sb, bsky_mk_str((char*) value));
+        bsky_sb_push(sb, '"');
+    }
+
+    enum bsky_error_code bsky_write_batcher_add(struct bsky_write_batcher *b,
+                                                struct bsky_str repo,
+                                                struct bsky_write write)
+    {
+        static const char *types[] = {
+            [bsky_write_Create] = "com.atproto.repo.applyWrites#create",
+            [bsky_write_Update] = "com.atproto.repo.applyWrites#update",
+            [bsky_write_Delete] = "com.atproto.repo.applyWrites#delete",
+        };
+
+        enum bsky_error_code ec = bsky_ec_Ok;
+        size_t *idx = bsky_str_map_get(&b->repos, repo);
+
+        if (idx == NULL) {
+            struct bsky_write_queue q = { 0 };
+            size_t len = bsky_str_len(repo);
+
+            if ((q.repo = malloc(len + 1)) == NULL)
+                bsky_return_error(bsky_ec_Out_of_memory);
+            memcpy(q.repo, repo.start, len);
+            q.repo[len] = '\0';
+
+            bsky_sb_push_str(&q.body, bsky_mk_str("{\"repo\":\""));
+            bsky_sb_push_str(&q.body, bsky_mk_str(q.repo));
+            bsky_sb_push_str(&q.body, bsky_mk_str("\",\"writes\":["));
+            q.head = q.body.len - 1;
+
+            if ((ec = bsky_da_push(&b->queues, q)) != bsky_ec_Ok) return ec;
+            if ((ec = bsky_str_map_set(&b->repos, repo, b->queues.len - 1))
+                    != bsky_ec_Ok) return ec;
+
+            idx = bsky_str_map_get(&b->repos, repo);
+        }
+
+        struct bsky_write_queue *q = &b->queues.data[*idx];
+        struct bsky_write_slot slot = { .done = write.done, .user = write.user };
+
+        if (q->writes.len != 0) bsky_sb_push(&q->body, ',');
+
+        slot.start = q->body.len - 1;
+
+        bsky_sb_push_str(&q->body, bsky_mk_str("{\"$type\":\""));
+        bsky_sb_push_str(&q->body, bsky_mk_str((char*) types[write.op]));
+        bsky_sb_push(&q->body, '"');
+        __bsky_sb_push_json_str(&q->body, "collection", write.collection);
+        if (write.rkey != NULL)
+            __bsky_sb_push_json_str(&q->body, "rkey", write.rkey);
+
+        if (write.op != bsky_write_Delete) {
+            bsky_sb_push_str(&q->body, bsky_mk_str(",\"value\":"));
+            bsky_sb_push_json(&q->body, write.value);
+        }
+        bsky_sb_push(&q->body, '}');
+
+        slot.end = q->body.len - 1;
+
+        size_t max_bytes = __BSKY_OR_DEFAULT(b->max_bytes,
+                                             BSKY_APPLY_WRITES_MAX_BYTES);
+
+        if (slot.end + 2 > max_bytes && q->writes.len != 0) {
+            // write does not fit: flush queue without it and start new one.
+            // `send' and response parsing use tmp arena, so the write is
+            // kept on heap.
+            size_t len = slot.end - slot.start;
+            char  *frag = malloc(len ? len : 1);
+
+            if (frag == NULL) {
+                bsky_return_error(bsky_ec_Out_of_memory);
+                return bsky_ec_Out_of_memory;
+            }
+            memcpy(frag, q->body.data + slot.start, len);
+
+            q->body.len = slot.start;  // drop separator too
+            q->body.data[q->body.len - 1] = '\0';
+
+            ec = __bsky_write_queue_flush(b, q);
+
+            slot.start = q->body.len - 1;
+            bsky_sb_push_str(&q->body, (struct bsky_str) {
+                                frag, frag + len });
+            slot.end = q->body.len - 1;
+            free(frag);
+        }
+
+        if (q->writes.len == 0) q->first_ns = __bsky_now_ns();
+
+        enum bsky_error_code push_ec = bsky_da_push(&q->writes, slot);
+        if (push_ec != bsky_ec_Ok) return push_ec;
+
+        if (q->writes.len >=
+                __BSKY_OR_DEFAULT(b->max_writes, BSKY_APPLY_WRITES_MAX)) {
+            enum bsky_error_code flush_ec = __bsky_write_queue_flush(b, q);
+            ec = ec != bsky_ec_Ok ? ec : flush_ec;
+        }
+
+        return ec;
+    }
+
+    enum bsky_error_code bsky_write_batcher_poll(struct bsky_write_batcher *b)
+    {
+        enum bsky_error_code ec = bsky_ec_Ok, ec2;
+        uint64_t now   = __bsky_now_ns();
+        uint64_t delay = __BSKY_OR_DEFAULT(b->max_delay_ms,
+                                           BSKY_APPLY_WRITES_DELAY_MS);
+
+        for (size_t i = 0; i < b->queues.len; ++i) {
+            struct bsky_write_queue *q = &b->queues.data[i];
+
+            if (q->writes.len == 0) continue;
+            if (now - q->first_ns < delay * 1000000ull) continue;
+
+            ec2 = __bsky_write_queue_flush(b, q);
+            ec  = ec != bsky_ec_Ok ? ec : ec2;
+        }
+
+        return ec;
+    }
+
+    enum bsky_error_code bsky_write_batcher_flush(struct bsky_write_batcher *b)
+    {
+        enum bsky_error_code ec = bsky_ec_Ok, ec2;
+
+        for (size_t i = 0; i < b->queues.len; ++i) {
+            ec2 = __bsky_write_queue_flush(b, &b->queues.data[i]);
+            ec  = ec != bsky_ec_Ok ? ec : ec2;
+        }
+
+        return ec;
+    }
+
+    void bsky_write_batcher_free(struct bsky_write_batcher *b)
+    {
+        for (size_t i = 0; i < b->queues.len; ++i) {
+            struct bsky_write_queue *q = &b->queues.data[i];
+
+            free(q->repo);
+            bsky_da_free(&q->body);
+            bsky_da_free(&q->writes);
+        }
+
+        bsky_da_free(&b->queues);
+        bsky_str_map_free(&b->repos);
+
+        bsky_clear_da(&b->queues);
+    }
+
+    /*
+     * BSKY EVENT LOOP
+     */
+    #include <sys/epoll.h>
+
+    enum bsky_error_code bsky_loop_init(struct bsky_loop *loop)
+    {
+        *loop = (struct bsky_loop) { 0 };
+
+        loop->epfd = epoll_create1(EPOLL_CLOEXEC);
+        if (loop->epfd < 0) bsky_return_error(bsky_ec_Loop);
+
+        return bsky_ec_Ok;
+    }
+
+    static uint32_t __bsky_loop_epoll_events(int events)
+    {
+        return (events & bsky_loop_Read  ? EPOLLIN  : 0) |
+               (events & bsky_loop_Write ? EPOLLOUT : 0) | EPOLLRDHUP;
+    }
+
+    enum bsky_error_code bsky_loop_add(struct bsky_loop *loop, int fd,
+                                       int events, bsky_loop_fd_fn fn,
+                                       void *user)
+    {
+        if ((size_t) fd >= loop->handlers_cap) {
+            size_t cap = loop->handlers_cap ? loop->handlers_cap : 64;
+            while (cap <= (size_t) fd) cap *= 2;
+
+            void *data = realloc(loop->handlers,
+                                 cap * sizeof (struct bsky_loop_handler));
+            if (data == NULL) bsky_return_error(bsky_ec_Out_of_memory);
+
+            loop->handlers     = data;
+            loop->handlers_cap = cap;
+        }
+
+        loop->handlers[fd] = (struct bsky_loop_handler) { fn, user };
+
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+        struct epoll_event ev = {
+            .events  = __bsky_loop_epoll_events(events),
+            .data.fd = fd,
+        };
+        if (epoll_ctl(loop->epfd, EPOLL_CTL_ADD, fd, &ev) != 0)
+            bsky_return_error(bsky_ec_Loop);
+
+        return bsky_ec_Ok;
+    }
+
+    enum bsky_error_code bsky_loop_mod(struct bsky_loop *loop, int fd,
+                                       int events)
+    {
+        struct epoll_event ev = {
+            .events  = __bsky_loop_epoll_events(events),
+            .data.fd = fd,
+        };
+        if (epoll_ctl(loop->epfd, EPOLL_CTL_MOD, fd, &ev) != 0)
+            bsky_return_error(bsky_ec_Loop);
+
+        return bsky_ec_Ok;
+    }
+
+    void bsky_loop_del(struct bsky_loop *loop, int fd)
+    {
+        epoll_ctl(loop->epfd, EPOLL_CTL_DEL, fd, NULL);
+
+        if ((size_t) fd < loop->handlers_cap)
+            loop->handlers[fd] = (struct bsky_loop_handler) { 0 };
+    }
+
+    enum bsky_error_code bsky_loop_timer(struct bsky_loop *loop,
+                                         uint64_t delay_ms,
+                                         bsky_loop_timer_fn fn, void *user)
+    {
+        struct bsky_loop_timer timer = {
+            .deadline_ns = __bsky_now_ns() + delay_ms * 1000000ull,
+            .fn = fn, .user = user,
+        };
+
+        enum bsky_error_code ec = bsky_da_push(&loop->timers, timer);
+        if (ec != bsky_ec_Ok) return ec;
+
+        // sift up
+        struct bsky_loop_timer *heap = loop->timers.data;
+        for (size_t i = loop->timers.len - 1; i != 0;) {
+            size_t parent = (i - 1) / 2;
+            if (heap[parent].deadline_ns <= heap[i].deadline_ns) break;
+
+            struct bsky_loop_timer tmp = heap[parent];
+            heap[parent] = heap[i];
+            heap[i]      = tmp;
+            i = parent;
+        }
+
+        return bsky_ec_Ok;
+    }
+
+    static struct bsky_loop_timer __bsky_loop_timer_pop(struct bsky_loop *loop)
+    {
+        struct bsky_loop_timer *heap = loop->timers.data;
+        struct bsky_loop_timer  top  = heap[0];
+        size_t len = --loop->timers.len;
+
+        heap[0] = heap[len];
+
+        // sift down
+        for (size_t i = 0;;) {
+            size_t l = i * 2 + 1, r = l + 1, min = i;
+
+            if (l < len && heap[l].deadline_ns < heap[min].deadline_ns) min = l;
+            if (r < len && heap[r].deadline_ns < heap[min].deadline_ns) min = r;
+            if (min == i) break;
+
+            struct bsky_loop_timer tmp = heap[min];
+            heap[min] = heap[i];
+            heap[i]   = tmp;
+            i = min;
+        }
+
+        return top;
+    }
+
+    enum bsky_error_code bsky_loop_run_once(struct bsky_loop *loop,
+                                            int timeout_ms)
+    {
+        struct epoll_event events[256];
+
+        if (loop->timers.len != 0) {
+            uint64_t now = __bsky_now_ns();
+            uint64_t deadline = loop->timers.data[0].deadline_ns;
+            int wait = deadline <= now ? 0 :
+                       (int) ((deadline - now + 999999) / 1000000);
+
+            if (timeout_ms < 0 || wait < timeout_ms) timeout_ms = wait;
+        }
+
+        int n = epoll_wait(loop->epfd, events, BSKY_ARRAY_LEN(events),
+                           timeout_ms);
+
+        if (n < 0 && errno != EINTR) bsky_return_error(bsky_ec_Loop);
+
+        for (int i = 0; i < n; ++i) {
+            int fd = events[i].data.fd;
+            uint32_t ev = events[i].events;
+            struct bsky_loop_handler h = loop->handlers[fd];
+
+            if (h.fn == NULL) continue;
+
+            h.fn(loop, fd,
+                 (ev & EPOLLIN  ? bsky_loop_Read  : 0) |
+                 (ev & EPOLLOUT ? bsky_loop_Write : 0) |
+                 (ev & (EPOLLHUP | EPOLLERR | EPOLLRDHUP) ? bsky_loop_Close : 0),
+                 h.user);
+        }
+
+        uint64_t now = __bsky_now_ns();
+        while (loop->timers.len != 0 && loop->timers.data[0].deadline_ns <= now) {
+            struct bsky_loop_timer timer = __bsky_loop_timer_pop(loop);
+            timer.fn(loop, timer.user);
+        }
+
+        return bsky_ec_Ok;
+    }
+
+    enum bsky_error_code bsky_loop_run(struct bsky_loop *loop)
+    {
+        enum bsky_error_code ec = bsky_ec_Ok;
+
+        loop->running = 1;
+        while (loop->running && ec == bsky_ec_Ok) {
+            ec = bsky_loop_run_once(loop, -1);
+        }
+
+        return ec;
+    }
+
+    void bsky_loop_stop(struct bsky_loop *loop)
+    {
+        loop->running = 0;
+    }
+
+    void bsky_loop_free(struct bsky_loop *loop)
+    {
+        if (loop->epfd > 0) close(loop->epfd);
+
+        free(loop->handlers);
+        bsky_da_free(&loop->timers);
+
+        *loop = (struct bsky_loop) { 0 };
+    }
+
+    /*
+     * BSKY WEBSOCKET
+     */
+    #include <sys/random.h>
+
+    static void __bsky_sha1(const void *data, size_t len,
+                            unsigned char digest[20])
+    {
+        uint32_t h[5] = {
+            0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476, 0xc3d2e1f0,
+        };
+        const unsigned char *p = data;
+        size_t total = (len + 8) / 64 * 64 + 64;
+
+        for (size_t block = 0; block < total; block += 64) {
+            uint32_t w[80];
+
+            for (int i = 0; i < 64; ++i) {
+                size_t   idx = block + i;
+                uint32_t byte = idx < len ? p[idx] : idx == len ? 0x80 : 0;
+
+                // length in bits is written to the last 8 bytes.
+                if (idx >= total - 8) byte = (uint64_t) len * 8
+                                             >> (8 * (total - 1 - idx)) & 0xff;
+
+                if (i % 4 == 0) w[i / 4] = 0;
+                w[i / 4] |= byte << (24 - i % 4 * 8);
+            }
+            for (int i = 16; i < 80; ++i) {
+                uint32_t x = w[i-3] ^ w[i-8] ^ w[i-14] ^ w[i-16];
+                w[i] = x << 1 | x >> 31;
+            }
+
+            uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+
+            for (int i = 0; i < 80; ++i) {
+                uint32_t f, k;
+
+                if (i < 20) {
+                    f = (b & c) | (~b & d);          k = 0x5a827999;
+                } else if (i < 40) {
+                    f = b ^ c ^ d;                   k = 0x6ed9eba1;
+                } else if (i < 60) {
+                    f = (b & c) | (b & d) | (c & d); k = 0x8f1bbcdc;
+                } else {
+                    f = b ^ c ^ d;                   k = 0xca62c1d6;
+                }
+
+                uint32_t t = (a << 5 | a >> 27) + f + e + k + w[i];
+                e = d; d = c; c = b << 30 | b >> 2; b = a; a = t;
+            }
+
+            h[0] += a; h[1] += b; h[2] += c; h[3] += d; h[4] += e;
+        }
+
+        for (int i = 0; i < 20; ++i) digest[i] = h[i / 4] >> (24 - i % 4 * 8);
+    }
+
+    static struct bsky_str __bsky_tmp_base64(const unsigned char *data,
+                                             size_t len)
+    {
+        static const char alphabet[] =
+            "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+        char *str = bsky_tmp_alloc((len + 2) / 3 * 4 + 1), *s = str;
+        if (str == NULL) return (struct bsky_str) { 0 };
+
+        for (size_t i = 0; i < len; i += 3) {
+            uint32_t v = (uint32_t) data[i] << 16 |
+                         (i + 1 < len ? (uint32_t) data[i+1] << 8 : 0) |
+                         (i + 2 < len ? data[i+2] : 0);
+
+            *s++ = alphabet[v >> 18 & 63];
+            *s++ = alphabet[v >> 12 & 63];
+            *s++ = i + 1 < len ? alphabet[v >> 6 & 63] : '=';
+            *s++ = i + 2 < len ? alphabet[v & 63] : '=';
+        }
+        *s = '\0';
+
+        return (struct bsky_str) { str, s };
+    }
+
+    struct bsky_str bsky_ws_accept_key(struct bsky_str key)
+    {
+        static const char guid[] = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+
+        unsigned char digest[20];
+        char   buf[256];
+        size_t len = bsky_str_len(key);
+
+        if (len + sizeof (guid) > sizeof (buf)) return (struct bsky_str) { 0 };
+
+        memcpy(buf, key.start, len);
+        memcpy(buf + len, guid, sizeof (guid) - 1);
+
+        __bsky_sha1(buf, len + sizeof (guid) - 1, digest);
+
+        return __bsky_tmp_base64(digest, sizeof (digest));
+    }
+
+    void bsky_ws_mask(void *data, size_t len, const unsigned char key[4])
+    {
+        unsigned char *p = data;
+        uint64_t k;
+        size_t   i = 0;
+
+        memcpy(&k, key, 4);
+        memcpy((char*) &k + 4, key, 4);
+
+        for (; i + 8 <= len; i += 8) {
+            uint64_t w;
+            memcpy(&w, p + i, 8);
+            w ^= k;
+            memcpy(p + i, &w, 8);
+        }
+        for (; i < len; ++i) p[i] ^= key[i & 3];
+    }
+
+    enum bsky_error_code bsky_ws_send(struct bsky_ws *ws,
+                                      enum bsky_ws_opcode opcode,
+                                      const void *data, size_t len)
+    {
+        unsigned char head[14], *key;
+        size_t hlen = 2;
+
+        if (ws->closed) bsky_return_error(bsky_ec_Ws_closed);
+
+        head[0] = 0x80 | opcode;
+        if (len < 126) {
+            head[1] = 0x80 | len;
+        } else if (len < 0x10000) {
+            head[1] = 0x80 | 126;
+            head[2] = len >> 8;
+            head[3] = len;
+            hlen = 4;
+        } else {
+            head[1] = 0x80 | 127;
+            for (int i = 0; i < 8; ++i)
+                head[2 + i] = (uint64_t) len >> (56 - i * 8);
+            hlen = 10;
+        }
+
+        key = head + hlen;
+        if (getrandom(key, 4, 0) != 4) memcpy(key, &len, 4);
+        hlen += 4;
+
+        ws->out.len = 0;
+        if (__bsky_da_append(&ws->out, head, 1, hlen) != bsky_ec_Ok ||
+            __bsky_da_append(&ws->out, data, 1, len)  != bsky_ec_Ok)
+            bsky_return_error(bsky_ec_Out_of_memory);
+
+        bsky_ws_mask(ws->out.data + hlen, len, key);
+
+        return __bsky_send_all(ws->fd, ws->out.data, ws->out.len);
+    }
+
+    static void __bsky_ws_closed(struct bsky_ws *ws, int code)
+    {
+        if (ws->closed) return;
+
+        if (code != 1006 && ws->fd >= 0) {
+            unsigned char payload[2] = { code >> 8, code & 0xff };
+            bsky_ws_send(ws, bsky_ws_Close, payload, 2);
+        }
+
+        ws->closed = 1;
+        if (ws->on_close != NULL) ws->on_close(ws->user, code);
+    }
+
+    static void __bsky_ws_deliver(struct bsky_ws *ws, int opcode,
+                                  void *data, size_t len)
+    {
+        if (ws->on_message == NULL) return;
+
+        ws->on_message(ws->user, opcode,
+                       (struct bsky_view) { data, (char*) data + len });
+    }
+
+    // Parse and deliver all complete frames. Return number of consumed
+    // bytes, the rest is beginning of incomplete frame.
+    static size_t __bsky_ws_process(struct bsky_ws *ws, char *buf, size_t len,
+                                    enum bsky_error_code *ec)
+    {
+        size_t off = 0;
+        size_t max = __BSKY_OR_DEFAULT(ws->max_message, BSKY_WS_MAX_MESSAGE);
+
+        *ec = bsky_ec_Ok;
+
+        while (!ws->closed && len - off >= 2) {
+            unsigned char *p = (unsigned char*) buf + off;
+            size_t left = len - off, hlen = 2;
+            int fin    = p[0] & 0x80;
+            int opcode = p[0] & 0x0f;
+            uint64_t plen = p[1] & 0x7f;
+
+            if (p[0] & 0x70) bsky_defer_ec(bsky_ec_Ws_protocol);
+
+            if (plen == 126) {
+                if (left < 4) break;
+                plen = (uint64_t) p[2] << 8 | p[3];
+                hlen = 4;
+            } else if (plen == 127) {
+                if (left < 10) break;
+                plen = 0;
+                for (int i = 0; i < 8; ++i) plen = plen << 8 | p[2 + i];
+                hlen = 10;
+            }
+            if (p[1] & 0x80) hlen += 4;
+
+            if (plen > max) bsky_defer_ec(bsky_ec_Ws_too_large);
+            if (left < hlen + plen) break;
+
+            unsigned char *payload = p + hlen;
+            if (p[1] & 0x80) bsky_ws_mask(payload, plen, payload - 4);
+
+            off += hlen + plen;
+
+            if (opcode >= bsky_ws_Close) {
+                if (!fin || plen > 125) bsky_defer_ec(bsky_ec_Ws_protocol);
+
+                switch (opcode) {
+                case bsky_ws_Ping:
+                    bsky_ws_send(ws, bsky_ws_Pong, payload, plen);
+                    break;
+                case bsky_ws_Pong:
+                    break;
+                case bsky_ws_Close:
+                    __bsky_ws_closed(ws, plen >= 2 ?
+                                     payload[0] << 8 | payload[1] : 1005);
+                    break;
+                default:
+                    bsky_defer_ec(bsky_ec_Ws_protocol);
+                }
+                continue;
+            }
+
+            if (opcode == bsky_ws_Continuation) {
+                if (ws->msg_opcode == 0) bsky_defer_ec(bsky_ec_Ws_protocol);
+                if (ws->msg.len + plen > max)
+                    bsky_defer_ec(bsky_ec_Ws_too_large);
+
+                __bsky_da_append(&ws->msg, payload, 1, plen);
+
+                if (fin) {
+                    __bsky_ws_deliver(ws, ws->msg_opcode,
+                                      ws->msg.data, ws->msg.len);
+                    ws->msg_opcode = 0;
+                    ws->msg.len    = 0;
+                }
+            }
+            else if (opcode == bsky_ws_Text || opcode == bsky_ws_Binary) {
+                if (ws->msg_opcode != 0) bsky_defer_ec(bsky_ec_Ws_protocol);
+
+                if (fin) {
+                    __bsky_ws_deliver(ws, opcode, payload, plen);
+                } else {
+                    ws->msg_opcode = opcode;
+                    ws->msg.len    = 0;
+                    __bsky_da_append(&ws->msg, payload, 1, plen);
+                }
+            }
+            else bsky_defer_ec(bsky_ec_Ws_protocol);
+        }
+
+    defer:
+        if (*ec != bsky_ec_Ok) {
+            __bsky_ws_closed(ws, *ec == bsky_ec_Ws_too_large ? 1009 : 1002);
+        }
+        return off;
+    }
+
+    static enum bsky_error_code __bsky_ws_process_in(struct bsky_ws *ws)
+    {
+        enum bsky_error_code ec;
+        size_t used = __bsky_ws_process(ws, ws->in.data, ws->in.len, &ec);
+
+        memmove(ws->in.data, ws->in.data + used, ws->in.len - used);
+        ws->in.len -= used;
+
+        return ec;
+    }
+
+    enum bsky_error_code bsky_ws_feed(struct bsky_ws *ws, void *data,
+                                      size_t len)
+    {
+        enum bsky_error_code ec;
+
+        if (ws->in.len == 0) {
+            size_t used = __bsky_ws_process(ws, data, len, &ec);
+
+            if (ec == bsky_ec_Ok && used < len) {
+                ec = __bsky_da_append(&ws->in, (char*) data + used, 1,
+                                      len - used);
+            }
+            return ec;
+        }
+
+        if ((ec = __bsky_da_append(&ws->in, data, 1, len)) != bsky_ec_Ok)
+            return ec;
+
+        return __bsky_ws_process_in(ws);
+    }
+
+    enum bsky_error_code bsky_ws_read(struct bsky_ws *ws)
+    {
+        enum bsky_error_code ec = bsky_ec_Ok;
+
+        while (!ws->closed && ec == bsky_ec_Ok) {
+            if (ws->in.cap - ws->in.len < 0x10000) {
+                size_t cap  = ws->in.cap ? ws->in.cap * 2 : 0x40000;
+                void  *data = realloc(ws->in.data, cap);
+
+                if (data == NULL) bsky_return_error(bsky_ec_Out_of_memory);
+
+                ws->in.data = data;
+                ws->in.cap  = cap;
+            }
+
+            ssize_t n = recv(ws->fd, ws->in.data + ws->in.len,
+                             ws->in.cap - ws->in.len, 0);
+
+            if (n < 0 && errno == EINTR) continue;
+            if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+            if (n <= 0) {
+                __bsky_ws_closed(ws, 1006);
+                bsky_return_error(bsky_ec_Ws_closed);
+            }
+
+            ws->in.len += n;
+            ec = __bsky_ws_process_in(ws);
+        }
+
+        return ec;
+    }
+
+    enum bsky_error_code bsky_ws_handshake(struct bsky_ws *ws, int fd,
+                                           struct bsky_str host,
+                                           struct bsky_str path)
+    {
+        enum bsky_error_code ec = bsky_ec_Ok;
+        unsigned char nonce[16];
+        struct bsky_str_builder sb = { 0 };
+
+        ws->fd = fd;
+        ws->closed = 0;
+        ws->in.len = ws->msg.len = 0;
+        ws->msg_opcode = 0;
+
+        if (getrandom(nonce, sizeof (nonce), 0) != sizeof (nonce))
+            bsky_return_error(bsky_ec_Ws_handshake);
+
+        struct bsky_str key = __bsky_tmp_base64(nonce, sizeof (nonce));
+
+        bsky_sb_push_str(&sb, bsky_mk_str("GET "));
+        bsky_sb_push_str(&sb, bsky_str_len(path) ? path : bsky_mk_str("/"));
+        bsky_sb_push_str(&sb, bsky_mk_str(" HTTP/1.1\r\nHost: "));
+        bsky_sb_push_str(&sb, host);
+        bsky_sb_push_str(&sb, bsky_mk_str("\r\nUpgrade: websocket\r\n"
+                                          "Connection: Upgrade\r\n"
+                                          "Sec-WebSocket-Version: 13\r\n"
+                                          "Sec-WebSocket-Key: "));
+        bsky_sb_push_str(&sb, key);
+        bsky_sb_push_str(&sb, bsky_mk_str("\r\n\r\n"));
+
+        struct bsky_str req = bsky_sb_build(&sb);
+        ec = __bsky_send_all(fd, req.start, bsky_str_len(req));
+        bsky_da_free(&sb);
+        if (ec != bsky_ec_Ok) return ec;
+
+        char *end = NULL;
+        while (end == NULL) {
+            char chunk[4096];
+            ssize_t n = recv(fd, chunk, sizeof (chunk), 0);
+
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) bsky_return_error(bsky_ec_Ws_handshake);
+
+            __bsky_da_append(&ws->in, chunk, 1, n);
+
+            for (size_t i = 3; i < ws->in.len && end == NULL; ++i) {
+                if (memcmp(ws->in.data + i - 3, "\r\n\r\n", 4) == 0)
+                    end = ws->in.data + i + 1;
+            }
+
+            if (end == NULL && ws->in.len > 0x10000)
+                bsky_return_error(bsky_ec_Ws_handshake);
+        }
+
+        struct bsky_str head   = { ws->in.data, end };
+        struct bsky_str accept = bsky_ws_accept_key(key);
+        int ok = bsky_str_starts_with(head, bsky_mk_str("HTTP/1.1 101"));
+
+        // look for `Sec-WebSocket-Accept' header case insensitively.
+        const char *name = "\nsec-websocket-accept:";
+        size_t name_len = strlen(name), accept_len = bsky_str_len(accept);
+        char *value = NULL;
+
+        for (char *p = head.start; ok && p + name_len < end; ++p) {
+            size_t i = 0;
+            while (i < name_len && (p[i] | 0x20) == (name[i] | 0x20)) ++i;
+
+            if (i == name_len) {
+                value = p + name_len;
+                break;
+            }
+        }
+        while (value != NULL && *value == ' ') ++value;
+
+        if (!ok || value == NULL || value + accept_len > end ||
+            memcmp(value, accept.start, accept_len) != 0) {
+            bsky_return_error(bsky_ec_Ws_handshake);
+        }
+
+        // frames sent right after response stay in input buffer.
+        size_t rest = ws->in.data + ws->in.len - end;
+        memmove(ws->in.data, end, rest);
+        ws->in.len = rest;
+
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+        return bsky_ec_Ok;
+    }
+
+    enum bsky_error_code bsky_ws_connect(struct bsky_ws *ws, struct bsky_str url,
+                                         enum bsky_error_code *ec)
+    {
+        struct bsky_url u = bsky_parse_url(url, ec);
+        if (*ec != bsky_ec_Ok) return *ec;
+
+        char *host = __bsky_tmp_cstr(u.host);
+        char *port = bsky_url_port(u).start;
+
+        ws->fd = -1;
+
+        if (host == NULL) bsky_defer_ec(bsky_ec_Tmp_overflow);
+
+        int fd = bsky_net_connect(host, port, ec);
+        if (*ec != bsky_ec_Ok) goto defer;
+
+        if ((*ec = bsky_ws_handshake(ws, fd, u.host, u.path)) != bsky_ec_Ok) {
+            close(fd);
+            ws->fd = -1;
+        }
+
+    defer:
+        return *ec;
+    }
+
+    static void __bsky_ws_on_event(struct bsky_loop *loop, int fd, int events,
+                                   void *user)
+    {
+        struct bsky_ws *ws = user;
+
+        bsky_ws_read(ws);
+
+        if (ws->closed) {
+            bsky_loop_del(loop, fd);
+            ws->loop = NULL;
+        }
+    }
+
+    enum bsky_error_code bsky_ws_attach(struct bsky_ws *ws,
+                                        struct bsky_loop *loop)
+    {
+        enum bsky_error_code ec;
+
+        ec = bsky_loop_add(loop, ws->fd, bsky_loop_Read,
+                           __bsky_ws_on_event, ws);
+        if (ec != bsky_ec_Ok) return ec;
+
+        ws->loop = loop;
+
+        // frames received together with handshake response.
+        return ws->in.len ? __bsky_ws_process_in(ws) : bsky_ec_Ok;
+    }
+
+    void bsky_ws_free(struct bsky_ws *ws)
+    {
+        if (ws->fd >= 0 && !ws->closed) {
+            unsigned char payload[2] = { 1000 >> 8, 1000 & 0xff };
+            bsky_ws_send(ws, bsky_ws_Close, payload, 2);
+        }
+
+        if (ws->loop != NULL) bsky_loop_del(ws->loop, ws->fd);
+        if (ws->fd >= 0) close(ws->fd);
+
+        bsky_da_free(&ws->in);
+        bsky_da_free(&ws->msg);
+        bsky_da_free(&ws->out);
+
+        bsky_clear_da(&ws->in);
+        bsky_clear_da(&ws->msg);
+        bsky_clear_da(&ws->out);
+        ws->fd  = -1;
+        ws->loop = NULL;
+        ws->closed = 1;
+    }
+
+    /*
+     * BSKY DAG-CBOR
+     */
+    #include <math.h>
+
+    // tmp arena does not align allocations.
+    static void *__bsky_tmp_alloc_aligned(size_t size)
+    {
+        char *p = bsky_tmp_alloc(size + 7);
+        return p ? (void*) (((uintptr_t) p + 7) & ~(uintptr_t) 7) : NULL;
+    }
+
+    static inline uint64_t __bsky_load_be(const unsigned char *p, int n)
+    {
+        uint32_t u32;
+        uint64_t u64;
+
+        switch (n) {
+        case 1: return p[0];
+        case 2: return (uint64_t) p[0] << 8 | p[1];
+        case 4: memcpy(&u32, p, 4); return __builtin_bswap32(u32);
+        default: memcpy(&u64, p, 8); return __builtin_bswap64(u64);
+        }
+    }
+
+    static int __bsky_utf8_valid(const unsigned char *p, size_t len)
+    {
+        const unsigned char *end = p + len;
+
+        while (p < end) {
+            // fast path for ASCII runs.
+            while (end - p >= 8) {
+                uint64_t w;
+                memcpy(&w, p, 8);
+                if (w & 0x8080808080808080ull) break;
+                p += 8;
+            }
+            if (p == end) break;
+
+            unsigned char c = *p;
+            if (c < 0x80) { p++; continue; }
+
+            int n;
+            uint32_t cp;
+
+            if      ((c & 0xe0) == 0xc0) { n = 1; cp = c & 0x1f; }
+            else if ((c & 0xf0) == 0xe0) { n = 2; cp = c & 0x0f; }
+            else if ((c & 0xf8) == 0xf0) { n = 3; cp = c & 0x07; }
+            else return 0;
+
+            if (end - p <= n) return 0;
+
+            for (int i = 1; i <= n; ++i) {
+                if ((p[i] & 0xc0) != 0x80) return 0;
+                cp = cp << 6 | (p[i] & 0x3f);
+            }
+
+            // overlong forms, surrogates and out of range code points.
+            if ((n == 1 && cp < 0x80) || (n == 2 && cp < 0x800) ||
+                (n == 3 && cp < 0x10000) || cp > 0x10ffff ||
+                (cp >= 0xd800 && cp <= 0xdfff)) {
+                return 0;
+            }
+
+            p += n + 1;
+        }
+
+        return 1;
+    }
+
+    // Decode (or only validate, when `out' is NULL) one item.
+    static enum bsky_error_code
+    __bsky_cbor_item(const unsigned char **pp, const unsigned char *end,
+                     struct bsky_cbor *out, int depth)
+    {
+        const unsigned char *p = *pp;
+        enum bsky_error_code ec = bsky_ec_Ok;
+        uint64_t arg;
+
+        if (p >= end) return bsky_ec_Cbor_eof;
+
+        int major = *p >> 5, info = *p & 0x1f;
+        p++;
+
+        if (info < 24) {
+            arg = info;
+        } else if (info < 28) {
+            int n = 1 << (info - 24);
+
+            if (end - p < n) return bsky_ec_Cbor_eof;
+
+            arg = __bsky_load_be(p, n);
+            p  += n;
+
+            // argument must use the shortest form (floats are checked
+            // separately).
+            if (major != 7 && (arg < 24 || (n > 1 && arg >> (n * 4) == 0)))
+                return bsky_ec_Cbor_non_canonical;
+        } else {
+            // indefinite lengths are forbidden by DAG-CBOR.
+            return info == 31 ? bsky_ec_Cbor_non_canonical
+                              : bsky_ec_Cbor_invalid;
+        }
+
+        switch (major) {
+        case 0: case 1:
+            if (arg > INT64_MAX) return bsky_ec_Cbor_invalid;
+
+            if (out) {
+                out->var = bsky_cbor_Int;
+                out->i   = major == 0 ? (int64_t) arg : -1 - (int64_t) arg;
+            }
+            break;
+
+        case 2: case 3:
+            if ((uint64_t) (end - p) < arg) return bsky_ec_Cbor_eof;
+            if (major == 3 && !__bsky_utf8_valid(p, arg))
+                return bsky_ec_Cbor_invalid;
+
+            if (out) {
+                out->var = major == 2 ? bsky_cbor_Bytes : bsky_cbor_Str;
+                out->bytes.start = (void*) p;
+                out->bytes.end   = (void*) (p + arg);
+            }
+            p += arg;
+            break;
+
+        case 4: {
+            struct bsky_cbor *items = NULL;
+
+            if (depth >= BSKY_CBOR_MAX_DEPTH) return bsky_ec_Cbor_invalid;
+            // every item takes at least one byte.
+            if ((uint64_t) (end - p) < arg) return bsky_ec_Cbor_eof;
+
+            if (out) {
+                items = __bsky_tmp_alloc_aligned(arg * sizeof (*items));
+                if (items == NULL && arg) return bsky_ec_Tmp_overflow;
+
+                out->var      = bsky_cbor_Arr;
+                out->arr.data = items;
+                out->arr.len  = arg;
+            }
+
+            for (uint64_t i = 0; i < arg; ++i) {
+                ec = __bsky_cbor_item(&p, end, items ? items + i : NULL,
+                                      depth + 1);
+                if (ec != bsky_ec_Ok) return ec;
+            }
+        } break;
+
+        case 5: {
+            struct bsky_cbor_pair *pairs = NULL;
+            const unsigned char   *prev = NULL;
+            size_t prev_len = 0;
+
+            if (depth >= BSKY_CBOR_MAX_DEPTH) return bsky_ec_Cbor_invalid;
+            if ((uint64_t) (end - p) / 2 < arg) return bsky_ec_Cbor_eof;
+
+            if (out) {
+                pairs = __bsky_tmp_alloc_aligned(arg * sizeof (*pairs));
+                if (pairs == NULL && arg) return bsky_ec_Tmp_overflow;
+
+                out->var      = bsky_cbor_Map;
+                out->map.data = pairs;
+                out->map.len  = arg;
+            }
+
+            for (uint64_t i = 0; i < arg; ++i) {
+                struct bsky_cbor key;
+
+                if (p >= end) return bsky_ec_Cbor_eof;
+                if (*p >> 5 != 3) return bsky_ec_Cbor_invalid;
+
+                ec = __bsky_cbor_item(&p, end, &key, depth + 1);
+                if (ec != bsky_ec_Ok) return ec;
+
+                // keys are sorted by length, then bytewise; no duplicates.
+                size_t len = key.str.end - key.str.start;
+                if (prev != NULL && (len < prev_len || (len == prev_len &&
+                    memcmp(prev, key.str.start, len) >= 0))) {
+                    return bsky_ec_Cbor_non_canonical;
+                }
+                prev     = (const unsigned char*) key.str.start;
+                prev_len = len;
+
+                if (pairs) pairs[i].key = key.str;
+
+                ec = __bsky_cbor_item(&p, end, pairs ? &pairs[i].value : NULL,
+                                      depth + 1);
+                if (ec != bsky_ec_Ok) return ec;
+            }
+        } break;
+
+        case 6: {
+            struct bsky_cbor cid;
+
+            if (arg != 42) return bsky_ec_Cbor_invalid;
+            if (p >= end) return bsky_ec_Cbor_eof;
+            if (*p >> 5 != 2) return bsky_ec_Cbor_invalid;
+
+            ec = __bsky_cbor_item(&p, end, &cid, depth + 1);
+            if (ec != bsky_ec_Ok) return ec;
+
+            // byte string with identity multibase prefix and CID.
+            if (cid.bytes.start == cid.bytes.end ||
+                *(unsigned char*) cid.bytes.start != 0) {
+                return bsky_ec_Cbor_invalid;
+            }
+
+            if (out) {
+                out->var         = bsky_cbor_Link;
+                out->bytes.start = (char*) cid.bytes.start + 1;
+                out->bytes.end   = cid.bytes.end;
+            }
+        } break;
+
+        default:
+            if (info == 20 || info == 21) {
+                if (out) {
+                    out->var   = bsky_cbor_Bool;
+                    out->_bool = info == 21;
+                }
+            } else if (info == 22) {
+                if (out) out->var = bsky_cbor_Null;
+            } else if (info == 27) {
+                double f;
+                memcpy(&f, &arg, sizeof (f));
+
+                if (!isfinite(f)) return bsky_ec_Cbor_invalid;
+
+                if (out) {
+                    out->var = bsky_cbor_Float;
+                    out->f   = f;
+                }
+            } else if (info == 25 || info == 26) {
+                return bsky_ec_Cbor_non_canonical;
+            } else {
+                return bsky_ec_Cbor_invalid;
+            }
+        }
+
+        *pp = p;
+        return bsky_ec_Ok;
+    }
+
+    struct bsky_cbor bsky_parse_cbor(struct bsky_view *data,
+                                     enum bsky_error_code *ec)
+    {
+        struct bsky_cbor cbor = { 0 };
+        const unsigned char *p = data->start;
+
+        *ec = __bsky_cbor_item(&p, data->end, &cbor, 0);
+        if (*ec != bsky_ec_Ok) bsky_defer_ec(*ec);
+
+        data->start = (void*) p;
+
+    defer:
+        return cbor;
+    }
+
+    enum bsky_error_code bsky_cbor_skip(struct bsky_view *data)
+    {
+        const unsigned char *p = data->start;
+        enum bsky_error_code ec = __bsky_cbor_item(&p, data->end, NULL, 0);
+
+        if (ec != bsky_ec_Ok) return ec;
+
+        data->start = (void*) p;
+        return bsky_ec_Ok;
+    }
+
+    int bsky_cbor_str_eq(struct bsky_str str, const char *cstr)
+    {
+        size_t len = strlen(cstr);
+
+        return (size_t) (str.end - str.start) == len &&
+               memcmp(str.start, cstr, len) == 0;
+    }
+
+    struct bsky_cbor *bsky_cbor_get(struct bsky_cbor *cbor, const char *key)
+    {
+        if (cbor == NULL || cbor->var != bsky_cbor_Map) return NULL;
+
+        size_t len = strlen(key);
+
+        for (size_t i = 0; i < cbor->map.len; ++i) {
+            struct bsky_str k = cbor->map.data[i].key;
+            size_t k_len = k.end - k.start;
+
+            // keys are sorted by length.
+            if (k_len > len) break;
+            if (k_len == len && memcmp(k.start, key, len) == 0)
+                return &cbor->map.data[i].value;
+        }
+
+        return NULL;
+    }
+
+    /*
+     * BSKY DAG-CBOR ENCODER
+     */
+    void bsky_cbor_push_head(struct bsky_str_builder *sb, int major,
+                             uint64_t arg)
+    {
+        unsigned char buf[9];
+        int n = 1;
+
+        if (arg < 24) {
+            buf[0] = major << 5 | arg;
+        } else {
+            int size = arg < 0x100 ? 1 : arg < 0x10000 ? 2
+                     : arg < 0x100000000ull ? 4 : 8;
+
+            buf[0] = major << 5 | (24 + __builtin_ctz(size));
+            for (int i = size - 1; i >= 0; --i) buf[n++] = arg >> (i * 8);
+        }
+
+        __bsky_da_append(sb, buf, 1, n);
+    }
+
+    void bsky_cbor_push_int(struct bsky_str_builder *sb, int64_t i)
+    {
+        if (i >= 0) bsky_cbor_push_head(sb, 0, i);
+        else        bsky_cbor_push_head(sb, 1, -1 - i);
+    }
+
+    void bsky_cbor_push_float(struct bsky_str_builder *sb, double f)
+    {
+        uint64_t bits;
+        unsigned char buf[9] = { 7 << 5 | 27 };
+
+        memcpy(&bits, &f, sizeof (bits));
+        for (int i = 0; i < 8; ++i) buf[1 + i] = bits >> (56 - i * 8);
+
+        __bsky_da_append(sb, buf, 1, sizeof (buf));
+    }
+
+    void bsky_cbor_push_str(struct bsky_str_builder *sb, struct bsky_str str)
+    {
+        bsky_cbor_push_head(sb, 3, str.end - str.start);
+        __bsky_da_append(sb, str.start, 1, str.end - str.start);
+    }
+
+    void bsky_cbor_push_bytes(struct bsky_str_builder *sb,
+                              struct bsky_view bytes)
+    {
+        size_t len = (char*) bytes.end - (char*) bytes.start;
+
+        bsky_cbor_push_head(sb, 2, len);
+        __bsky_da_append(sb, bytes.start, 1, len);
+    }
+
+    void bsky_cbor_push_link(struct bsky_str_builder *sb, struct bsky_view cid)
+    {
+        size_t len = (char*) cid.end - (char*) cid.start;
+
+        bsky_cbor_push_head(sb, 6, 42);
+        bsky_cbor_push_head(sb, 2, len + 1);
+        __bsky_da_append(sb, "", 1, 1);
+        __bsky_da_append(sb, cid.start, 1, len);
+    }
+
+    void bsky_cbor_push_bool(struct bsky_str_builder *sb, int b)
+    {
+        bsky_cbor_push_head(sb, 7, b ? 21 : 20);
+    }
+
+    void bsky_cbor_push_null(struct bsky_str_builder *sb)
+    {
+        bsky_cbor_push_head(sb, 7, 22);
+    }
+
+    void bsky_cbor_push_arr(struct bsky_str_builder *sb, size_t len)
+    {
+        bsky_cbor_push_head(sb, 4, len);
+    }
+
+    void bsky_cbor_push_map(struct bsky_str_builder *sb, size_t len)
+    {
+        bsky_cbor_push_head(sb, 5, len);
+    }
+
+    int bsky_cbor_key_cmp(struct bsky_str a, struct bsky_str b)
+    {
+        size_t a_len = a.end - a.start, b_len = b.end - b.start;
+
+        if (a_len != b_len) return a_len < b_len ? -1 : 1;
+        return memcmp(a.start, b.start, a_len);
+    }
+
+    struct __bsky_cbor_key { struct bsky_str key; size_t idx; };
+
+    static int __bsky_cbor_key_qsort_cmp(const void *a, const void *b)
+    {
+        return bsky_cbor_key_cmp(((struct __bsky_cbor_key*) a)->key,
+                                 ((struct __bsky_cbor_key*) b)->key);
+    }
+
+    // Sort keys in canonical order. Return 0 if there are duplicates.
+    static int __bsky_cbor_sort_keys(struct __bsky_cbor_key *keys, size_t n)
+    {
+        // insertion sort is linear for already sorted keys (re-encoded
+        // decoded data) and fastest for small maps.
+        if (n <= 16) {
+            for (size_t i = 1; i < n; ++i) {
+                struct __bsky_cbor_key key = keys[i];
+                size_t j = i;
+
+                while (j > 0 && bsky_cbor_key_cmp(keys[j-1].key, key.key) > 0) {
+                    keys[j] = keys[j-1];
+                    j--;
+                }
+                keys[j] = key;
+            }
+        } else {
+            qsort(keys, n, sizeof (*keys), __bsky_cbor_key_qsort_cmp);
+        }
+
+        for (size_t i = 1; i < n; ++i) {
+            if (bsky_cbor_key_cmp(keys[i-1].key, keys[i].key) == 0) return 0;
+        }
+        return 1;
+    }
+
+    enum bsky_error_code bsky_sb_push_cbor(struct bsky_str_builder *sb,
+                                           struct bsky_cbor cbor)
+    {
+        enum bsky_error_code ec = bsky_ec_Ok;
+
+        switch (cbor.var) {
+        case bsky_cbor_Int:   bsky_cbor_push_int(sb, cbor.i);       break;
+        case bsky_cbor_Str:   bsky_cbor_push_str(sb, cbor.str);     break;
+        case bsky_cbor_Bytes: bsky_cbor_push_bytes(sb, cbor.bytes); break;
+        case bsky_cbor_Link:  bsky_cbor_push_link(sb, cbor.bytes);  break;
+        case bsky_cbor_Bool:  bsky_cbor_push_bool(sb, cbor._bool);  break;
+        case bsky_cbor_Null:  bsky_cbor_push_null(sb);              break;
+
+        case bsky_cbor_Float:
+            if (!isfinite(cbor.f)) bsky_return_error(bsky_ec_Cbor_invalid);
+            bsky_cbor_push_float(sb, cbor.f);
+            break;
+
+        case bsky_cbor_Arr:
+            bsky_cbor_push_arr(sb, cbor.arr.len);
+
+            for (size_t i = 0; i < cbor.arr.len && ec == bsky_ec_Ok; ++i)
+                ec = bsky_sb_push_cbor(sb, cbor.arr.data[i]);
+            break;
+
+        case bsky_cbor_Map: {
+            struct __bsky_cbor_key stack[BSKY_CBOR_SORT_STACK], *keys = stack;
+            size_t n = cbor.map.len;
+
+            if (n > BSKY_CBOR_SORT_STACK) {
+                keys = malloc(n * sizeof (*keys));
+                if (keys == NULL) bsky_return_error(bsky_ec_Out_of_memory);
+            }
+
+            for (size_t i = 0; i < n; ++i) {
+                keys[i] = (struct __bsky_cbor_key) { cbor.map.data[i].key, i };
+            }
+
+            if (!__bsky_cbor_sort_keys(keys, n)) ec = bsky_ec_Cbor_invalid;
+            else bsky_cbor_push_map(sb, n);
+
+            for (size_t i = 0; i < n && ec == bsky_ec_Ok; ++i) {
+                bsky_cbor_push_str(sb, keys[i].key);
+                ec = bsky_sb_push_cbor(sb, cbor.map.data[keys[i].idx].value);
+            }
+
+            if (keys != stack) free(keys);
+        } break;
+
+        default:
+            bsky_return_error(bsky_ec_Cbor_invalid);
+        }
+
+        return ec;
+    }
+
+    // Decode lowercase RFC 4648 base32 without padding.
+    static int __bsky_base32_decode(struct bsky_str str, unsigned char *out,
+                                    size_t *len)
+    {
+        uint32_t acc = 0;
+        int bits = 0;
+
+        *len = 0;
+        for (char *c = str.start; c < str.end; ++c) {
+            int v;
+
+            if      (*c >= 'a' && *c <= 'z') v = *c - 'a';
+            else if (*c >= '2' && *c <= '7') v = *c - '2' + 26;
+            else return 0;
+
+            acc   = acc << 5 | v;
+            bits += 5;
+            if (bits >= 8) {
+                out[(*len)++] = acc >> (bits - 8);
+                bits -= 8;
+            }
+        }
+
+        return 1;
+    }
+
+    // Decode base64 (standard or url alphabet, padding is optional).
+    static int __bsky_base64_decode(struct bsky_str str, unsigned char *out,
+                                    size_t *len)
+    {
+        uint32_t acc = 0;
+        int bits = 0;
+
+        *len = 0;
+        for (char *c = str.start; c < str.end && *c != '='; ++c) {
+            int v;
+
+            if      (*c >= 'A' && *c <= 'Z') v = *c - 'A';
+            else if (*c >= 'a' && *c <= 'z') v = *c - 'a' + 26;
+            else if (*c >= '0' && *c <= '9') v = *c - '0' + 52;
+            else if (*c == '+' || *c == '-') v = 62;
+            else if (*c == '/' || *c == '_') v = 63;
+            else return 0;
+
+            acc   = acc << 6 | v;
+            bits += 6;
+            if (bits >= 8) {
+                out[(*len)++] = acc >> (bits - 8);
+                bits -= 8;
+            }
+        }
+
+        return 1;
+    }
+
+    // Read 4 hex digits of `\uXXXX' escape.
+    static int __bsky_json_hex4(const char *p, uint32_t *cp)
+    {
+        *cp = 0;
+        for (int i = 0; i < 4; ++i) {
+            int v;
+
+            if      (p[i] >= '0' && p[i] <= '9') v = p[i] - '0';
+            else if (p[i] >= 'a' && p[i] <= 'f') v = p[i] - 'a' + 10;
+            else if (p[i] >= 'A' && p[i] <= 'F') v = p[i] - 'A' + 10;
+            else return 0;
+
+            *cp = *cp << 4 | v;
+        }
+        return 1;
+    }
+
+    // Decode escapes of raw JSON string into tmp arena, string without
+    // escapes is returned as is. Decoded text is never longer than raw.
+    static enum bsky_error_code __bsky_json_unescape(const char *raw,
+                                                     struct bsky_str *out)
+    {
+        size_t len = strlen(raw);
+        char  *p;
+
+        *out = (struct bsky_str) { (char*) raw, (char*) raw + len };
+        if (memchr(raw, '\\', len) == NULL) return bsky_ec_Ok;
+
+        p = bsky_tmp_alloc(len + 1);
+        if (p == NULL) return bsky_ec_Tmp_overflow;
+        out->start = p;
+
+        for (const char *c = raw; *c; ++c) {
+            uint32_t cp, lo;
+
+            if (*c != '\\') {
+                *p++ = *c;
+                continue;
+            }
+
+            switch (*++c) {
+            case '"': case '\\': case '/': *p++ = *c;   continue;
+            case 'b':                      *p++ = '\b'; continue;
+            case 'f':                      *p++ = '\f'; continue;
+            case 'n':                      *p++ = '\n'; continue;
+            case 'r':                      *p++ = '\r'; continue;
+            case 't':                      *p++ = '\t'; continue;
+            case 'u':                                   break;
+            default:                       return bsky_ec_Cbor_invalid;
+            }
+
+            if (!__bsky_json_hex4(c + 1, &cp)) return bsky_ec_Cbor_invalid;
+            c += 4;
+
+            // surrogate pair, lone halves are not valid UTF-8.
+            if (cp >= 0xd800 && cp < 0xdc00) {
+                if (c[1] != '\\' || c[2] != 'u' ||
+                    !__bsky_json_hex4(c + 3, &lo) ||
+                    lo < 0xdc00 || lo >= 0xe000) {
+                    return bsky_ec_Cbor_invalid;
+                }
+                cp = 0x10000 + ((cp - 0xd800) << 10) + (lo - 0xdc00);
+                c += 6;
+            } else if (cp >= 0xdc00 && cp < 0xe000) {
+                return bsky_ec_Cbor_invalid;
+            }
+
+            if (cp < 0x80) {
+                *p++ = cp;
+            } else if (cp < 0x800) {
+                *p++ = 0xc0 | cp >> 6;
+                *p++ = 0x80 | (cp & 0x3f);
+            } else if (cp < 0x10000) {
+                *p++ = 0xe0 | cp >> 12;
+                *p++ = 0x80 | (cp >> 6 & 0x3f);
+                *p++ = 0x80 | (cp & 0x3f);
+            } else {
+                *p++ = 0xf0 | cp >> 18;
+                *p++ = 0x80 | (cp >> 12 & 0x3f);
+                *p++ = 0x80 | (cp >> 6 & 0x3f);
+                *p++ = 0x80 | (cp & 0x3f);
+            }
+        }
+
+        *p = '\0';
+        out->end = p;
+        return bsky_ec_Ok;
+    }
+
+    enum bsky_error_code bsky_sb_push_cbor_of_json(struct bsky_str_builder *sb,
+                                                   struct bsky_json json)
+    {
+        enum bsky_error_code ec = bsky_ec_Ok;
+
+        switch (json.var) {
+        case bsky_json_Bool: bsky_cbor_push_bool(sb, json._bool); break;
+        case bsky_json_Null: bsky_cbor_push_null(sb);             break;
+
+        case bsky_json_Str: {
+            struct bsky_str str;
+
+            ec = __bsky_json_unescape(json.str, &str);
+            if (ec != bsky_ec_Ok) {
+                bsky_log_error(ec);
+                return ec;
+            }
+            bsky_cbor_push_str(sb, str);
+        } break;
+
+        case bsky_json_Num:
+            if (!isfinite(json.num)) bsky_return_error(bsky_ec_Cbor_invalid);
+
+            if (json.num == truncl(json.num) && json.num >= -0x1p63L &&
+                json.num < 0x1p63L) {
+                bsky_cbor_push_int(sb, (int64_t) json.num);
+            } else {
+                bsky_cbor_push_float(sb, (double) json.num);
+            }
+            break;
+
+        case bsky_json_Arr:
+            bsky_cbor_push_arr(sb, json.arr.len);
+
+            for (size_t i = 0; i < json.arr.len && ec == bsky_ec_Ok; ++i)
+                ec = bsky_sb_push_cbor_of_json(sb, json.arr.data[i]);
+            break;
+
+        case bsky_json_Dct: {
+            struct bsky_json *value = json.dct.len == 1 ?
+                                      &json.dct.data[0].value : NULL;
+
+            // `$link' and `$bytes' objects.
+            if (value != NULL && value->var == bsky_json_Str &&
+                (strcmp(json.dct.data[0].name, "$link")  == 0 ||
+                 strcmp(json.dct.data[0].name, "$bytes") == 0)) {
+                struct bsky_str str = bsky_mk_str(value->str);
+                unsigned char *buf  = bsky_tmp_alloc(bsky_str_len(str) + 1);
+                size_t len;
+
+                // `bsky_return_error' skips this value, it equals
+                // `bsky_log_Error'.
+                if (buf == NULL) {
+                    bsky_log_error(bsky_ec_Tmp_overflow);
+                    return bsky_ec_Tmp_overflow;
+                }
+
+                if (json.dct.data[0].name[1] == 'l') {
+                    if (*str.start != 'b' || !__bsky_base32_decode(
+                            bsky_shift_str(str, 1), buf, &len) || len == 0) {
+                        bsky_return_error(bsky_ec_Cbor_invalid);
+                    }
+                    bsky_cbor_push_link(sb, (struct bsky_view) { buf,
+                                                                 buf + len });
+                } else {
+                    if (!__bsky_base64_decode(str, buf, &len))
+                        bsky_return_error(bsky_ec_Cbor_invalid);
+                    bsky_cbor_push_bytes(sb, (struct bsky_view) { buf,
+                                                                  buf + len });
+                }
+                break;
+            }
+
+            struct __bsky_cbor_key stack[BSKY_CBOR_SORT_STACK], *keys = stack;
+            size_t n = json.dct.len;
+
+            if (n > BSKY_CBOR_SORT_STACK) {
+                keys = malloc(n * sizeof (*keys));
+                if (keys == NULL) bsky_return_error(bsky_ec_Out_of_memory);
+            }
+
+            // keys are sorted by decoded bytes.
+            for (size_t i = 0; i < n && ec == bsky_ec_Ok; ++i) {
+                keys[i].idx = i;
+                ec = __bsky_json_unescape(json.dct.data[i].name, &keys[i].key);
+            }
+
+            if (ec != bsky_ec_Ok) {
+                bsky_log_error(ec);
+            } else if (!__bsky_cbor_sort_keys(keys, n)) {
+                ec = bsky_ec_Cbor_invalid;
+            } else {
+                bsky_cbor_push_map(sb, n);
+            }
+
+            for (size_t i = 0; i < n && ec == bsky_ec_Ok; ++i) {
+                bsky_cbor_push_str(sb, keys[i].key);
+                ec = bsky_sb_push_cbor_of_json(sb,
+                                               json.dct.data[keys[i].idx].value);
+            }
+
+            if (keys != stack) free(keys);
+        } break;
+
+        default:
+            bsky_return_error(bsky_ec_Json_invalid_variant);
+        }
+
+        return ec;
+    }
+
+    struct bsky_str bsky_tmp_record_cid(struct bsky_view cbor)
+    {
+        unsigned char digest[32];
+
+        bsky_sha256(cbor.start, (char*) cbor.end - (char*) cbor.start, digest);
+
+        return __bsky_tmp_cid_str(0x71, digest);
+    }
+
+    /*
+     * BSKY CAR V1
+     */
+
+    // Decode unsigned LEB128 varint (at most 9 bytes as multiformats
+    // require). Return number of bytes or 0 if it is invalid or does not
+    // fit into `len'.
+    static int __bsky_uvarint(const unsigned char *p, size_t len,
+                              uint64_t *v)
+    {
+        *v = 0;
+        for (int i = 0; i < 9 && (size_t) i < len; ++i) {
+            *v |= (uint64_t) (p[i] & 0x7f) << (7 * i);
+            if ((p[i] & 0x80) == 0) return i + 1;
+        }
+
+        return 0;
+    }
+
+    static void __bsky_push_uvarint(struct bsky_str_builder *sb, uint64_t v)
+    {
+        unsigned char buf[10];
+        int n = 0;
+
+        do {
+            buf[n++] = (v & 0x7f) | (v > 0x7f ? 0x80 : 0);
+            v >>= 7;
+        } while (v);
+
+        __bsky_da_append(sb, buf, 1, n);
+    }
+
+    // Length of binary CID at the beginning of data, 0 if it is invalid.
+    static size_t __bsky_cid_len(const unsigned char *p, size_t len)
+    {
+        uint64_t version, codec, hash, digest;
+        size_t   off = 0;
+        int      n;
+
+        // CIDv0 is bare sha2-256 multihash.
+        if (len >= 34 && p[0] == 0x12 && p[1] == 0x20) return 34;
+
+        if (!(n = __bsky_uvarint(p, len, &version)) || version != 1) return 0;
+        off += n;
+        if (!(n = __bsky_uvarint(p + off, len - off, &codec)))  return 0;
+        off += n;
+        if (!(n = __bsky_uvarint(p + off, len - off, &hash)))   return 0;
+        off += n;
+        if (!(n = __bsky_uvarint(p + off, len - off, &digest))) return 0;
+        off += n;
+
+        return digest <= len - off ? off + digest : 0;
+    }
+
+    // Make sure `need' bytes are available from position, reading stream
+    // if needed. Return number of available bytes.
+    static size_t __bsky_car_fill(struct bsky_car_reader *r, size_t need,
+                                  enum bsky_error_code *ec)
+    {
+        if (r->fd < 0) {
+            return (char*) r->mem.end - (char*) r->mem.start - r->pos;
+        }
+
+        size_t avail = r->buf.len - r->pos;
+        if (avail >= need) return avail;
+
+        // move the beginning of incomplete frame to the buffer start.
+        memmove(r->buf.data, r->buf.data + r->pos, avail);
+        r->offset += r->pos;
+        r->buf.len = avail;
+        r->pos     = 0;
+
+        size_t cap = need > BSKY_CAR_READ_CHUNK ? need : BSKY_CAR_READ_CHUNK;
+        if (r->buf.cap < cap) {
+            void *data = realloc(r->buf.data, cap);
+
+            if (data == NULL) {
+                *ec = bsky_ec_Out_of_memory;
+                return avail;
+            }
+            r->buf.data = data;
+            r->buf.cap  = cap;
+        }
+
+        while (r->buf.len < need) {
+            ssize_t n = read(r->fd, r->buf.data + r->buf.len,
+                             r->buf.cap - r->buf.len);
+
+            if (n == 0) break;
+            if (n < 0 && errno == EINTR) continue;
+            if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                struct pollfd pfd = { .fd = r->fd, .events = POLLIN };
+                poll(&pfd, 1, -1);
+                continue;
+            }
+            if (n < 0) {
+                *ec = bsky_ec_Io;
+                break;
+            }
+
+            r->buf.len += n;
+        }
+
+        return r->buf.len - r->pos;
+    }
+
+    static inline unsigned char *__bsky_car_ptr(struct bsky_car_reader *r)
+    {
+        return (unsigned char*) (r->fd < 0 ? r->mem.start : r->buf.data)
+               + r->pos;
+    }
+
+    // Read varint framed section: `len' bytes at returned pointer.
+    static unsigned char *__bsky_car_frame(struct bsky_car_reader *r,
+                                           uint64_t *len,
+                                           enum bsky_error_code *ec)
+    {
+        size_t avail = __bsky_car_fill(r, 10, ec);
+        int    n;
+
+        if (*ec != bsky_ec_Ok || avail == 0) return NULL;
+
+        if (!(n = __bsky_uvarint(__bsky_car_ptr(r), avail, len))) {
+            *ec = avail < 9 ? bsky_ec_Car_truncated : bsky_ec_Car_invalid;
+            return NULL;
+        }
+        if (*len > BSKY_CAR_MAX_BLOCK) {
+            *ec = bsky_ec_Car_invalid;
+            return NULL;
+        }
+
+        avail = __bsky_car_fill(r, n + *len, ec);
+        if (*ec != bsky_ec_Ok) return NULL;
+        if (avail < n + *len) {
+            *ec = bsky_ec_Car_truncated;
+            return NULL;
+        }
+
+        unsigned char *p = __bsky_car_ptr(r) + n;
+        r->pos += n + *len;
+
+        return p;
+    }
+
+    static enum bsky_error_code __bsky_car_read_header(
+                                    struct bsky_car_reader *r)
+    {
+        enum bsky_error_code ec = bsky_ec_Ok;
+        uint64_t len;
+
+        unsigned char *p = __bsky_car_frame(r, &len, &ec);
+        if (p == NULL && ec == bsky_ec_Ok) ec = bsky_ec_Car_truncated;
+        if (p == NULL) bsky_return_error(ec);
+
+        if ((ec = __bsky_da_append(&r->header, p, 1, len)) != bsky_ec_Ok)
+            return ec;
+
+        r->blocks_start = r->offset + r->pos;
+
+        struct bsky_view view = { r->header.data, r->header.data + len };
+        struct bsky_cbor header = bsky_parse_cbor(&view, &ec);
+        if (ec != bsky_ec_Ok) return ec;
+
+        struct bsky_cbor *version = bsky_cbor_get(&header, "version");
+        struct bsky_cbor *roots   = bsky_cbor_get(&header, "roots");
+
+        if (version == NULL || version->var != bsky_cbor_Int ||
+            version->i != 1 || roots == NULL || roots->var != bsky_cbor_Arr) {
+            bsky_return_error(bsky_ec_Car_invalid);
+        }
+
+        for (size_t i = 0; i < roots->arr.len; ++i) {
+            if (roots->arr.data[i].var != bsky_cbor_Link)
+                bsky_return_error(bsky_ec_Car_invalid);
+
+            bsky_da_push(&r->roots, roots->arr.data[i].bytes);
+        }
+
+        return bsky_ec_Ok;
+    }
+
+    enum bsky_error_code bsky_car_open_mem(struct bsky_car_reader *r,
+                                           struct bsky_view data,
+                                           enum bsky_error_code *ec)
+    {
+        *r = (struct bsky_car_reader) { .fd = -1, .mem = data };
+
+        return *ec = __bsky_car_read_header(r);
+    }
+
+    enum bsky_error_code bsky_car_open_file(struct bsky_car_reader *r,
+                                            const char *path,
+                                            enum bsky_error_code *ec)
+    {
+        struct stat st;
+        void *map = MAP_FAILED;
+        int fd = open(path, O_RDONLY | O_CLOEXEC);
+
+        *r = (struct bsky_car_reader) { .fd = -1 };
+
+        if (fd < 0 || fstat(fd, &st) != 0 || st.st_size == 0)
+            bsky_defer_ec(bsky_ec_Io);
+
+        map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map == MAP_FAILED) bsky_defer_ec(bsky_ec_Io);
+
+        madvise(map, st.st_size, MADV_SEQUENTIAL);
+
+        r->mem    = (struct bsky_view) { map, (char*) map + st.st_size };
+        r->mapped = 1;
+
+        *ec = __bsky_car_read_header(r);
+
+    defer:
+        if (fd >= 0) close(fd);
+        return *ec;
+    }
+
+    enum bsky_error_code bsky_car_open_stream(struct bsky_car_reader *r,
+                                              int fd, struct bsky_view prefix,
+                                              enum bsky_error_code *ec)
+    {
+        *r = (struct bsky_car_reader) { .fd = fd };
+
+        *ec = __bsky_da_append(&r->buf, prefix.start, 1,
+                               (char*) prefix.end - (char*) prefix.start);
+        if (*ec != bsky_ec_Ok) return *ec;
+
+        return *ec = __bsky_car_read_header(r);
+    }
+
+    int bsky_car_next(struct bsky_car_reader *r, struct bsky_car_block *block,
+                      enum bsky_error_code *ec)
+    {
+        uint64_t offset = r->offset + r->pos, len;
+
+        *ec = bsky_ec_Ok;
+
+        unsigned char *p = __bsky_car_frame(r, &len, ec);
+        if (p == NULL) return 0;
+
+        size_t cid_len = __bsky_cid_len(p, len);
+        if (cid_len == 0) {
+            *ec = bsky_ec_Car_invalid;
+            return 0;
+        }
+
+        // absolute offsets are kept when stream buffer is compacted.
+        block->cid    = (struct bsky_view) { p, p + cid_len };
+        block->data   = (struct bsky_view) { p + cid_len, p + len };
+        block->offset = offset;
+
+        return 1;
+    }
+
+    static void __bsky_car_index_put(struct bsky_car_index *index,
+                                     uint64_t hash, uint64_t offset)
+    {
+        size_t mask = index->cap - 1, i = hash & mask;
+
+        while (index->data[i].offset != 0) i = (i + 1) & mask;
+
+        // offset 0 marks empty slot, frames never start at 0.
+        index->data[i] = (struct bsky_car_index_entry) { hash, offset };
+        index->len++;
+    }
+
+    enum bsky_error_code bsky_car_build_index(struct bsky_car_reader *r)
+    {
+        enum bsky_error_code ec = bsky_ec_Ok;
+        struct bsky_car_block block;
+        size_t pos = r->pos;
+
+        if (r->fd >= 0) bsky_return_error(bsky_ec_Car_invalid);
+
+        r->pos = r->blocks_start;
+        while (bsky_car_next(r, &block, &ec)) {
+            // keep load factor below 1/2.
+            if ((r->index.len + 1) * 2 > r->index.cap) {
+                struct bsky_car_index old = r->index;
+                size_t cap = old.cap ? old.cap * 2 : 1024;
+
+                r->index.data = calloc(cap, sizeof (*r->index.data));
+                if (r->index.data == NULL) {
+                    r->index = old;
+                    ec = bsky_ec_Out_of_memory;
+                    break;
+                }
+                r->index.cap = cap;
+                r->index.len = 0;
+
+                for (size_t i = 0; i < old.cap; ++i) {
+                    if (old.data[i].offset == 0) continue;
+                    __bsky_car_index_put(&r->index, old.data[i].hash,
+                                         old.data[i].offset);
+                }
+                free(old.data);
+            }
+
+            __bsky_car_index_put(&r->index, __bsky_hash_bytes(block.cid.start,
+                                 (char*) block.cid.end - (char*) block.cid.start),
+                                 block.offset);
+        }
+        r->pos = pos;
+
+        if (ec != bsky_ec_Ok) bsky_return_error(ec);
+        return bsky_ec_Ok;
+    }
+
+    int bsky_car_find(struct bsky_car_reader *r, struct bsky_view cid,
+                      struct bsky_car_block *block)
+    {
+        enum bsky_error_code ec;
+        size_t len = (char*) cid.end - (char*) cid.start;
+
+        if (r->index.cap == 0 || r->fd >= 0) return 0;
+
+        uint64_t hash = __bsky_hash_bytes(cid.start, len);
+        size_t   mask = r->index.cap - 1, pos = r->pos;
+
+        for (size_t i = hash & mask; r->index.data[i].offset != 0;
+             i = (i + 1) & mask) {
+            if (r->index.data[i].hash != hash) continue;
+
+            r->pos = r->index.data[i].offset;
+            int ok = bsky_car_next(r, block, &ec);
+            r->pos = pos;
+
+            if (ok && (size_t) ((char*) block->cid.end -
+                                (char*) block->cid.start) == len &&
+                memcmp(block->cid.start, cid.start, len) == 0) {
+                return 1;
+            }
+        }
+
+        return 0;
+    }
+
+    void bsky_car_free(struct bsky_car_reader *r)
+    {
+        if (r->mapped) {
+            munmap(r->mem.start, (char*) r->mem.end - (char*) r->mem.start);
+        }
+
+        bsky_da_free(&r->buf);
+        bsky_da_free(&r->header);
+        bsky_da_free(&r->roots);
+        free(r->index.data);
+
+        *r = (struct bsky_car_reader) { .fd = -1 };
+    }
+
+    void bsky_car_push_header(struct bsky_str_builder *sb,
+                              const struct bsky_view *roots, size_t len)
+    {
+        struct bsky_str_builder header = { 0 };
+
+        bsky_cbor_push_map(&header, 2);
+        bsky_cbor_push_str(&header, bsky_mk_str("roots"));
+        bsky_cbor_push_arr(&header, len);
+        for (size_t i = 0; i < len; ++i) bsky_cbor_push_link(&header, roots[i]);
+        bsky_cbor_push_str(&header, bsky_mk_str("version"));
+        bsky_cbor_push_int(&header, 1);
+
+        __bsky_push_uvarint(sb, header.len);
+        __bsky_da_append(sb, header.data, 1, header.len);
+
+        bsky_da_free(&header);
+    }
+
+    void bsky_car_push_block(struct bsky_str_builder *sb, struct bsky_view cid,
+                             struct bsky_view data)
+    {
+        size_t cid_len  = (char*) cid.end  - (char*) cid.start;
+        size_t data_len = (char*) data.end - (char*) data.start;
+
+        __bsky_push_uvarint(sb, cid_len + data_len);
+        __bsky_da_append(sb, cid.start, 1, cid_len);
+        __bsky_da_append(sb, data.start, 1, data_len);
+    }
+
+    /*
+     * BSKY CID
+     */
+    struct bsky_cid bsky_cid_of_bytes(struct bsky_view *data,
+                                      enum bsky_error_code *ec)
+    {
+        struct bsky_cid cid = { 0 };
+        const unsigned char *p = data->start;
+        size_t   len = (char*) data->end - (char*) data->start, off = 0;
+        uint64_t digest_len;
+        int      n;
+
+        *ec = bsky_ec_Ok;
+
+        if (len >= 34 && p[0] == 0x12 && p[1] == 0x20) {
+            cid = (struct bsky_cid) { 0, bsky_multicodec_Dag_pb,
+                                      bsky_multicodec_Sha2_256, 32 };
+            memcpy(cid.digest, p + 2, 32);
+            data->start = (char*) data->start + 34;
+            return cid;
+        }
+
+        if (!(n = __bsky_uvarint(p, len, &cid.version)) || cid.version != 1)
+            bsky_defer_ec(bsky_ec_Cid_invalid);
+        off += n;
+        if (!(n = __bsky_uvarint(p + off, len - off, &cid.codec)))
+            bsky_defer_ec(bsky_ec_Cid_invalid);
+        off += n;
+        if (!(n = __bsky_uvarint(p + off, len - off, &cid.hash)))
+            bsky_defer_ec(bsky_ec_Cid_invalid);
+        off += n;
+        if (!(n = __bsky_uvarint(p + off, len - off, &digest_len)))
+            bsky_defer_ec(bsky_ec_Cid_invalid);
+        off += n;
+
+        if (digest_len > sizeof (cid.digest) || digest_len > len - off)
+            bsky_defer_ec(bsky_ec_Cid_invalid);
+
+        cid.digest_len = digest_len;
+        memcpy(cid.digest, p + off, digest_len);
+        data->start = (char*) data->start + off + digest_len;
+
+    defer:
+        return cid;
+    }
+
+    struct bsky_cid bsky_cid_of_str(struct bsky_str str,
+                                    enum bsky_error_code *ec)
+    {
+        unsigned char buf[128];
+        size_t len = bsky_str_len(str), n;
+
+        *ec = bsky_ec_Ok;
+
+        if (len < 2 || *str.start != 'b' || (len - 1) * 5 / 8 > sizeof (buf) ||
+            !__bsky_base32_decode(bsky_shift_str(str, 1), buf, &n)) {
+            *ec = bsky_ec_Cid_invalid;
+            return (struct bsky_cid) { 0 };
+        }
+
+        struct bsky_view view = { buf, buf + n };
+        struct bsky_cid  cid  = bsky_cid_of_bytes(&view, ec);
+
+        if (*ec == bsky_ec_Ok && (cid.version != 1 || view.start != view.end))
+            *ec = bsky_ec_Cid_invalid;
+
+        return cid;
+    }
+
+    struct bsky_cid bsky_cid_of_data(enum bsky_multicodec codec,
+                                     struct bsky_view data)
+    {
+        struct bsky_cid cid = { 1, codec, bsky_multicodec_Sha2_256, 32 };
+
+        bsky_sha256(data.start, (char*) data.end - (char*) data.start,
+                    cid.digest);
+
+        return cid;
+    }
+
+    // Binary CID into buffer. Return its length.
+    static size_t __bsky_cid_to_bytes(struct bsky_cid cid,
+                                      unsigned char buf[104])
+    {
+        uint64_t fields[4] = { cid.version, cid.codec, cid.hash,
+                               cid.digest_len };
+        size_t   len = 0;
+
+        if (cid.version == 0) {
+            buf[len++] = 0x12;
+            buf[len++] = 0x20;
+        } else {
+            for (int i = 0; i < 4; ++i) {
+                uint64_t v = fields[i];
+
+                do {
+                    buf[len++] = (v & 0x7f) | (v > 0x7f ? 0x80 : 0);
+                    v >>= 7;
+                } while (v);
+            }
+        }
+
+        memcpy(buf + len, cid.digest, cid.digest_len);
+        return len + cid.digest_len;
+    }
+
+    void bsky_sb_push_cid(struct bsky_str_builder *sb, struct bsky_cid cid)
+    {
+        unsigned char buf[104];
+
+        __bsky_da_append(sb, buf, 1, __bsky_cid_to_bytes(cid, buf));
+    }
+
+    struct bsky_str bsky_tmp_str_of_cid(struct bsky_cid cid)
+    {
+        unsigned char buf[104];
+
+        if (cid.version != 1) return (struct bsky_str) { 0 };
+
+        return __bsky_tmp_multibase32(buf, __bsky_cid_to_bytes(cid, buf));
+    }
+
+    int bsky_cid_eq(struct bsky_cid a, struct bsky_cid b)
+    {
+        return a.version == b.version && a.codec == b.codec &&
+               a.hash == b.hash && a.digest_len == b.digest_len &&
+               memcmp(a.digest, b.digest, a.digest_len) == 0;
+    }
+
+    int bsky_cid_verify(struct bsky_cid cid, struct bsky_view data)
+    {
+        unsigned char digest[32];
+
+        if (cid.hash != bsky_multicodec_Sha2_256 || cid.digest_len != 32)
+            return 0;
+
+        bsky_sha256(data.start, (char*) data.end - (char*) data.start, digest);
+
+        return memcmp(digest, cid.digest, 32) == 0;
+    }
+
+    size_t bsky_car_verify(const struct bsky_car_block *blocks, size_t len,
+                           unsigned char *ok)
+    {
+        struct bsky_view views[64];
+        unsigned char    digests[64][32];
+        size_t valid = 0;
+
+        for (size_t start = 0; start < len; start += 64) {
+            size_t n = len - start < 64 ? len - start : 64;
+
+            for (size_t i = 0; i < n; ++i) views[i] = blocks[start + i].data;
+            bsky_sha256_many(views, n, digests);
+
+            for (size_t i = 0; i < n; ++i) {
+                enum bsky_error_code ec;
+                struct bsky_view cid_view = blocks[start + i].cid;
+                struct bsky_cid  cid = bsky_cid_of_bytes(&cid_view, &ec);
+
+                int good = ec == bsky_ec_Ok &&
+                           cid.hash == bsky_multicodec_Sha2_256 &&
+                           cid.digest_len == 32 &&
+                           memcmp(cid.digest, digests[i], 32) == 0;
+
+                if (ok != NULL) ok[start + i] = good;
+                valid += good;
+            }
+        }
+
+        return valid;
+    }
+
+    /*
+     * BSKY MERKLE SEARCH TREE
+     */
+
+    // Read head of item in already validated DAG-CBOR. Return major type.
+    static int __bsky_cbor_head(const unsigned char **pp, uint64_t *arg)
+    {
+        const unsigned char *p = *pp;
+        int major = *p >> 5, info = *p++ & 0x1f;
+
+        if (info < 24) {
+            *arg = info;
+        } else {
+            int n = 1 << (info - 24);
+
+            *arg = __bsky_load_be(p, n);
+            p   += n;
+        }
+
+        *pp = p;
+        return major;
+    }
+
+    static int __bsky_view_eq(struct bsky_view a, struct bsky_view b)
+    {
+        size_t len = (char*) a.end - (char*) a.start;
+
+        return len == (size_t) ((char*) b.end - (char*) b.start) &&
+               (len == 0 || memcmp(a.start, b.start, len) == 0);
+    }
+
+    static int __bsky_mst_key_cmp(struct bsky_str a, struct bsky_str b)
+    {
+        size_t a_len = a.end - a.start, b_len = b.end - b.start;
+        int    cmp   = memcmp(a.start, b.start, a_len < b_len ? a_len : b_len);
+
+        return cmp ? cmp : (a_len > b_len) - (a_len < b_len);
+    }
+
+    // Read CID link or null (empty view).
+    static int __bsky_mst_link(const unsigned char **pp, struct bsky_view *cid)
+    {
+        uint64_t arg;
+
+        if (**pp == 0xf6) {
+            (*pp)++;
+            *cid = (struct bsky_view) { 0 };
+            return 1;
+        }
+
+        if (__bsky_cbor_head(pp, &arg) != 6) return 0;
+        if (__bsky_cbor_head(pp, &arg) != 2) return 0;
+
+        *cid = (struct bsky_view) { (void*) (*pp + 1), (void*) (*pp + arg) };
+        *pp += arg;
+
+        return 1;
+    }
+
+    static enum bsky_error_code __bsky_mst_decode(struct bsky_view cid,
+                                                  struct bsky_view block,
+                                                  struct bsky_mst_node **out)
+    {
+        enum bsky_error_code ec = bsky_ec_Ok, *ec_p = &ec;
+        struct bsky_view check = block;
+        struct { char *data; size_t len, cap; } keys = { 0 };
+        const unsigned char *p = block.start;
+        uint64_t n, m = 0;
+
+        struct bsky_mst_node *node = calloc(1, sizeof (*node));
+        if (node == NULL) bsky_return_error(bsky_ec_Out_of_memory);
+
+        node->cid = cid;
+
+        // strict validation once, then fields are read without checks.
+        if (bsky_cbor_skip(&check) != bsky_ec_Ok || check.start != check.end)
+            goto invalid;
+
+        if (__bsky_cbor_head(&p, &n) != 5) goto invalid;
+
+        for (uint64_t i = 0; i < n; ++i) {
+            uint64_t len;
+            __bsky_cbor_head(&p, &len);
+
+            char name = len == 1 ? *p : 0;
+            p += len;
+
+            if (name == 'l') {
+                if (!__bsky_mst_link(&p, &node->left)) goto invalid;
+                continue;
+            }
+            if (name != 'e' || __bsky_cbor_head(&p, &m) != 4) goto invalid;
+
+            node->data = calloc(m ? m : 1, sizeof (*node->data));
+            if (node->data == NULL) {
+                *ec_p = bsky_ec_Out_of_memory;
+                goto defer;
+            }
+            node->len = m;
+
+            size_t prev_off = 0, prev_len = 0;
+
+            for (uint64_t j = 0; j < m; ++j) {
+                struct bsky_mst_entry *e = &node->data[j];
+                const unsigned char *suffix = NULL;
+                uint64_t fields, prefix = 0, suffix_len = 0;
+
+                if (__bsky_cbor_head(&p, &fields) != 5) goto invalid;
+
+                for (uint64_t f = 0; f < fields; ++f) {
+                    uint64_t arg;
+                    __bsky_cbor_head(&p, &len);
+
+                    char field = len == 1 ? *p : 0;
+                    p += len;
+
+                    switch (field) {
+                    case 'p':
+                        if (__bsky_cbor_head(&p, &prefix) != 0) goto invalid;
+                        break;
+                    case 'k':
+                        if (__bsky_cbor_head(&p, &arg) != 2) goto invalid;
+                        suffix     = p;
+                        suffix_len = arg;
+                        p         += arg;
+                        break;
+                    case 't':
+                        if (!__bsky_mst_link(&p, &e->right)) goto invalid;
+                        break;
+                    case 'v':
+                        if (!__bsky_mst_link(&p, &e->value)) goto invalid;
+                        break;
+                    default:
+                        goto invalid;
+                    }
+                }
+
+                if (suffix == NULL || e->value.start == e->value.end ||
+                    prefix > prev_len) {
+                    goto invalid;
+                }
+
+                // key is prefix of the previous key and suffix.
+                size_t need = keys.len + prefix + suffix_len;
+                if (need > keys.cap) {
+                    size_t cap  = need * 2 > 256 ? need * 2 : 256;
+                    char  *data = realloc(keys.data, cap);
+
+                    if (data == NULL) {
+                        *ec_p = bsky_ec_Out_of_memory;
+                        goto defer;
+                    }
+                    keys.data = data;
+                    keys.cap  = cap;
+                }
+
+                size_t off = keys.len;
+                memcpy(keys.data + off, keys.data + prev_off, prefix);
+                memcpy(keys.data + off + prefix, suffix, suffix_len);
+                keys.len += prefix + suffix_len;
+
+                // offsets for now, pointers when keys buffer is final.
+                e->key.start = (char*) (uintptr_t) off;
+                e->key.end   = (char*) (uintptr_t) keys.len;
+
+                if (j > 0 && __bsky_mst_key_cmp(
+                        (struct bsky_str) { keys.data + prev_off,
+                                            keys.data + prev_off + prev_len },
+                        (struct bsky_str) { keys.data + off,
+                                            keys.data + keys.len }) >= 0) {
+                    goto invalid;
+                }
+
+                prev_off = off;
+                prev_len = prefix + suffix_len;
+            }
+        }
+
+        node->keys = keys.data;
+        for (size_t j = 0; j < node->len; ++j) {
+            node->data[j].key.start = keys.data +
+                                      (uintptr_t) node->data[j].key.start;
+            node->data[j].key.end   = keys.data +
+                                      (uintptr_t) node->data[j].key.end;
+        }
+
+        *out = node;
+        return bsky_ec_Ok;
+
+    invalid:
+        ec = bsky_ec_Mst_invalid;
+    defer:
+        free(keys.data);
+        free(node->data);
+        free(node);
+        bsky_log_error(ec);
+        return ec;
+    }
+
+    static int __bsky_mst_car_fetch(void *user, struct bsky_view cid,
+                                    struct bsky_view *block)
+    {
+        struct bsky_car_block car_block;
+
+        if (!bsky_car_find(user, cid, &car_block)) return 0;
+
+        *block = car_block.data;
+        return 1;
+    }
+
+    void bsky_mst_init(struct bsky_mst *mst, struct bsky_view root,
+                       bsky_mst_fetch_fn fetch, void *user)
+    {
+        *mst = (struct bsky_mst) { .root = root, .fetch = fetch, .user = user };
+    }
+
+    enum bsky_error_code bsky_mst_init_car(struct bsky_mst *mst,
+                                           struct bsky_car_reader *car,
+                                           enum bsky_error_code *ec)
+    {
+        struct bsky_view block;
+
+        *ec = bsky_ec_Ok;
+        bsky_mst_init(mst, (struct bsky_view) { 0 }, __bsky_mst_car_fetch, car);
+
+        if (car->roots.len == 0) bsky_defer_ec(bsky_ec_Mst_invalid);
+        if (!__bsky_mst_car_fetch(car, car->roots.data[0], &block))
+            bsky_defer_ec(bsky_ec_Mst_missing_block);
+
+        struct bsky_cbor commit = bsky_parse_cbor(&block, ec);
+        if (*ec != bsky_ec_Ok) goto defer;
+
+        struct bsky_cbor *data = bsky_cbor_get(&commit, "data");
+        if (data == NULL || data->var != bsky_cbor_Link)
+            bsky_defer_ec(bsky_ec_Mst_invalid);
+
+        mst->root = data->bytes;
+
+    defer:
+        return *ec;
+    }
+
+    enum bsky_error_code bsky_mst_node(struct bsky_mst *mst,
+                                       struct bsky_view cid,
+                                       struct bsky_mst_node **out)
+    {
+        enum bsky_error_code ec;
+        struct bsky_view block;
+        size_t len  = (char*) cid.end - (char*) cid.start;
+        size_t hash = __bsky_hash_bytes(cid.start, len);
+        size_t mask = mst->cache.cap - 1;
+
+        for (size_t i = hash & mask; mst->cache.cap &&
+             mst->cache.data[i] != NULL; i = (i + 1) & mask) {
+            if (__bsky_view_eq(mst->cache.data[i]->cid, cid)) {
+                *out = mst->cache.data[i];
+                return bsky_ec_Ok;
+            }
+        }
+
+        if (!mst->fetch(mst->user, cid, &block))
+            bsky_return_error(bsky_ec_Mst_missing_block);
+
+        if ((ec = __bsky_mst_decode(cid, block, out)) != bsky_ec_Ok)
+            return ec;
+
+        // keep load factor below 1/2.
+        if ((mst->cache.len + 1) * 2 > mst->cache.cap) {
+            size_t cap = mst->cache.cap ? mst->cache.cap * 2 : 256;
+            struct bsky_mst_node **data = calloc(cap, sizeof (*data));
+
+            if (data == NULL) {
+                free((*out)->keys);
+                free((*out)->data);
+                free(*out);
+                bsky_return_error(bsky_ec_Out_of_memory);
+            }
+
+            for (size_t i = 0; i < mst->cache.cap; ++i) {
+                struct bsky_mst_node *node = mst->cache.data[i];
+                if (node == NULL) continue;
+
+                size_t j = __bsky_hash_bytes(node->cid.start,
+                               (char*) node->cid.end - (char*) node->cid.start);
+                while (data[j & (cap - 1)] != NULL) j++;
+                data[j & (cap - 1)] = node;
+            }
+
+            free(mst->cache.data);
+            mst->cache.data = data;
+            mst->cache.cap  = cap;
+            mask = cap - 1;
+        }
+
+        size_t i = hash & mask;
+        while (mst->cache.data[i] != NULL) i = (i + 1) & mask;
+
+        mst->cache.data[i] = *out;
+        mst->cache.len++;
+        mst->loaded++;
+
+        return bsky_ec_Ok;
+    }
+
+    int bsky_mst_get(struct bsky_mst *mst, struct bsky_str key,
+                     struct bsky_view *value, enum bsky_error_code *ec)
+    {
+        struct bsky_view cid = mst->root;
+
+        *ec = bsky_ec_Ok;
+
+        while (cid.start != cid.end) {
+            struct bsky_mst_node *node;
+
+            if ((*ec = bsky_mst_node(mst, cid, &node)) != bsky_ec_Ok)
+                return 0;
+
+            // the first entry with key greater than searched one.
+            size_t lo = 0, hi = node->len;
+            while (lo < hi) {
+                size_t mid = (lo + hi) / 2;
+
+                if (__bsky_mst_key_cmp(node->data[mid].key, key) <= 0)
+                    lo = mid + 1;
+                else
+                    hi = mid;
+            }
+
+            if (lo > 0 && __bsky_mst_key_cmp(node->data[lo-1].key, key) == 0) {
+                *value = node->data[lo-1].value;
+                return 1;
+            }
+
+            cid = lo == 0 ? node->left : node->data[lo-1].right;
+        }
+
+        return 0;
+    }
+
+    /*
+     * Iterator walks positions of node: even position is subtree (left
+     * or right of the previous entry), odd position is entry. Before the
+     * first step the root itself is the current subtree.
+     */
+    struct __bsky_mst_item {
+        int tree;
+        struct bsky_view       cid;
+        struct bsky_mst_entry *entry;
+    };
+
+    void bsky_mst_iter_init(struct bsky_mst_iter *it, struct bsky_mst *mst)
+    {
+        *it = (struct bsky_mst_iter) { .mst = mst };
+    }
+
+    void bsky_mst_iter_free(struct bsky_mst_iter *it)
+    {
+        bsky_da_free(&it->stack);
+        bsky_clear_da(&it->stack);
+    }
+
+    static int __bsky_mst_cur(struct bsky_mst_iter *it,
+                              struct __bsky_mst_item *item)
+    {
+        if (!it->started) {
+            item->tree = 1;
+            item->cid  = it->mst->root;
+            if (item->cid.start != item->cid.end) return 1;
+
+            it->started = 1;
+            return 0;
+        }
+
+        while (it->stack.len != 0) {
+            struct __bsky_mst_frame *f = &it->stack.data[it->stack.len - 1];
+
+            if (f->pos == 2 * f->node->len + 1) {
+                it->stack.len--;
+                continue;
+            }
+
+            if (f->pos % 2) {
+                item->tree  = 0;
+                item->entry = &f->node->data[f->pos / 2];
+                return 1;
+            }
+
+            item->tree = 1;
+            item->cid  = f->pos == 0 ? f->node->left
+                                     : f->node->data[f->pos / 2 - 1].right;
+            if (item->cid.start != item->cid.end) return 1;
+
+            f->pos++;
+        }
+
+        return 0;
+    }
+
+    static void __bsky_mst_step_over(struct bsky_mst_iter *it)
+    {
+        if (!it->started) it->started = 1;
+        else              it->stack.data[it->stack.len - 1].pos++;
+    }
+
+    static enum bsky_error_code __bsky_mst_step_into(
+                                    struct bsky_mst_iter *it,
+                                    struct bsky_view cid)
+    {
+        struct __bsky_mst_frame frame = { 0 };
+        enum bsky_error_code ec = bsky_mst_node(it->mst, cid, &frame.node);
+
+        if (ec != bsky_ec_Ok) return ec;
+
+        __bsky_mst_step_over(it);
+        bsky_da_push(&it->stack, frame);
+
+        return bsky_ec_Ok;
+    }
+
+    int bsky_mst_next(struct bsky_mst_iter *it, struct bsky_str *key,
+                      struct bsky_view *value, enum bsky_error_code *ec)
+    {
+        struct __bsky_mst_item item;
+
+        *ec = bsky_ec_Ok;
+
+        while (__bsky_mst_cur(it, &item)) {
+            if (item.tree) {
+                if ((*ec = __bsky_mst_step_into(it, item.cid)) != bsky_ec_Ok)
+                    return 0;
+                continue;
+            }
+
+            *key   = item.entry->key;
+            *value = item.entry->value;
+            __bsky_mst_step_over(it);
+
+            return 1;
+        }
+
+        return 0;
+    }
+
+    enum bsky_error_code bsky_mst_diff(struct bsky_mst *from,
+                                       struct bsky_mst *to,
+                                       bsky_mst_diff_fn fn, void *user)
+    {
+        enum bsky_error_code ec = bsky_ec_Ok;
+        struct bsky_mst_iter a, b;
+        struct bsky_view none = { 0 };
+
+        bsky_mst_iter_init(&a, from);
+        bsky_mst_iter_init(&b, to);
+
+        while (ec == bsky_ec_Ok) {
+            struct __bsky_mst_item x, y;
+            int has_x = __bsky_mst_cur(&a, &x), has_y = __bsky_mst_cur(&b, &y);
+
+            if (!has_x && !has_y) break;
+
+            // equal subtrees are skipped, different ones are expanded.
+            if (has_x && has_y && x.tree && y.tree &&
+                __bsky_view_eq(x.cid, y.cid)) {
+                __bsky_mst_step_over(&a);
+                __bsky_mst_step_over(&b);
+                continue;
+            }
+            if (has_x && x.tree) {
+                ec = __bsky_mst_step_into(&a, x.cid);
+                if (ec == bsky_ec_Ok && has_y && y.tree)
+                    ec = __bsky_mst_step_into(&b, y.cid);
+                continue;
+            }
+            if (has_y && y.tree) {
+                ec = __bsky_mst_step_into(&b, y.cid);
+                continue;
+            }
+
+            int cmp = !has_y ? -1 : !has_x ? 1
+                    : __bsky_mst_key_cmp(x.entry->key, y.entry->key);
+
+            if (cmp < 0) {
+                fn(user, bsky_write_Delete, x.entry->key, x.entry->value, none);
+                __bsky_mst_step_over(&a);
+            } else if (cmp > 0) {
+                fn(user, bsky_write_Create, y.entry->key, none, y.entry->value);
+                __bsky_mst_step_over(&b);
+            } else {
+                if (!__bsky_view_eq(x.entry->value, y.entry->value)) {
+                    fn(user, bsky_write_Update, x.entry->key, x.entry->value,
+                       y.entry->value);
+                }
+                __bsky_mst_step_over(&a);
+                __bsky_mst_step_over(&b);
+            }
+        }
+
+        bsky_mst_iter_free(&a);
+        bsky_mst_iter_free(&b);
+
+        return ec;
+    }
+
+    void bsky_mst_free(struct bsky_mst *mst)
+    {
+        for (size_t i = 0; i < mst->cache.cap; ++i) {
+            struct bsky_mst_node *node = mst->cache.data[i];
+            if (node == NULL) continue;
+
+            free(node->keys);
+            free(node->data);
+            free(node);
+        }
+
+        free(mst->cache.data);
+        mst->cache.data = NULL;
+        mst->cache.len  = mst->cache.cap = 0;
+    }
+
+    /*
+     * BSKY FIREHOSE PIPELINE
+     */
+    #include <sched.h>
+
+    enum bsky_error_code bsky_spsc_init(struct bsky_spsc *ring, size_t cap)
+    {
+        size_t size = 1;
+
+        while (size < cap) size <<= 1;
+
+        memset(ring, 0, sizeof (*ring));
+        atomic_init(&ring->head, 0);
+        atomic_init(&ring->tail, 0);
+        atomic_init(&ring->max_depth, 0);
+
+        ring->data = calloc(size, sizeof (void*));
+        if (ring->data == NULL) bsky_return_error(bsky_ec_Out_of_memory);
+
+        ring->mask = size - 1;
+
+        return bsky_ec_Ok;
+    }
+
+    int bsky_spsc_push(struct bsky_spsc *ring, void *item)
+    {
+        size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+
+        if (tail - ring->head_cache > ring->mask) {
+            ring->head_cache = atomic_load_explicit(&ring->head,
+                                                    memory_order_acquire);
+            if (tail - ring->head_cache > ring->mask) return 0;
+        }
+
+        ring->data[tail & ring->mask] = item;
+        atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+
+        // cached head is behind, so depth is a bit overestimated.
+        size_t depth = tail + 1 - ring->head_cache;
+        if (depth > atomic_load_explicit(&ring->max_depth,
+                                         memory_order_relaxed)) {
+            atomic_store_explicit(&ring->max_depth, depth,
+                                  memory_order_relaxed);
+        }
+
+        return 1;
+    }
+
+    void *bsky_spsc_pop(struct bsky_spsc *ring)
+    {
+        size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+
+        if (head == ring->tail_cache) {
+            ring->tail_cache = atomic_load_explicit(&ring->tail,
+                                                    memory_order_acquire);
+            if (head == ring->tail_cache) return NULL;
+        }
+
+        void *item = ring->data[head & ring->mask];
+        atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+
+        return item;
+    }
+
+    size_t bsky_spsc_depth(struct bsky_spsc *ring)
+    {
+        size_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+        size_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+
+        return tail - head;
+    }
+
+    void bsky_spsc_free(struct bsky_spsc *ring)
+    {
+        free(ring->data);
+        ring->data = NULL;
+    }
+
+    // Spin, then yield, then sleep while waiting for other stage.
+    static void __bsky_spsc_backoff(unsigned *spins)
+    {
+        if (*spins < 64) {
+    #if defined(__x86_64__) || defined(__i386__)
+            __builtin_ia32_pause();
+    #elif defined(__aarch64__)
+            __asm__ volatile ("yield");
+    #endif
+        } else if (*spins < 128) {
+            sched_yield();
+        } else {
+            nanosleep(&(struct timespec) { .tv_nsec = 50000 }, NULL);
+        }
+
+        (*spins)++;
+    }
+
+    // Check that CBOR head with its argument fits before `end'.
+    static int __bsky_cbor_head_fits(const unsigned char *p,
+                                     const unsigned char *end)
+    {
+        int info;
+
+        if (p >= end) return 0;
+
+        info = *p & 0x1f;
+        if (info < 24) return 1;
+        if (info > 27) return 0;
+
+        return end - p > 1 << (info - 24);
+    }
+
+    // Find repo DID and `seq' of the frame for sharding. Only items up to
+    // both of them are validated: `seq' goes before `repo' of #commit, but
+    // after `did' of #identity and #account. Frames without DID have empty
+    // `repo', without `seq' - zero `seq'.
+    static int __bsky_firehose_repo(struct bsky_view frame,
+                                    struct bsky_str *repo, int64_t *seq)
+    {
+        struct bsky_view view = frame;
+        const unsigned char *p;
+        uint64_t n, len, arg;
+        int found = 0;
+
+        *repo = (struct bsky_str) { 0 };
+        *seq  = 0;
+
+        if (bsky_cbor_skip(&view) != bsky_ec_Ok) return 0;
+
+        p = view.start;
+        if (!__bsky_cbor_head_fits(p, view.end) || *p >> 5 != 5) return 0;
+
+        __bsky_cbor_head(&p, &n);
+        view.start = (void*) p;
+
+        for (uint64_t i = 0; i < n; ++i) {
+            struct bsky_view key = view, value;
+
+            if (bsky_cbor_skip(&view) != bsky_ec_Ok) return 0;
+
+            value = view;
+            if (bsky_cbor_skip(&view) != bsky_ec_Ok) return 0;
+
+            p = key.start;
+            if (__bsky_cbor_head(&p, &len) != 3) return 0;
+
+            if (len == 3 && memcmp(p, "seq", 3) == 0) {
+                p = value.start;
+                if (__bsky_cbor_head(&p, &arg) == 0) *seq = arg;
+                found |= 1;
+            } else if ((len == 4 && memcmp(p, "repo", 4) == 0) ||
+                       (len == 3 && memcmp(p, "did",  3) == 0)) {
+                p = value.start;
+                if (__bsky_cbor_head(&p, &len) != 3) return 0;
+
+                *repo = (struct bsky_str) { (char*) p, (char*) p + len };
+                found |= 2;
+            }
+
+            if (found == 3) break;
+        }
+
+        return 1;
+    }
+
+    static int __bsky_firehose_key(const unsigned char *p, uint64_t len,
+                                   const char *name)
+    {
+        return strlen(name) == len && memcmp(p, name, len) == 0;
+    }
+
+    static enum bsky_write_op __bsky_firehose_action(const unsigned char *p,
+                                                     uint64_t len)
+    {
+        if (__bsky_firehose_key(p, len, "create")) return bsky_write_Create;
+        if (__bsky_firehose_key(p, len, "update")) return bsky_write_Update;
+        if (__bsky_firehose_key(p, len, "delete")) return bsky_write_Delete;
+
+        return -1;
+    }
+
+    enum bsky_error_code bsky_firehose_decode(struct bsky_firehose_event *ev,
+                                              struct bsky_view frame)
+    {
+        struct bsky_view view = frame;
+        const unsigned char *p, *end = frame.end;
+        uint64_t n, len, arg;
+        int major;
+
+        ev->frame   = frame;
+        ev->op      = 0;
+        ev->seq     = 0;
+        ev->type    = ev->repo = ev->rev = ev->time = (struct bsky_str) { 0 };
+        ev->blocks  = (struct bsky_view) { 0 };
+        ev->ops.len = 0;
+
+        // strict validation once, then fields are read without checks.
+        if (bsky_cbor_skip(&view) != bsky_ec_Ok) goto invalid;
+
+        ev->body = view;
+        if (bsky_cbor_skip(&view) != bsky_ec_Ok || view.start != view.end)
+            goto invalid;
+
+        p = frame.start;
+        if (__bsky_cbor_head(&p, &n) != 5) goto invalid;
+
+        for (uint64_t i = 0; i < n; ++i) {
+            const unsigned char *key;
+
+            if (__bsky_cbor_head(&p, &len) != 3) goto invalid;
+            key = p;
+            p  += len;
+
+            if (__bsky_firehose_key(key, len, "op")) {
+                major = __bsky_cbor_head(&p, &arg);
+                if (major > 1) goto invalid;
+                ev->op = major ? -1 - (int64_t) arg : (int64_t) arg;
+            } else if (__bsky_firehose_key(key, len, "t")) {
+                if (__bsky_cbor_head(&p, &arg) != 3) goto invalid;
+                ev->type = (struct bsky_str) { (char*) p, (char*) p + arg };
+                p += arg;
+            } else {
+                struct bsky_view rest = { (void*) p, ev->body.start };
+                bsky_cbor_skip(&rest);
+                p = rest.start;
+            }
+        }
+
+        p = ev->body.start;
+        if (__bsky_cbor_head(&p, &n) != 5) goto invalid;
+
+        for (uint64_t i = 0; i < n; ++i) {
+            const unsigned char *key;
+            struct bsky_str text = { 0 };
+
+            if (__bsky_cbor_head(&p, &len) != 3) goto invalid;
+            key = p;
+            p  += len;
+
+            // text fields.
+            if (*p >> 5 == 3) {
+                const unsigned char *q = p;
+
+                __bsky_cbor_head(&q, &arg);
+                text = (struct bsky_str) { (char*) q, (char*) q + arg };
+            }
+
+            if (__bsky_firehose_key(key, len, "seq")) {
+                if (__bsky_cbor_head(&p, &arg) != 0) goto invalid;
+                ev->seq = arg;
+                continue;
+            }
+            if (__bsky_firehose_key(key, len, "repo") ||
+                __bsky_firehose_key(key, len, "did")) {
+                if (text.start == NULL) goto invalid;
+                ev->repo = text;
+            } else if (__bsky_firehose_key(key, len, "rev")) {
+                ev->rev  = text;
+            } else if (__bsky_firehose_key(key, len, "time")) {
+                ev->time = text;
+            } else if (__bsky_firehose_key(key, len, "blocks")) {
+                if (__bsky_cbor_head(&p, &arg) != 2) goto invalid;
+                ev->blocks = (struct bsky_view) { (void*) p, (void*) (p + arg) };
+                p += arg;
+                continue;
+            } else if (__bsky_firehose_key(key, len, "ops") && *p >> 5 == 4) {
+                uint64_t ops;
+
+                __bsky_cbor_head(&p, &ops);
+                for (uint64_t j = 0; j < ops; ++j) {
+                    struct bsky_firehose_op op = { .op = -1 };
+                    uint64_t fields;
+
+                    if (__bsky_cbor_head(&p, &fields) != 5) goto invalid;
+
+                    for (uint64_t f = 0; f < fields; ++f) {
+                        __bsky_cbor_head(&p, &len);
+                        key = p;
+                        p  += len;
+
+                        if (__bsky_firehose_key(key, len, "cid")) {
+                            if (!__bsky_mst_link(&p, &op.cid)) goto invalid;
+                            continue;
+                        }
+
+                        if (*p >> 5 == 3 &&
+                            (__bsky_firehose_key(key, len, "action") ||
+                             __bsky_firehose_key(key, len, "path"))) {
+                            __bsky_cbor_head(&p, &arg);
+
+                            if (key[0] == 'p') {
+                                op.path = (struct bsky_str) { (char*) p,
+                                                              (char*) p + arg };
+                            } else {
+                                op.op = __bsky_firehose_action(p, arg);
+                            }
+                            p += arg;
+                            continue;
+                        }
+
+                        struct bsky_view rest = { (void*) p, (void*) end };
+                        bsky_cbor_skip(&rest);
+                        p = rest.start;
+                    }
+
+                    if ((int) op.op < 0 || op.path.start == NULL) goto invalid;
+                    if (bsky_da_push(&ev->ops, op) != bsky_ec_Ok)
+                        bsky_return_error(bsky_ec_Out_of_memory);
+                }
+                continue;
+            }
+
+            struct bsky_view rest = { (void*) p, (void*) end };
+            bsky_cbor_skip(&rest);
+            p = rest.start;
+        }
+
+        return bsky_ec_Ok;
+
+    invalid:
+        bsky_return_error(bsky_ec_Firehose_invalid);
+        return bsky_ec_Firehose_invalid;
+    }
+
+    static void __bsky_firehose_event_free(struct bsky_firehose_event *ev)
+    {
+        bsky_da_free(&ev->__buf);
+        bsky_da_free(&ev->ops);
+        free(ev);
+    }
+
+    // Only the stage thread updates its counters.
+    static void __bsky_firehose_latency(_Atomic uint64_t *sum,
+                                        _Atomic uint64_t *max, uint64_t ns)
+    {
+        atomic_fetch_add_explicit(sum, ns, memory_order_relaxed);
+        if (ns > atomic_load_explicit(max, memory_order_relaxed))
+            atomic_store_explicit(max, ns, memory_order_relaxed);
+    }
+
+    static void *__bsky_firehose_decoder(void *arg)
+    {
+        struct __bsky_firehose_shard *shard = arg;
+        struct bsky_firehose         *pipe  = shard->pipe;
+        unsigned spins = 0;
+
+        for (;;) {
+            struct bsky_firehose_event *ev = bsky_spsc_pop(&shard->decode);
+
+            if (ev == NULL) {
+                if (atomic_load(&pipe->stop) &&
+                    bsky_spsc_depth(&shard->decode) == 0) {
+                    break;
+                }
+                __bsky_spsc_backoff(&spins);
+                continue;
+            }
+
+            struct bsky_view frame = {
+                ev->__buf.data, ev->__buf.data + ev->__buf.len
+            };
+
+            int ok = bsky_firehose_decode(ev, frame) == bsky_ec_Ok;
+
+            ev->__decoded_ns = __bsky_now_ns();
+            __bsky_firehose_latency(&shard->decode_ns, &shard->decode_ns_max,
+                                    ev->__decoded_ns - ev->__pushed_ns);
+
+            if (!ok) {
+                ev->__drop = 1;
+                atomic_fetch_add_explicit(&shard->invalid, 1,
+                                          memory_order_relaxed);
+            } else if ((pipe->config.prefilter &&
+                        !bsky_prefilter_ops(pipe->config.prefilter, ev)) ||
+                       (pipe->config.filter &&
+                        !pipe->config.filter(pipe->config.user, ev))) {
+                ev->__drop = 1;
+                atomic_fetch_add_explicit(&shard->filtered, 1,
+                                          memory_order_relaxed);
+            }
+
+            // dropped events also go through handler thread, it's the
+            // only producer of free ring.
+            for (spins = 0; !bsky_spsc_push(&shard->handle, ev); )
+                __bsky_spsc_backoff(&spins);
+            spins = 0;
+        }
+
+        atomic_store(&shard->decoder_done, 1);
+        return NULL;
+    }
+
+    static void *__bsky_firehose_handler(void *arg)
+    {
+        struct __bsky_firehose_shard *shard = arg;
+        struct bsky_firehose         *pipe  = shard->pipe;
+        unsigned spins = 0;
+
+        for (;;) {
+            struct bsky_firehose_event *ev = bsky_spsc_pop(&shard->handle);
+
+            if (ev == NULL) {
+                if (atomic_load(&shard->decoder_done) &&
+                    bsky_spsc_depth(&shard->handle) == 0) {
+                    break;
+                }
+                __bsky_spsc_backoff(&spins);
+                continue;
+            }
+            spins = 0;
+
+            if (!ev->__drop) {
+                pipe->config.handler(pipe->config.user, ev);
+                bsky_default_tmp_reset();
+                __bsky_firehose_latency(&shard->handle_ns,
+                                        &shard->handle_ns_max,
+                                        __bsky_now_ns() - ev->__decoded_ns);
+                atomic_fetch_add_explicit(&shard->handled, 1,
+                                          memory_order_relaxed);
+            }
+
+            if (ev->__cursor) {
+                bsky_checkpoint_done(pipe->config.checkpoint, ev->shard,
+                                     ev->__cursor);
+            }
+
+            if (!bsky_spsc_push(&shard->free, ev))
+                __bsky_firehose_event_free(ev);
+        }
+
+        return NULL;
+    }
+
+    enum bsky_error_code bsky_firehose_start(
+                                struct bsky_firehose *pipe,
+                                const struct bsky_firehose_config *config)
+    {
+        enum bsky_error_code ec = bsky_ec_Ok;
+        size_t shards = config->shards;
+        size_t ring   = config->ring ? config->ring : BSKY_FIREHOSE_RING;
+
+        if (config->checkpoint) shards = config->checkpoint->workers;
+        if (shards == 0) {
+            long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+            shards = cpus > 1 ? cpus / 2 : 1;
+        }
+
+        memset(pipe, 0, sizeof (*pipe));
+        pipe->config = *config;
+        atomic_init(&pipe->stop, 0);
+
+        pipe->shards = calloc(shards, sizeof (*pipe->shards));
+        if (pipe->shards == NULL) bsky_return_error(bsky_ec_Out_of_memory);
+        pipe->len = shards;
+
+        for (size_t i = 0; i < shards; ++i) {
+            struct __bsky_firehose_shard *shard = &pipe->shards[i];
+
+            shard->pipe = pipe;
+            atomic_init(&shard->decoder_done, 0);
+
+            // free ring holds every event of the shard.
+            if ((ec = bsky_spsc_init(&shard->decode, ring))    != bsky_ec_Ok ||
+                (ec = bsky_spsc_init(&shard->handle, ring))    != bsky_ec_Ok ||
+                (ec = bsky_spsc_init(&shard->free, ring * 4)) != bsky_ec_Ok) {
+                goto fail;
+            }
+        }
+
+        for (size_t i = 0; i < shards; ++i) {
+            struct __bsky_firehose_shard *shard = &pipe->shards[i];
+
+            if (pthread_create(&shard->decoder, NULL,
+                               __bsky_firehose_decoder, shard) != 0) {
+                ec = bsky_ec_Firehose_thread;
+                goto fail;
+            }
+            shard->decoder_started = 1;
+
+            if (pthread_create(&shard->handler, NULL,
+                               __bsky_firehose_handler, shard) != 0) {
+                ec = bsky_ec_Firehose_thread;
+                goto fail;
+            }
+            shard->handler_started = 1;
+        }
+
+        return bsky_ec_Ok;
+
+    fail:
+        bsky_firehose_stop(pipe);
+        bsky_return_error(ec);
+        return ec;
+    }
+
+    enum bsky_error_code bsky_firehose_push(struct bsky_firehose *pipe,
+                                            struct bsky_view frame)
+    {
+        struct __bsky_firehose_shard *shard;
+        struct bsky_firehose_event   *ev;
+        struct bsky_checkpoint       *cp = pipe->config.checkpoint;
+        struct bsky_str repo;
+        int64_t seq;
+        size_t i = 0, len = (char*) frame.end - (char*) frame.start;
+        unsigned spins = 0;
+
+        if (!__bsky_firehose_repo(frame, &repo, &seq))
+            bsky_return_error(bsky_ec_Firehose_invalid);
+
+        if (repo.start != repo.end)
+            i = __bsky_hash_bytes(repo.start, repo.end - repo.start) % pipe->len;
+
+        shard = &pipe->shards[i];
+
+        if (cp == NULL || seq <= 0) {
+            seq = 0;
+        } else if (seq <= atomic_load_explicit(&cp->last,
+                                               memory_order_relaxed)) {
+            atomic_fetch_add_explicit(&shard->duplicates, 1,
+                                      memory_order_relaxed);
+            return bsky_ec_Ok;
+        }
+
+        if (pipe->config.prefilter && repo.start != repo.end &&
+            !bsky_prefilter_repo(pipe->config.prefilter, repo)) {
+            if (seq) bsky_checkpoint_skip(cp, seq);
+            atomic_fetch_add_explicit(&shard->filtered, 1,
+                                      memory_order_relaxed);
+            return bsky_ec_Ok;
+        }
+
+        ev = bsky_spsc_pop(&shard->free);
+        if (ev == NULL && (ev = calloc(1, sizeof (*ev))) == NULL)
+            bsky_return_error(bsky_ec_Out_of_memory);
+
+        ev->__buf.len = 0;
+        if (__bsky_da_append(&ev->__buf, frame.start, 1, len) != bsky_ec_Ok) {
+            __bsky_firehose_event_free(ev);
+            bsky_return_error(bsky_ec_Out_of_memory);
+        }
+
+        ev->shard       = i;
+        ev->__drop      = 0;
+        ev->__cursor    = seq;
+        ev->__pushed_ns = __bsky_now_ns();
+
+        // registered right before the event is visible to decoder.
+        if (seq) bsky_checkpoint_dispatch(cp, i, seq);
+
+        atomic_fetch_add_explicit(&shard->pushed, 1, memory_order_relaxed);
+
+        if (!bsky_spsc_push(&shard->decode, ev)) {
+            atomic_fetch_add_explicit(&shard->stalls, 1, memory_order_relaxed);
+
+            while (!bsky_spsc_push(&shard->decode, ev))
+                __bsky_spsc_backoff(&spins);
+        }
+
+        return bsky_ec_Ok;
+    }
+
+    void bsky_firehose_on_ws_message(void *pipe, enum bsky_ws_opcode opcode,
+                                     struct bsky_view message)
+    {
+        if (opcode == bsky_ws_Binary) bsky_firehose_push(pipe, message);
+    }
+
+    size_t bsky_firehose_metrics(struct bsky_firehose *pipe,
+                                 struct bsky_firehose_metrics *metrics,
+                                 size_t len)
+    {
+        for (size_t i = 0; i < len && i < pipe->len; ++i) {
+            struct __bsky_firehose_shard *shard = &pipe->shards[i];
+
+            metrics[i] = (struct bsky_firehose_metrics) {
+                .decode_depth  = bsky_spsc_depth(&shard->decode),
+                .decode_max    = atomic_load(&shard->decode.max_depth),
+                .handle_depth  = bsky_spsc_depth(&shard->handle),
+                .handle_max    = atomic_load(&shard->handle.max_depth),
+                .pushed        = atomic_load(&shard->pushed),
+                .filtered      = atomic_load(&shard->filtered),
+                .invalid       = atomic_load(&shard->invalid),
+                .handled       = atomic_load(&shard->handled),
+                .stalls        = atomic_load(&shard->stalls),
+                .duplicates    = atomic_load(&shard->duplicates),
+                .decode_ns     = atomic_load(&shard->decode_ns),
+                .decode_ns_max = atomic_load(&shard->decode_ns_max),
+                .handle_ns     = atomic_load(&shard->handle_ns),
+                .handle_ns_max = atomic_load(&shard->handle_ns_max),
+            };
+        }
+
+        return pipe->len;
+    }
+
+    void bsky_firehose_stop(struct bsky_firehose *pipe)
+    {
+        atomic_store(&pipe->stop, 1);
+
+        for (size_t i = 0; i < pipe->len; ++i) {
+            struct __bsky_firehose_shard *shard = &pipe->shards[i];
+
+            if (shard->decoder_started) pthread_join(shard->decoder, NULL);
+            else                        atomic_store(&shard->decoder_done, 1);
+
+            if (shard->handler_started) pthread_join(shard->handler, NULL);
+        }
+
+        for (size_t i = 0; i < pipe->len; ++i) {
+            struct bsky_spsc *rings[] = {
+                &pipe->shards[i].decode, &pipe->shards[i].handle,
+                &pipe->shards[i].free,
+            };
+
+            for (size_t j = 0; j < BSKY_ARRAY_LEN(rings); ++j) {
+                struct bsky_firehose_event *ev;
+
+                if (rings[j]->data == NULL) continue;
+
+                while ((ev = bsky_spsc_pop(rings[j])) != NULL)
+                    __bsky_firehose_event_free(ev);
+                bsky_spsc_free(rings[j]);
+            }
+        }
+
+        free(pipe->shards);
+        pipe->shards = NULL;
+        pipe->len    = 0;
+    }
+
+    /*
+     * BSKY CURSOR CHECKPOINT
+     */
+    struct __bsky_checkpoint_record {
+        char     magic[8];
+        uint64_t generation;
+        int64_t  cursor;
+        uint64_t check;
+    };
+
+    #define __BSKY_CHECKPOINT_MAGIC "BSKYCKP1"
+
+    static uint64_t __bsky_checkpoint_check(
+                        const struct __bsky_checkpoint_record *record)
+    {
+        return __bsky_hash_bytes(record, offsetof(struct
+                                 __bsky_checkpoint_record, check));
+    }
+
+    enum bsky_error_code bsky_checkpoint_open(struct bsky_checkpoint *cp,
+                                              const char *path,
+                                              size_t workers,
+                                              enum bsky_error_code *ec)
+    {
+        struct __bsky_checkpoint_record records[2];
+        size_t size = workers * sizeof (*cp->data);
+
+        *ec = bsky_ec_Ok;
+
+        memset(cp, 0, sizeof (*cp));
+        cp->workers = workers;
+
+        cp->fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+        if (cp->fd < 0) bsky_defer_ec(bsky_ec_Checkpoint_io);
+
+        // valid slot with the latest generation.
+        ssize_t len = pread(cp->fd, records, sizeof (records), 0);
+        for (ssize_t i = 0; i < len / (ssize_t) sizeof (*records); ++i) {
+            if (memcmp(records[i].magic, __BSKY_CHECKPOINT_MAGIC, 8) != 0 ||
+                records[i].check != __bsky_checkpoint_check(&records[i]) ||
+                records[i].generation < cp->generation) {
+                continue;
+            }
+
+            cp->generation = records[i].generation;
+            cp->resume     = records[i].cursor;
+        }
+
+        cp->saved = cp->resume;
+        atomic_init(&cp->last, cp->resume);
+
+        cp->data = aligned_alloc(_Alignof (struct __bsky_checkpoint_worker),
+                                 size ? size : sizeof (*cp->data));
+        if (cp->data == NULL) bsky_defer_ec(bsky_ec_Out_of_memory);
+
+        for (size_t i = 0; i < workers; ++i) {
+            atomic_init(&cp->data[i].started, cp->resume);
+            atomic_init(&cp->data[i].base,    cp->resume);
+            atomic_init(&cp->data[i].done,    cp->resume);
+        }
+
+    defer:
+        if (*ec != bsky_ec_Ok && cp->fd >= 0) {
+            close(cp->fd);
+            cp->fd = -1;
+        }
+        return *ec;
+    }
+
+    int bsky_checkpoint_dispatch(struct bsky_checkpoint *cp, size_t worker,
+                                 int64_t cursor)
+    {
+        struct __bsky_checkpoint_worker *w = &cp->data[worker];
+        int64_t started;
+
+        if (cursor <= atomic_load_explicit(&cp->last, memory_order_relaxed))
+            return 0;
+
+        // idle worker can't move `done', so all its events before this
+        // one are done.
+        started = atomic_load_explicit(&w->started, memory_order_relaxed);
+        if (atomic_load_explicit(&w->done, memory_order_acquire) == started)
+            atomic_store_explicit(&w->base, cursor - 1, memory_order_relaxed);
+
+        atomic_store_explicit(&w->started, cursor, memory_order_release);
+        atomic_store_explicit(&cp->last,   cursor, memory_order_release);
+
+        return 1;
+    }
+
+    void bsky_checkpoint_skip(struct bsky_checkpoint *cp, int64_t cursor)
+    {
+        if (cursor > atomic_load_explicit(&cp->last, memory_order_relaxed))
+            atomic_store_explicit(&cp->last, cursor, memory_order_release);
+    }
+
+    void bsky_checkpoint_done(struct bsky_checkpoint *cp, size_t worker,
+                              int64_t cursor)
+    {
+        atomic_store_explicit(&cp->data[worker].done, cursor,
+                              memory_order_release);
+    }
+
+    int64_t bsky_checkpoint_watermark(struct bsky_checkpoint *cp)
+    {
+        int64_t mark = atomic_load_explicit(&cp->last, memory_order_acquire);
+
+        for (size_t i = 0; i < cp->workers; ++i) {
+            struct __bsky_checkpoint_worker *w = &cp->data[i];
+            int64_t done, started, base;
+
+            done    = atomic_load_explicit(&w->done,    memory_order_acquire);
+            started = atomic_load_explicit(&w->started, memory_order_acquire);
+            if (done == started) continue;
+
+            // busy worker: events up to `done' and before the first one
+            // of current busy period are processed.
+            base = atomic_load_explicit(&w->base, memory_order_acquire);
+            if (base > done) done = base;
+            if (done < mark) mark = done;
+        }
+
+        return mark;
+    }
+
+    enum bsky_error_code bsky_checkpoint_flush(struct bsky_checkpoint *cp,
+                                               int force)
+    {
+        struct __bsky_checkpoint_record record = {
+            .magic = __BSKY_CHECKPOINT_MAGIC,
+        };
+        uint64_t now = __bsky_now_ns();
+        uint64_t interval = cp->interval_ms ? cp->interval_ms
+                                            : BSKY_CHECKPOINT_INTERVAL_MS;
+        int64_t  mark = bsky_checkpoint_watermark(cp);
+
+        if (mark <= cp->saved) return bsky_ec_Ok;
+        if (!force && now - cp->synced_ns < interval * 1000000)
+            return bsky_ec_Ok;
+
+        record.generation = cp->generation + 1;
+        record.cursor     = mark;
+        record.check      = __bsky_checkpoint_check(&record);
+
+        off_t offset = (record.generation % 2) * sizeof (record);
+        if (pwrite(cp->fd, &record, sizeof (record), offset) !=
+            sizeof (record) || fdatasync(cp->fd) != 0) {
+            bsky_return_error(bsky_ec_Checkpoint_io);
+        }
+
+        cp->generation = record.generation;
+        cp->saved      = mark;
+        cp->synced_ns  = now;
+        cp->syncs++;
+
+        return bsky_ec_Ok;
+    }
+
+    static void __bsky_checkpoint_on_timer(struct bsky_loop *loop, void *user)
+    {
+        struct bsky_checkpoint *cp = user;
+
+        // detached by `bsky_checkpoint_close'.
+        if (cp->loop != loop) return;
+
+        bsky_checkpoint_flush(cp, 0);
+        bsky_checkpoint_attach(cp, loop);
+    }
+
+    enum bsky_error_code bsky_checkpoint_attach(struct bsky_checkpoint *cp,
+                                                struct bsky_loop *loop)
+    {
+        uint64_t interval = cp->interval_ms ? cp->interval_ms
+                                            : BSKY_CHECKPOINT_INTERVAL_MS;
+        cp->loop = loop;
+
+        return bsky_loop_timer(loop, interval, __bsky_checkpoint_on_timer, cp);
+    }
+
+    struct bsky_str bsky_checkpoint_url(struct bsky_checkpoint *cp,
+                                        struct bsky_str url)
+    {
+        size_t len = url.end - url.start;
+        char  *str = bsky_tmp_alloc(len + 32);
+
+        if (str == NULL) return (struct bsky_str) { 0 };
+
+        memcpy(str, url.start, len);
+        if (cp->resume > 0) {
+            len += sprintf(str + len, "%ccursor=%lld",
+                           memchr(url.start, '?', url.end - url.start)
+                           ? '&' : '?', (long long) cp->resume);
+        }
+        str[len] = '\0';
+
+        return (struct bsky_str) { str, str + len };
+    }
+
+    enum bsky_error_code bsky_checkpoint_close(struct bsky_checkpoint *cp)
+    {
+        enum bsky_error_code ec = bsky_ec_Ok;
+
+        if (cp->fd >= 0) {
+            ec = bsky_checkpoint_flush(cp, 1);
+            close(cp->fd);
+        }
+
+        free(cp->data);
+        cp->data    = NULL;
+        cp->workers = 0;
+        cp->fd      = -1;
+        cp->loop    = NULL;
+
+        return ec;
+    }
+
+    /*
+     * BSKY PREFILTER
+     */
+    static inline uint64_t __bsky_mix64(uint64_t h)
+    {
+        h ^= h >> 31;
+        h *= 0xbf58476d1ce4e5b9ull;
+        h ^= h >> 29;
+        h *= 0x94d049bb133111ebull;
+        h ^= h >> 32;
+
+        return h;
+    }
+
+    // Hash reading 8 bytes words, for short keys like DIDs and NSIDs.
+    static uint64_t __bsky_hash64(const void *data, size_t len)
+    {
+        const unsigned char *p = data;
+        uint64_t h = 0x9e3779b97f4a7c15ull ^ len, w;
+
+        for (; len >= 8; p += 8, len -= 8) {
+            memcpy(&w, p, 8);
+            h = (h ^ w) * 0xbf58476d1ce4e5b9ull;
+            h ^= h >> 31;
+        }
+
+        w = 0;
+        memcpy(&w, p, len);
+
+        return __bsky_mix64(h ^ w);
+    }
+
+    static size_t __bsky_nsid_set_find(const struct bsky_nsid_set *set,
+                                       const char *start, size_t len)
+    {
+        uint64_t h   = __bsky_mix64(__bsky_hash64(start, len) ^ set->seed);
+        uint32_t idx = set->table[h & set->mask];
+
+        if (idx == 0) return 0;
+
+        const struct bsky_str *nsid = &set->data[idx - 1].nsid;
+        if ((size_t) (nsid->end - nsid->start) != len ||
+            memcmp(nsid->start, start, len) != 0) {
+            return 0;
+        }
+
+        return idx;
+    }
+
+    enum bsky_error_code bsky_nsid_set_build(struct bsky_nsid_set *set,
+                                             const char **nsids, size_t len)
+    {
+        size_t total = 0, off = 0, size = 4;
+
+        memset(set, 0, sizeof (*set));
+
+        for (size_t i = 0; i < len; ++i) total += strlen(nsids[i]);
+
+        set->data = calloc(len ? len : 1, sizeof (*set->data));
+        set->keys = malloc(total ? total : 1);
+        if (set->data == NULL || set->keys == NULL) goto oom;
+
+        for (size_t i = 0; i < len; ++i) {
+            size_t n = strlen(nsids[i]), j;
+            int prefix = 0;
+
+            if (strcmp(nsids[i], "*") == 0) {
+                set->any = 1;
+                continue;
+            }
+
+            if (n >= 2 && memcmp(nsids[i] + n - 2, ".*", 2) == 0) {
+                n -= 2;
+                prefix = 1;
+                set->has_prefix = 1;
+            }
+
+            // equal keys collide under every seed, merge them.
+            for (j = 0; j < set->len; ++j) {
+                struct bsky_str nsid = set->data[j].nsid;
+
+                if ((size_t) (nsid.end - nsid.start) == n &&
+                    memcmp(nsid.start, nsids[i], n) == 0) {
+                    break;
+                }
+            }
+
+            if (j == set->len) {
+                memcpy(set->keys + off, nsids[i], n);
+                set->data[set->len++].nsid = (struct bsky_str) {
+                    set->keys + off, set->keys + off + n
+                };
+                off += n;
+            }
+
+            if (prefix) set->data[j].prefix = 1;
+            else        set->data[j].exact  = 1;
+        }
+
+        // find seed without collisions, grow table if it takes long.
+        while (size < set->len * 2) size <<= 1;
+
+        for (;;) {
+            if (size > BSKY_NSID_SET_MAX_SLOTS) {
+                bsky_nsid_set_free(set);
+                bsky_return_error(bsky_ec_Prefilter_build);
+                return bsky_ec_Prefilter_build;
+            }
+
+            free(set->table);
+            set->table = calloc(size, sizeof (*set->table));
+            if (set->table == NULL) goto oom;
+
+            set->mask = size - 1;
+
+            for (uint64_t seed = 1; seed <= 256; ++seed) {
+                size_t i;
+
+                memset(set->table, 0, size * sizeof (*set->table));
+                set->seed = seed;
+
+                for (i = 0; i < set->len; ++i) {
+                    struct bsky_str nsid = set->data[i].nsid;
+                    uint64_t h = __bsky_mix64(__bsky_hash64(nsid.start,
+                                              nsid.end - nsid.start) ^ seed);
+
+                    if (set->table[h & set->mask] != 0) break;
+                    set->table[h & set->mask] = i + 1;
+                }
+
+                if (i == set->len) return bsky_ec_Ok;
+            }
+
+            size <<= 1;
+        }
+
+    oom:
+        bsky_nsid_set_free(set);
+        bsky_return_error(bsky_ec_Out_of_memory);
+        return bsky_ec_Out_of_memory;
+    }
+
+    int bsky_nsid_set_has(const struct bsky_nsid_set *set,
+                          struct bsky_str collection)
+    {
+        const char *slash = memchr(collection.start, '/',
+                                   collection.end - collection.start);
+        size_t len = (slash ? slash : collection.end) - collection.start;
+        size_t idx;
+
+        if (set->any) return 1;
+
+        idx = __bsky_nsid_set_find(set, collection.start, len);
+        if (idx && set->data[idx - 1].exact) return 1;
+
+        if (!set->has_prefix) return 0;
+
+        // the longest prefix goes first: `app.bsky.feed' of `...feed.post'.
+        while (len > 0) {
+            while (len > 0 && collection.start[--len] != '.');
+
+            if (len == 0) break;
+
+            idx = __bsky_nsid_set_find(set, collection.start, len);
+            if (idx && set->data[idx - 1].prefix) return 1;
+        }
+
+        return 0;
+    }
+
+    void bsky_nsid_set_free(struct bsky_nsid_set *set)
+    {
+        free(set->data);
+        free(set->table);
+        free(set->keys);
+        memset(set, 0, sizeof (*set));
+    }
+
+    // Bit of every word of the block, salts are from Parquet split block
+    // bloom filter.
+    static const uint64_t __bsky_bloom_salt[8] = {
+        0x47b6137bu, 0x44974d91u, 0x8824ad5bu, 0xa2b7289du,
+        0x705495c7u, 0x2df1424bu, 0x9efc4947u, 0x5c6bfb31u,
+    };
+
+    enum bsky_error_code bsky_did_filter_init(struct bsky_did_filter *filter,
+                                              size_t expected)
+    {
+        size_t blocks = 1;
+
+        memset(filter, 0, sizeof (*filter));
+
+        // about 16 bits per DID.
+        while (blocks * 512 < expected * 16) blocks <<= 1;
+
+        filter->blocks = aligned_alloc(64, blocks * 64);
+        if (filter->blocks == NULL) bsky_return_error(bsky_ec_Out_of_memory);
+
+        memset(filter->blocks, 0, blocks * 64);
+        filter->mask = blocks - 1;
+
+        return bsky_ec_Ok;
+    }
+
+    enum bsky_error_code bsky_did_filter_add(struct bsky_did_filter *filter,
+                                             struct bsky_str did)
+    {
+        enum bsky_error_code ec;
+        uint64_t  h = __bsky_hash64(did.start, did.end - did.start);
+        uint64_t *block = filter->blocks + (h & filter->mask) * 8;
+        uint32_t  key = h >> 32;
+
+        if ((ec = bsky_str_map_set(&filter->exact, did, 0)) != bsky_ec_Ok)
+            return ec;
+
+        for (int i = 0; i < 8; ++i)
+            block[i] |= 1ull << ((uint32_t) (key * __bsky_bloom_salt[i]) >> 26);
+
+        filter->len = filter->exact.len;
+
+        return bsky_ec_Ok;
+    }
+
+    int bsky_did_filter_has(struct bsky_did_filter *filter, struct bsky_str did)
+    {
+        uint64_t  h = __bsky_hash64(did.start, did.end - did.start);
+        uint64_t *block = filter->blocks + (h & filter->mask) * 8;
+        uint32_t  key = h >> 32;
+        uint64_t  miss = 0;
+
+        // no early exit, so the loop is branch free.
+        for (int i = 0; i < 8; ++i) {
+            miss |= ~block[i] &
+                    1ull << ((uint32_t) (key * __bsky_bloom_salt[i]) >> 26);
+        }
+        if (miss) return 0;
+
+        filter->bloom_hits++;
+        if (bsky_str_map_get(&filter->exact, did)) return 1;
+
+        filter->false_positives++;
+        return 0;
+    }
+
+    void bsky_did_filter_free(struct bsky_did_filter *filter)
+    {
+        free(filter->blocks);
+        bsky_str_map_free(&filter->exact);
+        memset(filter, 0, sizeof (*filter));
+    }
+
+    int bsky_prefilter_repo(const struct bsky_prefilter *pf, struct bsky_str did)
+    {
+        return pf->dids == NULL || bsky_did_filter_has(pf->dids, did);
+    }
+
+    int bsky_prefilter_ops(const struct bsky_prefilter *pf,
+                           const struct bsky_firehose_event *ev)
+    {
+        if (pf->collections == NULL || ev->ops.len == 0) return 1;
+
+        for (size_t i = 0; i < ev->ops.len; ++i) {
+            if (bsky_nsid_set_has(pf->collections, ev->ops.data[i].path))
+                return 1;
+        }
+
+        return 0;
+    }
+
+    /*
+     * BSKY JETSTREAM
+     */
+    static const char *__bsky_json_ws(const char *p, const char *end)
+    {
+        while (p < end && (*p == ' ' || *p == '\n' || *p == '\r' || *p == '\t'))
+            p++;
+
+        return p;
+    }
+
+    // Pointer after closing quote of string at `p', NULL if unterminated.
+    static const char *__bsky_json_skip_str(const char *p, const char *end)
+    {
+        const char *start = ++p;
+
+        while (p < end) {
+            const char *q = memchr(p, '"', end - p);
+            size_t slashes = 0;
+
+            if (q == NULL) return NULL;
+
+            while (q - slashes > start && q[-1 - (ptrdiff_t) slashes] == '\\')
+                slashes++;
+            if (slashes % 2 == 0) return q + 1;
+
+            p = q + 1;
+        }
+
+        return NULL;
+    }
+
+    enum bsky_error_code bsky_json_cursor_object(struct bsky_json_cursor *c,
+                                                 enum bsky_error_code *ec)
+    {
+        c->p = __bsky_json_ws(c->p, c->end);
+
+        if (c->p == c->end || *c->p != '{') {
+            *ec = bsky_ec_Json_expect_OCB;
+            return *ec;
+        }
+
+        c->p++;
+        c->first = 1;
+
+        *ec = bsky_ec_Ok;
+        return *ec;
+    }
+
+    int bsky_json_cursor_field(struct bsky_json_cursor *c, struct bsky_str *key,
+                               enum bsky_error_code *ec)
+    {
+        const char *p = __bsky_json_ws(c->p, c->end), *q;
+
+        *ec = bsky_ec_Ok;
+
+        if (p == c->end) goto eof;
+
+        if (*p == '}') {
+            c->p     = p + 1;
+            c->first = 0;
+            return 0;
+        }
+
+        if (!c->first) {
+            if (*p != ',') bsky_defer_ec(bsky_ec_Json_expect_CCB);
+            p = __bsky_json_ws(p + 1, c->end);
+        }
+        c->first = 0;
+
+        if (p == c->end || *p != '"') bsky_defer_ec(bsky_ec_Json_expect_OQ);
+
+        if ((q = __bsky_json_skip_str(p, c->end)) == NULL)
+            bsky_defer_ec(bsky_ec_Json_expect_CQ);
+
+        *key = (struct bsky_str) { (char*) p + 1, (char*) q - 1 };
+
+        q = __bsky_json_ws(q, c->end);
+        if (q == c->end || *q != ':') bsky_defer_ec(bsky_ec_Json_expect_Colon);
+
+        c->p = __bsky_json_ws(q + 1, c->end);
+        return 1;
+
+    eof:
+        *ec = bsky_ec_Json_expect_CCB;
+    defer:
+        return 0;
+    }
+
+    enum bsky_error_code bsky_json_cursor_array(struct bsky_json_cursor *c,
+                                                enum bsky_error_code *ec)
+    {
+        c->p = __bsky_json_ws(c->p, c->end);
+
+        if (c->p == c->end || *c->p != '[') {
+            *ec = bsky_ec_Json_expect_OSB;
+            return *ec;
+        }
+
+        c->p++;
+        c->first = 1;
+
+        *ec = bsky_ec_Ok;
+        return *ec;
+    }
+
+    int bsky_json_cursor_elem(struct bsky_json_cursor *c,
+                              enum bsky_error_code *ec)
+    {
+        const char *p = __bsky_json_ws(c->p, c->end);
+
+        *ec = bsky_ec_Ok;
+
+        if (p == c->end) {
+            *ec = bsky_ec_Json_expect_CSB;
+            return 0;
+        }
+
+        if (*p == ']') {
+            c->p     = p + 1;
+            c->first = 0;
+            return 0;
+        }
+
+        if (!c->first) {
+            if (*p != ',') {
+                *ec = bsky_ec_Json_expect_CSB;
+                return 0;
+            }
+            p = __bsky_json_ws(p + 1, c->end);
+        }
+        c->first = 0;
+        c->p     = p;
+
+        return 1;
+    }
+
+    enum bsky_error_code bsky_json_cursor_str(struct bsky_json_cursor *c,
+                                              struct bsky_str *str,
+                                              enum bsky_error_code *ec)
+    {
+        const char *p = __bsky_json_ws(c->p, c->end), *q;
+
+        if (p == c->end || *p != '"') {
+            *ec = bsky_ec_Json_expect_OQ;
+            return *ec;
+        }
+        if ((q = __bsky_json_skip_str(p, c->end)) == NULL) {
+            *ec = bsky_ec_Json_expect_CQ;
+            return *ec;
+        }
+
+        *str = (struct bsky_str) { (char*) p + 1, (char*) q - 1 };
+        c->p = q;
+
+        *ec = bsky_ec_Ok;
+        return *ec;
+    }
+
+    int64_t bsky_json_cursor_int(struct bsky_json_cursor *c,
+                                 enum bsky_error_code *ec)
+    {
+        const char *p = __bsky_json_ws(c->p, c->end);
+        int64_t value = 0;
+        int     neg = p < c->end && *p == '-';
+
+        p += neg;
+        if (p == c->end || *p < '0' || *p > '9') {
+            *ec = bsky_ec_Json_expect_Number;
+            return 0;
+        }
+
+        while (p < c->end && *p >= '0' && *p <= '9')
+            value = value * 10 + (*p++ - '0');
+
+        c->p = p;
+        *ec  = bsky_ec_Ok;
+
+        return neg ? -value : value;
+    }
+
+    struct bsky_str bsky_json_cursor_skip(struct bsky_json_cursor *c,
+                                          enum bsky_error_code *ec)
+    {
+        const char *start = __bsky_json_ws(c->p, c->end), *p = start;
+        int depth = 0;
+
+        *ec = bsky_ec_Ok;
+
+        do {
+            if (p >= c->end) goto eof;
+
+            switch (*p) {
+            case '"':
+                if ((p = __bsky_json_skip_str(p, c->end)) == NULL) goto eof;
+                break;
+            case '{': case '[':
+                depth++;
+                p++;
+                break;
+            case '}': case ']':
+                if (--depth < 0) goto eof;
+                p++;
+                break;
+            default:
+                if (depth > 0) {
+                    p++;
+                    break;
+                }
+
+                // scalar: up to delimiter.
+                while (p < c->end && *p != ',' && *p != '}' && *p != ']' &&
+                       *p != ' ' && *p != '\n' && *p != '\r' && *p != '\t') {
+                    p++;
+                }
+            }
+        } while (depth > 0);
+
+        c->p = p;
+        return (struct bsky_str) { (char*) start, (char*) p };
+
+    eof:
+        *ec = bsky_ec_Json_invalid_variant;
+        return (struct bsky_str) { 0 };
+    }
+
+    int bsky_json_key_is(struct bsky_str key, const char *name)
+    {
+        size_t len = strlen(name);
+
+        return (size_t) (key.end - key.start) == len &&
+               memcmp(key.start, name, len) == 0;
+    }
+
+    static enum bsky_error_code __bsky_jetstream_commit(
+                                    struct bsky_json_cursor *c,
+                                    struct bsky_jetstream_commit *commit)
+    {
+        enum bsky_error_code ec;
+        struct bsky_str key, text;
+
+        commit->op = -1;
+
+        if (bsky_json_cursor_object(c, &ec) != bsky_ec_Ok) return ec;
+
+        while (bsky_json_cursor_field(c, &key, &ec)) {
+            struct bsky_str *field = NULL;
+
+            if (bsky_json_key_is(key, "record")) {
+                commit->record = bsky_json_cursor_skip(c, &ec);
+                if (ec != bsky_ec_Ok) return ec;
+                continue;
+            }
+
+            if (bsky_json_key_is(key, "collection"))
+                field = &commit->collection;
+            else if (bsky_json_key_is(key, "rkey"))
+                field = &commit->rkey;
+            else if (bsky_json_key_is(key, "rev"))
+                field = &commit->rev;
+            else if (bsky_json_key_is(key, "cid"))
+                field = &commit->cid;
+            else if (bsky_json_key_is(key, "operation"))
+                field = &text;
+
+            if (field == NULL) {
+                bsky_json_cursor_skip(c, &ec);
+            } else if (bsky_json_cursor_str(c, field, &ec) == bsky_ec_Ok &&
+                       field == &text) {
+                commit->op = __bsky_firehose_action((void*) text.start,
+                                                    text.end - text.start);
+            }
+            if (ec != bsky_ec_Ok) return ec;
+        }
+
+        return ec;
+    }
+
+    static enum bsky_error_code __bsky_jetstream_identity(
+                                    struct bsky_json_cursor *c,
+                                    struct bsky_jetstream_identity *identity,
+                                    struct bsky_jetstream_account  *account)
+    {
+        enum bsky_error_code ec;
+        struct bsky_str key;
+
+        if (bsky_json_cursor_object(c, &ec) != bsky_ec_Ok) return ec;
+
+        while (bsky_json_cursor_field(c, &key, &ec)) {
+            if (bsky_json_key_is(key, "seq")) {
+                int64_t seq = bsky_json_cursor_int(c, &ec);
+
+                if (identity) identity->seq = seq;
+                else          account->seq  = seq;
+            } else if (identity && bsky_json_key_is(key, "handle")) {
+                bsky_json_cursor_str(c, &identity->handle, &ec);
+            } else if (account && bsky_json_key_is(key, "status")) {
+                bsky_json_cursor_str(c, &account->status, &ec);
+            } else if (account && bsky_json_key_is(key, "active")) {
+                struct bsky_str value = bsky_json_cursor_skip(c, &ec);
+
+                account->active = bsky_json_key_is(value, "true");
+            } else {
+                bsky_json_cursor_skip(c, &ec);
+            }
+            if (ec != bsky_ec_Ok) return ec;
+        }
+
+        return ec;
+    }
+
+    enum bsky_error_code bsky_jetstream_feed(struct bsky_jetstream *js,
+                                             struct bsky_view message,
+                                             int compressed)
+    {
+        enum bsky_error_code ec = bsky_ec_Ok;
+        struct bsky_json_cursor c = { message.start, message.end };
+        struct bsky_json_cursor sub = { 0 };
+        struct bsky_str key, did = { 0 }, kind = { 0 };
+        int64_t time_us = 0;
+        int     dropped = 0;
+
+        if (compressed) {
+            js->buf.len = 0;
+            if (js->decompress == NULL ||
+                !js->decompress(js->decompress_user, message, &js->buf)) {
+                js->invalid++;
+                bsky_return_error(bsky_ec_Jetstream_decompress);
+            }
+            c = (struct bsky_json_cursor) {
+                js->buf.data, js->buf.data + js->buf.len
+            };
+        }
+
+        if (bsky_json_cursor_object(&c, &ec) != bsky_ec_Ok) goto invalid;
+
+        while (bsky_json_cursor_field(&c, &key, &ec)) {
+            if (bsky_json_key_is(key, "did")) {
+                if (bsky_json_cursor_str(&c, &did, &ec) != bsky_ec_Ok)
+                    goto invalid;
+
+                // dropped event is checkpointed too, `time_us' may follow.
+                if (js->prefilter && !bsky_prefilter_repo(js->prefilter, did)) {
+                    dropped = 1;
+                    if (time_us > 0) goto filtered;
+                }
+            } else if (bsky_json_key_is(key, "time_us")) {
+                time_us = bsky_json_cursor_int(&c, &ec);
+                if (ec != bsky_ec_Ok) goto invalid;
+
+                if (dropped) goto filtered;
+                if (js->checkpoint && time_us <= atomic_load_explicit(
+                        &js->checkpoint->last, memory_order_relaxed)) {
+                    goto filtered;
+                }
+            } else if (bsky_json_key_is(key, "kind")) {
+                if (bsky_json_cursor_str(&c, &kind, &ec) != bsky_ec_Ok)
+                    goto invalid;
+            } else if (bsky_json_key_is(key, "commit")   ||
+                       bsky_json_key_is(key, "identity") ||
+                       bsky_json_key_is(key, "account")) {
+                // read after `kind' is known, fields can be in any order.
+                struct bsky_str value = bsky_json_cursor_skip(&c, &ec);
+
+                sub = (struct bsky_json_cursor) { value.start, value.end };
+            } else {
+                bsky_json_cursor_skip(&c, &ec);
+            }
+            if (ec != bsky_ec_Ok) goto invalid;
+        }
+        if (ec != bsky_ec_Ok) goto invalid;
+        if (dropped) goto filtered;
+
+        if (js->checkpoint && time_us > 0)
+            bsky_checkpoint_dispatch(js->checkpoint, 0, time_us);
+
+        if (bsky_json_key_is(kind, "commit") && sub.p) {
+            struct bsky_jetstream_commit commit = {
+                .did = did, .time_us = time_us
+            };
+
+            if (__bsky_jetstream_commit(&sub, &commit) != bsky_ec_Ok ||
+                (int) commit.op < 0) {
+                goto invalid;
+            }
+
+            if (js->prefilter && js->prefilter->collections &&
+                !bsky_nsid_set_has(js->prefilter->collections,
+                                   commit.collection)) {
+                goto done_filtered;
+            }
+
+            if (js->on_commit) js->on_commit(js->user, &commit);
+        } else if (bsky_json_key_is(kind, "identity") && sub.p) {
+            struct bsky_jetstream_identity identity = {
+                .did = did, .time_us = time_us
+            };
+
+            if (__bsky_jetstream_identity(&sub, &identity, NULL) != bsky_ec_Ok)
+                goto invalid;
+            if (js->on_identity) js->on_identity(js->user, &identity);
+        } else if (bsky_json_key_is(kind, "account") && sub.p) {
+            struct bsky_jetstream_account account = {
+                .did = did, .time_us = time_us
+            };
+
+            if (__bsky_jetstream_identity(&sub, NULL, &account) != bsky_ec_Ok)
+                goto invalid;
+            if (js->on_account) js->on_account(js->user, &account);
+        }
+
+        js->events++;
+        if (js->checkpoint && time_us > 0)
+            bsky_checkpoint_done(js->checkpoint, 0, time_us);
+
+        return bsky_ec_Ok;
+
+    done_filtered:
+        if (js->checkpoint && time_us > 0)
+            bsky_checkpoint_done(js->checkpoint, 0, time_us);
+        js->filtered++;
+        return bsky_ec_Ok;
+
+    filtered:
+        if (js->checkpoint && time_us > 0)
+            bsky_checkpoint_skip(js->checkpoint, time_us);
+        js->filtered++;
+        return bsky_ec_Ok;
+
+    invalid:
+        js->invalid++;
+        if (js->checkpoint && time_us > 0)
+            bsky_checkpoint_skip(js->checkpoint, time_us);
+        bsky_return_error(bsky_ec_Jetstream_invalid);
+        return bsky_ec_Jetstream_invalid;
+    }
+
+    void bsky_jetstream_on_ws_message(void *js, enum bsky_ws_opcode opcode,
+                                      struct bsky_view message)
+    {
+        if (opcode == bsky_ws_Text || opcode == bsky_ws_Binary)
+            bsky_jetstream_feed(js, message, opcode == bsky_ws_Binary);
+    }
+
+    #ifdef BSKY_API_ZSTD
+        #include <zstd.h>
+
+        struct __bsky_jetstream_zstd { ZSTD_DCtx *dctx; ZSTD_DDict *ddict; };
+
+        static int __bsky_jetstream_zstd_decompress(void *user,
+                                                    struct bsky_view in,
+                                                    struct bsky_str_builder *out)
+        {
+            struct __bsky_jetstream_zstd *z = user;
+            size_t len  = (char*) in.end - (char*) in.start;
+            size_t size = ZSTD_getFrameContentSize(in.start, len);
+
+            if (size == ZSTD_CONTENTSIZE_ERROR) return 0;
+            if (size == ZSTD_CONTENTSIZE_UNKNOWN) size = len * 8;
+
+            // grow buffer while frame without content size doesn't fit.
+            for (;;) {
+                if (out->cap < size + 1) {
+                    char *data = realloc(out->data, size + 1);
+                    if (data == NULL) return 0;
+
+                    out->data = data;
+                    out->cap  = size + 1;
+                }
+
+                size_t n = ZSTD_decompress_usingDDict(z->dctx, out->data,
+                               out->cap - 1, in.start, len, z->ddict);
+
+                if (!ZSTD_isError(n)) {
+                    out->len = n;
+                    out->data[n] = '\0';
+                    return 1;
+                }
+                if (ZSTD_getErrorCode(n) != ZSTD_error_dstSize_tooSmall)
+                    return 0;
+
+                size = out->cap * 2;
+            }
+        }
+
+        enum bsky_error_code bsky_jetstream_use_zstd(struct bsky_jetstream *js,
+                                                     struct bsky_view dict)
+        {
+            struct __bsky_jetstream_zstd *z = calloc(1, sizeof (*z));
+
+            if (z == NULL) bsky_return_error(bsky_ec_Out_of_memory);
+
+            z->dctx  = ZSTD_createDCtx();
+            z->ddict = ZSTD_createDDict(dict.start,
+                                        (char*) dict.end - (char*) dict.start);
+
+            if (z->dctx == NULL || z->ddict == NULL) {
+                ZSTD_freeDCtx(z->dctx);
+                ZSTD_freeDDict(z->ddict);
+                free(z);
+                bsky_return_error(bsky_ec_Jetstream_decompress);
+            }
+
+            js->decompress      = __bsky_jetstream_zstd_decompress;
+            js->decompress_user = z;
+
+            return bsky_ec_Ok;
+        }
+    #endif
+
+    void bsky_jetstream_free(struct bsky_jetstream *js)
+    {
+    #ifdef BSKY_API_ZSTD
+        if (js->decompress == __bsky_jetstream_zstd_decompress) {
+            struct __bsky_jetstream_zstd *z = js->decompress_user;
+
+            ZSTD_freeDCtx(z->dctx);
+            ZSTD_freeDDict(z->ddict);
+            free(z);
+        }
+    #endif
+
+        bsky_da_free(&js->buf);
+        js->decompress = NULL;
+    }
+
+    /*
+     * BSKY SIGNATURE VERIFICATION
+     */
+
+    static const char __bsky_base58[] =
+        "123456789ABCDEFGHJKLMNPQRSTUVWXYZabcdefghijkmnopqrstuvwxyz";
+
+    // Decode base58btc into `out'. Return number of bytes or 0.
+    static size_t __bsky_base58_decode(const char *s, size_t len,
+                                       unsigned char *out, size_t cap)
+    {
+        size_t n = 0, zeros = 0;
+
+        while (zeros < len && s[zeros] == '1') zeros++;
+
+        // big number in `out' is little endian while decoding.
+        for (size_t i = zeros; i < len; ++i) {
+            const char *d = memchr(__bsky_base58, s[i], 58);
+            unsigned carry;
+
+            if (d == NULL || s[i] == '\0') return 0;
+            carry = d - __bsky_base58;
+
+            for (size_t j = 0; j < n; ++j) {
+                carry += out[j] * 58u;
+                out[j] = carry & 0xff;
+                carry >>= 8;
+            }
+            for (; carry; carry >>= 8) {
+                if (n == cap) return 0;
+                out[n++] = carry & 0xff;
+            }
+        }
+
+        if (n + zeros > cap) return 0;
+
+        for (size_t i = 0; i < n / 2; ++i) {
+            unsigned char t = out[i];
+            out[i] = out[n - 1 - i];
+            out[n - 1 - i] = t;
+        }
+        memmove(out + zeros, out, n);
+        memset(out, 0, zeros);
+
+        return n + zeros;
+    }
+
+    enum bsky_error_code bsky_pubkey_of_did_key(struct bsky_str text,
+                                                struct bsky_pubkey *key)
+    {
+        unsigned char buf[48];
+        size_t   len = bsky_str_len(text), n;
+        uint64_t codec;
+        int      m;
+
+        if (len > 8 && memcmp(text.start, "did:key:", 8) == 0) {
+            text.start += 8;
+            len        -= 8;
+        }
+
+        if (len < 2 || text.start[0] != 'z' ||
+            (n = __bsky_base58_decode(text.start + 1, len - 1,
+                                      buf, sizeof (buf))) == 0 ||
+            (m = __bsky_uvarint(buf, n, &codec)) == 0 ||
+            n - m != sizeof (key->point)) {
+            bsky_return_error(bsky_ec_Verify_invalid_key);
+            return bsky_ec_Verify_invalid_key;
+        }
+
+        if (codec == 0xe7) {
+            key->type = bsky_key_Secp256k1;
+        } else if (codec == 0x1200) {
+            key->type = bsky_key_P256;
+        } else {
+            bsky_return_error(bsky_ec_Verify_invalid_key);
+            return bsky_ec_Verify_invalid_key;
+        }
+
+        if (buf[m] != 2 && buf[m] != 3) {
+            bsky_return_error(bsky_ec_Verify_invalid_key);
+            return bsky_ec_Verify_invalid_key;
+        }
+        memcpy(key->point, buf + m, sizeof (key->point));
+
+        return bsky_ec_Ok;
+    }
+
+    // n / 2 of curve order, signatures with greater `s' are malleable.
+    static const unsigned char __bsky_half_order[2][32] = {
+        [bsky_key_Secp256k1] = {
+            0x7f, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+            0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+            0x5d, 0x57, 0x6e, 0x73, 0x57, 0xa4, 0x50, 0x1d,
+            0xdf, 0xe9, 0x2f, 0x46, 0x68, 0x1b, 0x20, 0xa0,
+        },
+        [bsky_key_P256] = {
+            0x7f, 0xff, 0xff, 0xff, 0x80, 0x00, 0x00, 0x00,
+            0x7f, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+            0xde, 0x73, 0x7d, 0x56, 0xd3, 0x8b, 0xcf, 0x42,
+            0x79, 0xdc, 0xe5, 0x61, 0x7e, 0x31, 0x92, 0xa8,
+        },
+    };
+
+    #ifdef BSKY_API_OPENSSL
+        #include <openssl/evp.h>
+        #include <openssl/core_names.h>
+        #include <openssl/params.h>
+
+        static void *__bsky_openssl_key_new(void *user,
+                                            const struct bsky_pubkey *pk)
+        {
+            char *group = pk->type == bsky_key_P256 ? "prime256v1"
+                                                    : "secp256k1";
+            OSSL_PARAM params[] = {
+                OSSL_PARAM_construct_utf8_string(OSSL_PKEY_PARAM_GROUP_NAME,
+                                                 group, 0),
+                OSSL_PARAM_construct_octet_string(OSSL_PKEY_PARAM_PUB_KEY,
+                                                  (void*) pk->point,
+                                                  sizeof (pk->point)),
+                OSSL_PARAM_construct_end(),
+            };
+            EVP_PKEY_CTX *ctx = EVP_PKEY_CTX_new_from_name(NULL, "EC", NULL);
+            EVP_PKEY     *key = NULL;
+
+            (void) user;
+            if (ctx && EVP_PKEY_fromdata_init(ctx) > 0)
+                EVP_PKEY_fromdata(ctx, &key, EVP_PKEY_PUBLIC_KEY, params);
+            EVP_PKEY_CTX_free(ctx);
+
+            return key;
+        }
+
+        static void __bsky_openssl_key_free(void *user, void *key)
+        {
+            (void) user;
+            EVP_PKEY_free(key);
+        }
+
+        // DER INTEGER of 32 byte big endian number.
+        static size_t __bsky_der_int(unsigned char *out,
+                                     const unsigned char *v)
+        {
+            size_t i = 0, n;
+
+            while (i < 31 && v[i] == 0) i++;
+            n = 32 - i;
+
+            out[0] = 0x02;
+            out[1] = n + (v[i] >> 7);
+            out[2] = 0;
+            memcpy(out + 2 + (v[i] >> 7), v + i, n);
+
+            return 2 + out[1];
+        }
+
+        static int __bsky_openssl_verify(void *user, void *key,
+                                         const unsigned char digest[32],
+                                         const unsigned char sig[64])
+        {
+            unsigned char der[72];
+            size_t len = 2;
+            int    ok  = 0;
+
+            (void) user;
+
+            len += __bsky_der_int(der + len, sig);
+            len += __bsky_der_int(der + len, sig + 32);
+            der[0] = 0x30;
+            der[1] = len - 2;
+
+            EVP_PKEY_CTX *ctx = EVP_PKEY_CTX_new(key, NULL);
+            if (ctx && EVP_PKEY_verify_init(ctx) > 0)
+                ok = EVP_PKEY_verify(ctx, der, len, digest, 32) == 1;
+            EVP_PKEY_CTX_free(ctx);
+
+            return ok;
+        }
+
+        struct bsky_crypto bsky_crypto_openssl(void)
+        {
+            return (struct bsky_crypto) {
+                .key_new  = __bsky_openssl_key_new,
+                .key_free = __bsky_openssl_key_free,
+                .verify   = __bsky_openssl_verify,
+            };
+        }
+    #endif
+
+    // Re-encode commit without `sig' into `buf' and verify it.
+    static enum bsky_verify_status
+    __bsky_verify_commit(struct bsky_verifier *v,
+                         const struct __bsky_verify_job *job,
+                         struct bsky_str_builder *buf)
+    {
+        struct bsky_view check = job->commit;
+        const unsigned char *p = job->commit.start, *sig = NULL;
+        unsigned char digest[32];
+        uint64_t n, len;
+        int did_ok = 0;
+
+        if (job->key == NULL) return bsky_verify_No_key;
+
+        if (bsky_cbor_skip(&check) != bsky_ec_Ok ||
+            check.start != job->commit.end ||
+            __bsky_cbor_head(&p, &n) != 5 || n == 0 || n > 24) {
+            return bsky_verify_Invalid;
+        }
+
+        buf->len = 0;
+        __bsky_da_append(buf, &(char) { 0xa0 | (n - 1) }, 1, 1);
+
+        for (uint64_t i = 0; i < n; ++i) {
+            const unsigned char *pair = p, *key;
+            struct bsky_view rest;
+            uint64_t arg;
+
+            if (__bsky_cbor_head(&p, &len) != 3) return bsky_verify_Invalid;
+            key = p;
+            p  += len;
+
+            rest = (struct bsky_view) { (void*) p, job->commit.end };
+            bsky_cbor_skip(&rest);
+
+            if (__bsky_firehose_key(key, len, "sig")) {
+                if (__bsky_cbor_head(&p, &arg) != 2 || arg != 64)
+                    return bsky_verify_Invalid;
+                sig = p;
+            } else {
+                if (__bsky_firehose_key(key, len, "did")) {
+                    if (__bsky_cbor_head(&p, &arg) != 3) {
+                        return bsky_verify_Invalid;
+                    }
+                    did_ok = arg == bsky_str_len(job->did) &&
+                             memcmp(p, job->did.start, arg) == 0;
+                }
+                if (__bsky_da_append(buf, pair, 1,
+                                     (unsigned char*) rest.start - pair)
+                    != bsky_ec_Ok) {
+                    return bsky_verify_Invalid;
+                }
+            }
+            p = rest.start;
+        }
+
+        if (sig == NULL || !did_ok) return bsky_verify_Invalid;
+
+        if (memcmp(sig + 32, __bsky_half_order[job->key->pubkey.type],
+                   32) > 0) {
+            return bsky_verify_Bad_signature;
+        }
+
+        bsky_sha256(buf->data, buf->len, digest);
+
+        return v->crypto.verify(v->crypto.user, job->key->key, digest, sig)
+               ? bsky_verify_Ok : bsky_verify_Bad_signature;
+    }
+
+    static void *__bsky_verify_worker(void *arg)
+    {
+        struct bsky_verifier     *v = arg;
+        struct __bsky_verify_job *jobs;
+        struct bsky_str_builder   buf = { 0 };
+
+        if ((jobs = malloc(v->batch * sizeof (*jobs))) == NULL) {
+            bsky_log_error(bsky_ec_Out_of_memory);
+            return NULL;
+        }
+
+        pthread_mutex_lock(&v->lock);
+        for (;;) {
+            size_t n;
+
+            while (v->len == 0 && !v->stop)
+                pthread_cond_wait(&v->has_jobs, &v->lock);
+            if (v->len == 0) break;
+
+            n = v->len < v->batch ? v->len : v->batch;
+            for (size_t i = 0; i < n; ++i)
+                jobs[i] = v->jobs[(v->head + i) % v->queue];
+
+            v->head  = (v->head + n) % v->queue;
+            v->len  -= n;
+            v->busy += n;
+            pthread_cond_broadcast(&v->has_space);
+            pthread_mutex_unlock(&v->lock);
+
+            for (size_t i = 0; i < n; ++i) {
+                enum bsky_verify_status status =
+                    __bsky_verify_commit(v, &jobs[i], &buf);
+
+                atomic_fetch_add_explicit(status == bsky_verify_Ok
+                                          ? &v->verified : &v->failed,
+                                          1, memory_order_relaxed);
+                if (v->on_result) v->on_result(v->user, jobs[i].user, status);
+
+                free(jobs[i].did.start);
+            }
+
+            pthread_mutex_lock(&v->lock);
+            v->busy -= n;
+            if (v->len == 0 && v->busy == 0)
+                pthread_cond_broadcast(&v->idle);
+        }
+        pthread_mutex_unlock(&v->lock);
+
+        bsky_da_free(&buf);
+        free(jobs);
+
+        return NULL;
+    }
+
+    enum bsky_error_code bsky_verifier_start(struct bsky_verifier *v)
+    {
+        enum bsky_error_code ec = bsky_ec_Ok;
+
+        if (v->workers == 0) {
+            long cpus  = sysconf(_SC_NPROCESSORS_ONLN);
+            v->workers = cpus > 0 ? cpus : 1;
+        }
+        if (v->batch == 0) v->batch = BSKY_VERIFY_BATCH;
+        if (v->queue == 0) v->queue = BSKY_VERIFY_QUEUE;
+
+        atomic_init(&v->verified, 0);
+        atomic_init(&v->failed, 0);
+
+        pthread_mutex_init(&v->lock, NULL);
+        pthread_cond_init(&v->has_jobs, NULL);
+        pthread_cond_init(&v->has_space, NULL);
+        pthread_cond_init(&v->idle, NULL);
+
+        v->head = v->len = v->busy = 0;
+        v->stop = 0;
+        v->threads  = (__typeof__ (v->threads)) { 0 };
+        v->keys     = (struct bsky_str_map) { 0 };
+        v->key_list = (__typeof__ (v->key_list)) { 0 };
+
+        if ((v->jobs = calloc(v->queue, sizeof (*v->jobs))) == NULL) {
+            ec = bsky_ec_Out_of_memory;
+            goto fail;
+        }
+
+        for (size_t i = 0; i < v->workers; ++i) {
+            pthread_t thread;
+
+            if (pthread_create(&thread, NULL, __bsky_verify_worker, v) != 0) {
+                ec = bsky_ec_Verify_thread;
+                goto fail;
+            }
+            if ((ec = bsky_da_push(&v->threads, thread)) != bsky_ec_Ok) {
+                pthread_detach(thread);
+                goto fail;
+            }
+        }
+
+        return bsky_ec_Ok;
+
+    fail:
+        bsky_verifier_stop(v);
+        bsky_return_error(ec);
+        return ec;
+    }
+
+    static enum bsky_error_code
+    __bsky_verifier_add_key(struct bsky_verifier *v, struct bsky_str did,
+                            const struct bsky_pubkey *pubkey,
+                            struct __bsky_verify_key **out)
+    {
+        enum bsky_error_code ec;
+        struct __bsky_verify_key *key = malloc(sizeof (*key));
+
+        if (key == NULL) bsky_return_error(bsky_ec_Out_of_memory);
+
+        key->pubkey = *pubkey;
+        key->key    = v->crypto.key_new(v->crypto.user, pubkey);
+        if (key->key == NULL) {
+            free(key);
+            bsky_return_error(bsky_ec_Verify_invalid_key);
+            return bsky_ec_Verify_invalid_key;
+        }
+
+        // old key of DID can be used by queued jobs, so it stays in list.
+        pthread_mutex_lock(&v->lock);
+        if ((ec = bsky_da_push(&v->key_list, key)) == bsky_ec_Ok &&
+            (ec = bsky_str_map_set(&v->keys, did, v->key_list.len - 1))
+            != bsky_ec_Ok) {
+            v->key_list.len--;
+        }
+        pthread_mutex_unlock(&v->lock);
+
+        if (ec != bsky_ec_Ok) {
+            v->crypto.key_free(v->crypto.user, key->key);
+            free(key);
+            bsky_return_error(ec);
+            return ec;
+        }
+
+        if (out) *out = key;
+        return bsky_ec_Ok;
+    }
+
+    enum bsky_error_code bsky_verifier_set_key(struct bsky_verifier *v,
+                                               struct bsky_str did,
+                                               const struct bsky_pubkey *key)
+    {
+        return __bsky_verifier_add_key(v, did, key, NULL);
+    }
+
+    enum bsky_error_code bsky_verifier_submit(struct bsky_verifier *v,
+                                              struct bsky_str did,
+                                              struct bsky_view commit,
+                                              void *user)
+    {
+        struct __bsky_verify_job  job = { .user = user };
+        struct bsky_pubkey        pubkey;
+        size_t did_len = bsky_str_len(did);
+        size_t len     = (char*) commit.end - (char*) commit.start;
+        size_t *idx;
+        char   *data;
+
+        pthread_mutex_lock(&v->lock);
+        idx     = bsky_str_map_get(&v->keys, did);
+        job.key = idx ? v->key_list.data[*idx] : NULL;
+        pthread_mutex_unlock(&v->lock);
+
+        // unknown key is reported as `No_key' by worker.
+        if (job.key == NULL && v->resolve &&
+            v->resolve(v->user, did, &pubkey)) {
+            __bsky_verifier_add_key(v, did, &pubkey, &job.key);
+        }
+
+        // DID and commit share one allocation.
+        if ((data = malloc(did_len + len + 1)) == NULL)
+            bsky_return_error(bsky_ec_Out_of_memory);
+
+        memcpy(data, did.start, did_len);
+        memcpy(data + did_len, commit.start, len);
+        job.did    = (struct bsky_str) { data, data + did_len };
+        job.commit = (struct bsky_view) { data + did_len,
+                                          data + did_len + len };
+
+        pthread_mutex_lock(&v->lock);
+        while (v->len == v->queue)
+            pthread_cond_wait(&v->has_space, &v->lock);
+
+        v->jobs[(v->head + v->len) % v->queue] = job;
+        v->len++;
+        pthread_cond_signal(&v->has_jobs);
+        pthread_mutex_unlock(&v->lock);
+
+        return bsky_ec_Ok;
+    }
+
+    enum bsky_error_code bsky_verifier_submit_event(
+                                struct bsky_verifier *v,
+                                const struct bsky_firehose_event *ev,
+                                void *user)
+    {
+        enum bsky_error_code   ec = bsky_ec_Ok;
+        struct bsky_car_reader car;
+        struct bsky_car_block  block;
+
+        if (bsky_car_open_mem(&car, ev->blocks, &ec) != bsky_ec_Ok) {
+            bsky_car_free(&car);
+            return ec;
+        }
+
+        // commit is the root and is usually the first block.
+        while (car.roots.len && bsky_car_next(&car, &block, &ec)) {
+            if (__bsky_view_eq(block.cid, car.roots.data[0])) {
+                ec = bsky_verifier_submit(v, ev->repo, block.data, user);
+                bsky_car_free(&car);
+                return ec;
+            }
+        }
+
+        bsky_car_free(&car);
+        if (ec == bsky_ec_Ok) ec = bsky_ec_Firehose_invalid;
+        bsky_return_error(ec);
+
+        return ec;
+    }
+
+    void bsky_verifier_wait(struct bsky_verifier *v)
+    {
+        pthread_mutex_lock(&v->lock);
+        while (v->len || v->busy) pthread_cond_wait(&v->idle, &v->lock);
+        pthread_mutex_unlock(&v->lock);
+    }
+
+    void bsky_verifier_stop(struct bsky_verifier *v)
+    {
+        pthread_mutex_lock(&v->lock);
+        v->stop = 1;
+        pthread_cond_broadcast(&v->has_jobs);
+        pthread_mutex_unlock(&v->lock);
+
+        for (size_t i = 0; i < v->threads.len; ++i)
+            pthread_join(v->threads.data[i], NULL);
+
+        // jobs left when no worker could start.
+        for (size_t i = 0; i < v->len; ++i)
+            free(v->jobs[(v->head + i) % v->queue].did.start);
+
+        for (size_t i = 0; i < v->key_list.len; ++i) {
+            v->crypto.key_free(v->crypto.user, v->key_list.data[i]->key);
+            free(v->key_list.data[i]);
+        }
+
+        bsky_da_free(&v->key_list);
+        bsky_da_free(&v->threads);
+        bsky_str_map_free(&v->keys);
+        free(v->jobs);
+        v->jobs = NULL;
+
+        pthread_cond_destroy(&v->idle);
+        pthread_cond_destroy(&v->has_space);
+        pthread_cond_destroy(&v->has_jobs);
+        pthread_mutex_destroy(&v->lock);
+    }
+
+    /*
+     * BSKY CAPTURE & REPLAY
+     */
+
+    static void __bsky_capture_le(unsigned char *p, uint64_t v, int n)
+    {
+        for (int i = 0; i < n; ++i) p[i] = v >> (i * 8);
+    }
+
+    static uint64_t __bsky_capture_load_le(const unsigned char *p, int n)
+    {
+        uint64_t v = 0;
+
+        for (int i = n - 1; i >= 0; --i) v = v << 8 | p[i];
+        return v;
+    }
+
+    static enum bsky_error_code __bsky_capture_write_all(int fd,
+                                                         const char *data,
+                                                         size_t len)
+    {
+        while (len) {
+            ssize_t n = write(fd, data, len);
+
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) bsky_return_error(bsky_ec_Io);
+
+            data += n;
+            len  -= n;
+        }
+
+        return bsky_ec_Ok;
+    }
+
+    static enum bsky_error_code __bsky_capture_flush(struct bsky_capture *cap)
+    {
+        enum bsky_error_code ec;
+
+        ec = __bsky_capture_write_all(cap->fd, cap->buf.data, cap->buf.len);
+        cap->buf.len = 0;
+
+        return ec;
+    }
+
+    enum bsky_error_code bsky_capture_open(struct bsky_capture *cap,
+                                           const char *path,
+                                           enum bsky_error_code *ec)
+    {
+        cap->frames = cap->bytes = 0;
+        cap->buf    = (__typeof__ (cap->buf)) { 0 };
+
+        cap->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (cap->fd < 0) bsky_defer_ec(bsky_ec_Io);
+
+        posix_fadvise(cap->fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+        cap->buf.data = malloc(BSKY_CAPTURE_BUFFER);
+        if (cap->buf.data == NULL) bsky_defer_ec(bsky_ec_Out_of_memory);
+        cap->buf.cap = BSKY_CAPTURE_BUFFER;
+
+        memcpy(cap->buf.data, BSKY_CAPTURE_MAGIC, 8);
+        cap->buf.len = 8;
+
+        return *ec = bsky_ec_Ok;
+
+    defer:
+        if (cap->fd >= 0) close(cap->fd);
+        cap->fd = -1;
+        free(cap->buf.data);
+        cap->buf = (__typeof__ (cap->buf)) { 0 };
+        return *ec;
+    }
+
+    enum bsky_error_code bsky_capture_write(struct bsky_capture *cap,
+                                            uint64_t time_ns,
+                                            enum bsky_ws_opcode opcode,
+                                            struct bsky_view message)
+    {
+        enum bsky_error_code ec;
+        unsigned char head[12 + 10];
+        size_t len  = (char*) message.end - (char*) message.start;
+        size_t hlen = 12 + 2;
+
+        // unmasked server frame.
+        head[12] = 0x80 | opcode;
+        if (len < 126) {
+            head[13] = len;
+        } else if (len < 0x10000) {
+            head[13] = 126;
+            head[14] = len >> 8;
+            head[15] = len;
+            hlen += 2;
+        } else {
+            head[13] = 127;
+            for (int i = 0; i < 8; ++i)
+                head[14 + i] = (uint64_t) len >> (56 - i * 8);
+            hlen += 8;
+        }
+
+        if (hlen - 12 + len > UINT32_MAX) bsky_return_error(bsky_ec_Io);
+
+        __bsky_capture_le(head, hlen - 12 + len, 4);
+        __bsky_capture_le(head + 4, time_ns, 8);
+
+        if (cap->buf.cap - cap->buf.len < hlen + len &&
+            (ec = __bsky_capture_flush(cap)) != bsky_ec_Ok) {
+            return ec;
+        }
+
+        memcpy(cap->buf.data + cap->buf.len, head, hlen);
+        cap->buf.len += hlen;
+
+        // message larger than buffer goes right after flushed head.
+        if (cap->buf.cap - cap->buf.len < len) {
+            if ((ec = __bsky_capture_flush(cap)) != bsky_ec_Ok ||
+                (ec = __bsky_capture_write_all(cap->fd, message.start, len))
+                != bsky_ec_Ok) {
+                return ec;
+            }
+        } else {
+            memcpy(cap->buf.data + cap->buf.len, message.start, len);
+            cap->buf.len += len;
+        }
+
+        cap->frames++;
+        cap->bytes += hlen - 12 + len;
+
+        return bsky_ec_Ok;
+    }
+
+    void bsky_capture_on_ws_message(void *user, enum bsky_ws_opcode opcode,
+                                    struct bsky_view message)
+    {
+        struct bsky_capture *cap = user;
+
+        bsky_capture_write(cap, __bsky_now_ns(), opcode, message);
+        if (cap->on_message) cap->on_message(cap->user, opcode, message);
+    }
+
+    enum bsky_error_code bsky_capture_close(struct bsky_capture *cap)
+    {
+        enum bsky_error_code ec = bsky_ec_Ok;
+
+        if (cap->fd < 0) return ec;
+
+        ec = __bsky_capture_flush(cap);
+        if (close(cap->fd) != 0 && ec == bsky_ec_Ok) ec = bsky_ec_Io;
+
+        cap->fd = -1;
+        bsky_da_free(&cap->buf);
+
+        return ec;
+    }
+
+    enum bsky_error_code bsky_replay_open(struct bsky_replay *r,
+                                          const char *path,
+                                          enum bsky_error_code *ec)
+    {
+        struct stat st;
+        void *map = MAP_FAILED;
+        int fd = open(path, O_RDONLY | O_CLOEXEC);
+
+        *r  = (struct bsky_replay) { 0 };
+        *ec = bsky_ec_Ok;
+
+        if (fd < 0 || fstat(fd, &st) != 0) bsky_defer_ec(bsky_ec_Io);
+        if (st.st_size < 8) bsky_defer_ec(bsky_ec_Capture_invalid);
+
+        map = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE,
+                   fd, 0);
+        if (map == MAP_FAILED) bsky_defer_ec(bsky_ec_Io);
+
+        madvise(map, st.st_size, MADV_SEQUENTIAL);
+
+        r->data = (struct bsky_view) { map, (char*) map + st.st_size };
+        r->pos  = 8;
+
+        if (memcmp(map, BSKY_CAPTURE_MAGIC, 8) != 0) {
+            bsky_replay_free(r);
+            bsky_defer_ec(bsky_ec_Capture_invalid);
+        }
+
+    defer:
+        if (fd >= 0) close(fd);
+        return *ec;
+    }
+
+    int bsky_replay_next(struct bsky_replay *r, struct bsky_view *frame,
+                         uint64_t *time_ns, enum bsky_error_code *ec)
+    {
+        const unsigned char *p = (unsigned char*) r->data.start + r->pos;
+        size_t left = (char*) r->data.end - (char*) r->data.start - r->pos;
+        uint64_t len;
+
+        *ec = bsky_ec_Ok;
+        if (left == 0) return 0;
+
+        if (left < 12 ||
+            (len = __bsky_capture_load_le(p, 4)) > left - 12) {
+            *ec = bsky_ec_Capture_invalid;
+            bsky_log_error(*ec);
+            return 0;
+        }
+
+        *time_ns = __bsky_capture_load_le(p + 4, 8);
+        *frame   = (struct bsky_view) { (void*) (p + 12),
+                                        (void*) (p + 12 + len) };
+        r->pos  += 12 + len;
+
+        return 1;
+    }
+
+    enum bsky_error_code bsky_replay_run(struct bsky_replay *r,
+                                         struct bsky_ws *ws, int paced,
+                                         struct bsky_replay_stats *stats)
+    {
+        enum bsky_error_code ec = bsky_ec_Ok;
+        struct bsky_replay_stats s = { 0 };
+        struct bsky_view frame;
+        uint64_t time_ns, first = 0, start = __bsky_now_ns();
+
+        while (bsky_replay_next(r, &frame, &time_ns, &ec)) {
+            size_t len = (char*) frame.end - (char*) frame.start;
+
+            if (s.frames == 0) first = time_ns;
+
+            if (paced && time_ns > first) {
+                uint64_t target = start + (time_ns - first), now;
+
+                if ((now = __bsky_now_ns()) < target) {
+                    struct timespec ts = {
+                        .tv_sec  = target / 1000000000ull,
+                        .tv_nsec = target % 1000000000ull,
+                    };
+                    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME,
+                                           &ts, NULL) == EINTR);
+                } else if (now - target > s.late_max_ns) {
+                    s.late_max_ns = now - target;
+                }
+            }
+
+            uint64_t fed = __bsky_now_ns();
+            if ((ec = bsky_ws_feed(ws, frame.start, len)) != bsky_ec_Ok)
+                break;
+            fed = __bsky_now_ns() - fed;
+
+            s.frames++;
+            s.bytes   += len;
+            s.feed_ns += fed;
+            if (fed > s.feed_max_ns) s.feed_max_ns = fed;
+        }
+
+        s.elapsed_ns = __bsky_now_ns() - start;
+        if (stats) *stats = s;
+
+        if (ec != bsky_ec_Ok) bsky_log_error(ec);
+        return ec;
+    }
+
+    void bsky_replay_rewind(struct bsky_replay *r)
+    {
+        r->pos = 8;
+    }
+
+    void bsky_replay_free(struct bsky_replay *r)
+    {
+        if (r->data.start) {
+            munmap(r->data.start,
+                   (char*) r->data.end - (char*) r->data.start);
+        }
+        *r = (struct bsky_replay) { 0 };
+    }
+
+    /*
+     * BSKY BACKFILL
+     */
+
+    #include <sys/uio.h>
+
+    enum {
+        __bsky_backfill_Commit,
+        __bsky_backfill_Node,
+        __bsky_backfill_Record,
+    };
+
+    // record keys waiting for the same CID are chained by `next' (index
+    // + 1, 0 is the end).
+    struct __bsky_backfill_key { char *key; size_t next; };
+
+    // State of streamed MST walk of one repo.
+    struct __bsky_backfill_walk {
+        struct bsky_backfill *bf;
+        struct bsky_str       did;
+
+        struct bsky_str_map wanted; // CID -> kind | index << 2
+        struct bsky_str_map stash;  // CID -> index of early block
+        struct { struct bsky_str_builder *data; size_t len, cap; } blocks;
+        struct { struct __bsky_backfill_key *data; size_t len, cap; } keys;
+        int depth;
+    };
+
+    // Hex of binary CID as map key.
+    static struct bsky_str __bsky_backfill_cid_key(struct bsky_view cid,
+                                                   char buf[129])
+    {
+        static const char hex[] = "0123456789abcdef";
+        const unsigned char *p = cid.start;
+        size_t len = (char*) cid.end - (char*) cid.start;
+
+        if (len > 64) len = 64;
+        for (size_t i = 0; i < len; ++i) {
+            buf[i * 2]     = hex[p[i] >> 4];
+            buf[i * 2 + 1] = hex[p[i] & 0xf];
+        }
+        buf[len * 2] = '\0';
+
+        return (struct bsky_str) { buf, buf + len * 2 };
+    }
+
+    static enum bsky_error_code __bsky_backfill_use(
+        struct __bsky_backfill_walk *, size_t, struct bsky_view cid,
+        struct bsky_view data);
+
+    static enum bsky_error_code __bsky_backfill_want(
+                                    struct __bsky_backfill_walk *w, int kind,
+                                    struct bsky_view cid, struct bsky_str key)
+    {
+        enum bsky_error_code ec;
+        char   buf[129];
+        struct bsky_str id = __bsky_backfill_cid_key(cid, buf);
+        size_t *idx, value = kind;
+
+        if ((char*) cid.end - (char*) cid.start > 64)
+            bsky_return_error(bsky_ec_Mst_invalid);
+
+        if (kind == __bsky_backfill_Record) {
+            struct __bsky_backfill_key k = { strndup(key.start,
+                                                     bsky_str_len(key)) };
+
+            if (k.key == NULL) bsky_return_error(bsky_ec_Out_of_memory);
+
+            // the same record under other key is waited for already.
+            idx = bsky_str_map_get(&w->wanted, id);
+            if (idx && (*idx & 3) == __bsky_backfill_Record)
+                k.next = (*idx >> 2) + 1;
+
+            if ((ec = bsky_da_push(&w->keys, k)) != bsky_ec_Ok) {
+                free(k.key);
+                return ec;
+            }
+            value |= (w->keys.len - 1) << 2;
+        }
+
+        // block came before its parent. Records are kept, other key can
+        // point to the same one.
+        if ((idx = bsky_str_map_get(&w->stash, id)) != NULL) {
+            struct bsky_str_builder block = { 0 };
+
+            if (*idx != SIZE_MAX) block = w->blocks.data[*idx];
+
+            if (kind != __bsky_backfill_Record && *idx != SIZE_MAX) {
+                w->blocks.data[*idx] = (struct bsky_str_builder) { 0 };
+                bsky_str_map_del(&w->stash, id);
+            }
+
+            ec = __bsky_backfill_use(w, value, cid, (struct bsky_view) {
+                                     block.data, block.data + block.len });
+            if (kind != __bsky_backfill_Record) bsky_da_free(&block);
+            return ec;
+        }
+
+        return bsky_str_map_set(&w->wanted, id, value);
+    }
+
+    static enum bsky_error_code __bsky_backfill_use(
+                                    struct __bsky_backfill_walk *w,
+                                    size_t value, struct bsky_view cid,
+                                    struct bsky_view data)
+    {
+        enum bsky_error_code ec = bsky_ec_Ok;
+        struct bsky_view check = data;
+
+        switch (value & 3) {
+        case __bsky_backfill_Record:
+            for (size_t i = (value >> 2) + 1; i; ) {
+                struct __bsky_backfill_key *k = &w->keys.data[i - 1];
+
+                if (w->bf->on_record) {
+                    w->bf->on_record(w->bf->user, w->did,
+                                     bsky_mk_str(k->key), cid, data);
+                }
+                atomic_fetch_add_explicit(&w->bf->records, 1,
+                                          memory_order_relaxed);
+                free(k->key);
+                k->key = NULL;
+                i = k->next;
+            }
+            return bsky_ec_Ok;
+
+        case __bsky_backfill_Commit: {
+            const unsigned char *p = data.start;
+            uint64_t n, len;
+
+            if (bsky_cbor_skip(&check) != bsky_ec_Ok ||
+                __bsky_cbor_head(&p, &n) != 5) {
+                bsky_return_error(bsky_ec_Mst_invalid);
+                return bsky_ec_Mst_invalid;
+            }
+
+            for (uint64_t i = 0; i < n; ++i) {
+                struct bsky_view rest;
+                const unsigned char *key;
+
+                if (__bsky_cbor_head(&p, &len) != 3) break;
+                key = p;
+                p  += len;
+
+                if (__bsky_firehose_key(key, len, "data")) {
+                    struct bsky_view root;
+
+                    if (!__bsky_mst_link(&p, &root) || root.start == NULL)
+                        break;
+                    return __bsky_backfill_want(w, __bsky_backfill_Node,
+                                                root, (struct bsky_str) { 0 });
+                }
+
+                rest = (struct bsky_view) { (void*) p, data.end };
+                bsky_cbor_skip(&rest);
+                p = rest.start;
+            }
+
+            bsky_return_error(bsky_ec_Mst_invalid);
+            return bsky_ec_Mst_invalid;
+        }
+
+        case __bsky_backfill_Node: {
+            struct bsky_mst_node *node;
+
+            // stashed subtrees are walked recursively.
+            if (++w->depth > BSKY_CBOR_MAX_DEPTH) {
+                bsky_return_error(bsky_ec_Mst_invalid);
+                return bsky_ec_Mst_invalid;
+            }
+
+            if ((ec = __bsky_mst_decode(cid, data, &node)) != bsky_ec_Ok)
+                return ec;
+
+            if (node->left.start) {
+                ec = __bsky_backfill_want(w, __bsky_backfill_Node, node->left,
+                                          (struct bsky_str) { 0 });
+            }
+            for (size_t i = 0; ec == bsky_ec_Ok && i < node->len; ++i) {
+                struct bsky_mst_entry *e = &node->data[i];
+
+                ec = __bsky_backfill_want(w, __bsky_backfill_Record, e->value,
+                                          e->key);
+                if (ec == bsky_ec_Ok && e->right.start) {
+                    ec = __bsky_backfill_want(w, __bsky_backfill_Node,
+                                              e->right, (struct bsky_str) { 0 });
+                }
+            }
+
+            free(node->keys);
+            free(node->data);
+            free(node);
+            w->depth--;
+
+            return ec;
+        }
+        }
+
+        return ec;
+    }
+
+    static enum bsky_error_code __bsky_backfill_block(
+                                    struct __bsky_backfill_walk *w,
+                                    struct bsky_car_block *block)
+    {
+        enum bsky_error_code ec;
+        char   buf[129];
+        struct bsky_str id = __bsky_backfill_cid_key(block->cid, buf);
+        size_t *idx = bsky_str_map_get(&w->wanted, id);
+        size_t len  = (char*) block->data.end - (char*) block->data.start;
+
+        if (idx != NULL) {
+            size_t value = *idx;
+
+            bsky_str_map_del(&w->wanted, id);
+            ec = __bsky_backfill_use(w, value, block->cid, block->data);
+
+            // bytes are gone, later keys of the record get empty one.
+            if (ec == bsky_ec_Ok && (value & 3) == __bsky_backfill_Record)
+                ec = bsky_str_map_set(&w->stash, id, SIZE_MAX);
+            return ec;
+        }
+
+        // parent is not seen yet, block is copied out of reader buffer.
+        struct bsky_str_builder copy = { 0 };
+
+        if ((ec = __bsky_da_append(&copy, block->data.start, 1, len))
+            != bsky_ec_Ok ||
+            (ec = bsky_da_push(&w->blocks, copy)) != bsky_ec_Ok) {
+            bsky_da_free(&copy);
+            return ec;
+        }
+
+        return bsky_str_map_set(&w->stash, id, w->blocks.len - 1);
+    }
+
+    static void __bsky_backfill_walk_free(struct __bsky_backfill_walk *w)
+    {
+        for (size_t i = 0; i < w->blocks.len; ++i)
+            bsky_da_free(&w->blocks.data[i]);
+        for (size_t i = 0; i < w->keys.len; ++i)
+            free(w->keys.data[i].key);
+
+        bsky_da_free(&w->blocks);
+        bsky_da_free(&w->keys);
+        bsky_str_map_free(&w->wanted);
+        bsky_str_map_free(&w->stash);
+    }
+
+    // Download and walk repo. `status' is result of fetch (0 if it was
+    // opened).
+    static enum bsky_error_code __bsky_backfill_repo(struct bsky_backfill *bf,
+                                                     struct bsky_str did,
+                                                     struct bsky_str host,
+                                                     int *status)
+    {
+        enum bsky_error_code ec = bsky_ec_Ok;
+        struct bsky_str_builder prefix = { 0 };
+        struct __bsky_backfill_walk w = { .bf = bf, .did = did };
+        struct bsky_car_reader car;
+        struct bsky_car_block  block;
+        int fd = bf->fetch(bf->user, did, host, &prefix);
+
+        if ((*status = fd < 0 ? fd : 0) != 0) {
+            bsky_da_free(&prefix);
+            return bsky_ec_Backfill_fetch;
+        }
+
+        if (bsky_car_open_stream(&car, fd, (struct bsky_view) {
+                prefix.data, prefix.data + prefix.len }, &ec) == bsky_ec_Ok) {
+            if (car.roots.len == 0) ec = bsky_ec_Mst_invalid;
+            else ec = __bsky_backfill_want(&w, __bsky_backfill_Commit,
+                                           car.roots.data[0],
+                                           (struct bsky_str) { 0 });
+
+            while (ec == bsky_ec_Ok && bsky_car_next(&car, &block, &ec))
+                ec = __bsky_backfill_block(&w, &block);
+
+            if (ec == bsky_ec_Ok && w.wanted.len) ec = bsky_ec_Mst_missing_block;
+        }
+
+        bsky_car_free(&car);
+        close(fd);
+        __bsky_backfill_walk_free(&w);
+        bsky_da_free(&prefix);
+        bsky_default_tmp_reset();
+
+        return ec;
+    }
+
+    static size_t __bsky_backfill_host_index(struct bsky_backfill *bf,
+                                             struct bsky_str host,
+                                             enum bsky_error_code *ec)
+    {
+        size_t *idx = bsky_str_map_get(&bf->host_index, host);
+        struct __bsky_backfill_host h = {
+            .limit     = bf->per_host,
+            .rate      = bf->rate,
+            .tokens    = 1,
+            .refill_ns = __bsky_now_ns(),
+        };
+
+        *ec = bsky_ec_Ok;
+        if (idx) return *idx;
+
+        if ((h.host = strndup(host.start, bsky_str_len(host))) == NULL) {
+            *ec = bsky_ec_Out_of_memory;
+            return 0;
+        }
+        if ((*ec = bsky_da_push(&bf->hosts, h)) != bsky_ec_Ok) {
+            free(h.host);
+            return 0;
+        }
+        if ((*ec = bsky_str_map_set(&bf->host_index, host,
+                                    bf->hosts.len - 1)) != bsky_ec_Ok) {
+            bf->hosts.len--;
+            free(h.host);
+            return 0;
+        }
+
+        return bf->hosts.len - 1;
+    }
+
+    // Take job of the first host (round robin) which has free slot and
+    // token. Otherwise return 0 and time to wait for a token in `wait'.
+    static int __bsky_backfill_take(struct bsky_backfill *bf, size_t *host,
+                                    struct __bsky_backfill_job *job,
+                                    uint64_t *wait)
+    {
+        uint64_t now = __bsky_now_ns();
+
+        *wait = UINT64_MAX;
+
+        for (size_t k = 0; k < bf->hosts.len; ++k) {
+            size_t i = (bf->next_host + k) % bf->hosts.len;
+            struct __bsky_backfill_host *h = &bf->hosts.data[i];
+            double burst = h->rate > 1 ? h->rate : 1;
+
+            if (h->head == h->jobs.len || h->active >= h->limit) continue;
+
+            if (h->paused_until_ns > now) {
+                if (h->paused_until_ns - now < *wait)
+                    *wait = h->paused_until_ns - now;
+                continue;
+            }
+
+            h->tokens += (now - h->refill_ns) / 1e9 * h->rate;
+            if (h->tokens > burst) h->tokens = burst;
+            h->refill_ns = now;
+
+            if (h->tokens < 1) {
+                uint64_t ns = (1 - h->tokens) / h->rate * 1e9 + 1;
+                if (ns < *wait) *wait = ns;
+                continue;
+            }
+
+            h->tokens -= 1;
+            h->active++;
+            *job = h->jobs.data[h->head++];
+            if (h->head == h->jobs.len) h->head = h->jobs.len = 0;
+
+            *host         = i;
+            bf->next_host = i + 1;
+            bf->pending--;
+            bf->active++;
+
+            return 1;
+        }
+
+        return 0;
+    }
+
+    static void __bsky_backfill_finish(struct bsky_backfill *bf,
+                                       struct bsky_str did)
+    {
+        struct iovec line[2] = {
+            { did.start, bsky_str_len(did) }, { "\n", 1 },
+        };
+
+        bsky_str_map_set(&bf->done, did, 1);
+
+        if (bf->fd >= 0 && writev(bf->fd, line, 2) < 0)
+            bsky_log_error(bsky_ec_Io);
+        bf->dirty = 1;
+    }
+
+    static void *__bsky_backfill_worker(void *arg)
+    {
+        struct bsky_backfill *bf = arg;
+
+        pthread_mutex_lock(&bf->lock);
+        for (;;) {
+            struct __bsky_backfill_job job;
+            enum bsky_error_code ec;
+            size_t   host;
+            uint64_t wait;
+            int      status, sync = 0;
+
+            if (bf->stop && bf->pending == 0) break;
+
+            if (!__bsky_backfill_take(bf, &host, &job, &wait)) {
+                if (wait == UINT64_MAX) {
+                    pthread_cond_wait(&bf->wake, &bf->lock);
+                } else {
+                    struct timespec ts;
+                    uint64_t until;
+
+                    clock_gettime(CLOCK_MONOTONIC, &ts);
+                    until = ts.tv_sec * 1000000000ull + ts.tv_nsec + wait;
+                    ts = (struct timespec) { until / 1000000000ull,
+                                             until % 1000000000ull };
+                    pthread_cond_timedwait(&bf->wake, &bf->lock, &ts);
+                }
+                continue;
+            }
+
+            char *name = bf->hosts.data[host].host;
+            pthread_mutex_unlock(&bf->lock);
+
+            struct bsky_str did = bsky_mk_str(job.did);
+            ec = __bsky_backfill_repo(bf, did, bsky_mk_str(name), &status);
+
+            // 429 is retried without counting attempt, server errors and
+            // broken streams up to `retries' times.
+            int final = status != -429 &&
+                        (ec == bsky_ec_Ok || (status < -1 && status > -500) ||
+                         ++job.attempts > bf->retries);
+
+            if (final) {
+                if (bf->on_repo) bf->on_repo(bf->user, did, ec);
+                atomic_fetch_add_explicit(ec == bsky_ec_Ok ? &bf->repos
+                                                           : &bf->failed,
+                                          1, memory_order_relaxed);
+            }
+
+            pthread_mutex_lock(&bf->lock);
+
+            struct __bsky_backfill_host *h = &bf->hosts.data[host];
+            h->active--;
+            bf->active--;
+
+            if (status == -429) {
+                uint64_t backoff = 1000000000ull << (h->strikes < 6
+                                                     ? h->strikes : 6);
+
+                h->strikes++;
+                h->paused_until_ns = __bsky_now_ns() + backoff;
+                atomic_fetch_add_explicit(&bf->rate_limited, 1,
+                                          memory_order_relaxed);
+            } else if (status == 0) {
+                h->strikes = 0;
+            }
+
+            if (!final) {
+                // retried job goes first, so order of host is kept.
+                if (h->head > 0) {
+                    h->jobs.data[--h->head] = job;
+                } else if (bsky_da_push(&h->jobs, job) != bsky_ec_Ok) {
+                    free(job.did);
+                    pthread_cond_broadcast(&bf->wake);
+                    continue;
+                } else {
+                    memmove(h->jobs.data + 1, h->jobs.data,
+                            (h->jobs.len - 1) * sizeof (job));
+                    h->jobs.data[0] = job;
+                }
+                bf->pending++;
+            } else {
+                if (ec == bsky_ec_Ok || status < -1)
+                    __bsky_backfill_finish(bf, did);
+                free(job.did);
+
+                uint64_t now = __bsky_now_ns();
+                if (bf->dirty &&
+                    now - bf->synced_ns >= BSKY_BACKFILL_SYNC_MS * 1000000ull) {
+                    bf->synced_ns = now;
+                    bf->dirty     = 0;
+                    sync = bf->fd >= 0;
+                }
+            }
+
+            pthread_cond_broadcast(&bf->wake);
+            if (bf->pending == 0 && bf->active == 0)
+                pthread_cond_broadcast(&bf->idle);
+
+            if (sync) {
+                pthread_mutex_unlock(&bf->lock);
+                fdatasync(bf->fd);
+                pthread_mutex_lock(&bf->lock);
+            }
+        }
+        pthread_mutex_unlock(&bf->lock);
+        bsky_default_tmp_free();
+
+        return NULL;
+    }
+
+    static enum bsky_error_code __bsky_backfill_load(struct bsky_backfill *bf,
+                                                     const char *path)
+    {
+        enum bsky_error_code ec = bsky_ec_Ok;
+        struct bsky_str_builder data = { 0 };
+        char   buf[0x10000];
+        ssize_t n;
+        size_t  end;
+
+        bf->fd = open(path, O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+        if (bf->fd < 0) bsky_return_error(bsky_ec_Io);
+
+        while ((n = read(bf->fd, buf, sizeof (buf))) > 0) {
+            if ((ec = __bsky_da_append(&data, buf, 1, n)) != bsky_ec_Ok)
+                break;
+        }
+        if (n < 0) ec = bsky_ec_Io;
+
+        // the last line without newline was torn by crash, it can be
+        // the only one.
+        end = data.len;
+        while (end > 0 && data.data[end - 1] != '\n') end--;
+
+        if (ec == bsky_ec_Ok && end < data.len && ftruncate(bf->fd, end) != 0)
+            ec = bsky_ec_Io;
+
+        for (size_t i = 0, start = 0; ec == bsky_ec_Ok && i < end; ++i) {
+            if (data.data[i] != '\n') continue;
+
+            if (i > start) {
+                ec = bsky_str_map_set(&bf->done, (struct bsky_str) {
+                                      data.data + start, data.data + i }, 1);
+            }
+            start = i + 1;
+        }
+
+        bsky_da_free(&data);
+        if (ec != bsky_ec_Ok) bsky_log_error(ec);
+
+        return ec;
+    }
+
+    enum bsky_error_code bsky_backfill_start(struct bsky_backfill *bf,
+                                             const char *progress)
+    {
+        enum bsky_error_code ec = bsky_ec_Ok;
+        pthread_condattr_t attr;
+
+        if (bf->concurrency == 0) bf->concurrency = BSKY_BACKFILL_CONCURRENCY;
+        if (bf->per_host == 0)    bf->per_host    = BSKY_BACKFILL_PER_HOST;
+        if (bf->rate <= 0)        bf->rate        = BSKY_BACKFILL_RATE;
+        if (bf->retries == 0)     bf->retries     = BSKY_BACKFILL_RETRIES;
+
+        atomic_init(&bf->repos, 0);
+        atomic_init(&bf->failed, 0);
+        atomic_init(&bf->skipped, 0);
+        atomic_init(&bf->records, 0);
+        atomic_init(&bf->rate_limited, 0);
+
+        pthread_mutex_init(&bf->lock, NULL);
+        pthread_condattr_init(&attr);
+        pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+        pthread_cond_init(&bf->wake, &attr);
+        pthread_cond_init(&bf->idle, NULL);
+        pthread_condattr_destroy(&attr);
+
+        bf->host_index = (struct bsky_str_map) { 0 };
+        bf->done       = (struct bsky_str_map) { 0 };
+        bf->hosts      = (__typeof__ (bf->hosts)) { 0 };
+        bf->threads    = (__typeof__ (bf->threads)) { 0 };
+        bf->next_host  = bf->pending = bf->active = 0;
+        bf->stop       = 0;
+        bf->fd         = -1;
+        bf->dirty      = 0;
+        bf->synced_ns  = __bsky_now_ns();
+
+        if (progress && (ec = __bsky_backfill_load(bf, progress))
+            != bsky_ec_Ok) {
+            goto fail;
+        }
+
+        for (size_t i = 0; i < bf->concurrency; ++i) {
+            pthread_t thread;
+
+            if (pthread_create(&thread, NULL, __bsky_backfill_worker,
+                               bf) != 0) {
+                ec = bsky_ec_Backfill_fetch;
+                goto fail;
+            }
+            if ((ec = bsky_da_push(&bf->threads, thread)) != bsky_ec_Ok) {
+                pthread_detach(thread);
+                goto fail;
+            }
+        }
+
+        return bsky_ec_Ok;
+
+    fail:
+        bsky_backfill_stop(bf);
+        bsky_return_error(ec);
+        return ec;
+    }
+
+    enum bsky_error_code bsky_backfill_host(struct bsky_backfill *bf,
+                                            struct bsky_str host,
+                                            size_t concurrency, double rate)
+    {
+        enum bsky_error_code ec;
+
+        pthread_mutex_lock(&bf->lock);
+
+        size_t i = __bsky_backfill_host_index(bf, host, &ec);
+        if (ec == bsky_ec_Ok) {
+            if (concurrency) bf->hosts.data[i].limit = concurrency;
+            if (rate > 0)    bf->hosts.data[i].rate  = rate;
+            pthread_cond_broadcast(&bf->wake);
+        }
+
+        pthread_mutex_unlock(&bf->lock);
+
+        return ec;
+    }
+
+    enum bsky_error_code bsky_backfill_add(struct bsky_backfill *bf,
+                                           struct bsky_str did,
+                                           struct bsky_str host)
+    {
+        enum bsky_error_code ec = bsky_ec_Ok;
+        struct __bsky_backfill_job job = { 0 };
+
+        pthread_mutex_lock(&bf->lock);
+
+        if (bsky_str_map_get(&bf->done, did)) {
+            atomic_fetch_add_explicit(&bf->skipped, 1, memory_order_relaxed);
+            goto unlock;
+        }
+
+        size_t i = __bsky_backfill_host_index(bf, host, &ec);
+        if (ec != bsky_ec_Ok) goto unlock;
+
+        if ((job.did = strndup(did.start, bsky_str_len(did))) == NULL) {
+            ec = bsky_ec_Out_of_memory;
+            goto unlock;
+        }
+        if ((ec = bsky_da_push(&bf->hosts.data[i].jobs, job)) != bsky_ec_Ok) {
+            free(job.did);
+            goto unlock;
+        }
+
+        bf->pending++;
+        pthread_cond_signal(&bf->wake);
+
+    unlock:
+        pthread_mutex_unlock(&bf->lock);
+
+        if (ec != bsky_ec_Ok) bsky_log_error(ec);
+        return ec;
+    }
+
+    struct bsky_str bsky_backfill_add_list(struct bsky_backfill *bf,
+                                           struct bsky_str host,
+                                           struct bsky_str response,
+                                           enum bsky_error_code *ec)
+    {
+        struct bsky_json_cursor c = { response.start, response.end };
+        struct bsky_str key, cursor = { 0 };
+
+        if (bsky_json_cursor_object(&c, ec) != bsky_ec_Ok) goto fail;
+
+        while (bsky_json_cursor_field(&c, &key, ec)) {
+            if (bsky_json_key_is(key, "cursor")) {
+                if (bsky_json_cursor_str(&c, &cursor, ec) != bsky_ec_Ok)
+                    goto fail;
+                continue;
+            }
+            if (!bsky_json_key_is(key, "repos")) {
+                bsky_json_cursor_skip(&c, ec);
+                if (*ec != bsky_ec_Ok) goto fail;
+                continue;
+            }
+
+            if (bsky_json_cursor_array(&c, ec) != bsky_ec_Ok) goto fail;
+
+            while (bsky_json_cursor_elem(&c, ec)) {
+                struct bsky_str did = { 0 };
+                int active = 1;
+
+                if (bsky_json_cursor_object(&c, ec) != bsky_ec_Ok) goto fail;
+
+                while (bsky_json_cursor_field(&c, &key, ec)) {
+                    if (bsky_json_key_is(key, "did")) {
+                        bsky_json_cursor_str(&c, &did, ec);
+                    } else if (bsky_json_key_is(key, "active")) {
+                        active = bsky_json_key_is(
+                                    bsky_json_cursor_skip(&c, ec), "true");
+                    } else {
+                        bsky_json_cursor_skip(&c, ec);
+                    }
+                    if (*ec != bsky_ec_Ok) goto fail;
+                }
+                if (*ec != bsky_ec_Ok) goto fail;
+
+                if (did.start != did.end && active &&
+                    (*ec = bsky_backfill_add(bf, did, host)) != bsky_ec_Ok) {
+                    return (struct bsky_str) { 0 };
+                }
+            }
+            if (*ec != bsky_ec_Ok) goto fail;
+        }
+        if (*ec != bsky_ec_Ok) goto fail;
+
+        return cursor;
+
+    fail:
+        bsky_log_error(*ec);
+        return (struct bsky_str) { 0 };
+    }
+
+    int bsky_backfill_done(struct bsky_backfill *bf, struct bsky_str did)
+    {
+        pthread_mutex_lock(&bf->lock);
+        int done = bsky_str_map_get(&bf->done, did) != NULL;
+        pthread_mutex_unlock(&bf->lock);
+
+        return done;
+    }
+
+    void bsky_backfill_wait(struct bsky_backfill *bf)
+    {
+        pthread_mutex_lock(&bf->lock);
+        while (bf->pending || bf->active)
+            pthread_cond_wait(&bf->idle, &bf->lock);
+        pthread_mutex_unlock(&bf->lock);
+    }
+
+    void bsky_backfill_stop(struct bsky_backfill *bf)
+    {
+        pthread_mutex_lock(&bf->lock);
+        bf->stop = 1;
+        pthread_cond_broadcast(&bf->wake);
+        pthread_mutex_unlock(&bf->lock);
+
+        for (size_t i = 0; i < bf->threads.len; ++i)
+            pthread_join(bf->threads.data[i], NULL);
+
+        if (bf->fd >= 0) {
+            fdatasync(bf->fd);
+            close(bf->fd);
+            bf->fd = -1;
+        }
+
+        for (size_t i = 0; i < bf->hosts.len; ++i) {
+            struct __bsky_backfill_host *h = &bf->hosts.data[i];
+
+            for (size_t j = h->head; j < h->jobs.len; ++j)
+                free(h->jobs.data[j].did);
+            bsky_da_free(&h->jobs);
+            free(h->host);
+        }
+
+        bsky_da_free(&bf->hosts);
+        bsky_da_free(&bf->threads);
+        bsky_str_map_free(&bf->host_index);
+        bsky_str_map_free(&bf->done);
+
+        pthread_cond_destroy(&bf->idle);
+        pthread_cond_destroy(&bf->wake);
+        pthread_mutex_destroy(&bf->lock);
+    }
+
+    /*
+     * BSKY LABEL INDEX
+     */
+
+    static struct __bsky_label_subject __bsky_label_tombstone;
+
+    static const char *__bsky_label_key(const struct __bsky_label_subject *s)
+    {
+        return (const char*) (s->data + s->len);
+    }
+
+    static struct __bsky_label_table *__bsky_label_table_new(size_t cap)
+    {
+        struct __bsky_label_table *t = calloc(1, sizeof (*t) +
+                                              cap * sizeof (t->slots[0]));
+
+        if (t) t->cap = cap;
+        return t;
+    }
+
+    static void __bsky_label_retire(void *ptr)
+    {
+        if (ptr == NULL || ptr == &__bsky_label_tombstone) return;
+        bsky_ebr_retire(ptr, free);
+    }
+
+    // Find slot of subject or free slot for it (the first tombstone on
+    // the way). Writer only.
+    static size_t __bsky_label_slot(struct __bsky_label_table *t,
+                                    struct bsky_str key, size_t hash,
+                                    struct __bsky_label_subject **found)
+    {
+        size_t mask = t->cap - 1, len = bsky_str_len(key), free = SIZE_MAX;
+
+        *found = NULL;
+        for (size_t i = hash & mask;; i = (i + 1) & mask) {
+            struct __bsky_label_subject *s = atomic_load_explicit(
+                                    &t->slots[i], memory_order_relaxed);
+
+            if (s == NULL) return free != SIZE_MAX ? free : i;
+            if (s == &__bsky_label_tombstone) {
+                if (free == SIZE_MAX) free = i;
+                continue;
+            }
+            if (s->hash == hash && s->key_len == len &&
+                memcmp(__bsky_label_key(s), key.start, len) == 0) {
+                *found = s;
+                return i;
+            }
+        }
+    }
+
+    static enum bsky_error_code __bsky_label_grow(struct bsky_label_index *idx)
+    {
+        struct __bsky_label_table *old = atomic_load_explicit(&idx->table,
+                                                    memory_order_relaxed);
+        size_t cap = old->cap;
+
+        // many tombstones only need rehash.
+        if (idx->subjects * 2 >= cap) cap *= 2;
+
+        struct __bsky_label_table *t = __bsky_label_table_new(cap);
+        if (t == NULL) bsky_return_error(bsky_ec_Out_of_memory);
+
+        for (size_t i = 0; i < old->cap; ++i) {
+            struct __bsky_label_subject *s = atomic_load_explicit(
+                                    &old->slots[i], memory_order_relaxed);
+            size_t j;
+
+            if (s == NULL || s == &__bsky_label_tombstone) continue;
+
+            for (j = s->hash & (cap - 1); t->slots[j]; j = (j + 1) & (cap - 1))
+                ;
+            atomic_store_explicit(&t->slots[j], s, memory_order_relaxed);
+        }
+        t->used = idx->subjects;
+
+        atomic_store_explicit(&idx->table, t, memory_order_release);
+        __bsky_label_retire(old);
+
+        return bsky_ec_Ok;
+    }
+
+    // Copy of subject without labels matching `drop' (src, val or expired
+    // at `now') and with `add' appended.
+    static struct __bsky_label_subject *__bsky_label_copy(
+                            const struct __bsky_label_subject *s,
+                            struct bsky_str key, size_t hash,
+                            const struct bsky_label_entry *drop, int64_t now,
+                            const struct bsky_label_entry *add)
+    {
+        size_t n = (s ? s->len : 0) + (add != NULL), len = bsky_str_len(key);
+        struct __bsky_label_subject *copy = malloc(sizeof (*copy) +
+                                                   n * sizeof (copy->data[0]) +
+                                                   len);
+        if (copy == NULL) return NULL;
+
+        copy->hash    = hash;
+        copy->key_len = len;
+        copy->len     = 0;
+
+        for (size_t i = 0; s && i < s->len; ++i) {
+            const struct bsky_label_entry *e = &s->data[i];
+
+            if (drop && e->src == drop->src && e->val == drop->val) continue;
+            if (now && e->exp && e->exp <= now) continue;
+            copy->data[copy->len++] = *e;
+        }
+        if (add) copy->data[copy->len++] = *add;
+
+        memcpy((char*) __bsky_label_key(copy), key.start, len);
+
+        return copy;
+    }
+
+    // Publish `copy' (NULL removes subject) in slot `i'. Writer only.
+    static void __bsky_label_publish(struct bsky_label_index *idx, size_t i,
+                                     struct __bsky_label_subject *old,
+                                     struct __bsky_label_subject *copy)
+    {
+        struct __bsky_label_table *t = atomic_load_explicit(&idx->table,
+                                                    memory_order_relaxed);
+
+        if (copy && copy->len == 0) {
+            free(copy);
+            copy = NULL;
+        }
+
+        idx->labels += (copy ? copy->len : 0);
+        idx->labels -= (old ? old->len : 0);
+        idx->subjects += (copy != NULL) - (old != NULL);
+
+        if (old == NULL && copy == NULL) return;
+        if (old == NULL && atomic_load_explicit(&t->slots[i],
+                                                memory_order_relaxed) == NULL)
+            t->used++;
+
+        atomic_store_explicit(&t->slots[i], copy ? copy
+                              : &__bsky_label_tombstone, memory_order_release);
+        __bsky_label_retire(old);
+    }
+
+    enum bsky_error_code bsky_label_index_init(struct bsky_label_index *idx)
+    {
+        struct __bsky_label_table *t = __bsky_label_table_new(64);
+
+        if (t == NULL) bsky_return_error(bsky_ec_Out_of_memory);
+
+        atomic_init(&idx->table, t);
+
+        pthread_mutex_init(&idx->lock, NULL);
+        idx->names    = (struct bsky_str_map) { 0 };
+        idx->subjects = idx->labels = 0;
+        idx->next_exp = 0;
+
+        return bsky_ec_Ok;
+    }
+
+    static uint32_t __bsky_label_id(struct bsky_label_index *idx,
+                                    struct bsky_str name)
+    {
+        size_t *id = bsky_str_map_get(&idx->names, name);
+
+        if (id) return *id;
+        if (bsky_str_map_set(&idx->names, name, idx->names.len + 1)
+            != bsky_ec_Ok) {
+            return 0;
+        }
+
+        return idx->names.len;
+    }
+
+    uint32_t bsky_label_id(struct bsky_label_index *idx, struct bsky_str name)
+    {
+        pthread_mutex_lock(&idx->lock);
+        uint32_t id = __bsky_label_id(idx, name);
+        pthread_mutex_unlock(&idx->lock);
+
+        return id;
+    }
+
+    enum bsky_error_code bsky_label_index_apply(struct bsky_label_index *idx,
+                                                const struct bsky_label *label)
+    {
+        enum bsky_error_code ec = bsky_ec_Ok;
+        struct __bsky_label_subject *old, *copy;
+        struct bsky_label_entry e = { .exp = label->exp };
+        size_t  hash = __bsky_hash_bytes(label->uri.start,
+                                         bsky_str_len(label->uri));
+        int64_t now  = time(NULL);
+
+        if (bsky_str_len(label->uri) == 0 || bsky_str_len(label->src) == 0 ||
+            bsky_str_len(label->val) == 0) {
+            bsky_return_error(bsky_ec_Label_invalid);
+            return bsky_ec_Label_invalid;
+        }
+
+        pthread_mutex_lock(&idx->lock);
+
+        if ((e.src = __bsky_label_id(idx, label->src)) == 0 ||
+            (e.val = __bsky_label_id(idx, label->val)) == 0) {
+            ec = bsky_ec_Out_of_memory;
+            goto defer;
+        }
+
+        struct __bsky_label_table *t = atomic_load_explicit(&idx->table,
+                                                    memory_order_relaxed);
+        size_t i = __bsky_label_slot(t, label->uri, hash, &old);
+
+        // label which is already expired works as negation.
+        int add = !label->neg && (e.exp == 0 || e.exp > now);
+
+        if (old == NULL && !add) goto defer;
+
+        if (old == NULL && (t->used + 1) * 4 > t->cap * 3) {
+            if ((ec = __bsky_label_grow(idx)) != bsky_ec_Ok) goto defer;
+
+            t = atomic_load_explicit(&idx->table, memory_order_relaxed);
+            i = __bsky_label_slot(t, label->uri, hash, &old);
+        }
+
+        copy = __bsky_label_copy(old, label->uri, hash, &e, 0,
+                                 add ? &e : NULL);
+        if (copy == NULL) {
+            ec = bsky_ec_Out_of_memory;
+            goto defer;
+        }
+
+        // negation of label which is not there.
+        if (!add && copy->len == old->len) {
+            free(copy);
+            goto defer;
+        }
+
+        __bsky_label_publish(idx, i, old, copy);
+
+        if (add && e.exp && (idx->next_exp == 0 || e.exp < idx->next_exp))
+            idx->next_exp = e.exp;
+
+    defer:
+        pthread_mutex_unlock(&idx->lock);
+
+        if (ec != bsky_ec_Ok) bsky_log_error(ec);
+        return ec;
+    }
+
+    int bsky_label_index_has(struct bsky_label_index *idx,
+                             struct bsky_str subject, uint32_t src,
+                             uint32_t val)
+    {
+        size_t   len  = bsky_str_len(subject);
+        size_t   hash = __bsky_hash_bytes(subject.start, len);
+        int      has  = 0;
+
+        bsky_ebr_enter();
+
+        struct __bsky_label_table *t = atomic_load_explicit(&idx->table,
+                                                    memory_order_acquire);
+        size_t mask = t->cap - 1;
+
+        for (size_t i = hash & mask;; i = (i + 1) & mask) {
+            struct __bsky_label_subject *s = atomic_load_explicit(
+                                    &t->slots[i], memory_order_acquire);
+
+            if (s == NULL) break;
+            if (s == &__bsky_label_tombstone || s->hash != hash ||
+                s->key_len != len ||
+                memcmp(__bsky_label_key(s), subject.start, len) != 0) {
+                continue;
+            }
+
+            int64_t now = 0;
+            for (size_t j = 0; j < s->len; ++j) {
+                const struct bsky_label_entry *l = &s->data[j];
+
+                if (l->val != val || (src && l->src != src)) continue;
+                if (l->exp && l->exp <= (now ? now : (now = time(NULL))))
+                    continue;
+
+                has = 1;
+                break;
+            }
+            break;
+        }
+
+        bsky_ebr_leave();
+
+        return has;
+    }
+
+    size_t bsky_label_index_expire(struct bsky_label_index *idx, int64_t now)
+    {
+        size_t removed = 0;
+
+        pthread_mutex_lock(&idx->lock);
+
+        if (idx->next_exp == 0 || idx->next_exp > now) {
+            pthread_mutex_unlock(&idx->lock);
+            return 0;
+        }
+
+        struct __bsky_label_table *t = atomic_load_explicit(&idx->table,
+                                                    memory_order_relaxed);
+        int64_t next = 0;
+
+        for (size_t i = 0; i < t->cap; ++i) {
+            struct __bsky_label_subject *s = atomic_load_explicit(
+                                    &t->slots[i], memory_order_relaxed);
+            size_t expired = 0;
+
+            if (s == NULL || s == &__bsky_label_tombstone) continue;
+
+            for (size_t j = 0; j < s->len; ++j) {
+                int64_t exp = s->data[j].exp;
+
+                if (exp && exp <= now) expired++;
+                else if (exp && (next == 0 || exp < next)) next = exp;
+            }
+            if (expired == 0) continue;
+
+            struct bsky_str key = {
+                (char*) __bsky_label_key(s),
+                (char*) __bsky_label_key(s) + s->key_len,
+            };
+            struct __bsky_label_subject *copy = __bsky_label_copy(
+                                        s, key, s->hash, NULL, now, NULL);
+
+            // keep it for the next sweep.
+            if (copy == NULL) {
+                next = now;
+                continue;
+            }
+
+            __bsky_label_publish(idx, i, s, copy);
+            removed += expired;
+        }
+        idx->next_exp = next;
+
+        pthread_mutex_unlock(&idx->lock);
+
+        return removed;
+    }
+
+    void bsky_label_index_free(struct bsky_label_index *idx)
+    {
+        struct __bsky_label_table *t = atomic_load(&idx->table);
+
+        for (size_t i = 0; t && i < t->cap; ++i) {
+            struct __bsky_label_subject *s = atomic_load(&t->slots[i]);
+
+            if (s != &__bsky_label_tombstone) free(s);
+        }
+        free(t);
+
+        bsky_str_map_free(&idx->names);
+
+        pthread_mutex_destroy(&idx->lock);
+    }
+
+    static int64_t __bsky_label_days(int64_t y, int64_t m, int64_t d)
+    {
+        // days from civil, 1970-01-01 is 0.
+        y -= m <= 2;
+
+        int64_t era = (y >= 0 ? y : y - 399) / 400;
+        int64_t yoe = y - era * 400;
+        int64_t doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+        int64_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+
+        return era * 146097 + doe - 719468;
+    }
+
+    // RFC 3339 datetime of `exp' to unix seconds.
+    static int __bsky_label_time(struct bsky_str str, int64_t *out)
+    {
+        char buf[40], *p;
+        int  y, mo, d, h, mi, s, n = 0, off = 0;
+
+        if (bsky_str_len(str) >= sizeof (buf)) return 0;
+        memcpy(buf, str.start, bsky_str_len(str));
+        buf[bsky_str_len(str)] = '\0';
+
+        if (sscanf(buf, "%4d-%2d-%2d%*1[Tt ]%2d:%2d:%2d%n",
+                   &y, &mo, &d, &h, &mi, &s, &n) != 6 || n == 0) {
+            return 0;
+        }
+
+        p = buf + n;
+        if (*p == '.') while (*++p >= '0' && *p <= '9') ;
+
+        if (*p == '+' || *p == '-') {
+            int oh, om;
+
+            if (sscanf(p + 1, "%2d:%2d", &oh, &om) != 2) return 0;
+            off = (oh * 60 + om) * 60 * (*p == '-' ? -1 : 1);
+            p  += 6;
+        } else if (*p == 'Z' || *p == 'z') {
+            p++;
+        } else {
+            return 0;
+        }
+
+        if (*p || mo < 1 || mo > 12 || d < 1 || d > 31) return 0;
+
+        *out = __bsky_label_days(y, mo, d) * 86400 + h * 3600 + mi * 60 + s
+             - off;
+        return 1;
+    }
+
+    enum bsky_error_code bsky_label_stream_feed(struct bsky_label_stream *ls,
+                                                struct bsky_view frame)
+    {
+        enum bsky_error_code ec;
+        const unsigned char *p, *end = frame.end;
+        uint64_t n, len, arg;
+
+        if ((ec = bsky_firehose_decode(&ls->ev, frame)) != bsky_ec_Ok) {
+            ls->invalid++;
+            return ec;
+        }
+        ls->events++;
+
+        if (ls->ev.op != 1) {
+            ls->invalid++;
+            return bsky_ec_Ok;
+        }
+        if (!bsky_json_key_is(ls->ev.type, "#labels")) return bsky_ec_Ok;
+
+        p = ls->ev.body.start;
+        __bsky_cbor_head(&p, &n);
+
+        for (uint64_t i = 0; i < n; ++i) {
+            const unsigned char *key;
+            uint64_t labels;
+
+            __bsky_cbor_head(&p, &len);
+            key = p;
+            p  += len;
+
+            if (!__bsky_firehose_key(key, len, "labels") || *p >> 5 != 4) {
+                struct bsky_view rest = { (void*) p, (void*) end };
+                bsky_cbor_skip(&rest);
+                p = rest.start;
+                continue;
+            }
+
+            __bsky_cbor_head(&p, &labels);
+            for (uint64_t j = 0; j < labels; ++j) {
+                struct bsky_label label = { 0 };
+                uint64_t fields;
+
+                if (__bsky_cbor_head(&p, &fields) != 5) goto invalid;
+
+                for (uint64_t f = 0; f < fields; ++f) {
+                    struct bsky_str text = { 0 };
+
+                    __bsky_cbor_head(&p, &len);
+                    key = p;
+                    p  += len;
+
+                    if (*p == 0xf4 || *p == 0xf5) {
+                        if (__bsky_firehose_key(key, len, "neg"))
+                            label.neg = *p == 0xf5;
+                        p++;
+                        continue;
+                    }
+                    if (*p >> 5 != 3) {
+                        struct bsky_view rest = { (void*) p, (void*) end };
+                        bsky_cbor_skip(&rest);
+                        p = rest.start;
+                        continue;
+                    }
+
+                    __bsky_cbor_head(&p, &arg);
+                    text = (struct bsky_str) { (char*) p, (char*) p + arg };
+                    p   += arg;
+
+                    if (__bsky_firehose_key(key, len, "src")) {
+                        label.src = text;
+                    } else if (__bsky_firehose_key(key, len, "uri")) {
+                        label.uri = text;
+                    } else if (__bsky_firehose_key(key, len, "val")) {
+                        label.val = text;
+                    } else if (__bsky_firehose_key(key, len, "exp") &&
+                               !__bsky_label_time(text, &label.exp)) {
+                        goto invalid;
+                    }
+                }
+
+                if ((ec = bsky_label_index_apply(ls->index, &label))
+                    != bsky_ec_Ok) {
+                    ls->invalid++;
+                    return ec;
+                }
+                if (ls->on_label) ls->on_label(ls->user, &label);
+                ls->labels++;
+            }
+        }
+
+        ls->seq = ls->ev.seq;
+        bsky_label_index_expire(ls->index, time(NULL));
+
+        return bsky_ec_Ok;
+
+    invalid:
+        ls->invalid++;
+        bsky_return_error(bsky_ec_Label_invalid);
+        return bsky_ec_Label_invalid;
+    }
+
+    void bsky_label_stream_on_ws_message(void *ls, enum bsky_ws_opcode opcode,
+                                         struct bsky_view message)
+    {
+        if (opcode == bsky_ws_Binary) bsky_label_stream_feed(ls, message);
+    }
+
+    void bsky_label_stream_free(struct bsky_label_stream *ls)
+    {
+        bsky_da_free(&ls->ev.ops);
+    }
+
+    /*
+     * BSKY EPOCH RECLAMATION
+     */
+
+    struct __bsky_ebr_retired {
+        void    *ptr;
+        void   (*free_fn)(void *);
+        uint64_t epoch;
+    };
+
+    struct __bsky_ebr_thread {
+        _Atomic uint64_t local; // epoch << 1 | inside
+        _Atomic int      used;
+        struct __bsky_ebr_thread *next;
+
+        // owner only
+        unsigned nesting;
+        size_t   retires, head;
+        struct { struct __bsky_ebr_retired *data; size_t len, cap; } limbo;
+    };
+
+    static struct {
+        _Atomic uint64_t epoch;
+        _Atomic(struct __bsky_ebr_thread *) threads;
+
+        pthread_mutex_t lock; // registration, orphans and advance
+        struct { struct __bsky_ebr_retired *data; size_t len, cap; } orphans;
+    } __bsky_ebr = { .lock = PTHREAD_MUTEX_INITIALIZER };
+
+    static pthread_once_t __bsky_ebr_once = PTHREAD_ONCE_INIT;
+    static pthread_key_t  __bsky_ebr_key;
+    static _Thread_local struct __bsky_ebr_thread *__bsky_ebr_self;
+
+    static void __bsky_ebr_exit(void *arg)
+    {
+        struct __bsky_ebr_thread *self = arg;
+
+        pthread_mutex_lock(&__bsky_ebr.lock);
+        for (size_t i = self->head; i < self->limbo.len; ++i) {
+            if (bsky_da_push(&__bsky_ebr.orphans, self->limbo.data[i])
+                != bsky_ec_Ok) {
+                bsky_log_error(bsky_ec_Out_of_memory);
+            }
+        }
+        pthread_mutex_unlock(&__bsky_ebr.lock);
+
+        bsky_da_free(&self->limbo);
+        self->limbo = (__typeof__ (self->limbo)) { 0 };
+        self->head  = self->retires = self->nesting = 0;
+
+        atomic_store(&self->local, 0);
+        atomic_store_explicit(&self->used, 0, memory_order_release);
+    }
+
+    static void __bsky_ebr_init(void)
+    {
+        pthread_key_create(&__bsky_ebr_key, __bsky_ebr_exit);
+    }
+
+    // Record of the thread, records of exited threads are reused.
+    static struct __bsky_ebr_thread *__bsky_ebr_thread(void)
+    {
+        struct __bsky_ebr_thread *t;
+
+        if (__bsky_ebr_self) return __bsky_ebr_self;
+
+        pthread_once(&__bsky_ebr_once, __bsky_ebr_init);
+
+        for (t = atomic_load(&__bsky_ebr.threads); t; t = t->next) {
+            int unused = 0;
+
+            if (atomic_compare_exchange_strong(&t->used, &unused, 1))
+                break;
+        }
+
+        if (t == NULL) {
+            // records are never freed, advance walks list without lock.
+            if ((t = calloc(1, sizeof (*t))) == NULL) {
+                bsky_log_error(bsky_ec_Out_of_memory);
+                abort();
+            }
+            atomic_init(&t->used, 1);
+
+            pthread_mutex_lock(&__bsky_ebr.lock);
+            t->next = atomic_load(&__bsky_ebr.threads);
+            atomic_store(&__bsky_ebr.threads, t);
+            pthread_mutex_unlock(&__bsky_ebr.lock);
+        }
+
+        pthread_setspecific(__bsky_ebr_key, t);
+        return __bsky_ebr_self = t;
+    }
+
+    void bsky_ebr_enter(void)
+    {
+        struct __bsky_ebr_thread *self = __bsky_ebr_thread();
+
+        if (self->nesting++) return;
+
+        // announced epoch must still be current after announcement is
+        // visible, otherwise advance could miss the thread.
+        for (;;) {
+            uint64_t e = atomic_load(&__bsky_ebr.epoch);
+
+            atomic_store_explicit(&self->local, e << 1 | 1,
+                                  memory_order_relaxed);
+            atomic_thread_fence(memory_order_seq_cst);
+
+            if (atomic_load_explicit(&__bsky_ebr.epoch,
+                                     memory_order_relaxed) == e) {
+                break;
+            }
+        }
+    }
+
+    void bsky_ebr_leave(void)
+    {
+        struct __bsky_ebr_thread *self = __bsky_ebr_self;
+
+        if (--self->nesting == 0)
+            atomic_store_explicit(&self->local, 0, memory_order_release);
+    }
+
+    // Advance epoch if every thread inside has seen current one. Return
+    // current epoch.
+    static uint64_t __bsky_ebr_advance(void)
+    {
+        uint64_t e = atomic_load(&__bsky_ebr.epoch);
+
+        if (pthread_mutex_trylock(&__bsky_ebr.lock) != 0) return e;
+
+        for (struct __bsky_ebr_thread *t = atomic_load(&__bsky_ebr.threads);
+             t; t = t->next) {
+            uint64_t local = atomic_load(&t->local);
+
+            if ((local & 1) && (local >> 1) != e) goto unlock;
+        }
+
+        if (atomic_compare_exchange_strong(&__bsky_ebr.epoch, &e, e + 1)) e++;
+
+        // orphans are in epoch order too.
+        size_t n = 0;
+        while (n < __bsky_ebr.orphans.len &&
+               __bsky_ebr.orphans.data[n].epoch + 2 <= e) {
+            __bsky_ebr.orphans.data[n].free_fn(__bsky_ebr.orphans.data[n].ptr);
+            n++;
+        }
+        if (n) {
+            memmove(__bsky_ebr.orphans.data, __bsky_ebr.orphans.data + n,
+                    (__bsky_ebr.orphans.len - n) *
+                    sizeof (__bsky_ebr.orphans.data[0]));
+            __bsky_ebr.orphans.len -= n;
+        }
+
+    unlock:
+        pthread_mutex_unlock(&__bsky_ebr.lock);
+
+        return e;
+    }
+
+    size_t bsky_ebr_collect(void)
+    {
+        struct __bsky_ebr_thread *self = __bsky_ebr_thread();
+        uint64_t e = __bsky_ebr_advance();
+        size_t   freed = 0;
+
+        while (self->head < self->limbo.len &&
+               self->limbo.data[self->head].epoch + 2 <= e) {
+            struct __bsky_ebr_retired *r = &self->limbo.data[self->head++];
+
+            r->free_fn(r->ptr);
+            freed++;
+        }
+        if (self->head == self->limbo.len) self->head = self->limbo.len = 0;
+
+        return freed;
+    }
+
+    enum bsky_error_code bsky_ebr_retire(void *ptr, void (*free_fn)(void *))
+    {
+        struct __bsky_ebr_thread *self = __bsky_ebr_thread();
+        struct __bsky_ebr_retired r = {
+            ptr, free_fn, atomic_load(&__bsky_ebr.epoch)
+        };
+
+        // limbo is compacted only when it drains.
+        if (self->head && self->limbo.len == self->limbo.cap) {
+            memmove(self->limbo.data, self->limbo.data + self->head,
+                    (self->limbo.len - self->head) * sizeof (r));
+            self->limbo.len -= self->head;
+            self->head       = 0;
+        }
+
+        if (bsky_da_push(&self->limbo, r) != bsky_ec_Ok)
+            bsky_return_error(bsky_ec_Out_of_memory);
+
+        if (++self->retires % BSKY_EBR_COLLECT == 0) bsky_ebr_collect();
+
+        return bsky_ec_Ok;
+    }
+
+    void bsky_ebr_flush(void)
+    {
+        struct __bsky_ebr_thread *self = __bsky_ebr_thread();
+
+        for (;;) {
+            bsky_ebr_collect();
+
+            pthread_mutex_lock(&__bsky_ebr.lock);
+            int orphans = __bsky_ebr.orphans.len != 0;
+            pthread_mutex_unlock(&__bsky_ebr.lock);
+
+            if (self->head == self->limbo.len && !orphans) break;
+            sched_yield();
+        }
+    }
+
+    enum bsky_error_code bsky_ebr_retire_tmp(void)
+    {
+        enum bsky_error_code ec;
+
+        if (__bsky_default_tmp_arena.allocator == NULL) return bsky_ec_Ok;
+
+        ec = bsky_ebr_retire(__bsky_default_tmp_arena.allocator,
+                             __bsky_tmp_pool_put);
+        if (ec == bsky_ec_Ok) {
+            __bsky_default_tmp_arena = (struct __bsky_default_tmp_arena) { 0 };
+        }
+
+        return ec;
+    }
+
+    /*
+     * BSKY THREAD POOL
+     */
+
+    #include <limits.h>
+    #include <sys/syscall.h>
+    #include <linux/futex.h>
+
+    static void __bsky_futex_wait(_Atomic uint32_t *addr, uint32_t value,
+                                  uint64_t timeout_ns)
+    {
+        struct timespec ts = { timeout_ns / 1000000000ull,
+                               timeout_ns % 1000000000ull };
+
+        syscall(SYS_futex, addr, FUTEX_WAIT_PRIVATE, value,
+                timeout_ns ? &ts : NULL, NULL, 0);
+    }
+
+    static void __bsky_futex_wake(_Atomic uint32_t *addr, int n)
+    {
+        syscall(SYS_futex, addr, FUTEX_WAKE_PRIVATE, n, NULL, NULL, 0);
+    }
+
+    static _Thread_local struct __bsky_pool_worker *__bsky_pool_self;
+
+    static struct __bsky_deque_array *__bsky_deque_array_new(int64_t size)
+    {
+        struct __bsky_deque_array *a = calloc(1, sizeof (*a) +
+                                              size * sizeof (a->data[0]));
+
+        if (a) a->size = size;
+        return a;
+    }
+
+    static enum bsky_error_code __bsky_deque_push(struct __bsky_deque *d,
+                                                  struct bsky_task *task)
+    {
+        int64_t b = atomic_load_explicit(&d->bottom, memory_order_relaxed);
+        int64_t t = atomic_load_explicit(&d->top, memory_order_acquire);
+        struct __bsky_deque_array *a = atomic_load_explicit(&d->array,
+                                                    memory_order_relaxed);
+
+        if (b - t > a->size - 1) {
+            struct __bsky_deque_array *grown = __bsky_deque_array_new(
+                                                            a->size * 2);
+            if (grown == NULL) {
+                bsky_return_error(bsky_ec_Out_of_memory);
+                return bsky_ec_Out_of_memory;
+            }
+
+            for (int64_t i = t; i < b; ++i) {
+                atomic_store_explicit(&grown->data[i % grown->size],
+                    atomic_load_explicit(&a->data[i % a->size],
+                                         memory_order_relaxed),
+                    memory_order_relaxed);
+            }
+
+            // thieves can still read the old array.
+            atomic_store_explicit(&d->array, grown, memory_order_release);
+            bsky_ebr_retire(a, free);
+            a = grown;
+        }
+
+        atomic_store_explicit(&a->data[b % a->size], task,
+                              memory_order_relaxed);
+        atomic_store_explicit(&d->bottom, b + 1, memory_order_release);
+
+        return bsky_ec_Ok;
+    }
+
+    static struct bsky_task *__bsky_deque_take(struct __bsky_deque *d)
+    {
+        int64_t b = atomic_load_explicit(&d->bottom, memory_order_relaxed) - 1;
+        struct __bsky_deque_array *a = atomic_load_explicit(&d->array,
+                                                    memory_order_relaxed);
+        struct bsky_task *task = NULL;
+        int64_t t;
+
+        atomic_store_explicit(&d->bottom, b, memory_order_relaxed);
+        atomic_thread_fence(memory_order_seq_cst);
+        t = atomic_load_explicit(&d->top, memory_order_relaxed);
+
+        if (t <= b) {
+            task = atomic_load_explicit(&a->data[b % a->size],
+                                        memory_order_relaxed);
+            if (t == b) {
+                // the last one, race with thieves.
+                if (!atomic_compare_exchange_strong_explicit(&d->top, &t,
+                        t + 1, memory_order_seq_cst, memory_order_relaxed)) {
+                    task = NULL;
+                }
+                atomic_store_explicit(&d->bottom, b + 1, memory_order_relaxed);
+            }
+        } else {
+            atomic_store_explicit(&d->bottom, b + 1, memory_order_relaxed);
+        }
+
+        return task;
+    }
+
+    static struct bsky_task *__bsky_deque_steal(struct __bsky_deque *d)
+    {
+        struct bsky_task *task = NULL;
+        int64_t t = atomic_load_explicit(&d->top, memory_order_acquire);
+
+        atomic_thread_fence(memory_order_seq_cst);
+        int64_t b = atomic_load_explicit(&d->bottom, memory_order_acquire);
+
+        if (t < b) {
+            bsky_ebr_enter();
+
+            struct __bsky_deque_array *a = atomic_load_explicit(&d->array,
+                                                    memory_order_acquire);
+            task = atomic_load_explicit(&a->data[t % a->size],
+                                        memory_order_relaxed);
+            if (!atomic_compare_exchange_strong_explicit(&d->top, &t, t + 1,
+                    memory_order_seq_cst, memory_order_relaxed)) {
+                task = NULL;
+            }
+
+            bsky_ebr_leave();
+        }
+
+        return task;
+    }
+
+    static int __bsky_deque_empty(struct __bsky_deque *d)
+    {
+        return atomic_load(&d->bottom) <= atomic_load(&d->top);
+    }
+
+    static struct bsky_task *__bsky_pool_dequeue(struct bsky_pool *pool)
+    {
+        struct bsky_task *task = NULL;
+
+        if (atomic_load(&pool->queued) == 0) return NULL;
+
+        pthread_mutex_lock(&pool->lock);
+        if (pool->head < pool->queue.len) {
+            task = pool->queue.data[pool->head++];
+            atomic_fetch_sub(&pool->queued, 1);
+            if (pool->head == pool->queue.len)
+                pool->head = pool->queue.len = 0;
+        }
+        pthread_mutex_unlock(&pool->lock);
+
+        return task;
+    }
+
+    // Own deque, then random victims, then shared queue.
+    static struct bsky_task *__bsky_pool_find(struct bsky_pool *pool,
+                                              struct __bsky_pool_worker *self)
+    {
+        struct bsky_task *task;
+        uint64_t seed = self ? self->seed : (uintptr_t) &task;
+
+        if (self && (task = __bsky_deque_take(&self->deque))) return task;
+
+        for (size_t k = 0; k < pool->workers; ++k) {
+            seed = seed * 6364136223846793005ull + 1442695040888963407ull;
+
+            size_t i = (seed >> 33) % pool->workers;
+            if (&pool->worker[i] == self) continue;
+
+            if ((task = __bsky_deque_steal(&pool->worker[i].deque))) {
+                atomic_fetch_add_explicit(&pool->stolen, 1,
+                                          memory_order_relaxed);
+                break;
+            }
+        }
+        if (self) self->seed = seed;
+
+        return task ? task : __bsky_pool_dequeue(pool);
+    }
+
+    static void __bsky_pool_run(struct bsky_pool *pool, struct bsky_task *task)
+    {
+        struct bsky_task_group *group = task->group;
+
+        task->fn(task->arg);
+        atomic_fetch_add_explicit(&pool->executed, 1, memory_order_relaxed);
+
+        // waiter can return as soon as pending is 0, group is not touched
+        // after (wake of gone address is harmless).
+        if (group && atomic_fetch_sub(&group->pending, 1) == 1)
+            __bsky_futex_wake(&group->pending, INT_MAX);
+    }
+
+    static int __bsky_pool_has_work(struct bsky_pool *pool)
+    {
+        if (atomic_load(&pool->queued)) return 1;
+
+        for (size_t i = 0; i < pool->workers; ++i)
+            if (!__bsky_deque_empty(&pool->worker[i].deque)) return 1;
+
+        return 0;
+    }
+
+    static void __bsky_pool_notify(struct bsky_pool *pool)
+    {
+        atomic_thread_fence(memory_order_seq_cst);
+
+        if (atomic_load(&pool->idle)) {
+            pthread_mutex_lock(&pool->lock);
+            pthread_cond_signal(&pool->wake);
+            pthread_mutex_unlock(&pool->lock);
+        }
+    }
+
+    static void *__bsky_pool_main(void *arg)
+    {
+        struct __bsky_pool_worker *self = arg;
+        struct bsky_pool *pool = self->pool;
+
+        __bsky_pool_self = self;
+
+        if (pool->pin) {
+            long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+            unsigned long mask[16] = { 0 };
+            size_t cpu = self->index % (cpus > 0 ? cpus : 1);
+
+            if (cpu < sizeof (mask) * 8) {
+                mask[cpu / (sizeof (mask[0]) * 8)] |=
+                    1ul << cpu % (sizeof (mask[0]) * 8);
+                syscall(SYS_sched_setaffinity, 0, sizeof (mask), mask);
+            }
+        }
+
+        while (!atomic_load(&pool->stop)) {
+            struct bsky_task *task = __bsky_pool_find(pool, self);
+
+            if (task) {
+                if (atomic_exchange(&self->reset_tmp, 0))
+                    bsky_default_tmp_reset();
+
+                __bsky_pool_run(pool, task);
+                continue;
+            }
+
+            // idle is counted before the last look, so submitter either
+            // sees sleeper or sleeper sees the task.
+            pthread_mutex_lock(&pool->lock);
+            atomic_fetch_add(&pool->idle, 1);
+            if (!atomic_load(&pool->stop) && !__bsky_pool_has_work(pool))
+                pthread_cond_wait(&pool->wake, &pool->lock);
+            atomic_fetch_sub(&pool->idle, 1);
+            pthread_mutex_unlock(&pool->lock);
+        }
+
+        bsky_default_tmp_free();
+
+        return NULL;
+    }
+
+    enum bsky_error_code bsky_pool_start(struct bsky_pool *pool)
+    {
+        enum bsky_error_code ec = bsky_ec_Ok;
+        size_t started = 0;
+
+        if (pool->workers == 0) {
+            long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+            pool->workers = cpus > 0 ? cpus : 1;
+        }
+
+        atomic_init(&pool->executed, 0);
+        atomic_init(&pool->stolen, 0);
+        atomic_init(&pool->idle, 0);
+        atomic_init(&pool->stop, 0);
+        atomic_init(&pool->queued, 0);
+        pthread_mutex_init(&pool->lock, NULL);
+        pthread_cond_init(&pool->wake, NULL);
+        pool->queue = (__typeof__ (pool->queue)) { 0 };
+        pool->head  = 0;
+
+        pool->worker = calloc(pool->workers, sizeof (pool->worker[0]));
+        if (pool->worker == NULL) {
+            ec = bsky_ec_Out_of_memory;
+            goto defer;
+        }
+
+        for (size_t i = 0; i < pool->workers; ++i) {
+            struct __bsky_pool_worker *w = &pool->worker[i];
+            struct __bsky_deque_array *a = __bsky_deque_array_new(
+                                                        BSKY_POOL_DEQUE);
+
+            if (a == NULL) {
+                ec = bsky_ec_Out_of_memory;
+                goto defer;
+            }
+
+            atomic_init(&w->deque.top, 0);
+            atomic_init(&w->deque.bottom, 0);
+            atomic_init(&w->deque.array, a);
+            atomic_init(&w->reset_tmp, 0);
+            w->pool  = pool;
+            w->index = i;
+            w->seed  = i + 1;
+        }
+
+        for (; started < pool->workers; ++started) {
+            if (pthread_create(&pool->worker[started].thread, NULL,
+                               __bsky_pool_main, &pool->worker[started])) {
+                ec = bsky_ec_Pool_thread;
+                goto defer;
+            }
+        }
+
+        return bsky_ec_Ok;
+
+    defer:
+        atomic_store(&pool->stop, 1);
+        pthread_mutex_lock(&pool->lock);
+        pthread_cond_broadcast(&pool->wake);
+        pthread_mutex_unlock(&pool->lock);
+
+        for (size_t i = 0; i < started; ++i)
+            pthread_join(pool->worker[i].thread, NULL);
+        for (size_t i = 0; pool->worker && i < pool->workers; ++i)
+            free(atomic_load(&pool->worker[i].deque.array));
+        free(pool->worker);
+        pool->worker = NULL;
+
+        pthread_cond_destroy(&pool->wake);
+        pthread_mutex_destroy(&pool->lock);
+
+        bsky_log_error(ec);
+        return ec;
+    }
+
+    enum bsky_error_code bsky_pool_submit(struct bsky_pool *pool,
+                                          struct bsky_task *task)
+    {
+        enum bsky_error_code ec;
+        struct __bsky_pool_worker *self = __bsky_pool_self;
+
+        if (task->group) atomic_fetch_add(&task->group->pending, 1);
+
+        if (self && self->pool == pool) {
+            ec = __bsky_deque_push(&self->deque, task);
+        } else {
+            pthread_mutex_lock(&pool->lock);
+            ec = bsky_da_push(&pool->queue, task);
+            if (ec == bsky_ec_Ok) atomic_fetch_add(&pool->queued, 1);
+            pthread_mutex_unlock(&pool->lock);
+        }
+
+        if (ec != bsky_ec_Ok) {
+            if (task->group) atomic_fetch_sub(&task->group->pending, 1);
+            bsky_log_error(ec);
+            return ec;
+        }
+
+        __bsky_pool_notify(pool);
+
+        return bsky_ec_Ok;
+    }
+
+    void bsky_pool_wait(struct bsky_pool *pool, struct bsky_task_group *group)
+    {
+        struct __bsky_pool_worker *self = __bsky_pool_self;
+
+        if (self && self->pool != pool) self = NULL;
+
+        for (;;) {
+            uint32_t pending = atomic_load(&group->pending);
+            struct bsky_task *task;
+
+            if (pending == 0) break;
+
+            if ((task = __bsky_pool_find(pool, self)) != NULL) {
+                __bsky_pool_run(pool, task);
+                continue;
+            }
+
+            // tasks of group run elsewhere, look for new work now and then.
+            __bsky_futex_wait(&group->pending, pending, 1000000);
+        }
+    }
+
+    struct __bsky_pool_for {
+        void (*fn)(void *user, size_t begin, size_t end);
+        void  *user;
+        size_t grain;
+
+        struct bsky_pool      *pool;
+        struct bsky_task_group group;
+        struct __bsky_pool_range {
+            struct bsky_task        task;
+            struct __bsky_pool_for *f;
+            size_t begin, end;
+        } *ranges;
+        _Atomic size_t next;
+    };
+
+    static void __bsky_pool_range(void *arg)
+    {
+        struct __bsky_pool_range *r = arg;
+        struct __bsky_pool_for   *f = r->f;
+        size_t begin = r->begin, end = r->end;
+
+        // right half is given away, left is split further.
+        while (end - begin > f->grain) {
+            size_t mid = begin + (end - begin) / 2;
+            struct __bsky_pool_range *right =
+                &f->ranges[atomic_fetch_add_explicit(&f->next, 1,
+                                                     memory_order_relaxed)];
+
+            *right = (struct __bsky_pool_range) {
+                { __bsky_pool_range, right, &f->group }, f, mid, end,
+            };
+            if (bsky_pool_submit(f->pool, &right->task) != bsky_ec_Ok) break;
+            end = mid;
+        }
+
+        f->fn(f->user, begin, end);
+    }
+
+    enum bsky_error_code bsky_pool_for(struct bsky_pool *pool, size_t begin,
+                                       size_t end, size_t grain,
+                                       void (*fn)(void *user, size_t begin,
+                                                  size_t end),
+                                       void *user)
+    {
+        size_t n = end > begin ? end - begin : 0;
+        struct __bsky_pool_for f = { fn, user, grain, pool };
+
+        if (n == 0) return bsky_ec_Ok;
+        if (f.grain == 0) f.grain = n / (pool->workers * 8);
+        if (f.grain == 0) f.grain = 1;
+
+        // every split makes one range, leaves are at least grain / 2.
+        f.ranges = malloc((2 * (n / f.grain) + 2) * sizeof (f.ranges[0]));
+        if (f.ranges == NULL) {
+            bsky_return_error(bsky_ec_Out_of_memory);
+            return bsky_ec_Out_of_memory;
+        }
+
+        atomic_init(&f.next, 1);
+        f.ranges[0] = (struct __bsky_pool_range) {
+            { __bsky_pool_range, &f.ranges[0], NULL }, &f, begin, end,
+        };
+
+        __bsky_pool_range(&f.ranges[0]);
+        bsky_pool_wait(pool, &f.group);
+
+        free(f.ranges);
+
+        return bsky_ec_Ok;
+    }
+
+    int bsky_pool_worker(void)
+    {
+        return __bsky_pool_self ? (int) __bsky_pool_self->index : -1;
+    }
+
+    void bsky_pool_tmp_reset(struct bsky_pool *pool)
+    {
+        for (size_t i = 0; i < pool->workers; ++i)
+            atomic_store(&pool->worker[i].reset_tmp, 1);
+    }
+
+    void bsky_pool_stop(struct bsky_pool *pool)
+    {
+        if (pool->worker == NULL) return;
+
+        atomic_store(&pool->stop, 1);
+        pthread_mutex_lock(&pool->lock);
+        pthread_cond_broadcast(&pool->wake);
+        pthread_mutex_unlock(&pool->lock);
+
+        for (size_t i = 0; i < pool->workers; ++i) {
+            pthread_join(pool->worker[i].thread, NULL);
+            free(atomic_load(&pool->worker[i].deque.array));
+        }
+
+        free(pool->worker);
+        pool->worker = NULL;
+        bsky_da_free(&pool->queue);
+
+        pthread_cond_destroy(&pool->wake);
+        pthread_mutex_destroy(&pool->lock);
+    }
+
+    /*
+     * BSKY MPMC QUEUE
+     */
+    enum bsky_error_code bsky_mpmc_init(struct bsky_mpmc *q, size_t cap)
+    {
+        size_t size = 2;
+
+        while (size < cap) size <<= 1;
+
+        memset(q, 0, sizeof (*q));
+        atomic_init(&q->head, 0);
+        atomic_init(&q->tail, 0);
+        atomic_init(&q->pushes, 0);
+        atomic_init(&q->pops, 0);
+        atomic_init(&q->push_waiters, 0);
+        atomic_init(&q->pop_waiters, 0);
+        atomic_init(&q->closed, 0);
+
+        q->cells = malloc(size * sizeof (q->cells[0]));
+        if (q->cells == NULL) {
+            bsky_return_error(bsky_ec_Out_of_memory);
+            return bsky_ec_Out_of_memory;
+        }
+
+        for (size_t i = 0; i < size; ++i) {
+            atomic_init(&q->cells[i].seq, i);
+            q->cells[i].item = NULL;
+        }
+        q->mask = size - 1;
+
+        return bsky_ec_Ok;
+    }
+
+    // Fence pairs with increment of waiters before the last try of waiter.
+    static void __bsky_mpmc_notify(_Atomic uint32_t *waiters,
+                                   _Atomic uint32_t *word, size_t n)
+    {
+        atomic_thread_fence(memory_order_seq_cst);
+
+        if (atomic_load_explicit(waiters, memory_order_relaxed)) {
+            atomic_fetch_add(word, 1);
+            __bsky_futex_wake(word, n > INT_MAX ? INT_MAX : (int) n);
+        }
+    }
+
+    // Claim up to `n' positions whose cells have sequence `pos + i + full'.
+    static size_t __bsky_mpmc_claim(struct bsky_mpmc *q, _Atomic size_t *index,
+                                    size_t full, size_t n, size_t *pos)
+    {
+        size_t at = atomic_load_explicit(index, memory_order_relaxed), k;
+
+        for (;;) {
+            for (k = 0; k < n; ++k) {
+                struct __bsky_mpmc_cell *cell = &q->cells[(at + k) & q->mask];
+                size_t seq = atomic_load_explicit(&cell->seq,
+                                                  memory_order_acquire);
+                if (seq != at + k + full) break;
+            }
+
+            if (k == 0) {
+                struct __bsky_mpmc_cell *cell = &q->cells[at & q->mask];
+                intptr_t dif = (intptr_t) (atomic_load_explicit(&cell->seq,
+                                    memory_order_acquire) - (at + full));
+
+                // full for producer (empty for consumer).
+                if (dif < 0) return 0;
+
+                at = atomic_load_explicit(index, memory_order_relaxed);
+                continue;
+            }
+
+            if (atomic_compare_exchange_weak_explicit(index, &at, at + k,
+                    memory_order_relaxed, memory_order_relaxed)) {
+                break;
+            }
+        }
+
+        *pos = at;
+        return k;
+    }
+
+    size_t bsky_mpmc_push_n(struct bsky_mpmc *q, void **items, size_t n)
+    {
+        size_t pos, k = __bsky_mpmc_claim(q, &q->tail, 0, n, &pos);
+
+        for (size_t i = 0; i < k; ++i) {
+            struct __bsky_mpmc_cell *cell = &q->cells[(pos + i) & q->mask];
+
+            cell->item = items[i];
+            atomic_store_explicit(&cell->seq, pos + i + 1,
+                                  memory_order_release);
+        }
+
+        if (k) __bsky_mpmc_notify(&q->pop_waiters, &q->pushes, k);
+
+        return k;
+    }
+
+    size_t bsky_mpmc_pop_n(struct bsky_mpmc *q, void **items, size_t n)
+    {
+        size_t pos, k = __bsky_mpmc_claim(q, &q->head, 1, n, &pos);
+
+        for (size_t i = 0; i < k; ++i) {
+            struct __bsky_mpmc_cell *cell = &q->cells[(pos + i) & q->mask];
+
+            items[i] = cell->item;
+            atomic_store_explicit(&cell->seq, pos + i + q->mask + 1,
+                                  memory_order_release);
+        }
+
+        if (k) __bsky_mpmc_notify(&q->push_waiters, &q->pops, k);
+
+        return k;
+    }
+
+    int bsky_mpmc_push(struct bsky_mpmc *q, void *item)
+    {
+        return bsky_mpmc_push_n(q, &item, 1) == 1;
+    }
+
+    void *bsky_mpmc_pop(struct bsky_mpmc *q)
+    {
+        void *item = NULL;
+
+        bsky_mpmc_pop_n(q, &item, 1);
+
+        return item;
+    }
+
+    int bsky_mpmc_push_wait(struct bsky_mpmc *q, void *item)
+    {
+        unsigned spins = 0;
+
+        while (!bsky_mpmc_push(q, item)) {
+            if (atomic_load(&q->closed)) return 0;
+
+            if (spins < 128) {
+                __bsky_spsc_backoff(&spins);
+                continue;
+            }
+
+            atomic_fetch_add(&q->push_waiters, 1);
+            uint32_t pops = atomic_load(&q->pops);
+            int done = bsky_mpmc_push(q, item);
+            if (!done && !atomic_load(&q->closed))
+                __bsky_futex_wait(&q->pops, pops, 0);
+            atomic_fetch_sub(&q->push_waiters, 1);
+
+            if (done) return 1;
+        }
+
+        return 1;
+    }
+
+    void *bsky_mpmc_pop_wait(struct bsky_mpmc *q)
+    {
+        unsigned spins = 0;
+        void *item;
+
+        while ((item = bsky_mpmc_pop(q)) == NULL) {
+            if (atomic_load(&q->closed)) return bsky_mpmc_pop(q);
+
+            if (spins < 128) {
+                __bsky_spsc_backoff(&spins);
+                continue;
+            }
+
+            atomic_fetch_add(&q->pop_waiters, 1);
+            uint32_t pushes = atomic_load(&q->pushes);
+            item = bsky_mpmc_pop(q);
+            if (item == NULL && !atomic_load(&q->closed))
+                __bsky_futex_wait(&q->pushes, pushes, 0);
+            atomic_fetch_sub(&q->pop_waiters, 1);
+
+            if (item) return item;
+        }
+
+        return item;
+    }
+
+    void bsky_mpmc_close(struct bsky_mpmc *q)
+    {
+        atomic_store(&q->closed, 1);
+
+        atomic_fetch_add(&q->pushes, 1);
+        atomic_fetch_add(&q->pops, 1);
+        __bsky_futex_wake(&q->pushes, INT_MAX);
+        __bsky_futex_wake(&q->pops, INT_MAX);
+    }
+
+    size_t bsky_mpmc_depth(struct bsky_mpmc *q)
+    {
+        size_t head = atomic_load_explicit(&q->head, memory_order_acquire);
+        size_t tail = atomic_load_explicit(&q->tail, memory_order_acquire);
+
+        return tail > head ? tail - head : 0;
+    }
+
+    void bsky_mpmc_free(struct bsky_mpmc *q)
+    {
+        free(q->cells);
+        q->cells = NULL;
+    }
+
+    /*
+     * BSKY JSON SNAPSHOT
+     */
+
+    // Reserve zeroed and aligned `size' bytes at the end of the document.
+    static enum bsky_error_code __bsky_snap_reserve(struct bsky_snap_writer *w,
+                                                    size_t size, size_t *at)
+    {
+        size_t len = (w->doc.len + 7) & ~(size_t) 7;
+
+        if (len + size > w->doc.cap) {
+            size_t cap = w->doc.cap ? w->doc.cap : 256;
+            char  *data;
+
+            while (cap < len + size) cap *= 2;
+            if ((data = realloc(w->doc.data, cap)) == NULL) {
+                bsky_return_error(bsky_ec_Out_of_memory);
+                return bsky_ec_Out_of_memory;
+            }
+            w->doc.data = data;
+            w->doc.cap  = cap;
+        }
+
+        memset(w->doc.data + w->doc.len, 0, len + size - w->doc.len);
+        w->doc.len = len + size;
+        *at = len;
+
+        return bsky_ec_Ok;
+    }
+
+    static enum bsky_error_code __bsky_snap_str(struct bsky_snap_writer *w,
+                                                size_t at, const char *str,
+                                                size_t len)
+    {
+        enum bsky_error_code ec;
+        struct bsky_snap_node node = { bsky_json_Str, len };
+        size_t pos;
+
+        if (len > UINT32_MAX) bsky_return_error(bsky_ec_Snapshot_invalid);
+        if ((ec = __bsky_snap_reserve(w, len + 1, &pos)) != bsky_ec_Ok)
+            return ec;
+
+        memcpy(w->doc.data + pos, str, len);
+        node.off = pos - at;
+        memcpy(w->doc.data + at, &node, sizeof (node));
+
+        return bsky_ec_Ok;
+    }
+
+    // Children are placed after parent, positions because `doc' moves.
+    static enum bsky_error_code __bsky_snap_encode(struct bsky_snap_writer *w,
+                                                   size_t at,
+                                                   struct bsky_json *json)
+    {
+        enum bsky_error_code ec = bsky_ec_Ok;
+        struct bsky_snap_node node = { json->var };
+        const size_t size = sizeof (node);
+        size_t pos;
+
+        switch (json->var) {
+        case bsky_json_Arr:
+            if (json->arr.len > UINT32_MAX)
+                bsky_return_error(bsky_ec_Snapshot_invalid);
+            if ((ec = __bsky_snap_reserve(w, json->arr.len * size, &pos))
+                != bsky_ec_Ok) {
+                return ec;
+            }
+
+            node.len = json->arr.len;
+            node.off = pos - at;
+            memcpy(w->doc.data + at, &node, size);
+
+            for (size_t i = 0; i < json->arr.len && ec == bsky_ec_Ok; ++i)
+                ec = __bsky_snap_encode(w, pos + i * size, &json->arr.data[i]);
+            return ec;
+
+        case bsky_json_Dct:
+            if (json->dct.len > UINT32_MAX)
+                bsky_return_error(bsky_ec_Snapshot_invalid);
+            if ((ec = __bsky_snap_reserve(w, json->dct.len * 2 * size, &pos))
+                != bsky_ec_Ok) {
+                return ec;
+            }
+
+            node.len = json->dct.len;
+            node.off = pos - at;
+            memcpy(w->doc.data + at, &node, size);
+
+            for (size_t i = 0; i < json->dct.len && ec == bsky_ec_Ok; ++i) {
+                struct bsky_json_pair *pair = &json->dct.data[i];
+
+                ec = __bsky_snap_str(w, pos + 2 * i * size, pair->name,
+                                     strlen(pair->name));
+                if (ec == bsky_ec_Ok) {
+                    ec = __bsky_snap_encode(w, pos + (2 * i + 1) * size,
+                                            &pair->value);
+                }
+            }
+            return ec;
+
+        case bsky_json_Str:
+            return __bsky_snap_str(w, at, json->str, strlen(json->str));
+
+        case bsky_json_Num:
+            node.num = json->num;
+            break;
+
+        case bsky_json_Bool:
+            node._bool = json->_bool;
+            break;
+
+        case bsky_json_Null:
+            break;
+
+        default:
+            bsky_return_error(bsky_ec_Snapshot_invalid);
+            return bsky_ec_Snapshot_invalid;
+        }
+
+        memcpy(w->doc.data + at, &node, size);
+
+        return bsky_ec_Ok;
+    }
+
+    static enum bsky_error_code __bsky_snap_flush(struct bsky_snap_writer *w)
+    {
+        enum bsky_error_code ec;
+
+        ec = __bsky_capture_write_all(w->fd, w->buf.data, w->buf.len);
+        w->buf.len = 0;
+
+        return ec;
+    }
+
+    static enum bsky_error_code __bsky_snap_write(struct bsky_snap_writer *w,
+                                                  const void *data, size_t len)
+    {
+        enum bsky_error_code ec;
+
+        if (w->buf.cap - w->buf.len < len &&
+            (ec = __bsky_snap_flush(w)) != bsky_ec_Ok) {
+            return ec;
+        }
+
+        // larger than buffer goes directly.
+        if (w->buf.cap < len)
+            return __bsky_capture_write_all(w->fd, data, len);
+
+        memcpy(w->buf.data + w->buf.len, data, len);
+        w->buf.len += len;
+
+        return bsky_ec_Ok;
+    }
+
+    enum bsky_error_code bsky_snap_writer_open(struct bsky_snap_writer *w,
+                                               const char *path,
+                                               enum bsky_error_code *ec)
+    {
+        struct bsky_snap_header header = { BSKY_SNAP_MAGIC };
+
+        *w = (struct bsky_snap_writer) { .fd = -1 };
+        *ec = bsky_ec_Ok;
+
+        // written aside and renamed, old file is valid until then.
+        w->path = strdup(path);
+        bsky_sb_push_str(&w->tmp, bsky_mk_str((char*) path));
+        bsky_sb_push_str(&w->tmp, bsky_mk_str(".tmp"));
+        if (w->path == NULL || w->tmp.data == NULL)
+            bsky_defer_ec(bsky_ec_Out_of_memory);
+
+        w->fd = open(w->tmp.data, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+                     0644);
+        if (w->fd < 0) bsky_defer_ec(bsky_ec_Io);
+
+        w->buf.data = malloc(BSKY_SNAP_BUFFER);
+        if (w->buf.data == NULL) bsky_defer_ec(bsky_ec_Out_of_memory);
+        w->buf.cap = BSKY_SNAP_BUFFER;
+
+        // size is written on close.
+        memcpy(w->buf.data, &header, sizeof (header));
+        w->buf.len = w->bytes = sizeof (header);
+
+        return *ec;
+
+    defer:
+        if (w->fd >= 0) {
+            close(w->fd);
+            unlink(w->tmp.data);
+        }
+        w->fd = -1;
+        free(w->path);
+        w->path = NULL;
+        bsky_da_free(&w->tmp);
+        w->tmp = (struct bsky_str_builder) { 0 };
+        bsky_da_free(&w->buf);
+        w->buf = (__typeof__ (w->buf)) { 0 };
+        return *ec;
+    }
+
+    enum bsky_error_code bsky_snap_put(struct bsky_snap_writer *w,
+                                       struct bsky_str key,
+                                       struct bsky_json json)
+    {
+        enum bsky_error_code ec;
+        size_t at, len = bsky_str_len(key);
+        size_t *seen = bsky_str_map_get(&w->seen, key);
+        struct bsky_snap_slot slot = { __bsky_hash_bytes(key.start, len),
+                                       w->bytes };
+
+        w->doc.len = 0;
+        if ((ec = __bsky_snap_reserve(w, 2 * sizeof (struct bsky_snap_node),
+                                      &at)) != bsky_ec_Ok ||
+            (ec = __bsky_snap_str(w, 0, key.start, len)) != bsky_ec_Ok ||
+            (ec = __bsky_snap_encode(w, sizeof (struct bsky_snap_node),
+                                     &json)) != bsky_ec_Ok) {
+            return ec;
+        }
+
+        // document starts aligned, so relative offsets stay aligned.
+        w->doc.len = (w->doc.len + 7) & ~(size_t) 7;
+
+        if ((ec = __bsky_snap_write(w, w->doc.data, w->doc.len)) != bsky_ec_Ok)
+            return ec;
+
+        w->bytes += w->doc.len;
+        w->docs++;
+
+        // older document of key stays in file unreferenced.
+        if (seen) {
+            w->keys.data[*seen] = slot;
+            return bsky_ec_Ok;
+        }
+
+        if ((ec = bsky_da_push(&w->keys, slot)) != bsky_ec_Ok) return ec;
+        if ((ec = bsky_str_map_set(&w->seen, key, w->keys.len - 1))
+            != bsky_ec_Ok) {
+            w->keys.len--;
+            return ec;
+        }
+
+        return bsky_ec_Ok;
+    }
+
+    enum bsky_error_code bsky_snap_writer_close(struct bsky_snap_writer *w)
+    {
+        enum bsky_error_code ec = bsky_ec_Ok;
+        struct bsky_snap_header header = { BSKY_SNAP_MAGIC };
+        struct bsky_snap_slot  *slots  = NULL;
+        size_t cap = 2;
+
+        if (w->fd < 0) return ec;
+
+        // load factor is at most 1/2.
+        while (cap < 2 * w->keys.len) cap <<= 1;
+
+        slots = calloc(cap, sizeof (*slots));
+        if (slots == NULL) {
+            ec = bsky_ec_Out_of_memory;
+            goto defer;
+        }
+
+        for (size_t i = 0; i < w->keys.len; ++i) {
+            size_t j = w->keys.data[i].hash & (cap - 1);
+
+            while (slots[j].key) j = (j + 1) & (cap - 1);
+            slots[j] = w->keys.data[i];
+        }
+
+        header.docs      = w->keys.len;
+        header.index     = w->bytes;
+        header.index_cap = cap;
+        header.size      = w->bytes + cap * sizeof (*slots);
+
+        if ((ec = __bsky_snap_write(w, slots, cap * sizeof (*slots)))
+            != bsky_ec_Ok ||
+            (ec = __bsky_snap_flush(w)) != bsky_ec_Ok) {
+            goto defer;
+        }
+
+        // header makes file valid only after everything is written, and
+        // it is on disk before file replaces the old one.
+        if (fdatasync(w->fd) != 0 ||
+            pwrite(w->fd, &header, sizeof (header), 0)
+            != (ssize_t) sizeof (header) ||
+            fdatasync(w->fd) != 0) {
+            ec = bsky_ec_Io;
+        }
+        w->bytes = header.size;
+
+    defer:
+        if (close(w->fd) != 0 && ec == bsky_ec_Ok) ec = bsky_ec_Io;
+        w->fd = -1;
+
+        if (ec == bsky_ec_Ok && rename(w->tmp.data, w->path) != 0)
+            ec = bsky_ec_Io;
+        if (ec != bsky_ec_Ok) unlink(w->tmp.data);
+
+        free(slots);
+        free(w->path);
+        w->path = NULL;
+        bsky_da_free(&w->tmp);
+        bsky_da_free(&w->buf);
+        bsky_da_free(&w->doc);
+        bsky_da_free(&w->keys);
+        bsky_str_map_free(&w->seen);
+
+        if (ec != bsky_ec_Ok) bsky_log_error(ec);
+        return ec;
+    }
+
+    enum bsky_error_code bsky_snap_open(struct bsky_snap *snap,
+                                        const char *path,
+                                        enum bsky_error_code *ec)
+    {
+        struct stat st;
+        struct bsky_snap_header header;
+        void *map = MAP_FAILED;
+        int fd = open(path, O_RDONLY | O_CLOEXEC);
+
+        *snap = (struct bsky_snap) { 0 };
+        *ec   = bsky_ec_Ok;
+
+        if (fd < 0 || fstat(fd, &st) != 0) bsky_defer_ec(bsky_ec_Io);
+        if ((size_t) st.st_size < sizeof (header))
+            bsky_defer_ec(bsky_ec_Snapshot_invalid);
+
+        map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        if (map == MAP_FAILED) bsky_defer_ec(bsky_ec_Io);
+
+        snap->data = (struct bsky_view) { map, (char*) map + st.st_size };
+        memcpy(&header, map, sizeof (header));
+
+        // index must fit exactly at the end.
+        if (memcmp(header.magic, BSKY_SNAP_MAGIC, 8) != 0 ||
+            header.size != (uint64_t) st.st_size ||
+            header.index < sizeof (header) || header.index % 8 ||
+            header.index_cap == 0 ||
+            (header.index_cap & (header.index_cap - 1)) ||
+            header.index_cap > (header.size - header.index) /
+                               sizeof (struct bsky_snap_slot) ||
+            header.index + header.index_cap * sizeof (struct bsky_snap_slot)
+            != header.size) {
+            bsky_snap_free(snap);
+            bsky_defer_ec(bsky_ec_Snapshot_invalid);
+        }
+
+        snap->docs  = header.docs;
+        snap->slots = (void*) ((char*) map + header.index);
+        snap->mask  = header.index_cap - 1;
+
+    defer:
+        if (fd >= 0) close(fd);
+        return *ec;
+    }
+
+    // `left' is number of nodes which fit into file: shared child arrays
+    // can't make walk longer than that.
+    static int __bsky_snap_check(struct bsky_snap *snap,
+                                 const struct bsky_snap_node *node,
+                                 int depth, size_t *left)
+    {
+        const char *start = snap->data.start;
+        const char *end   = (char*) snap->slots;
+        const char *p     = (const char*) node;
+        const char *at;
+        size_t items;
+
+        if (depth > BSKY_SNAP_DEPTH || *left == 0) return 0;
+        --*left;
+
+        switch (node->var) {
+        case bsky_json_Num: case bsky_json_Bool: case bsky_json_Null:
+            return 1;
+        case bsky_json_Str:
+            items = 0;
+            break;
+        case bsky_json_Arr:
+            items = node->len;
+            break;
+        case bsky_json_Dct:
+            items = 2 * (size_t) node->len;
+            break;
+        default:
+            return 0;
+        }
+
+        // offsets are compared before pointers are made.
+        if (node->off < (int64_t) sizeof (struct bsky_snap_header) -
+                        (p - start) ||
+            node->off > end - p) {
+            return 0;
+        }
+        at = p + node->off;
+
+        if (node->var == bsky_json_Str)
+            return (size_t) (end - at) > node->len && at[node->len] == '\0';
+
+        if ((at - start) % 8 ||
+            (size_t) (end - at) / sizeof (*node) < items) {
+            return 0;
+        }
+
+        for (size_t i = 0; i < items; ++i) {
+            const struct bsky_snap_node *child = (void*) at;
+
+            if (node->var == bsky_json_Dct && i % 2 == 0 &&
+                child[i].var != bsky_json_Str) {
+                return 0;
+            }
+            if (!__bsky_snap_check(snap, &child[i], depth + 1, left))
+                return 0;
+        }
+
+        return 1;
+    }
+
+    enum bsky_error_code bsky_snap_validate(struct bsky_snap *snap)
+    {
+        const char *start = snap->data.start;
+        size_t docs = 0, docs_area = (char*) snap->slots - start;
+        size_t left = docs_area / sizeof (struct bsky_snap_node);
+
+        for (uint64_t i = 0; i <= snap->mask; ++i) {
+            const struct bsky_snap_slot *slot = &snap->slots[i];
+            const struct bsky_snap_node *key;
+
+            if (slot->key == 0) continue;
+
+            if (slot->key < sizeof (struct bsky_snap_header) ||
+                slot->key % 8 ||
+                slot->key + 2 * sizeof (*key) > docs_area) {
+                goto invalid;
+            }
+
+            key = (void*) (start + slot->key);
+            if (key->var != bsky_json_Str ||
+                !__bsky_snap_check(snap, key, 0, &left) ||
+                !__bsky_snap_check(snap, key + 1, 0, &left) ||
+                __bsky_hash_bytes(bsky_snap_str(key).start, key->len)
+                != slot->hash ||
+                bsky_snap_get(snap, bsky_snap_str(key)) != key + 1) {
+                goto invalid;
+            }
+            docs++;
+        }
+
+        if (docs != snap->docs) goto invalid;
+
+        return bsky_ec_Ok;
+
+    invalid:
+        bsky_return_error(bsky_ec_Snapshot_invalid);
+        return bsky_ec_Snapshot_invalid;
+    }
+
+    const struct bsky_snap_node *bsky_snap_get(struct bsky_snap *snap,
+                                               struct bsky_str key)
+    {
+        size_t len  = bsky_str_len(key);
+        size_t hash = __bsky_hash_bytes(key.start, len);
+
+        if (snap->slots == NULL) return NULL;
+
+        // full table can't be made by writer, bound the probe anyway.
+        for (uint64_t i = hash & snap->mask, n = 0; n <= snap->mask;
+             i = (i + 1) & snap->mask, ++n) {
+            const struct bsky_snap_slot *slot = &snap->slots[i];
+            const struct bsky_snap_node *node;
+
+            if (slot->key == 0) return NULL;
+            if (slot->hash != hash) continue;
+
+            node = (void*) ((char*) snap->data.start + slot->key);
+            if (node->len == len &&
+                memcmp(bsky_snap_str(node).start, key.start, len) == 0) {
+                return node + 1;
+            }
+        }
+
+        return NULL;
+    }
+
+    const struct bsky_snap_node *
+    bsky_snap_items(const struct bsky_snap_node *node)
+    {
+        return (void*) ((const char*) node + node->off);
+    }
+
+    struct bsky_str bsky_snap_str(const struct bsky_snap_node *node)
+    {
+        char *start = (char*) node + node->off;
+
+        return (struct bsky_str) { start, start + node->len };
+    }
+
+    const struct bsky_snap_node *
+    bsky_snap_field(const struct bsky_snap_node *node, const char *name)
+    {
+        const struct bsky_snap_node *items;
+        size_t len = strlen(name);
+
+        if (node == NULL || node->var != bsky_json_Dct) return NULL;
+
+        items = bsky_snap_items(node);
+        for (size_t i = 0; i < node->len; ++i) {
+            if (items[2 * i].len == len &&
+                memcmp(bsky_snap_str(&items[2 * i]).start, name, len) == 0) {
+                return &items[2 * i + 1];
+            }
+        }
+
+        return NULL;
+    }
+
+    void bsky_snap_free(struct bsky_snap *snap)
+    {
+        if (snap->data.start) {
+            munmap(snap->data.start,
+                   (char*) snap->data.end - (char*) snap->data.start);
+        }
+        *snap = (struct bsky_snap) { 0 };
+    }
+
+    /*
+     * BSKY SOCIAL GRAPH
+     */
+    struct __bsky_graph_iter {
+        const unsigned char *p, *end;
+        uint32_t id, limit;
+        int first;
+    };
+
+    static struct __bsky_graph_iter
+    __bsky_graph_row(struct __bsky_graph_csr *csr, uint32_t u)
+    {
+        struct __bsky_graph_iter it = { NULL, NULL, 0, csr->nodes, 1 };
+
+        if (u < csr->nodes) {
+            it.p   = csr->data + csr->off[u];
+            it.end = csr->data + csr->off[u + 1];
+        }
+
+        return it;
+    }
+
+    // Stops at the end of row and at broken varint or id of mapped file.
+    static int __bsky_graph_next(struct __bsky_graph_iter *it)
+    {
+        uint32_t v = 0;
+        int shift = 0;
+
+        do {
+            if (it->p >= it->end || shift > 28) return 0;
+            v |= (uint32_t) (*it->p & 0x7f) << shift;
+            shift += 7;
+        } while (*it->p++ & 0x80);
+
+        if (!it->first && v > it->limit - it->id) return 0;
+
+        it->id    = it->first ? v : it->id + v;
+        it->first = 0;
+
+        return it->id < it->limit;
+    }
+
+    uint32_t bsky_graph_id(struct bsky_graph *g, struct bsky_str did)
+    {
+        size_t *id = bsky_str_map_get(&g->ids, did);
+        size_t  hash;
+
+        if (id) return *id;
+        if (g->nodes >= BSKY_GRAPH_NONE) return BSKY_GRAPH_NONE;
+
+        if (bsky_str_map_set(&g->ids, did, g->nodes) != bsky_ec_Ok)
+            return BSKY_GRAPH_NONE;
+
+        // id -> DID shares the key copy of map.
+        hash = __bsky_hash_bytes(did.start, bsky_str_len(did));
+        if (bsky_da_push(&g->dids, __bsky_str_map_slot(&g->ids, did,
+                                                       hash)->key)
+            != bsky_ec_Ok) {
+            bsky_str_map_del(&g->ids, did);
+            return BSKY_GRAPH_NONE;
+        }
+
+        return g->nodes++;
+    }
+
+    uint32_t bsky_graph_find(struct bsky_graph *g, struct bsky_str did)
+    {
+        size_t *id = bsky_str_map_get(&g->ids, did);
+
+        return id ? *id : BSKY_GRAPH_NONE;
+    }
+
+    const char *bsky_graph_did(struct bsky_graph *g, uint32_t id)
+    {
+        return id < g->dids.len ? g->dids.data[id] : NULL;
+    }
+
+    static enum bsky_error_code __bsky_graph_log(struct bsky_graph *g,
+                                                 uint32_t src, uint32_t dst,
+                                                 int unfollow)
+    {
+        enum bsky_error_code ec;
+        struct __bsky_graph_op op = {
+            src, dst, (uint64_t) g->log.len << 1 | unfollow,
+        };
+
+        if (src >= g->nodes || dst >= g->nodes) {
+            bsky_return_error(bsky_ec_Graph_invalid);
+            return bsky_ec_Graph_invalid;
+        }
+
+        if ((ec = bsky_da_push(&g->log, op)) != bsky_ec_Ok) return ec;
+        if (g->log.len >= BSKY_GRAPH_LOG) return bsky_graph_merge(g);
+
+        return bsky_ec_Ok;
+    }
+
+    enum bsky_error_code bsky_graph_follow(struct bsky_graph *g, uint32_t src,
+                                           uint32_t dst)
+    {
+        return __bsky_graph_log(g, src, dst, 0);
+    }
+
+    enum bsky_error_code bsky_graph_unfollow(struct bsky_graph *g, uint32_t src,
+                                             uint32_t dst)
+    {
+        return __bsky_graph_log(g, src, dst, 1);
+    }
+
+    enum bsky_error_code bsky_graph_follow_record(struct bsky_graph *g,
+                                                  struct bsky_str did,
+                                                  struct bsky_json *record)
+    {
+        struct bsky_json *subject = bsky_json_get(record, "subject");
+        uint32_t src, dst;
+
+        if (subject == NULL || subject->var != bsky_json_Str) {
+            bsky_return_error(bsky_ec_Graph_invalid);
+            return bsky_ec_Graph_invalid;
+        }
+
+        src = bsky_graph_id(g, did);
+        dst = bsky_graph_id(g, bsky_mk_str(subject->str));
+        if (src == BSKY_GRAPH_NONE || dst == BSKY_GRAPH_NONE) {
+            bsky_return_error(bsky_ec_Out_of_memory);
+            return bsky_ec_Out_of_memory;
+        }
+
+        return bsky_graph_follow(g, src, dst);
+    }
+
+    static int __bsky_graph_op_cmp(const void *a, const void *b)
+    {
+        const struct __bsky_graph_op *x = a, *y = b;
+
+        if (x->src != y->src) return x->src < y->src ? -1 : 1;
+        if (x->dst != y->dst) return x->dst < y->dst ? -1 : 1;
+        return x->seq < y->seq ? -1 : x->seq > y->seq;
+    }
+
+    // Merge of old row and sorted ops of the same source, one pass.
+    static enum bsky_error_code
+    __bsky_graph_rebuild(struct __bsky_graph_csr *old, size_t nodes,
+                         struct __bsky_graph_op *ops, size_t n,
+                         struct __bsky_graph_csr *csr, uint64_t *edges)
+    {
+        struct { unsigned char *data; size_t len, cap; } data = { 0 };
+        uint64_t *off = malloc((nodes + 1) * sizeof (uint64_t));
+        size_t k = 0;
+
+        *edges = 0;
+        if (off == NULL) goto oom;
+
+        data.cap  = (old->nodes ? old->off[old->nodes] : 0) + 2 * n + 16;
+        data.data = malloc(data.cap);
+        if (data.data == NULL) goto oom;
+
+        for (size_t u = 0; u < nodes; ++u) {
+            struct __bsky_graph_iter it = __bsky_graph_row(old, u);
+            int      has   = __bsky_graph_next(&it), first = 1;
+            uint32_t prev  = 0;
+
+            off[u] = data.len;
+
+            while (has || (k < n && ops[k].src == u)) {
+                uint32_t v;
+                int keep = 1;
+
+                if (k < n && ops[k].src == u && (!has || ops[k].dst <= it.id)) {
+                    v = ops[k].dst;
+
+                    // the last op of edge wins.
+                    while (k + 1 < n && ops[k + 1].src == u &&
+                           ops[k + 1].dst == v) {
+                        k++;
+                    }
+                    keep = !(ops[k++].seq & 1);
+
+                    if (has && it.id == v) has = __bsky_graph_next(&it);
+                } else {
+                    v   = it.id;
+                    has = __bsky_graph_next(&it);
+                }
+
+                if (!keep || (!first && v == prev)) continue;
+
+                if (data.cap - data.len < 5) {
+                    unsigned char *grown = realloc(data.data, data.cap * 2);
+
+                    if (grown == NULL) goto oom;
+                    data.data = grown;
+                    data.cap *= 2;
+                }
+
+                uint32_t gap = first ? v : v - prev;
+                while (gap >= 0x80) {
+                    data.data[data.len++] = gap | 0x80;
+                    gap >>= 7;
+                }
+                data.data[data.len++] = gap;
+
+                prev  = v;
+                first = 0;
+                (*edges)++;
+            }
+        }
+        off[nodes] = data.len;
+
+        *csr = (struct __bsky_graph_csr) { off, data.data, nodes, 1 };
+
+        return bsky_ec_Ok;
+
+    oom:
+        free(off);
+        free(data.data);
+        bsky_return_error(bsky_ec_Out_of_memory);
+        return bsky_ec_Out_of_memory;
+    }
+
+    static void __bsky_graph_csr_free(struct __bsky_graph_csr *csr)
+    {
+        if (csr->owned) {
+            free(csr->off);
+            free(csr->data);
+        }
+        *csr = (struct __bsky_graph_csr) { 0 };
+    }
+
+    static void __bsky_graph_swap(struct __bsky_graph_op *ops, size_t n)
+    {
+        for (size_t i = 0; i < n; ++i) {
+            uint32_t src = ops[i].src;
+
+            ops[i].src = ops[i].dst;
+            ops[i].dst = src;
+        }
+    }
+
+    enum bsky_error_code bsky_graph_merge(struct bsky_graph *g)
+    {
+        enum bsky_error_code ec;
+        struct __bsky_graph_csr out, in;
+        struct __bsky_graph_op *ops = g->log.data;
+        size_t n = g->log.len;
+        uint64_t edges, in_edges;
+
+        if (n == 0) return bsky_ec_Ok;
+
+        qsort(ops, n, sizeof (*ops), __bsky_graph_op_cmp);
+        if ((ec = __bsky_graph_rebuild(&g->out, g->nodes, ops, n, &out,
+                                       &edges)) != bsky_ec_Ok) {
+            return ec;
+        }
+
+        __bsky_graph_swap(ops, n);
+        qsort(ops, n, sizeof (*ops), __bsky_graph_op_cmp);
+        if ((ec = __bsky_graph_rebuild(&g->in, g->nodes, ops, n, &in,
+                                       &in_edges)) != bsky_ec_Ok) {
+            // log stays for the next try.
+            __bsky_graph_swap(ops, n);
+            __bsky_graph_csr_free(&out);
+            return ec;
+        }
+
+        __bsky_graph_csr_free(&g->out);
+        __bsky_graph_csr_free(&g->in);
+        g->out      = out;
+        g->in       = in;
+        g->edges    = edges;
+        g->log.len  = 0;
+
+        return bsky_ec_Ok;
+    }
+
+    static enum bsky_error_code __bsky_graph_ids(struct __bsky_graph_csr *csr,
+                                                 uint32_t id,
+                                                 struct bsky_graph_ids *out)
+    {
+        enum bsky_error_code ec;
+        struct __bsky_graph_iter it = __bsky_graph_row(csr, id);
+
+        while (__bsky_graph_next(&it)) {
+            if ((ec = bsky_da_push(out, it.id)) != bsky_ec_Ok) return ec;
+        }
+
+        return bsky_ec_Ok;
+    }
+
+    enum bsky_error_code bsky_graph_following(struct bsky_graph *g, uint32_t id,
+                                              struct bsky_graph_ids *out)
+    {
+        return __bsky_graph_ids(&g->out, id, out);
+    }
+
+    enum bsky_error_code bsky_graph_followers(struct bsky_graph *g, uint32_t id,
+                                              struct bsky_graph_ids *out)
+    {
+        return __bsky_graph_ids(&g->in, id, out);
+    }
+
+    // Every varint ends with byte without high bit.
+    static size_t __bsky_graph_count(struct __bsky_graph_csr *csr, uint32_t id)
+    {
+        size_t count = 0;
+
+        if (id >= csr->nodes) return 0;
+
+        for (uint64_t i = csr->off[id]; i < csr->off[id + 1]; ++i)
+            count += !(csr->data[i] & 0x80);
+
+        return count;
+    }
+
+    size_t bsky_graph_following_count(struct bsky_graph *g, uint32_t id)
+    {
+        return __bsky_graph_count(&g->out, id);
+    }
+
+    size_t bsky_graph_followers_count(struct bsky_graph *g, uint32_t id)
+    {
+        return __bsky_graph_count(&g->in, id);
+    }
+
+    int bsky_graph_follows(struct bsky_graph *g, uint32_t src, uint32_t dst)
+    {
+        struct __bsky_graph_iter it = __bsky_graph_row(&g->out, src);
+
+        while (__bsky_graph_next(&it)) {
+            if (it.id >= dst) return it.id == dst;
+        }
+
+        return 0;
+    }
+
+    static int __bsky_graph_id_cmp(const void *a, const void *b)
+    {
+        uint32_t x = *(const uint32_t*) a, y = *(const uint32_t*) b;
+
+        return x < y ? -1 : x > y;
+    }
+
+    enum bsky_error_code bsky_graph_two_hop(struct bsky_graph *g, uint32_t id,
+                                            struct bsky_graph_ids *out)
+    {
+        enum bsky_error_code ec;
+        struct bsky_graph_ids direct = { 0 }, reach = { 0 };
+        size_t j = 0;
+
+        if ((ec = __bsky_graph_ids(&g->out, id, &direct)) != bsky_ec_Ok)
+            goto defer;
+
+        for (size_t i = 0; i < direct.len; ++i) {
+            ec = __bsky_graph_ids(&g->out, direct.data[i], &reach);
+            if (ec != bsky_ec_Ok) goto defer;
+        }
+
+        if (reach.len) {
+            qsort(reach.data, reach.len, sizeof (uint32_t),
+                  __bsky_graph_id_cmp);
+        }
+
+        // both sorted: skip duplicates, `id' and direct follows.
+        for (size_t i = 0; i < reach.len; ++i) {
+            uint32_t v = reach.data[i];
+
+            if (i && v == reach.data[i - 1]) continue;
+            if (v == id) continue;
+
+            while (j < direct.len && direct.data[j] < v) j++;
+            if (j < direct.len && direct.data[j] == v) continue;
+
+            if ((ec = bsky_da_push(out, v)) != bsky_ec_Ok) goto defer;
+        }
+
+    defer:
+        bsky_da_free(&direct);
+        bsky_da_free(&reach);
+        return ec;
+    }
+
+    struct __bsky_graph_file {
+        int fd;
+        struct { char *data; size_t len, cap; } buf;
+    };
+
+    static enum bsky_error_code __bsky_graph_put(struct __bsky_graph_file *f,
+                                                 const void *data, size_t len)
+    {
+        enum bsky_error_code ec;
+
+        if (f->buf.cap - f->buf.len < len) {
+            ec = __bsky_capture_write_all(f->fd, f->buf.data, f->buf.len);
+            f->buf.len = 0;
+            if (ec != bsky_ec_Ok) return ec;
+        }
+        if (f->buf.cap < len) return __bsky_capture_write_all(f->fd, data, len);
+
+        memcpy(f->buf.data + f->buf.len, data, len);
+        f->buf.len += len;
+
+        return bsky_ec_Ok;
+    }
+
+    static enum bsky_error_code
+    __bsky_graph_put_rows(struct __bsky_graph_file *f,
+                          struct __bsky_graph_csr *csr, size_t nodes)
+    {
+        enum bsky_error_code ec = bsky_ec_Ok;
+        uint64_t len = csr->nodes ? csr->off[csr->nodes] : 0;
+
+        // nodes interned after the last merge have empty rows.
+        for (size_t u = 0; u <= nodes && ec == bsky_ec_Ok; ++u) {
+            uint64_t off = u < csr->nodes ? csr->off[u] : len;
+            ec = __bsky_graph_put(f, &off, sizeof (off));
+        }
+        if (ec == bsky_ec_Ok && len) ec = __bsky_graph_put(f, csr->data, len);
+
+        // next section is aligned.
+        if (ec == bsky_ec_Ok && len % 8)
+            ec = __bsky_graph_put(f, "\0\0\0\0\0\0\0", 8 - len % 8);
+
+        return ec;
+    }
+
+    enum bsky_error_code bsky_graph_save(struct bsky_graph *g, const char *path)
+    {
+        enum bsky_error_code ec;
+        struct bsky_graph_header h = { BSKY_GRAPH_MAGIC };
+        struct __bsky_graph_file f = { -1 };
+        struct bsky_str_builder tmp = { 0 };
+        uint64_t out_len, in_len;
+
+        if ((ec = bsky_graph_merge(g)) != bsky_ec_Ok) return ec;
+
+        out_len = g->out.nodes ? g->out.off[g->out.nodes] : 0;
+        in_len  = g->in.nodes ? g->in.off[g->in.nodes] : 0;
+
+        h.nodes = g->nodes;
+        h.edges = g->edges;
+        h.dids  = sizeof (h);
+        for (size_t i = 0; i < g->nodes; ++i)
+            h.dids_len += strlen(g->dids.data[i]) + 1;
+
+        h.out_off  = (h.dids + h.dids_len + 7) & ~(uint64_t) 7;
+        h.out_data = h.out_off + (g->nodes + 1) * sizeof (uint64_t);
+        h.out_len  = out_len;
+        h.in_off   = (h.out_data + out_len + 7) & ~(uint64_t) 7;
+        h.in_data  = h.in_off + (g->nodes + 1) * sizeof (uint64_t);
+        h.in_len   = in_len;
+        h.size     = h.in_data + in_len;
+
+        // written aside and renamed, old file is valid until then.
+        bsky_sb_push_str(&tmp, bsky_mk_str((char*) path));
+        bsky_sb_push_str(&tmp, bsky_mk_str(".tmp"));
+        if (tmp.data == NULL) {
+            bsky_return_error(bsky_ec_Out_of_memory);
+            return bsky_ec_Out_of_memory;
+        }
+
+        f.fd = open(tmp.data, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (f.fd < 0) {
+            ec = bsky_ec_Io;
+            goto defer;
+        }
+
+        f.buf.data = malloc(BSKY_SNAP_BUFFER);
+        if (f.buf.data == NULL) {
+            ec = bsky_ec_Out_of_memory;
+            goto defer;
+        }
+        f.buf.cap = BSKY_SNAP_BUFFER;
+
+        ec = __bsky_graph_put(&f, &h, sizeof (h));
+        for (size_t i = 0; i < g->nodes && ec == bsky_ec_Ok; ++i) {
+            ec = __bsky_graph_put(&f, g->dids.data[i],
+                                  strlen(g->dids.data[i]) + 1);
+        }
+        if (ec == bsky_ec_Ok && h.dids_len % 8) {
+            ec = __bsky_graph_put(&f, "\0\0\0\0\0\0\0", 8 - h.dids_len % 8);
+        }
+        if (ec == bsky_ec_Ok)
+            ec = __bsky_graph_put_rows(&f, &g->out, g->nodes);
+        if (ec == bsky_ec_Ok)
+            ec = __bsky_graph_put_rows(&f, &g->in, g->nodes);
+        if (ec == bsky_ec_Ok) {
+            ec = __bsky_capture_write_all(f.fd, f.buf.data, f.buf.len);
+        }
 
-        bsky_sb_push_str(sb, (struct bsky_str) {result, result + len + 1});
+        // trailing padding of the last section is not part of file.
+        if (ec == bsky_ec_Ok &&
+            (ftruncate(f.fd, h.size) != 0 || fdatasync(f.fd) != 0)) {
+            ec = bsky_ec_Io;
+        }
+        if (close(f.fd) != 0 && ec == bsky_ec_Ok) ec = bsky_ec_Io;
+        f.fd = -1;
+
+        if (ec == bsky_ec_Ok && rename(tmp.data, path) != 0) ec = bsky_ec_Io;
+
+    defer:
+        if (f.fd >= 0) close(f.fd);
+        if (ec != bsky_ec_Ok) {
+            unlink(tmp.data);
+            bsky_log_error(ec);
+        }
+        bsky_da_free(&f.buf);
+        bsky_da_free(&tmp);
+        return ec;
     }
 
-    struct bsky_str bsky_sb_build(struct bsky_str_builder *sb)
+    static int __bsky_graph_section(struct bsky_graph_header *h, uint64_t at,
+                                    uint64_t len, int aligned)
     {
-        return (struct bsky_str) { sb->data, sb->data + sb->len-1 };
+        return at >= sizeof (*h) && at <= h->size && len <= h->size - at &&
+               (!aligned || at % 8 == 0);
     }
 
-    struct bsky_str bsky_sb_build_tmp(struct bsky_str_builder *sb)
+    static int __bsky_graph_map_rows(struct bsky_graph *g,
+                                     struct bsky_graph_header *h,
+                                     struct __bsky_graph_csr *csr,
+                                     uint64_t off, uint64_t data,
+                                     uint64_t len)
     {
-        struct bsky_view str = bsky_view_of_str(bsky_sb_build(sb));
-        struct bsky_view tmp = bsky_view_to_tmp(str);
+        char *start = g->map.start;
 
-        bsky_da_free(sb);
-        *sb = (struct bsky_str_builder) { 0 };
+        if (!__bsky_graph_section(h, off, (h->nodes + 1) * 8, 1) ||
+            !__bsky_graph_section(h, data, len, 0)) {
+            return 0;
+        }
 
-        return (struct bsky_str) { tmp.start, tmp.end-1 };
-    }
+        *csr = (struct __bsky_graph_csr) {
+            (void*) (start + off), (void*) (start + data), h->nodes, 0,
+        };
 
-    struct bsky_view bsky_view_of_str(struct bsky_str str)
-    {
-        return (struct bsky_view) { str.start, str.end + 1 };
-    }
+        // offsets are monotone and end at the end of data.
+        if (csr->off[0] != 0 || csr->off[h->nodes] != len) return 0;
+        for (size_t u = 0; u < h->nodes; ++u)
+            if (csr->off[u] > csr->off[u + 1]) return 0;
 
-    static int __s_is_whitespace(char c) {
-        return c == ' ' || c == '\n' || c == '\t';
+        return 1;
     }
 
-    struct bsky_str bsky_trim_left(struct bsky_str str)
+    enum bsky_error_code bsky_graph_load(struct bsky_graph *g,
+                                         const char *path,
+                                         enum bsky_error_code *ec)
     {
-        while (str.start != str.end && __s_is_whitespace(*str.start)) {
-            str.start++;
+        struct stat st;
+        struct bsky_graph_header h;
+        void *map = MAP_FAILED;
+        int fd = open(path, O_RDONLY | O_CLOEXEC);
+        char *did, *end;
+
+        *g  = (struct bsky_graph) { 0 };
+        *ec = bsky_ec_Ok;
+
+        if (fd < 0 || fstat(fd, &st) != 0) bsky_defer_ec(bsky_ec_Io);
+        if ((size_t) st.st_size < sizeof (h))
+            bsky_defer_ec(bsky_ec_Graph_invalid);
+
+        map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        if (map == MAP_FAILED) bsky_defer_ec(bsky_ec_Io);
+
+        g->map = (struct bsky_view) { map, (char*) map + st.st_size };
+        memcpy(&h, map, sizeof (h));
+
+        if (memcmp(h.magic, BSKY_GRAPH_MAGIC, 8) != 0 ||
+            h.size != (uint64_t) st.st_size || h.nodes >= BSKY_GRAPH_NONE ||
+            !__bsky_graph_section(&h, h.dids, h.dids_len, 0) ||
+            !__bsky_graph_map_rows(g, &h, &g->out, h.out_off, h.out_data,
+                                   h.out_len) ||
+            !__bsky_graph_map_rows(g, &h, &g->in, h.in_off, h.in_data,
+                                   h.in_len)) {
+            goto invalid;
         }
 
-        return str;
+        did = (char*) map + h.dids;
+        end = did + h.dids_len;
+        for (size_t i = 0; i < h.nodes; ++i) {
+            char *zero = memchr(did, '\0', end - did);
+
+            struct bsky_str key = { did, zero };
+
+            if (zero == NULL || bsky_graph_find(g, key) != BSKY_GRAPH_NONE)
+                goto invalid;
+            if (bsky_graph_id(g, key) != i)
+                bsky_defer_ec(bsky_ec_Out_of_memory);
+            did = zero + 1;
+        }
+
+        g->edges = h.edges;
+
+    defer:
+        if (fd >= 0) close(fd);
+        if (*ec != bsky_ec_Ok) bsky_graph_free(g);
+        return *ec;
+
+    invalid:
+        *ec = bsky_ec_Graph_invalid;
+        bsky_log_error(*ec);
+        goto defer;
     }
 
-    int bsky_str_starts_with(struct bsky_str fst, struct bsky_str pref)
+    void bsky_graph_free(struct bsky_graph *g)
     {
-        size_t fst_len = bsky_str_len(fst), pref_len = bsky_str_len(pref);
+        __bsky_graph_csr_free(&g->out);
+        __bsky_graph_csr_free(&g->in);
 
-        if (fst_len < pref_len) return 0;
+        bsky_str_map_free(&g->ids);
+        bsky_da_free(&g->dids);
+        bsky_da_free(&g->log);
 
-        return memcmp(fst.start, pref.start, pref_len) == 0;
+        if (g->map.start) {
+            munmap(g->map.start,
+                   (char*) g->map.end - (char*) g->map.start);
+        }
+
+        *g = (struct bsky_graph) { 0 };
     }
 
-    int bsky_str_ends_with(struct bsky_str fst, struct bsky_str post)
+
+    /*
+     * BSKY ROARING BITMAP
+     */
+    #define __BSKY_ROARING_WORDS 1024
+
+    enum { __bsky_roaring_And, __bsky_roaring_Or, __bsky_roaring_Andnot };
+
+    #if !defined(BSKY_ROARING_PORTABLE) && (defined(__x86_64__) || \
+                                            defined(__i386__))
+        #define __BSKY_ROARING_X86
+        #include <immintrin.h>
+
+    // Lanes of `va' equal to lanes of `vb' rotated by `r' lanes.
+    #define __BSKY_ROARING_EQ(va, vb, r)                                   \
+        _mm_cmpeq_epi16(va, _mm_or_si128(_mm_srli_si128(vb, 2 * (r)),      \
+                                         _mm_slli_si128(vb, 16 - 2 * (r))))
+
+    // Values of `a' found in `b' (`want' is 1) or missing in it (0), into
+    // `out'. Every block of 8 values of `a' is compared with all rotations
+    // of block of `b', block with smaller maximum is consumed. Bits of
+    // block of `a' found by earlier blocks of `b' stay in `found'.
+    __attribute__((target("sse2")))
+    static size_t __bsky_roaring_match_sse2(const uint16_t *a, size_t na,
+                                            const uint16_t *b, size_t nb,
+                                            uint16_t *out, int want)
     {
-        size_t fst_len = bsky_str_len(fst), post_len = bsky_str_len(post);
+        size_t i = 0, j = 0, k = 0, base;
+        uint32_t found = 0;
+
+        while (i + 8 <= na && j + 8 <= nb) {
+            __m128i va = _mm_loadu_si128((const __m128i*) (a + i));
+            __m128i vb = _mm_loadu_si128((const __m128i*) (b + j));
+            __m128i eq = _mm_cmpeq_epi16(va, vb);
+            uint16_t amax = a[i + 7], bmax = b[j + 7];
+
+            eq = _mm_or_si128(eq, __BSKY_ROARING_EQ(va, vb, 1));
+            eq = _mm_or_si128(eq, __BSKY_ROARING_EQ(va, vb, 2));
+            eq = _mm_or_si128(eq, __BSKY_ROARING_EQ(va, vb, 3));
+            eq = _mm_or_si128(eq, __BSKY_ROARING_EQ(va, vb, 4));
+            eq = _mm_or_si128(eq, __BSKY_ROARING_EQ(va, vb, 5));
+            eq = _mm_or_si128(eq, __BSKY_ROARING_EQ(va, vb, 6));
+            eq = _mm_or_si128(eq, __BSKY_ROARING_EQ(va, vb, 7));
+            found |= (uint32_t) _mm_movemask_epi8(eq);
+
+            if (amax <= bmax) {
+                for (int t = 0; t < 8; ++t) {
+                    if ((int) ((found >> 2 * t) & 1) == want)
+                        out[k++] = a[i + t];
+                }
+                found = 0;
+                i += 8;
+            }
+            if (bmax <= amax) j += 8;
+        }
 
-        if (fst_len < post_len) return 0;
+        for (base = i; i < na; ++i) {
+            while (j < nb && b[j] < a[i]) j++;
 
-        return memcmp(fst.start + fst_len - post_len,
-                      post.start, post_len) == 0;
+            int hit = (j < nb && b[j] == a[i]) ||
+                      (i - base < 8 && ((found >> 2 * (i - base)) & 1));
+
+            if (hit == want) out[k++] = a[i];
+        }
+
+        return k;
     }
 
-    size_t bsky_str_len(struct bsky_str str) {
-        return (str.end - str.start) / sizeof (char);
+    __attribute__((target("avx2,popcnt")))
+    static uint32_t __bsky_roaring_words_avx2(uint64_t *out, const uint64_t *a,
+                                              const uint64_t *b, int op)
+    {
+        uint32_t card = 0;
+
+        for (size_t i = 0; i < __BSKY_ROARING_WORDS; i += 4) {
+            __m256i va = _mm256_loadu_si256((const __m256i*) (a + i));
+            __m256i vb = _mm256_loadu_si256((const __m256i*) (b + i));
+            __m256i w  = op == __bsky_roaring_And ? _mm256_and_si256(va, vb)
+                       : op == __bsky_roaring_Or  ? _mm256_or_si256(va, vb)
+                       : _mm256_andnot_si256(vb, va);
+
+            _mm256_storeu_si256((__m256i*) (out + i), w);
+            card += __builtin_popcountll(out[i])     +
+                    __builtin_popcountll(out[i + 1]) +
+                    __builtin_popcountll(out[i + 2]) +
+                    __builtin_popcountll(out[i + 3]);
+        }
+
+        return card;
     }
+    #endif
 
-    int bsky_str_eq(struct bsky_str fst, struct bsky_str snd) {
-        return strcmp(fst.start, snd.start) == 0;
+    static size_t __bsky_roaring_match_portable(const uint16_t *a, size_t na,
+                                                const uint16_t *b, size_t nb,
+                                                uint16_t *out, int want)
+    {
+        size_t j = 0, k = 0;
+
+        for (size_t i = 0; i < na; ++i) {
+            while (j < nb && b[j] < a[i]) j++;
+            if ((j < nb && b[j] == a[i]) == want) out[k++] = a[i];
+        }
+
+        return k;
     }
 
-    int bsky_str_cmp(struct bsky_str fst, struct bsky_str snd) {
-        size_t fst_len = bsky_str_len(fst), snd_len = bsky_str_len(snd);
+    static uint32_t __bsky_roaring_words_portable(uint64_t *out,
+                                                  const uint64_t *a,
+                                                  const uint64_t *b, int op)
+    {
+        uint32_t card = 0;
 
-        for (int i = 0; i < (fst_len > snd_len ? fst_len : snd_len); ++i) {
-            if (fst.start[i] > snd.start[i]) return  1 + i;
-            if (fst.start[i] < snd.start[i]) return -1 - i;
+        for (size_t i = 0; i < __BSKY_ROARING_WORDS; ++i) {
+            out[i] = op == __bsky_roaring_And ? a[i] & b[i]
+                   : op == __bsky_roaring_Or  ? a[i] | b[i]
+                   : a[i] & ~b[i];
+            card += __builtin_popcountll(out[i]);
         }
 
-        return fst_len > snd_len ?   1 + snd_len :
-               snd_len > fst_len ? - 1 - fst_len :
-               0;
+        return card;
     }
 
+    struct __bsky_roaring_kernels {
+        size_t   (*match)(const uint16_t *, size_t, const uint16_t *, size_t,
+                          uint16_t *, int);
+        uint32_t (*words)(uint64_t *, const uint64_t *, const uint64_t *,
+                          int);
+    };
 
-    struct bsky_str bsky_shift_str(struct bsky_str str, size_t n) {
-        if (n > bsky_str_len(str)) {
-            return (struct bsky_str){str.end, str.end};
+    static const struct __bsky_roaring_kernels __bsky_roaring_portable = {
+        __bsky_roaring_match_portable, __bsky_roaring_words_portable,
+    };
+    #if defined(__BSKY_ROARING_X86)
+    static const struct __bsky_roaring_kernels __bsky_roaring_sse2 = {
+        __bsky_roaring_match_sse2, __bsky_roaring_words_portable,
+    };
+    static const struct __bsky_roaring_kernels __bsky_roaring_avx2 = {
+        __bsky_roaring_match_sse2, __bsky_roaring_words_avx2,
+    };
+    #endif
+
+    // Kernels are published before backend, so backend other than `Auto'
+    // means they are set, also for concurrent first uses.
+    static _Atomic(enum bsky_roaring_backend) __bsky_roaring_backend =
+        bsky_roaring_Auto;
+    static const struct __bsky_roaring_kernels *_Atomic __bsky_roaring_kernels
+        = &__bsky_roaring_portable;
+
+    static int __bsky_roaring_supported(enum bsky_roaring_backend backend)
+    {
+    #if defined(__BSKY_ROARING_X86)
+        if (backend == bsky_roaring_Sse2) return __builtin_cpu_supports("sse2");
+        if (backend == bsky_roaring_Avx2) {
+            return __builtin_cpu_supports("avx2") &&
+                   __builtin_cpu_supports("popcnt");
         }
+    #endif
 
+        return backend == bsky_roaring_Portable;
+    }
 
-        return (struct bsky_str) {str.start + n, str.end};
+    enum bsky_roaring_backend
+    bsky_roaring_use(enum bsky_roaring_backend backend)
+    {
+        if (backend == bsky_roaring_Auto) {
+            backend = __bsky_roaring_supported(bsky_roaring_Avx2)
+                    ? bsky_roaring_Avx2
+                    : __bsky_roaring_supported(bsky_roaring_Sse2)
+                    ? bsky_roaring_Sse2 : bsky_roaring_Portable;
+        }
+        if (!__bsky_roaring_supported(backend)) backend = bsky_roaring_Portable;
+
+        const struct __bsky_roaring_kernels *k = &__bsky_roaring_portable;
+    #if defined(__BSKY_ROARING_X86)
+        if (backend == bsky_roaring_Sse2) k = &__bsky_roaring_sse2;
+        if (backend == bsky_roaring_Avx2) k = &__bsky_roaring_avx2;
+    #endif
+
+        atomic_store_explicit(&__bsky_roaring_kernels, k,
+                              memory_order_release);
+        atomic_store_explicit(&__bsky_roaring_backend, backend,
+                              memory_order_release);
+
+        return backend;
     }
 
-    struct bsky_str bsky_mk_str(char *str) {
-        return (struct bsky_str) { str, str + strlen(str) };
+    static const struct __bsky_roaring_kernels *__bsky_roaring_current(void)
+    {
+        if (atomic_load_explicit(&__bsky_roaring_backend,
+                                 memory_order_acquire) == bsky_roaring_Auto) {
+            bsky_roaring_use(bsky_roaring_Auto);
+        }
+
+        return atomic_load_explicit(&__bsky_roaring_kernels,
+                                    memory_order_acquire);
     }
 
-    struct bsky_str bsky_mk_str(char *str) {
-        return (struct bsky_str) { str, str + strlen(str) };
+    static void
+    __bsky_roaring_container_free(struct __bsky_roaring_container *c)
+    {
+        free(c->array);
+        c->array = NULL;
+        c->len   = c->cap = c->card = 0;
     }
 
-	/*
-     * BSKY JSON
-     */
-    void bsky_sb_push_json(struct bsky_str_builder *sb, struct bsky_json json)
+    static enum bsky_error_code
+    __bsky_roaring_to_bitmap(struct __bsky_roaring_container *c)
     {
-        switch (json.var) {
-        case bsky_json_Arr: {
-            bsky_sb_push_fmt(sb, "[");
+        uint64_t *words = calloc(__BSKY_ROARING_WORDS, sizeof (uint64_t));
 
-            for (size_t i = 0; i < json.arr.len; ++i) {
-                bsky_sb_push_json(sb, json.arr.data[i]);
+        if (words == NULL) {
+            bsky_return_error(bsky_ec_Out_of_memory);
+            return bsky_ec_Out_of_memory;
+        }
 
-                if (i != json.arr.len-1) bsky_sb_push_fmt(sb, ",");
-                else                     bsky_sb_push_fmt(sb, "]");
+        if (c->type == __bsky_roaring_Array) {
+            for (uint32_t i = 0; i < c->len; ++i)
+                words[c->array[i] >> 6] |= 1ull << (c->array[i] & 63);
+        } else if (c->type == __bsky_roaring_Run) {
+            for (uint32_t i = 0; i < c->len; ++i) {
+                uint32_t v = c->runs[2 * i], end = v + c->runs[2 * i + 1];
+
+                // bits from `v' to the end of run or word at once.
+                for (; v <= end; v = (v | 63) + 1) {
+                    uint32_t last = (v | 63) < end ? (v | 63) : end;
+
+                    words[v >> 6] |= (~0ull >> (63 - (last - v))) << (v & 63);
+                }
             }
-        } break;
-        case bsky_json_Dct: {
-            bsky_sb_push_fmt(sb, "{");
+        }
 
-            for (size_t i = 0; i < json.dct.len; ++i) {
-                bsky_sb_push_fmt(sb, "\"%s\":", json.dct.data[i].name);
-                bsky_sb_push_json(sb, json.dct.data[i].value);
+        free(c->array);
+        c->bitmap = words;
+        c->type   = __bsky_roaring_Bitmap;
+        c->len    = c->cap = 0;
 
-                if (i != json.dct.len-1) bsky_sb_push_fmt(sb, ",");
-                else                     bsky_sb_push_fmt(sb, "}");
+        return bsky_ec_Ok;
+    }
+
+    static enum bsky_error_code
+    __bsky_roaring_to_array(struct __bsky_roaring_container *c)
+    {
+        uint16_t *values = malloc((c->card ? c->card : 1) * sizeof (uint16_t));
+        uint32_t  k = 0;
+
+        if (values == NULL) {
+            bsky_return_error(bsky_ec_Out_of_memory);
+            return bsky_ec_Out_of_memory;
+        }
+
+        if (c->type == __bsky_roaring_Bitmap) {
+            for (uint32_t i = 0; i < __BSKY_ROARING_WORDS; ++i) {
+                for (uint64_t w = c->bitmap[i]; w; w &= w - 1)
+                    values[k++] = i * 64 + __builtin_ctzll(w);
             }
+        } else {
+            for (uint32_t i = 0; i < c->len; ++i) {
+                uint32_t v = c->runs[2 * i], end = v + c->runs[2 * i + 1];
 
-        } break;
-        case bsky_json_Num: {
-            if (fabsl(json.num - (float)(int)json.num) < 0.0001) {
-                bsky_sb_push_fmt(sb, "%d", (int)json.num);
-            } else {
-                bsky_sb_push_fmt(sb, "%f.3",    json.num);
+                for (; v <= end; ++v) values[k++] = v;
             }
-        }break;
-        case bsky_json_Str:  bsky_sb_push_fmt(sb, "\"%s\"", json.str); break;
-        case bsky_json_Null: bsky_sb_push_fmt(sb, "null"); break;
-        case bsky_json_Bool: {
-            bsky_sb_push_fmt(sb, "%s", json._bool ? "true" : "false"); 
-        }break;
         }
+
+        free(c->array);
+        c->array = values;
+        c->type  = __bsky_roaring_Array;
+        c->cap   = c->card ? c->card : 1;
+        c->len   = c->card;
+
+        return bsky_ec_Ok;
     }
 
-    struct bsky_str bsky_tmp_str_of_json(struct bsky_json json)
+    // Runs are only read, updates and operations work with plain forms.
+    static enum bsky_error_code
+    __bsky_roaring_unrun(struct __bsky_roaring_container *c)
     {
-        struct bsky_str_builder sb = { 0 };
+        if (c->type != __bsky_roaring_Run) return bsky_ec_Ok;
 
-        bsky_sb_push_json(&sb, json);
+        return c->card > BSKY_ROARING_ARRAY_MAX ? __bsky_roaring_to_bitmap(c)
+                                                : __bsky_roaring_to_array(c);
+    }
 
-        return bsky_sb_build_tmp(&sb);
+    // Bitmap of small cardinality becomes array, empty container is freed.
+    static enum bsky_error_code
+    __bsky_roaring_shrink(struct __bsky_roaring_container *c)
+    {
+        if (c->card == 0) {
+            __bsky_roaring_container_free(c);
+            return bsky_ec_Ok;
+        }
+        if (c->type == __bsky_roaring_Bitmap &&
+            c->card <= BSKY_ROARING_ARRAY_MAX) {
+            return __bsky_roaring_to_array(c);
+        }
+
+        return bsky_ec_Ok;
     }
 
+    // Index of container with `key' or where it should be inserted.
+    static size_t __bsky_roaring_find(struct bsky_roaring *r, uint16_t key)
+    {
+        size_t lo = 0, hi = r->len;
 
-    struct bsky_json bsky_parse_json_arr(struct bsky_str *data,
-                                         enum bsky_error_code *ec)
+        // values mostly come in order.
+        if (r->len && r->data[r->len - 1].key < key) return r->len;
+
+        while (lo < hi) {
+            size_t mid = lo + (hi - lo) / 2;
+
+            if (r->data[mid].key < key) lo = mid + 1;
+            else                        hi = mid;
+        }
+
+        return lo;
+    }
+
+    static size_t __bsky_roaring_search(const uint16_t *values, size_t len,
+                                        uint16_t v)
     {
-        *ec = bsky_ec_Ok;
+        size_t lo = 0, hi = len;
 
-        struct bsky_json_da arr_da = { 0 };
-        struct bsky_json json = { 0 };
+        while (lo < hi) {
+            size_t mid = lo + (hi - lo) / 2;
 
-        *data = bsky_trim_left(*data);
+            if (values[mid] < v) lo = mid + 1;
+            else                 hi = mid;
+        }
 
-        if (*data->start != '[') bsky_defer_ec(bsky_ec_Json_expect_OSB);
+        return lo;
+    }
 
-        do {
-            *data = bsky_shift_str(*data, 1);
-            *data = bsky_trim_left(*data);
-            if (*data->start == ']') break;
+    enum bsky_error_code bsky_roaring_add(struct bsky_roaring *r, uint32_t v)
+    {
+        enum bsky_error_code ec;
+        struct __bsky_roaring_container *c;
+        uint16_t key = v >> 16, low = v & 0xffff;
+        size_t   i   = __bsky_roaring_find(r, key), at;
+
+        if (i == r->len || r->data[i].key != key) {
+            struct __bsky_roaring_container empty = { .key = key };
+
+            if ((ec = bsky_da_push(r, empty)) != bsky_ec_Ok) return ec;
+            memmove(r->data + i + 1, r->data + i,
+                    (r->len - i - 1) * sizeof (*r->data));
+            r->data[i] = empty;
+        }
 
-            struct bsky_json elem = bsky_parse_json(data, ec);
-            if (*ec != bsky_ec_Ok) bsky_defer_ec(*ec);
+        c = &r->data[i];
+        if ((ec = __bsky_roaring_unrun(c)) != bsky_ec_Ok) return ec;
 
-            bsky_da_push(&arr_da, elem);
+        if (c->type == __bsky_roaring_Bitmap) {
+            uint64_t bit = 1ull << (low & 63);
 
-            *data = bsky_trim_left(*data);
-        } while(*data->start == ',');
+            c->card += (c->bitmap[low >> 6] & bit) == 0;
+            c->bitmap[low >> 6] |= bit;
+            return bsky_ec_Ok;
+        }
 
-        if (*data->start != ']') bsky_defer_ec(bsky_ec_Json_expect_CSB);
+        at = c->len && c->array[c->len - 1] < low
+           ? c->len : __bsky_roaring_search(c->array, c->len, low);
+        if (at < c->len && c->array[at] == low) return bsky_ec_Ok;
 
-        *ec = bsky_ec_Ok;
-        *data = bsky_shift_str(*data, 1);
+        if (c->len == BSKY_ROARING_ARRAY_MAX) {
+            if ((ec = __bsky_roaring_to_bitmap(c)) != bsky_ec_Ok) return ec;
+            c->bitmap[low >> 6] |= 1ull << (low & 63);
+            c->card++;
+            return bsky_ec_Ok;
+        }
 
-        struct bsky_view arr = bsky_tmp_view_of_da(&arr_da);
+        if (c->len == c->cap) {
+            uint32_t  cap = c->cap ? c->cap * 2 : 4;
+            uint16_t *array;
 
-        json.var = bsky_json_Arr;
-        json.arr.data = arr.start;
-        json.arr.len  = (arr.end - arr.start) / sizeof (struct bsky_json);
+            if (cap > BSKY_ROARING_ARRAY_MAX) cap = BSKY_ROARING_ARRAY_MAX;
+            if ((array = realloc(c->array, cap * sizeof (uint16_t))) == NULL) {
+                bsky_return_error(bsky_ec_Out_of_memory);
+                return bsky_ec_Out_of_memory;
+            }
+            c->array = array;
+            c->cap   = cap;
+        }
 
-    defer:
-        bsky_da_free(&arr_da);
-        return json;
+        memmove(c->array + at + 1, c->array + at,
+                (c->len - at) * sizeof (uint16_t));
+        c->array[at] = low;
+        c->len++;
+        c->card++;
+
+        return bsky_ec_Ok;
     }
 
+    enum bsky_error_code bsky_roaring_add_many(struct bsky_roaring *r,
+                                               const uint32_t *values, size_t n)
+    {
+        enum bsky_error_code ec;
+
+        for (size_t i = 0; i < n; ++i) {
+            if ((ec = bsky_roaring_add(r, values[i])) != bsky_ec_Ok) return ec;
+        }
 
-    struct bsky_json bsky_parse_json_dct(struct bsky_str *data,
-                                         enum bsky_error_code *ec)
+        return bsky_ec_Ok;
+    }
+
+    enum bsky_error_code bsky_roaring_remove(struct bsky_roaring *r, uint32_t v)
     {
-        *ec = bsky_ec_Ok;
+        enum bsky_error_code ec;
+        struct __bsky_roaring_container *c;
+        uint16_t key = v >> 16, low = v & 0xffff;
+        size_t   i   = __bsky_roaring_find(r, key), at;
 
-        struct bsky_json_pair_da dct_da = { 0 };
-        struct bsky_json json = { 0 };
+        if (i == r->len || r->data[i].key != key) return bsky_ec_Ok;
 
-        *data = bsky_trim_left(*data);
+        c = &r->data[i];
+        if ((ec = __bsky_roaring_unrun(c)) != bsky_ec_Ok) return ec;
 
-        if (*data->start != '{') bsky_defer_ec(bsky_ec_Json_expect_OCB);
+        if (c->type == __bsky_roaring_Bitmap) {
+            uint64_t bit = 1ull << (low & 63);
 
-        json.var = bsky_json_Dct;
+            if ((c->bitmap[low >> 6] & bit) == 0) return bsky_ec_Ok;
+            c->bitmap[low >> 6] &= ~bit;
+            c->card--;
+        } else {
+            at = __bsky_roaring_search(c->array, c->len, low);
+            if (at == c->len || c->array[at] != low) return bsky_ec_Ok;
 
-        struct bsky_json elem = { 0 };
-        struct bsky_json name = { 0 };
-        struct bsky_json_pair pair = { 0 };
+            memmove(c->array + at, c->array + at + 1,
+                    (c->len - at - 1) * sizeof (uint16_t));
+            c->len--;
+            c->card--;
+        }
 
-        do {
-            *data = bsky_shift_str(*data, 1);
+        if ((ec = __bsky_roaring_shrink(c)) != bsky_ec_Ok) return ec;
+        if (c->card == 0) {
+            memmove(r->data + i, r->data + i + 1,
+                    (r->len - i - 1) * sizeof (*r->data));
+            r->len--;
+        }
 
-            name = bsky_parse_json_str(data, ec);
-            if (*ec != bsky_ec_Ok) bsky_defer_ec(*ec);
+        return bsky_ec_Ok;
+    }
 
-            *data = bsky_trim_left(*data);
+    int bsky_roaring_has(struct bsky_roaring *r, uint32_t v)
+    {
+        struct __bsky_roaring_container *c;
+        uint16_t key = v >> 16, low = v & 0xffff;
+        size_t   i   = __bsky_roaring_find(r, key), at;
+
+        if (i == r->len || r->data[i].key != key) return 0;
+
+        c = &r->data[i];
+        switch (c->type) {
+        case __bsky_roaring_Bitmap:
+            return (c->bitmap[low >> 6] >> (low & 63)) & 1;
+        case __bsky_roaring_Array:
+            at = __bsky_roaring_search(c->array, c->len, low);
+            return at < c->len && c->array[at] == low;
+        }
+
+        // the last run starting at or before `low'.
+        size_t lo = 0, hi = c->len;
+
+        while (lo < hi) {
+            size_t mid = lo + (hi - lo) / 2;
+
+            if (c->runs[2 * mid] <= low) lo = mid + 1;
+            else                         hi = mid;
+        }
+
+        return lo > 0 && low - c->runs[2 * (lo - 1)] <= c->runs[2 * lo - 1];
+    }
+
+    uint64_t bsky_roaring_card(struct bsky_roaring *r)
+    {
+        uint64_t card = 0;
+
+        for (size_t i = 0; i < r->len; ++i) card += r->data[i].card;
+
+        return card;
+    }
+
+    static enum bsky_error_code
+    __bsky_roaring_copy(const struct __bsky_roaring_container *c,
+                        struct __bsky_roaring_container *copy)
+    {
+        size_t size = c->type == __bsky_roaring_Bitmap
+                    ? __BSKY_ROARING_WORDS * sizeof (uint64_t)
+                    : c->type == __bsky_roaring_Run
+                    ? c->len * 2 * sizeof (uint16_t)
+                    : c->len * sizeof (uint16_t);
 
-            if (*data->start != ':') bsky_defer_ec(bsky_ec_Json_expect_Colon);
+        void *data = malloc(size ? size : 1);
 
-            *data = bsky_shift_str(*data, 1);
+        if (data == NULL) {
+            bsky_return_error(bsky_ec_Out_of_memory);
+            return bsky_ec_Out_of_memory;
+        }
+        memcpy(data, c->array, size);
 
-            elem = bsky_parse_json(data, ec);
+        *copy = *c;
+        copy->array = data;
+        copy->cap   = c->len;
 
-            if (*ec != bsky_ec_Ok) bsky_defer_ec(*ec);
+        return bsky_ec_Ok;
+    }
 
-            pair.name  = name.str;
-            pair.value = elem;
-            bsky_da_push(&dct_da, pair);
+    // Array or bitmap copy of run container.
+    static enum bsky_error_code
+    __bsky_roaring_plain(const struct __bsky_roaring_container *c,
+                         struct __bsky_roaring_container *plain)
+    {
+        enum bsky_error_code ec;
 
-            *data = bsky_trim_left(*data);
-        } while(*data->start == ',');
+        if ((ec = __bsky_roaring_copy(c, plain)) != bsky_ec_Ok) return ec;
+        if ((ec = __bsky_roaring_unrun(plain)) != bsky_ec_Ok)
+            __bsky_roaring_container_free(plain);
 
-        if (*data->start != '}') bsky_defer_ec(bsky_ec_Json_expect_CCB);
+        return ec;
+    }
 
-        *data = bsky_shift_str(*data, 1);
+    static enum bsky_error_code
+    __bsky_roaring_append(struct bsky_roaring *out,
+                          struct __bsky_roaring_container *c)
+    {
+        enum bsky_error_code ec;
 
-        struct bsky_view dct = bsky_tmp_view_of_da(&dct_da);
+        if ((ec = __bsky_roaring_shrink(c)) != bsky_ec_Ok) {
+            __bsky_roaring_container_free(c);
+            return ec;
+        }
+        if (c->card == 0) return bsky_ec_Ok;
 
-        json.dct.data = dct.start;
-        json.dct.len  = (dct.end - dct.start) / sizeof (struct bsky_json_pair);
+        if ((ec = bsky_da_push(out, *c)) != bsky_ec_Ok) {
+            __bsky_roaring_container_free(c);
+            return ec;
+        }
 
-    defer:
-        bsky_da_free(&dct_da);
-        return json;
+        return bsky_ec_Ok;
     }
 
-    struct bsky_json bsky_parse_json_str(struct bsky_str *data,
-                                         enum bsky_error_code *ec)
+    // Array container of `a' ∪ `b', bitmap when it does not fit.
+    static enum bsky_error_code
+    __bsky_roaring_union(const struct __bsky_roaring_container *a,
+                         const struct __bsky_roaring_container *b,
+                         struct __bsky_roaring_container *res)
     {
-        *ec = bsky_ec_Ok;
+        uint32_t i = 0, j = 0, k = 0;
 
-        struct bsky_str_builder sb = { 0 };
-        struct bsky_json json = { 0 };
+        res->array = malloc((a->len + b->len) * sizeof (uint16_t));
+        if (res->array == NULL) {
+            bsky_return_error(bsky_ec_Out_of_memory);
+            return bsky_ec_Out_of_memory;
+        }
 
-        *data = bsky_trim_left(*data);
+        while (i < a->len && j < b->len) {
+            uint16_t x = a->array[i], y = b->array[j];
 
-        if (*data->start != '"') bsky_defer_ec(bsky_ec_Json_expect_OQ);
+            res->array[k++] = x < y ? x : y;
+            i += x <= y;
+            j += y <= x;
+        }
+        while (i < a->len) res->array[k++] = a->array[i++];
+        while (j < b->len) res->array[k++] = b->array[j++];
 
-        *data = bsky_shift_str(*data, 1);
+        res->type = __bsky_roaring_Array;
+        res->len  = res->card = k;
+        res->cap  = a->len + b->len;
 
-        char *end = data->start;
+        return k > BSKY_ROARING_ARRAY_MAX ? __bsky_roaring_to_bitmap(res)
+                                          : bsky_ec_Ok;
+    }
 
-        while (end < data->end && *end != '"') {
-            if (*end == '\\' && end+1 != data->end) end++;
-            end++;
+    // Operation on containers of the same key, neither is run.
+    static enum bsky_error_code
+    __bsky_roaring_combine(const struct __bsky_roaring_kernels *k,
+                           const struct __bsky_roaring_container *a,
+                           const struct __bsky_roaring_container *b,
+                           int op, struct __bsky_roaring_container *res)
+    {
+        enum bsky_error_code ec;
+        int abit = a->type == __bsky_roaring_Bitmap;
+        int bbit = b->type == __bsky_roaring_Bitmap;
+
+        *res = (struct __bsky_roaring_container) { .key = a->key };
+
+        if (!abit && !bbit && op == __bsky_roaring_Or)
+            return __bsky_roaring_union(a, b, res);
+
+        if (!abit && !bbit) {
+            res->array = malloc((a->len ? a->len : 1) * sizeof (uint16_t));
+            if (res->array == NULL) {
+                bsky_return_error(bsky_ec_Out_of_memory);
+                return bsky_ec_Out_of_memory;
+            }
+            res->type = __bsky_roaring_Array;
+            res->cap  = a->len;
+            res->len  = res->card = k->match(
+                a->array, a->len, b->array, b->len, res->array,
+                op == __bsky_roaring_And);
+            return bsky_ec_Ok;
         }
 
-        bsky_sb_push_str(&sb, (struct bsky_str) { data->start, end });
-        data->start = end;
+        if (abit && bbit) {
+            res->bitmap = malloc(__BSKY_ROARING_WORDS * sizeof (uint64_t));
+            if (res->bitmap == NULL) {
+                bsky_return_error(bsky_ec_Out_of_memory);
+                return bsky_ec_Out_of_memory;
+            }
+            res->type = __bsky_roaring_Bitmap;
+            res->card = k->words(res->bitmap, a->bitmap, b->bitmap, op);
+            return bsky_ec_Ok;
+        }
 
-        if (end >= data->end) bsky_defer_ec(bsky_ec_Json_expect_CQ);
+        // values of array filtered by bitmap.
+        if (op == __bsky_roaring_And ||
+            (!abit && op == __bsky_roaring_Andnot)) {
+            const struct __bsky_roaring_container *arr = abit ? b : a;
+            const uint64_t *bits = abit ? a->bitmap : b->bitmap;
+            uint64_t want = op == __bsky_roaring_And;
+
+            res->array = malloc((arr->len ? arr->len : 1) * sizeof (uint16_t));
+            if (res->array == NULL) {
+                bsky_return_error(bsky_ec_Out_of_memory);
+                return bsky_ec_Out_of_memory;
+            }
+            res->type = __bsky_roaring_Array;
+            res->cap  = arr->len;
+            for (uint32_t i = 0; i < arr->len; ++i) {
+                uint16_t v = arr->array[i];
 
-        data->start++;
+                res->array[res->len] = v;
+                res->len += ((bits[v >> 6] >> (v & 63)) & 1) == want;
+            }
+            res->card = res->len;
+            return bsky_ec_Ok;
+        }
 
+        // copy of bitmap with bits of array set or cleared.
+        const struct __bsky_roaring_container *arr = abit ? b : a;
 
+        if ((ec = __bsky_roaring_copy(abit ? a : b, res)) != bsky_ec_Ok)
+            return ec;
+        res->key = a->key;
 
-        struct bsky_str str = bsky_sb_build_tmp(&sb);
+        for (uint32_t i = 0; i < arr->len; ++i) {
+            uint16_t v   = arr->array[i];
+            uint64_t bit = 1ull << (v & 63), old = res->bitmap[v >> 6];
 
-        json.var = bsky_json_Str;
-        json.str = str.start;
+            if (op == __bsky_roaring_Or) {
+                res->bitmap[v >> 6] = old | bit;
+                res->card += (old & bit) == 0;
+            } else {
+                res->bitmap[v >> 6] = old & ~bit;
+                res->card -= (old & bit) != 0;
+            }
+        }
 
-    defer:
-        bsky_da_free(&sb);
-        return json;
+        return bsky_ec_Ok;
     }
 
-    struct bsky_json bsky_parse_json_num(struct bsky_str *data,
-                                         enum bsky_error_code *ec)
+    static enum bsky_error_code __bsky_roaring_op(struct bsky_roaring *out,
+                                                  struct bsky_roaring *a,
+                                                  struct bsky_roaring *b,
+                                                  int op)
     {
-        *ec = bsky_ec_Ok;
+        const struct __bsky_roaring_kernels *k = __bsky_roaring_current();
+        enum bsky_error_code ec = bsky_ec_Ok;
+        struct __bsky_roaring_container c;
+        size_t i = 0, j = 0;
+
+        bsky_roaring_free(out);
+
+        while (i < a->len || j < b->len) {
+            uint32_t ka = i < a->len ? a->data[i].key : 0x10000;
+            uint32_t kb = j < b->len ? b->data[j].key : 0x10000;
+
+            if (ka != kb) {
+                struct __bsky_roaring_container *only = ka < kb
+                                                      ? &a->data[i++]
+                                                      : &b->data[j++];
+
+                if (op == __bsky_roaring_And ||
+                    (op == __bsky_roaring_Andnot && ka > kb)) {
+                    continue;
+                }
+                if ((ec = __bsky_roaring_copy(only, &c)) != bsky_ec_Ok)
+                    break;
+                if ((ec = bsky_da_push(out, c)) != bsky_ec_Ok) {
+                    __bsky_roaring_container_free(&c);
+                    break;
+                }
+                continue;
+            }
 
-        struct bsky_json json = { 0 };
+            // runs of inputs are expanded to copies.
+            struct __bsky_roaring_container *x = &a->data[i++], px = { 0 };
+            struct __bsky_roaring_container *y = &b->data[j++], py = { 0 };
 
-        *data = bsky_trim_left(*data);
+            if (x->type == __bsky_roaring_Run) {
+                if ((ec = __bsky_roaring_plain(x, &px)) != bsky_ec_Ok) break;
+                x = &px;
+            }
+            if (y->type == __bsky_roaring_Run) {
+                if ((ec = __bsky_roaring_plain(y, &py)) != bsky_ec_Ok) {
+                    __bsky_roaring_container_free(&px);
+                    break;
+                }
+                y = &py;
+            }
 
-        char *endptr = NULL;
-        long double v = strtold(data->start, &endptr);
+            ec = __bsky_roaring_combine(k, x, y, op, &c);
+            __bsky_roaring_container_free(&px);
+            __bsky_roaring_container_free(&py);
 
-        if (endptr == data->start) bsky_defer_ec(bsky_ec_Json_expect_Number);
+            if (ec != bsky_ec_Ok) break;
+            if ((ec = __bsky_roaring_append(out, &c)) != bsky_ec_Ok) break;
+        }
 
-        data->start = endptr;
+        if (ec != bsky_ec_Ok) bsky_roaring_free(out);
 
-        json.var = bsky_json_Num;
-        json.num = v;
+        return ec;
+    }
 
-    defer:
-        return json;
+    enum bsky_error_code bsky_roaring_and(struct bsky_roaring *out,
+                                          struct bsky_roaring *a,
+                                          struct bsky_roaring *b)
+    {
+        return __bsky_roaring_op(out, a, b, __bsky_roaring_And);
     }
 
-    struct bsky_json bsky_parse_json_null(struct bsky_str *data,
-                                          enum bsky_error_code *ec)
+    enum bsky_error_code bsky_roaring_or(struct bsky_roaring *out,
+                                         struct bsky_roaring *a,
+                                         struct bsky_roaring *b)
     {
-        *ec = bsky_ec_Ok;
+        return __bsky_roaring_op(out, a, b, __bsky_roaring_Or);
+    }
 
-        struct bsky_json json = { 0 };
+    enum bsky_error_code bsky_roaring_andnot(struct bsky_roaring *out,
+                                             struct bsky_roaring *a,
+                                             struct bsky_roaring *b)
+    {
+        return __bsky_roaring_op(out, a, b, __bsky_roaring_Andnot);
+    }
 
-        *data = bsky_trim_left(*data);
+    static uint32_t
+    __bsky_roaring_runs(const struct __bsky_roaring_container *c)
+    {
+        uint32_t runs = 0;
 
-        if (!bsky_str_starts_with(*data, bsky_mk_str("null")))
-            bsky_defer_ec(bsky_ec_Json_expect_Null);
+        if (c->type == __bsky_roaring_Run) return c->len;
 
-        json.var = bsky_json_Null;
+        if (c->type == __bsky_roaring_Array) {
+            for (uint32_t i = 0; i < c->len; ++i)
+                runs += i == 0 || c->array[i] != c->array[i - 1] + 1;
+            return runs;
+        }
 
-        data->start += 4;
+        // bits without set bit before them.
+        for (uint32_t i = 0, carry = 0; i < __BSKY_ROARING_WORDS; ++i) {
+            uint64_t w = c->bitmap[i];
 
-	defer:
-        return json;
+            runs  += __builtin_popcountll(w & ~((w << 1) | carry));
+            carry  = w >> 63;
+        }
+
+        return runs;
     }
 
-    struct bsky_json bsky_parse_json_bool(struct bsky_str *data,
-                                          enum bsky_error_code *ec)
+    static enum bsky_error_code
+    __bsky_roaring_to_runs(struct __bsky_roaring_container *c, uint32_t n)
     {
-        *ec = bsky_ec_Ok;
+        uint16_t *runs = malloc(n * 2 * sizeof (uint16_t));
+        uint32_t  k = 0, v = 0;
 
-        struct bsky_json json = { 0 };
+        if (runs == NULL) {
+            bsky_return_error(bsky_ec_Out_of_memory);
+            return bsky_ec_Out_of_memory;
+        }
 
-        *data = bsky_trim_left(*data);
+        // start and last value of every run, then length - 1.
+        if (c->type == __bsky_roaring_Array) {
+            for (uint32_t i = 0; i < c->len; ++i) {
+                if (i == 0 || c->array[i] != c->array[i - 1] + 1) {
+                    runs[2 * k++] = c->array[i];
+                }
+                runs[2 * k - 1] = c->array[i];
+            }
+        } else {
+            while (v < 0x10000) {
+                uint64_t w = c->bitmap[v >> 6] >> (v & 63);
+
+                if (w == 0) {
+                    v = (v | 63) + 1;
+                    continue;
+                }
+                v += __builtin_ctzll(w);
+                runs[2 * k] = v;
+
+                // the first clear bit after start.
+                while (v < 0x10000) {
+                    uint64_t z = ~c->bitmap[v >> 6] & (~0ull << (v & 63));
+
+                    if (z) {
+                        v = (v & ~63u) + __builtin_ctzll(z);
+                        break;
+                    }
+                    v = (v | 63) + 1;
+                }
+                runs[2 * k++ + 1] = v - 1;
+            }
+        }
 
-        json.var = bsky_json_Bool;
+        for (uint32_t i = 0; i < k; ++i) runs[2 * i + 1] -= runs[2 * i];
 
-        if (bsky_str_starts_with(*data, bsky_mk_str("false"))) {
-            data->start += 5;
-            json._bool = 0;
+        free(c->array);
+        c->runs = runs;
+        c->type = __bsky_roaring_Run;
+        c->len  = c->cap = k;
 
-        } else if (bsky_str_starts_with(*data, bsky_mk_str("true"))) {
-            data->start += 4;
-            json._bool = 1;
+        return bsky_ec_Ok;
+    }
 
-        } else {
-            bsky_defer_ec(bsky_ec_Json_expect_Bool);
+    enum bsky_error_code bsky_roaring_optimize(struct bsky_roaring *r)
+    {
+        enum bsky_error_code ec;
+
+        for (size_t i = 0; i < r->len; ++i) {
+            struct __bsky_roaring_container *c = &r->data[i];
+            uint32_t runs = __bsky_roaring_runs(c);
+            size_t   size = c->card > BSKY_ROARING_ARRAY_MAX
+                          ? __BSKY_ROARING_WORDS * sizeof (uint64_t)
+                          : c->card * sizeof (uint16_t);
+
+            if (c->type == __bsky_roaring_Run) continue;
+            if (runs * 2 * sizeof (uint16_t) >= size) continue;
+
+            if ((ec = __bsky_roaring_to_runs(c, runs)) != bsky_ec_Ok)
+                return ec;
         }
 
-    defer:
-        return json;
+        return bsky_ec_Ok;
     }
 
-    struct bsky_json bsky_parse_json(struct bsky_str *data,
-                                     enum bsky_error_code* ec)
+    enum bsky_error_code bsky_roaring_ids(struct bsky_roaring *r,
+                                          struct bsky_graph_ids *out)
     {
-        *ec = bsky_ec_Ok;
-        struct bsky_json json = { 0 };
+        size_t len = out->len;
 
-        *data = bsky_trim_left(*data);
-        struct bsky_str data_s = *data;
+        for (size_t i = 0; i < r->len; ++i) len += r->data[i].card;
+        if (len > out->cap) {
+            uint32_t *data = realloc(out->data, len * sizeof (uint32_t));
 
-        json = bsky_parse_json_null(data, ec);
-        if (*ec != bsky_ec_Json_expect_Null) return json;
+            if (data == NULL) {
+                bsky_return_error(bsky_ec_Out_of_memory);
+                return bsky_ec_Out_of_memory;
+            }
+            out->data = data;
+            out->cap  = len;
+        }
 
-        *data = data_s;
-        json = bsky_parse_json_bool(data, ec);
-        if (*ec != bsky_ec_Json_expect_Bool) return json;
+        for (size_t i = 0; i < r->len; ++i) {
+            struct __bsky_roaring_container *c = &r->data[i];
+            uint32_t high = (uint32_t) c->key << 16;
+
+            switch (c->type) {
+            case __bsky_roaring_Array:
+                for (uint32_t k = 0; k < c->len; ++k)
+                    out->data[out->len++] = high | c->array[k];
+                break;
+            case __bsky_roaring_Bitmap:
+                for (uint32_t k = 0; k < __BSKY_ROARING_WORDS; ++k) {
+                    for (uint64_t w = c->bitmap[k]; w; w &= w - 1)
+                        out->data[out->len++] = high | (k * 64 +
+                                                __builtin_ctzll(w));
+                }
+                break;
+            case __bsky_roaring_Run:
+                for (uint32_t k = 0; k < c->len; ++k) {
+                    uint32_t v = c->runs[2 * k], end = v + c->runs[2 * k + 1];
+
+                    for (; v <= end; ++v) out->data[out->len++] = high | v;
+                }
+                break;
+            }
+        }
 
-        *data = data_s;
-        json = bsky_parse_json_num(data, ec);
-        if (*ec != bsky_ec_Json_expect_Number) return json;
+        return bsky_ec_Ok;
+    }
 
-        *data = data_s;
-        json = bsky_parse_json_str(data, ec);
-        if (*ec != bsky_ec_Json_expect_OQ) return json;
+    enum bsky_error_code bsky_roaring_add_actors(struct bsky_roaring *r,
+                                                 struct bsky_graph *g,
+                                                 struct bsky_json *response)
+    {
+        static const char *lists[] = {
+            "follows", "followers", "blocks", "mutes", "items",
+        };
+        enum bsky_error_code ec;
+        struct bsky_json *actors = NULL;
 
-        *data = data_s;
-        json = bsky_parse_json_arr(data, ec);
-        if (*ec != bsky_ec_Json_expect_OSB) return json;
+        for (size_t i = 0; i < BSKY_ARRAY_LEN(lists) && actors == NULL; ++i) {
+            actors = bsky_json_get(response, lists[i]);
+            if (actors && actors->var != bsky_json_Arr) actors = NULL;
+        }
 
-        *data = data_s;
-        json = bsky_parse_json_dct(data, ec);
-        if (*ec != bsky_ec_Json_expect_OCB) return json;
+        if (actors == NULL) {
+            bsky_return_error(bsky_ec_Roaring_response);
+            return bsky_ec_Roaring_response;
+        }
 
-        *ec = bsky_ec_Json_invalid_variant;
+        for (size_t i = 0; i < actors->arr.len; ++i) {
+            struct bsky_json *actor = &actors->arr.data[i];
+            struct bsky_json *did   = bsky_json_get(actor, "did");
+            uint32_t id;
+
+            // list item, actor is its subject.
+            if (did == NULL && (actor = bsky_json_get(actor, "subject")))
+                did = bsky_json_get(actor, "did");
+            if (did == NULL || did->var != bsky_json_Str) {
+                bsky_return_error(bsky_ec_Roaring_response);
+                return bsky_ec_Roaring_response;
+            }
 
-    defer:
-        return json;
+            if ((id = bsky_graph_id(g, bsky_mk_str(did->str))) ==
+                BSKY_GRAPH_NONE) {
+                bsky_return_error(bsky_ec_Out_of_memory);
+                return bsky_ec_Out_of_memory;
+            }
+            if ((ec = bsky_roaring_add(r, id)) != bsky_ec_Ok) return ec;
+        }
+
+        return bsky_ec_Ok;
     }
 
+    void bsky_roaring_free(struct bsky_roaring *r)
+    {
+        for (size_t i = 0; i < r->len; ++i)
+            __bsky_roaring_container_free(&r->data[i]);
+
+        free(r->data);
+        r->data = NULL;
+        r->len  = r->cap = 0;
+    }
 
 #endif
 
@@ -1122,6 +15495,44 @@
     #define ec_Json_expect_CQ       bsky_ec_Json_expect_CQ
     #define ec_Json_expect_Colon    bsky_ec_Json_expect_Colon
     #define ec_Json_invalid_variant bsky_ec_Json_invalid_variant
+    #define ec_Out_of_memory        bsky_ec_Out_of_memory
+    #define ec_Url_invalid          bsky_ec_Url_invalid
+    #define ec_Net_resolve          bsky_ec_Net_resolve
+    #define ec_Net_connect          bsky_ec_Net_connect
+    #define ec_Pds_not_found        bsky_ec_Pds_not_found
+    #define ec_Pds_unknown_did      bsky_ec_Pds_unknown_did
+    #define ec_Io                   bsky_ec_Io
+    #define ec_Net_send             bsky_ec_Net_send
+    #define ec_Xrpc_status          bsky_ec_Xrpc_status
+    #define ec_Xrpc_transport       bsky_ec_Xrpc_transport
+    #define ec_Loop                 bsky_ec_Loop
+    #define ec_Ws_handshake         bsky_ec_Ws_handshake
+    #define ec_Ws_protocol          bsky_ec_Ws_protocol
+    #define ec_Ws_too_large         bsky_ec_Ws_too_large
+    #define ec_Ws_closed            bsky_ec_Ws_closed
+    #define ec_Cbor_eof             bsky_ec_Cbor_eof
+    #define ec_Cbor_invalid         bsky_ec_Cbor_invalid
+    #define ec_Cbor_non_canonical   bsky_ec_Cbor_non_canonical
+    #define ec_Car_invalid          bsky_ec_Car_invalid
+    #define ec_Car_truncated        bsky_ec_Car_truncated
+    #define ec_Cid_invalid          bsky_ec_Cid_invalid
+    #define ec_Mst_invalid          bsky_ec_Mst_invalid
+    #define ec_Mst_missing_block    bsky_ec_Mst_missing_block
+    #define ec_Firehose_invalid     bsky_ec_Firehose_invalid
+    #define ec_Firehose_thread      bsky_ec_Firehose_thread
+    #define ec_Checkpoint_io        bsky_ec_Checkpoint_io
+    #define ec_Prefilter_build      bsky_ec_Prefilter_build
+    #define ec_Jetstream_invalid    bsky_ec_Jetstream_invalid
+    #define ec_Jetstream_decompress bsky_ec_Jetstream_decompress
+    #define ec_Verify_invalid_key   bsky_ec_Verify_invalid_key
+    #define ec_Verify_thread        bsky_ec_Verify_thread
+    #define ec_Capture_invalid      bsky_ec_Capture_invalid
+    #define ec_Backfill_fetch       bsky_ec_Backfill_fetch
+    #define ec_Label_invalid        bsky_ec_Label_invalid
+    #define ec_Pool_thread          bsky_ec_Pool_thread
+    #define ec_Snapshot_invalid     bsky_ec_Snapshot_invalid
+    #define ec_Graph_invalid        bsky_ec_Graph_invalid
+    #define ec_Roaring_response     bsky_ec_Roaring_response
 
     #define str_of_error_code(ec)     bsky_str_of_error_code(ec)
     #define log_error(ec)             bsky_log_error(ec)
@@ -1134,6 +15545,7 @@
      */
     #define tmp_alloc(size) bsky_tmp_alloc(size)
     #define default_tmp_reset() bsky_default_tmp_reset()
+    #define default_tmp_free() bsky_default_tmp_free()
 
     /*
      * BSKY DYNAMIC ARRAY
@@ -1193,10 +15605,420 @@
     #define parse_json_str(str, ec) bsky_parse_json_str(str, ec)
     #define parse_json_bool(str, ec) bsky_parse_json_bool(str, ec)
     #define parse_json_null(str, ec) bsky_parse_json_null(str, ec)
+    #define json_get(json, name) bsky_json_get(json, name)
 
     #define Json      bsky_Json;
     #define Json_Pair bsky_Json_Pair;
 
+    /*
+     * BSKY STRING MAP
+     */
+    #define str_map_set(map, key, value) bsky_str_map_set(map, key, value)
+    #define str_map_get(map, key) bsky_str_map_get(map, key)
+    #define str_map_del(map, key) bsky_str_map_del(map, key)
+    #define str_map_free(map) bsky_str_map_free(map)
+
+    /*
+     * BSKY NET
+     */
+    #define parse_url(str, ec) bsky_parse_url(str, ec)
+    #define url_port(url) bsky_url_port(url)
+    #define net_connect(host, port, ec) bsky_net_connect(host, port, ec)
+    #define conn_pool_host(pool, h, p, ec) bsky_conn_pool_host(pool, h, p, ec)
+    #define conn_pool_get(pool, host, ec) bsky_conn_pool_get(pool, host, ec)
+    #define conn_pool_put(pool, host, fd, ka) \
+                        bsky_conn_pool_put(pool, host, fd, ka)
+    #define conn_pool_free(pool) bsky_conn_pool_free(pool)
+    #define conn_pool_warmup(pool, n, timeout, stats) \
+                        bsky_conn_pool_warmup(pool, n, timeout, stats)
+
+    /*
+     * BSKY PDS ROUTING
+     */
+    #define pds_of_did_doc(doc, ec) bsky_pds_of_did_doc(doc, ec)
+    #define xrpc_is_pds_scoped(nsid) bsky_xrpc_is_pds_scoped(nsid)
+    #define pds_router_set(r, did, ep) bsky_pds_router_set(r, did, ep)
+    #define pds_router_add_doc(r, doc) bsky_pds_router_add_doc(r, doc)
+    #define pds_router_set_fallback(r, ep) bsky_pds_router_set_fallback(r, ep)
+    #define pds_router_lookup(r, did) bsky_pds_router_lookup(r, did)
+    #define pds_router_route(r, did, nsid, ec) \
+                        bsky_pds_router_route(r, did, nsid, ec)
+    #define pds_router_release(r, t, ka) bsky_pds_router_release(r, t, ka)
+    #define pds_router_free(r) bsky_pds_router_free(r)
+
+    /*
+     * BSKY SHA-256
+     */
+    #define sha256_init(sha) bsky_sha256_init(sha)
+    #define sha256_update(sha, data, len) bsky_sha256_update(sha, data, len)
+    #define sha256_final(sha, digest) bsky_sha256_final(sha, digest)
+    #define sha256(data, len, digest) bsky_sha256(data, len, digest)
+    #define sha256_use(backend) bsky_sha256_use(backend)
+    #define sha256_many(data, len, digests) bsky_sha256_many(data, len, digests)
+
+    #define sha256_Auto     bsky_sha256_Auto
+    #define sha256_Portable bsky_sha256_Portable
+    #define sha256_Avx2     bsky_sha256_Avx2
+    #define sha256_Shani    bsky_sha256_Shani
+    #define sha256_Armv8    bsky_sha256_Armv8
+
+    /*
+     * BSKY BLOB UPLOAD
+     */
+    #define blob_upload_file(up, fd) bsky_blob_upload_file(up, fd)
+    #define blob_upload_mem(up, view) bsky_blob_upload_mem(up, view)
+    #define tmp_blob_cid(sha256) bsky_tmp_blob_cid(sha256)
+
+    /*
+     * BSKY WRITE BATCHER
+     */
+    #define write_Create bsky_write_Create
+    #define write_Update bsky_write_Update
+    #define write_Delete bsky_write_Delete
+
+    #define write_batcher_add(b, repo, w) bsky_write_batcher_add(b, repo, w)
+    #define write_batcher_poll(b) bsky_write_batcher_poll(b)
+    #define write_batcher_flush(b) bsky_write_batcher_flush(b)
+    #define write_batcher_free(b) bsky_write_batcher_free(b)
+
+    /*
+     * BSKY EVENT LOOP
+     */
+    #define loop_Read  bsky_loop_Read
+    #define loop_Write bsky_loop_Write
+    #define loop_Close bsky_loop_Close
+
+    #define loop_init(loop) bsky_loop_init(loop)
+    #define loop_add(loop, fd, ev, fn, user) bsky_loop_add(loop, fd, ev, fn, user)
+    #define loop_mod(loop, fd, ev) bsky_loop_mod(loop, fd, ev)
+    #define loop_del(loop, fd) bsky_loop_del(loop, fd)
+    #define loop_timer(loop, ms, fn, user) bsky_loop_timer(loop, ms, fn, user)
+    #define loop_run_once(loop, timeout) bsky_loop_run_once(loop, timeout)
+    #define loop_run(loop) bsky_loop_run(loop)
+    #define loop_stop(loop) bsky_loop_stop(loop)
+    #define loop_free(loop) bsky_loop_free(loop)
+
+    /*
+     * BSKY WEBSOCKET
+     */
+    #define ws_Continuation bsky_ws_Continuation
+    #define ws_Text         bsky_ws_Text
+    #define ws_Binary       bsky_ws_Binary
+    #define ws_Close        bsky_ws_Close
+    #define ws_Ping         bsky_ws_Ping
+    #define ws_Pong         bsky_ws_Pong
+
+    #define ws_connect(ws, url, ec) bsky_ws_connect(ws, url, ec)
+    #define ws_handshake(ws, fd, host, path) bsky_ws_handshake(ws, fd, host, path)
+    #define ws_attach(ws, loop) bsky_ws_attach(ws, loop)
+    #define ws_read(ws) bsky_ws_read(ws)
+    #define ws_feed(ws, data, len) bsky_ws_feed(ws, data, len)
+    #define ws_send(ws, op, data, len) bsky_ws_send(ws, op, data, len)
+    #define ws_free(ws) bsky_ws_free(ws)
+    #define ws_mask(data, len, key) bsky_ws_mask(data, len, key)
+    #define ws_accept_key(key) bsky_ws_accept_key(key)
+
+    /*
+     * BSKY DAG-CBOR
+     */
+    #define cbor_Int   bsky_cbor_Int
+    #define cbor_Float bsky_cbor_Float
+    #define cbor_Bytes bsky_cbor_Bytes
+    #define cbor_Str   bsky_cbor_Str
+    #define cbor_Arr   bsky_cbor_Arr
+    #define cbor_Map   bsky_cbor_Map
+    #define cbor_Bool  bsky_cbor_Bool
+    #define cbor_Null  bsky_cbor_Null
+    #define cbor_Link  bsky_cbor_Link
+
+    #define parse_cbor(data, ec) bsky_parse_cbor(data, ec)
+    #define cbor_skip(data) bsky_cbor_skip(data)
+    #define cbor_get(cbor, key) bsky_cbor_get(cbor, key)
+    #define cbor_str_eq(str, cstr) bsky_cbor_str_eq(str, cstr)
+
+    #define Cbor      bsky_Cbor
+    #define Cbor_Pair bsky_Cbor_Pair
+
+    #define sb_push_cbor(sb, cbor) bsky_sb_push_cbor(sb, cbor)
+    #define sb_push_cbor_of_json(sb, json) bsky_sb_push_cbor_of_json(sb, json)
+    #define cbor_push_head(sb, major, arg) bsky_cbor_push_head(sb, major, arg)
+    #define cbor_push_int(sb, i) bsky_cbor_push_int(sb, i)
+    #define cbor_push_float(sb, f) bsky_cbor_push_float(sb, f)
+    #define cbor_push_str(sb, str) bsky_cbor_push_str(sb, str)
+    #define cbor_push_bytes(sb, bytes) bsky_cbor_push_bytes(sb, bytes)
+    #define cbor_push_link(sb, cid) bsky_cbor_push_link(sb, cid)
+    #define cbor_push_bool(sb, b) bsky_cbor_push_bool(sb, b)
+    #define cbor_push_null(sb) bsky_cbor_push_null(sb)
+    #define cbor_push_arr(sb, len) bsky_cbor_push_arr(sb, len)
+    #define cbor_push_map(sb, len) bsky_cbor_push_map(sb, len)
+    #define cbor_key_cmp(a, b) bsky_cbor_key_cmp(a, b)
+    #define tmp_record_cid(cbor) bsky_tmp_record_cid(cbor)
+
+    /*
+     * BSKY CAR V1
+     */
+    #define car_open_mem(car, data, ec) bsky_car_open_mem(car, data, ec)
+    #define car_open_file(car, path, ec) bsky_car_open_file(car, path, ec)
+    #define car_open_stream(car, fd, prefix, ec) \
+                bsky_car_open_stream(car, fd, prefix, ec)
+    #define car_next(car, block, ec) bsky_car_next(car, block, ec)
+    #define car_build_index(car) bsky_car_build_index(car)
+    #define car_find(car, cid, block) bsky_car_find(car, cid, block)
+    #define car_free(car) bsky_car_free(car)
+    #define car_push_header(sb, roots, len) bsky_car_push_header(sb, roots, len)
+    #define car_push_block(sb, cid, data) bsky_car_push_block(sb, cid, data)
+
+    /*
+     * BSKY CID
+     */
+    #define multicodec_Sha2_256 bsky_multicodec_Sha2_256
+    #define multicodec_Raw      bsky_multicodec_Raw
+    #define multicodec_Dag_pb   bsky_multicodec_Dag_pb
+    #define multicodec_Dag_cbor bsky_multicodec_Dag_cbor
+
+    #define cid_of_bytes(data, ec) bsky_cid_of_bytes(data, ec)
+    #define cid_of_str(str, ec) bsky_cid_of_str(str, ec)
+    #define cid_of_data(codec, data) bsky_cid_of_data(codec, data)
+    #define sb_push_cid(sb, cid) bsky_sb_push_cid(sb, cid)
+    #define tmp_str_of_cid(cid) bsky_tmp_str_of_cid(cid)
+    #define cid_eq(a, b) bsky_cid_eq(a, b)
+    #define cid_verify(cid, data) bsky_cid_verify(cid, data)
+    #define car_verify(blocks, len, ok) bsky_car_verify(blocks, len, ok)
+
+    /*
+     * BSKY MERKLE SEARCH TREE
+     */
+    #define mst_init(mst, root, fetch, user) bsky_mst_init(mst, root, fetch, user)
+    #define mst_init_car(mst, car, ec) bsky_mst_init_car(mst, car, ec)
+    #define mst_node(mst, cid, node) bsky_mst_node(mst, cid, node)
+    #define mst_get(mst, key, value, ec) bsky_mst_get(mst, key, value, ec)
+    #define mst_iter_init(it, mst) bsky_mst_iter_init(it, mst)
+    #define mst_next(it, key, value, ec) bsky_mst_next(it, key, value, ec)
+    #define mst_iter_free(it) bsky_mst_iter_free(it)
+    #define mst_diff(from, to, fn, user) bsky_mst_diff(from, to, fn, user)
+    #define mst_free(mst) bsky_mst_free(mst)
+
+    /*
+     * BSKY FIREHOSE PIPELINE
+     */
+    #define spsc_init(ring, cap) bsky_spsc_init(ring, cap)
+    #define spsc_push(ring, item) bsky_spsc_push(ring, item)
+    #define spsc_pop(ring) bsky_spsc_pop(ring)
+    #define spsc_depth(ring) bsky_spsc_depth(ring)
+    #define spsc_free(ring) bsky_spsc_free(ring)
+    #define firehose_start(pipe, config) bsky_firehose_start(pipe, config)
+    #define firehose_push(pipe, frame) bsky_firehose_push(pipe, frame)
+    #define firehose_on_ws_message(pipe, opcode, message)                  \
+        bsky_firehose_on_ws_message(pipe, opcode, message)
+    #define firehose_decode(ev, frame) bsky_firehose_decode(ev, frame)
+    #define firehose_metrics(pipe, metrics, len)                           \
+        bsky_firehose_metrics(pipe, metrics, len)
+    #define firehose_stop(pipe) bsky_firehose_stop(pipe)
+
+    /*
+     * BSKY CURSOR CHECKPOINT
+     */
+    #define checkpoint_open(cp, path, workers, ec)                         \
+        bsky_checkpoint_open(cp, path, workers, ec)
+    #define checkpoint_dispatch(cp, worker, cursor)                        \
+        bsky_checkpoint_dispatch(cp, worker, cursor)
+    #define checkpoint_skip(cp, cursor) bsky_checkpoint_skip(cp, cursor)
+    #define checkpoint_done(cp, worker, cursor)                            \
+        bsky_checkpoint_done(cp, worker, cursor)
+    #define checkpoint_watermark(cp) bsky_checkpoint_watermark(cp)
+    #define checkpoint_flush(cp, force) bsky_checkpoint_flush(cp, force)
+    #define checkpoint_attach(cp, loop) bsky_checkpoint_attach(cp, loop)
+    #define checkpoint_url(cp, url) bsky_checkpoint_url(cp, url)
+    #define checkpoint_close(cp) bsky_checkpoint_close(cp)
+
+    /*
+     * BSKY PREFILTER
+     */
+    #define nsid_set_build(set, nsids, len) bsky_nsid_set_build(set, nsids, len)
+    #define nsid_set_has(set, collection) bsky_nsid_set_has(set, collection)
+    #define nsid_set_free(set) bsky_nsid_set_free(set)
+    #define did_filter_init(filter, expected)                              \
+        bsky_did_filter_init(filter, expected)
+    #define did_filter_add(filter, did) bsky_did_filter_add(filter, did)
+    #define did_filter_has(filter, did) bsky_did_filter_has(filter, did)
+    #define did_filter_free(filter) bsky_did_filter_free(filter)
+    #define prefilter_repo(pf, did) bsky_prefilter_repo(pf, did)
+    #define prefilter_ops(pf, ev) bsky_prefilter_ops(pf, ev)
+
+    /*
+     * BSKY JETSTREAM
+     */
+    #define json_cursor_object(c, ec) bsky_json_cursor_object(c, ec)
+    #define json_cursor_field(c, key, ec) bsky_json_cursor_field(c, key, ec)
+    #define json_cursor_array(c, ec) bsky_json_cursor_array(c, ec)
+    #define json_cursor_elem(c, ec) bsky_json_cursor_elem(c, ec)
+    #define json_cursor_str(c, str, ec) bsky_json_cursor_str(c, str, ec)
+    #define json_cursor_int(c, ec) bsky_json_cursor_int(c, ec)
+    #define json_cursor_skip(c, ec) bsky_json_cursor_skip(c, ec)
+    #define json_key_is(key, name) bsky_json_key_is(key, name)
+    #define jetstream_feed(js, message, compressed)                        \
+        bsky_jetstream_feed(js, message, compressed)
+    #define jetstream_on_ws_message(js, opcode, message)                   \
+        bsky_jetstream_on_ws_message(js, opcode, message)
+    #ifdef BSKY_API_ZSTD
+        #define jetstream_use_zstd(js, dict) bsky_jetstream_use_zstd(js, dict)
+    #endif
+    #define jetstream_free(js) bsky_jetstream_free(js)
+
+    /*
+     * BSKY SIGNATURE VERIFICATION
+     */
+    #define pubkey_of_did_key(text, key) bsky_pubkey_of_did_key(text, key)
+    #ifdef BSKY_API_OPENSSL
+        #define crypto_openssl() bsky_crypto_openssl()
+    #endif
+    #define verifier_start(v) bsky_verifier_start(v)
+    #define verifier_set_key(v, did, key) bsky_verifier_set_key(v, did, key)
+    #define verifier_submit(v, did, commit, job)                           \
+        bsky_verifier_submit(v, did, commit, job)
+    #define verifier_submit_event(v, ev, job)                              \
+        bsky_verifier_submit_event(v, ev, job)
+    #define verifier_wait(v) bsky_verifier_wait(v)
+    #define verifier_stop(v) bsky_verifier_stop(v)
+
+    /*
+     * BSKY CAPTURE & REPLAY
+     */
+    #define capture_open(cap, path, ec) bsky_capture_open(cap, path, ec)
+    #define capture_write(cap, time_ns, opcode, message)                   \
+        bsky_capture_write(cap, time_ns, opcode, message)
+    #define capture_on_ws_message(cap, opcode, message)                    \
+        bsky_capture_on_ws_message(cap, opcode, message)
+    #define capture_close(cap) bsky_capture_close(cap)
+    #define replay_open(r, path, ec) bsky_replay_open(r, path, ec)
+    #define replay_next(r, frame, time_ns, ec)                             \
+        bsky_replay_next(r, frame, time_ns, ec)
+    #define replay_run(r, ws, paced, stats) bsky_replay_run(r, ws, paced, stats)
+    #define replay_rewind(r) bsky_replay_rewind(r)
+    #define replay_free(r) bsky_replay_free(r)
+
+    /*
+     * BSKY BACKFILL
+     */
+    #define backfill_start(bf, progress) bsky_backfill_start(bf, progress)
+    #define backfill_host(bf, host, concurrency, rate)                     \
+        bsky_backfill_host(bf, host, concurrency, rate)
+    #define backfill_add(bf, did, host) bsky_backfill_add(bf, did, host)
+    #define backfill_add_list(bf, host, response, ec)                      \
+        bsky_backfill_add_list(bf, host, response, ec)
+    #define backfill_done(bf, did) bsky_backfill_done(bf, did)
+    #define backfill_wait(bf) bsky_backfill_wait(bf)
+    #define backfill_stop(bf) bsky_backfill_stop(bf)
+
+    /*
+     * BSKY LABEL INDEX
+     */
+    #define label_index_init(idx) bsky_label_index_init(idx)
+    #define label_id(idx, name) bsky_label_id(idx, name)
+    #define label_index_apply(idx, label) bsky_label_index_apply(idx, label)
+    #define label_index_has(idx, subject, src, val)                        \
+        bsky_label_index_has(idx, subject, src, val)
+    #define label_index_expire(idx, now) bsky_label_index_expire(idx, now)
+    #define label_index_free(idx) bsky_label_index_free(idx)
+    #define label_stream_feed(ls, frame) bsky_label_stream_feed(ls, frame)
+    #define label_stream_on_ws_message(ls, opcode, message)                \
+        bsky_label_stream_on_ws_message(ls, opcode, message)
+    #define label_stream_free(ls) bsky_label_stream_free(ls)
+
+    /*
+     * BSKY EPOCH RECLAMATION
+     */
+    #define ebr_enter() bsky_ebr_enter()
+    #define ebr_leave() bsky_ebr_leave()
+    #define ebr_retire(ptr, free_fn) bsky_ebr_retire(ptr, free_fn)
+    #define ebr_retire_tmp() bsky_ebr_retire_tmp()
+    #define ebr_collect() bsky_ebr_collect()
+    #define ebr_flush() bsky_ebr_flush()
+
+    /*
+     * BSKY THREAD POOL
+     */
+    #define pool_start(pool) bsky_pool_start(pool)
+    #define pool_submit(pool, task) bsky_pool_submit(pool, task)
+    #define pool_wait(pool, group) bsky_pool_wait(pool, group)
+    #define pool_for(pool, begin, end, grain, fn, user)                    \
+        bsky_pool_for(pool, begin, end, grain, fn, user)
+    #define pool_worker() bsky_pool_worker()
+    #define pool_tmp_reset(pool) bsky_pool_tmp_reset(pool)
+    #define pool_stop(pool) bsky_pool_stop(pool)
+
+    /*
+     * BSKY MPMC QUEUE
+     */
+    #define mpmc_init(q, cap) bsky_mpmc_init(q, cap)
+    #define mpmc_push(q, item) bsky_mpmc_push(q, item)
+    #define mpmc_pop(q) bsky_mpmc_pop(q)
+    #define mpmc_push_n(q, items, n) bsky_mpmc_push_n(q, items, n)
+    #define mpmc_pop_n(q, items, n) bsky_mpmc_pop_n(q, items, n)
+    #define mpmc_push_wait(q, item) bsky_mpmc_push_wait(q, item)
+    #define mpmc_pop_wait(q) bsky_mpmc_pop_wait(q)
+    #define mpmc_close(q) bsky_mpmc_close(q)
+    #define mpmc_depth(q) bsky_mpmc_depth(q)
+    #define mpmc_free(q) bsky_mpmc_free(q)
+
+    /*
+     * BSKY JSON SNAPSHOT
+     */
+    #define snap_writer_open(w, path, ec) bsky_snap_writer_open(w, path, ec)
+    #define snap_put(w, key, json) bsky_snap_put(w, key, json)
+    #define snap_writer_close(w) bsky_snap_writer_close(w)
+    #define snap_open(snap, path, ec) bsky_snap_open(snap, path, ec)
+    #define snap_validate(snap) bsky_snap_validate(snap)
+    #define snap_get(snap, key) bsky_snap_get(snap, key)
+    #define snap_items(node) bsky_snap_items(node)
+    #define snap_str(node) bsky_snap_str(node)
+    #define snap_field(node, name) bsky_snap_field(node, name)
+    #define snap_free(snap) bsky_snap_free(snap)
+
+    /*
+     * BSKY SOCIAL GRAPH
+     */
+    #define graph_id(g, did) bsky_graph_id(g, did)
+    #define graph_find(g, did) bsky_graph_find(g, did)
+    #define graph_did(g, id) bsky_graph_did(g, id)
+    #define graph_follow(g, src, dst) bsky_graph_follow(g, src, dst)
+    #define graph_unfollow(g, src, dst) bsky_graph_unfollow(g, src, dst)
+    #define graph_follow_record(g, did, record)                            \
+        bsky_graph_follow_record(g, did, record)
+    #define graph_merge(g) bsky_graph_merge(g)
+    #define graph_following(g, id, out) bsky_graph_following(g, id, out)
+    #define graph_followers(g, id, out) bsky_graph_followers(g, id, out)
+    #define graph_following_count(g, id) bsky_graph_following_count(g, id)
+    #define graph_followers_count(g, id) bsky_graph_followers_count(g, id)
+    #define graph_follows(g, src, dst) bsky_graph_follows(g, src, dst)
+    #define graph_two_hop(g, id, out) bsky_graph_two_hop(g, id, out)
+    #define graph_save(g, path) bsky_graph_save(g, path)
+    #define graph_load(g, path, ec) bsky_graph_load(g, path, ec)
+    #define graph_free(g) bsky_graph_free(g)
+
+    /*
+     * BSKY ROARING BITMAP
+     */
+    #define roaring_add(r, v) bsky_roaring_add(r, v)
+    #define roaring_add_many(r, values, n) bsky_roaring_add_many(r, values, n)
+    #define roaring_remove(r, v) bsky_roaring_remove(r, v)
+    #define roaring_has(r, v) bsky_roaring_has(r, v)
+    #define roaring_card(r) bsky_roaring_card(r)
+    #define roaring_and(out, a, b) bsky_roaring_and(out, a, b)
+    #define roaring_or(out, a, b) bsky_roaring_or(out, a, b)
+    #define roaring_andnot(out, a, b) bsky_roaring_andnot(out, a, b)
+    #define roaring_optimize(r) bsky_roaring_optimize(r)
+    #define roaring_ids(r, out) bsky_roaring_ids(r, out)
+    #define roaring_add_actors(r, g, response)                             \
+        bsky_roaring_add_actors(r, g, response)
+    #define roaring_free(r) bsky_roaring_free(r)
+    #define roaring_use(backend) bsky_roaring_use(backend)
+
+    #define roaring_Auto     bsky_roaring_Auto
+    #define roaring_Portable bsky_roaring_Portable
+    #define roaring_Sse2     bsky_roaring_Sse2
+    #define roaring_Avx2     bsky_roaring_Avx2
+
 #endif
 
 #endif //GUARD
@@ -0,0 +1,94 @@
+/*
+ * Generate `firehose.cap': synthetic `subscribeRepos' capture for
+ * `bench/bench-replay'. Content and timestamps are deterministic.
+ */
+#define BSKY_API_IMPLEMENTATION
+#include "stdio.h"
+#include "../bsky-api.h"
+
+#define FRAMES 300
+#define REPOS  64
+
+static uint64_t state = 0x9e3779b97f4a7c15ull;
+
+static uint64_t next(void)
+{
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    return state;
+}
+
+static void push_commit(struct bsky_str_builder *sb, int64_t seq)
+{
+    static const char *paths[] = {
+        "app.bsky.feed.like/3kxyzabcdefgh", "app.bsky.feed.post/3kxyzabcdefgh",
+        "app.bsky.graph.follow/3kxyzabcdefgh", "app.bsky.feed.repost/3kxyzab",
+    };
+    unsigned char cid[36] = { 0x01, 0x71, 0x12, 0x20 }, block[800];
+    size_t len = 100 + next() % 700;
+    int ops = 1 + next() % 2;
+    char repo[64];
+
+    for (size_t i = 0; i < len; ++i) block[i] = next();
+    snprintf(repo, sizeof (repo), "did:plc:%024d", (int) (next() % REPOS));
+
+    bsky_cbor_push_map(sb, 2);
+    bsky_cbor_push_str(sb, bsky_mk_str("t"));
+    bsky_cbor_push_str(sb, bsky_mk_str("#commit"));
+    bsky_cbor_push_str(sb, bsky_mk_str("op"));
+    bsky_cbor_push_int(sb, 1);
+
+    bsky_cbor_push_map(sb, 6);
+    bsky_cbor_push_str(sb, bsky_mk_str("ops"));
+    bsky_cbor_push_arr(sb, ops);
+    for (int i = 0; i < ops; ++i) {
+        cid[4] = next();
+        bsky_cbor_push_map(sb, 3);
+        bsky_cbor_push_str(sb, bsky_mk_str("cid"));
+        bsky_cbor_push_link(sb, (struct bsky_view) { cid, cid + 36 });
+        bsky_cbor_push_str(sb, bsky_mk_str("path"));
+        bsky_cbor_push_str(sb, bsky_mk_str((char*) paths[next() % 4]));
+        bsky_cbor_push_str(sb, bsky_mk_str("action"));
+        bsky_cbor_push_str(sb, bsky_mk_str("create"));
+    }
+    bsky_cbor_push_str(sb, bsky_mk_str("rev"));
+    bsky_cbor_push_str(sb, bsky_mk_str("3kxyzabcdefgh"));
+    bsky_cbor_push_str(sb, bsky_mk_str("seq"));
+    bsky_cbor_push_int(sb, seq);
+    bsky_cbor_push_str(sb, bsky_mk_str("repo"));
+    bsky_cbor_push_str(sb, bsky_mk_str(repo));
+    bsky_cbor_push_str(sb, bsky_mk_str("time"));
+    bsky_cbor_push_str(sb, bsky_mk_str("2024-01-01T00:00:00.000Z"));
+    bsky_cbor_push_str(sb, bsky_mk_str("blocks"));
+    bsky_cbor_push_bytes(sb, (struct bsky_view) { block, block + len });
+}
+
+int main(int argc, char **argv)
+{
+    enum bsky_error_code ec;
+    struct bsky_capture cap = { 0 };
+    struct bsky_str_builder sb = { 0 };
+    uint64_t time_ns = 0;
+
+    if (bsky_capture_open(&cap, argc > 1 ? argv[1] : "firehose.cap", &ec)
+        != bsky_ec_Ok) {
+        return 1;
+    }
+
+    // about 500 events per second with bursts.
+    for (int64_t seq = 1; seq <= FRAMES; ++seq) {
+        sb.len   = 0;
+        time_ns += next() % 8 == 0 ? 10000000 : next() % 1000000;
+
+        push_commit(&sb, seq);
+        bsky_capture_write(&cap, time_ns, bsky_ws_Binary,
+                           (struct bsky_view) { sb.data, sb.data + sb.len });
+    }
+
+    printf("%llu frames, %llu bytes\n", (unsigned long long) cap.frames,
+           (unsigned long long) cap.bytes);
+
+    bsky_da_free(&sb);
+    return bsky_capture_close(&cap) != bsky_ec_Ok;
+}
@@ -0,0 +1,228 @@
+/*
+ * Closed loop HTTP/1.1 load generator for `mock-pds' (or any XRPC server
+ * reachable without TLS).
+ *
+ * Usage:
+ *      ./bench-xrpc [-h host] [-p port] [-c connections] [-d depth]
+ *                   [-t seconds] [-m nsid]
+ *
+ *      -c  number of keep-alive connections.
+ *      -d  number of pipelined requests in flight per connection.
+ *      -m  XRPC method (default `app.bsky.feed.getTimeline').
+ *
+ * Reports requests per second, bytes per second, status codes and
+ * latency percentiles.
+ */
+#define _GNU_SOURCE
+#define BSKY_API_IMPLEMENTATION
+#include "../bsky-api.h"
+
+#include <signal.h>
+#include <strings.h>
+
+struct config {
+    const char *host, *port, *nsid;
+    int conns, depth, seconds;
+} cfg = {
+    .host = "127.0.0.1", .port = "2583", .nsid = "app.bsky.feed.getTimeline",
+    .conns = 16, .depth = 8, .seconds = 5,
+};
+
+struct client {
+    int fd;
+    struct { char *data; size_t len, cap; } in;
+    uint64_t *sent_ns;  // ring of `depth' send timestamps
+    size_t head, inflight;
+};
+
+static struct bsky_loop loop;
+static struct bsky_str  request;
+
+// latency histogram: bucket i holds latencies in [i, i+1) microseconds,
+// the last bucket holds everything above.
+#define HIST_LEN 100000
+static uint64_t hist[HIST_LEN];
+static uint64_t responses, bytes, statuses[600];
+static uint64_t start_ns, end_ns;
+
+static void send_requests(struct client *c, int n)
+{
+    struct bsky_str_builder sb = { 0 };
+    uint64_t now = __bsky_now_ns();
+
+    for (int i = 0; i < n; ++i) {
+        bsky_sb_push_str(&sb, request);
+        c->sent_ns[(c->head + c->inflight++) % cfg.depth] = now;
+    }
+
+    size_t len = bsky_str_len(bsky_sb_build(&sb)), off = 0;
+
+    while (off < len) {
+        ssize_t w = send(c->fd, sb.data + off, len - off, MSG_NOSIGNAL);
+        if (w < 0 && errno == EINTR) continue;
+        if (w <= 0) {
+            perror("bench-xrpc: send");
+            exit(1);
+        }
+        off += w;
+    }
+
+    bsky_da_free(&sb);
+}
+
+static size_t parse_responses(struct client *c)
+{
+    size_t off = 0, done = 0;
+    uint64_t now = __bsky_now_ns();
+
+    for (;;) {
+        char  *start = c->in.data + off;
+        size_t left  = c->in.len - off;
+        char  *end   = memmem(start, left, "\r\n\r\n", 4);
+
+        if (end == NULL) break;
+
+        size_t body = 0;
+        for (char *p = start; p < end; ++p) {
+            if (p[-1] == '\n' && strncasecmp(p, "content-length:", 15) == 0)
+                body = strtoul(p + 15, NULL, 10);
+        }
+
+        size_t len = end + 4 - start + body;
+        if (len > left) break;
+
+        int status = atoi(start + 9);
+        if (status > 0 && status < 600) statuses[status]++;
+
+        uint64_t us = (now - c->sent_ns[c->head]) / 1000;
+        hist[us < HIST_LEN ? us : HIST_LEN - 1]++;
+
+        c->head = (c->head + 1) % cfg.depth;
+        c->inflight--;
+
+        bytes += len;
+        off   += len;
+        done++;
+    }
+
+    memmove(c->in.data, c->in.data + off, c->in.len - off);
+    c->in.len -= off;
+
+    return done;
+}
+
+static void on_client(struct bsky_loop *l, int fd, int events, void *user)
+{
+    struct client *c = user;
+
+    for (;;) {
+        if (c->in.cap - c->in.len < 16384) {
+            c->in.cap  = c->in.cap ? c->in.cap * 2 : 65536;
+            c->in.data = realloc(c->in.data, c->in.cap);
+        }
+
+        ssize_t n = recv(fd, c->in.data + c->in.len,
+                         c->in.cap - c->in.len, 0);
+
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && errno == EAGAIN) break;
+        if (n <= 0) {
+            fprintf(stderr, "bench-xrpc: server closed connection\n");
+            exit(1);
+        }
+        c->in.len += n;
+    }
+
+    size_t done = parse_responses(c);
+    responses += done;
+
+    if (done != 0 && __bsky_now_ns() < end_ns) send_requests(c, done);
+}
+
+static void on_end(struct bsky_loop *l, void *user)
+{
+    bsky_loop_stop(l);
+}
+
+static uint64_t percentile(double p)
+{
+    uint64_t total = 0, acc = 0;
+
+    for (size_t i = 0; i < HIST_LEN; ++i) total += hist[i];
+    for (size_t i = 0; i < HIST_LEN; ++i) {
+        acc += hist[i];
+        if (acc >= total * p) return i;
+    }
+
+    return HIST_LEN;
+}
+
+int main(int argc, char **argv)
+{
+    int opt;
+    enum bsky_error_code ec;
+
+    while ((opt = getopt(argc, argv, "h:p:c:d:t:m:")) != -1) {
+        switch (opt) {
+        case 'h': cfg.host    = optarg; break;
+        case 'p': cfg.port    = optarg; break;
+        case 'c': cfg.conns   = atoi(optarg); break;
+        case 'd': cfg.depth   = atoi(optarg); break;
+        case 't': cfg.seconds = atoi(optarg); break;
+        case 'm': cfg.nsid    = optarg; break;
+        default:
+            fprintf(stderr, "usage: %s [-h host] [-p port] [-c conns] "
+                    "[-d depth] [-t seconds] [-m nsid]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+
+    struct bsky_str_builder sb = { 0 };
+    bsky_sb_push_fmt(&sb, "GET /xrpc/%s HTTP/1.1\r\nHost: %s\r\n\r\n",
+                     cfg.nsid, cfg.host);
+    request = bsky_sb_build(&sb);
+
+    bsky_loop_init(&loop);
+
+    struct client *clients = calloc(cfg.conns, sizeof (struct client));
+
+    for (int i = 0; i < cfg.conns; ++i) {
+        clients[i].fd = bsky_net_connect(cfg.host, cfg.port, &ec);
+        if (ec != bsky_ec_Ok) {
+            bsky_log_error(ec);
+            return 1;
+        }
+
+        clients[i].sent_ns = calloc(cfg.depth, sizeof (uint64_t));
+        bsky_loop_add(&loop, clients[i].fd, bsky_loop_Read,
+                      on_client, &clients[i]);
+    }
+
+    start_ns = __bsky_now_ns();
+    end_ns   = start_ns + cfg.seconds * 1000000000ull;
+
+    for (int i = 0; i < cfg.conns; ++i) send_requests(&clients[i], cfg.depth);
+
+    bsky_loop_timer(&loop, cfg.seconds * 1000, on_end, NULL);
+    bsky_loop_run(&loop);
+
+    double secs = (__bsky_now_ns() - start_ns) / 1e9;
+
+    printf("%s: %llu requests in %.2fs\n", cfg.nsid,
+           (unsigned long long) responses, secs);
+    printf("  requests/s: %.0f\n", responses / secs);
+    printf("  MiB/s:      %.1f\n", bytes / secs / (1 << 20));
+    printf("  latency us: p50=%llu p99=%llu p999=%llu\n",
+           (unsigned long long) percentile(0.5),
+           (unsigned long long) percentile(0.99),
+           (unsigned long long) percentile(0.999));
+
+    for (int i = 0; i < 600; ++i) {
+        if (statuses[i]) printf("  status %d: %llu\n", i,
+                                (unsigned long long) statuses[i]);
+    }
+
+    return 0;
+}
@@ -0,0 +1,592 @@
+/*
+ * Mock XRPC/PDS server for load tests and benchmarks.
+ *
+ * Serves generated responses for common endpoints over HTTP/1.1 with
+ * keep-alive and pipelining:
+ *      app.bsky.feed.getTimeline
+ *      app.bsky.feed.getPosts
+ *      app.bsky.actor.getProfiles
+ *      com.atproto.repo.listRecords
+ *      com.atproto.repo.createRecord
+ *      com.atproto.repo.applyWrites
+ *
+ * Usage:
+ *      ./mock-pds [-p port] [-l latency_ms] [-e error_rate]
+ *                 [-r rate_limit] [-w window_s] [-n items]
+ *
+ *      -e  fraction of requests answered with 500 (0..1).
+ *      -r  requests allowed per window; sends `RateLimit-*' headers and
+ *          429 after limit is exhausted (0 disables rate limit).
+ *      -n  number of posts/profiles/records in generated responses.
+ */
+#define _GNU_SOURCE
+#define BSKY_API_IMPLEMENTATION
+#include "../bsky-api.h"
+
+#include <signal.h>
+#include <strings.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+struct config {
+    int      port, items;
+    uint64_t latency_ms;
+    double   error_rate;
+    size_t   rate_limit;
+    uint64_t window_s;
+} cfg = { .port = 2583, .items = 50, .window_s = 300 };
+
+struct endpoint {
+    const char *nsid;
+    struct bsky_str body;
+} endpoints[] = {
+    { "app.bsky.feed.getTimeline"    },
+    { "app.bsky.feed.getPosts"       },
+    { "app.bsky.actor.getProfiles"   },
+    { "com.atproto.repo.listRecords" },
+    { "com.atproto.repo.createRecord" },
+    { "com.atproto.repo.applyWrites" },
+};
+
+enum { ep_Timeline, ep_Posts, ep_Profiles, ep_List, ep_Create, ep_Apply };
+
+struct pending {
+    uint64_t ready_ns;
+    int      status, close;
+    struct bsky_str body;  // static body or owned by `owned'
+    char    *owned;
+};
+
+struct conn {
+    int fd, open;
+    struct { char *data; size_t len, cap; } in, out;
+    size_t out_off;
+    struct { struct pending *data; size_t len, cap; } pending;
+    size_t pending_head;
+    int    closing, timer;
+};
+
+struct {
+    struct conn *data; size_t len, cap;
+} conns;
+
+struct {
+    size_t   used;
+    uint64_t window_start_ns;
+    time_t   window_start_s;
+    uint64_t requests, errors, limited;
+    uint64_t rkey;
+} stats;
+
+static struct bsky_loop loop;
+
+
+/*
+ * Generated responses
+ */
+static struct bsky_json mk_str_json(char *str)
+{
+    return (struct bsky_json) { .var = bsky_json_Str, .str = str };
+}
+
+static struct bsky_json mk_num_json(long double num)
+{
+    return (struct bsky_json) { .var = bsky_json_Num, .num = num };
+}
+
+static struct bsky_json mk_dct_json(struct bsky_json_pair *pairs, size_t len)
+{
+    struct bsky_json json = { .var = bsky_json_Dct };
+
+    json.dct.data = malloc(sizeof (*pairs) * len);
+    json.dct.len  = len;
+    memcpy(json.dct.data, pairs, sizeof (*pairs) * len);
+
+    return json;
+}
+
+static char *fmt(const char *f, int i)
+{
+    char *str = malloc(128);
+    snprintf(str, 128, f, i);
+    return str;
+}
+
+static struct bsky_json mk_profile(int i)
+{
+    struct bsky_json_pair pairs[] = {
+        { "did",            mk_str_json(fmt("did:plc:mock%06d", i)) },
+        { "handle",         mk_str_json(fmt("user%d.mock.test", i)) },
+        { "displayName",    mk_str_json(fmt("Mock User %d", i)) },
+        { "followersCount", mk_num_json(i * 7) },
+        { "followsCount",   mk_num_json(i * 3) },
+        { "postsCount",     mk_num_json(i * 11) },
+    };
+    return mk_dct_json(pairs, BSKY_ARRAY_LEN(pairs));
+}
+
+static struct bsky_json mk_post(int i)
+{
+    struct bsky_json_pair record[] = {
+        { "$type",     mk_str_json("app.bsky.feed.post") },
+        { "text",      mk_str_json(fmt("mock post number %d", i)) },
+        { "createdAt", mk_str_json("2024-01-01T00:00:00.000Z") },
+    };
+    struct bsky_json_pair pairs[] = {
+        { "uri", mk_str_json(fmt(
+               "at://did:plc:mock%06d/app.bsky.feed.post/3kmock", i)) },
+        { "cid", mk_str_json(
+               "bafyreie5737gdxlw5i64vzichcalba3z2v5n6icifvx5xytvske7mr3hpm") },
+        { "author",      mk_profile(i) },
+        { "record",      mk_dct_json(record, BSKY_ARRAY_LEN(record)) },
+        { "replyCount",  mk_num_json(i % 5) },
+        { "repostCount", mk_num_json(i % 7) },
+        { "likeCount",   mk_num_json(i % 13) },
+        { "indexedAt",   mk_str_json("2024-01-01T00:00:00.000Z") },
+    };
+    return mk_dct_json(pairs, BSKY_ARRAY_LEN(pairs));
+}
+
+static struct bsky_json mk_arr(struct bsky_json (*mk)(int), int n, int wrap)
+{
+    struct bsky_json arr = { .var = bsky_json_Arr };
+
+    arr.arr.data = malloc(sizeof (struct bsky_json) * n);
+    arr.arr.len  = n;
+
+    for (int i = 0; i < n; ++i) {
+        arr.arr.data[i] = mk(i);
+
+        if (wrap) {
+            struct bsky_json_pair pair[] = { { "post", arr.arr.data[i] } };
+            arr.arr.data[i] = mk_dct_json(pair, 1);
+        }
+    }
+
+    return arr;
+}
+
+static struct bsky_json mk_record(int i)
+{
+    struct bsky_json post = mk_post(i);
+    struct bsky_json_pair pairs[] = {
+        { "uri",   post.dct.data[0].value },
+        { "cid",   post.dct.data[1].value },
+        { "value", post.dct.data[3].value },
+    };
+    return mk_dct_json(pairs, BSKY_ARRAY_LEN(pairs));
+}
+
+static struct bsky_str render(struct bsky_json json)
+{
+    struct bsky_str_builder sb = { 0 };
+
+    bsky_sb_push_json(&sb, json);
+    bsky_default_tmp_reset();
+
+    return bsky_sb_build(&sb);
+}
+
+static void generate_responses(void)
+{
+    int n = cfg.items;
+
+    struct bsky_json_pair timeline[] = {
+        { "cursor", mk_str_json("mock-cursor") },
+        { "feed",   mk_arr(mk_post, n, 1) },
+    };
+    struct bsky_json_pair posts[]    = { { "posts",    mk_arr(mk_post, n, 0) } };
+    struct bsky_json_pair profiles[] = { { "profiles", mk_arr(mk_profile, n, 0) } };
+    struct bsky_json_pair records[]  = {
+        { "cursor",  mk_str_json("mock-cursor") },
+        { "records", mk_arr(mk_record, n, 0) },
+    };
+    struct bsky_json_pair apply[] = {
+        { "commit", mk_str_json("mock") },
+    };
+
+    endpoints[ep_Timeline].body = render(mk_dct_json(timeline, 2));
+    endpoints[ep_Posts].body    = render(mk_dct_json(posts, 1));
+    endpoints[ep_Profiles].body = render(mk_dct_json(profiles, 1));
+    endpoints[ep_List].body     = render(mk_dct_json(records, 2));
+    endpoints[ep_Apply].body    = render(mk_dct_json(apply, 1));
+}
+
+
+/*
+ * Connections
+ */
+static void on_conn(struct bsky_loop *, int fd, int events, void *user);
+
+static struct conn *conn_of_fd(int fd)
+{
+    while (conns.len <= (size_t) fd) {
+        struct conn c = { .fd = -1 };
+        bsky_da_push(&conns, c);
+    }
+
+    return &conns.data[fd];
+}
+
+static void conn_close(struct conn *c)
+{
+    bsky_loop_del(&loop, c->fd);
+    close(c->fd);
+
+    for (size_t i = c->pending_head; i < c->pending.len; ++i)
+        free(c->pending.data[i].owned);
+
+    c->open = 0;
+    c->in.len = c->out.len = c->out_off = 0;
+    c->pending.len = c->pending_head = 0;
+}
+
+static void out_push(struct conn *c, const char *data, size_t len)
+{
+    __bsky_da_append(&c->out, data, 1, len);
+}
+
+static void write_response(struct conn *c, struct pending *p)
+{
+    static const char *reasons[] = {
+        [200] = "OK", [400] = "Bad Request", [404] = "Not Found",
+        [429] = "Too Many Requests", [500] = "Internal Server Error",
+    };
+    char head[512];
+    size_t body_len = bsky_str_len(p->body);
+    int len = snprintf(head, sizeof (head),
+                       "HTTP/1.1 %d %s\r\n"
+                       "Content-Type: application/json\r\n"
+                       "Content-Length: %zu\r\n",
+                       p->status, reasons[p->status], body_len);
+
+    if (cfg.rate_limit != 0) {
+        uint64_t reset = stats.window_start_s + cfg.window_s;
+        size_t   left  = stats.used < cfg.rate_limit ?
+                         cfg.rate_limit - stats.used : 0;
+
+        len += snprintf(head + len, sizeof (head) - len,
+                        "RateLimit-Limit: %zu\r\n"
+                        "RateLimit-Remaining: %zu\r\n"
+                        "RateLimit-Reset: %llu\r\n"
+                        "RateLimit-Policy: %zu;w=%llu\r\n",
+                        cfg.rate_limit, left, (unsigned long long) reset,
+                        cfg.rate_limit, (unsigned long long) cfg.window_s);
+    }
+    if (p->close) len += snprintf(head + len, sizeof (head) - len,
+                                  "Connection: close\r\n");
+
+    out_push(c, head, len);
+    out_push(c, "\r\n", 2);
+    out_push(c, p->body.start, body_len);
+}
+
+static void flush_out(struct conn *c)
+{
+    while (c->out_off < c->out.len) {
+        ssize_t n = send(c->fd, c->out.data + c->out_off,
+                         c->out.len - c->out_off, MSG_NOSIGNAL);
+
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && errno == EAGAIN) break;
+        if (n <= 0) {
+            conn_close(c);
+            return;
+        }
+        c->out_off += n;
+    }
+
+    if (c->out_off == c->out.len) {
+        c->out.len = c->out_off = 0;
+
+        if (c->closing && c->pending_head == c->pending.len) {
+            conn_close(c);
+            return;
+        }
+    }
+
+    bsky_loop_mod(&loop, c->fd, bsky_loop_Read |
+                  (c->out.len ? bsky_loop_Write : 0));
+}
+
+static void on_ready(struct bsky_loop *, void *user);
+
+static void drain_pending(struct conn *c)
+{
+    uint64_t now = __bsky_now_ns();
+
+    while (c->pending_head < c->pending.len) {
+        struct pending *p = &c->pending.data[c->pending_head];
+
+        if (p->ready_ns > now) {
+            if (!c->timer) {
+                c->timer = 1;
+                bsky_loop_timer(&loop, (p->ready_ns - now) / 1000000 + 1,
+                                on_ready, (void*) (intptr_t) c->fd);
+            }
+            break;
+        }
+
+        write_response(c, p);
+        if (p->close) c->closing = 1;
+
+        free(p->owned);
+        c->pending_head++;
+    }
+
+    if (c->pending_head == c->pending.len)
+        c->pending.len = c->pending_head = 0;
+
+    flush_out(c);
+}
+
+static void on_ready(struct bsky_loop *l, void *user)
+{
+    struct conn *c = &conns.data[(intptr_t) user];
+
+    c->timer = 0;
+    if (c->open) drain_pending(c);
+}
+
+static int rate_limited(void)
+{
+    if (cfg.rate_limit == 0) return 0;
+
+    uint64_t now = __bsky_now_ns();
+    if (now - stats.window_start_ns >= cfg.window_s * 1000000000ull) {
+        stats.window_start_ns = now;
+        stats.window_start_s  = time(NULL);
+        stats.used = 0;
+    }
+
+    return ++stats.used > cfg.rate_limit;
+}
+
+static struct pending route(struct bsky_str path, struct bsky_str body)
+{
+    struct pending p = { .status = 200 };
+    const char *prefix = "/xrpc/";
+
+    stats.requests++;
+
+    if (rate_limited()) {
+        stats.limited++;
+        p.status = 429;
+        p.body   = bsky_mk_str("{\"error\":\"RateLimitExceeded\","
+                               "\"message\":\"Rate Limit Exceeded\"}");
+        return p;
+    }
+
+    if (cfg.error_rate > 0 && rand() < cfg.error_rate * RAND_MAX) {
+        stats.errors++;
+        p.status = 500;
+        p.body   = bsky_mk_str("{\"error\":\"InternalServerError\","
+                               "\"message\":\"mock failure\"}");
+        return p;
+    }
+
+    if (bsky_str_starts_with(path, bsky_mk_str((char*) prefix))) {
+        struct bsky_str nsid = bsky_shift_str(path, strlen(prefix));
+        char *q = memchr(nsid.start, '?', bsky_str_len(nsid));
+        if (q != NULL) nsid.end = q;
+
+        for (size_t i = 0; i < BSKY_ARRAY_LEN(endpoints); ++i) {
+            size_t len = strlen(endpoints[i].nsid);
+
+            if (bsky_str_len(nsid) != len ||
+                memcmp(nsid.start, endpoints[i].nsid, len) != 0) continue;
+
+            if (i == ep_Create) {
+                p.owned = malloc(256);
+                int n = snprintf(p.owned, 256,
+                        "{\"uri\":\"at://did:plc:mock/app.bsky.feed.post/"
+                        "3kmock%llu\",\"cid\":\"bafyreie5737gdxlw5i64vzichcal"
+                        "ba3z2v5n6icifvx5xytvske7mr3hpm\"}",
+                        (unsigned long long) stats.rkey++);
+                p.body = (struct bsky_str) { p.owned, p.owned + n };
+            }
+            else p.body = endpoints[i].body;
+
+            return p;
+        }
+    }
+
+    p.status = 404;
+    p.body   = bsky_mk_str("{\"error\":\"MethodNotImplemented\"}");
+    return p;
+}
+
+static char *header_find(struct bsky_str head, const char *name)
+{
+    size_t len = strlen(name);
+
+    // request line goes first, header follows a newline.
+    for (char *p = head.start + 1; p + len < head.end; ++p) {
+        if (p[-1] == '\n' && strncasecmp(p, name, len) == 0) return p + len;
+    }
+
+    return NULL;
+}
+
+static size_t header_value(struct bsky_str head, const char *name)
+{
+    char *value = header_find(head, name);
+
+    return value ? strtoul(value, NULL, 10) : 0;
+}
+
+static void handle_requests(struct conn *c)
+{
+    size_t off = 0;
+
+    for (;;) {
+        char *start = c->in.data + off;
+        size_t left = c->in.len - off;
+        char *end   = memmem(start, left, "\r\n\r\n", 4);
+
+        if (end == NULL) break;
+
+        struct bsky_str head = { start, end + 2 };
+        size_t body_len = header_value(head, "content-length:");
+        size_t req_len  = end + 4 - start + body_len;
+
+        if (req_len > left) break;
+
+        char *sp1 = memchr(start, ' ', end - start);
+        char *sp2 = sp1 ? memchr(sp1 + 1, ' ', end - sp1 - 1) : NULL;
+
+        struct pending p = { .status = 400, .close = 1,
+                             .body = bsky_mk_str("{\"error\":\"BadRequest\"}") };
+
+        if (sp2 != NULL) {
+            p = route((struct bsky_str) { sp1 + 1, sp2 },
+                      (struct bsky_str) { end + 4, end + 4 + body_len });
+            p.close = header_find(head, "connection: close") != NULL;
+        }
+
+        p.ready_ns = cfg.latency_ms ?
+                     __bsky_now_ns() + cfg.latency_ms * 1000000ull : 0;
+        bsky_da_push(&c->pending, p);
+
+        off += req_len;
+    }
+
+    memmove(c->in.data, c->in.data + off, c->in.len - off);
+    c->in.len -= off;
+
+    drain_pending(c);
+}
+
+static void on_conn(struct bsky_loop *l, int fd, int events, void *user)
+{
+    struct conn *c = conn_of_fd(fd);
+
+    if (events & bsky_loop_Write) flush_out(c);
+    if (!c->open || !(events & (bsky_loop_Read | bsky_loop_Close))) return;
+
+    for (;;) {
+        if (c->in.cap - c->in.len < 4096) {
+            c->in.cap  = c->in.cap ? c->in.cap * 2 : 16384;
+            c->in.data = realloc(c->in.data, c->in.cap);
+        }
+
+        ssize_t n = recv(fd, c->in.data + c->in.len,
+                         c->in.cap - c->in.len, 0);
+
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && errno == EAGAIN) break;
+        if (n <= 0) {
+            conn_close(c);
+            return;
+        }
+
+        c->in.len += n;
+    }
+
+    handle_requests(c);
+}
+
+static void on_accept(struct bsky_loop *l, int lfd, int events, void *user)
+{
+    for (;;) {
+        int fd = accept4(lfd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) break;
+
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof (one));
+
+        struct conn *c = conn_of_fd(fd);
+        c->fd      = fd;
+        c->open    = 1;
+        c->closing = 0;
+        c->timer   = 0;
+
+        bsky_loop_add(l, fd, bsky_loop_Read, on_conn, NULL);
+    }
+}
+
+static void on_stats(struct bsky_loop *l, void *user)
+{
+    static uint64_t last;
+
+    fprintf(stderr, "rps: %llu (errors: %llu, limited: %llu)\n",
+            (unsigned long long) (stats.requests - last),
+            (unsigned long long) stats.errors,
+            (unsigned long long) stats.limited);
+
+    last = stats.requests;
+    bsky_loop_timer(l, 1000, on_stats, NULL);
+}
+
+int main(int argc, char **argv)
+{
+    int opt;
+
+    while ((opt = getopt(argc, argv, "p:l:e:r:w:n:")) != -1) {
+        switch (opt) {
+        case 'p': cfg.port       = atoi(optarg); break;
+        case 'l': cfg.latency_ms = strtoull(optarg, NULL, 10); break;
+        case 'e': cfg.error_rate = atof(optarg); break;
+        case 'r': cfg.rate_limit = strtoull(optarg, NULL, 10); break;
+        case 'w': cfg.window_s   = strtoull(optarg, NULL, 10); break;
+        case 'n': cfg.items      = atoi(optarg); break;
+        default:
+            fprintf(stderr, "usage: %s [-p port] [-l latency_ms] "
+                    "[-e error_rate] [-r rate_limit] [-w window_s] "
+                    "[-n items]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+    generate_responses();
+    stats.window_start_ns = __bsky_now_ns();
+    stats.window_start_s  = time(NULL);
+
+    int lfd = socket(AF_INET, SOCK_STREAM, 0), one = 1;
+    struct sockaddr_in addr = {
+        .sin_family      = AF_INET,
+        .sin_port        = htons(cfg.port),
+        .sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+    };
+
+    setsockopt(lfd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof (one));
+    if (bind(lfd, (struct sockaddr*) &addr, sizeof (addr)) != 0 ||
+        listen(lfd, 1024) != 0) {
+        perror("mock-pds");
+        return 1;
+    }
+
+    bsky_loop_init(&loop);
+    bsky_loop_add(&loop, lfd, bsky_loop_Read, on_accept, NULL);
+    bsky_loop_timer(&loop, 1000, on_stats, NULL);
+
+    bsky_log(bsky_log_Info, "mock pds listening on 127.0.0.1:%d", cfg.port);
+
+    bsky_loop_run(&loop);
+    bsky_loop_free(&loop);
+
+    return 0;
+}
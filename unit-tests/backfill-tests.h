@@ -0,0 +1,328 @@
+#ifndef backfill_tests_h_INCLUDED
+#define backfill_tests_h_INCLUDED
+
+
+void run_backfill_tests(void);
+
+
+#ifdef IMPLEMENT_TESTS
+
+    #include "../bsky-api.h"
+    #include <unistd.h>
+
+    static char __backfill_path[] = "/tmp/bsky-backfill-test";
+
+    /*
+     * Repo (nodes are from mst tests):
+     *
+     *                  root [b/5]
+     *                 /          \
+     *       [a/1, a/2]            [c/1]
+     *
+     * a/1 and c/1 have the same record.
+     */
+    struct __backfill_repo {
+        struct __mst_store store;
+        struct bsky_view   commit;
+        struct bsky_str_builder in_order, shuffled, preorder;
+
+        _Atomic int calls, inflight, max_inflight;
+        _Atomic int records, empty;
+        int fail[4]; // fetch results before success, 0 is the end
+    };
+
+    static struct bsky_view __backfill_record(struct __mst_store *store,
+                                              const char *text)
+    {
+        struct bsky_str_builder sb = { 0 };
+
+        bsky_cbor_push_map(&sb, 1);
+        bsky_cbor_push_str(&sb, bsky_mk_str("text"));
+        bsky_cbor_push_str(&sb, bsky_mk_str((char*) text));
+
+        return __mst_cid(store, sb);
+    }
+
+    static void __backfill_push(struct bsky_str_builder *car,
+                                struct __mst_store *store, size_t i)
+    {
+        bsky_car_push_block(car, (struct bsky_view) {
+            store->cid[i], store->cid[i] + 36
+        }, (struct bsky_view) {
+            store->block[i].data, store->block[i].data + store->block[i].len
+        });
+    }
+
+    static void __backfill_build(struct __backfill_repo *repo)
+    {
+        struct __mst_store *store = &repo->store;
+        struct bsky_str_builder sb = { 0 };
+        struct bsky_view none = { 0 };
+
+        struct bsky_view r0 = __backfill_record(store, "one");    // 0
+        struct bsky_view r1 = __backfill_record(store, "two");    // 1
+        struct bsky_view r2 = __backfill_record(store, "three");  // 2
+
+        struct bsky_view left = __mst_node(store, none,           // 3
+            (const char*[]) { "a/1", "a/2" },
+            (struct bsky_view[]) { r0, r1 }, NULL, 2);
+        struct bsky_view right = __mst_node(store, none,          // 4
+            (const char*[]) { "c/1" },
+            (struct bsky_view[]) { r0 }, NULL, 1);
+        struct bsky_view root = __mst_node(store, left,           // 5
+            (const char*[]) { "b/5" },
+            (struct bsky_view[]) { r2 }, (struct bsky_view[]) { right }, 1);
+
+        bsky_cbor_push_map(&sb, 5);
+        bsky_cbor_push_str(&sb, bsky_mk_str("did"));
+        bsky_cbor_push_str(&sb, bsky_mk_str("did:plc:alice"));
+        bsky_cbor_push_str(&sb, bsky_mk_str("rev"));
+        bsky_cbor_push_str(&sb, bsky_mk_str("3kabc"));
+        bsky_cbor_push_str(&sb, bsky_mk_str("data"));
+        bsky_cbor_push_link(&sb, root);
+        bsky_cbor_push_str(&sb, bsky_mk_str("prev"));
+        bsky_cbor_push_null(&sb);
+        bsky_cbor_push_str(&sb, bsky_mk_str("version"));
+        bsky_cbor_push_int(&sb, 3);
+        repo->commit = __mst_cid(store, sb);                      // 6
+
+        bsky_car_push_header(&repo->in_order, &repo->commit, 1);
+        for (size_t i = 7; i-- > 0; )
+            __backfill_push(&repo->in_order, store, i);
+
+        // every block comes before its parent.
+        bsky_car_push_header(&repo->shuffled, &repo->commit, 1);
+        for (size_t i = 0; i < 7; ++i)
+            __backfill_push(&repo->shuffled, store, i);
+
+        // depth first, c/1 is reached after its record.
+        bsky_car_push_header(&repo->preorder, &repo->commit, 1);
+        for (size_t i = 0; i < 7; ++i)
+            __backfill_push(&repo->preorder, store, "6530124"[i] - '0');
+    }
+
+    static int __backfill_fetch(void *user, struct bsky_str did,
+                                struct bsky_str host,
+                                struct bsky_str_builder *prefix)
+    {
+        struct __backfill_repo *repo = user;
+        struct bsky_str_builder *cars[] = {
+            &repo->in_order, &repo->shuffled, &repo->preorder,
+        };
+        struct bsky_str_builder *car = cars[bsky_str_len(did) % 3];
+        int fds[2], call = atomic_fetch_add(&repo->calls, 1);
+        int inflight = atomic_fetch_add(&repo->inflight, 1) + 1;
+        int max = atomic_load(&repo->max_inflight);
+
+        (void) host;
+
+        while (inflight > max &&
+               !atomic_compare_exchange_weak(&repo->max_inflight, &max,
+                                             inflight)) {
+        }
+        usleep(2000);
+        atomic_fetch_sub(&repo->inflight, 1);
+
+        if (call < 4 && repo->fail[call]) return repo->fail[call];
+
+        // the first bytes came with response headers.
+        __bsky_da_append(prefix, car->data, 1, 10);
+
+        TEST_ASSERT(pipe(fds) == 0);
+        TEST_ASSERT_EQUAL(car->len - 10, write(fds[1], car->data + 10,
+                                               car->len - 10));
+        close(fds[1]);
+
+        return fds[0];
+    }
+
+    static void __backfill_on_record(void *user, struct bsky_str did,
+                                     struct bsky_str key, struct bsky_view cid,
+                                     struct bsky_view record)
+    {
+        struct __backfill_repo *repo = user;
+        struct bsky_view expected = { 0 };
+
+        (void) did;
+
+        if (bsky_json_key_is(key, "a/1") || bsky_json_key_is(key, "c/1")) {
+            expected = (struct bsky_view) {
+                repo->store.cid[0], repo->store.cid[0] + 36 };
+        } else if (bsky_json_key_is(key, "a/2")) {
+            expected = (struct bsky_view) {
+                repo->store.cid[1], repo->store.cid[1] + 36 };
+        } else if (bsky_json_key_is(key, "b/5")) {
+            expected = (struct bsky_view) {
+                repo->store.cid[2], repo->store.cid[2] + 36 };
+        }
+
+        TEST_ASSERT(expected.start != NULL);
+        TEST_ASSERT(memcmp(cid.start, expected.start, 36) == 0);
+        if (record.start == record.end) {
+            TEST_ASSERT(bsky_json_key_is(key, "c/1"));
+            atomic_fetch_add(&repo->empty, 1);
+        }
+        atomic_fetch_add(&repo->records, 1);
+    }
+
+    static void __backfill_free(struct __backfill_repo *repo)
+    {
+        __mst_free(&repo->store);
+        bsky_da_free(&repo->in_order);
+        bsky_da_free(&repo->shuffled);
+        bsky_da_free(&repo->preorder);
+    }
+
+    static void backfill_walk(void)
+    {
+        struct __backfill_repo repo = { 0 };
+        struct bsky_backfill bf = {
+            .fetch = __backfill_fetch, .on_record = __backfill_on_record,
+            .user  = &repo, .concurrency = 4,
+        };
+
+        __backfill_build(&repo);
+
+        TEST_ASSERT_EQUAL(bsky_ec_Ok, bsky_backfill_start(&bf, NULL));
+        bsky_backfill_add(&bf, bsky_mk_str("did:plc:ab"),
+                          bsky_mk_str("pds.example"));
+        bsky_backfill_add(&bf, bsky_mk_str("did:plc:abc"),
+                          bsky_mk_str("pds.example"));
+        bsky_backfill_add(&bf, bsky_mk_str("did:plc:abcd"),
+                          bsky_mk_str("pds.example"));
+        bsky_backfill_wait(&bf);
+
+        TEST_ASSERT_EQUAL(3, bf.repos);
+        TEST_ASSERT_EQUAL(0, bf.failed);
+        TEST_ASSERT_EQUAL(12, bf.records);
+        TEST_ASSERT_EQUAL(12, repo.records);
+        TEST_ASSERT_EQUAL(1, repo.empty);
+
+        bsky_backfill_stop(&bf);
+        __backfill_free(&repo);
+    }
+
+    static void backfill_retry(void)
+    {
+        struct __backfill_repo repo = { .fail = { -429, -1, -503 } };
+        struct bsky_backfill bf = {
+            .fetch = __backfill_fetch, .user = &repo,
+            .concurrency = 2, .retries = 2,
+        };
+
+        __backfill_build(&repo);
+
+        TEST_ASSERT_EQUAL(bsky_ec_Ok, bsky_backfill_start(&bf, NULL));
+        bsky_backfill_add(&bf, bsky_mk_str("did:plc:aa"),
+                          bsky_mk_str("pds.example"));
+        bsky_backfill_wait(&bf);
+
+        // 429 is not counted as attempt.
+        TEST_ASSERT_EQUAL(4, repo.calls);
+        TEST_ASSERT_EQUAL(1, bf.rate_limited);
+        TEST_ASSERT_EQUAL(1, bf.repos);
+        TEST_ASSERT_EQUAL(4, bf.records);
+
+        // out of retries.
+        repo.calls   = 0;
+        repo.fail[0] = repo.fail[1] = repo.fail[2] = -1;
+        bsky_backfill_add(&bf, bsky_mk_str("did:plc:bb"),
+                          bsky_mk_str("pds.example"));
+        bsky_backfill_wait(&bf);
+
+        TEST_ASSERT_EQUAL(3, repo.calls);
+        TEST_ASSERT_EQUAL(1, bf.failed);
+        TEST_ASSERT(!bsky_backfill_done(&bf, bsky_mk_str("did:plc:bb")));
+
+        bsky_backfill_stop(&bf);
+        __backfill_free(&repo);
+    }
+
+    static void backfill_progress(void)
+    {
+        enum bsky_error_code ec;
+        struct __backfill_repo repo = { 0 };
+        struct bsky_backfill bf = {
+            .fetch = __backfill_fetch, .user = &repo,
+            .concurrency = 4, .per_host = 1, .rate = 1000,
+        };
+        char list[] = "{\"cursor\":\"next\",\"repos\":["
+                      "{\"did\":\"did:plc:a\",\"head\":\"x\",\"active\":true},"
+                      "{\"did\":\"did:plc:b\",\"active\":false},"
+                      "{\"did\":\"did:plc:c\"},"
+                      "{\"did\":\"did:plc:d\",\"status\":\"takendown\"}]}";
+        struct bsky_str cursor;
+
+        __backfill_build(&repo);
+        unlink(__backfill_path);
+
+        TEST_ASSERT_EQUAL(bsky_ec_Ok,
+                          bsky_backfill_start(&bf, __backfill_path));
+        cursor = bsky_backfill_add_list(&bf, bsky_mk_str("pds.example"),
+                                        bsky_mk_str(list), &ec);
+        TEST_ASSERT_EQUAL(bsky_ec_Ok, ec);
+        TEST_ASSERT(bsky_json_key_is(cursor, "next"));
+        bsky_backfill_wait(&bf);
+
+        TEST_ASSERT_EQUAL(3, bf.repos);
+        TEST_ASSERT_EQUAL(1, repo.max_inflight);
+        bsky_backfill_stop(&bf);
+
+        // torn line of crash is dropped.
+        int fd = open(__backfill_path, O_WRONLY | O_APPEND);
+        TEST_ASSERT_EQUAL(5, write(fd, "did:p", 5));
+        close(fd);
+
+        repo.calls = 0;
+        bf = (struct bsky_backfill) {
+            .fetch = __backfill_fetch, .user = &repo, .concurrency = 2,
+        };
+        TEST_ASSERT_EQUAL(bsky_ec_Ok,
+                          bsky_backfill_start(&bf, __backfill_path));
+        TEST_ASSERT(bsky_backfill_done(&bf, bsky_mk_str("did:plc:c")));
+        TEST_ASSERT(!bsky_backfill_done(&bf, bsky_mk_str("did:p")));
+
+        bsky_backfill_add_list(&bf, bsky_mk_str("pds.example"),
+                               bsky_mk_str(list), &ec);
+        bsky_backfill_add(&bf, bsky_mk_str("did:plc:b"),
+                          bsky_mk_str("pds.example"));
+        bsky_backfill_wait(&bf);
+
+        TEST_ASSERT_EQUAL(3, bf.skipped);
+        TEST_ASSERT_EQUAL(1, repo.calls);
+        TEST_ASSERT_EQUAL(1, bf.repos);
+
+        bsky_backfill_stop(&bf);
+
+        // the only line is torn.
+        fd = open(__backfill_path, O_WRONLY | O_TRUNC);
+        TEST_ASSERT_EQUAL(5, write(fd, "did:p", 5));
+        close(fd);
+
+        bf = (struct bsky_backfill) {
+            .fetch = __backfill_fetch, .user = &repo, .concurrency = 2,
+        };
+        TEST_ASSERT_EQUAL(bsky_ec_Ok,
+                          bsky_backfill_start(&bf, __backfill_path));
+        TEST_ASSERT(!bsky_backfill_done(&bf, bsky_mk_str("did:p")));
+        bsky_backfill_stop(&bf);
+
+        fd = open(__backfill_path, O_RDONLY);
+        TEST_ASSERT_EQUAL(0, lseek(fd, 0, SEEK_END));
+        close(fd);
+
+        unlink(__backfill_path);
+        __backfill_free(&repo);
+    }
+
+    void run_backfill_tests(void)
+    {
+        RUN_TEST(backfill_walk);
+        RUN_TEST(backfill_retry);
+        RUN_TEST(backfill_progress);
+    }
+
+#endif
+
+
+#endif // backfill-tests_h_INCLUDED
@@ -0,0 +1,147 @@
+#ifndef blob_tests_h_INCLUDED
+#define blob_tests_h_INCLUDED
+
+
+void run_blob_tests(void);
+
+
+#ifdef IMPLEMENT_TESTS
+
+    #include "../bsky-api.h"
+    #include <fcntl.h>
+    #include <unistd.h>
+    #include <sys/socket.h>
+
+    static const char *__blob_hex(const unsigned char digest[32])
+    {
+        static char hex[65];
+
+        for (int i = 0; i < 32; ++i) sprintf(hex + i * 2, "%02x", digest[i]);
+
+        return hex;
+    }
+
+    static void blob_sha256(void)
+    {
+        unsigned char digest[32];
+        char data[1000];
+
+        bsky_sha256("", 0, digest);
+        TEST_ASSERT_EQUAL_STRING(
+            "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855",
+            __blob_hex(digest));
+
+        bsky_sha256("abc", 3, digest);
+        TEST_ASSERT_EQUAL_STRING(
+            "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad",
+            __blob_hex(digest));
+
+        // incremental update across block boundaries.
+        struct bsky_sha256 sha;
+        memset(data, 'a', sizeof (data));
+
+        bsky_sha256_init(&sha);
+        for (size_t i = 0; i < sizeof (data); i += 7) {
+            bsky_sha256_update(&sha, data + i,
+                               sizeof (data) - i < 7 ? sizeof (data) - i : 7);
+        }
+        bsky_sha256_final(&sha, digest);
+        TEST_ASSERT_EQUAL_STRING(
+            "41edece42d63e8d9bf515a9ba6932e1c20cbc9f5a5d134645adb5db1b9737ea3",
+            __blob_hex(digest));
+    }
+
+    static void blob_upload_mem(void)
+    {
+        int fds[2];
+        char buf[1024] = { 0 };
+        char blob[]    = "hello world";
+
+        TEST_ASSERT(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+
+        struct bsky_blob_upload up = {
+            .fd    = fds[0],
+            .host  = bsky_mk_str("localhost"),
+            .token = bsky_mk_str("jwt"),
+            .mime  = bsky_mk_str("text/plain"),
+        };
+
+        TEST_ASSERT_EQUAL(bsky_ec_Ok, bsky_blob_upload_mem(&up,
+                    (struct bsky_view) { blob, blob + sizeof (blob) - 1 }));
+        TEST_ASSERT_EQUAL(sizeof (blob) - 1, up.sent);
+
+        read(fds[1], buf, sizeof (buf) - 1);
+        TEST_ASSERT(strstr(buf, "Content-Length: 11\r\n") != NULL);
+        TEST_ASSERT(strstr(buf, "Authorization: Bearer jwt\r\n") != NULL);
+        TEST_ASSERT_EQUAL_STRING("\r\n\r\nhello world",
+                                 buf + strlen(buf) - strlen(blob) - 4);
+
+        TEST_ASSERT_EQUAL_STRING(
+            "bafkreifzjut3te2nhyekklss27nh3k72ysco7y32koao5eei66wof36n5e",
+            bsky_tmp_blob_cid(up.sha256).start);
+
+        close(fds[0]);
+        close(fds[1]);
+    }
+
+    static void *__blob_drain(void *arg)
+    {
+        int    fd = *(int*) arg;
+        char   buf[0x4000];
+        size_t total = 0;
+        ssize_t n;
+
+        // writer finds socket buffer full.
+        usleep(100 * 1000);
+        while ((n = read(fd, buf, sizeof (buf))) > 0) total += n;
+
+        return (void*) total;
+    }
+
+    static void blob_upload_file_nonblock(void)
+    {
+        int fds[2], fd;
+        pthread_t reader;
+        void *received;
+        static char blob[0x100000];
+
+        // socket buffer is much smaller than blob, send fills it.
+        TEST_ASSERT(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+        fcntl(fds[0], F_SETFL, fcntl(fds[0], F_GETFL) | O_NONBLOCK);
+
+        memset(blob, 'x', sizeof (blob));
+        fd = open("/tmp/bsky-blob-test", O_RDWR | O_CREAT | O_TRUNC, 0644);
+        TEST_ASSERT(fd >= 0);
+        TEST_ASSERT_EQUAL(sizeof (blob), write(fd, blob, sizeof (blob)));
+
+        struct bsky_blob_upload up = {
+            .fd    = fds[0],
+            .host  = bsky_mk_str("localhost"),
+            .token = bsky_mk_str("jwt"),
+            .mime  = bsky_mk_str("text/plain"),
+        };
+
+        TEST_ASSERT(pthread_create(&reader, NULL, __blob_drain, &fds[1]) == 0);
+        TEST_ASSERT_EQUAL(bsky_ec_Ok, bsky_blob_upload_file(&up, fd));
+        TEST_ASSERT_EQUAL(sizeof (blob), up.sent);
+
+        close(fds[0]);
+        pthread_join(reader, &received);
+        TEST_ASSERT((size_t) received > sizeof (blob));
+
+        close(fds[1]);
+        close(fd);
+        unlink("/tmp/bsky-blob-test");
+    }
+
+    void run_blob_tests(void)
+    {
+        RUN_TEST(blob_sha256);
+        RUN_TEST(blob_upload_mem);
+        RUN_TEST(blob_upload_file_nonblock);
+    }
+
+#endif
+
+
+#endif // blob-tests_h_INCLUDED
@@ -0,0 +1,143 @@
+#ifndef capture_tests_h_INCLUDED
+#define capture_tests_h_INCLUDED
+
+
+void run_capture_tests(void);
+
+
+#ifdef IMPLEMENT_TESTS
+
+    #include "../bsky-api.h"
+    #include <unistd.h>
+
+    static size_t __capture_lens[4];
+    static int    __capture_opcodes[4];
+    static size_t __capture_len;
+
+    static void __capture_on_message(void *user, enum bsky_ws_opcode opcode,
+                                     struct bsky_view message)
+    {
+        const char *data = message.start;
+        size_t len = (char*) message.end - data;
+
+        (void) user;
+        for (size_t i = 0; i < len; ++i)
+            TEST_ASSERT_EQUAL('a' + __capture_len, data[i]);
+
+        __capture_opcodes[__capture_len] = opcode;
+        __capture_lens[__capture_len++]  = len;
+    }
+
+    static void capture_roundtrip(void)
+    {
+        enum bsky_error_code ec;
+        char path[] = "/tmp/bsky-capture-XXXXXX";
+        size_t lens[4] = { 5, 300, 0x10000, 2 * BSKY_CAPTURE_BUFFER };
+        struct bsky_capture cap = { .on_message = __capture_on_message };
+        struct bsky_replay  replay;
+        struct bsky_replay_stats stats;
+        struct bsky_ws ws = { .fd = -1, .on_message = __capture_on_message };
+        struct bsky_view frame;
+        uint64_t time_ns;
+        char *data = malloc(lens[3]);
+
+        close(mkstemp(path));
+        TEST_ASSERT_EQUAL(bsky_ec_Ok, bsky_capture_open(&cap, path, &ec));
+
+        // on_message forwards, write only records.
+        __capture_len = 0;
+        memset(data, 'a', lens[0]);
+        bsky_capture_on_ws_message(&cap, bsky_ws_Binary,
+                                   (struct bsky_view) { data, data + lens[0] });
+        TEST_ASSERT_EQUAL(1, __capture_len);
+
+        for (int i = 1; i < 4; ++i) {
+            memset(data, 'a' + i, lens[i]);
+            TEST_ASSERT_EQUAL(bsky_ec_Ok, bsky_capture_write(&cap, i * 1000,
+                i == 1 ? bsky_ws_Text : bsky_ws_Binary,
+                (struct bsky_view) { data, data + lens[i] }));
+        }
+        TEST_ASSERT_EQUAL(4, cap.frames);
+        TEST_ASSERT_EQUAL(bsky_ec_Ok, bsky_capture_close(&cap));
+
+        TEST_ASSERT_EQUAL(bsky_ec_Ok, bsky_replay_open(&replay, path, &ec));
+        TEST_ASSERT(bsky_replay_next(&replay, &frame, &time_ns, &ec));
+        TEST_ASSERT_EQUAL(2 + 5, (char*) frame.end - (char*) frame.start);
+        TEST_ASSERT(bsky_replay_next(&replay, &frame, &time_ns, &ec));
+        TEST_ASSERT_EQUAL(1000, time_ns);
+
+        bsky_replay_rewind(&replay);
+        __capture_len = 0;
+        TEST_ASSERT_EQUAL(bsky_ec_Ok, bsky_replay_run(&replay, &ws, 0,
+                                                      &stats));
+        TEST_ASSERT_EQUAL(4, __capture_len);
+        TEST_ASSERT_EQUAL(4, stats.frames);
+        TEST_ASSERT_EQUAL(cap.bytes, stats.bytes);
+        for (int i = 0; i < 4; ++i)
+            TEST_ASSERT_EQUAL(lens[i], __capture_lens[i]);
+        TEST_ASSERT_EQUAL(bsky_ws_Text, __capture_opcodes[1]);
+        TEST_ASSERT(!bsky_replay_next(&replay, &frame, &time_ns, &ec));
+        TEST_ASSERT_EQUAL(bsky_ec_Ok, ec);
+
+        // truncated record.
+        replay.data.end = (char*) replay.data.end - 1;
+        bsky_replay_rewind(&replay);
+        for (int i = 0; i < 3; ++i)
+            TEST_ASSERT(bsky_replay_next(&replay, &frame, &time_ns, &ec));
+        TEST_ASSERT(!bsky_replay_next(&replay, &frame, &time_ns, &ec));
+        TEST_ASSERT_EQUAL(bsky_ec_Capture_invalid, ec);
+        replay.data.end = (char*) replay.data.end + 1;
+
+        bsky_replay_free(&replay);
+        bsky_ws_free(&ws);
+        unlink(path);
+        free(data);
+    }
+
+    static void capture_paced(void)
+    {
+        enum bsky_error_code ec;
+        char path[] = "/tmp/bsky-capture-XXXXXX";
+        struct bsky_capture cap = { 0 };
+        struct bsky_replay  replay;
+        struct bsky_replay_stats stats;
+        struct bsky_ws ws = { .fd = -1, .on_message = __capture_on_message };
+
+        close(mkstemp(path));
+        TEST_ASSERT_EQUAL(bsky_ec_Ok, bsky_capture_open(&cap, path, &ec));
+        for (int i = 0; i < 3; ++i) {
+            bsky_capture_write(&cap, 5000000000ull + i * 10000000ull,
+                               bsky_ws_Binary, (struct bsky_view) {
+                               "a" + i, "a" + i });
+        }
+        bsky_capture_close(&cap);
+
+        TEST_ASSERT_EQUAL(bsky_ec_Ok, bsky_replay_open(&replay, path, &ec));
+        __capture_len = 0;
+        TEST_ASSERT_EQUAL(bsky_ec_Ok, bsky_replay_run(&replay, &ws, 1,
+                                                      &stats));
+        TEST_ASSERT_EQUAL(3, __capture_len);
+        TEST_ASSERT(stats.elapsed_ns >= 20000000ull);
+
+        bsky_replay_free(&replay);
+        bsky_ws_free(&ws);
+
+        // not a capture.
+        FILE *file = fopen(path, "w");
+        fputs("BSKYCAR1 not a capture", file);
+        fclose(file);
+        TEST_ASSERT_EQUAL(bsky_ec_Capture_invalid,
+                          bsky_replay_open(&replay, path, &ec));
+        unlink(path);
+    }
+
+    void run_capture_tests(void)
+    {
+        RUN_TEST(capture_roundtrip);
+        RUN_TEST(capture_paced);
+    }
+
+#endif
+
+
+#endif // capture-tests_h_INCLUDED
@@ -0,0 +1,185 @@
+#ifndef car_tests_h_INCLUDED
+#define car_tests_h_INCLUDED
+
+
+void run_car_tests(void);
+
+
+#ifdef IMPLEMENT_TESTS
+
+    #include "../bsky-api.h"
+    #include <unistd.h>
+
+    // CAR with 3 records {"n": i}, the first one is root.
+    static void __car_build(struct bsky_str_builder *car,
+                            unsigned char cids[3][36])
+    {
+        struct bsky_str_builder blocks = { 0 };
+
+        for (int i = 0; i < 3; ++i) {
+            struct bsky_str_builder record = { 0 };
+            unsigned char digest[32];
+
+            bsky_cbor_push_map(&record, 1);
+            bsky_cbor_push_str(&record, bsky_mk_str("n"));
+            bsky_cbor_push_int(&record, i);
+
+            bsky_sha256(record.data, record.len, digest);
+            memcpy(cids[i], "\x01\x71\x12\x20", 4);
+            memcpy(cids[i] + 4, digest, 32);
+
+            bsky_car_push_block(&blocks,
+                (struct bsky_view) { cids[i], cids[i] + 36 },
+                (struct bsky_view) { record.data, record.data + record.len });
+            bsky_da_free(&record);
+        }
+
+        struct bsky_view root = { cids[0], cids[0] + 36 };
+        bsky_car_push_header(car, &root, 1);
+        __bsky_da_append(car, blocks.data, 1, blocks.len);
+        bsky_da_free(&blocks);
+    }
+
+    static void car_read_mem(void)
+    {
+        enum bsky_error_code ec;
+        struct bsky_str_builder data = { 0 };
+        struct bsky_car_reader  car;
+        struct bsky_car_block   block;
+        unsigned char cids[3][36];
+        int n = 0;
+
+        __car_build(&data, cids);
+
+        TEST_ASSERT_EQUAL(bsky_ec_Ok, bsky_car_open_mem(&car,
+                          (struct bsky_view) { data.data, data.data + data.len },
+                          &ec));
+        TEST_ASSERT_EQUAL(1, car.roots.len);
+        TEST_ASSERT(memcmp(car.roots.data[0].start, cids[0], 36) == 0);
+
+        while (bsky_car_next(&car, &block, &ec)) {
+            struct bsky_view view = block.data;
+            struct bsky_cbor rec  = bsky_parse_cbor(&view, &ec);
+
+            TEST_ASSERT(memcmp(block.cid.start, cids[n], 36) == 0);
+            TEST_ASSERT_EQUAL(n, bsky_cbor_get(&rec, "n")->i);
+            n++;
+        }
+        TEST_ASSERT_EQUAL(bsky_ec_Ok, ec);
+        TEST_ASSERT_EQUAL(3, n);
+
+        // random access does not move sequential position.
+        TEST_ASSERT_EQUAL(bsky_ec_Ok, bsky_car_build_index(&car));
+        TEST_ASSERT(bsky_car_find(&car,
+                    (struct bsky_view) { cids[1], cids[1] + 36 }, &block));
+        TEST_ASSERT(memcmp(block.data.start, "\xa1\x61n\x01", 4) == 0);
+
+        cids[2][35] ^= 1;
+        TEST_ASSERT(!bsky_car_find(&car,
+                    (struct bsky_view) { cids[2], cids[2] + 36 }, &block));
+        TEST_ASSERT(!bsky_car_next(&car, &block, &ec));
+
+        bsky_car_free(&car);
+
+        // cut in the middle of the last block.
+        TEST_ASSERT_EQUAL(bsky_ec_Ok, bsky_car_open_mem(&car,
+                          (struct bsky_view) { data.data,
+                                               data.data + data.len - 2 },
+                          &ec));
+        while (bsky_car_next(&car, &block, &ec));
+        TEST_ASSERT_EQUAL(bsky_ec_Car_truncated, ec);
+
+        bsky_car_free(&car);
+        bsky_da_free(&data);
+    }
+
+    static void car_read_stream(void)
+    {
+        enum bsky_error_code ec;
+        struct bsky_str_builder data = { 0 };
+        struct bsky_car_reader  car;
+        struct bsky_car_block   block;
+        unsigned char cids[3][36];
+        int fds[2], n = 0;
+
+        __car_build(&data, cids);
+        TEST_ASSERT(pipe(fds) == 0);
+
+        // part of body is already read together with response headers.
+        TEST_ASSERT_EQUAL(data.len - 5, write(fds[1], data.data + 5,
+                                              data.len - 5));
+        close(fds[1]);
+
+        TEST_ASSERT_EQUAL(bsky_ec_Ok, bsky_car_open_stream(&car, fds[0],
+                          (struct bsky_view) { data.data, data.data + 5 },
+                          &ec));
+
+        while (bsky_car_next(&car, &block, &ec)) {
+            TEST_ASSERT(memcmp(block.cid.start, cids[n++], 36) == 0);
+        }
+        TEST_ASSERT_EQUAL(bsky_ec_Ok, ec);
+        TEST_ASSERT_EQUAL(3, n);
+
+        bsky_car_free(&car);
+        bsky_da_free(&data);
+        close(fds[0]);
+    }
+
+    static void car_max_block(void)
+    {
+        enum bsky_error_code ec;
+        struct bsky_str_builder data = { 0 };
+        struct bsky_car_reader  car;
+        struct bsky_car_block   block;
+        unsigned char cids[3][36];
+        unsigned char huge[] = { 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+                                 0x80, 0x40 }; // 2^62
+        int fds[2];
+
+        // header frame of hostile stream, nothing else is sent.
+        TEST_ASSERT(pipe(fds) == 0);
+        close(fds[1]);
+        TEST_ASSERT_EQUAL(bsky_ec_Car_invalid, bsky_car_open_stream(&car,
+                          fds[0], (struct bsky_view) { huge, huge + 9 },
+                          &ec));
+        TEST_ASSERT(car.buf.cap <= BSKY_CAR_READ_CHUNK);
+        bsky_car_free(&car);
+        close(fds[0]);
+
+        // block frame after valid header.
+        __car_build(&data, cids);
+        data.len = 1 + data.data[0];
+        __bsky_da_append(&data, huge, 1, 9);
+
+        TEST_ASSERT(pipe(fds) == 0);
+        close(fds[1]);
+        TEST_ASSERT_EQUAL(bsky_ec_Ok, bsky_car_open_stream(&car, fds[0],
+                          (struct bsky_view) { data.data, data.data + data.len },
+                          &ec));
+        TEST_ASSERT(!bsky_car_next(&car, &block, &ec));
+        TEST_ASSERT_EQUAL(bsky_ec_Car_invalid, ec);
+        TEST_ASSERT(car.buf.cap <= BSKY_CAR_READ_CHUNK);
+        bsky_car_free(&car);
+        close(fds[0]);
+
+        TEST_ASSERT_EQUAL(bsky_ec_Ok, bsky_car_open_mem(&car,
+                          (struct bsky_view) { data.data, data.data + data.len },
+                          &ec));
+        TEST_ASSERT(!bsky_car_next(&car, &block, &ec));
+        TEST_ASSERT_EQUAL(bsky_ec_Car_invalid, ec);
+        bsky_car_free(&car);
+
+        bsky_da_free(&data);
+    }
+
+    void run_car_tests(void)
+    {
+        RUN_TEST(car_read_mem);
+        RUN_TEST(car_read_stream);
+        RUN_TEST(car_max_block);
+    }
+
+#endif
+
+
+#endif // car-tests_h_INCLUDED
@@ -0,0 +1,222 @@
+#ifndef cbor_tests_h_INCLUDED
+#define cbor_tests_h_INCLUDED
+
+
+void run_cbor_tests(void);
+
+
+#ifdef IMPLEMENT_TESTS
+
+    #include "../bsky-api.h"
+
+    #define __CBOR_VIEW(lit) \
+        ((struct bsky_view) { lit, lit + sizeof (lit) - 1 })
+
+    static void cbor_decode(void)
+    {
+        enum bsky_error_code ec;
+
+        // {"a": 1, "bb": [true, null, -2], "ccc": Link(01 02)}
+        char data[] = "\xa3" "\x61" "a" "\x01"
+                      "\x62" "bb" "\x83\xf5\xf6\x21"
+                      "\x63" "ccc" "\xd8\x2a\x43\x00\x01\x02";
+        struct bsky_view view = __CBOR_VIEW(data);
+        struct bsky_cbor cbor = bsky_parse_cbor(&view, &ec);
+
+        TEST_ASSERT_EQUAL(bsky_ec_Ok, ec);
+        TEST_ASSERT(view.start == view.end);
+        TEST_ASSERT_EQUAL(bsky_cbor_Map, cbor.var);
+        TEST_ASSERT_EQUAL(3, cbor.map.len);
+        TEST_ASSERT(bsky_cbor_str_eq(cbor.map.data[1].key, "bb"));
+
+        struct bsky_cbor *a = bsky_cbor_get(&cbor, "a");
+        TEST_ASSERT(a != NULL && a->var == bsky_cbor_Int && a->i == 1);
+
+        struct bsky_cbor *bb = bsky_cbor_get(&cbor, "bb");
+        TEST_ASSERT(bb != NULL && bb->var == bsky_cbor_Arr);
+        TEST_ASSERT_EQUAL(3, bb->arr.len);
+        TEST_ASSERT(bb->arr.data[0].var == bsky_cbor_Bool &&
+                    bb->arr.data[0]._bool);
+        TEST_ASSERT_EQUAL(bsky_cbor_Null, bb->arr.data[1].var);
+        TEST_ASSERT_EQUAL(-2, bb->arr.data[2].i);
+
+        // link is view right into the input.
+        struct bsky_cbor *link = bsky_cbor_get(&cbor, "ccc");
+        TEST_ASSERT(link != NULL && link->var == bsky_cbor_Link);
+        TEST_ASSERT(link->bytes.start == data + sizeof (data) - 3);
+        TEST_ASSERT(link->bytes.end   == data + sizeof (data) - 1);
+
+        TEST_ASSERT(bsky_cbor_get(&cbor, "d") == NULL);
+    }
+
+    static void cbor_sequence(void)
+    {
+        enum bsky_error_code ec;
+
+        // firehose frame: header and body items.
+        char data[] = "\xa1\x62op\x01" "\xfb\x3f\xf8\0\0\0\0\0\0";
+        struct bsky_view view = __CBOR_VIEW(data);
+
+        TEST_ASSERT_EQUAL(bsky_ec_Ok, bsky_cbor_skip(&view));
+        TEST_ASSERT(view.start == data + 5);
+
+        struct bsky_cbor body = bsky_parse_cbor(&view, &ec);
+        TEST_ASSERT_EQUAL(bsky_ec_Ok, ec);
+        TEST_ASSERT_EQUAL(bsky_cbor_Float, body.var);
+        TEST_ASSERT(body.f == 1.5);
+
+        TEST_ASSERT_EQUAL(bsky_ec_Cbor_eof, bsky_cbor_skip(&view));
+    }
+
+    static void cbor_strict(void)
+    {
+        struct { char *data; size_t len; enum bsky_error_code ec; } cases[] = {
+            { "\x18\x05",                  2, bsky_ec_Cbor_non_canonical },
+            { "\xa2\x62" "bb\x01\x61" "a\x02", 8, bsky_ec_Cbor_non_canonical },
+            { "\xa2\x61" "a\x01\x61" "a\x02",  7, bsky_ec_Cbor_non_canonical },
+            { "\x9f\xff",                  2, bsky_ec_Cbor_non_canonical },
+            { "\xfa\x3f\xc0\0\0",          5, bsky_ec_Cbor_non_canonical },
+            { "\x62\xc0\x80",              3, bsky_ec_Cbor_invalid },
+            { "\xa1\x01\x02",              3, bsky_ec_Cbor_invalid },
+            { "\xc1\x01",                  2, bsky_ec_Cbor_invalid },
+            { "\xd8\x2a\x42\x01\x02",      5, bsky_ec_Cbor_invalid },
+            { "\x83\x01\x02",              3, bsky_ec_Cbor_eof },
+        };
+
+        for (size_t i = 0; i < sizeof (cases) / sizeof (*cases); ++i) {
+            struct bsky_view view = { cases[i].data,
+                                      cases[i].data + cases[i].len };
+
+            TEST_ASSERT_EQUAL(cases[i].ec, bsky_cbor_skip(&view));
+        }
+    }
+
+    static void cbor_encode(void)
+    {
+        enum bsky_error_code ec;
+        struct bsky_str_builder sb = { 0 };
+
+        // decoded canonical data is encoded back byte to byte.
+        char data[] = "\xa3" "\x61" "a" "\x19\x01\xf4"
+                      "\x62" "bb" "\x83\xf5\xf6\x39\x01\xf3"
+                      "\x63" "ccc" "\xd8\x2a\x43\x00\x01\x02";
+        struct bsky_view view = __CBOR_VIEW(data);
+        struct bsky_cbor cbor = bsky_parse_cbor(&view, &ec);
+
+        TEST_ASSERT_EQUAL(bsky_ec_Ok, ec);
+        TEST_ASSERT_EQUAL(bsky_ec_Ok, bsky_sb_push_cbor(&sb, cbor));
+        TEST_ASSERT_EQUAL(sizeof (data) - 1, sb.len);
+        TEST_ASSERT(memcmp(sb.data, data, sb.len) == 0);
+
+        // keys are sorted, even if tree is not in canonical order.
+        struct bsky_cbor_pair tmp = cbor.map.data[0];
+        cbor.map.data[0] = cbor.map.data[2];
+        cbor.map.data[2] = tmp;
+
+        sb.len = 0;
+        TEST_ASSERT_EQUAL(bsky_ec_Ok, bsky_sb_push_cbor(&sb, cbor));
+        TEST_ASSERT(memcmp(sb.data, data, sb.len) == 0);
+
+        bsky_da_free(&sb);
+    }
+
+    static void cbor_encode_json(void)
+    {
+        enum bsky_error_code ec;
+        struct bsky_str_builder sb = { 0 };
+        struct bsky_str str = bsky_mk_str(
+            "{\"size\": 1.5, \"ref\": {\"$link\": \"bafyreiaaaebagbafaydqqcik"
+            "bmga2dqpcaireeyuculbogazdinryhi6d4\"}, \"data\": {\"$bytes\": "
+            "\"AQL/\"}, \"n\": -24}");
+        struct bsky_json json = bsky_parse_json(&str, &ec);
+
+        TEST_ASSERT_EQUAL(bsky_ec_Ok, ec);
+        TEST_ASSERT_EQUAL(bsky_ec_Ok, bsky_sb_push_cbor_of_json(&sb, json));
+
+        struct bsky_view view = { sb.data, sb.data + sb.len };
+        struct bsky_cbor cbor = bsky_parse_cbor(&view, &ec);
+
+        TEST_ASSERT_EQUAL(bsky_ec_Ok, ec);
+        TEST_ASSERT(bsky_cbor_str_eq(cbor.map.data[0].key, "n"));
+        TEST_ASSERT_EQUAL(-24, cbor.map.data[0].value.i);
+        TEST_ASSERT(bsky_cbor_str_eq(cbor.map.data[1].key, "ref"));
+
+        struct bsky_cbor *ref = bsky_cbor_get(&cbor, "ref");
+        TEST_ASSERT(ref->var == bsky_cbor_Link);
+        TEST_ASSERT_EQUAL(36, (char*) ref->bytes.end -
+                              (char*) ref->bytes.start);
+        TEST_ASSERT_EQUAL(31, ((unsigned char*) ref->bytes.start)[35]);
+
+        struct bsky_cbor *bytes = bsky_cbor_get(&cbor, "data");
+        TEST_ASSERT(bytes->var == bsky_cbor_Bytes);
+        TEST_ASSERT(memcmp(bytes->bytes.start, "\x01\x02\xff", 3) == 0);
+
+        TEST_ASSERT(bsky_cbor_get(&cbor, "size")->f == 1.5);
+
+        bsky_da_free(&sb);
+    }
+
+    static void cbor_record_cid(void)
+    {
+        char data[] = "\xa1\x61" "a\x01";
+        struct bsky_str cid = bsky_tmp_record_cid(__CBOR_VIEW(data));
+
+        TEST_ASSERT_EQUAL_STRING(
+            "bafyreihltcnuuyqp2jm24aqydpnlj7b6w3ogwrplomrjtg5rifv44mmjey",
+            cid.start);
+    }
+
+    static void cbor_json_escapes(void)
+    {
+        enum bsky_error_code ec;
+        struct bsky_str_builder sb = { 0 }, want = { 0 };
+        struct bsky_str str = bsky_mk_str(
+            "{\"text\": \"a\\nb \\\"q\\\" \\u00e9 \\ud83d\\ude00\\/\","
+            " \"\\u0062\": 1}");
+        struct bsky_json json = bsky_parse_json(&str, &ec);
+
+        TEST_ASSERT_EQUAL(bsky_ec_Ok, ec);
+        TEST_ASSERT_EQUAL(bsky_ec_Ok, bsky_sb_push_cbor_of_json(&sb, json));
+
+        // `b' goes before `text' by decoded bytes.
+        bsky_cbor_push_map(&want, 2);
+        bsky_cbor_push_str(&want, bsky_mk_str("b"));
+        bsky_cbor_push_int(&want, 1);
+        bsky_cbor_push_str(&want, bsky_mk_str("text"));
+        bsky_cbor_push_str(&want,
+                           bsky_mk_str("a\nb \"q\" \xc3\xa9 \xf0\x9f\x98\x80/"));
+
+        TEST_ASSERT_EQUAL(want.len, sb.len);
+        TEST_ASSERT(memcmp(want.data, sb.data, sb.len) == 0);
+        TEST_ASSERT_EQUAL_STRING(
+            bsky_tmp_record_cid((struct bsky_view) {
+                want.data, want.data + want.len }).start,
+            bsky_tmp_record_cid((struct bsky_view) {
+                sb.data, sb.data + sb.len }).start);
+
+        // lone surrogate.
+        str = bsky_mk_str("\"\\ude00\"");
+        json = bsky_parse_json(&str, &ec);
+        TEST_ASSERT_EQUAL(bsky_ec_Ok, ec);
+        TEST_ASSERT_EQUAL(bsky_ec_Cbor_invalid,
+                          bsky_sb_push_cbor_of_json(&sb, json));
+
+        bsky_da_free(&want);
+        bsky_da_free(&sb);
+    }
+
+    void run_cbor_tests(void)
+    {
+        RUN_TEST(cbor_decode);
+        RUN_TEST(cbor_sequence);
+        RUN_TEST(cbor_strict);
+        RUN_TEST(cbor_encode);
+        RUN_TEST(cbor_encode_json);
+        RUN_TEST(cbor_record_cid);
+        RUN_TEST(cbor_json_escapes);
+    }
+
+#endif
+
+
+#endif // cbor-tests_h_INCLUDED
@@ -0,0 +1,163 @@
+#ifndef checkpoint_tests_h_INCLUDED
+#define checkpoint_tests_h_INCLUDED
+
+
+void run_checkpoint_tests(void);
+
+
+#ifdef IMPLEMENT_TESTS
+
+    #include "../bsky-api.h"
+    #include <unistd.h>
+
+    static char __checkpoint_path[] = "/tmp/bsky-checkpoint-test";
+
+    static void checkpoint_watermark(void)
+    {
+        enum bsky_error_code ec;
+        struct bsky_checkpoint cp;
+
+        unlink(__checkpoint_path);
+        TEST_ASSERT_EQUAL(bsky_ec_Ok,
+                          bsky_checkpoint_open(&cp, __checkpoint_path, 2, &ec));
+        TEST_ASSERT_EQUAL(0, cp.resume);
+
+        TEST_ASSERT(bsky_checkpoint_dispatch(&cp, 0, 1));
+        TEST_ASSERT(bsky_checkpoint_dispatch(&cp, 1, 2));
+        TEST_ASSERT(bsky_checkpoint_dispatch(&cp, 0, 3));
+        TEST_ASSERT(!bsky_checkpoint_dispatch(&cp, 1, 2));
+
+        // 1 is not done yet.
+        bsky_checkpoint_done(&cp, 1, 2);
+        TEST_ASSERT_EQUAL(0, bsky_checkpoint_watermark(&cp));
+
+        bsky_checkpoint_done(&cp, 0, 1);
+        TEST_ASSERT_EQUAL(1, bsky_checkpoint_watermark(&cp));
+
+        // idle worker 1 gets event 10 long after its last one.
+        bsky_checkpoint_done(&cp, 0, 3);
+        TEST_ASSERT_EQUAL(3, bsky_checkpoint_watermark(&cp));
+        TEST_ASSERT(bsky_checkpoint_dispatch(&cp, 1, 10));
+        TEST_ASSERT(bsky_checkpoint_dispatch(&cp, 0, 11));
+        bsky_checkpoint_done(&cp, 0, 11);
+        TEST_ASSERT_EQUAL(9, bsky_checkpoint_watermark(&cp));
+
+        bsky_checkpoint_done(&cp, 1, 10);
+        TEST_ASSERT_EQUAL(11, bsky_checkpoint_watermark(&cp));
+
+        TEST_ASSERT_EQUAL(bsky_ec_Ok, bsky_checkpoint_close(&cp));
+        unlink(__checkpoint_path);
+    }
+
+    static void checkpoint_persist(void)
+    {
+        enum bsky_error_code ec;
+        struct bsky_checkpoint cp;
+        struct bsky_str url;
+        FILE *file;
+
+        unlink(__checkpoint_path);
+        TEST_ASSERT_EQUAL(bsky_ec_Ok,
+                          bsky_checkpoint_open(&cp, __checkpoint_path, 1, &ec));
+        cp.interval_ms = 60000;
+
+        bsky_checkpoint_dispatch(&cp, 0, 5);
+        bsky_checkpoint_done(&cp, 0, 5);
+        TEST_ASSERT_EQUAL(bsky_ec_Ok, bsky_checkpoint_flush(&cp, 0));
+        TEST_ASSERT_EQUAL(1, cp.syncs);
+
+        // batched: interval is not passed.
+        bsky_checkpoint_dispatch(&cp, 0, 7);
+        bsky_checkpoint_done(&cp, 0, 7);
+        TEST_ASSERT_EQUAL(bsky_ec_Ok, bsky_checkpoint_flush(&cp, 0));
+        TEST_ASSERT_EQUAL(1, cp.syncs);
+        TEST_ASSERT_EQUAL(bsky_ec_Ok, bsky_checkpoint_close(&cp));
+
+        TEST_ASSERT_EQUAL(bsky_ec_Ok,
+                          bsky_checkpoint_open(&cp, __checkpoint_path, 1, &ec));
+        TEST_ASSERT_EQUAL(7, cp.resume);
+        TEST_ASSERT(!bsky_checkpoint_dispatch(&cp, 0, 7));
+
+        url = bsky_checkpoint_url(&cp, bsky_mk_str(
+                  "ws://localhost/subscribe?wantedCollections=a.b.c"));
+        TEST_ASSERT_EQUAL_STRING(
+            "ws://localhost/subscribe?wantedCollections=a.b.c&cursor=7",
+            url.start);
+        TEST_ASSERT_EQUAL(bsky_ec_Ok, bsky_checkpoint_close(&cp));
+
+        // torn write of the last slot falls back to the previous one.
+        TEST_ASSERT((file = fopen(__checkpoint_path, "r+")) != NULL);
+        fseek(file, 0, SEEK_SET);
+        fputc('X', file);
+        fclose(file);
+
+        TEST_ASSERT_EQUAL(bsky_ec_Ok,
+                          bsky_checkpoint_open(&cp, __checkpoint_path, 1, &ec));
+        TEST_ASSERT_EQUAL(5, cp.resume);
+        TEST_ASSERT_EQUAL(bsky_ec_Ok, bsky_checkpoint_close(&cp));
+
+        unlink(__checkpoint_path);
+    }
+
+    static void __checkpoint_handler(void *user,
+                                     struct bsky_firehose_event *ev)
+    {
+        (void) ev;
+        (*(_Atomic int*) user)++;
+    }
+
+    static void checkpoint_firehose(void)
+    {
+        enum bsky_error_code ec;
+        struct bsky_checkpoint cp;
+        struct bsky_firehose   pipe;
+        _Atomic int handled = 0;
+        struct bsky_firehose_config config = {
+            .handler    = __checkpoint_handler,
+            .user       = &handled,
+            .checkpoint = &cp,
+        };
+
+        unlink(__checkpoint_path);
+        TEST_ASSERT_EQUAL(bsky_ec_Ok,
+                          bsky_checkpoint_open(&cp, __checkpoint_path, 2, &ec));
+        TEST_ASSERT_EQUAL(bsky_ec_Ok, bsky_firehose_start(&pipe, &config));
+        TEST_ASSERT_EQUAL(2, pipe.len);
+
+        // the second pass is replay after reconnect.
+        for (int pass = 0; pass < 2; ++pass) {
+            for (int seq = 1; seq <= 50; ++seq) {
+                struct bsky_str_builder sb = { 0 };
+
+                __firehose_frame(&sb, __firehose_repos[seq % 4], seq);
+                TEST_ASSERT_EQUAL(bsky_ec_Ok, bsky_firehose_push(&pipe,
+                    (struct bsky_view) { sb.data, sb.data + sb.len }));
+                bsky_da_free(&sb);
+            }
+        }
+
+        while (bsky_checkpoint_watermark(&cp) != 50) sched_yield();
+
+        bsky_firehose_stop(&pipe);
+        TEST_ASSERT_EQUAL(50, handled);
+        TEST_ASSERT_EQUAL(bsky_ec_Ok, bsky_checkpoint_close(&cp));
+
+        TEST_ASSERT_EQUAL(bsky_ec_Ok,
+                          bsky_checkpoint_open(&cp, __checkpoint_path, 2, &ec));
+        TEST_ASSERT_EQUAL(50, cp.resume);
+        TEST_ASSERT_EQUAL(bsky_ec_Ok, bsky_checkpoint_close(&cp));
+
+        unlink(__checkpoint_path);
+    }
+
+    void run_checkpoint_tests(void)
+    {
+        RUN_TEST(checkpoint_watermark);
+        RUN_TEST(checkpoint_persist);
+        RUN_TEST(checkpoint_firehose);
+    }
+
+#endif
+
+
+#endif // checkpoint-tests_h_INCLUDED
@@ -0,0 +1,130 @@
+#ifndef cid_tests_h_INCLUDED
+#define cid_tests_h_INCLUDED
+
+
+void run_cid_tests(void);
+
+
+#ifdef IMPLEMENT_TESTS
+
+    #include "../bsky-api.h"
+
+    static void cid_parse_format(void)
+    {
+        enum bsky_error_code ec;
+        const char *str =
+            "bafyreihltcnuuyqp2jm24aqydpnlj7b6w3ogwrplomrjtg5rifv44mmjey";
+        char record[] = "\xa1\x61" "a\x01";
+
+        struct bsky_cid cid = bsky_cid_of_str(bsky_mk_str((char*) str), &ec);
+
+        TEST_ASSERT_EQUAL(bsky_ec_Ok, ec);
+        TEST_ASSERT_EQUAL(1, cid.version);
+        TEST_ASSERT_EQUAL(bsky_multicodec_Dag_cbor, cid.codec);
+        TEST_ASSERT_EQUAL(bsky_multicodec_Sha2_256, cid.hash);
+        TEST_ASSERT_EQUAL(32, cid.digest_len);
+        TEST_ASSERT_EQUAL_STRING(str, bsky_tmp_str_of_cid(cid).start);
+
+        struct bsky_view data = { record, record + 4 };
+        TEST_ASSERT(bsky_cid_verify(cid, data));
+        TEST_ASSERT(bsky_cid_eq(cid, bsky_cid_of_data(
+                                         bsky_multicodec_Dag_cbor, data)));
+
+        // binary form round trip.
+        struct bsky_str_builder sb = { 0 };
+        bsky_sb_push_cid(&sb, cid);
+        TEST_ASSERT_EQUAL(36, sb.len);
+
+        struct bsky_view bytes = { sb.data, sb.data + sb.len };
+        TEST_ASSERT(bsky_cid_eq(cid, bsky_cid_of_bytes(&bytes, &ec)));
+        TEST_ASSERT(bytes.start == bytes.end);
+        bsky_da_free(&sb);
+
+        record[3] = 2;
+        TEST_ASSERT(!bsky_cid_verify(cid, data));
+
+        bsky_cid_of_str(bsky_mk_str("bafyrei1"), &ec);
+        TEST_ASSERT_EQUAL(bsky_ec_Cid_invalid, ec);
+    }
+
+    static void cid_sha256_backends(void)
+    {
+        enum bsky_sha256_backend backends[] = {
+            bsky_sha256_Avx2, bsky_sha256_Shani, bsky_sha256_Armv8,
+        };
+        static unsigned char data[1000];
+        unsigned char expect[200][32], digests[200][32];
+        struct bsky_view views[200];
+
+        for (size_t i = 0; i < sizeof (data); ++i) data[i] = i * 7 + 3;
+        for (int i = 0; i < 200; ++i) {
+            // lengths around padding boundaries and few blocks.
+            views[i] = (struct bsky_view) { data + i, data + i + i * 3 % 257 };
+        }
+
+        bsky_sha256_use(bsky_sha256_Portable);
+        bsky_sha256("abc", 3, expect[0]);
+        TEST_ASSERT(memcmp(expect[0], "\xba\x78\x16\xbf\x8f\x01\xcf\xea", 8)
+                    == 0);
+
+        for (int i = 0; i < 200; ++i) {
+            bsky_sha256(views[i].start,
+                        (char*) views[i].end - (char*) views[i].start,
+                        expect[i]);
+        }
+
+        for (size_t b = 0; b < sizeof (backends) / sizeof (*backends); ++b) {
+            // unsupported backends fall back to portable code.
+            bsky_sha256_use(backends[b]);
+
+            memset(digests, 0, sizeof (digests));
+            bsky_sha256_many(views, 200, digests);
+            TEST_ASSERT(memcmp(expect, digests, sizeof (digests)) == 0);
+
+            for (int i = 0; i < 200; ++i) {
+                bsky_sha256(views[i].start,
+                            (char*) views[i].end - (char*) views[i].start,
+                            digests[i]);
+            }
+            TEST_ASSERT(memcmp(expect, digests, sizeof (digests)) == 0);
+        }
+
+        bsky_sha256_use(bsky_sha256_Auto);
+    }
+
+    static void *__cid_hash_abc(void *arg)
+    {
+        bsky_sha256("abc", 3, arg);
+
+        return NULL;
+    }
+
+    static void cid_sha256_first_use(void)
+    {
+        unsigned char digests[4][32];
+        pthread_t threads[4];
+
+        // backend is selected by concurrent first calls.
+        atomic_store(&__bsky_sha256_backend, bsky_sha256_Auto);
+        for (int i = 0; i < 4; ++i)
+            pthread_create(&threads[i], NULL, __cid_hash_abc, digests[i]);
+        for (int i = 0; i < 4; ++i) pthread_join(threads[i], NULL);
+
+        for (int i = 0; i < 4; ++i) {
+            TEST_ASSERT(memcmp(digests[i], "\xba\x78\x16\xbf\x8f\x01\xcf\xea",
+                               8) == 0);
+        }
+        TEST_ASSERT(atomic_load(&__bsky_sha256_backend) != bsky_sha256_Auto);
+    }
+
+    void run_cid_tests(void)
+    {
+        RUN_TEST(cid_parse_format);
+        RUN_TEST(cid_sha256_backends);
+        RUN_TEST(cid_sha256_first_use);
+    }
+
+#endif
+
+
+#endif // cid-tests_h_INCLUDED
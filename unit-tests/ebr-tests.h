@@ -0,0 +1,174 @@
+#ifndef ebr_tests_h_INCLUDED
+#define ebr_tests_h_INCLUDED
+
+
+void run_ebr_tests(void);
+
+
+#ifdef IMPLEMENT_TESTS
+
+    #include "../bsky-api.h"
+
+    static _Atomic int __ebr_freed;
+
+    static void __ebr_free(void *ptr)
+    {
+        *(int*) ptr = 0;
+        free(ptr);
+        atomic_fetch_add(&__ebr_freed, 1);
+    }
+
+    struct __ebr_holder { _Atomic int inside, release; };
+
+    static void *__ebr_hold(void *arg)
+    {
+        struct __ebr_holder *h = arg;
+
+        bsky_ebr_enter();
+        atomic_store(&h->inside, 1);
+        while (!atomic_load(&h->release)) sched_yield();
+        bsky_ebr_leave();
+
+        return NULL;
+    }
+
+    static void ebr_grace(void)
+    {
+        struct __ebr_holder h = { 0 };
+        pthread_t thread;
+        int *obj = malloc(sizeof (int));
+
+        // objects retired by other tests.
+        bsky_ebr_flush();
+
+        atomic_store(&__ebr_freed, 0);
+        TEST_ASSERT(pthread_create(&thread, NULL, __ebr_hold, &h) == 0);
+        while (!atomic_load(&h.inside)) sched_yield();
+
+        TEST_ASSERT_EQUAL(bsky_ec_Ok, bsky_ebr_retire(obj, __ebr_free));
+
+        // reader inside holds the epoch.
+        for (int i = 0; i < 4; ++i) bsky_ebr_collect();
+        TEST_ASSERT_EQUAL(0, __ebr_freed);
+
+        atomic_store(&h.release, 1);
+        pthread_join(thread, NULL);
+
+        size_t freed = 0;
+        for (int i = 0; i < 2; ++i) freed += bsky_ebr_collect();
+        TEST_ASSERT_EQUAL(1, freed);
+        TEST_ASSERT_EQUAL(1, __ebr_freed);
+
+        // nested sections of the same thread.
+        bsky_ebr_enter();
+        bsky_ebr_enter();
+        bsky_ebr_leave();
+        TEST_ASSERT_EQUAL(bsky_ec_Ok,
+                          bsky_ebr_retire(malloc(sizeof (int)), __ebr_free));
+        bsky_ebr_leave();
+        bsky_ebr_flush();
+        TEST_ASSERT_EQUAL(2, __ebr_freed);
+    }
+
+    struct __ebr_shared {
+        _Atomic(int *) current;
+        _Atomic int    stop;
+        size_t         bad;
+    };
+
+    static void *__ebr_read(void *arg)
+    {
+        struct __ebr_shared *s = arg;
+
+        while (!atomic_load(&s->stop)) {
+            bsky_ebr_enter();
+            int *value = atomic_load(&s->current);
+            if (*value == 0) s->bad++;
+            bsky_ebr_leave();
+        }
+
+        return NULL;
+    }
+
+    static void *__ebr_retire_and_exit(void *arg)
+    {
+        (void) arg;
+        bsky_ebr_retire(malloc(sizeof (int)), __ebr_free);
+
+        return NULL;
+    }
+
+    static void ebr_readers(void)
+    {
+        struct __ebr_shared s = { 0 };
+        pthread_t threads[3];
+        int *first = malloc(sizeof (int));
+
+        *first = 1;
+        atomic_store(&s.current, first);
+        atomic_store(&__ebr_freed, 0);
+
+        for (int i = 0; i < 2; ++i)
+            pthread_create(&threads[i], NULL, __ebr_read, &s);
+
+        for (int i = 2; i < 2000; ++i) {
+            int *next = malloc(sizeof (int));
+
+            *next = i;
+            bsky_ebr_retire(atomic_exchange(&s.current, next), __ebr_free);
+        }
+
+        atomic_store(&s.stop, 1);
+        for (int i = 0; i < 2; ++i) pthread_join(threads[i], NULL);
+
+        // thread exited before its retired object could be freed.
+        pthread_create(&threads[2], NULL, __ebr_retire_and_exit, NULL);
+        pthread_join(threads[2], NULL);
+
+        bsky_ebr_flush();
+
+        TEST_ASSERT_EQUAL(0, s.bad);
+        TEST_ASSERT_EQUAL(1999, __ebr_freed);
+        free(atomic_load(&s.current));
+    }
+
+    static void ebr_tmp(void)
+    {
+        enum bsky_error_code ec;
+        struct bsky_str text = bsky_mk_str("{\"a\": [1, 2, 3]}");
+        struct bsky_json json;
+        char *block;
+
+        bsky_default_tmp_reset();
+        json  = bsky_parse_json(&text, &ec);
+        TEST_ASSERT_EQUAL(bsky_ec_Ok, ec);
+        block = __bsky_default_tmp_arena.allocator;
+
+        bsky_ebr_enter();
+        TEST_ASSERT_EQUAL(bsky_ec_Ok, bsky_ebr_retire_tmp());
+
+        // the next allocation goes to another block, json stays.
+        TEST_ASSERT(bsky_tmp_alloc(16) != NULL);
+        TEST_ASSERT(__bsky_default_tmp_arena.allocator != block);
+        TEST_ASSERT_EQUAL(bsky_json_Dct, json.var);
+        TEST_ASSERT_EQUAL(1, json.dct.len);
+        bsky_ebr_leave();
+
+        // retired block is back in the pool.
+        bsky_default_tmp_free();
+        bsky_ebr_flush();
+        TEST_ASSERT(bsky_tmp_alloc(16) == block);
+        bsky_default_tmp_reset();
+    }
+
+    void run_ebr_tests(void)
+    {
+        RUN_TEST(ebr_grace);
+        RUN_TEST(ebr_readers);
+        RUN_TEST(ebr_tmp);
+    }
+
+#endif
+
+
+#endif // ebr-tests_h_INCLUDED
@@ -0,0 +1,233 @@
+#ifndef firehose_tests_h_INCLUDED
+#define firehose_tests_h_INCLUDED
+
+
+void run_firehose_tests(void);
+
+
+#ifdef IMPLEMENT_TESTS
+
+    #include "../bsky-api.h"
+
+    // `#commit' frame with one create op.
+    static void __firehose_frame(struct bsky_str_builder *sb, char *repo,
+                                 int64_t seq)
+    {
+        unsigned char cid[36] = { 0x01, 0x71, 0x12, 0x20 };
+
+        bsky_cbor_push_map(sb, 2);
+        bsky_cbor_push_str(sb, bsky_mk_str("t"));
+        bsky_cbor_push_str(sb, bsky_mk_str("#commit"));
+        bsky_cbor_push_str(sb, bsky_mk_str("op"));
+        bsky_cbor_push_int(sb, 1);
+
+        bsky_cbor_push_map(sb, 6);
+        bsky_cbor_push_str(sb, bsky_mk_str("ops"));
+        bsky_cbor_push_arr(sb, 1);
+        bsky_cbor_push_map(sb, 3);
+        bsky_cbor_push_str(sb, bsky_mk_str("cid"));
+        bsky_cbor_push_link(sb, (struct bsky_view) { cid, cid + 36 });
+        bsky_cbor_push_str(sb, bsky_mk_str("path"));
+        bsky_cbor_push_str(sb, bsky_mk_str("app.bsky.feed.post/3k"));
+        bsky_cbor_push_str(sb, bsky_mk_str("action"));
+        bsky_cbor_push_str(sb, bsky_mk_str("create"));
+        bsky_cbor_push_str(sb, bsky_mk_str("rev"));
+        bsky_cbor_push_str(sb, bsky_mk_str("3kabc"));
+        bsky_cbor_push_str(sb, bsky_mk_str("seq"));
+        bsky_cbor_push_int(sb, seq);
+        bsky_cbor_push_str(sb, bsky_mk_str("repo"));
+        bsky_cbor_push_str(sb, bsky_mk_str(repo));
+        bsky_cbor_push_str(sb, bsky_mk_str("time"));
+        bsky_cbor_push_str(sb, bsky_mk_str("2024-01-01T00:00:00Z"));
+        bsky_cbor_push_str(sb, bsky_mk_str("blocks"));
+        bsky_cbor_push_bytes(sb, (struct bsky_view) { "car", "car" + 3 });
+    }
+
+    static int __firehose_eq(struct bsky_str str, const char *expected)
+    {
+        return (size_t) (str.end - str.start) == strlen(expected) &&
+               memcmp(str.start, expected, strlen(expected)) == 0;
+    }
+
+    static void firehose_spsc(void)
+    {
+        struct bsky_spsc ring;
+        int items[5];
+
+        TEST_ASSERT_EQUAL(bsky_ec_Ok, bsky_spsc_init(&ring, 3));
+        TEST_ASSERT(bsky_spsc_pop(&ring) == NULL);
+
+        for (int i = 0; i < 4; ++i)
+            TEST_ASSERT(bsky_spsc_push(&ring, &items[i]));
+        TEST_ASSERT(!bsky_spsc_push(&ring, &items[4]));
+        TEST_ASSERT_EQUAL(4, bsky_spsc_depth(&ring));
+
+        for (int i = 0; i < 4; ++i)
+            TEST_ASSERT(bsky_spsc_pop(&ring) == &items[i]);
+        TEST_ASSERT(bsky_spsc_pop(&ring) == NULL);
+        TEST_ASSERT_EQUAL(4, ring.max_depth);
+
+        bsky_spsc_free(&ring);
+    }
+
+    static void firehose_decode(void)
+    {
+        struct bsky_str_builder    sb = { 0 };
+        struct bsky_firehose_event ev = { 0 };
+
+        __firehose_frame(&sb, "did:plc:alice", 42);
+        TEST_ASSERT_EQUAL(bsky_ec_Ok, bsky_firehose_decode(&ev,
+                          (struct bsky_view) { sb.data, sb.data + sb.len }));
+
+        TEST_ASSERT_EQUAL(1, ev.op);
+        TEST_ASSERT(__firehose_eq(ev.type, "#commit"));
+        TEST_ASSERT_EQUAL(42, ev.seq);
+        TEST_ASSERT(__firehose_eq(ev.repo, "did:plc:alice"));
+        TEST_ASSERT(__firehose_eq(ev.rev, "3kabc"));
+        TEST_ASSERT_EQUAL(3, (char*) ev.blocks.end - (char*) ev.blocks.start);
+
+        TEST_ASSERT_EQUAL(1, ev.ops.len);
+        TEST_ASSERT_EQUAL(bsky_write_Create, ev.ops.data[0].op);
+        TEST_ASSERT(__firehose_eq(ev.ops.data[0].path,
+                                  "app.bsky.feed.post/3k"));
+        TEST_ASSERT_EQUAL(36, (char*) ev.ops.data[0].cid.end -
+                              (char*) ev.ops.data[0].cid.start);
+
+        // truncated frame.
+        TEST_ASSERT_EQUAL(bsky_ec_Firehose_invalid, bsky_firehose_decode(&ev,
+                          (struct bsky_view) { sb.data, sb.data + sb.len - 1 }));
+
+        bsky_da_free(&ev.ops);
+        bsky_da_free(&sb);
+    }
+
+    static void firehose_identity_seq(void)
+    {
+        struct bsky_str_builder sb = { 0 };
+        struct bsky_str repo;
+        int64_t seq;
+
+        // `did' goes before `seq' in canonical order.
+        bsky_cbor_push_map(&sb, 2);
+        bsky_cbor_push_str(&sb, bsky_mk_str("t"));
+        bsky_cbor_push_str(&sb, bsky_mk_str("#identity"));
+        bsky_cbor_push_str(&sb, bsky_mk_str("op"));
+        bsky_cbor_push_int(&sb, 1);
+
+        bsky_cbor_push_map(&sb, 4);
+        bsky_cbor_push_str(&sb, bsky_mk_str("did"));
+        bsky_cbor_push_str(&sb, bsky_mk_str("did:plc:alice"));
+        bsky_cbor_push_str(&sb, bsky_mk_str("seq"));
+        bsky_cbor_push_int(&sb, 7);
+        bsky_cbor_push_str(&sb, bsky_mk_str("time"));
+        bsky_cbor_push_str(&sb, bsky_mk_str("2024-01-01T00:00:00Z"));
+        bsky_cbor_push_str(&sb, bsky_mk_str("handle"));
+        bsky_cbor_push_str(&sb, bsky_mk_str("alice.test"));
+
+        TEST_ASSERT(__bsky_firehose_repo((struct bsky_view) {
+                        sb.data, sb.data + sb.len }, &repo, &seq));
+        TEST_ASSERT(__firehose_eq(repo, "did:plc:alice"));
+        TEST_ASSERT_EQUAL(7, seq);
+
+        sb.len = 0;
+        __firehose_frame(&sb, "did:plc:bob", 8);
+        TEST_ASSERT(__bsky_firehose_repo((struct bsky_view) {
+                        sb.data, sb.data + sb.len }, &repo, &seq));
+        TEST_ASSERT(__firehose_eq(repo, "did:plc:bob"));
+        TEST_ASSERT_EQUAL(8, seq);
+
+        bsky_da_free(&sb);
+    }
+
+    static char *__firehose_repos[] = {
+        "did:plc:alice", "did:plc:bob", "did:plc:carol", "did:plc:dave",
+    };
+
+    static struct {
+        pthread_mutex_t lock;
+        int64_t last[4];
+        size_t  handled, out_of_order;
+    } __firehose_seen = { .lock = PTHREAD_MUTEX_INITIALIZER };
+
+    static int __firehose_filter(void *user, const struct bsky_firehose_event *ev)
+    {
+        (void) user;
+        return ev->seq % 10 != 0;
+    }
+
+    static void __firehose_handler(void *user, struct bsky_firehose_event *ev)
+    {
+        (void) user;
+
+        pthread_mutex_lock(&__firehose_seen.lock);
+        for (int i = 0; i < 4; ++i) {
+            if (!__firehose_eq(ev->repo, __firehose_repos[i]))
+                continue;
+
+            if (ev->seq <= __firehose_seen.last[i])
+                __firehose_seen.out_of_order++;
+            __firehose_seen.last[i] = ev->seq;
+        }
+        __firehose_seen.handled++;
+        pthread_mutex_unlock(&__firehose_seen.lock);
+    }
+
+    static void firehose_pipeline(void)
+    {
+        struct bsky_firehose pipe;
+        struct bsky_firehose_config config = {
+            .shards  = 3,
+            .ring    = 4,
+            .filter  = __firehose_filter,
+            .handler = __firehose_handler,
+        };
+        struct bsky_firehose_metrics metrics[3];
+        uint64_t pushed = 0, done = 0;
+
+        TEST_ASSERT_EQUAL(bsky_ec_Ok, bsky_firehose_start(&pipe, &config));
+
+        for (int seq = 1; seq <= 200; ++seq) {
+            struct bsky_str_builder sb = { 0 };
+
+            __firehose_frame(&sb, __firehose_repos[seq % 4], seq);
+            TEST_ASSERT_EQUAL(bsky_ec_Ok, bsky_firehose_push(&pipe,
+                              (struct bsky_view) { sb.data, sb.data + sb.len }));
+            bsky_da_free(&sb);
+        }
+
+        TEST_ASSERT_EQUAL(bsky_ec_Firehose_invalid, bsky_firehose_push(&pipe,
+                          (struct bsky_view) { "\xa1", "\xa1" + 1 }));
+
+        while (done != 200) {
+            TEST_ASSERT_EQUAL(3, bsky_firehose_metrics(&pipe, metrics, 3));
+
+            pushed = done = 0;
+            for (int i = 0; i < 3; ++i) {
+                pushed += metrics[i].pushed;
+                done   += metrics[i].handled + metrics[i].filtered +
+                          metrics[i].invalid;
+                TEST_ASSERT(metrics[i].decode_max <= 4);
+            }
+            sched_yield();
+        }
+        TEST_ASSERT_EQUAL(200, pushed);
+
+        bsky_firehose_stop(&pipe);
+
+        TEST_ASSERT_EQUAL(180, __firehose_seen.handled);
+        TEST_ASSERT_EQUAL(0, __firehose_seen.out_of_order);
+        TEST_ASSERT_EQUAL(199, __firehose_seen.last[3]);
+    }
+
+    void run_firehose_tests(void)
+    {
+        RUN_TEST(firehose_spsc);
+        RUN_TEST(firehose_decode);
+        RUN_TEST(firehose_identity_seq);
+        RUN_TEST(firehose_pipeline);
+    }
+
+#endif
+
+
+#endif // firehose-tests_h_INCLUDED
@@ -0,0 +1,240 @@
+#ifndef graph_tests_h_INCLUDED
+#define graph_tests_h_INCLUDED
+
+
+void run_graph_tests(void);
+
+
+#ifdef IMPLEMENT_TESTS
+
+    #include "../bsky-api.h"
+    #include <stdio.h>
+    #include <unistd.h>
+
+    static char __graph_path[] = "/tmp/bsky-graph-test";
+
+    static void __graph_expect(struct bsky_graph_ids *ids,
+                               const uint32_t *expected, size_t n)
+    {
+        TEST_ASSERT_EQUAL(n, ids->len);
+        for (size_t i = 0; i < n && i < ids->len; ++i)
+            TEST_ASSERT_EQUAL(expected[i], ids->data[i]);
+        ids->len = 0;
+    }
+
+    static void graph_basic(void)
+    {
+        enum bsky_error_code ec;
+        struct bsky_graph g = { 0 };
+        struct bsky_graph_ids ids = { 0 };
+        char text[] = "{\"$type\": \"app.bsky.graph.follow\","
+                      " \"subject\": \"did:plc:carol\","
+                      " \"createdAt\": \"2024-05-01T00:00:00.000Z\"}";
+        struct bsky_str str = bsky_mk_str(text);
+        struct bsky_json record = bsky_parse_json(&str, &ec);
+
+        uint32_t alice = bsky_graph_id(&g, bsky_mk_str("did:plc:alice"));
+        uint32_t bob   = bsky_graph_id(&g, bsky_mk_str("did:plc:bob"));
+
+        TEST_ASSERT_EQUAL(0, alice);
+        TEST_ASSERT_EQUAL(1, bob);
+        TEST_ASSERT_EQUAL(bob, bsky_graph_id(&g, bsky_mk_str("did:plc:bob")));
+        TEST_ASSERT_EQUAL(BSKY_GRAPH_NONE,
+                          bsky_graph_find(&g, bsky_mk_str("did:plc:carol")));
+
+        TEST_ASSERT_EQUAL(bsky_ec_Ok, bsky_graph_follow_record(&g,
+                          bsky_mk_str("did:plc:alice"), &record));
+        uint32_t carol = bsky_graph_find(&g, bsky_mk_str("did:plc:carol"));
+        TEST_ASSERT_EQUAL(2, carol);
+        TEST_ASSERT_EQUAL_STRING("did:plc:carol", bsky_graph_did(&g, carol));
+        TEST_ASSERT(bsky_graph_did(&g, 3) == NULL);
+
+        TEST_ASSERT_EQUAL(bsky_ec_Ok, bsky_graph_follow(&g, alice, bob));
+        TEST_ASSERT_EQUAL(bsky_ec_Ok, bsky_graph_follow(&g, bob, carol));
+        TEST_ASSERT_EQUAL(bsky_ec_Ok, bsky_graph_follow(&g, carol, alice));
+        TEST_ASSERT_EQUAL(bsky_ec_Graph_invalid,
+                          bsky_graph_follow(&g, alice, 7));
+
+        // log is not visible before merge.
+        TEST_ASSERT(!bsky_graph_follows(&g, alice, bob));
+        TEST_ASSERT_EQUAL(bsky_ec_Ok, bsky_graph_merge(&g));
+        TEST_ASSERT_EQUAL(4, g.edges);
+
+        TEST_ASSERT(bsky_graph_follows(&g, alice, bob));
+        TEST_ASSERT(!bsky_graph_follows(&g, bob, alice));
+        TEST_ASSERT_EQUAL(2, bsky_graph_following_count(&g, alice));
+        TEST_ASSERT_EQUAL(2, bsky_graph_followers_count(&g, carol));
+
+        bsky_graph_following(&g, alice, &ids);
+        __graph_expect(&ids, (uint32_t[]) { bob, carol }, 2);
+        bsky_graph_followers(&g, carol, &ids);
+        __graph_expect(&ids, (uint32_t[]) { alice, bob }, 2);
+
+        // the last op of edge wins, unknown unfollow is nothing.
+        uint32_t dave = bsky_graph_id(&g, bsky_mk_str("did:plc:dave"));
+        bsky_graph_unfollow(&g, alice, bob);
+        bsky_graph_follow(&g, alice, bob);
+        bsky_graph_unfollow(&g, alice, carol);
+        bsky_graph_unfollow(&g, dave, alice);
+        bsky_graph_follow(&g, bob, dave);
+        bsky_graph_follow(&g, bob, dave);
+        TEST_ASSERT_EQUAL(bsky_ec_Ok, bsky_graph_merge(&g));
+
+        TEST_ASSERT_EQUAL(4, g.edges);
+        bsky_graph_following(&g, alice, &ids);
+        __graph_expect(&ids, (uint32_t[]) { bob }, 1);
+        bsky_graph_following(&g, bob, &ids);
+        __graph_expect(&ids, (uint32_t[]) { carol, dave }, 2);
+        bsky_graph_followers(&g, alice, &ids);
+        __graph_expect(&ids, (uint32_t[]) { carol }, 1);
+
+        // alice -> bob -> carol, dave.
+        bsky_graph_two_hop(&g, alice, &ids);
+        __graph_expect(&ids, (uint32_t[]) { carol, dave }, 2);
+        bsky_graph_follow(&g, alice, dave);
+        bsky_graph_merge(&g);
+        bsky_graph_two_hop(&g, alice, &ids);
+        __graph_expect(&ids, (uint32_t[]) { carol }, 1);
+
+        bsky_da_free(&ids);
+        bsky_graph_free(&g);
+        bsky_default_tmp_reset();
+    }
+
+    #define GRAPH_NODES 300
+
+    static void __graph_compare(struct bsky_graph *g,
+                                unsigned char (*adj)[GRAPH_NODES])
+    {
+        struct bsky_graph_ids ids = { 0 };
+        uint64_t edges = 0;
+
+        for (uint32_t u = 0; u < GRAPH_NODES; ++u) {
+            size_t out = 0, in = 0;
+
+            ids.len = 0;
+            bsky_graph_following(g, u, &ids);
+            for (uint32_t v = 0; v < GRAPH_NODES; ++v) {
+                if (!adj[u][v]) continue;
+                TEST_ASSERT(out < ids.len && ids.data[out] == v);
+                out++;
+            }
+            TEST_ASSERT_EQUAL(out, ids.len);
+            TEST_ASSERT_EQUAL(out, bsky_graph_following_count(g, u));
+
+            ids.len = 0;
+            bsky_graph_followers(g, u, &ids);
+            for (uint32_t v = 0; v < GRAPH_NODES; ++v) {
+                if (!adj[v][u]) continue;
+                TEST_ASSERT(in < ids.len && ids.data[in] == v);
+                in++;
+            }
+            TEST_ASSERT_EQUAL(in, ids.len);
+            edges += out;
+        }
+        TEST_ASSERT_EQUAL(edges, g->edges);
+
+        bsky_da_free(&ids);
+    }
+
+    static void graph_random(void)
+    {
+        enum bsky_error_code ec;
+        struct bsky_graph g = { 0 };
+        unsigned char (*adj)[GRAPH_NODES] = calloc(GRAPH_NODES,
+                                                   GRAPH_NODES);
+        uint64_t seed = 42;
+        char did[32];
+
+        for (int i = 0; i < GRAPH_NODES; ++i) {
+            snprintf(did, sizeof (did), "did:plc:%d", i);
+            TEST_ASSERT_EQUAL(i, bsky_graph_id(&g, bsky_mk_str(did)));
+        }
+
+        for (int round = 0; round < 6; ++round) {
+            for (int i = 0; i < 5000; ++i) {
+                seed = seed * 6364136223846793005ull + 1442695040888963407ull;
+
+                // ids far apart need long varints.
+                uint32_t u = (seed >> 20) % GRAPH_NODES;
+                uint32_t v = (seed >> 40) % GRAPH_NODES;
+                int unfollow = (seed >> 60) < 5;
+
+                if (unfollow) {
+                    bsky_graph_unfollow(&g, u, v);
+                } else {
+                    bsky_graph_follow(&g, u, v);
+                }
+                adj[u][v] = !unfollow;
+            }
+            TEST_ASSERT_EQUAL(bsky_ec_Ok, bsky_graph_merge(&g));
+            __graph_compare(&g, adj);
+
+            // rows of loaded file are replaced by the next merge.
+            if (round % 2) continue;
+            TEST_ASSERT_EQUAL(bsky_ec_Ok, bsky_graph_save(&g, __graph_path));
+            bsky_graph_free(&g);
+            TEST_ASSERT_EQUAL(bsky_ec_Ok,
+                              bsky_graph_load(&g, __graph_path, &ec));
+            TEST_ASSERT_EQUAL(GRAPH_NODES, g.nodes);
+            __graph_compare(&g, adj);
+        }
+
+        snprintf(did, sizeof (did), "did:plc:%d", GRAPH_NODES - 1);
+        TEST_ASSERT_EQUAL(GRAPH_NODES - 1,
+                          bsky_graph_find(&g, bsky_mk_str(did)));
+
+        bsky_graph_free(&g);
+        unlink(__graph_path);
+        free(adj);
+    }
+
+    static void graph_invalid(void)
+    {
+        enum bsky_error_code ec;
+        struct bsky_graph g = { 0 };
+        struct bsky_graph_header h;
+        int fd;
+
+        bsky_graph_id(&g, bsky_mk_str("did:plc:a"));
+        bsky_graph_id(&g, bsky_mk_str("did:plc:b"));
+        bsky_graph_follow(&g, 0, 1);
+        TEST_ASSERT_EQUAL(bsky_ec_Ok, bsky_graph_save(&g, __graph_path));
+        bsky_graph_free(&g);
+
+        fd = open(__graph_path, O_RDWR);
+        TEST_ASSERT_EQUAL(sizeof (h), read(fd, &h, sizeof (h)));
+
+        // offsets of rows are not monotone.
+        uint64_t bad = 100;
+        TEST_ASSERT_EQUAL(8, pwrite(fd, &bad, 8, h.out_off + 8));
+        TEST_ASSERT_EQUAL(bsky_ec_Graph_invalid,
+                          bsky_graph_load(&g, __graph_path, &ec));
+        TEST_ASSERT(g.map.start == NULL);
+
+        // duplicate DID.
+        bad = 0;
+        TEST_ASSERT_EQUAL(8, pwrite(fd, &bad, 8, h.out_off + 8));
+        TEST_ASSERT_EQUAL(9, pwrite(fd, "did:plc:a", 9, h.dids + 10));
+        TEST_ASSERT_EQUAL(bsky_ec_Graph_invalid,
+                          bsky_graph_load(&g, __graph_path, &ec));
+
+        TEST_ASSERT_EQUAL(0, ftruncate(fd, h.size - 1));
+        close(fd);
+        TEST_ASSERT_EQUAL(bsky_ec_Graph_invalid,
+                          bsky_graph_load(&g, __graph_path, &ec));
+
+        unlink(__graph_path);
+    }
+
+    void run_graph_tests(void)
+    {
+        RUN_TEST(graph_basic);
+        RUN_TEST(graph_random);
+        RUN_TEST(graph_invalid);
+    }
+
+#endif
+
+
+#endif // graph-tests_h_INCLUDED
@@ -0,0 +1,266 @@
+#ifndef jetstream_tests_h_INCLUDED
+#define jetstream_tests_h_INCLUDED
+
+
+void run_jetstream_tests(void);
+
+
+#ifdef IMPLEMENT_TESTS
+
+    #include "../bsky-api.h"
+    #include <unistd.h>
+
+    static struct bsky_view __jetstream_view(const char *text)
+    {
+        return (struct bsky_view) {
+            (void*) text, (void*) (text + strlen(text))
+        };
+    }
+
+    static void jetstream_cursor(void)
+    {
+        enum bsky_error_code ec;
+        const char *text =
+            "{ \"a\": -12, \"b\": {\"x\": [1, \"}\", {}]}, \"c\": \"q\\\"s\","
+            "  \"d\": true, \"e\": {} }";
+        struct bsky_json_cursor c = { text, text + strlen(text) };
+        struct bsky_str key, value;
+        int n = 0;
+
+        TEST_ASSERT_EQUAL(bsky_ec_Ok, bsky_json_cursor_object(&c, &ec));
+
+        while (bsky_json_cursor_field(&c, &key, &ec)) {
+            switch (n++) {
+            case 0:
+                TEST_ASSERT(bsky_json_key_is(key, "a"));
+                TEST_ASSERT_EQUAL(-12, bsky_json_cursor_int(&c, &ec));
+                break;
+            case 1:
+                value = bsky_json_cursor_skip(&c, &ec);
+                TEST_ASSERT_EQUAL(19, value.end - value.start);
+                TEST_ASSERT(memcmp(value.start,
+                                   "{\"x\": [1, \"}\", {}]}", 19) == 0);
+                break;
+            case 2:
+                TEST_ASSERT_EQUAL(bsky_ec_Ok,
+                                  bsky_json_cursor_str(&c, &value, &ec));
+                TEST_ASSERT_EQUAL(4, value.end - value.start);
+                break;
+            case 3:
+                TEST_ASSERT(bsky_json_key_is(bsky_json_cursor_skip(&c, &ec),
+                                             "true"));
+                break;
+            case 4: {
+                // nested empty object with the same cursor.
+                struct bsky_str inner;
+
+                TEST_ASSERT_EQUAL(bsky_ec_Ok, bsky_json_cursor_object(&c, &ec));
+                TEST_ASSERT(!bsky_json_cursor_field(&c, &inner, &ec));
+                TEST_ASSERT_EQUAL(bsky_ec_Ok, ec);
+            } break;
+            }
+            TEST_ASSERT_EQUAL(bsky_ec_Ok, ec);
+        }
+        TEST_ASSERT_EQUAL(bsky_ec_Ok, ec);
+        TEST_ASSERT_EQUAL(5, n);
+
+        // missing comma.
+        text = "{\"a\": 1 \"b\": 2}";
+        c = (struct bsky_json_cursor) { text, text + strlen(text) };
+        bsky_json_cursor_object(&c, &ec);
+        TEST_ASSERT(bsky_json_cursor_field(&c, &key, &ec));
+        bsky_json_cursor_skip(&c, &ec);
+        TEST_ASSERT(!bsky_json_cursor_field(&c, &key, &ec));
+        TEST_ASSERT_EQUAL(bsky_ec_Json_expect_CCB, ec);
+    }
+
+    static const char *__jetstream_events[] = {
+        "{\"did\":\"did:plc:alice\",\"time_us\":1725911162329308,"
+        "\"kind\":\"commit\",\"commit\":{\"rev\":\"3l3qo2vutsw2b\","
+        "\"operation\":\"create\",\"collection\":\"app.bsky.feed.post\","
+        "\"rkey\":\"3l3qo2vuowo2b\",\"record\":{\"$type\":\"app.bsky.feed.post\","
+        "\"text\":\"hi {there}\",\"createdAt\":\"2024-09-09T19:46:02.102Z\"},"
+        "\"cid\":\"bafyreidwaivazkwu67xztlmuobx35hs2lnfh3kolmgfmucldvhd3sgzcqi\"}}",
+
+        "{\"did\":\"did:plc:bob\",\"time_us\":1725911162329309,"
+        "\"kind\":\"commit\",\"commit\":{\"rev\":\"3l3qo2vutsw2c\","
+        "\"operation\":\"delete\",\"collection\":\"app.bsky.feed.like\","
+        "\"rkey\":\"3l3qo2vuowo2c\"}}",
+
+        "{\"did\":\"did:plc:alice\",\"time_us\":1725911162329310,"
+        "\"kind\":\"identity\",\"identity\":{\"did\":\"did:plc:alice\","
+        "\"handle\":\"alice.test\",\"seq\":1409752997,"
+        "\"time\":\"2024-09-05T06:11:04.870Z\"}}",
+
+        "{\"did\":\"did:plc:bob\",\"time_us\":1725911162329311,"
+        "\"kind\":\"account\",\"account\":{\"active\":false,"
+        "\"did\":\"did:plc:bob\",\"seq\":1409753013,\"status\":\"takendown\","
+        "\"time\":\"2024-09-05T06:11:04.870Z\"}}",
+    };
+
+    static struct {
+        int commits, identities, accounts;
+        struct bsky_jetstream_commit last;
+        int64_t seq;
+        int     active;
+    } __jetstream_seen;
+
+    static void __jetstream_on_commit(void *user,
+                                      const struct bsky_jetstream_commit *commit)
+    {
+        (void) user;
+        __jetstream_seen.commits++;
+        __jetstream_seen.last = *commit;
+    }
+
+    static void __jetstream_on_identity(void *user,
+                                        const struct bsky_jetstream_identity *i)
+    {
+        (void) user;
+        __jetstream_seen.identities++;
+        __jetstream_seen.seq = i->seq;
+        TEST_ASSERT(bsky_json_key_is(i->handle, "alice.test"));
+    }
+
+    static void __jetstream_on_account(void *user,
+                                       const struct bsky_jetstream_account *a)
+    {
+        (void) user;
+        __jetstream_seen.accounts++;
+        __jetstream_seen.active = a->active;
+        TEST_ASSERT(bsky_json_key_is(a->status, "takendown"));
+    }
+
+    static void jetstream_events(void)
+    {
+        struct bsky_jetstream js = {
+            .on_commit   = __jetstream_on_commit,
+            .on_identity = __jetstream_on_identity,
+            .on_account  = __jetstream_on_account,
+        };
+
+        memset(&__jetstream_seen, 0, sizeof (__jetstream_seen));
+
+        TEST_ASSERT_EQUAL(bsky_ec_Ok, bsky_jetstream_feed(&js,
+                          __jetstream_view(__jetstream_events[0]), 0));
+        TEST_ASSERT_EQUAL(1, __jetstream_seen.commits);
+        TEST_ASSERT_EQUAL(bsky_write_Create, __jetstream_seen.last.op);
+        TEST_ASSERT(bsky_json_key_is(__jetstream_seen.last.did,
+                                     "did:plc:alice"));
+        TEST_ASSERT(bsky_json_key_is(__jetstream_seen.last.collection,
+                                     "app.bsky.feed.post"));
+        TEST_ASSERT_EQUAL(1725911162329308, __jetstream_seen.last.time_us);
+        TEST_ASSERT_EQUAL('{', __jetstream_seen.last.record.start[0]);
+        TEST_ASSERT_EQUAL('}', __jetstream_seen.last.record.end[-1]);
+
+        TEST_ASSERT_EQUAL(bsky_ec_Ok, bsky_jetstream_feed(&js,
+                          __jetstream_view(__jetstream_events[1]), 0));
+        TEST_ASSERT_EQUAL(bsky_write_Delete, __jetstream_seen.last.op);
+        TEST_ASSERT(__jetstream_seen.last.record.start == NULL);
+
+        TEST_ASSERT_EQUAL(bsky_ec_Ok, bsky_jetstream_feed(&js,
+                          __jetstream_view(__jetstream_events[2]), 0));
+        TEST_ASSERT_EQUAL(1409752997, __jetstream_seen.seq);
+
+        __jetstream_seen.active = 1;
+        TEST_ASSERT_EQUAL(bsky_ec_Ok, bsky_jetstream_feed(&js,
+                          __jetstream_view(__jetstream_events[3]), 0));
+        TEST_ASSERT_EQUAL(0, __jetstream_seen.active);
+
+        TEST_ASSERT_EQUAL(bsky_ec_Jetstream_invalid, bsky_jetstream_feed(&js,
+                          __jetstream_view("{\"did\": 1}"), 0));
+        TEST_ASSERT_EQUAL(4, js.events);
+        TEST_ASSERT_EQUAL(1, js.invalid);
+
+        bsky_jetstream_free(&js);
+    }
+
+    // "compression" of tests: bytes are reversed.
+    static int __jetstream_unreverse(void *user, struct bsky_view in,
+                                     struct bsky_str_builder *out)
+    {
+        size_t len = (char*) in.end - (char*) in.start;
+
+        (void) user;
+        for (size_t i = 0; i < len; ++i) {
+            char ch = ((char*) in.end)[-1 - (ptrdiff_t) i];
+            if (bsky_da_push(out, ch) != bsky_ec_Ok) return 0;
+        }
+
+        return 1;
+    }
+
+    static void jetstream_filter_and_resume(void)
+    {
+        enum bsky_error_code   ec;
+        struct bsky_nsid_set   collections;
+        struct bsky_did_filter dids;
+        struct bsky_prefilter  pf = { .collections = &collections };
+        struct bsky_checkpoint cp;
+        struct bsky_jetstream  js = {
+            .on_commit  = __jetstream_on_commit,
+            .prefilter  = &pf,
+            .checkpoint = &cp,
+            .decompress = __jetstream_unreverse,
+        };
+        char reversed[1024];
+        size_t len = strlen(__jetstream_events[0]);
+
+        memset(&__jetstream_seen, 0, sizeof (__jetstream_seen));
+        unlink("/tmp/bsky-jetstream-test");
+
+        TEST_ASSERT_EQUAL(bsky_ec_Ok, bsky_nsid_set_build(&collections,
+                          (const char*[]) { "app.bsky.feed.post" }, 1));
+        TEST_ASSERT_EQUAL(bsky_ec_Ok, bsky_checkpoint_open(&cp,
+                          "/tmp/bsky-jetstream-test", 1, &ec));
+
+        for (size_t i = 0; i < len; ++i)
+            reversed[i] = __jetstream_events[0][len - 1 - i];
+
+        TEST_ASSERT_EQUAL(bsky_ec_Ok, bsky_jetstream_feed(&js,
+                          (struct bsky_view) { reversed, reversed + len }, 1));
+        TEST_ASSERT_EQUAL(1, __jetstream_seen.commits);
+
+        // replayed event and other collection are filtered.
+        TEST_ASSERT_EQUAL(bsky_ec_Ok, bsky_jetstream_feed(&js,
+                          __jetstream_view(__jetstream_events[0]), 0));
+        TEST_ASSERT_EQUAL(bsky_ec_Ok, bsky_jetstream_feed(&js,
+                          __jetstream_view(__jetstream_events[1]), 0));
+        TEST_ASSERT_EQUAL(1, __jetstream_seen.commits);
+        TEST_ASSERT_EQUAL(2, js.filtered);
+
+        TEST_ASSERT_EQUAL(1725911162329309, bsky_checkpoint_watermark(&cp));
+        TEST_ASSERT_EQUAL(bsky_ec_Ok, bsky_checkpoint_close(&cp));
+        TEST_ASSERT_EQUAL(bsky_ec_Ok, bsky_checkpoint_open(&cp,
+                          "/tmp/bsky-jetstream-test", 1, &ec));
+        TEST_ASSERT_EQUAL(1725911162329309, cp.resume);
+
+        // events of other repos move checkpoint, `did' goes first.
+        TEST_ASSERT_EQUAL(bsky_ec_Ok, bsky_did_filter_init(&dids, 1));
+        TEST_ASSERT_EQUAL(bsky_ec_Ok, bsky_did_filter_add(&dids,
+                          bsky_mk_str("did:plc:alice")));
+        pf.dids = &dids;
+
+        TEST_ASSERT_EQUAL(bsky_ec_Ok, bsky_jetstream_feed(&js,
+                          __jetstream_view(__jetstream_events[3]), 0));
+        TEST_ASSERT_EQUAL(3, js.filtered);
+        TEST_ASSERT_EQUAL(1725911162329311, bsky_checkpoint_watermark(&cp));
+
+        bsky_did_filter_free(&dids);
+        bsky_checkpoint_close(&cp);
+        bsky_nsid_set_free(&collections);
+        bsky_jetstream_free(&js);
+        unlink("/tmp/bsky-jetstream-test");
+    }
+
+    void run_jetstream_tests(void)
+    {
+        RUN_TEST(jetstream_cursor);
+        RUN_TEST(jetstream_events);
+        RUN_TEST(jetstream_filter_and_resume);
+    }
+
+#endif
+
+
+#endif // jetstream-tests_h_INCLUDED
@@ -0,0 +1,228 @@
+#ifndef label_tests_h_INCLUDED
+#define label_tests_h_INCLUDED
+
+
+void run_label_tests(void);
+
+
+#ifdef IMPLEMENT_TESTS
+
+    #include "../bsky-api.h"
+    #include <stdio.h>
+    #include <time.h>
+
+    static struct bsky_label __label(const char *src, const char *uri,
+                                     const char *val, int neg, int64_t exp)
+    {
+        return (struct bsky_label) {
+            bsky_mk_str((char*) src), bsky_mk_str((char*) uri),
+            bsky_mk_str((char*) val), neg, exp,
+        };
+    }
+
+    static void label_index(void)
+    {
+        struct bsky_label_index idx;
+        struct bsky_label l;
+        struct bsky_str post = bsky_mk_str("at://did:plc:a/app.bsky.feed.post/1");
+        int64_t now = time(NULL);
+
+        TEST_ASSERT_EQUAL(bsky_ec_Ok, bsky_label_index_init(&idx));
+
+        uint32_t mod   = bsky_label_id(&idx, bsky_mk_str("did:plc:mod"));
+        uint32_t other = bsky_label_id(&idx, bsky_mk_str("did:plc:other"));
+        uint32_t porn  = bsky_label_id(&idx, bsky_mk_str("porn"));
+        uint32_t spam  = bsky_label_id(&idx, bsky_mk_str("spam"));
+
+        TEST_ASSERT(mod && other && porn && spam);
+        TEST_ASSERT_EQUAL(mod, bsky_label_id(&idx, bsky_mk_str("did:plc:mod")));
+
+        l = __label("did:plc:mod", post.start, "porn", 0, 0);
+        TEST_ASSERT_EQUAL(bsky_ec_Ok, bsky_label_index_apply(&idx, &l));
+        l = __label("did:plc:mod", post.start, "spam", 0, now + 3600);
+        TEST_ASSERT_EQUAL(bsky_ec_Ok, bsky_label_index_apply(&idx, &l));
+
+        TEST_ASSERT(bsky_label_index_has(&idx, post, mod, porn));
+        TEST_ASSERT(bsky_label_index_has(&idx, post, 0, porn));
+        TEST_ASSERT(!bsky_label_index_has(&idx, post, other, porn));
+        TEST_ASSERT(!bsky_label_index_has(&idx,
+                    bsky_mk_str("at://did:plc:a/app.bsky.feed.post/2"), 0, porn));
+        TEST_ASSERT_EQUAL(2, idx.labels);
+
+        // negation of other labeler changes nothing.
+        l = __label("did:plc:other", post.start, "porn", 1, 0);
+        TEST_ASSERT_EQUAL(bsky_ec_Ok, bsky_label_index_apply(&idx, &l));
+        TEST_ASSERT(bsky_label_index_has(&idx, post, mod, porn));
+
+        l = __label("did:plc:mod", post.start, "porn", 1, 0);
+        TEST_ASSERT_EQUAL(bsky_ec_Ok, bsky_label_index_apply(&idx, &l));
+        TEST_ASSERT(!bsky_label_index_has(&idx, post, mod, porn));
+        TEST_ASSERT(bsky_label_index_has(&idx, post, mod, spam));
+
+        // already expired label is not added.
+        l = __label("did:plc:mod", "did:plc:b", "spam", 0, now - 1);
+        TEST_ASSERT_EQUAL(bsky_ec_Ok, bsky_label_index_apply(&idx, &l));
+        TEST_ASSERT(!bsky_label_index_has(&idx, bsky_mk_str("did:plc:b"),
+                                          mod, spam));
+        TEST_ASSERT_EQUAL(1, idx.subjects);
+
+        TEST_ASSERT_EQUAL(0, bsky_label_index_expire(&idx, now));
+        TEST_ASSERT_EQUAL(1, bsky_label_index_expire(&idx, now + 3600));
+        TEST_ASSERT(!bsky_label_index_has(&idx, post, mod, spam));
+        TEST_ASSERT_EQUAL(0, idx.subjects);
+        TEST_ASSERT_EQUAL(0, idx.labels);
+
+        l = __label("", post.start, "spam", 0, 0);
+        TEST_ASSERT_EQUAL(bsky_ec_Label_invalid,
+                          bsky_label_index_apply(&idx, &l));
+
+        bsky_label_index_free(&idx);
+    }
+
+    struct __label_reader {
+        struct bsky_label_index *idx;
+        uint32_t  mod, spam;
+        _Atomic int stop;
+        size_t    misses;
+    };
+
+    static void *__label_read(void *arg)
+    {
+        struct __label_reader *r = arg;
+
+        while (!atomic_load(&r->stop)) {
+            if (!bsky_label_index_has(r->idx, bsky_mk_str("did:plc:pinned"),
+                                      r->mod, r->spam)) {
+                r->misses++;
+            }
+        }
+
+        return NULL;
+    }
+
+    static void label_concurrent(void)
+    {
+        struct bsky_label_index idx;
+        struct __label_reader   r = { &idx };
+        struct bsky_label l;
+        pthread_t thread;
+        char uri[64];
+
+        TEST_ASSERT_EQUAL(bsky_ec_Ok, bsky_label_index_init(&idx));
+        r.mod  = bsky_label_id(&idx, bsky_mk_str("did:plc:mod"));
+        r.spam = bsky_label_id(&idx, bsky_mk_str("spam"));
+
+        l = __label("did:plc:mod", "did:plc:pinned", "spam", 0, 0);
+        TEST_ASSERT_EQUAL(bsky_ec_Ok, bsky_label_index_apply(&idx, &l));
+
+        TEST_ASSERT(pthread_create(&thread, NULL, __label_read, &r) == 0);
+
+        // growing table and churn of subjects while reader probes.
+        for (int i = 0; i < 3000; ++i) {
+            snprintf(uri, sizeof (uri), "did:plc:%d", i);
+            l = __label("did:plc:mod", uri, "spam", 0, 0);
+            TEST_ASSERT_EQUAL(bsky_ec_Ok, bsky_label_index_apply(&idx, &l));
+
+            if (i % 2 == 0) continue;
+            snprintf(uri, sizeof (uri), "did:plc:%d", i - 1);
+            l = __label("did:plc:mod", uri, "spam", 1, 0);
+            TEST_ASSERT_EQUAL(bsky_ec_Ok, bsky_label_index_apply(&idx, &l));
+        }
+
+        atomic_store(&r.stop, 1);
+        pthread_join(thread, NULL);
+
+        TEST_ASSERT_EQUAL(0, r.misses);
+        TEST_ASSERT_EQUAL(1501, idx.subjects);
+        TEST_ASSERT(bsky_label_index_has(&idx, bsky_mk_str("did:plc:2999"),
+                                         r.mod, r.spam));
+        TEST_ASSERT(!bsky_label_index_has(&idx, bsky_mk_str("did:plc:2998"),
+                                          r.mod, r.spam));
+
+        bsky_label_index_free(&idx);
+    }
+
+    static void __label_push(struct bsky_str_builder *sb, const char *uri,
+                             int neg, const char *exp)
+    {
+        // canonical order of keys.
+        bsky_cbor_push_map(sb, 5 + (neg >= 0) + (exp != NULL));
+        bsky_cbor_push_str(sb, bsky_mk_str("cts"));
+        bsky_cbor_push_str(sb, bsky_mk_str("2024-05-01T00:00:00.000Z"));
+        if (exp) {
+            bsky_cbor_push_str(sb, bsky_mk_str("exp"));
+            bsky_cbor_push_str(sb, bsky_mk_str((char*) exp));
+        }
+        if (neg >= 0) {
+            bsky_cbor_push_str(sb, bsky_mk_str("neg"));
+            __bsky_da_append(sb, neg ? "\xf5" : "\xf4", 1, 1);
+        }
+        bsky_cbor_push_str(sb, bsky_mk_str("src"));
+        bsky_cbor_push_str(sb, bsky_mk_str("did:plc:mod"));
+        bsky_cbor_push_str(sb, bsky_mk_str("uri"));
+        bsky_cbor_push_str(sb, bsky_mk_str((char*) uri));
+        bsky_cbor_push_str(sb, bsky_mk_str("val"));
+        bsky_cbor_push_str(sb, bsky_mk_str("!hide"));
+        bsky_cbor_push_str(sb, bsky_mk_str("ver"));
+        bsky_cbor_push_int(sb, 1);
+    }
+
+    static void label_stream(void)
+    {
+        struct bsky_label_index  idx;
+        struct bsky_label_stream ls = { .index = &idx };
+        struct bsky_str_builder  sb = { 0 };
+        uint32_t mod, hide;
+
+        TEST_ASSERT_EQUAL(bsky_ec_Ok, bsky_label_index_init(&idx));
+
+        bsky_cbor_push_map(&sb, 2);
+        bsky_cbor_push_str(&sb, bsky_mk_str("t"));
+        bsky_cbor_push_str(&sb, bsky_mk_str("#labels"));
+        bsky_cbor_push_str(&sb, bsky_mk_str("op"));
+        bsky_cbor_push_int(&sb, 1);
+
+        bsky_cbor_push_map(&sb, 2);
+        bsky_cbor_push_str(&sb, bsky_mk_str("seq"));
+        bsky_cbor_push_int(&sb, 42);
+        bsky_cbor_push_str(&sb, bsky_mk_str("labels"));
+        bsky_cbor_push_arr(&sb, 4);
+        __label_push(&sb, "did:plc:a", -1, NULL);
+        __label_push(&sb, "did:plc:b", 0, "2999-01-01T00:00:00Z");
+        __label_push(&sb, "did:plc:c", 0, "2001-01-01T00:00:00+02:00");
+        __label_push(&sb, "did:plc:a", 1, NULL);
+
+        TEST_ASSERT_EQUAL(bsky_ec_Ok, bsky_label_stream_feed(&ls,
+                          (struct bsky_view) { sb.data, sb.data + sb.len }));
+        TEST_ASSERT_EQUAL(42, ls.seq);
+        TEST_ASSERT_EQUAL(4, ls.labels);
+
+        mod  = bsky_label_id(&idx, bsky_mk_str("did:plc:mod"));
+        hide = bsky_label_id(&idx, bsky_mk_str("!hide"));
+
+        TEST_ASSERT(!bsky_label_index_has(&idx, bsky_mk_str("did:plc:a"),
+                                          mod, hide));
+        TEST_ASSERT(bsky_label_index_has(&idx, bsky_mk_str("did:plc:b"),
+                                         mod, hide));
+        TEST_ASSERT(!bsky_label_index_has(&idx, bsky_mk_str("did:plc:c"),
+                                          mod, hide));
+
+        // 2999-01-01 (leap days of 1970..2998 included).
+        TEST_ASSERT_EQUAL(32472144000ll, idx.next_exp);
+
+        bsky_label_stream_free(&ls);
+        bsky_label_index_free(&idx);
+        bsky_da_free(&sb);
+    }
+
+    void run_label_tests(void)
+    {
+        RUN_TEST(label_index);
+        RUN_TEST(label_concurrent);
+        RUN_TEST(label_stream);
+    }
+
+#endif
+
+
+#endif // label-tests_h_INCLUDED
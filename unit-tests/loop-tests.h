@@ -0,0 +1,84 @@
+#ifndef loop_tests_h_INCLUDED
+#define loop_tests_h_INCLUDED
+
+
+void run_loop_tests(void);
+
+
+#ifdef IMPLEMENT_TESTS
+
+    #include "../bsky-api.h"
+    #include <unistd.h>
+
+    static char   __loop_order[8];
+    static size_t __loop_order_len;
+
+    static void __loop_on_timer(struct bsky_loop *loop, void *user)
+    {
+        __loop_order[__loop_order_len++] = *(char*) user;
+        if (__loop_order_len == 3) bsky_loop_stop(loop);
+    }
+
+    static void loop_timers(void)
+    {
+        struct bsky_loop loop;
+
+        TEST_ASSERT_EQUAL(bsky_ec_Ok, bsky_loop_init(&loop));
+
+        __loop_order_len = 0;
+        bsky_loop_timer(&loop, 30, __loop_on_timer, "c");
+        bsky_loop_timer(&loop, 10, __loop_on_timer, "a");
+        bsky_loop_timer(&loop, 20, __loop_on_timer, "b");
+
+        TEST_ASSERT_EQUAL(bsky_ec_Ok, bsky_loop_run(&loop));
+        TEST_ASSERT_EQUAL(3, __loop_order_len);
+        TEST_ASSERT(memcmp(__loop_order, "abc", 3) == 0);
+
+        bsky_loop_free(&loop);
+    }
+
+    static void __loop_on_read(struct bsky_loop *loop, int fd, int events,
+                               void *user)
+    {
+        char buf[16];
+
+        TEST_ASSERT(events & bsky_loop_Read);
+        TEST_ASSERT_EQUAL(2, read(fd, buf, sizeof (buf)));
+
+        *(int*) user = 1;
+        bsky_loop_stop(loop);
+    }
+
+    static void loop_read(void)
+    {
+        struct bsky_loop loop;
+        int fds[2], called = 0;
+
+        TEST_ASSERT(pipe(fds) == 0);
+        TEST_ASSERT_EQUAL(bsky_ec_Ok, bsky_loop_init(&loop));
+        TEST_ASSERT_EQUAL(bsky_ec_Ok, bsky_loop_add(&loop, fds[0],
+                          bsky_loop_Read, __loop_on_read, &called));
+
+        TEST_ASSERT_EQUAL(bsky_ec_Ok, bsky_loop_run_once(&loop, 0));
+        TEST_ASSERT(!called);
+
+        TEST_ASSERT_EQUAL(2, write(fds[1], "hi", 2));
+        TEST_ASSERT_EQUAL(bsky_ec_Ok, bsky_loop_run(&loop));
+        TEST_ASSERT(called);
+
+        bsky_loop_del(&loop, fds[0]);
+        bsky_loop_free(&loop);
+        close(fds[0]);
+        close(fds[1]);
+    }
+
+    void run_loop_tests(void)
+    {
+        RUN_TEST(loop_timers);
+        RUN_TEST(loop_read);
+    }
+
+#endif
+
+
+#endif // loop-tests_h_INCLUDED
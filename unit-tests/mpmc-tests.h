@@ -0,0 +1,132 @@
+#ifndef mpmc_tests_h_INCLUDED
+#define mpmc_tests_h_INCLUDED
+
+
+void run_mpmc_tests(void);
+
+
+#ifdef IMPLEMENT_TESTS
+
+    #include "../bsky-api.h"
+
+    static void mpmc_ring(void)
+    {
+        struct bsky_mpmc q;
+        void *items[8];
+
+        TEST_ASSERT_EQUAL(bsky_ec_Ok, bsky_mpmc_init(&q, 3));
+        TEST_ASSERT_EQUAL(3, q.mask);
+        TEST_ASSERT(bsky_mpmc_pop(&q) == NULL);
+
+        for (uintptr_t i = 1; i <= 4; ++i)
+            TEST_ASSERT(bsky_mpmc_push(&q, (void*) i));
+        TEST_ASSERT(!bsky_mpmc_push(&q, (void*) 5));
+        TEST_ASSERT_EQUAL(4, bsky_mpmc_depth(&q));
+
+        TEST_ASSERT_EQUAL(1, (uintptr_t) bsky_mpmc_pop(&q));
+        TEST_ASSERT_EQUAL(2, (uintptr_t) bsky_mpmc_pop(&q));
+
+        // batch wraps around the end and stops at full.
+        for (uintptr_t i = 0; i < 8; ++i) items[i] = (void*) (i + 5);
+        TEST_ASSERT_EQUAL(2, bsky_mpmc_push_n(&q, items, 8));
+
+        TEST_ASSERT_EQUAL(4, bsky_mpmc_pop_n(&q, items, 8));
+        TEST_ASSERT_EQUAL(3, (uintptr_t) items[0]);
+        TEST_ASSERT_EQUAL(4, (uintptr_t) items[1]);
+        TEST_ASSERT_EQUAL(5, (uintptr_t) items[2]);
+        TEST_ASSERT_EQUAL(6, (uintptr_t) items[3]);
+        TEST_ASSERT_EQUAL(0, bsky_mpmc_pop_n(&q, items, 8));
+        TEST_ASSERT_EQUAL(0, bsky_mpmc_depth(&q));
+
+        bsky_mpmc_close(&q);
+        TEST_ASSERT(bsky_mpmc_pop_wait(&q) == NULL);
+
+        bsky_mpmc_free(&q);
+    }
+
+    #define MPMC_ITEMS 20000
+
+    struct __mpmc_shared {
+        struct bsky_mpmc q;
+        _Atomic int      next;
+        _Atomic uint64_t sum;
+        _Atomic int      seen[MPMC_ITEMS + 1];
+    };
+
+    static void *__mpmc_produce(void *arg)
+    {
+        struct __mpmc_shared *s = arg;
+        void *batch[7];
+        int i;
+
+        while ((i = atomic_fetch_add(&s->next, 7)) < MPMC_ITEMS) {
+            size_t n = 0, pushed = 0;
+
+            for (int j = i; j < i + 7 && j < MPMC_ITEMS; ++j)
+                batch[n++] = (void*) (uintptr_t) (j + 1);
+
+            // odd batches one by one with waiting.
+            if (i / 7 % 2) {
+                for (size_t j = 0; j < n; ++j)
+                    TEST_ASSERT(bsky_mpmc_push_wait(&s->q, batch[j]));
+                continue;
+            }
+            while (pushed < n) {
+                pushed += bsky_mpmc_push_n(&s->q, batch + pushed, n - pushed);
+                if (pushed < n) sched_yield();
+            }
+        }
+
+        return NULL;
+    }
+
+    static void *__mpmc_consume(void *arg)
+    {
+        struct __mpmc_shared *s = arg;
+        void *item;
+
+        while ((item = bsky_mpmc_pop_wait(&s->q)) != NULL) {
+            atomic_fetch_add(&s->seen[(uintptr_t) item], 1);
+            atomic_fetch_add(&s->sum, (uintptr_t) item);
+        }
+
+        return NULL;
+    }
+
+    static void mpmc_threads(void)
+    {
+        struct __mpmc_shared *s = calloc(1, sizeof (*s));
+        pthread_t producers[3], consumers[3];
+
+        // small ring, so both sides sleep.
+        TEST_ASSERT_EQUAL(bsky_ec_Ok, bsky_mpmc_init(&s->q, 16));
+
+        for (int i = 0; i < 3; ++i) {
+            pthread_create(&consumers[i], NULL, __mpmc_consume, s);
+            pthread_create(&producers[i], NULL, __mpmc_produce, s);
+        }
+        for (int i = 0; i < 3; ++i) pthread_join(producers[i], NULL);
+
+        bsky_mpmc_close(&s->q);
+        for (int i = 0; i < 3; ++i) pthread_join(consumers[i], NULL);
+
+        TEST_ASSERT_EQUAL((uint64_t) MPMC_ITEMS * (MPMC_ITEMS + 1) / 2,
+                          s->sum);
+        for (int i = 1; i <= MPMC_ITEMS; ++i)
+            TEST_ASSERT_EQUAL(1, s->seen[i]);
+        TEST_ASSERT_EQUAL(0, bsky_mpmc_depth(&s->q));
+
+        bsky_mpmc_free(&s->q);
+        free(s);
+    }
+
+    void run_mpmc_tests(void)
+    {
+        RUN_TEST(mpmc_ring);
+        RUN_TEST(mpmc_threads);
+    }
+
+#endif
+
+
+#endif // mpmc-tests_h_INCLUDED
@@ -0,0 +1,279 @@
+#ifndef mst_tests_h_INCLUDED
+#define mst_tests_h_INCLUDED
+
+
+void run_mst_tests(void);
+
+
+#ifdef IMPLEMENT_TESTS
+
+    #include "../bsky-api.h"
+
+    struct __mst_store {
+        unsigned char           cid[8][36];
+        struct bsky_str_builder block[8];
+        size_t len;
+    };
+
+    static struct bsky_view __mst_cid(struct __mst_store *store,
+                                      struct bsky_str_builder block)
+    {
+        unsigned char *cid = store->cid[store->len];
+
+        memcpy(cid, "\x01\x71\x12\x20", 4);
+        bsky_sha256(block.data, block.len, cid + 4);
+        store->block[store->len++] = block;
+
+        return (struct bsky_view) { cid, cid + 36 };
+    }
+
+    // record CID is fake, the last byte tells the version.
+    static struct bsky_view __mst_value(unsigned char buf[36], int version)
+    {
+        memset(buf, 0, 36);
+        memcpy(buf, "\x01\x71\x12\x20", 4);
+        buf[35] = version;
+
+        return (struct bsky_view) { buf, buf + 36 };
+    }
+
+    static struct bsky_view __mst_node(struct __mst_store *store,
+                                       struct bsky_view left,
+                                       const char **keys,
+                                       const struct bsky_view *values,
+                                       const struct bsky_view *rights,
+                                       size_t n)
+    {
+        struct bsky_str_builder sb = { 0 };
+
+        bsky_cbor_push_map(&sb, 2);
+        bsky_cbor_push_str(&sb, bsky_mk_str("e"));
+        bsky_cbor_push_arr(&sb, n);
+
+        for (size_t i = 0; i < n; ++i) {
+            size_t prefix = 0;
+
+            while (i > 0 && keys[i][prefix] &&
+                   keys[i][prefix] == keys[i-1][prefix]) {
+                prefix++;
+            }
+
+            bsky_cbor_push_map(&sb, 4);
+            bsky_cbor_push_str(&sb, bsky_mk_str("k"));
+            bsky_cbor_push_bytes(&sb, (struct bsky_view) {
+                (void*) (keys[i] + prefix), (void*) (keys[i] + strlen(keys[i]))
+            });
+            bsky_cbor_push_str(&sb, bsky_mk_str("p"));
+            bsky_cbor_push_int(&sb, prefix);
+            bsky_cbor_push_str(&sb, bsky_mk_str("t"));
+            if (rights && rights[i].start) bsky_cbor_push_link(&sb, rights[i]);
+            else                           bsky_cbor_push_null(&sb);
+            bsky_cbor_push_str(&sb, bsky_mk_str("v"));
+            bsky_cbor_push_link(&sb, values[i]);
+        }
+
+        bsky_cbor_push_str(&sb, bsky_mk_str("l"));
+        if (left.start) bsky_cbor_push_link(&sb, left);
+        else            bsky_cbor_push_null(&sb);
+
+        return __mst_cid(store, sb);
+    }
+
+    static int __mst_fetch(void *user, struct bsky_view cid,
+                           struct bsky_view *block)
+    {
+        struct __mst_store *store = user;
+
+        for (size_t i = 0; i < store->len; ++i) {
+            if (memcmp(store->cid[i], cid.start, 36) != 0) continue;
+
+            *block = (struct bsky_view) {
+                store->block[i].data, store->block[i].data + store->block[i].len
+            };
+            return 1;
+        }
+
+        return 0;
+    }
+
+    static void __mst_free(struct __mst_store *store)
+    {
+        for (size_t i = 0; i < store->len; ++i)
+            bsky_da_free(&store->block[i]);
+    }
+
+    /*
+     * Revision 1:          root [b/5]
+     *                     /          \
+     *          [a/1, a/2]              [c/1, c/2]
+     *
+     * Revision 2 changes c/2 and adds c/5.
+     */
+    static unsigned char __mst_values[6][36];
+    static struct bsky_view __mst_roots[2];
+
+    static void __mst_build(struct __mst_store *store)
+    {
+        struct bsky_view v1 = __mst_value(__mst_values[0], 1);
+        struct bsky_view v2 = __mst_value(__mst_values[1], 2);
+        struct bsky_view none = { 0 };
+
+        struct bsky_view n0 = __mst_node(store, none,
+            (const char*[]) { "a/1", "a/2" },
+            (struct bsky_view[]) { v1, v1 }, NULL, 2);
+
+        struct bsky_view n1 = __mst_node(store, none,
+            (const char*[]) { "c/1", "c/2" },
+            (struct bsky_view[]) { v1, v1 }, NULL, 2);
+
+        struct bsky_view n1_new = __mst_node(store, none,
+            (const char*[]) { "c/1", "c/2", "c/5" },
+            (struct bsky_view[]) { v1, v2, v1 }, NULL, 3);
+
+        __mst_roots[0] = __mst_node(store, n0, (const char*[]) { "b/5" },
+            (struct bsky_view[]) { v1 }, (struct bsky_view[]) { n1 }, 1);
+
+        __mst_roots[1] = __mst_node(store, n0, (const char*[]) { "b/5" },
+            (struct bsky_view[]) { v1 }, (struct bsky_view[]) { n1_new }, 1);
+    }
+
+    static void mst_get_and_iterate(void)
+    {
+        enum bsky_error_code ec;
+        struct __mst_store store = { 0 };
+        struct bsky_mst      mst;
+        struct bsky_mst_iter it;
+        struct bsky_str  key;
+        struct bsky_view value;
+        const char *expected[] = { "a/1", "a/2", "b/5", "c/1", "c/2" };
+        size_t n = 0;
+
+        __mst_build(&store);
+        bsky_mst_init(&mst, __mst_roots[0], __mst_fetch, &store);
+
+        TEST_ASSERT(bsky_mst_get(&mst, bsky_mk_str("c/2"), &value, &ec));
+        TEST_ASSERT_EQUAL(1, ((unsigned char*) value.start)[35]);
+        TEST_ASSERT(!bsky_mst_get(&mst, bsky_mk_str("c/3"), &value, &ec));
+        TEST_ASSERT_EQUAL(bsky_ec_Ok, ec);
+
+        // the left subtree was never on the path.
+        TEST_ASSERT_EQUAL(2, mst.loaded);
+
+        bsky_mst_iter_init(&it, &mst);
+        while (bsky_mst_next(&it, &key, &value, &ec)) {
+            TEST_ASSERT(n < 5);
+            TEST_ASSERT_EQUAL(3, key.end - key.start);
+            TEST_ASSERT(memcmp(key.start, expected[n++], 3) == 0);
+        }
+        TEST_ASSERT_EQUAL(bsky_ec_Ok, ec);
+        TEST_ASSERT_EQUAL(5, n);
+        TEST_ASSERT_EQUAL(3, mst.loaded);
+
+        bsky_mst_iter_free(&it);
+        bsky_mst_free(&mst);
+        __mst_free(&store);
+    }
+
+    static struct {
+        enum bsky_write_op op[4];
+        char key[4][4];
+        size_t len;
+    } __mst_changes;
+
+    static void __mst_on_change(void *user, enum bsky_write_op op,
+                                struct bsky_str key, struct bsky_view old,
+                                struct bsky_view new)
+    {
+        (void) user; (void) old; (void) new;
+
+        TEST_ASSERT(__mst_changes.len < 4);
+        __mst_changes.op[__mst_changes.len] = op;
+        memcpy(__mst_changes.key[__mst_changes.len++], key.start, 3);
+    }
+
+    static void mst_diff(void)
+    {
+        struct __mst_store store = { 0 };
+        struct bsky_mst from, to;
+
+        __mst_build(&store);
+        bsky_mst_init(&from, __mst_roots[0], __mst_fetch, &store);
+        bsky_mst_init(&to,   __mst_roots[1], __mst_fetch, &store);
+
+        __mst_changes.len = 0;
+        TEST_ASSERT_EQUAL(bsky_ec_Ok,
+                          bsky_mst_diff(&from, &to, __mst_on_change, NULL));
+
+        TEST_ASSERT_EQUAL(2, __mst_changes.len);
+        TEST_ASSERT_EQUAL(bsky_write_Update, __mst_changes.op[0]);
+        TEST_ASSERT(memcmp(__mst_changes.key[0], "c/2", 3) == 0);
+        TEST_ASSERT_EQUAL(bsky_write_Create, __mst_changes.op[1]);
+        TEST_ASSERT(memcmp(__mst_changes.key[1], "c/5", 3) == 0);
+
+        // shared left subtree is skipped.
+        TEST_ASSERT_EQUAL(2, from.loaded);
+        TEST_ASSERT_EQUAL(2, to.loaded);
+
+        bsky_mst_free(&from);
+        bsky_mst_free(&to);
+        __mst_free(&store);
+    }
+
+    static void mst_car(void)
+    {
+        enum bsky_error_code ec;
+        struct __mst_store store = { 0 };
+        struct bsky_str_builder commit = { 0 }, data = { 0 };
+        struct bsky_car_reader  car;
+        struct bsky_mst  mst;
+        struct bsky_view value;
+
+        __mst_build(&store);
+
+        bsky_cbor_push_map(&commit, 1);
+        bsky_cbor_push_str(&commit, bsky_mk_str("data"));
+        bsky_cbor_push_link(&commit, __mst_roots[0]);
+
+        struct bsky_view root = __mst_cid(&store, commit);
+        bsky_car_push_header(&data, &root, 1);
+        for (size_t i = 0; i < store.len; ++i) {
+            bsky_car_push_block(&data,
+                (struct bsky_view) { store.cid[i], store.cid[i] + 36 },
+                (struct bsky_view) { store.block[i].data,
+                                     store.block[i].data + store.block[i].len });
+        }
+
+        TEST_ASSERT_EQUAL(bsky_ec_Ok, bsky_car_open_mem(&car,
+                          (struct bsky_view) { data.data, data.data + data.len },
+                          &ec));
+        TEST_ASSERT_EQUAL(bsky_ec_Ok, bsky_car_build_index(&car));
+        TEST_ASSERT_EQUAL(bsky_ec_Ok, bsky_mst_init_car(&mst, &car, &ec));
+        TEST_ASSERT(bsky_mst_get(&mst, bsky_mk_str("a/2"), &value, &ec));
+
+        // broken node is rejected: "a/2" becomes "a/0" out of order.
+        for (size_t i = 0; i + 4 <= store.block[0].len; ++i) {
+            if (memcmp(store.block[0].data + i, "\x61k\x41\x32", 4) == 0)
+                store.block[0].data[i + 3] = '0';
+        }
+        bsky_mst_free(&mst);
+        bsky_mst_init(&mst, __mst_roots[0], __mst_fetch, &store);
+        TEST_ASSERT(!bsky_mst_get(&mst, bsky_mk_str("a/2"), &value, &ec));
+        TEST_ASSERT_EQUAL(bsky_ec_Mst_invalid, ec);
+
+        bsky_mst_free(&mst);
+        bsky_car_free(&car);
+        bsky_da_free(&data);
+        __mst_free(&store);
+    }
+
+    void run_mst_tests(void)
+    {
+        RUN_TEST(mst_get_and_iterate);
+        RUN_TEST(mst_diff);
+        RUN_TEST(mst_car);
+    }
+
+#endif
+
+
+#endif // mst-tests_h_INCLUDED
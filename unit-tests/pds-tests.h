@@ -0,0 +1,209 @@
+#ifndef pds_tests_h_INCLUDED
+#define pds_tests_h_INCLUDED
+
+
+void run_pds_tests(void);
+
+
+#ifdef IMPLEMENT_TESTS
+
+    #include "../bsky-api.h"
+
+    static void pds_str_map(void)
+    {
+        struct bsky_str_map map = { 0 };
+        struct bsky_str_builder sb = { 0 };
+
+        for (size_t i = 0; i < 1000; ++i) {
+            bsky_sb_push_fmt(&sb, "did:plc:%zu", i);
+            TEST_ASSERT_EQUAL(bsky_ec_Ok,
+                              bsky_str_map_set(&map, bsky_sb_build_tmp(&sb), i));
+        }
+        TEST_ASSERT_EQUAL(1000, map.len);
+
+        for (size_t i = 0; i < 1000; ++i) {
+            bsky_sb_push_fmt(&sb, "did:plc:%zu", i);
+            size_t *v = bsky_str_map_get(&map, bsky_sb_build_tmp(&sb));
+            TEST_ASSERT(v != NULL && *v == i);
+        }
+
+        TEST_ASSERT(bsky_str_map_get(&map, bsky_mk_str("did:plc:")) == NULL);
+        TEST_ASSERT(bsky_str_map_get(&map, bsky_mk_str("did:plc:10000")) == NULL);
+
+        // odd keys are removed, even keys stay reachable.
+        for (size_t i = 1; i < 1000; i += 2) {
+            bsky_sb_push_fmt(&sb, "did:plc:%zu", i);
+            TEST_ASSERT(bsky_str_map_del(&map, bsky_sb_build_tmp(&sb)));
+        }
+        TEST_ASSERT_EQUAL(500, map.len);
+        TEST_ASSERT(!bsky_str_map_del(&map, bsky_mk_str("did:plc:1")));
+
+        for (size_t i = 0; i < 1000; ++i) {
+            bsky_sb_push_fmt(&sb, "did:plc:%zu", i);
+            size_t *v = bsky_str_map_get(&map, bsky_sb_build_tmp(&sb));
+            TEST_ASSERT(i % 2 ? v == NULL : v != NULL && *v == i);
+        }
+
+        bsky_str_map_free(&map);
+    }
+
+    static void pds_parse_url(void)
+    {
+        enum bsky_error_code ec;
+        struct bsky_url url;
+
+        url = bsky_parse_url(bsky_mk_str("https://pds.example.com/xrpc"), &ec);
+        TEST_ASSERT_EQUAL(bsky_ec_Ok, ec);
+        TEST_ASSERT_EQUAL(5,  bsky_str_len(url.scheme));
+        TEST_ASSERT_EQUAL(15, bsky_str_len(url.host));
+        TEST_ASSERT_EQUAL(0,  bsky_str_len(url.port));
+        TEST_ASSERT_EQUAL_STRING("/xrpc", url.path.start);
+        TEST_ASSERT_EQUAL_STRING("443", bsky_url_port(url).start);
+
+        url = bsky_parse_url(bsky_mk_str("http://localhost:2583"), &ec);
+        TEST_ASSERT_EQUAL(bsky_ec_Ok, ec);
+        TEST_ASSERT_EQUAL_STRING("2583", bsky_url_port(url).start);
+        TEST_ASSERT_EQUAL(0, bsky_str_len(url.path));
+
+        bsky_parse_url(bsky_mk_str("pds.example.com"), &ec);
+        TEST_ASSERT_EQUAL(bsky_ec_Url_invalid, ec);
+
+        bsky_parse_url(bsky_mk_str("http://host:port"), &ec);
+        TEST_ASSERT_EQUAL(bsky_ec_Url_invalid, ec);
+    }
+
+    static void pds_route_did_doc(void)
+    {
+        enum bsky_error_code ec;
+        struct bsky_pds_router router = { 0 };
+
+        struct bsky_str str = bsky_mk_str(
+            "{\"id\":\"did:plc:abc\",\"service\":[{"
+                "\"id\":\"#atproto_pds\","
+                "\"type\":\"AtprotoPersonalDataServer\","
+                "\"serviceEndpoint\":\"http://localhost:2583/\"}]}");
+        struct bsky_json doc = bsky_parse_json(&str, &ec);
+        TEST_ASSERT_EQUAL(bsky_ec_Ok, ec);
+
+        TEST_ASSERT_EQUAL(bsky_ec_Ok, bsky_pds_router_add_doc(&router, doc));
+        TEST_ASSERT_EQUAL(bsky_ec_Ok, bsky_pds_router_set(&router,
+                                bsky_mk_str("did:plc:xyz"),
+                                bsky_mk_str("http://localhost:2583")));
+
+        struct bsky_pds_route *abc, *xyz;
+        abc = bsky_pds_router_lookup(&router, bsky_mk_str("did:plc:abc"));
+        xyz = bsky_pds_router_lookup(&router, bsky_mk_str("did:plc:xyz"));
+        TEST_ASSERT(abc != NULL && abc == xyz);
+        TEST_ASSERT_EQUAL_STRING("http://localhost:2583", abc->endpoint);
+        TEST_ASSERT_EQUAL(1, router.pool.len);
+
+        TEST_ASSERT(bsky_xrpc_is_pds_scoped(
+                        bsky_mk_str("com.atproto.sync.getRepo")));
+        TEST_ASSERT(!bsky_xrpc_is_pds_scoped(
+                        bsky_mk_str("app.bsky.feed.getTimeline")));
+
+        bsky_pds_router_route(&router, bsky_mk_str("did:plc:none"),
+                              bsky_mk_str("com.atproto.sync.getRepo"), &ec);
+        TEST_ASSERT_EQUAL(bsky_ec_Pds_unknown_did, ec);
+
+        bsky_pds_router_free(&router);
+    }
+
+    // Listening socket on loopback, port is written to `port'.
+    static int __pds_listen(char port[8])
+    {
+        struct sockaddr_in addr = { .sin_family = AF_INET };
+        socklen_t len = sizeof (addr);
+        int fd = socket(AF_INET, SOCK_STREAM, 0);
+
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        TEST_ASSERT(fd >= 0);
+        TEST_ASSERT_EQUAL(0, bind(fd, (struct sockaddr*) &addr, len));
+        TEST_ASSERT_EQUAL(0, listen(fd, 16));
+        TEST_ASSERT_EQUAL(0, getsockname(fd, (struct sockaddr*) &addr, &len));
+        snprintf(port, 8, "%d", ntohs(addr.sin_port));
+
+        return fd;
+    }
+
+    static void pds_warmup(void)
+    {
+        enum bsky_error_code ec;
+        struct bsky_conn_pool pool = { 0 };
+        struct bsky_warmup_stats stats;
+        struct bsky_conn_host *h;
+        char port[8], dead_port[8];
+        int lfd = __pds_listen(port), fd;
+        size_t live, dead;
+
+        // nothing listens on port of closed socket.
+        close(__pds_listen(dead_port));
+
+        live = bsky_conn_pool_host(&pool, bsky_mk_str("127.0.0.1"),
+                                   bsky_mk_str(port), &ec);
+        TEST_ASSERT_EQUAL(bsky_ec_Ok, ec);
+        dead = bsky_conn_pool_host(&pool, bsky_mk_str("127.0.0.1"),
+                                   bsky_mk_str(dead_port), &ec);
+        TEST_ASSERT_EQUAL(bsky_ec_Ok, ec);
+
+        TEST_ASSERT_EQUAL(bsky_ec_Ok,
+                          bsky_conn_pool_warmup(&pool, 3, 2000, &stats));
+        TEST_ASSERT_EQUAL(3, stats.ready);
+        TEST_ASSERT_EQUAL(3, stats.failed);
+        TEST_ASSERT(stats.first_ready_ns > 0);
+        TEST_ASSERT(stats.first_ready_ns <= stats.all_ready_ns);
+
+        h = &pool.data[live];
+        TEST_ASSERT_EQUAL(3, h->idle.len);
+        TEST_ASSERT_EQUAL(3, h->connects);
+        TEST_ASSERT_EQUAL(stats.first_ready_ns, h->first_ready_ns);
+        TEST_ASSERT(h->addr_len != 0);
+        TEST_ASSERT_EQUAL(0, pool.data[dead].idle.len);
+
+        // idle sockets are used first, the warmest one on top.
+        fd = bsky_conn_pool_get(&pool, live, &ec);
+        TEST_ASSERT_EQUAL(bsky_ec_Ok, ec);
+        TEST_ASSERT_EQUAL(h->idle.data[2], fd);
+        TEST_ASSERT_EQUAL(1, h->reuses);
+        bsky_conn_pool_put(&pool, live, fd, 1);
+
+        // live host is warm, only dead one is tried again.
+        TEST_ASSERT_EQUAL(bsky_ec_Net_connect,
+                          bsky_conn_pool_warmup(&pool, 3, 2000, &stats));
+        TEST_ASSERT_EQUAL(0, stats.ready);
+        TEST_ASSERT_EQUAL(3, stats.failed);
+        TEST_ASSERT_EQUAL(3, h->idle.len);
+
+        // stale cached address is resolved again on connect failure.
+        for (size_t i = 0; i < h->idle.len; ++i) close(h->idle.data[i]);
+        h->idle.len = 0;
+        ((struct sockaddr_in*) &h->addr)->sin_port = htons(atoi(dead_port));
+
+        fd = bsky_conn_pool_get(&pool, live, &ec);
+        TEST_ASSERT_EQUAL(bsky_ec_Ok, ec);
+        TEST_ASSERT(fd >= 0);
+        TEST_ASSERT_EQUAL(atoi(port),
+                          ntohs(((struct sockaddr_in*) &h->addr)->sin_port));
+        TEST_ASSERT_EQUAL(4, h->connects);
+        close(fd);
+
+        fd = bsky_conn_pool_get(&pool, dead, &ec);
+        TEST_ASSERT_EQUAL(-1, fd);
+        TEST_ASSERT_EQUAL(bsky_ec_Net_connect, ec);
+
+        bsky_conn_pool_free(&pool);
+        close(lfd);
+    }
+
+    void run_pds_tests(void)
+    {
+        RUN_TEST(pds_str_map);
+        RUN_TEST(pds_parse_url);
+        RUN_TEST(pds_route_did_doc);
+        RUN_TEST(pds_warmup);
+    }
+
+#endif
+
+
+#endif // pds-tests_h_INCLUDED
@@ -0,0 +1,211 @@
+#ifndef pool_tests_h_INCLUDED
+#define pool_tests_h_INCLUDED
+
+
+void run_pool_tests(void);
+
+
+#ifdef IMPLEMENT_TESTS
+
+    #include "../bsky-api.h"
+
+    struct __pool_node {
+        struct bsky_pool      *pool;
+        struct bsky_task_group group;
+        struct bsky_task       task;
+        int     depth;
+        _Atomic int *leaves;
+    };
+
+    // binary tree of tasks, every node waits for its children.
+    static void __pool_tree(void *arg)
+    {
+        struct __pool_node *node = arg;
+        struct __pool_node  kids[2];
+
+        if (node->depth == 0) {
+            atomic_fetch_add(node->leaves, 1);
+            return;
+        }
+
+        for (int i = 0; i < 2; ++i) {
+            kids[i] = (struct __pool_node) {
+                node->pool, { 0 }, { __pool_tree, &kids[i], &node->group },
+                node->depth - 1, node->leaves,
+            };
+            TEST_ASSERT_EQUAL(bsky_ec_Ok,
+                              bsky_pool_submit(node->pool, &kids[i].task));
+        }
+        bsky_pool_wait(node->pool, &node->group);
+    }
+
+    static void pool_nested(void)
+    {
+        struct bsky_pool pool = { .workers = 4 };
+        struct bsky_task_group group = { 0 };
+        _Atomic int leaves = 0;
+        struct __pool_node root = { &pool, { 0 }, { 0 }, 10, &leaves };
+
+        TEST_ASSERT_EQUAL(bsky_ec_Ok, bsky_pool_start(&pool));
+
+        root.task = (struct bsky_task) { __pool_tree, &root, &group };
+        TEST_ASSERT_EQUAL(bsky_ec_Ok, bsky_pool_submit(&pool, &root.task));
+        bsky_pool_wait(&pool, &group);
+
+        TEST_ASSERT_EQUAL(1024, leaves);
+        TEST_ASSERT_EQUAL(2047, pool.executed);
+        TEST_ASSERT_EQUAL(-1, bsky_pool_worker());
+
+        bsky_pool_stop(&pool);
+    }
+
+    struct __pool_sum {
+        const uint32_t *items;
+        _Atomic uint64_t sum;
+        _Atomic size_t   calls, max;
+        _Atomic int      workers[4];
+    };
+
+    static void __pool_add(void *user, size_t begin, size_t end)
+    {
+        struct __pool_sum *s = user;
+        uint64_t sum = 0;
+        size_t   max = atomic_load(&s->max);
+        int worker = bsky_pool_worker();
+
+        for (size_t i = begin; i < end; ++i) sum += s->items[i];
+
+        atomic_fetch_add(&s->sum, sum);
+        atomic_fetch_add(&s->calls, 1);
+        while (end - begin > max &&
+               !atomic_compare_exchange_weak(&s->max, &max, end - begin)) {
+        }
+        if (worker >= 0) atomic_store(&s->workers[worker], 1);
+    }
+
+    static void pool_for(void)
+    {
+        struct bsky_pool  pool = { .workers = 4 };
+        struct __pool_sum s    = { 0 };
+        size_t   n     = 100003;
+        uint32_t *items = malloc(n * sizeof (uint32_t));
+
+        for (size_t i = 0; i < n; ++i) items[i] = i;
+        s.items = items;
+
+        TEST_ASSERT_EQUAL(bsky_ec_Ok, bsky_pool_start(&pool));
+        TEST_ASSERT_EQUAL(bsky_ec_Ok,
+                          bsky_pool_for(&pool, 0, n, 100, __pool_add, &s));
+
+        TEST_ASSERT_EQUAL((uint64_t) n * (n - 1) / 2, s.sum);
+        TEST_ASSERT(s.max <= 100);
+        TEST_ASSERT(s.calls >= n / 100);
+
+        // default grain and empty range.
+        s.sum = s.calls = s.max = 0;
+        TEST_ASSERT_EQUAL(bsky_ec_Ok,
+                          bsky_pool_for(&pool, 10, n, 0, __pool_add, &s));
+        TEST_ASSERT_EQUAL((uint64_t) n * (n - 1) / 2 - 45, s.sum);
+        TEST_ASSERT(s.max <= (n - 10) / 32);
+        TEST_ASSERT_EQUAL(bsky_ec_Ok,
+                          bsky_pool_for(&pool, 5, 5, 0, __pool_add, &s));
+
+        bsky_pool_stop(&pool);
+        free(items);
+    }
+
+    static void __pool_count(void *arg)
+    {
+        atomic_fetch_add((_Atomic int*) arg, 1);
+    }
+
+    static void __pool_alloc(void *arg)
+    {
+        size_t *len = arg;
+
+        TEST_ASSERT(bsky_tmp_alloc(64) != NULL);
+        *len = __bsky_default_tmp_arena.len;
+    }
+
+    static void pool_tmp(void)
+    {
+        struct bsky_pool pool = { .workers = 1 };
+        struct bsky_task_group group = { 0 };
+        size_t len[3] = { 0 };
+        struct bsky_task tasks[3];
+
+        TEST_ASSERT_EQUAL(bsky_ec_Ok, bsky_pool_start(&pool));
+
+        // worker allocates into its own arena, the arena of caller stays.
+        bsky_default_tmp_reset();
+        for (int i = 0; i < 3; ++i) {
+            if (i == 2) bsky_pool_tmp_reset(&pool);
+
+            // no wait, it would run the task here.
+            tasks[i] = (struct bsky_task) { __pool_alloc, &len[i], &group };
+            bsky_pool_submit(&pool, &tasks[i]);
+            while (atomic_load(&group.pending)) sched_yield();
+        }
+
+        TEST_ASSERT(len[0] >= 64);
+        TEST_ASSERT(len[1] >= 2 * 64);
+        TEST_ASSERT_EQUAL(len[0], len[2]);
+        TEST_ASSERT_EQUAL(0, __bsky_default_tmp_arena.len);
+
+        bsky_pool_stop(&pool);
+    }
+
+    struct __pool_burst {
+        struct bsky_pool      *pool;
+        struct bsky_task_group group;
+        struct bsky_task       tasks[2000];
+        _Atomic int count;
+    };
+
+    // worker fills its own deque past initial capacity.
+    static void __pool_burst(void *arg)
+    {
+        struct __pool_burst *b = arg;
+
+        for (size_t i = 0; i < 2000; ++i) {
+            b->tasks[i] = (struct bsky_task) {
+                __pool_count, &b->count, &b->group };
+            TEST_ASSERT_EQUAL(bsky_ec_Ok,
+                              bsky_pool_submit(b->pool, &b->tasks[i]));
+        }
+        bsky_pool_wait(b->pool, &b->group);
+    }
+
+    static void pool_grow(void)
+    {
+        struct bsky_pool pool = { .workers = 3, .pin = 1 };
+        struct bsky_task_group group = { 0 };
+        struct __pool_burst *b = calloc(1, sizeof (*b));
+        struct bsky_task task = { __pool_burst, b, &group };
+
+        b->pool = &pool;
+        TEST_ASSERT_EQUAL(bsky_ec_Ok, bsky_pool_start(&pool));
+
+        bsky_pool_submit(&pool, &task);
+        bsky_pool_wait(&pool, &group);
+
+        TEST_ASSERT_EQUAL(2000, b->count);
+        TEST_ASSERT_EQUAL(2001, pool.executed);
+
+        bsky_pool_stop(&pool);
+        bsky_ebr_flush();
+        free(b);
+    }
+
+    void run_pool_tests(void)
+    {
+        RUN_TEST(pool_nested);
+        RUN_TEST(pool_for);
+        RUN_TEST(pool_tmp);
+        RUN_TEST(pool_grow);
+    }
+
+#endif
+
+
+#endif // pool-tests_h_INCLUDED
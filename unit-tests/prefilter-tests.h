@@ -0,0 +1,192 @@
+#ifndef prefilter_tests_h_INCLUDED
+#define prefilter_tests_h_INCLUDED
+
+
+void run_prefilter_tests(void);
+
+
+#ifdef IMPLEMENT_TESTS
+
+    #include "../bsky-api.h"
+
+    static void prefilter_nsid_set(void)
+    {
+        struct bsky_nsid_set set;
+        const char *nsids[] = {
+            "app.bsky.feed.post", "app.bsky.graph.*", "com.example.x",
+        };
+        static char buf[200][32];
+        const char *many[200];
+
+        TEST_ASSERT_EQUAL(bsky_ec_Ok, bsky_nsid_set_build(&set, nsids, 3));
+
+        TEST_ASSERT(bsky_nsid_set_has(&set,
+                    bsky_mk_str("app.bsky.feed.post/3kabc")));
+        TEST_ASSERT(bsky_nsid_set_has(&set, bsky_mk_str("com.example.x")));
+        TEST_ASSERT(bsky_nsid_set_has(&set,
+                    bsky_mk_str("app.bsky.graph.follow/3kabc")));
+        TEST_ASSERT(!bsky_nsid_set_has(&set, bsky_mk_str("app.bsky.graph")));
+        TEST_ASSERT(!bsky_nsid_set_has(&set,
+                    bsky_mk_str("app.bsky.graphx.follow")));
+        TEST_ASSERT(!bsky_nsid_set_has(&set,
+                    bsky_mk_str("app.bsky.feed.like/3kabc")));
+        bsky_nsid_set_free(&set);
+
+        for (int i = 0; i < 200; ++i) {
+            snprintf(buf[i], sizeof (buf[i]), "com.example.n%d", i);
+            many[i] = buf[i];
+        }
+
+        TEST_ASSERT_EQUAL(bsky_ec_Ok, bsky_nsid_set_build(&set, many, 100));
+        for (int i = 0; i < 200; ++i) {
+            TEST_ASSERT_EQUAL(i < 100,
+                              bsky_nsid_set_has(&set, bsky_mk_str(buf[i])));
+        }
+        bsky_nsid_set_free(&set);
+
+        TEST_ASSERT_EQUAL(bsky_ec_Ok, bsky_nsid_set_build(&set,
+                          (const char*[]) { "*" }, 1));
+        TEST_ASSERT(bsky_nsid_set_has(&set, bsky_mk_str("a.b.c")));
+        bsky_nsid_set_free(&set);
+    }
+
+    static void prefilter_nsid_duplicates(void)
+    {
+        struct bsky_nsid_set set;
+
+        TEST_ASSERT_EQUAL(bsky_ec_Ok, bsky_nsid_set_build(&set,
+                          (const char*[]) { "app.bsky.feed.post",
+                                            "app.bsky.feed.post" }, 2));
+        TEST_ASSERT_EQUAL(1, set.len);
+        TEST_ASSERT(bsky_nsid_set_has(&set, bsky_mk_str("app.bsky.feed.post")));
+        TEST_ASSERT(!bsky_nsid_set_has(&set, bsky_mk_str("app.bsky.feed")));
+        bsky_nsid_set_free(&set);
+
+        // exact and prefix entry of the same NSID share one slot.
+        TEST_ASSERT_EQUAL(bsky_ec_Ok, bsky_nsid_set_build(&set,
+                          (const char*[]) { "app.bsky.feed", "app.bsky.feed.*",
+                                            "app.bsky.feed" }, 3));
+        TEST_ASSERT_EQUAL(1, set.len);
+        TEST_ASSERT(bsky_nsid_set_has(&set, bsky_mk_str("app.bsky.feed")));
+        TEST_ASSERT(bsky_nsid_set_has(&set,
+                    bsky_mk_str("app.bsky.feed.like/3kabc")));
+        TEST_ASSERT(!bsky_nsid_set_has(&set, bsky_mk_str("app.bsky.graph")));
+        bsky_nsid_set_free(&set);
+
+        TEST_ASSERT_EQUAL(bsky_ec_Ok, bsky_nsid_set_build(&set,
+                          (const char*[]) { "app.bsky.feed.*",
+                                            "app.bsky.feed.post" }, 2));
+        TEST_ASSERT_EQUAL(2, set.len);
+        TEST_ASSERT(!bsky_nsid_set_has(&set, bsky_mk_str("app.bsky.feed")));
+        TEST_ASSERT(bsky_nsid_set_has(&set, bsky_mk_str("app.bsky.feed.post")));
+        TEST_ASSERT(bsky_nsid_set_has(&set, bsky_mk_str("app.bsky.feed.like")));
+        bsky_nsid_set_free(&set);
+    }
+
+    static void prefilter_did_filter(void)
+    {
+        struct bsky_did_filter filter;
+        char did[64];
+
+        TEST_ASSERT_EQUAL(bsky_ec_Ok, bsky_did_filter_init(&filter, 20000));
+
+        for (int i = 0; i < 20000; ++i) {
+            snprintf(did, sizeof (did), "did:plc:%024d", i);
+            TEST_ASSERT_EQUAL(bsky_ec_Ok,
+                              bsky_did_filter_add(&filter, bsky_mk_str(did)));
+        }
+        TEST_ASSERT_EQUAL(20000, filter.len);
+
+        for (int i = 0; i < 40000; ++i) {
+            snprintf(did, sizeof (did), "did:plc:%024d", i);
+            TEST_ASSERT_EQUAL(i < 20000,
+                              bsky_did_filter_has(&filter, bsky_mk_str(did)));
+        }
+
+        // 16 bits per DID keep bloom false positives well below 1%.
+        TEST_ASSERT(filter.false_positives < 200);
+
+        bsky_did_filter_free(&filter);
+    }
+
+    static void __prefilter_handler(void *user, struct bsky_firehose_event *ev)
+    {
+        TEST_ASSERT(__firehose_eq(ev->repo, "did:plc:alice") ||
+                    __firehose_eq(ev->repo, "did:plc:bob"));
+        (*(_Atomic int*) user)++;
+    }
+
+    static void prefilter_firehose(void)
+    {
+        struct bsky_nsid_set   collections;
+        struct bsky_did_filter dids;
+        struct bsky_prefilter  pf = { &collections, &dids };
+        struct bsky_firehose   pipe;
+        struct bsky_firehose_metrics metrics[2];
+        _Atomic int handled = 0;
+        struct bsky_firehose_config config = {
+            .shards    = 2,
+            .handler   = __prefilter_handler,
+            .user      = &handled,
+            .prefilter = &pf,
+        };
+        uint64_t filtered = 0;
+
+        TEST_ASSERT_EQUAL(bsky_ec_Ok, bsky_nsid_set_build(&collections,
+                          (const char*[]) { "app.bsky.feed.*" }, 1));
+        TEST_ASSERT_EQUAL(bsky_ec_Ok, bsky_did_filter_init(&dids, 16));
+        bsky_did_filter_add(&dids, bsky_mk_str("did:plc:alice"));
+        bsky_did_filter_add(&dids, bsky_mk_str("did:plc:bob"));
+
+        TEST_ASSERT_EQUAL(bsky_ec_Ok, bsky_firehose_start(&pipe, &config));
+
+        for (int seq = 1; seq <= 100; ++seq) {
+            struct bsky_str_builder sb = { 0 };
+
+            __firehose_frame(&sb, __firehose_repos[seq % 4], seq);
+            TEST_ASSERT_EQUAL(bsky_ec_Ok, bsky_firehose_push(&pipe,
+                (struct bsky_view) { sb.data, sb.data + sb.len }));
+            bsky_da_free(&sb);
+        }
+
+        bsky_firehose_metrics(&pipe, metrics, 2);
+        filtered = metrics[0].filtered + metrics[1].filtered;
+        TEST_ASSERT_EQUAL(50, filtered);
+
+        bsky_firehose_stop(&pipe);
+        TEST_ASSERT_EQUAL(50, handled);
+
+        // the same frames without matching collection.
+        bsky_nsid_set_free(&collections);
+        TEST_ASSERT_EQUAL(bsky_ec_Ok, bsky_nsid_set_build(&collections,
+                          (const char*[]) { "app.bsky.graph.follow" }, 1));
+
+        handled = 0;
+        TEST_ASSERT_EQUAL(bsky_ec_Ok, bsky_firehose_start(&pipe, &config));
+        for (int seq = 1; seq <= 10; ++seq) {
+            struct bsky_str_builder sb = { 0 };
+
+            __firehose_frame(&sb, "did:plc:alice", seq);
+            bsky_firehose_push(&pipe,
+                (struct bsky_view) { sb.data, sb.data + sb.len });
+            bsky_da_free(&sb);
+        }
+        bsky_firehose_stop(&pipe);
+        TEST_ASSERT_EQUAL(0, handled);
+
+        bsky_nsid_set_free(&collections);
+        bsky_did_filter_free(&dids);
+    }
+
+    void run_prefilter_tests(void)
+    {
+        RUN_TEST(prefilter_nsid_set);
+        RUN_TEST(prefilter_nsid_duplicates);
+        RUN_TEST(prefilter_did_filter);
+        RUN_TEST(prefilter_firehose);
+    }
+
+#endif
+
+
+#endif // prefilter-tests_h_INCLUDED
@@ -0,0 +1,308 @@
+#ifndef roaring_tests_h_INCLUDED
+#define roaring_tests_h_INCLUDED
+
+
+void run_roaring_tests(void);
+
+
+#ifdef IMPLEMENT_TESTS
+
+    #include "../bsky-api.h"
+
+    #define __ROARING_UNIVERSE (5 << 16)
+
+    static uint32_t __roaring_seed = 1;
+
+    static uint32_t __roaring_rand(void)
+    {
+        __roaring_seed = __roaring_seed * 1103515245 + 12345;
+        return __roaring_seed >> 8;
+    }
+
+    /*
+     * Containers of keys:
+     *     0 -- sparse, array in both sets;
+     *     1 -- dense, bitmap in both sets;
+     *     2 -- ranges, runs after optimize;
+     *     3 -- sparse in `a', dense in `b';
+     *     4 -- only in `a'.
+     */
+    static void __roaring_fill(struct bsky_roaring *r, unsigned char *bits,
+                               int second)
+    {
+        for (int i = 0; i < 1000; ++i) {
+            uint32_t v = __roaring_rand() % 3000;
+
+            bits[v] = 1;
+            TEST_ASSERT_EQUAL(bsky_ec_Ok, bsky_roaring_add(r, v));
+        }
+        for (int i = 0; i < 30000; ++i) {
+            uint32_t v = (1 << 16) | (__roaring_rand() & 0xffff);
+
+            bits[v] = 1;
+            TEST_ASSERT_EQUAL(bsky_ec_Ok, bsky_roaring_add(r, v));
+        }
+        for (uint32_t start = second * 100; start < 60000; start += 1000) {
+            for (uint32_t v = start; v < start + 500; ++v) {
+                bits[(2 << 16) | v] = 1;
+                TEST_ASSERT_EQUAL(bsky_ec_Ok,
+                                  bsky_roaring_add(r, (2 << 16) | v));
+            }
+        }
+        for (int i = 0; i < (second ? 20000 : 300); ++i) {
+            uint32_t v = (3 << 16) | (__roaring_rand() & 0xffff);
+
+            bits[v] = 1;
+            TEST_ASSERT_EQUAL(bsky_ec_Ok, bsky_roaring_add(r, v));
+        }
+        for (int i = 0; i < 100 && !second; ++i) {
+            uint32_t v = (4 << 16) | (i * 7);
+
+            bits[v] = 1;
+            TEST_ASSERT_EQUAL(bsky_ec_Ok, bsky_roaring_add(r, v));
+        }
+    }
+
+    static void __roaring_expect(struct bsky_roaring *r,
+                                 const unsigned char *bits)
+    {
+        struct bsky_graph_ids ids = { 0 };
+        size_t k = 0;
+
+        TEST_ASSERT_EQUAL(bsky_ec_Ok, bsky_roaring_ids(r, &ids));
+        for (uint32_t v = 0; v < __ROARING_UNIVERSE; ++v) {
+            if (!bits[v]) continue;
+
+            TEST_ASSERT(k < ids.len);
+            TEST_ASSERT_EQUAL(v, ids.data[k++]);
+        }
+        TEST_ASSERT_EQUAL(k, ids.len);
+        TEST_ASSERT_EQUAL(k, bsky_roaring_card(r));
+
+        bsky_da_free(&ids);
+    }
+
+    static void roaring_ops(void)
+    {
+        struct bsky_roaring a = { 0 }, b = { 0 }, out = { 0 };
+        unsigned char *x   = calloc(__ROARING_UNIVERSE, 1);
+        unsigned char *y   = calloc(__ROARING_UNIVERSE, 1);
+        unsigned char *exp = calloc(__ROARING_UNIVERSE, 1);
+        enum bsky_roaring_backend backends[] = {
+            bsky_roaring_Portable, bsky_roaring_Sse2, bsky_roaring_Avx2,
+        };
+
+        __roaring_fill(&a, x, 0);
+        __roaring_fill(&b, y, 1);
+        __roaring_expect(&a, x);
+        __roaring_expect(&b, y);
+
+        // the second round works with runs of `b'.
+        for (int round = 0; round < 2; ++round) {
+            for (size_t i = 0; i < BSKY_ARRAY_LEN(backends); ++i) {
+                bsky_roaring_use(backends[i]);
+
+                TEST_ASSERT_EQUAL(bsky_ec_Ok, bsky_roaring_and(&out, &a, &b));
+                for (uint32_t v = 0; v < __ROARING_UNIVERSE; ++v)
+                    exp[v] = x[v] && y[v];
+                __roaring_expect(&out, exp);
+
+                TEST_ASSERT_EQUAL(bsky_ec_Ok, bsky_roaring_or(&out, &a, &b));
+                for (uint32_t v = 0; v < __ROARING_UNIVERSE; ++v)
+                    exp[v] = x[v] || y[v];
+                __roaring_expect(&out, exp);
+
+                TEST_ASSERT_EQUAL(bsky_ec_Ok,
+                                  bsky_roaring_andnot(&out, &a, &b));
+                for (uint32_t v = 0; v < __ROARING_UNIVERSE; ++v)
+                    exp[v] = x[v] && !y[v];
+                __roaring_expect(&out, exp);
+
+                TEST_ASSERT_EQUAL(bsky_ec_Ok,
+                                  bsky_roaring_andnot(&out, &b, &a));
+                for (uint32_t v = 0; v < __ROARING_UNIVERSE; ++v)
+                    exp[v] = y[v] && !x[v];
+                __roaring_expect(&out, exp);
+            }
+
+            TEST_ASSERT_EQUAL(bsky_ec_Ok, bsky_roaring_optimize(&b));
+            __roaring_expect(&b, y);
+        }
+
+        // ranges became runs, random containers stay as they were.
+        TEST_ASSERT_EQUAL(__bsky_roaring_Array,  b.data[0].type);
+        TEST_ASSERT_EQUAL(__bsky_roaring_Bitmap, b.data[1].type);
+        TEST_ASSERT_EQUAL(__bsky_roaring_Run,    b.data[2].type);
+        TEST_ASSERT_EQUAL(60, b.data[2].len);
+        TEST_ASSERT(bsky_roaring_has(&b, (2 << 16) | 100));
+        TEST_ASSERT(bsky_roaring_has(&b, (2 << 16) | 599));
+        TEST_ASSERT(!bsky_roaring_has(&b, (2 << 16) | 600));
+        TEST_ASSERT(!bsky_roaring_has(&b, (2 << 16) | 99));
+
+        bsky_roaring_use(bsky_roaring_Auto);
+        bsky_roaring_free(&a);
+        bsky_roaring_free(&b);
+        bsky_roaring_free(&out);
+        free(x);
+        free(y);
+        free(exp);
+    }
+
+    static void roaring_update(void)
+    {
+        struct bsky_roaring r = { 0 };
+
+        // array turns into bitmap and back at 4096 values.
+        for (uint32_t v = 0; v < 2 * BSKY_ROARING_ARRAY_MAX; v += 2)
+            TEST_ASSERT_EQUAL(bsky_ec_Ok, bsky_roaring_add(&r, v + 70000));
+        TEST_ASSERT_EQUAL(__bsky_roaring_Array, r.data[0].type);
+        TEST_ASSERT_EQUAL(bsky_ec_Ok, bsky_roaring_add(&r, 70001));
+        TEST_ASSERT_EQUAL(__bsky_roaring_Bitmap, r.data[0].type);
+        TEST_ASSERT_EQUAL(bsky_ec_Ok, bsky_roaring_add(&r, 70001));
+        TEST_ASSERT_EQUAL(BSKY_ROARING_ARRAY_MAX + 1, bsky_roaring_card(&r));
+        TEST_ASSERT(bsky_roaring_has(&r, 70001));
+        TEST_ASSERT(!bsky_roaring_has(&r, 70003));
+
+        TEST_ASSERT_EQUAL(bsky_ec_Ok, bsky_roaring_remove(&r, 70002));
+        TEST_ASSERT_EQUAL(__bsky_roaring_Array, r.data[0].type);
+        TEST_ASSERT(!bsky_roaring_has(&r, 70002));
+        TEST_ASSERT(bsky_roaring_has(&r, 70004));
+
+        // run container is expanded by update.
+        TEST_ASSERT_EQUAL(bsky_ec_Ok, bsky_roaring_add(&r, 5));
+        for (uint32_t v = 10; v < 20; ++v)
+            TEST_ASSERT_EQUAL(bsky_ec_Ok, bsky_roaring_add(&r, v));
+        TEST_ASSERT_EQUAL(bsky_ec_Ok, bsky_roaring_optimize(&r));
+        TEST_ASSERT_EQUAL(__bsky_roaring_Run, r.data[0].type);
+        TEST_ASSERT_EQUAL(2, r.data[0].len);
+        TEST_ASSERT(bsky_roaring_has(&r, 5) && bsky_roaring_has(&r, 19));
+        TEST_ASSERT(!bsky_roaring_has(&r, 4) && !bsky_roaring_has(&r, 9));
+        TEST_ASSERT_EQUAL(bsky_ec_Ok, bsky_roaring_remove(&r, 12));
+        TEST_ASSERT_EQUAL(__bsky_roaring_Array, r.data[0].type);
+        TEST_ASSERT_EQUAL(10, r.data[0].card);
+
+        // empty container is dropped.
+        TEST_ASSERT_EQUAL(2, r.len);
+        for (uint32_t v = 0; v < 20; ++v)
+            TEST_ASSERT_EQUAL(bsky_ec_Ok, bsky_roaring_remove(&r, v));
+        TEST_ASSERT_EQUAL(1, r.len);
+        TEST_ASSERT_EQUAL(1, r.data[0].key);
+
+        bsky_roaring_free(&r);
+    }
+
+    static void roaring_actors(void)
+    {
+        enum bsky_error_code ec;
+        struct bsky_graph   g = { 0 };
+        struct bsky_roaring follows = { 0 }, list = { 0 }, out = { 0 };
+        char text_follows[] =
+            "{\"subject\": {\"did\": \"did:plc:alice\"},"
+            " \"follows\": [{\"did\": \"did:plc:bob\", \"handle\": \"bob\"},"
+                          " {\"did\": \"did:plc:carol\"}],"
+            " \"cursor\": \"next\"}";
+        char text_list[] =
+            "{\"list\": {\"uri\": \"at://did:plc:alice/app.bsky.graph.list/1\"},"
+            " \"items\": [{\"uri\": \"at://x\","
+                          " \"subject\": {\"did\": \"did:plc:carol\"}},"
+                         " {\"uri\": \"at://y\","
+                          " \"subject\": {\"did\": \"did:plc:dave\"}}]}";
+        char text_blocks[] = "{\"blocks\": [{\"did\": \"did:plc:dave\"},"
+                                          " {\"handle\": \"nobody\"}]}";
+        char text_other[] = "{\"feed\": [{\"did\": \"did:plc:bob\"}]}";
+        struct bsky_str str;
+        struct bsky_json json;
+
+        str  = bsky_mk_str(text_follows);
+        json = bsky_parse_json(&str, &ec);
+        TEST_ASSERT_EQUAL(bsky_ec_Ok, ec);
+        TEST_ASSERT_EQUAL(bsky_ec_Ok,
+                          bsky_roaring_add_actors(&follows, &g, &json));
+
+        str  = bsky_mk_str(text_list);
+        json = bsky_parse_json(&str, &ec);
+        TEST_ASSERT_EQUAL(bsky_ec_Ok, ec);
+        TEST_ASSERT_EQUAL(bsky_ec_Ok, bsky_roaring_add_actors(&list, &g, &json));
+
+        uint32_t bob   = bsky_graph_find(&g, bsky_mk_str("did:plc:bob"));
+        uint32_t carol = bsky_graph_find(&g, bsky_mk_str("did:plc:carol"));
+        uint32_t dave  = bsky_graph_find(&g, bsky_mk_str("did:plc:dave"));
+
+        TEST_ASSERT_EQUAL(3, g.nodes);
+        TEST_ASSERT_EQUAL(2, bsky_roaring_card(&follows));
+        TEST_ASSERT(bsky_roaring_has(&follows, bob));
+        TEST_ASSERT(bsky_roaring_has(&list, dave));
+
+        TEST_ASSERT_EQUAL(bsky_ec_Ok, bsky_roaring_and(&out, &follows, &list));
+        TEST_ASSERT_EQUAL(1, bsky_roaring_card(&out));
+        TEST_ASSERT(bsky_roaring_has(&out, carol));
+
+        str  = bsky_mk_str(text_blocks);
+        json = bsky_parse_json(&str, &ec);
+        TEST_ASSERT_EQUAL(bsky_ec_Ok, ec);
+        TEST_ASSERT_EQUAL(bsky_ec_Roaring_response,
+                          bsky_roaring_add_actors(&out, &g, &json));
+        TEST_ASSERT(bsky_roaring_has(&out, dave));
+
+        str  = bsky_mk_str(text_other);
+        json = bsky_parse_json(&str, &ec);
+        TEST_ASSERT_EQUAL(bsky_ec_Ok, ec);
+        TEST_ASSERT_EQUAL(bsky_ec_Roaring_response,
+                          bsky_roaring_add_actors(&out, &g, &json));
+
+        bsky_roaring_free(&follows);
+        bsky_roaring_free(&list);
+        bsky_roaring_free(&out);
+        bsky_graph_free(&g);
+    }
+
+    struct __roaring_pair { struct bsky_roaring *a, *b; uint64_t card; };
+
+    static void *__roaring_and(void *arg)
+    {
+        struct __roaring_pair *p = arg;
+        struct bsky_roaring out = { 0 };
+
+        bsky_roaring_and(&out, p->a, p->b);
+        p->card = bsky_roaring_card(&out);
+        bsky_roaring_free(&out);
+
+        return NULL;
+    }
+
+    static void roaring_first_use(void)
+    {
+        struct bsky_roaring a = { 0 }, b = { 0 };
+        struct __roaring_pair pairs[4];
+        pthread_t threads[4];
+
+        for (uint32_t v = 0; v < 100000; v += 2) bsky_roaring_add(&a, v);
+        for (uint32_t v = 0; v < 100000; v += 3) bsky_roaring_add(&b, v);
+
+        // kernels are selected by concurrent first operations.
+        atomic_store(&__bsky_roaring_backend, bsky_roaring_Auto);
+        for (int i = 0; i < 4; ++i) {
+            pairs[i] = (struct __roaring_pair) { &a, &b, 0 };
+            pthread_create(&threads[i], NULL, __roaring_and, &pairs[i]);
+        }
+        for (int i = 0; i < 4; ++i) pthread_join(threads[i], NULL);
+
+        for (int i = 0; i < 4; ++i) TEST_ASSERT_EQUAL(16667, pairs[i].card);
+        TEST_ASSERT(atomic_load(&__bsky_roaring_backend) != bsky_roaring_Auto);
+
+        bsky_roaring_free(&a);
+        bsky_roaring_free(&b);
+    }
+
+    void run_roaring_tests(void)
+    {
+        RUN_TEST(roaring_ops);
+        RUN_TEST(roaring_update);
+        RUN_TEST(roaring_actors);
+        RUN_TEST(roaring_first_use);
+    }
+
+#endif
+
+
+#endif // roaring-tests_h_INCLUDED
@@ -3,6 +3,29 @@
 
 #include "json-tests.h"
 #include "string-tests.h"
+#include "pds-tests.h"
+#include "blob-tests.h"
+#include "write-tests.h"
+#include "loop-tests.h"
+#include "ws-tests.h"
+#include "cbor-tests.h"
+#include "car-tests.h"
+#include "cid-tests.h"
+#include "mst-tests.h"
+#include "firehose-tests.h"
+#include "checkpoint-tests.h"
+#include "prefilter-tests.h"
+#include "jetstream-tests.h"
+#include "verify-tests.h"
+#include "capture-tests.h"
+#include "backfill-tests.h"
+#include "label-tests.h"
+#include "ebr-tests.h"
+#include "pool-tests.h"
+#include "mpmc-tests.h"
+#include "snap-tests.h"
+#include "graph-tests.h"
+#include "roaring-tests.h"
 
 #include <unity.h>
 
@@ -19,6 +42,52 @@ int main(int argc, char **argv)
 
     run_string_tests();
 
+    run_pds_tests();
+
+    run_blob_tests();
+
+    run_write_tests();
+
+    run_loop_tests();
+
+    run_ws_tests();
+
+    run_cbor_tests();
+
+    run_car_tests();
+
+    run_cid_tests();
+
+    run_mst_tests();
+
+    run_firehose_tests();
+
+    run_checkpoint_tests();
+
+    run_prefilter_tests();
+
+    run_jetstream_tests();
+
+    run_verify_tests();
+
+    run_capture_tests();
+
+    run_backfill_tests();
+
+    run_label_tests();
+
+    run_ebr_tests();
+
+    run_pool_tests();
+
+    run_mpmc_tests();
+
+    run_snap_tests();
+
+    run_graph_tests();
+
+    run_roaring_tests();
+
 
 	return UNITY_END();
 }
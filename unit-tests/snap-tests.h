@@ -0,0 +1,212 @@
+#ifndef snap_tests_h_INCLUDED
+#define snap_tests_h_INCLUDED
+
+
+void run_snap_tests(void);
+
+
+#ifdef IMPLEMENT_TESTS
+
+    #include "../bsky-api.h"
+    #include <stdio.h>
+    #include <unistd.h>
+
+    static char __snap_path[] = "/tmp/bsky-snap-test";
+    static char __snap_tmp_path[] = "/tmp/bsky-snap-test.tmp";
+
+    static void __snap_put(struct bsky_snap_writer *w, const char *key,
+                           const char *text)
+    {
+        enum bsky_error_code ec;
+        struct bsky_str str = bsky_mk_str((char*) text);
+        struct bsky_json json = bsky_parse_json(&str, &ec);
+
+        TEST_ASSERT_EQUAL(bsky_ec_Ok, ec);
+        TEST_ASSERT_EQUAL(bsky_ec_Ok,
+                          bsky_snap_put(w, bsky_mk_str((char*) key), json));
+    }
+
+    static void snap_roundtrip(void)
+    {
+        enum bsky_error_code ec;
+        struct bsky_snap_writer w;
+        struct bsky_snap snap;
+        const struct bsky_snap_node *root, *node, *items;
+        char key[32];
+
+        TEST_ASSERT_EQUAL(bsky_ec_Ok,
+                          bsky_snap_writer_open(&w, __snap_path, &ec));
+        __snap_put(&w, "did:plc:alice",
+                   "{\"handle\": \"alice.test\", \"followers\": 42,"
+                   " \"labels\": [\"a\", {\"val\": null}, true, -1.5],"
+                   " \"none\": []}");
+        TEST_ASSERT_EQUAL(bsky_ec_Ok, bsky_snap_put(&w, bsky_mk_str("empty"),
+                          (struct bsky_json) { .var = bsky_json_Dct }));
+        __snap_put(&w, "did:plc:bob", "{\"handle\": \"old\"}");
+        for (int i = 0; i < 100; ++i) {
+            snprintf(key, sizeof (key), "did:plc:%d", i);
+            __snap_put(&w, key, "[1, 2, 3]");
+        }
+        __snap_put(&w, "did:plc:bob", "{\"handle\": \"bob.test\"}");
+        __snap_put(&w, "str", "\"just string\"");
+        TEST_ASSERT_EQUAL(105, w.docs);
+        TEST_ASSERT_EQUAL(bsky_ec_Ok, bsky_snap_writer_close(&w));
+
+        TEST_ASSERT_EQUAL(bsky_ec_Ok, bsky_snap_open(&snap, __snap_path, &ec));
+        TEST_ASSERT_EQUAL(bsky_ec_Ok, bsky_snap_validate(&snap));
+        TEST_ASSERT_EQUAL(104, snap.docs);
+
+        root = bsky_snap_get(&snap, bsky_mk_str("did:plc:alice"));
+        TEST_ASSERT(root != NULL);
+        TEST_ASSERT_EQUAL(bsky_json_Dct, root->var);
+        TEST_ASSERT_EQUAL(4, root->len);
+
+        node = bsky_snap_field(root, "handle");
+        TEST_ASSERT_EQUAL(bsky_json_Str, node->var);
+        TEST_ASSERT_EQUAL_STRING("alice.test", bsky_snap_str(node).start);
+        TEST_ASSERT_EQUAL(42, bsky_snap_field(root, "followers")->num);
+
+        node  = bsky_snap_field(root, "labels");
+        items = bsky_snap_items(node);
+        TEST_ASSERT_EQUAL(4, node->len);
+        TEST_ASSERT_EQUAL_STRING("a", bsky_snap_str(&items[0]).start);
+        TEST_ASSERT_EQUAL(bsky_json_Null,
+                          bsky_snap_field(&items[1], "val")->var);
+        TEST_ASSERT_EQUAL(bsky_json_Bool, items[2].var);
+        TEST_ASSERT_EQUAL(1, items[2]._bool);
+        TEST_ASSERT(items[3].num == -1.5);
+
+        TEST_ASSERT_EQUAL(bsky_json_Arr, bsky_snap_field(root, "none")->var);
+        TEST_ASSERT(bsky_snap_field(root, "missing") == NULL);
+
+        node = bsky_snap_get(&snap, bsky_mk_str("empty"));
+        TEST_ASSERT_EQUAL(bsky_json_Dct, node->var);
+        TEST_ASSERT_EQUAL(0, node->len);
+
+        // the last document of key wins.
+        node = bsky_snap_field(bsky_snap_get(&snap,
+                               bsky_mk_str("did:plc:bob")), "handle");
+        TEST_ASSERT_EQUAL_STRING("bob.test", bsky_snap_str(node).start);
+
+        node = bsky_snap_get(&snap, bsky_mk_str("did:plc:99"));
+        TEST_ASSERT_EQUAL(3, node->len);
+        TEST_ASSERT_EQUAL(3, bsky_snap_items(node)[2].num);
+
+        node = bsky_snap_get(&snap, bsky_mk_str("str"));
+        TEST_ASSERT_EQUAL_STRING("just string", bsky_snap_str(node).start);
+        TEST_ASSERT(bsky_snap_get(&snap, bsky_mk_str("did:plc:100")) == NULL);
+
+        bsky_snap_free(&snap);
+        bsky_default_tmp_reset();
+    }
+
+    static void __snap_patch(size_t at, const void *data, size_t len)
+    {
+        int fd = open(__snap_path, O_WRONLY);
+
+        TEST_ASSERT_EQUAL(len, pwrite(fd, data, len, at));
+        close(fd);
+    }
+
+    static void snap_invalid(void)
+    {
+        enum bsky_error_code ec;
+        struct bsky_snap_writer w;
+        struct bsky_snap snap, old;
+        struct bsky_snap_node node, chain[66];
+        size_t root = sizeof (struct bsky_snap_header) + sizeof (node);
+        char   zeros[2 * 80 + 2];
+
+        TEST_ASSERT_EQUAL(bsky_ec_Ok,
+                          bsky_snap_writer_open(&w, __snap_path, &ec));
+        __snap_put(&w, "old", "1");
+        TEST_ASSERT_EQUAL(bsky_ec_Ok, bsky_snap_writer_close(&w));
+        TEST_ASSERT_EQUAL(bsky_ec_Ok, bsky_snap_open(&old, __snap_path, &ec));
+
+        // writer did not finish: new file is rejected, old one is intact.
+        TEST_ASSERT_EQUAL(bsky_ec_Ok,
+                          bsky_snap_writer_open(&w, __snap_path, &ec));
+        __snap_put(&w, "k", "{\"a\": [1, {\"b\": \"c\"}]}");
+        TEST_ASSERT_EQUAL(bsky_ec_Ok, __bsky_snap_flush(&w));
+        TEST_ASSERT_EQUAL(bsky_ec_Snapshot_invalid,
+                          bsky_snap_open(&snap, __snap_tmp_path, &ec));
+        TEST_ASSERT_EQUAL(bsky_ec_Ok, bsky_snap_validate(&old));
+
+        // mapped old file stays readable after it is replaced.
+        TEST_ASSERT_EQUAL(bsky_ec_Ok, bsky_snap_writer_close(&w));
+        TEST_ASSERT(bsky_snap_get(&old, bsky_mk_str("old")) != NULL);
+        TEST_ASSERT_EQUAL(bsky_ec_Ok, bsky_snap_validate(&old));
+        bsky_snap_free(&old);
+
+        TEST_ASSERT_EQUAL(-1, access(__snap_tmp_path, F_OK));
+        TEST_ASSERT_EQUAL(bsky_ec_Ok, bsky_snap_open(&snap, __snap_path, &ec));
+        TEST_ASSERT_EQUAL(bsky_ec_Ok, bsky_snap_validate(&snap));
+        TEST_ASSERT(bsky_snap_get(&snap, bsky_mk_str("old")) == NULL);
+        memcpy(&node, (char*) snap.data.start + root, sizeof (node));
+        bsky_snap_free(&snap);
+
+        // root points outside of file.
+        node.off += 1 << 20;
+        __snap_patch(root, &node, sizeof (node));
+        TEST_ASSERT_EQUAL(bsky_ec_Ok, bsky_snap_open(&snap, __snap_path, &ec));
+        TEST_ASSERT_EQUAL(bsky_ec_Snapshot_invalid, bsky_snap_validate(&snap));
+        bsky_snap_free(&snap);
+
+        // dictionary contains itself.
+        node.off = 0;
+        __snap_patch(root, &node, sizeof (node));
+        TEST_ASSERT_EQUAL(bsky_ec_Ok, bsky_snap_open(&snap, __snap_path, &ec));
+        TEST_ASSERT_EQUAL(bsky_ec_Snapshot_invalid, bsky_snap_validate(&snap));
+        bsky_snap_free(&snap);
+
+        // string without terminator.
+        node = (struct bsky_snap_node) {
+            .var = bsky_json_Str, .len = 1000, .off = 16
+        };
+        __snap_patch(root, &node, sizeof (node));
+        TEST_ASSERT_EQUAL(bsky_ec_Ok, bsky_snap_open(&snap, __snap_path, &ec));
+        TEST_ASSERT_EQUAL(bsky_ec_Snapshot_invalid, bsky_snap_validate(&snap));
+        bsky_snap_free(&snap);
+
+        // each array shares child with the next one: walk is fib(64)
+        // without node limit.
+        for (size_t i = 0; i < BSKY_ARRAY_LEN(zeros); ++i)
+            zeros[i] = i % 2 ? '0' : ',';
+        zeros[0] = '[';
+        zeros[BSKY_ARRAY_LEN(zeros) - 2] = ']';
+        zeros[BSKY_ARRAY_LEN(zeros) - 1] = '\0';
+        TEST_ASSERT_EQUAL(bsky_ec_Ok,
+                          bsky_snap_writer_open(&w, __snap_path, &ec));
+        __snap_put(&w, "k", zeros);
+        TEST_ASSERT_EQUAL(bsky_ec_Ok, bsky_snap_writer_close(&w));
+
+        for (size_t i = 0; i < BSKY_ARRAY_LEN(chain); ++i) {
+            chain[i] = (struct bsky_snap_node) {
+                .var = bsky_json_Arr, .len = 2, .off = sizeof (node)
+            };
+        }
+        chain[BSKY_ARRAY_LEN(chain) - 2].var = bsky_json_Null;
+        chain[BSKY_ARRAY_LEN(chain) - 1].var = bsky_json_Null;
+        __snap_patch(root, chain, sizeof (chain));
+        TEST_ASSERT_EQUAL(bsky_ec_Ok, bsky_snap_open(&snap, __snap_path, &ec));
+        TEST_ASSERT_EQUAL(bsky_ec_Snapshot_invalid, bsky_snap_validate(&snap));
+        bsky_snap_free(&snap);
+
+        __snap_patch(0, "BSKYSNP0", 8);
+        TEST_ASSERT_EQUAL(bsky_ec_Snapshot_invalid,
+                          bsky_snap_open(&snap, __snap_path, &ec));
+
+        unlink(__snap_path);
+        bsky_default_tmp_reset();
+    }
+
+    void run_snap_tests(void)
+    {
+        RUN_TEST(snap_roundtrip);
+        RUN_TEST(snap_invalid);
+    }
+
+#endif
+
+
+#endif // snap-tests_h_INCLUDED
@@ -0,0 +1,263 @@
+#ifndef verify_tests_h_INCLUDED
+#define verify_tests_h_INCLUDED
+
+
+void run_verify_tests(void);
+
+
+#ifdef IMPLEMENT_TESTS
+
+    #include "../bsky-api.h"
+
+    // test backend: `r' is digest xor key, `s' must be low.
+    static void *__verify_key_new(void *user, const struct bsky_pubkey *pk)
+    {
+        struct bsky_pubkey *key = malloc(sizeof (*key));
+
+        (void) user;
+        *key = *pk;
+        return key;
+    }
+
+    static void __verify_key_free(void *user, void *key)
+    {
+        (void) user;
+        free(key);
+    }
+
+    static int __verify_verify(void *user, void *key,
+                               const unsigned char digest[32],
+                               const unsigned char sig[64])
+    {
+        const struct bsky_pubkey *pk = key;
+
+        (void) user;
+        for (int i = 0; i < 32; ++i)
+            if (sig[i] != (digest[i] ^ pk->point[i + 1])) return 0;
+
+        return 1;
+    }
+
+    static struct bsky_pubkey __verify_alice = { .point = { 2, 1, 2, 3 } };
+
+    // signed commit of `did'; `rev' is replaced after signing if `tamper'.
+    static void __verify_commit(struct bsky_str_builder *sb, char *did,
+                                const struct bsky_pubkey *key, int tamper,
+                                int high_s)
+    {
+        unsigned char cid[36] = { 0x01, 0x71, 0x12, 0x20, 7 };
+        unsigned char sig[64] = { 0 }, digest[32];
+        struct bsky_str_builder unsigned_sb = { 0 };
+
+        for (int signed_ = 0; signed_ < 2; ++signed_) {
+            struct bsky_str_builder *out = signed_ ? sb : &unsigned_sb;
+
+            bsky_cbor_push_map(out, 5 + signed_);
+            bsky_cbor_push_str(out, bsky_mk_str("did"));
+            bsky_cbor_push_str(out, bsky_mk_str(did));
+            bsky_cbor_push_str(out, bsky_mk_str("rev"));
+            bsky_cbor_push_str(out, bsky_mk_str(signed_ && tamper ? "3kxyz"
+                                                                  : "3kabc"));
+            if (signed_) {
+                bsky_cbor_push_str(out, bsky_mk_str("sig"));
+                bsky_cbor_push_bytes(out, (struct bsky_view) { sig, sig + 64 });
+            }
+            bsky_cbor_push_str(out, bsky_mk_str("data"));
+            bsky_cbor_push_link(out, (struct bsky_view) { cid, cid + 36 });
+            bsky_cbor_push_str(out, bsky_mk_str("prev"));
+            bsky_cbor_push_null(out);
+            bsky_cbor_push_str(out, bsky_mk_str("version"));
+            bsky_cbor_push_int(out, 3);
+
+            if (!signed_) {
+                bsky_sha256(unsigned_sb.data, unsigned_sb.len, digest);
+                for (int i = 0; i < 32; ++i)
+                    sig[i] = digest[i] ^ key->point[i + 1];
+                memset(sig + 32, high_s ? 0xff : 0, 32);
+                sig[63] = 1;
+            }
+        }
+
+        bsky_da_free(&unsigned_sb);
+    }
+
+    static int __verify_results[8];
+    static int __verify_resolved;
+
+    static void __verify_on_result(void *user, void *job,
+                                   enum bsky_verify_status status)
+    {
+        (void) user;
+        __verify_results[(intptr_t) job] = status;
+    }
+
+    static int __verify_resolve(void *user, struct bsky_str did,
+                                struct bsky_pubkey *key)
+    {
+        (void) user;
+        if (bsky_str_len(did) != 13 || memcmp(did.start, "did:plc:carol", 13))
+            return 0;
+
+        __verify_resolved++;
+        *key = __verify_alice;
+        return 1;
+    }
+
+    static void verify_did_key(void)
+    {
+        struct bsky_pubkey key;
+
+        TEST_ASSERT_EQUAL(bsky_ec_Ok, bsky_pubkey_of_did_key(bsky_mk_str(
+            "did:key:zQ3shXjHeiBuRCKmM36cuYnm7YEMzhGnCmCyW92sRJ9pribSF"),
+            &key));
+        TEST_ASSERT_EQUAL(bsky_key_Secp256k1, key.type);
+        TEST_ASSERT(memcmp(key.point, "\x02\x99\x51\xfe\xa6", 5) == 0);
+        TEST_ASSERT_EQUAL(0xd8, key.point[32]);
+
+        TEST_ASSERT_EQUAL(bsky_ec_Ok, bsky_pubkey_of_did_key(bsky_mk_str(
+            "zDnaembgSGUhZULN2Caob4HLJPaxBh92N7rtH21TErzqf8HQo"), &key));
+        TEST_ASSERT_EQUAL(bsky_key_P256, key.type);
+        TEST_ASSERT(memcmp(key.point, "\x03\x3a\x82\x73\xee", 5) == 0);
+        TEST_ASSERT_EQUAL(0xdc, key.point[32]);
+
+        TEST_ASSERT_EQUAL(bsky_ec_Verify_invalid_key,
+            bsky_pubkey_of_did_key(bsky_mk_str("did:key:zQ3sh0"), &key));
+        TEST_ASSERT_EQUAL(bsky_ec_Verify_invalid_key,
+            bsky_pubkey_of_did_key(bsky_mk_str("did:web:example.com"), &key));
+        // ed25519 key.
+        TEST_ASSERT_EQUAL(bsky_ec_Verify_invalid_key,
+            bsky_pubkey_of_did_key(bsky_mk_str(
+                "did:key:z6MkhaXgBZDvotDkL5257faiztiGiC2QtKLGpbnnEGta2doK"),
+                &key));
+    }
+
+    static void verify_pool(void)
+    {
+        struct bsky_str_builder sb[7] = { 0 };
+        struct bsky_verifier v = {
+            .crypto  = { __verify_key_new, __verify_key_free, __verify_verify },
+            .resolve = __verify_resolve, .on_result = __verify_on_result,
+            .workers = 2, .batch = 2, .queue = 2,
+        };
+        struct bsky_str alice = bsky_mk_str("did:plc:alice");
+
+        __verify_commit(&sb[0], "did:plc:alice", &__verify_alice, 0, 0);
+        __verify_commit(&sb[1], "did:plc:alice", &__verify_alice, 1, 0);
+        __verify_commit(&sb[2], "did:plc:alice", &__verify_alice, 0, 1);
+        __verify_commit(&sb[3], "did:plc:bob",   &__verify_alice, 0, 0);
+        __verify_commit(&sb[4], "did:plc:bob",   &__verify_alice, 0, 0);
+        __verify_commit(&sb[5], "did:plc:carol", &__verify_alice, 0, 0);
+        __verify_commit(&sb[6], "did:plc:carol", &__verify_alice, 0, 0);
+
+        TEST_ASSERT_EQUAL(bsky_ec_Ok, bsky_verifier_start(&v));
+        TEST_ASSERT_EQUAL(bsky_ec_Ok, bsky_verifier_set_key(&v, alice,
+                                                            &__verify_alice));
+
+        memset(__verify_results, 0xff, sizeof (__verify_results));
+        __verify_resolved = 0;
+
+        char *dids[7] = {
+            "did:plc:alice", "did:plc:alice", "did:plc:alice",
+            "did:plc:alice", "did:plc:bob", "did:plc:carol", "did:plc:carol",
+        };
+        for (intptr_t i = 0; i < 7; ++i) {
+            TEST_ASSERT_EQUAL(bsky_ec_Ok, bsky_verifier_submit(&v,
+                bsky_mk_str(dids[i]),
+                (struct bsky_view) { sb[i].data, sb[i].data + sb[i].len },
+                (void*) i));
+        }
+        bsky_verifier_wait(&v);
+
+        TEST_ASSERT_EQUAL(bsky_verify_Ok,            __verify_results[0]);
+        TEST_ASSERT_EQUAL(bsky_verify_Bad_signature, __verify_results[1]);
+        TEST_ASSERT_EQUAL(bsky_verify_Bad_signature, __verify_results[2]);
+        TEST_ASSERT_EQUAL(bsky_verify_Invalid,       __verify_results[3]);
+        TEST_ASSERT_EQUAL(bsky_verify_No_key,        __verify_results[4]);
+        TEST_ASSERT_EQUAL(bsky_verify_Ok,            __verify_results[5]);
+        TEST_ASSERT_EQUAL(bsky_verify_Ok,            __verify_results[6]);
+        TEST_ASSERT_EQUAL(1, __verify_resolved);
+        TEST_ASSERT_EQUAL(3, v.verified);
+        TEST_ASSERT_EQUAL(4, v.failed);
+
+        // rotated key fails old signatures.
+        struct bsky_pubkey rotated = { .point = { 3, 9 } };
+        TEST_ASSERT_EQUAL(bsky_ec_Ok, bsky_verifier_set_key(&v, alice,
+                                                            &rotated));
+        bsky_verifier_submit(&v, alice,
+            (struct bsky_view) { sb[0].data, sb[0].data + sb[0].len },
+            (void*) 7);
+        bsky_verifier_wait(&v);
+        TEST_ASSERT_EQUAL(bsky_verify_Bad_signature, __verify_results[7]);
+
+        bsky_verifier_stop(&v);
+        for (int i = 0; i < 7; ++i) bsky_da_free(&sb[i]);
+    }
+
+    static void verify_event(void)
+    {
+        struct bsky_str_builder commit = { 0 }, car = { 0 }, frame = { 0 };
+        struct bsky_firehose_event ev = { 0 };
+        unsigned char root[36]  = { 0x01, 0x71, 0x12, 0x20, 1 };
+        unsigned char other[36] = { 0x01, 0x71, 0x12, 0x20, 2 };
+        struct bsky_verifier v = {
+            .crypto    = { __verify_key_new, __verify_key_free,
+                           __verify_verify },
+            .on_result = __verify_on_result, .workers = 1,
+        };
+
+        __verify_commit(&commit, "did:plc:alice", &__verify_alice, 0, 0);
+
+        struct bsky_view root_view = { root, root + 36 };
+        bsky_car_push_header(&car, &root_view, 1);
+        bsky_car_push_block(&car, (struct bsky_view) { other, other + 36 },
+                            (struct bsky_view) { "\xa0", "\xa0" + 1 });
+        size_t without_root = car.len;
+        bsky_car_push_block(&car, root_view, (struct bsky_view) {
+                            commit.data, commit.data + commit.len });
+
+        bsky_cbor_push_map(&frame, 1);
+        bsky_cbor_push_str(&frame, bsky_mk_str("t"));
+        bsky_cbor_push_str(&frame, bsky_mk_str("#commit"));
+        bsky_cbor_push_map(&frame, 2);
+        bsky_cbor_push_str(&frame, bsky_mk_str("repo"));
+        bsky_cbor_push_str(&frame, bsky_mk_str("did:plc:alice"));
+        bsky_cbor_push_str(&frame, bsky_mk_str("blocks"));
+        bsky_cbor_push_bytes(&frame, (struct bsky_view) {
+                             car.data, car.data + car.len });
+
+        TEST_ASSERT_EQUAL(bsky_ec_Ok, bsky_firehose_decode(&ev,
+            (struct bsky_view) { frame.data, frame.data + frame.len }));
+
+        TEST_ASSERT_EQUAL(bsky_ec_Ok, bsky_verifier_start(&v));
+        bsky_verifier_set_key(&v, bsky_mk_str("did:plc:alice"),
+                              &__verify_alice);
+
+        __verify_results[0] = -1;
+        TEST_ASSERT_EQUAL(bsky_ec_Ok, bsky_verifier_submit_event(&v, &ev,
+                                                                 (void*) 0));
+        bsky_verifier_wait(&v);
+        TEST_ASSERT_EQUAL(bsky_verify_Ok, __verify_results[0]);
+
+        // commit block is missing.
+        ev.blocks.end = (char*) ev.blocks.start + without_root;
+        TEST_ASSERT_EQUAL(bsky_ec_Firehose_invalid,
+                          bsky_verifier_submit_event(&v, &ev, (void*) 0));
+
+        bsky_verifier_stop(&v);
+        bsky_da_free(&ev.ops);
+        bsky_da_free(&commit);
+        bsky_da_free(&car);
+        bsky_da_free(&frame);
+    }
+
+    void run_verify_tests(void)
+    {
+        RUN_TEST(verify_did_key);
+        RUN_TEST(verify_pool);
+        RUN_TEST(verify_event);
+    }
+
+#endif
+
+
+#endif // verify-tests_h_INCLUDED
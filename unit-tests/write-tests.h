@@ -0,0 +1,197 @@
+#ifndef write_tests_h_INCLUDED
+#define write_tests_h_INCLUDED
+
+
+void run_write_tests(void);
+
+
+#ifdef IMPLEMENT_TESTS
+
+    #include "../bsky-api.h"
+
+    struct __write_server {
+        size_t calls, limit;
+        char   last[4096];
+        char   response[4096];
+    };
+
+    static int __write_post(void *user, struct bsky_str repo,
+                            struct bsky_str body, struct bsky_str *response)
+    {
+        struct __write_server *srv = user;
+        struct bsky_str cur = body;
+        enum bsky_error_code ec;
+
+        srv->calls++;
+        snprintf(srv->last, sizeof (srv->last), "%s", body.start);
+
+        struct bsky_json json = bsky_parse_json(&cur, &ec);
+        struct bsky_json *writes = bsky_json_get(&json, "writes");
+
+        if (ec != bsky_ec_Ok || writes == NULL) return 400;
+
+        if (writes->arr.len > srv->limit) {
+            *response = bsky_mk_str("{\"error\":\"InvalidRequest\","
+                                    "\"message\":\"Too many writes\"}");
+            return 400;
+        }
+
+        struct bsky_str_builder sb = { 0 };
+        bsky_sb_push_str(&sb, bsky_mk_str("{\"results\":["));
+        for (size_t i = 0; i < writes->arr.len; ++i) {
+            struct bsky_json *rkey = bsky_json_get(&writes->arr.data[i], "rkey");
+            bsky_sb_push_fmt(&sb, "{\"uri\":\"at://%s/%s\"}%s", repo.start,
+                             rkey ? rkey->str : "-",
+                             i + 1 < writes->arr.len ? "," : "");
+        }
+        bsky_sb_push_str(&sb, bsky_mk_str("]}"));
+
+        snprintf(srv->response, sizeof (srv->response), "%s", sb.data);
+        *response = bsky_mk_str(srv->response);
+        bsky_da_free(&sb);
+
+        return 200;
+    }
+
+    static size_t __write_done_count;
+
+    static void __write_done(void *user, enum bsky_error_code ec,
+                             struct bsky_json *result)
+    {
+        struct bsky_json *uri = result ? bsky_json_get(result, "uri") : NULL;
+
+        TEST_ASSERT_EQUAL(bsky_ec_Ok, ec);
+        TEST_ASSERT(uri != NULL);
+        if (uri != NULL && user != NULL) TEST_ASSERT_EQUAL_STRING(user, uri->str);
+        __write_done_count++;
+    }
+
+    static void write_batch_count(void)
+    {
+        struct __write_server srv = { .limit = 200 };
+        struct bsky_write_batcher b = {
+            .max_writes = 3, .send = __write_post, .user = &srv,
+        };
+        char *rkeys[] = { "a", "b", "c", "d" };
+
+        __write_done_count = 0;
+
+        for (size_t i = 0; i < 4; ++i) {
+            TEST_ASSERT_EQUAL(bsky_ec_Ok, bsky_write_batcher_add(&b,
+                bsky_mk_str("did:plc:me"), (struct bsky_write) {
+                    .op         = bsky_write_Delete,
+                    .collection = "app.bsky.feed.like",
+                    .rkey       = rkeys[i],
+                    .done       = __write_done,
+                }));
+        }
+        TEST_ASSERT_EQUAL(1, srv.calls);
+        TEST_ASSERT_EQUAL(3, __write_done_count);
+        TEST_ASSERT_EQUAL_STRING("{\"repo\":\"did:plc:me\",\"writes\":["
+            "{\"$type\":\"com.atproto.repo.applyWrites#delete\","
+              "\"collection\":\"app.bsky.feed.like\",\"rkey\":\"a\"},"
+            "{\"$type\":\"com.atproto.repo.applyWrites#delete\","
+              "\"collection\":\"app.bsky.feed.like\",\"rkey\":\"b\"},"
+            "{\"$type\":\"com.atproto.repo.applyWrites#delete\","
+              "\"collection\":\"app.bsky.feed.like\",\"rkey\":\"c\"}]}",
+            srv.last);
+
+        TEST_ASSERT_EQUAL(bsky_ec_Ok, bsky_write_batcher_flush(&b));
+        TEST_ASSERT_EQUAL(2, srv.calls);
+        TEST_ASSERT_EQUAL(4, __write_done_count);
+
+        bsky_write_batcher_free(&b);
+    }
+
+    static void write_batch_split(void)
+    {
+        struct __write_server srv = { .limit = 2 };
+        struct bsky_write_batcher b = { .send = __write_post, .user = &srv };
+        struct bsky_json value = {
+            .var = bsky_json_Dct,
+            .dct.len  = 1,
+            .dct.data = (bsky_Json_Pair[]) {
+                { "text", { .var = bsky_json_Str, .str = "hi" } },
+            },
+        };
+
+        __write_done_count = 0;
+
+        for (size_t i = 0; i < 5; ++i) {
+            bsky_write_batcher_add(&b, bsky_mk_str("did:plc:me"),
+                (struct bsky_write) {
+                    .op         = bsky_write_Create,
+                    .collection = "app.bsky.feed.post",
+                    .rkey       = i == 4 ? "last" : NULL,
+                    .value      = value,
+                    .done       = __write_done,
+                    .user       = i == 4 ? "at://did:plc:me/last" : NULL,
+                });
+        }
+
+        TEST_ASSERT_EQUAL(0, srv.calls);
+        TEST_ASSERT_EQUAL(bsky_ec_Ok, bsky_write_batcher_flush(&b));
+        TEST_ASSERT_EQUAL(5, __write_done_count);
+        TEST_ASSERT(b.max_writes <= 2);
+
+        // 5 -> 2 + 3 -> 2 + 1 + 2: three rejected or accepted posts.
+        TEST_ASSERT_EQUAL(5, srv.calls);
+
+        bsky_write_batcher_free(&b);
+    }
+
+    // callback reusing tmp arena, as one doing its own requests would.
+    static int __write_post_tmp(void *user, struct bsky_str repo,
+                                struct bsky_str body, struct bsky_str *response)
+    {
+        bsky_default_tmp_reset();
+        memset(bsky_tmp_alloc(512), 'x', 512);
+
+        return __write_post(user, repo, body, response);
+    }
+
+    static void write_batch_bytes(void)
+    {
+        struct __write_server srv = { .limit = 200 };
+        struct bsky_write_batcher b = {
+            .max_bytes = 200, .send = __write_post_tmp, .user = &srv,
+        };
+        char *rkeys[] = { "first", "second" };
+
+        __write_done_count = 0;
+        bsky_default_tmp_reset();
+
+        // the second write does not fit and waits over the flush.
+        for (size_t i = 0; i < 2; ++i) {
+            TEST_ASSERT_EQUAL(bsky_ec_Ok, bsky_write_batcher_add(&b,
+                bsky_mk_str("did:plc:me"), (struct bsky_write) {
+                    .op         = bsky_write_Delete,
+                    .collection = "app.bsky.feed.like",
+                    .rkey       = rkeys[i],
+                    .done       = __write_done,
+                }));
+        }
+        TEST_ASSERT_EQUAL(1, srv.calls);
+
+        TEST_ASSERT_EQUAL(bsky_ec_Ok, bsky_write_batcher_flush(&b));
+        TEST_ASSERT_EQUAL(2, srv.calls);
+        TEST_ASSERT_EQUAL(2, __write_done_count);
+        TEST_ASSERT_EQUAL_STRING("{\"repo\":\"did:plc:me\",\"writes\":["
+            "{\"$type\":\"com.atproto.repo.applyWrites#delete\","
+              "\"collection\":\"app.bsky.feed.like\",\"rkey\":\"second\"}]}",
+            srv.last);
+
+        bsky_write_batcher_free(&b);
+    }
+
+    void run_write_tests(void)
+    {
+        RUN_TEST(write_batch_count);
+        RUN_TEST(write_batch_split);
+        RUN_TEST(write_batch_bytes);
+    }
+
+#endif
+
+
+#endif // write-tests_h_INCLUDED
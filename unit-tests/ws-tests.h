@@ -0,0 +1,121 @@
+#ifndef ws_tests_h_INCLUDED
+#define ws_tests_h_INCLUDED
+
+
+void run_ws_tests(void);
+
+
+#ifdef IMPLEMENT_TESTS
+
+    #include "../bsky-api.h"
+    #include <sys/socket.h>
+    #include <unistd.h>
+
+    struct __ws_log {
+        char   text[64];
+        int    opcode, messages, close_code;
+    };
+
+    static void __ws_on_message(void *user, enum bsky_ws_opcode opcode,
+                                struct bsky_view message)
+    {
+        struct __ws_log *log = user;
+        size_t len = (char*) message.end - (char*) message.start;
+
+        memcpy(log->text, message.start, len);
+        log->text[len] = '\0';
+        log->opcode = opcode;
+        log->messages++;
+    }
+
+    static void __ws_on_close(void *user, int code)
+    {
+        ((struct __ws_log*) user)->close_code = code;
+    }
+
+    static void ws_accept_key(void)
+    {
+        struct bsky_str accept = bsky_ws_accept_key(
+                                   bsky_mk_str("dGhlIHNhbXBsZSBub25jZQ=="));
+
+        TEST_ASSERT_EQUAL_STRING("s3pPLMBiTxaQ9kYGzzhZRbK+xOo=", accept.start);
+    }
+
+    static void ws_frames(void)
+    {
+        struct __ws_log log = { 0 };
+        struct bsky_ws  ws  = { .fd = -1, .user = &log,
+                                .on_message = __ws_on_message,
+                                .on_close   = __ws_on_close };
+
+        // masked "Hello" from RFC 6455, split between two reads.
+        char masked[] = "\x81\x85\x37\xfa\x21\x3d\x7f\x9f\x4d\x51\x58";
+
+        TEST_ASSERT_EQUAL(bsky_ec_Ok, bsky_ws_feed(&ws, masked, 4));
+        TEST_ASSERT_EQUAL(0, log.messages);
+        TEST_ASSERT_EQUAL(bsky_ec_Ok, bsky_ws_feed(&ws, masked + 4, 7));
+        TEST_ASSERT_EQUAL(1, log.messages);
+        TEST_ASSERT_EQUAL(bsky_ws_Text, log.opcode);
+        TEST_ASSERT_EQUAL_STRING("Hello", log.text);
+
+        // fragmented unmasked binary message "Hel" + "lo".
+        char fragments[] = "\x02\x03Hel\x80\x02lo";
+
+        TEST_ASSERT_EQUAL(bsky_ec_Ok, bsky_ws_feed(&ws, fragments, 9));
+        TEST_ASSERT_EQUAL(2, log.messages);
+        TEST_ASSERT_EQUAL(bsky_ws_Binary, log.opcode);
+        TEST_ASSERT_EQUAL_STRING("Hello", log.text);
+
+        // continuation without first fragment.
+        char bad[] = "\x80\x01x";
+
+        TEST_ASSERT_EQUAL(bsky_ec_Ws_protocol, bsky_ws_feed(&ws, bad, 3));
+        TEST_ASSERT(ws.closed);
+        TEST_ASSERT_EQUAL(1002, log.close_code);
+
+        bsky_ws_free(&ws);
+    }
+
+    static void ws_control(void)
+    {
+        struct __ws_log log = { 0 };
+        struct bsky_ws  ws  = { .user = &log, .on_close = __ws_on_close };
+        unsigned char   frame[16];
+        int fds[2];
+
+        TEST_ASSERT(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+        ws.fd = fds[0];
+
+        char ping[] = "\x89\x02hi";
+        TEST_ASSERT_EQUAL(bsky_ec_Ok, bsky_ws_feed(&ws, ping, 4));
+
+        // pong is masked with echoed payload.
+        TEST_ASSERT_EQUAL(8, read(fds[1], frame, sizeof (frame)));
+        TEST_ASSERT_EQUAL(0x8A, frame[0]);
+        TEST_ASSERT_EQUAL(0x82, frame[1]);
+        bsky_ws_mask(frame + 6, 2, frame + 2);
+        TEST_ASSERT(memcmp(frame + 6, "hi", 2) == 0);
+
+        char close_frame[] = "\x88\x02\x03\xe8";
+        TEST_ASSERT_EQUAL(bsky_ec_Ok, bsky_ws_feed(&ws, close_frame, 4));
+        TEST_ASSERT(ws.closed);
+        TEST_ASSERT_EQUAL(1000, log.close_code);
+
+        TEST_ASSERT_EQUAL(8, read(fds[1], frame, sizeof (frame)));
+        TEST_ASSERT_EQUAL(0x88, frame[0]);
+
+        bsky_ws_free(&ws);
+        close(fds[1]);
+    }
+
+    void run_ws_tests(void)
+    {
+        RUN_TEST(ws_accept_key);
+        RUN_TEST(ws_frames);
+        RUN_TEST(ws_control);
+    }
+
+#endif
+
+
+#endif // ws-tests_h_INCLUDED